@@ -0,0 +1,172 @@
+/*
+* Parallel algorithms on the thread pool
+*
+* Benchmark of the algorithms against the serial standard library versions and the C++17 parallel
+* execution policies where the standard library provides them
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "ParallelAlgorithms.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <numeric>
+#include <random>
+#include <string>
+
+#if (__cplusplus >= 201703L) || (defined(_MSVC_LANG) && (_MSVC_LANG >= 201703L))
+#include <execution>
+#endif
+
+#if defined(__cpp_lib_execution) && defined(__cpp_lib_parallel_algorithm)
+#define VKS_HAS_PARALLEL_POLICIES 1
+#else
+#define VKS_HAS_PARALLEL_POLICIES 0
+#endif
+
+namespace vks
+{
+	namespace parallel
+	{
+		namespace
+		{
+			const int benchmarkRuns = 5;
+
+			/** Best of a few runs in milliseconds, setup runs before every run and is not timed */
+			double measure(const std::function<void()>& setup, const std::function<void()>& run)
+			{
+				double best = 0.0;
+				for (int i = 0; i < benchmarkRuns; i++)
+				{
+					setup();
+					auto start = std::chrono::high_resolution_clock::now();
+					run();
+					double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+					best = (i == 0) ? ms : std::min(best, ms);
+				}
+				return best;
+			}
+
+			void printRow(std::ostream& out, const std::string& name, double serial, double ours, double policy, bool valid)
+			{
+				out << "  " << std::left << std::setw(16) << name << std::right
+					<< std::setw(10) << serial
+					<< std::setw(10) << ours << std::setw(7) << (ours > 0.0 ? serial / ours : 0.0) << "x";
+				if (policy >= 0.0)
+				{
+					out << std::setw(10) << policy << std::setw(7) << (policy > 0.0 ? serial / policy : 0.0) << "x";
+				}
+				else
+				{
+					out << std::setw(18) << "n/a";
+				}
+				out << (valid ? "" : "  MISMATCH") << "\n";
+			}
+		}
+
+		/**
+		* Run every algorithm on elementCount elements and print the best of a few runs for the serial std:: version,
+		* vks::parallel and the std::execution::par version, results of the parallel versions are checked against the serial one
+		*
+		* @param out Stream the table is written to
+		* @param elementCount Number of elements per algorithm
+		*/
+		void benchmark(std::ostream& out, size_t elementCount)
+		{
+			std::mt19937 random(42);
+			std::vector<uint32_t> keys(elementCount);
+			for (auto& key : keys)
+			{
+				key = random();
+			}
+			std::vector<float> values(elementCount);
+			std::vector<float> input(elementCount);
+			std::transform(keys.begin(), keys.end(), input.begin(), [](uint32_t key) { return static_cast<float>(key & 0xffff) / 65535.0f; });
+			std::vector<uint32_t> small(elementCount);
+			std::transform(keys.begin(), keys.end(), small.begin(), [](uint32_t key) { return key & 0xff; });
+			std::vector<uint32_t> scanned(elementCount);
+			std::vector<uint32_t> expected(elementCount);
+			std::vector<uint32_t> sorted(elementCount);
+
+			std::ios_base::fmtflags flags = out.flags();
+			std::streamsize precision = out.precision();
+			out << std::fixed << std::setprecision(2);
+			out << "Parallel algorithms benchmark, " << elementCount << " elements, " << (threadPool().threads.size() + 1) << " threads, best of " << benchmarkRuns << " runs (ms)\n";
+			out << "  " << std::left << std::setw(16) << "algorithm" << std::right << std::setw(10) << "std" << std::setw(18) << "vks::parallel" << std::setw(18) << "execution::par" << "\n";
+
+			auto workload = [](float& value) { value = std::sqrt(value * value + 1.0f) * 0.5f; };
+			auto resetValues = [&] { values = input; };
+			double serial = measure(resetValues, [&] { std::for_each(values.begin(), values.end(), workload); });
+			std::vector<float> reference = values;
+			double ours = measure(resetValues, [&] { forEach(values.begin(), values.end(), workload); });
+			bool valid = (values == reference);
+			double policy = -1.0;
+#if VKS_HAS_PARALLEL_POLICIES
+			policy = measure(resetValues, [&] { std::for_each(std::execution::par, values.begin(), values.end(), workload); });
+#endif
+			printRow(out, "for_each", serial, ours, policy, valid);
+
+			auto operation = [](float value) { return std::sqrt(value) + value * 0.25f; };
+			auto noSetup = [] {};
+			serial = measure(noSetup, [&] { std::transform(input.begin(), input.end(), values.begin(), operation); });
+			reference = values;
+			ours = measure(noSetup, [&] { parallel::transform(input.begin(), input.end(), values.begin(), operation); });
+			valid = (values == reference);
+#if VKS_HAS_PARALLEL_POLICIES
+			policy = measure(noSetup, [&] { std::transform(std::execution::par, input.begin(), input.end(), values.begin(), operation); });
+#endif
+			printRow(out, "transform", serial, ours, policy, valid);
+
+			// Integer sums, so the different association orders give identical results
+			uint64_t serialSum = 0;
+			uint64_t parallelSum = 0;
+			serial = measure(noSetup, [&] { serialSum = std::accumulate(small.begin(), small.end(), uint64_t(0)); });
+			ours = measure(noSetup, [&] { parallelSum = parallel::reduce(small.begin(), small.end(), uint64_t(0)); });
+			valid = (serialSum == parallelSum);
+#if VKS_HAS_PARALLEL_POLICIES
+			policy = measure(noSetup, [&] { parallelSum = std::reduce(std::execution::par, small.begin(), small.end(), uint64_t(0)); });
+#endif
+			printRow(out, "reduce", serial, ours, policy, valid);
+
+			serial = measure(noSetup, [&] { std::partial_sum(small.begin(), small.end(), expected.begin()); });
+			ours = measure(noSetup, [&] { inclusiveScan(small.begin(), small.end(), scanned.begin()); });
+			valid = (scanned == expected);
+#if VKS_HAS_PARALLEL_POLICIES
+			policy = measure(noSetup, [&] { std::inclusive_scan(std::execution::par, small.begin(), small.end(), scanned.begin()); });
+#endif
+			printRow(out, "inclusive_scan", serial, ours, policy, valid);
+
+			serial = measure(noSetup, [&]
+			{
+				uint32_t sum = 0;
+				for (size_t i = 0; i < small.size(); i++)
+				{
+					expected[i] = sum;
+					sum += small[i];
+				}
+			});
+			ours = measure(noSetup, [&] { exclusiveScan(small.begin(), small.end(), scanned.begin(), 0u); });
+			valid = (scanned == expected);
+#if VKS_HAS_PARALLEL_POLICIES
+			policy = measure(noSetup, [&] { std::exclusive_scan(std::execution::par, small.begin(), small.end(), scanned.begin(), 0u); });
+#endif
+			printRow(out, "exclusive_scan", serial, ours, policy, valid);
+
+			auto resetSorted = [&] { sorted = keys; };
+			serial = measure(resetSorted, [&] { std::sort(sorted.begin(), sorted.end()); });
+			expected = sorted;
+			ours = measure(resetSorted, [&] { radixSort(sorted); });
+			valid = (sorted == expected);
+#if VKS_HAS_PARALLEL_POLICIES
+			policy = measure(resetSorted, [&] { std::sort(std::execution::par, sorted.begin(), sorted.end()); });
+#endif
+			printRow(out, "sort (radix)", serial, ours, policy, valid);
+
+			out.flags(flags);
+			out.precision(precision);
+		}
+	}//parallel
+}//vks
@@ -0,0 +1,416 @@
+/*
+* Parallel algorithms on the thread pool
+*
+* Data parallel for_each, transform, reduce, inclusive/exclusive scan and a stable LSD radix sort that split
+* their range into chunks executed on a shared vks::ThreadPool and the calling thread
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "ThreadPool.hpp"
+
+namespace vks
+{
+	namespace parallel
+	{
+		namespace detail
+		{
+			// Smallest number of elements per chunk when no grain is given, below this the dispatch costs more than it saves
+			const size_t minimumGrain = 2048;
+			// Chunks per thread when no grain is given, so uneven chunks still balance
+			const size_t chunksPerThread = 4;
+
+			struct DefaultPool
+			{
+				vks::ThreadPool pool;
+				DefaultPool()
+				{
+					// The calling thread works on the chunks as well
+					pool.setThreadCount(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+				}
+			};
+
+			/** @brief Set while a thread executes chunks of a pool job, nested calls from there run serially */
+			inline bool& insideJob()
+			{
+				static thread_local bool inside = false;
+				return inside;
+			}
+
+			/**
+			* Execute chunk(i) for every i in [0, chunkCount)
+			*
+			* Chunks are claimed through an atomic counter by the calling thread and up to one job per pool thread,
+			* the call returns once all chunks have finished
+			*/
+			template<typename Chunk>
+			void runChunks(vks::ThreadPool& pool, size_t chunkCount, const Chunk& chunk)
+			{
+				const size_t helperCount = std::min(pool.threads.size(), chunkCount - std::min<size_t>(chunkCount, 1));
+				if (helperCount == 0 || insideJob())
+				{
+					for (size_t i = 0; i < chunkCount; i++)
+					{
+						chunk(i);
+					}
+					return;
+				}
+
+				std::atomic<size_t> nextChunk{ 0 };
+				std::mutex mutex;
+				std::condition_variable finished;
+				size_t activeHelpers = helperCount;
+
+				auto work = [&]()
+				{
+					size_t i;
+					while ((i = nextChunk.fetch_add(1)) < chunkCount)
+					{
+						chunk(i);
+					}
+				};
+
+				for (size_t i = 0; i < helperCount; i++)
+				{
+					pool.threads[i]->addJob([&]()
+					{
+						insideJob() = true;
+						work();
+						insideJob() = false;
+						std::lock_guard<std::mutex> lock(mutex);
+						if (--activeHelpers == 0)
+						{
+							finished.notify_one();
+						}
+					});
+				}
+
+				insideJob() = true;
+				work();
+				insideJob() = false;
+
+				std::unique_lock<std::mutex> lock(mutex);
+				finished.wait(lock, [&] { return activeHelpers == 0; });
+			}
+		}//detail
+
+		/** @brief Pool shared by all algorithms, created on first use with one thread less than the hardware threads */
+		inline vks::ThreadPool& threadPool()
+		{
+			static detail::DefaultPool defaultPool;
+			return defaultPool.pool;
+		}
+
+		/** @brief Elements per chunk for a range of the given size, grain 0 selects a size from the thread count */
+		inline size_t chunkSize(size_t count, size_t grain)
+		{
+			if (grain == 0)
+			{
+				size_t chunks = (threadPool().threads.size() + 1) * detail::chunksPerThread;
+				grain = std::max((count + chunks - 1) / chunks, detail::minimumGrain);
+			}
+			return std::max<size_t>(grain, 1);
+		}
+
+		/**
+		* @brief Calls function(chunkBegin, chunkEnd) for consecutive sub ranges of [begin, end) in parallel
+		* @note Must not be called from jobs of the algorithm's thread pool other than through nested algorithm calls
+		*/
+		template<typename Function>
+		void forRange(size_t begin, size_t end, Function function, size_t grain = 0)
+		{
+			if (end <= begin)
+			{
+				return;
+			}
+			const size_t count = end - begin;
+			const size_t size = chunkSize(count, grain);
+			const size_t chunkCount = (count + size - 1) / size;
+			detail::runChunks(threadPool(), chunkCount, [&](size_t chunk)
+			{
+				size_t chunkBegin = begin + chunk * size;
+				function(chunkBegin, std::min(chunkBegin + size, end));
+			});
+		}
+
+		/** @brief Calls function(i) for every index in [begin, end) in parallel */
+		template<typename Function>
+		void forEachIndex(size_t begin, size_t end, Function function, size_t grain = 0)
+		{
+			forRange(begin, end, [&](size_t chunkBegin, size_t chunkEnd)
+			{
+				for (size_t i = chunkBegin; i < chunkEnd; i++)
+				{
+					function(i);
+				}
+			}, grain);
+		}
+
+		/** @brief Calls function(element) for every element of a random access range in parallel */
+		template<typename Iterator, typename Function>
+		void forEach(Iterator first, Iterator last, Function function, size_t grain = 0)
+		{
+			forRange(0, static_cast<size_t>(std::distance(first, last)), [&](size_t chunkBegin, size_t chunkEnd)
+			{
+				std::for_each(first + chunkBegin, first + chunkEnd, function);
+			}, grain);
+		}
+
+		/** @brief Writes operation(element) of every input element to the output range in parallel, returns the end of the output */
+		template<typename InputIterator, typename OutputIterator, typename Operation>
+		OutputIterator transform(InputIterator first, InputIterator last, OutputIterator result, Operation operation, size_t grain = 0)
+		{
+			const size_t count = static_cast<size_t>(std::distance(first, last));
+			forRange(0, count, [&](size_t chunkBegin, size_t chunkEnd)
+			{
+				std::transform(first + chunkBegin, first + chunkEnd, result + chunkBegin, operation);
+			}, grain);
+			return result + count;
+		}
+
+		/**
+		* @brief Combines init and all elements with an associative operation
+		* @note Chunk results are combined in range order, so the operation does not need to be commutative
+		*/
+		template<typename Iterator, typename T, typename Operation>
+		T reduce(Iterator first, Iterator last, T init, Operation operation, size_t grain = 0)
+		{
+			const size_t count = static_cast<size_t>(std::distance(first, last));
+			if (count == 0)
+			{
+				return init;
+			}
+			const size_t size = chunkSize(count, grain);
+			const size_t chunkCount = (count + size - 1) / size;
+			std::vector<std::unique_ptr<T>> partials(chunkCount);
+			detail::runChunks(threadPool(), chunkCount, [&](size_t chunk)
+			{
+				Iterator it = first + chunk * size;
+				Iterator end = first + std::min((chunk + 1) * size, count);
+				T value = *it;
+				for (++it; it != end; ++it)
+				{
+					value = operation(value, *it);
+				}
+				partials[chunk].reset(new T(std::move(value)));
+			});
+
+			T value = init;
+			for (auto& partial : partials)
+			{
+				value = operation(value, *partial);
+			}
+			return value;
+		}
+
+		template<typename Iterator, typename T>
+		T reduce(Iterator first, Iterator last, T init)
+		{
+			return parallel::reduce(first, last, init, [](const T& a, const T& b) { return a + b; });
+		}
+
+		namespace detail
+		{
+			/**
+			* Three pass chunked scan: reduce every chunk, scan the chunk sums serially and scan every chunk
+			* starting from its offset. Works in place (result == first)
+			*/
+			template<typename InputIterator, typename OutputIterator, typename T, typename Operation>
+			OutputIterator scan(InputIterator first, InputIterator last, OutputIterator result, T init, Operation operation, bool inclusive, size_t grain)
+			{
+				const size_t count = static_cast<size_t>(std::distance(first, last));
+				if (count == 0)
+				{
+					return result;
+				}
+				const size_t size = chunkSize(count, grain);
+				const size_t chunkCount = (count + size - 1) / size;
+
+				std::vector<T> offsets(chunkCount, init);
+				if (chunkCount > 1)
+				{
+					std::vector<std::unique_ptr<T>> sums(chunkCount);
+					// The last chunk's sum is never needed
+					detail::runChunks(threadPool(), chunkCount - 1, [&](size_t chunk)
+					{
+						InputIterator it = first + chunk * size;
+						InputIterator end = it + size;
+						T value = *it;
+						for (++it; it != end; ++it)
+						{
+							value = operation(value, *it);
+						}
+						sums[chunk].reset(new T(std::move(value)));
+					});
+					for (size_t i = 1; i < chunkCount; i++)
+					{
+						offsets[i] = operation(offsets[i - 1], *sums[i - 1]);
+					}
+				}
+
+				detail::runChunks(threadPool(), chunkCount, [&](size_t chunk)
+				{
+					const size_t begin = chunk * size;
+					const size_t end = std::min(begin + size, count);
+					T value = offsets[chunk];
+					for (size_t i = begin; i < end; i++)
+					{
+						if (inclusive)
+						{
+							value = operation(value, first[i]);
+							result[i] = value;
+						}
+						else
+						{
+							T element = first[i];
+							result[i] = value;
+							value = operation(value, element);
+						}
+					}
+				});
+				return result + count;
+			}
+		}//detail
+
+		/** @brief result[i] = init op first[0] op ... op first[i], in parallel and in place if result == first */
+		template<typename InputIterator, typename OutputIterator, typename T, typename Operation>
+		OutputIterator inclusiveScan(InputIterator first, InputIterator last, OutputIterator result, T init, Operation operation, size_t grain = 0)
+		{
+			return detail::scan(first, last, result, init, operation, true, grain);
+		}
+
+		template<typename InputIterator, typename OutputIterator>
+		OutputIterator inclusiveScan(InputIterator first, InputIterator last, OutputIterator result)
+		{
+			typedef typename std::iterator_traits<InputIterator>::value_type T;
+			return detail::scan(first, last, result, T(), [](const T& a, const T& b) { return a + b; }, true, 0);
+		}
+
+		/** @brief result[i] = init op first[0] op ... op first[i - 1], in parallel and in place if result == first */
+		template<typename InputIterator, typename OutputIterator, typename T, typename Operation>
+		OutputIterator exclusiveScan(InputIterator first, InputIterator last, OutputIterator result, T init, Operation operation, size_t grain = 0)
+		{
+			return detail::scan(first, last, result, init, operation, false, grain);
+		}
+
+		template<typename InputIterator, typename OutputIterator, typename T>
+		OutputIterator exclusiveScan(InputIterator first, InputIterator last, OutputIterator result, T init)
+		{
+			return detail::scan(first, last, result, init, [](const T& a, const T& b) { return a + b; }, false, 0);
+		}
+
+		/**
+		* @brief Stable LSD radix sort of values by an unsigned integer key, 8 bits per pass
+		*
+		* Every pass builds per chunk digit histograms in parallel, turns them into per chunk output offsets and
+		* scatters the chunks in parallel. Passes in which all keys share the digit are skipped, so keys that only
+		* use their low bits are cheap to sort
+		*
+		* @param values Values to sort, T must be default constructible and movable
+		* @param key Function returning the unsigned integer key of a value, e.g. a 64 bit draw sort key
+		*/
+		template<typename T, typename KeyFunction>
+		void radixSort(std::vector<T>& values, KeyFunction key, size_t grain = 0)
+		{
+			typedef typename std::decay<decltype(key(values[0]))>::type Key;
+			static_assert(std::is_unsigned<Key>::value, "radixSort needs an unsigned integer key");
+			const size_t radixBits = 8;
+			const size_t radix = size_t(1) << radixBits;
+			const size_t passCount = sizeof(Key) * 8 / radixBits;
+
+			const size_t count = values.size();
+			if (count < 2)
+			{
+				return;
+			}
+			const size_t size = chunkSize(count, grain);
+			const size_t chunkCount = (count + size - 1) / size;
+
+			std::vector<T> buffer(count);
+			std::vector<size_t> histograms(chunkCount * radix);
+			std::vector<T>* source = &values;
+			std::vector<T>* target = &buffer;
+
+			for (size_t pass = 0; pass < passCount; pass++)
+			{
+				const size_t shift = pass * radixBits;
+				std::fill(histograms.begin(), histograms.end(), 0);
+				detail::runChunks(threadPool(), chunkCount, [&](size_t chunk)
+				{
+					size_t* histogram = &histograms[chunk * radix];
+					const size_t end = std::min((chunk + 1) * size, count);
+					for (size_t i = chunk * size; i < end; i++)
+					{
+						histogram[(key((*source)[i]) >> shift) & (radix - 1)]++;
+					}
+				});
+
+				// Turn the counts into output offsets, digit major so equal digits keep their chunk order
+				size_t offset = 0;
+				bool singleDigit = false;
+				for (size_t digit = 0; digit < radix; digit++)
+				{
+					size_t digitStart = offset;
+					for (size_t chunk = 0; chunk < chunkCount; chunk++)
+					{
+						size_t digitCount = histograms[chunk * radix + digit];
+						histograms[chunk * radix + digit] = offset;
+						offset += digitCount;
+					}
+					if (offset - digitStart == count)
+					{
+						singleDigit = true;
+					}
+				}
+				if (singleDigit)
+				{
+					continue;
+				}
+
+				detail::runChunks(threadPool(), chunkCount, [&](size_t chunk)
+				{
+					size_t* offsets = &histograms[chunk * radix];
+					const size_t end = std::min((chunk + 1) * size, count);
+					for (size_t i = chunk * size; i < end; i++)
+					{
+						T& value = (*source)[i];
+						(*target)[offsets[(key(value) >> shift) & (radix - 1)]++] = std::move(value);
+					}
+				});
+				std::swap(source, target);
+			}
+
+			if (source != &values)
+			{
+				values.swap(buffer);
+			}
+		}
+
+		/** @brief Sorts unsigned integers in ascending order */
+		template<typename T>
+		void radixSort(std::vector<T>& values)
+		{
+			radixSort(values, [](const T& value) { return value; });
+		}
+
+		/**
+		* @brief Times the algorithms against their serial std:: counterparts and, where the standard library provides them,
+		* the C++17 parallel execution policies, and prints a table
+		*/
+		void benchmark(std::ostream& out, size_t elementCount = size_t(1) << 22);
+	}//parallel
+}//vks
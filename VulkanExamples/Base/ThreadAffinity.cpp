@@ -0,0 +1,463 @@
+/*
+* Thread placement
+*
+* Topology queries and thread placement for Windows (processor groups, SetThreadGroupAffinity, VirtualAllocExNuma)
+* and Linux / Android (sysfs, sched_setaffinity, first touch allocation). Other platforms only support naming
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "ThreadAffinity.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+#include "VulkanTools.h"
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+namespace vks
+{
+	namespace threading
+	{
+		namespace
+		{
+			// Highest NUMA node number probed in sysfs
+			const uint32_t maxNumaNodes = 256;
+			// Nice values used for the priority classes, raising above 0 needs CAP_SYS_NICE
+			const int frameCriticalNice = -5;
+			const int backgroundNice = 10;
+
+#if defined(__linux__)
+			bool readNumber(const std::string& fileName, uint32_t& value)
+			{
+				std::ifstream file(fileName);
+				return static_cast<bool>(file >> value);
+			}
+
+			/** Parses a sysfs cpu list like "0-3,8,10-11" */
+			std::vector<uint32_t> readProcessorList(const std::string& fileName)
+			{
+				std::vector<uint32_t> list;
+				std::ifstream file(fileName);
+				std::string text;
+				if (!std::getline(file, text))
+				{
+					return list;
+				}
+				std::stringstream stream(text);
+				std::string range;
+				while (std::getline(stream, range, ','))
+				{
+					if (range.empty())
+					{
+						continue;
+					}
+					size_t dash = range.find('-');
+					uint32_t first = static_cast<uint32_t>(std::stoul(range.substr(0, dash)));
+					uint32_t last = (dash == std::string::npos) ? first : static_cast<uint32_t>(std::stoul(range.substr(dash + 1)));
+					for (uint32_t i = first; i <= last; i++)
+					{
+						list.push_back(i);
+					}
+				}
+				return list;
+			}
+#endif
+
+			Topology queryTopology()
+			{
+				Topology topology;
+#if defined(_WIN32)
+				DWORD length = 0;
+				GetLogicalProcessorInformationEx(RelationAll, nullptr, &length);
+				std::vector<uint8_t> buffer(length);
+				if (length > 0 && GetLogicalProcessorInformationEx(RelationAll, reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data()), &length))
+				{
+					std::vector<std::pair<uint32_t, GROUP_AFFINITY>> nodeMasks;
+					for (DWORD offset = 0; offset < length;)
+					{
+						auto info = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data() + offset);
+						if (info->Relationship == RelationProcessorCore)
+						{
+							uint32_t core = static_cast<uint32_t>(topology.cores.size());
+							topology.cores.emplace_back();
+							for (WORD group = 0; group < info->Processor.GroupCount; group++)
+							{
+								const GROUP_AFFINITY& affinity = info->Processor.GroupMask[group];
+								for (uint32_t bit = 0; bit < sizeof(KAFFINITY) * 8; bit++)
+								{
+									if (affinity.Mask & (KAFFINITY(1) << bit))
+									{
+										LogicalProcessor processor;
+										processor.number = bit;
+										processor.group = affinity.Group;
+										processor.core = core;
+										topology.cores.back().push_back(static_cast<uint32_t>(topology.processors.size()));
+										topology.processors.push_back(processor);
+									}
+								}
+							}
+						}
+						else if (info->Relationship == RelationNumaNode)
+						{
+							nodeMasks.push_back(std::make_pair(static_cast<uint32_t>(info->NumaNode.NodeNumber), info->NumaNode.GroupMask));
+						}
+						offset += info->Size;
+					}//for
+
+					for (auto& nodeMask : nodeMasks)
+					{
+						topology.numaNodes.push_back(nodeMask.first);
+						for (auto& processor : topology.processors)
+						{
+							if (processor.group == nodeMask.second.Group && (nodeMask.second.Mask & (KAFFINITY(1) << processor.number)))
+							{
+								processor.numaNode = nodeMask.first;
+							}
+						}
+					}
+				}
+#elif defined(__linux__)
+				// Only processors the process may run on, e.g. inside a container or under taskset
+				cpu_set_t allowed;
+				CPU_ZERO(&allowed);
+				if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+				{
+					std::map<std::pair<uint32_t, uint32_t>, uint32_t> coreIndices;
+					for (uint32_t cpu = 0; cpu < CPU_SETSIZE; cpu++)
+					{
+						if (!CPU_ISSET(cpu, &allowed))
+						{
+							continue;
+						}
+						const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+						uint32_t package = 0;
+						uint32_t coreId = cpu;
+						readNumber(path + "physical_package_id", package);
+						readNumber(path + "core_id", coreId);
+
+						auto key = std::make_pair(package, coreId);
+						auto it = coreIndices.find(key);
+						if (it == coreIndices.end())
+						{
+							it = coreIndices.insert(std::make_pair(key, static_cast<uint32_t>(topology.cores.size()))).first;
+							topology.cores.emplace_back();
+						}
+
+						LogicalProcessor processor;
+						processor.number = cpu;
+						processor.core = it->second;
+						topology.cores[it->second].push_back(static_cast<uint32_t>(topology.processors.size()));
+						topology.processors.push_back(processor);
+					}//for cpu
+
+					for (uint32_t node = 0; node < maxNumaNodes; node++)
+					{
+						std::vector<uint32_t> cpus = readProcessorList("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+						if (cpus.empty())
+						{
+							continue;
+						}
+						topology.numaNodes.push_back(node);
+						for (auto& processor : topology.processors)
+						{
+							if (std::find(cpus.begin(), cpus.end(), processor.number) != cpus.end())
+							{
+								processor.numaNode = node;
+							}
+						}
+					}
+				}
+#endif
+				// Platforms without a topology query get one core per hardware thread on a single node
+				if (topology.processors.empty())
+				{
+					uint32_t count = std::max(std::thread::hardware_concurrency(), 1u);
+					for (uint32_t i = 0; i < count; i++)
+					{
+						LogicalProcessor processor;
+						processor.number = i;
+						processor.core = i;
+						topology.processors.push_back(processor);
+						topology.cores.push_back({ i });
+					}
+				}
+				if (topology.numaNodes.empty())
+				{
+					topology.numaNodes.push_back(0);
+				}
+				return topology;
+			}
+		}
+
+		std::vector<uint32_t> Topology::processorsOfNode(uint32_t numaNode) const
+		{
+			std::vector<uint32_t> indices;
+			for (uint32_t i = 0; i < static_cast<uint32_t>(processors.size()); i++)
+			{
+				if (processors[i].numaNode == numaNode)
+				{
+					indices.push_back(i);
+				}
+			}
+			return indices;
+		}
+
+		const Topology& topology()
+		{
+			static const Topology cpus = queryTopology();
+			return cpus;
+		}
+
+		bool pinCurrentThread(const std::vector<uint32_t>& processors)
+		{
+			const Topology& cpus = topology();
+			if (processors.empty())
+			{
+				return false;
+			}
+#if defined(_WIN32)
+			// A thread can only be pinned within one processor group, processors of other groups are ignored
+			GROUP_AFFINITY affinity = {};
+			affinity.Group = cpus.processors[processors[0]].group;
+			for (uint32_t index : processors)
+			{
+				if (cpus.processors[index].group == affinity.Group)
+				{
+					affinity.Mask |= KAFFINITY(1) << cpus.processors[index].number;
+				}
+			}
+			return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+#elif defined(__linux__)
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			for (uint32_t index : processors)
+			{
+				CPU_SET(cpus.processors[index].number, &set);
+			}
+			// Thread id 0 is the calling thread
+			return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+			// No thread affinity API (e.g. macOS / iOS only have affinity hints)
+			(void)cpus;
+			return false;
+#endif
+		}
+
+		bool setCurrentThreadName(const std::string& name)
+		{
+#if defined(_WIN32)
+			// SetThreadDescription is only available since Windows 10 1607, so it is looked up at runtime
+			typedef HRESULT(WINAPI* SetThreadDescriptionFunction)(HANDLE, PCWSTR);
+			static const SetThreadDescriptionFunction setThreadDescription =
+				reinterpret_cast<SetThreadDescriptionFunction>(GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "SetThreadDescription"));
+			if (!setThreadDescription)
+			{
+				return false;
+			}
+			std::wstring wideName(name.begin(), name.end());
+			return SUCCEEDED(setThreadDescription(GetCurrentThread(), wideName.c_str()));
+#elif defined(__APPLE__)
+			return pthread_setname_np(name.c_str()) == 0;
+#else
+			// Linux limits names to 15 characters plus the terminator
+			return pthread_setname_np(pthread_self(), name.substr(0, 15).c_str()) == 0;
+#endif
+		}
+
+		bool setCurrentThreadPriority(Priority priority)
+		{
+#if defined(_WIN32)
+			int value = THREAD_PRIORITY_NORMAL;
+			switch (priority)
+			{
+			case Priority::FrameCritical: value = THREAD_PRIORITY_ABOVE_NORMAL; break;
+			case Priority::Background: value = THREAD_PRIORITY_BELOW_NORMAL; break;
+			default: break;
+			}
+			return SetThreadPriority(GetCurrentThread(), value) != 0;
+#elif defined(__linux__)
+			int nice = 0;
+			switch (priority)
+			{
+			case Priority::FrameCritical: nice = frameCriticalNice; break;
+			case Priority::Background: nice = backgroundNice; break;
+			default: break;
+			}
+			// On Linux the nice value is per thread when set for the thread id
+			return setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), nice) == 0;
+#else
+			(void)priority;
+			(void)frameCriticalNice;
+			(void)backgroundNice;
+			return false;
+#endif
+		}
+
+		uint32_t currentNumaNode()
+		{
+#if defined(_WIN32)
+			PROCESSOR_NUMBER processor;
+			GetCurrentProcessorNumberEx(&processor);
+			USHORT node = 0;
+			if (GetNumaProcessorNodeEx(&processor, &node))
+			{
+				return node;
+			}
+#elif defined(__linux__)
+			int cpu = sched_getcpu();
+			for (auto& processor : topology().processors)
+			{
+				if (static_cast<int>(processor.number) == cpu)
+				{
+					return processor.numaNode;
+				}
+			}
+#endif
+			return topology().numaNodes[0];
+		}
+
+		bool applyPlacement(const ThreadPlacement& placement, uint32_t index)
+		{
+			bool applied = true;
+			if (placement.pinning == Pinning::PerCore)
+			{
+				const Topology& cpus = topology();
+				// Reserved cores are skipped unless nothing would be left
+				const uint32_t coreCount = static_cast<uint32_t>(cpus.cores.size());
+				const uint32_t reserved = (placement.reservedCores < coreCount) ? placement.reservedCores : 0;
+				applied = pinCurrentThread(cpus.cores[reserved + index % (coreCount - reserved)]) && applied;
+			}
+			else if (placement.pinning == Pinning::PerNumaNode)
+			{
+				const Topology& cpus = topology();
+				const uint32_t node = cpus.numaNodes[index % cpus.numaNodes.size()];
+				applied = pinCurrentThread(cpus.processorsOfNode(node)) && applied;
+			}
+#if defined(__linux__)
+			else
+			{
+				// Linux threads inherit the affinity of the thread that created them, so an unpinned thread started
+				// from a pinned one (e.g. the render thread) is given back all processors of the process
+				const Topology& cpus = topology();
+				std::vector<uint32_t> all(cpus.processors.size());
+				for (uint32_t i = 0; i < static_cast<uint32_t>(all.size()); i++)
+				{
+					all[i] = i;
+				}
+				pinCurrentThread(all);
+			}
+#endif
+			// Normal priority is set as well because Linux threads also inherit the nice value of their creator
+			const bool prioritySet = setCurrentThreadPriority(placement.priority);
+			applied = (prioritySet || placement.priority == Priority::Normal) && applied;
+			if (!placement.name.empty())
+			{
+				applied = setCurrentThreadName(placement.name) && applied;
+			}
+			return applied;
+		}
+
+		const char* toString(Pinning pinning)
+		{
+			switch (pinning)
+			{
+			case Pinning::PerCore: return "core";
+			case Pinning::PerNumaNode: return "node";
+			default: return "none";
+			}
+		}
+
+		bool parsePinning(const std::string& value, Pinning& pinning)
+		{
+			if (value == "none")
+			{
+				pinning = Pinning::None;
+			}
+			else if (value == "core")
+			{
+				pinning = Pinning::PerCore;
+			}
+			else if (value == "node")
+			{
+				pinning = Pinning::PerNumaNode;
+			}
+			else
+			{
+				return false;
+			}
+			return true;
+		}
+
+		ScratchMemory::~ScratchMemory()
+		{
+			release();
+		}
+
+		/**
+		* Allocate page aligned memory on a NUMA node, replaces a previous allocation
+		*
+		* @param size Size in bytes
+		* @param numaNode Preferred node, on platforms without an explicit node allocation the memory ends up on the node of the calling thread
+		*/
+		void ScratchMemory::allocate(size_t size, uint32_t numaNode)
+		{
+			release();
+			if (size == 0)
+			{
+				return;
+			}
+#if defined(_WIN32)
+			memory = VirtualAllocExNuma(GetCurrentProcess(), nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, numaNode);
+			if (!memory)
+			{
+				memory = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+			}
+#else
+			(void)numaNode;
+			void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (mapping != MAP_FAILED)
+			{
+				memory = mapping;
+				// Fault in every page now, so the first touch happens on this thread
+				memset(memory, 0, size);
+			}
+#endif
+			if (!memory)
+			{
+				vks::tools::exitFatal("Could not allocate " + std::to_string(size) + " bytes of thread scratch memory", -1);
+			}
+			bytes = size;
+		}
+
+		void ScratchMemory::release()
+		{
+			if (!memory)
+			{
+				return;
+			}
+#if defined(_WIN32)
+			VirtualFree(memory, 0, MEM_RELEASE);
+#else
+			munmap(memory, bytes);
+#endif
+			memory = nullptr;
+			bytes = 0;
+		}
+	}//threading
+}//vks
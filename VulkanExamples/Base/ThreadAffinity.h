@@ -0,0 +1,122 @@
+/*
+* Thread placement
+*
+* Processor topology (physical cores, NUMA nodes), pinning of threads to cores or NUMA nodes, thread naming for
+* profilers and debuggers, thread priority classes and NUMA local scratch memory for worker threads
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vks
+{
+	namespace threading
+	{
+		struct LogicalProcessor
+		{
+			/** @brief Operating system processor number, within its processor group on Windows */
+			uint32_t number = 0;
+			/** @brief Windows processor group, always 0 on other platforms */
+			uint16_t group = 0;
+			/** @brief Index into Topology::cores */
+			uint32_t core = 0;
+			/** @brief Operating system NUMA node number */
+			uint32_t numaNode = 0;
+		};
+
+		struct Topology
+		{
+			std::vector<LogicalProcessor> processors;
+			/** @brief Indices into processors per physical core, SMT siblings share a core */
+			std::vector<std::vector<uint32_t>> cores;
+			/** @brief NUMA node numbers present on the system */
+			std::vector<uint32_t> numaNodes;
+
+			/** @brief Indices into processors of all processors of a NUMA node */
+			std::vector<uint32_t> processorsOfNode(uint32_t numaNode) const;
+		};
+
+		/** @brief Topology of the processors the process may run on, queried once */
+		const Topology& topology();
+
+		enum class Pinning
+		{
+			/** @brief Threads may migrate freely, the default of the operating system */
+			None,
+			/** @brief Each thread is pinned to one physical core (all of its SMT siblings) */
+			PerCore,
+			/** @brief Each thread is pinned to all processors of one NUMA node, workers are distributed round robin */
+			PerNumaNode
+		};
+
+		enum class Priority
+		{
+			/** @brief Work the current frame waits for, e.g. the render thread and frame job workers */
+			FrameCritical,
+			Normal,
+			/** @brief Work that must not delay frames, e.g. streaming and asset loading */
+			Background
+		};
+
+		/** @brief Placement of a thread, applied by the thread itself */
+		struct ThreadPlacement
+		{
+			Pinning pinning = Pinning::None;
+			Priority priority = Priority::Normal;
+			/** @brief Thread name, the thread pool appends the worker index. Empty keeps the name assigned by the system */
+			std::string name;
+			/** @brief Physical cores at the start of the topology that per core pinning leaves to other threads (e.g. the render thread) */
+			uint32_t reservedCores = 0;
+			/** @brief Size of the NUMA local scratch memory each worker allocates, 0 for none */
+			size_t scratchSize = 0;
+		};
+
+		/** @brief Pins the calling thread to the given indices into Topology::processors, returns false if unsupported */
+		bool pinCurrentThread(const std::vector<uint32_t>& processors);
+		/** @brief Names the calling thread, names longer than the platform limit are truncated */
+		bool setCurrentThreadName(const std::string& name);
+		/** @brief Raising the priority above normal may need elevated rights on some platforms, returns false if it failed */
+		bool setCurrentThreadPriority(Priority priority);
+		/** @brief NUMA node of the processor the calling thread currently runs on */
+		uint32_t currentNumaNode();
+		/**
+		* @brief Applies pinning, priority and name for the thread with the given index
+		* @return False if any part of the placement could not be applied, the other parts are still applied
+		*/
+		bool applyPlacement(const ThreadPlacement& placement, uint32_t index);
+
+		const char* toString(Pinning pinning);
+		/** @brief Parses "none", "core" or "node", returns false for anything else */
+		bool parsePinning(const std::string& value, Pinning& pinning);
+
+		/**
+		* @brief Page aligned memory allocated on a NUMA node
+		* @note On platforms without an explicit NUMA allocation the pages are touched on allocation, so a pinned thread
+		* that allocates the memory gets it on its own node through the first touch policy
+		*/
+		class ScratchMemory
+		{
+		public:
+			ScratchMemory() = default;
+			ScratchMemory(const ScratchMemory&) = delete;
+			ScratchMemory& operator=(const ScratchMemory&) = delete;
+			~ScratchMemory();
+
+			void allocate(size_t size, uint32_t numaNode);
+			void release();
+
+			void* data() const { return memory; }
+			size_t size() const { return bytes; }
+
+		private:
+			void* memory = nullptr;
+			size_t bytes = 0;
+		};
+	}//threading
+}//vks
@@ -14,6 +14,9 @@
 #include <mutex>
 #include <condition_variable>
 #include <functional>
+#include <string>
+
+#include "ThreadAffinity.h"
 
 // make_unique is not available in C++11
 // Taken from Herb Sutter's blog(https://herbsutter.com/gotw/_102/)
@@ -29,6 +32,9 @@ namespace vks
 	{
 	private:
 		bool destroying = false;
+		threading::ThreadPlacement placement;
+		threading::ScratchMemory scratchMemory;
+		uint32_t index = 0;
 
 		std::thread worker;
 		std::queue<std::function<void()>> jobQueue;
@@ -38,6 +44,14 @@ namespace vks
 		// Loop through all remaining jobs
 		void queueLoop()
 		{
+			// Placement is applied by the worker itself, so the scratch memory is allocated after pinning on the worker's node
+			threading::applyPlacement(placement, index);
+			if (placement.scratchSize > 0)
+			{
+				scratchMemory.allocate(placement.scratchSize, threading::currentNumaNode());
+				scratch() = &scratchMemory;
+			}
+
 			while (true)
 			{
 				std::function<void()>job;
@@ -67,6 +81,16 @@ namespace vks
 			worker = std::thread(&Thread::queueLoop, this);
 		}
 
+		// Worker with the given index of a pool, the index is appended to the name and selects the core or node it is pinned to
+		Thread(const threading::ThreadPlacement& placement, uint32_t index) : placement(placement), index(index)
+		{
+			if (!this->placement.name.empty())
+			{
+				this->placement.name += " " + std::to_string(index);
+			}
+			worker = std::thread(&Thread::queueLoop, this);
+		}
+
 		~Thread()
 		{
 			if (worker.joinable())
@@ -94,6 +118,13 @@ namespace vks
 			std::unique_lock<std::mutex> lock(queueMutex);
 			condition.wait(lock, [this]() { return jobQueue.empty(); });
 		}
+
+		// NUMA local scratch memory of the worker running the calling job, nullptr outside of workers or without a scratch size
+		static threading::ScratchMemory*& scratch()
+		{
+			static thread_local threading::ScratchMemory* memory = nullptr;
+			return memory;
+		}
 	};
 
 	class ThreadPool
@@ -101,13 +132,14 @@ namespace vks
 	public:
 		std::vector<std::unique_ptr<Thread>> threads;
 
-		// Sets the number of threads to be allocated in this pool
-		void setThreadCount(uint32_t count)
+		// Sets the number of threads to be allocated in this pool, every worker applies the placement
+		// (pinning, priority class, name and scratch memory) before it runs its first job
+		void setThreadCount(uint32_t count, const threading::ThreadPlacement& placement = threading::ThreadPlacement())
 		{
 			threads.clear();
 			for (uint32_t i = 0; i < count; i++)
 			{
-				threads.push_back(make_unique<Thread>());
+				threads.push_back(make_unique<Thread>(placement, i));
 			}
 		}
 
@@ -10,6 +10,8 @@
 
 #include "VulkanBuffer.h"
 
+#include <algorithm>
+
 namespace vks
 {	
 	/** 
@@ -131,4 +133,114 @@ namespace vks
 		}
 	}
 
+	/**
+	* Set up the tracker for a device
+	*
+	* @param device Device the memory objects belong to
+	* @param nonCoherentAtomSize Flush granularity from the device limits
+	*/
+	void MappedRangeTracker::create(VkDevice device, VkDeviceSize nonCoherentAtomSize)
+	{
+		this->device = device;
+		atomSize = std::max<VkDeviceSize>(nonCoherentAtomSize, 1);
+		ranges.clear();
+		counters = Statistics();
+	}
+
+	/**
+	* Record a dirty range of a memory object
+	*
+	* @param memory Memory object the range belongs to
+	* @param memorySize Size of the memory object, used to keep widened ranges inside it
+	* @param offset Byte offset of the range from the start of the memory object
+	* @param size Size of the range, VK_WHOLE_SIZE for everything from offset to the end
+	*/
+	void MappedRangeTracker::add(VkDeviceMemory memory, VkDeviceSize memorySize, VkDeviceSize offset, VkDeviceSize size)
+	{
+		if ((memory == VK_NULL_HANDLE) || (size == 0))
+		{
+			return;
+		}
+		Range range;
+		range.memory = memory;
+		range.begin = (offset / atomSize) * atomSize;
+		range.end = VK_WHOLE_SIZE;
+		if (size != VK_WHOLE_SIZE)
+		{
+			VkDeviceSize end = ((offset + size + atomSize - 1) / atomSize) * atomSize;
+			if (end <= memorySize)
+			{
+				range.end = end;
+			}
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		ranges.push_back(range);
+		counters.addedRanges++;
+	}
+
+	void MappedRangeTracker::add(const Buffer& buffer, VkDeviceSize size, VkDeviceSize offset)
+	{
+		if ((buffer.memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0)
+		{
+			add(buffer.deviceMemory, buffer.size, offset, size);
+		}
+	}
+
+	VkResult MappedRangeTracker::flush()
+	{
+		return submit(true);
+	}
+
+	VkResult MappedRangeTracker::invalidate()
+	{
+		return submit(false);
+	}
+
+	/**
+	* Sort the recorded ranges, merge overlapping and adjacent ranges of the same memory object and pass them to the driver in one call
+	*/
+	VkResult MappedRangeTracker::submit(bool flush)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (ranges.empty())
+		{
+			return VK_SUCCESS;
+		}
+		std::sort(ranges.begin(), ranges.end(), [](const Range& a, const Range& b)
+		{
+			return (a.memory != b.memory) ? (a.memory < b.memory) : (a.begin < b.begin);
+		});
+		mappedRanges.clear();
+		Range current = ranges[0];
+		for (size_t i = 1; i <= ranges.size(); i++)
+		{
+			if ((i < ranges.size()) && (ranges[i].memory == current.memory) && (ranges[i].begin <= current.end))
+			{
+				current.end = std::max(current.end, ranges[i].end);
+				continue;
+			}
+			VkMappedMemoryRange mappedRange = {};
+			mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+			mappedRange.memory = current.memory;
+			mappedRange.offset = current.begin;
+			mappedRange.size = (current.end == VK_WHOLE_SIZE) ? VK_WHOLE_SIZE : current.end - current.begin;
+			mappedRanges.push_back(mappedRange);
+			if (i < ranges.size())
+			{
+				current = ranges[i];
+			}
+		}
+		ranges.clear();
+		counters.submittedRanges += mappedRanges.size();
+		counters.calls++;
+		uint32_t count = static_cast<uint32_t>(mappedRanges.size());
+		return flush ? vkFlushMappedMemoryRanges(device, count, mappedRanges.data()) : vkInvalidateMappedMemoryRanges(device, count, mappedRanges.data());
+	}
+
+	MappedRangeTracker::Statistics MappedRangeTracker::statistics()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return counters;
+	}
+
 }// namespace vks
@@ -11,6 +11,7 @@
 #pragma once
 
 
+#include <mutex>
 #include <vector>
 #include "vulkan/vulkan.h"
 #include "VulkanTools.h"
@@ -52,4 +53,54 @@ namespace vks
 		void destroy();
 	};
 
+	/**
+	* @brief Collects dirty ranges of non coherent mapped memory and flushes (or invalidates) them with a single call
+	* @note Ranges are widened to nonCoherentAtomSize and coalesced per memory object. A range reaching into the last, partial atom
+	* is extended to the end of the memory object, which therefore has to be mapped to its end
+	*/
+	class MappedRangeTracker
+	{
+	public:
+		struct Statistics
+		{
+			/** @brief Ranges passed to add */
+			uint64_t addedRanges = 0;
+			/** @brief Ranges left after coalescing and passed to the driver */
+			uint64_t submittedRanges = 0;
+			uint64_t calls = 0;
+		};
+
+		void create(VkDevice device, VkDeviceSize nonCoherentAtomSize);
+
+		/** @brief Record a dirty range, memorySize is the size of the memory object (or of the part mapped from offset 0) */
+		void add(VkDeviceMemory memory, VkDeviceSize memorySize, VkDeviceSize offset, VkDeviceSize size);
+		/** @brief Record a dirty range of a buffer bound at the start of its memory, ignored for host coherent memory */
+		void add(const Buffer& buffer, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+
+		/** @brief Make host writes to all recorded ranges visible to the device and clear them */
+		VkResult flush();
+		/** @brief Make device writes to all recorded ranges visible to the host and clear them */
+		VkResult invalidate();
+
+		Statistics statistics();
+
+	private:
+		struct Range
+		{
+			VkDeviceMemory memory;
+			VkDeviceSize begin;
+			/** @brief VK_WHOLE_SIZE for ranges that extend to the end of the memory object */
+			VkDeviceSize end;
+		};
+
+		VkDevice device = VK_NULL_HANDLE;
+		VkDeviceSize atomSize = 1;
+		std::mutex mutex;
+		std::vector<Range> ranges;
+		std::vector<VkMappedMemoryRange> mappedRanges;
+		Statistics counters;
+
+		VkResult submit(bool flush);
+	};
+
 }//vks
\ No newline at end of file
@@ -0,0 +1,1052 @@
+/*
+* Cascaded shadow maps
+*
+* Practical split scheme with texel snapped, rotation invariant cascade projections, single pass caster culling
+* against all cascades, reduced update rates for distant cascades and a static caster cache per cascade
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanCascadedShadows.h"
+
+#include <cstddef>
+#include <iomanip>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace vks
+{
+	namespace
+	{
+		struct DepthReducePushConstants
+		{
+			float zNear;
+			float zFar;
+			uint32_t width;
+			uint32_t height;
+		};
+
+		// Local size of depth_reduce.comp
+		const uint32_t depthReduceGroupSize = 16;
+
+		/** Vertex layout of shadowmappingcascade/depthpass.vert */
+		struct CasterVertex
+		{
+			float pos[3];
+			float uv[2];
+		};
+
+		/** Per cascade totals of a benchmark flight */
+		struct CascadeTotals
+		{
+			uint32_t updates = 0;
+			uint32_t cacheRebuilds = 0;
+			uint64_t draws = 0;
+			double gpuMilliseconds = 0.0;
+		};
+	}
+
+	/**
+	* Create the shadow map images, render passes, frame buffers and the depth reduction pipeline
+	*
+	* @param device Device to create the resources on
+	* @param queue Queue used for the initial image layout transitions
+	* @param shadersPath Base path of the GLSL shaders (getShadersPath())
+	* @param pipelineCache Pipeline cache used for the depth reduction pipeline
+	* @param frameCount Number of command buffers the shadow passes get recorded into, used for the GPU timer query ranges
+	*/
+	void CascadedShadowMap::prepare(vks::VulkanDevice* device, VkQueue queue, const std::string& shadersPath, VkPipelineCache pipelineCache, uint32_t frameCount)
+	{
+		this->device = device;
+		settings.cascadeCount = std::min(std::max(settings.cascadeCount, 1u), static_cast<uint32_t>(SHADOW_MAP_MAX_CASCADE_COUNT));
+
+		// Depth only formats that can be rendered to and sampled from
+		const std::vector<VkFormat> formats = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM };
+		for (VkFormat format : formats)
+		{
+			VkFormatProperties formatProperties;
+			vkGetPhysicalDeviceFormatProperties(device->physicalDevice, format, &formatProperties);
+			const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+			if ((formatProperties.optimalTilingFeatures & required) == required)
+			{
+				depthFormat = format;
+				break;
+			}
+		}//for
+		if (depthFormat == VK_FORMAT_UNDEFINED)
+		{
+			vks::tools::exitFatal("No depth format usable for cascaded shadow maps", -1);
+		}
+
+		createImages(queue);
+		createRenderPasses();
+
+		// Frame buffers, one per cascade layer (and cache layer)
+		for (uint32_t i = 0; i < settings.cascadeCount; i++)
+		{
+			VkFramebufferCreateInfo frameBufferInfo = vks::initializers::GenFrameBufferCreateInfo();
+			frameBufferInfo.renderPass = clearRenderPass;
+			frameBufferInfo.attachmentCount = 1;
+			frameBufferInfo.pAttachments = &cascades[i].view;
+			frameBufferInfo.width = settings.mapSize;
+			frameBufferInfo.height = settings.mapSize;
+			frameBufferInfo.layers = 1;
+			VK_CHECK_RESULT(vkCreateFramebuffer(device->logicalDevice, &frameBufferInfo, nullptr, &cascades[i].frameBuffer));
+			if (cacheImage != VK_NULL_HANDLE)
+			{
+				frameBufferInfo.renderPass = cacheRenderPass;
+				frameBufferInfo.pAttachments = &cascades[i].cacheView;
+				VK_CHECK_RESULT(vkCreateFramebuffer(device->logicalDevice, &frameBufferInfo, nullptr, &cascades[i].cacheFrameBuffer));
+			}
+		}//for
+
+		// Cascade matrices
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&uniformBuffer, sizeof(glm::mat4) * SHADOW_MAP_MAX_CASCADE_COUNT));
+		VK_CHECK_RESULT(uniformBuffer.map());
+
+		// Depth reduction result (min and max linear depth as float bits), read back by the host
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &depthReduce.result, sizeof(uint32_t) * 2));
+		VK_CHECK_RESULT(depthReduce.result.map());
+
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1),
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::GenDescriptorPoolCreateInfo(poolSizes, 2);
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+
+		VkDescriptorSetLayoutBinding uboBinding = vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0);
+		VkDescriptorSetLayoutCreateInfo layoutInfo = vks::initializers::GenDescriptorSetLayoutCreateInfo(&uboBinding, 1);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &layoutInfo, nullptr, &descriptorSetLayout));
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &descriptorSet));
+		VkWriteDescriptorSet writeDescriptorSet = vks::initializers::GenWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffer.descriptorBufferInfo);
+		vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+
+		// Depth reduction pipeline
+		std::vector<VkDescriptorSetLayoutBinding> reduceBindings = {
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+		};
+		layoutInfo = vks::initializers::GenDescriptorSetLayoutCreateInfo(reduceBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &layoutInfo, nullptr, &depthReduce.descriptorSetLayout));
+		allocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &depthReduce.descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &depthReduce.descriptorSet));
+
+		VkPushConstantRange pushConstantRange = vks::initializers::GenPushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(DepthReducePushConstants), 0);
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = vks::initializers::GenPipelineLayoutCreateInfo(&depthReduce.descriptorSetLayout, 1);
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutInfo, nullptr, &depthReduce.pipelineLayout));
+
+		VkComputePipelineCreateInfo computePipelineInfo = vks::initializers::GenComputePipelineCreateInfo(depthReduce.pipelineLayout);
+		computePipelineInfo.stage = vks::tools::loadShaderStage(shadersPath + "shadowmappingcascade/depth_reduce.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT, device->logicalDevice);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &computePipelineInfo, nullptr, &depthReduce.pipeline));
+		vkDestroyShaderModule(device->logicalDevice, computePipelineInfo.stage.module, nullptr);
+
+		gpuTimer.create(device, SHADOW_MAP_MAX_CASCADE_COUNT, frameCount);
+	}
+
+	void CascadedShadowMap::createImages(VkQueue queue)
+	{
+		VkImageCreateInfo imageInfo = vks::initializers::GenImageCreateInfo();
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = depthFormat;
+		imageInfo.extent = { settings.mapSize, settings.mapSize, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = settings.cascadeCount;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageInfo, nullptr, &image));
+
+		VkMemoryRequirements memReqs;
+		VkMemoryAllocateInfo memAlloc = vks::initializers::GenMemoryAllocateInfo();
+		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &memory));
+		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, memory, 0));
+
+		if (settings.cacheStaticCasters)
+		{
+			imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageInfo, nullptr, &cacheImage));
+			vkGetImageMemoryRequirements(device->logicalDevice, cacheImage, &memReqs);
+			memAlloc.allocationSize = memReqs.size;
+			memAlloc.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &cacheMemory));
+			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, cacheImage, cacheMemory, 0));
+		}
+
+		VkImageViewCreateInfo viewInfo = vks::initializers::GenImageViewCreateInfo();
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		viewInfo.format = depthFormat;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, settings.cascadeCount };
+		viewInfo.image = image;
+		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewInfo, nullptr, &arrayView));
+
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.subresourceRange.layerCount = 1;
+		for (uint32_t i = 0; i < settings.cascadeCount; i++)
+		{
+			viewInfo.subresourceRange.baseArrayLayer = i;
+			viewInfo.image = image;
+			VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewInfo, nullptr, &cascades[i].view));
+			if (cacheImage != VK_NULL_HANDLE)
+			{
+				viewInfo.image = cacheImage;
+				VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewInfo, nullptr, &cascades[i].cacheView));
+			}
+		}//for
+
+		VkSamplerCreateInfo samplerInfo = vks::initializers::GenSamplerCreateInfo();
+		samplerInfo.magFilter = VK_FILTER_LINEAR;
+		samplerInfo.minFilter = VK_FILTER_LINEAR;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = samplerInfo.addressModeU;
+		samplerInfo.addressModeW = samplerInfo.addressModeU;
+		samplerInfo.maxAnisotropy = 1.0f;
+		samplerInfo.maxLod = 1.0f;
+		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerInfo, nullptr, &sampler));
+
+		descriptor = vks::initializers::GenDescriptorImageInfo(sampler, arrayView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+
+		// Cascades that are skipped in a frame keep their previous contents, so every layer must start in the sampled layout
+		VkCommandBuffer commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkImageSubresourceRange range = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, settings.cascadeCount };
+		vks::tools::setImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, range);
+		if (cacheImage != VK_NULL_HANDLE)
+		{
+			vks::tools::setImageLayout(commandBuffer, cacheImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, range);
+		}
+		device->FlushCommandBuffer(commandBuffer, queue);
+	}
+
+	void CascadedShadowMap::createRenderPasses()
+	{
+		auto createRenderPass = [&](VkAttachmentLoadOp loadOp, VkImageLayout initialLayout, VkImageLayout finalLayout, VkRenderPass* renderPass)
+		{
+			VkAttachmentDescription attachment{};
+			attachment.format = depthFormat;
+			attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+			attachment.loadOp = loadOp;
+			attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachment.initialLayout = initialLayout;
+			attachment.finalLayout = finalLayout;
+
+			VkAttachmentReference depthReference = { 0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+			VkSubpassDescription subpass{};
+			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+			subpass.pDepthStencilAttachment = &depthReference;
+
+			// Previous shader reads and transfers must finish before the layer is written, and the
+			// written depth must be visible to later shader reads and cache copies
+			std::array<VkSubpassDependency, 2> dependencies{};
+			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+			dependencies[0].dstSubpass = 0;
+			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+			dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+			dependencies[1].srcSubpass = 0;
+			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+			dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+			dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+			VkRenderPassCreateInfo renderPassInfo = vks::initializers::GenRenderPassCreateInfo();
+			renderPassInfo.attachmentCount = 1;
+			renderPassInfo.pAttachments = &attachment;
+			renderPassInfo.subpassCount = 1;
+			renderPassInfo.pSubpasses = &subpass;
+			renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+			renderPassInfo.pDependencies = dependencies.data();
+			VK_CHECK_RESULT(vkCreateRenderPass(device->logicalDevice, &renderPassInfo, nullptr, renderPass));
+		};
+
+		createRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, &clearRenderPass);
+		createRenderPass(VK_ATTACHMENT_LOAD_OP_LOAD, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, &loadRenderPass);
+		createRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, &cacheRenderPass);
+	}
+
+	/**
+	* Create the depth only pipeline used for all cascades
+	*
+	* @param shaderStages Depth pass shaders, e.g. shadowmappingcascade/depthpass.vert/.frag
+	* @param vertexInputState Vertex layout of the casters
+	* @param additionalSetLayouts Set layouts bound after the cascade matrix set (e.g. material textures for alpha testing)
+	*/
+	void CascadedShadowMap::preparePipeline(VkPipelineCache pipelineCache, const std::vector<VkPipelineShaderStageCreateInfo>& shaderStages,
+		const VkPipelineVertexInputStateCreateInfo& vertexInputState, const std::vector<VkDescriptorSetLayout>& additionalSetLayouts)
+	{
+		std::vector<VkDescriptorSetLayout> setLayouts = { descriptorSetLayout };
+		setLayouts.insert(setLayouts.end(), additionalSetLayouts.begin(), additionalSetLayouts.end());
+		VkPushConstantRange pushConstantRange = vks::initializers::GenPushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(PushConstants), 0);
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = vks::initializers::GenPipelineLayoutCreateInfo(setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::GenPipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
+		VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::GenPipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+		rasterizationState.depthBiasEnable = VK_TRUE;
+		rasterizationState.depthBiasConstantFactor = settings.depthBiasConstant;
+		rasterizationState.depthBiasSlopeFactor = settings.depthBiasSlope;
+		// Casters between the light and the extended near plane are clamped instead of clipped if supported
+		rasterizationState.depthClampEnable = device->m_enabledDeviceFeatures.depthClamp;
+		VkPipelineColorBlendStateCreateInfo colorBlendState = vks::initializers::GenPipelineColorBlendStateCreateInfo(0, nullptr);
+		VkPipelineDepthStencilStateCreateInfo depthStencilState = vks::initializers::GenPipelineDepthStencilStateCreateInfo(VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL);
+		VkPipelineViewportStateCreateInfo viewportState = vks::initializers::GenPipelineViewportStateCreateInfo(1, 1, 0);
+		VkPipelineMultisampleStateCreateInfo multisampleState = vks::initializers::GenPipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT, 0);
+		std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamicState = vks::initializers::GenPipelineDynamicStateCreateInfo(dynamicStateEnables);
+
+		// All three render passes are compatible, the pipeline is created against one of them
+		VkGraphicsPipelineCreateInfo pipelineInfo = vks::initializers::GenPipelineCreateInfo(pipelineLayout, clearRenderPass, 0);
+		pipelineInfo.pVertexInputState = &vertexInputState;
+		pipelineInfo.pInputAssemblyState = &inputAssemblyState;
+		pipelineInfo.pRasterizationState = &rasterizationState;
+		pipelineInfo.pColorBlendState = &colorBlendState;
+		pipelineInfo.pMultisampleState = &multisampleState;
+		pipelineInfo.pViewportState = &viewportState;
+		pipelineInfo.pDepthStencilState = &depthStencilState;
+		pipelineInfo.pDynamicState = &dynamicState;
+		pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+		pipelineInfo.pStages = shaderStages.data();
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device->logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline));
+	}
+
+	void CascadedShadowMap::destroy()
+	{
+		if (!device)
+		{
+			return;
+		}
+		VkDevice logicalDevice = device->logicalDevice;
+		for (uint32_t i = 0; i < settings.cascadeCount; i++)
+		{
+			vkDestroyFramebuffer(logicalDevice, cascades[i].frameBuffer, nullptr);
+			vkDestroyImageView(logicalDevice, cascades[i].view, nullptr);
+			if (cacheImage != VK_NULL_HANDLE)
+			{
+				vkDestroyFramebuffer(logicalDevice, cascades[i].cacheFrameBuffer, nullptr);
+				vkDestroyImageView(logicalDevice, cascades[i].cacheView, nullptr);
+			}
+		}//for
+		vkDestroyImageView(logicalDevice, arrayView, nullptr);
+		vkDestroyImage(logicalDevice, image, nullptr);
+		vkFreeMemory(logicalDevice, memory, nullptr);
+		if (cacheImage != VK_NULL_HANDLE)
+		{
+			vkDestroyImage(logicalDevice, cacheImage, nullptr);
+			vkFreeMemory(logicalDevice, cacheMemory, nullptr);
+		}
+		vkDestroySampler(logicalDevice, sampler, nullptr);
+		vkDestroyRenderPass(logicalDevice, clearRenderPass, nullptr);
+		vkDestroyRenderPass(logicalDevice, loadRenderPass, nullptr);
+		vkDestroyRenderPass(logicalDevice, cacheRenderPass, nullptr);
+		vkDestroyPipeline(logicalDevice, pipeline, nullptr);
+		vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+		vkDestroyPipeline(logicalDevice, depthReduce.pipeline, nullptr);
+		vkDestroyPipelineLayout(logicalDevice, depthReduce.pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(logicalDevice, depthReduce.descriptorSetLayout, nullptr);
+		vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+		uniformBuffer.destroy();
+		depthReduce.result.destroy();
+		gpuTimer.destroy();
+		device = nullptr;
+	}
+
+	/**
+	* Register a shadow caster by its bounding sphere
+	*
+	* @param isStatic Static casters are rendered into the cache layers and only redrawn when a cascade projection changes
+	*
+	* @return Caster index passed to drawCaster
+	*/
+	uint32_t CascadedShadowMap::addCaster(const glm::vec3& center, float radius, bool isStatic)
+	{
+		casters.push_back({ center, radius, isStatic, true, 0 });
+		if (isStatic)
+		{
+			invalidateCache();
+		}
+		return static_cast<uint32_t>(casters.size() - 1);
+	}
+
+	/** @brief Move a caster, moving a static caster invalidates the cache */
+	void CascadedShadowMap::updateCaster(uint32_t index, const glm::vec3& center, float radius)
+	{
+		Caster& caster = casters[index];
+		caster.center = center;
+		caster.radius = radius;
+		if (caster.isStatic)
+		{
+			invalidateCache();
+		}
+	}
+
+	void CascadedShadowMap::removeCaster(uint32_t index)
+	{
+		casters[index].active = false;
+		if (casters[index].isStatic)
+		{
+			invalidateCache();
+		}
+	}
+
+	void CascadedShadowMap::invalidateCache()
+	{
+		for (Cascade& cascade : cascades)
+		{
+			cascade.cacheValid = false;
+		}
+	}
+
+	/**
+	* Set the scene depth buffer used for fitting the cascades to the visible depth range
+	*
+	* @note The depth image must have been created with VK_IMAGE_USAGE_SAMPLED_BIT and be in a depth read only layout when the reduction runs
+	*/
+	void CascadedShadowMap::setDepthSource(VkImageView depthView, VkSampler depthSampler, uint32_t width, uint32_t height)
+	{
+		depthReduce.width = width;
+		depthReduce.height = height;
+		depthReduce.valid = false;
+		VkDescriptorImageInfo imageInfo = vks::initializers::GenDescriptorImageInfo(depthSampler, depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::GenWriteDescriptorSet(depthReduce.descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageInfo),
+			vks::initializers::GenWriteDescriptorSet(depthReduce.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &depthReduce.result.descriptorBufferInfo),
+		};
+		vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
+	/**
+	* Practical split scheme, blends logarithmic and uniform split distances
+	*
+	* @param splits Receives cascadeCount split positions, normalized to [0..1] over the [zNear..zFar] range
+	*/
+	void CascadedShadowMap::computeSplits(float zNear, float zFar, float lambda, uint32_t cascadeCount, float* splits)
+	{
+		const float range = zFar - zNear;
+		const float ratio = zFar / zNear;
+		for (uint32_t i = 0; i < cascadeCount; i++)
+		{
+			const float p = static_cast<float>(i + 1) / static_cast<float>(cascadeCount);
+			const float logSplit = zNear * std::pow(ratio, p);
+			const float uniformSplit = zNear + range * p;
+			const float d = lambda * (logSplit - uniformSplit) + uniformSplit;
+			splits[i] = (d - zNear) / range;
+		}//for
+	}
+
+	/**
+	* Compute splits and projections for the cascades that are due this frame and cull the casters
+	*
+	* @note Cascades that are not due keep their previous matrices so the shadow map contents stay consistent
+	*/
+	void CascadedShadowMap::update(const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar, const glm::vec3& lightDir)
+	{
+		const uint32_t cascadeCount = settings.cascadeCount;
+
+		// All cascades share the light rotation, which also makes the culling a single transform per caster
+		const glm::vec3 dir = glm::normalize(lightDir);
+		if (dir != lastLightDir)
+		{
+			const glm::vec3 up = std::abs(dir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+			lightRotation = glm::lookAt(glm::vec3(0.0f), dir, up);
+			lastLightDir = dir;
+			invalidateCache();
+			// A new light direction invalidates the contents of every cascade
+			for (Cascade& cascade : cascades)
+			{
+				cascade.radius = 0.0f;
+			}
+		}
+
+		// Optionally tighten the split range to the depth range visible in the previous frame
+		float fitNear = zNear;
+		float fitFar = zFar;
+		if (settings.fitToDepthRange && depthReduce.valid)
+		{
+			const uint32_t* bits = static_cast<const uint32_t*>(depthReduce.result.mappedData);
+			float minDepth, maxDepth;
+			memcpy(&minDepth, &bits[0], sizeof(float));
+			memcpy(&maxDepth, &bits[1], sizeof(float));
+			if (bits[0] != UINT32_MAX && minDepth < maxDepth)
+			{
+				fitNear = std::max(zNear, minDepth);
+				fitFar = std::min(zFar, maxDepth);
+			}
+		}
+
+		float splits[SHADOW_MAP_MAX_CASCADE_COUNT];
+		computeSplits(fitNear, fitFar, settings.splitLambda, cascadeCount, splits);
+
+		// Frustum corners in world space, the slices are interpolated along the corner rays
+		const glm::mat4 invCamera = glm::inverse(projection * view);
+		glm::vec3 corners[8] = {
+			glm::vec3(-1.0f,  1.0f, 0.0f), glm::vec3(1.0f,  1.0f, 0.0f), glm::vec3(1.0f, -1.0f, 0.0f), glm::vec3(-1.0f, -1.0f, 0.0f),
+			glm::vec3(-1.0f,  1.0f, 1.0f), glm::vec3(1.0f,  1.0f, 1.0f), glm::vec3(1.0f, -1.0f, 1.0f), glm::vec3(-1.0f, -1.0f, 1.0f),
+		};
+		for (uint32_t i = 0; i < 8; i++)
+		{
+			glm::vec4 corner = invCamera * glm::vec4(corners[i], 1.0f);
+			corners[i] = glm::vec3(corner) / corner.w;
+		}
+		const float clipRange = zFar - zNear;
+
+		float lastSplit = (fitNear - zNear) / clipRange;
+		for (uint32_t i = 0; i < cascadeCount; i++)
+		{
+			Cascade& cascade = cascades[i];
+			const float split = (fitNear + splits[i] * (fitFar - fitNear) - zNear) / clipRange;
+			const uint32_t interval = std::max(settings.updateIntervals[i], 1u);
+			// Stagger the reduced rate cascades so they do not all update in the same frame
+			updateScheduled[i] = cascade.radius == 0.0f || ((frameIndex + i) % interval) == 0;
+			if (updateScheduled[i])
+			{
+				glm::vec3 sliceCorners[8];
+				glm::vec3 center = glm::vec3(0.0f);
+				for (uint32_t j = 0; j < 4; j++)
+				{
+					const glm::vec3 ray = corners[j + 4] - corners[j];
+					sliceCorners[j] = corners[j] + ray * lastSplit;
+					sliceCorners[j + 4] = corners[j] + ray * split;
+				}
+				for (uint32_t j = 0; j < 8; j++)
+				{
+					center += sliceCorners[j];
+				}
+				center /= 8.0f;
+				// A bounding sphere keeps the projection size constant under camera rotation
+				float radius = 0.0f;
+				for (uint32_t j = 0; j < 8; j++)
+				{
+					radius = std::max(radius, glm::length(sliceCorners[j] - center));
+				}
+				cascade.radius = std::ceil(radius * 16.0f) / 16.0f;
+				cascade.lightSpaceCenter = glm::vec3(lightRotation * glm::vec4(center, 1.0f));
+				cascade.splitDepth = -(zNear + split * clipRange);
+			}
+			lastSplit = split;
+		}//for
+
+		cullCasters();
+
+		for (uint32_t i = 0; i < cascadeCount; i++)
+		{
+			if (!updateScheduled[i])
+			{
+				continue;
+			}
+			Cascade& cascade = cascades[i];
+			const float r = cascade.radius;
+			// The eye sits on the light side of the bounding sphere, in light space the light shines along -z
+			const glm::vec3 eye = cascade.lightSpaceCenter + glm::vec3(0.0f, 0.0f, r);
+			const glm::mat4 lightView = glm::translate(glm::mat4(1.0f), -eye) * lightRotation;
+			// Quantized so that small caster movements do not change the projection (and invalidate the cache)
+			const float step = r * 0.25f;
+			const float nearExtension = std::ceil(cascade.nearExtension / step) * step;
+			glm::mat4 lightProjection = glm::ortho(-r, r, -r, r, -nearExtension, 2.0f * r);
+
+			// Snap the projection to shadow map texels to avoid shimmering when the camera moves
+			glm::vec4 origin = (lightProjection * lightView) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			origin *= static_cast<float>(settings.mapSize) * 0.5f;
+			const glm::vec4 rounded = glm::round(origin);
+			const glm::vec4 offset = (rounded - origin) * 2.0f / static_cast<float>(settings.mapSize);
+			lightProjection[3][0] += offset.x;
+			lightProjection[3][1] += offset.y;
+
+			cascade.viewProjMatrix = lightProjection * lightView;
+			if (cascade.viewProjMatrix != cascade.cachedViewProjMatrix)
+			{
+				cascade.cacheValid = false;
+			}
+		}//for
+
+		glm::mat4* matrices = static_cast<glm::mat4*>(uniformBuffer.mappedData);
+		for (uint32_t i = 0; i < cascadeCount; i++)
+		{
+			matrices[i] = cascades[i].viewProjMatrix;
+		}
+		frameIndex++;
+	}
+
+	/**
+	* Test every caster against all cascades in one pass, producing a cascade bit mask per caster
+	*/
+	void CascadedShadowMap::cullCasters()
+	{
+		for (uint32_t i = 0; i < settings.cascadeCount; i++)
+		{
+			cascades[i].nearExtension = 0.0f;
+		}
+		for (Caster& caster : casters)
+		{
+			caster.cascadeMask = 0;
+			if (!caster.active)
+			{
+				continue;
+			}
+			const glm::vec3 center = glm::vec3(lightRotation * glm::vec4(caster.center, 1.0f));
+			for (uint32_t i = 0; i < settings.cascadeCount; i++)
+			{
+				Cascade& cascade = cascades[i];
+				const glm::vec3 d = center - cascade.lightSpaceCenter;
+				const float extent = cascade.radius + caster.radius;
+				// Casters anywhere between the light and the far side of the cascade volume can cast into it
+				if (std::abs(d.x) <= extent && std::abs(d.y) <= extent && d.z >= -extent)
+				{
+					caster.cascadeMask |= 1u << i;
+					cascade.nearExtension = std::max(cascade.nearExtension, d.z + caster.radius - cascade.radius);
+				}
+			}//for
+		}//for
+	}
+
+	/**
+	* Reduce the scene depth buffer to its min and max linear depth, used by the next update() if fitToDepthRange is enabled
+	*/
+	void CascadedShadowMap::recordDepthReduce(VkCommandBuffer commandBuffer, float zNear, float zFar)
+	{
+		if (!settings.fitToDepthRange || depthReduce.width == 0)
+		{
+			return;
+		}
+		vkCmdFillBuffer(commandBuffer, depthReduce.result.buffer, 0, sizeof(uint32_t), UINT32_MAX);
+		vkCmdFillBuffer(commandBuffer, depthReduce.result.buffer, sizeof(uint32_t), sizeof(uint32_t), 0);
+
+		VkBufferMemoryBarrier bufferBarrier = vks::initializers::GenBufferMemoryBarrier();
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		bufferBarrier.buffer = depthReduce.result.buffer;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
+		DepthReducePushConstants pushConstants = { zNear, zFar, depthReduce.width, depthReduce.height };
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthReduce.pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthReduce.pipelineLayout, 0, 1, &depthReduce.descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, depthReduce.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DepthReducePushConstants), &pushConstants);
+		vkCmdDispatch(commandBuffer, (depthReduce.width + depthReduceGroupSize - 1) / depthReduceGroupSize, (depthReduce.height + depthReduceGroupSize - 1) / depthReduceGroupSize, 1);
+
+		bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
+		depthReduce.valid = true;
+	}
+
+	void CascadedShadowMap::drawCasters(VkCommandBuffer commandBuffer, uint32_t cascadeIndex, bool staticCasters, uint32_t& drawCount)
+	{
+		for (uint32_t i = 0; i < static_cast<uint32_t>(casters.size()); i++)
+		{
+			const Caster& caster = casters[i];
+			if (caster.isStatic == staticCasters && (caster.cascadeMask & (1u << cascadeIndex)))
+			{
+				drawCaster(commandBuffer, i);
+				drawCount++;
+			}
+		}//for
+	}
+
+	/**
+	* Record the shadow passes of all cascades that are due this frame
+	*
+	* @note Must be re-recorded every frame after update(), as the set of cascades and casters changes per frame
+	*/
+	void CascadedShadowMap::recordShadowPasses(VkCommandBuffer commandBuffer)
+	{
+		assert(drawCaster);
+		gpuTimer.reset(commandBuffer);
+
+		bool hasStaticCasters = false;
+		for (const Caster& caster : casters)
+		{
+			hasStaticCasters |= caster.active && caster.isStatic;
+		}
+		const bool useCache = cacheImage != VK_NULL_HANDLE && hasStaticCasters;
+
+		VkClearValue clearValue{};
+		clearValue.depthStencil = { 1.0f, 0 };
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::GenRenderPassBeginInfo();
+		renderPassBeginInfo.renderArea.extent = { settings.mapSize, settings.mapSize };
+		VkViewport viewport = vks::initializers::GenViewport(static_cast<float>(settings.mapSize), static_cast<float>(settings.mapSize), 0.0f, 1.0f);
+		VkRect2D scissor = vks::initializers::GenRect2D(settings.mapSize, settings.mapSize, 0, 0);
+
+		auto beginPass = [&](VkRenderPass renderPass, VkFramebuffer frameBuffer, uint32_t cascadeIndex)
+		{
+			renderPassBeginInfo.renderPass = renderPass;
+			renderPassBeginInfo.framebuffer = frameBuffer;
+			renderPassBeginInfo.clearValueCount = renderPass == loadRenderPass ? 0 : 1;
+			renderPassBeginInfo.pClearValues = &clearValue;
+			vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+			vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, offsetof(PushConstants, cascadeIndex), sizeof(uint32_t), &cascadeIndex);
+		};
+
+		for (uint32_t i = 0; i < settings.cascadeCount; i++)
+		{
+			Cascade& cascade = cascades[i];
+			CascadeStats& cascadeStats = stats[i];
+			cascadeStats = CascadeStats();
+			timerScopes[i] = UINT32_MAX;
+			if (!updateScheduled[i])
+			{
+				continue;
+			}
+			cascadeStats.updated = true;
+			timerScopes[i] = gpuTimer.beginScope(commandBuffer, "Cascade " + std::to_string(i));
+
+			if (useCache)
+			{
+				if (!cascade.cacheValid)
+				{
+					beginPass(cacheRenderPass, cascade.cacheFrameBuffer, i);
+					drawCasters(commandBuffer, i, true, cascadeStats.staticDraws);
+					vkCmdEndRenderPass(commandBuffer);
+					cascade.cachedViewProjMatrix = cascade.viewProjMatrix;
+					cascade.cacheValid = true;
+					cascadeStats.cacheRebuilt = true;
+				}
+
+				// Start from the cached static depth and only add the dynamic casters
+				VkImageSubresourceRange range = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, i, 1 };
+				vks::tools::insertImageMemoryBarrier(commandBuffer, image, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+					VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, range);
+				VkImageCopy copyRegion{};
+				copyRegion.srcSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, i, 1 };
+				copyRegion.dstSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, i, 1 };
+				copyRegion.extent = { settings.mapSize, settings.mapSize, 1 };
+				vkCmdCopyImage(commandBuffer, cacheImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+				vks::tools::insertImageMemoryBarrier(commandBuffer, image, VK_ACCESS_TRANSFER_WRITE_BIT,
+					VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+					VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, range);
+
+				beginPass(loadRenderPass, cascade.frameBuffer, i);
+				drawCasters(commandBuffer, i, false, cascadeStats.dynamicDraws);
+				vkCmdEndRenderPass(commandBuffer);
+			}
+			else
+			{
+				beginPass(clearRenderPass, cascade.frameBuffer, i);
+				drawCasters(commandBuffer, i, true, cascadeStats.staticDraws);
+				drawCasters(commandBuffer, i, false, cascadeStats.dynamicDraws);
+				vkCmdEndRenderPass(commandBuffer);
+			}
+
+			gpuTimer.endScope(commandBuffer, timerScopes[i]);
+		}//for
+	}
+
+	/**
+	* Read back the per cascade GPU times of the last completed frame into stats
+	*/
+	void CascadedShadowMap::collectStats()
+	{
+		if (!gpuTimer.collect())
+		{
+			return;
+		}
+		for (uint32_t i = 0; i < settings.cascadeCount; i++)
+		{
+			stats[i].gpuMilliseconds = stats[i].updated ? gpuTimer.getMilliseconds("Cascade " + std::to_string(i)) : 0.0;
+		}
+	}
+
+	/**
+	* Flies a camera over a field of static pillars and orbiting dynamic boxes. The camera alternates between holding still and
+	* moving, so the static caster cache is reused in one half of the frames and rebuilt in the other. Every frame renders the
+	* camera depth, reduces it with depth_reduce.comp and renders the cascades that are due
+	*
+	* @param device Device the shadow maps are rendered on
+	* @param queue Queue the frames are submitted to, every frame is waited for
+	* @param shadersPath Base path of the GLSL shaders (getShadersPath())
+	* @param out Stream the report is written to
+	* @param frames Number of frames of each flight
+	*/
+	void benchmarkCascadedShadows(vks::VulkanDevice* device, VkQueue queue, const std::string& shadersPath, std::ostream& out, uint32_t frames)
+	{
+		const uint32_t width = 1920;
+		const uint32_t height = 1080;
+		const float zNear = 0.5f;
+		const float zFar = 256.0f;
+		const uint32_t pillarRows = 24;
+		const uint32_t dynamicCasters = 32;
+		const glm::vec3 lightDir = glm::normalize(glm::vec3(-0.4f, -1.0f, -0.3f));
+		VkDevice logicalDevice = device->logicalDevice;
+
+		// One box shape for all casters, 2 x 4 x 2 units
+		const glm::vec3 halfExtent(1.0f, 2.0f, 1.0f);
+		std::vector<CasterVertex> vertices;
+		std::vector<uint32_t> indices;
+		for (uint32_t face = 0; face < 6; face++)
+		{
+			const uint32_t axis = face / 2;
+			const float sign = (face % 2 == 0) ? 1.0f : -1.0f;
+			const uint32_t first = static_cast<uint32_t>(vertices.size());
+			for (uint32_t corner = 0; corner < 4; corner++)
+			{
+				glm::vec3 p(0.0f);
+				p[axis] = sign;
+				p[(axis + 1) % 3] = (corner & 1) ? 1.0f : -1.0f;
+				p[(axis + 2) % 3] = (corner & 2) ? 1.0f : -1.0f;
+				p *= halfExtent;
+				vertices.push_back({ { p.x, p.y, p.z }, { (corner & 1) ? 1.0f : 0.0f, (corner & 2) ? 1.0f : 0.0f } });
+			}
+			const uint32_t quad[6] = { first, first + 1, first + 2, first + 2, first + 1, first + 3 };
+			indices.insert(indices.end(), quad, quad + 6);
+		}//for
+		vks::Buffer vertexBuffer, indexBuffer;
+		VK_CHECK_RESULT(device->CreateDeviceLocalBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &vertexBuffer, vertices.size() * sizeof(CasterVertex), vertices.data(), queue));
+		VK_CHECK_RESULT(device->CreateDeviceLocalBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, &indexBuffer, indices.size() * sizeof(uint32_t), indices.data(), queue));
+		const float casterRadius = glm::length(halfExtent);
+
+		std::vector<VkVertexInputBindingDescription> bindings = { vks::initializers::GenVertexInputBindingDescription(0, sizeof(CasterVertex), VK_VERTEX_INPUT_RATE_VERTEX) };
+		std::vector<VkVertexInputAttributeDescription> attributes = {
+			vks::initializers::GenVertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(CasterVertex, pos)),
+			vks::initializers::GenVertexInputAttributeDescription(0, 1, VK_FORMAT_R32G32_SFLOAT, offsetof(CasterVertex, uv)),
+		};
+		VkPipelineVertexInputStateCreateInfo vertexInputState = vks::initializers::GenPipelineVertexInputStateCreateInfo(bindings, attributes);
+
+		struct Configuration
+		{
+			const char* name;
+			bool reducedRates;
+		};
+		const Configuration configurations[] =
+		{
+			{ "every cascade every frame, no cache", false },
+			{ "reduced rates, static cache, depth fit", true },
+		};
+
+		std::ios_base::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+		out << std::fixed << std::setprecision(3);
+		out << "Cascaded shadows: " << frames << " frames at " << width << " x " << height << ", " << pillarRows * pillarRows << " static and "
+			<< dynamicCasters << " dynamic casters, camera alternates between holding still and moving every 60 frames\n";
+
+		for (const Configuration& configuration : configurations)
+		{
+			CascadedShadowMap shadows;
+			if (!configuration.reducedRates)
+			{
+				shadows.settings.updateIntervals = { 1, 1, 1, 1 };
+				shadows.settings.cacheStaticCasters = false;
+			}
+			shadows.settings.fitToDepthRange = configuration.reducedRates;
+			shadows.prepare(device, queue, shadersPath, VK_NULL_HANDLE);
+			// Depth only, the alpha tested fragment shader of the depth pass needs material images the boxes don't have
+			std::vector<VkPipelineShaderStageCreateInfo> shaderStages = {
+				vks::tools::loadShaderStage(shadersPath + "shadowmappingcascade/depthpass.vert.spv", VK_SHADER_STAGE_VERTEX_BIT, logicalDevice)
+			};
+			shadows.preparePipeline(VK_NULL_HANDLE, shaderStages, vertexInputState);
+			vkDestroyShaderModule(logicalDevice, shaderStages[0].module, nullptr);
+
+			for (uint32_t z = 0; z < pillarRows; z++)
+			{
+				for (uint32_t x = 0; x < pillarRows; x++)
+				{
+					shadows.addCaster(glm::vec3((x - pillarRows * 0.5f) * 8.0f, -halfExtent.y, (z - pillarRows * 0.5f) * 8.0f), casterRadius, true);
+				}
+			}//for
+			for (uint32_t i = 0; i < dynamicCasters; i++)
+			{
+				shadows.addCaster(glm::vec3(0.0f), casterRadius, false);
+			}
+
+			// Camera depth for the reduction, rendered with the shadow pipeline and the camera matrix in cascade slot 0
+			VkImageCreateInfo imageInfo = vks::initializers::GenImageCreateInfo();
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.format = shadows.depthFormat;
+			imageInfo.extent = { width, height, 1 };
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+			VkImage cameraDepth;
+			VK_CHECK_RESULT(vkCreateImage(logicalDevice, &imageInfo, nullptr, &cameraDepth));
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(logicalDevice, cameraDepth, &memReqs);
+			VkMemoryAllocateInfo memAlloc = vks::initializers::GenMemoryAllocateInfo();
+			memAlloc.allocationSize = memReqs.size;
+			memAlloc.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			VkDeviceMemory cameraDepthMemory;
+			VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &cameraDepthMemory));
+			VK_CHECK_RESULT(vkBindImageMemory(logicalDevice, cameraDepth, cameraDepthMemory, 0));
+			VkImageViewCreateInfo viewInfo = vks::initializers::GenImageViewCreateInfo();
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = shadows.depthFormat;
+			viewInfo.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+			viewInfo.image = cameraDepth;
+			VkImageView cameraDepthView;
+			VK_CHECK_RESULT(vkCreateImageView(logicalDevice, &viewInfo, nullptr, &cameraDepthView));
+			VkFramebufferCreateInfo frameBufferInfo = vks::initializers::GenFrameBufferCreateInfo();
+			frameBufferInfo.renderPass = shadows.clearRenderPass;
+			frameBufferInfo.attachmentCount = 1;
+			frameBufferInfo.pAttachments = &cameraDepthView;
+			frameBufferInfo.width = width;
+			frameBufferInfo.height = height;
+			frameBufferInfo.layers = 1;
+			VkFramebuffer cameraFrameBuffer;
+			VK_CHECK_RESULT(vkCreateFramebuffer(logicalDevice, &frameBufferInfo, nullptr, &cameraFrameBuffer));
+			shadows.setDepthSource(cameraDepthView, shadows.sampler, width, height);
+
+			vks::Buffer cameraBuffer;
+			VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&cameraBuffer, sizeof(glm::mat4) * SHADOW_MAP_MAX_CASCADE_COUNT));
+			VK_CHECK_RESULT(cameraBuffer.map());
+			VkDescriptorPool descriptorPool;
+			std::vector<VkDescriptorPoolSize> poolSizes = { vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1) };
+			VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::GenDescriptorPoolCreateInfo(poolSizes, 1);
+			VK_CHECK_RESULT(vkCreateDescriptorPool(logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+			VkDescriptorSetAllocateInfo allocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &shadows.descriptorSetLayout, 1);
+			VkDescriptorSet cameraSet;
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(logicalDevice, &allocInfo, &cameraSet));
+			VkWriteDescriptorSet writeDescriptorSet = vks::initializers::GenWriteDescriptorSet(cameraSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &cameraBuffer.descriptorBufferInfo);
+			vkUpdateDescriptorSets(logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+
+			const VkDeviceSize offsets[1] = { 0 };
+			shadows.drawCaster = [&](VkCommandBuffer commandBuffer, uint32_t casterIndex)
+			{
+				const glm::vec4 position(shadows.casters[casterIndex].center, 0.0f);
+				vkCmdPushConstants(commandBuffer, shadows.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, offsetof(CascadedShadowMap::PushConstants, position), sizeof(glm::vec4), &position);
+				vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer.buffer, offsets);
+				vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+				vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+			};
+
+			vks::GpuTimer gpuTimer;
+			gpuTimer.create(device, 2);
+			std::array<CascadeTotals, SHADOW_MAP_MAX_CASCADE_COUNT> totals{};
+			double cameraMilliseconds = 0.0;
+			double reduceMilliseconds = 0.0;
+			glm::vec3 cameraPosition(-40.0f, 12.0f, 40.0f);
+			float yaw = 0.0f;
+			const glm::mat4 projection = glm::perspective(glm::radians(60.0f), static_cast<float>(width) / static_cast<float>(height), zNear, zFar);
+			for (uint32_t frame = 0; frame < frames; frame++)
+			{
+				if ((frame / 60) % 2 == 1)
+				{
+					cameraPosition += glm::vec3(0.25f, 0.0f, -0.25f);
+					yaw += 0.005f;
+				}
+				const glm::vec3 forward(std::sin(yaw + 2.4f), -0.35f, std::cos(yaw + 2.4f));
+				const glm::mat4 view = glm::lookAt(cameraPosition, cameraPosition + forward, glm::vec3(0.0f, 1.0f, 0.0f));
+				const float t = frame / 60.0f;
+				for (uint32_t i = 0; i < dynamicCasters; i++)
+				{
+					const float angle = t + i * 2.0f * glm::pi<float>() / dynamicCasters;
+					shadows.updateCaster(pillarRows * pillarRows + i, cameraPosition + glm::vec3(std::cos(angle) * 20.0f, -8.0f, std::sin(angle) * 20.0f), casterRadius);
+				}
+				shadows.update(view, projection, zNear, zFar, lightDir);
+				static_cast<glm::mat4*>(cameraBuffer.mappedData)[0] = projection * view;
+
+				VkCommandBuffer commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+				gpuTimer.reset(commandBuffer);
+				uint32_t scope = gpuTimer.beginScope(commandBuffer, "Camera depth");
+				VkClearValue clearValue{};
+				clearValue.depthStencil = { 1.0f, 0 };
+				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::GenRenderPassBeginInfo();
+				renderPassBeginInfo.renderPass = shadows.clearRenderPass;
+				renderPassBeginInfo.framebuffer = cameraFrameBuffer;
+				renderPassBeginInfo.renderArea.extent = { width, height };
+				renderPassBeginInfo.clearValueCount = 1;
+				renderPassBeginInfo.pClearValues = &clearValue;
+				vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+				VkViewport viewport = vks::initializers::GenViewport(static_cast<float>(width), static_cast<float>(height), 0.0f, 1.0f);
+				VkRect2D scissor = vks::initializers::GenRect2D(width, height, 0, 0);
+				vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+				vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadows.pipeline);
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadows.pipelineLayout, 0, 1, &cameraSet, 0, nullptr);
+				const uint32_t cascadeIndex = 0;
+				vkCmdPushConstants(commandBuffer, shadows.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, offsetof(CascadedShadowMap::PushConstants, cascadeIndex), sizeof(uint32_t), &cascadeIndex);
+				for (uint32_t i = 0; i < static_cast<uint32_t>(shadows.casters.size()); i++)
+				{
+					shadows.drawCaster(commandBuffer, i);
+				}
+				vkCmdEndRenderPass(commandBuffer);
+				gpuTimer.endScope(commandBuffer, scope);
+
+				// The render pass makes the depth visible to fragment shaders, the reduction reads it in a compute shader
+				VkMemoryBarrier memoryBarrier = vks::initializers::GenMemoryBarrier();
+				memoryBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+				memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+				scope = gpuTimer.beginScope(commandBuffer, "Depth reduce");
+				shadows.recordDepthReduce(commandBuffer, zNear, zFar);
+				gpuTimer.endScope(commandBuffer, scope);
+
+				shadows.recordShadowPasses(commandBuffer);
+				device->FlushCommandBuffer(commandBuffer, queue, true);
+				gpuTimer.collect(true);
+				shadows.collectStats();
+
+				cameraMilliseconds += gpuTimer.getMilliseconds("Camera depth");
+				reduceMilliseconds += gpuTimer.getMilliseconds("Depth reduce");
+				for (uint32_t i = 0; i < shadows.settings.cascadeCount; i++)
+				{
+					const CascadedShadowMap::CascadeStats& stats = shadows.stats[i];
+					totals[i].updates += stats.updated ? 1 : 0;
+					totals[i].cacheRebuilds += stats.cacheRebuilt ? 1 : 0;
+					totals[i].draws += stats.staticDraws + stats.dynamicDraws;
+					totals[i].gpuMilliseconds += stats.gpuMilliseconds;
+				}
+			}//for
+
+			out << "  " << configuration.name << "\n";
+			if (!gpuTimer.supported)
+			{
+				out << "    Timestamp queries are not supported, GPU times are 0\n";
+			}
+			out << "    " << std::left << std::setw(10) << "cascade" << std::right << std::setw(10) << "updates" << std::setw(10) << "rebuilds" << std::setw(14)
+				<< "draws/update" << std::setw(12) << "ms/update" << std::setw(12) << "ms/frame" << "\n";
+			double shadowMilliseconds = 0.0;
+			for (uint32_t i = 0; i < shadows.settings.cascadeCount; i++)
+			{
+				const CascadeTotals& total = totals[i];
+				const uint32_t updates = std::max(total.updates, 1u);
+				out << "    " << std::left << std::setw(10) << i << std::right << std::setw(10) << total.updates << std::setw(10) << total.cacheRebuilds
+					<< std::setw(14) << static_cast<double>(total.draws) / updates << std::setw(12) << total.gpuMilliseconds / updates << std::setw(12)
+					<< total.gpuMilliseconds / frames << "\n";
+				shadowMilliseconds += total.gpuMilliseconds;
+			}//for
+			out << "    shadow maps " << shadowMilliseconds / frames << " ms/frame, camera depth " << cameraMilliseconds / frames << " ms/frame, depth reduce "
+				<< reduceMilliseconds / frames << " ms/frame\n";
+
+			gpuTimer.destroy();
+			vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+			cameraBuffer.destroy();
+			vkDestroyFramebuffer(logicalDevice, cameraFrameBuffer, nullptr);
+			vkDestroyImageView(logicalDevice, cameraDepthView, nullptr);
+			vkDestroyImage(logicalDevice, cameraDepth, nullptr);
+			vkFreeMemory(logicalDevice, cameraDepthMemory, nullptr);
+			shadows.destroy();
+		}//for
+		out.flags(flags);
+		out.precision(precision);
+
+		vertexBuffer.destroy();
+		indexBuffer.destroy();
+	}
+}//vks
@@ -0,0 +1,182 @@
+/*
+* Cascaded shadow maps
+*
+* Practical split scheme with texel snapped, rotation invariant cascade projections, single pass caster culling
+* against all cascades, reduced update rates for distant cascades and a static caster cache per cascade
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <array>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanGpuTimer.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#define SHADOW_MAP_MAX_CASCADE_COUNT 4
+
+namespace vks
+{
+	class CascadedShadowMap
+	{
+	public:
+		struct Settings
+		{
+			uint32_t cascadeCount = SHADOW_MAP_MAX_CASCADE_COUNT;
+			uint32_t mapSize = 2048;
+			/** @brief Blend between logarithmic (1.0) and uniform (0.0) split distribution */
+			float splitLambda = 0.95f;
+			/** @brief Cascade i is re-rendered every updateIntervals[i] frames */
+			std::array<uint32_t, SHADOW_MAP_MAX_CASCADE_COUNT> updateIntervals = { 1, 1, 2, 4 };
+			/** @brief Render static casters once into a cache layer and only redraw dynamic casters */
+			bool cacheStaticCasters = true;
+			/** @brief Fit the split range to the visible depth range reduced on the GPU (previous frame) */
+			bool fitToDepthRange = false;
+			float depthBiasConstant = 1.25f;
+			float depthBiasSlope = 1.75f;
+		} settings;
+
+		struct Cascade
+		{
+			/** @brief Negative view space depth at which this cascade ends (same convention as shadowmappingcascade/scene.frag) */
+			float splitDepth = 0.0f;
+			glm::mat4 viewProjMatrix = glm::mat4(1.0f);
+			glm::vec3 lightSpaceCenter = glm::vec3(0.0f);
+			float radius = 0.0f;
+			/** @brief Distance the projection was extended toward the light to keep casters outside the cascade volume */
+			float nearExtension = 0.0f;
+			/** @brief Matrix the static cache layer was rendered with, the cache is rebuilt when it changes */
+			glm::mat4 cachedViewProjMatrix = glm::mat4(0.0f);
+			bool cacheValid = false;
+			VkImageView view = VK_NULL_HANDLE;
+			VkImageView cacheView = VK_NULL_HANDLE;
+			VkFramebuffer frameBuffer = VK_NULL_HANDLE;
+			VkFramebuffer cacheFrameBuffer = VK_NULL_HANDLE;
+		};
+
+		struct Caster
+		{
+			glm::vec3 center;
+			float radius;
+			bool isStatic;
+			bool active;
+			/** @brief Bit i is set if the caster overlaps cascade i, filled by cullCasters */
+			uint32_t cascadeMask;
+		};
+
+		struct CascadeStats
+		{
+			bool updated = false;
+			bool cacheRebuilt = false;
+			uint32_t staticDraws = 0;
+			uint32_t dynamicDraws = 0;
+			double gpuMilliseconds = 0.0;
+		};
+
+		/** @brief Push constant block, matches shadowmappingcascade/depthpass.vert */
+		struct PushConstants
+		{
+			glm::vec4 position;
+			uint32_t cascadeIndex;
+		};
+
+		/** @brief Records the draw of a single caster, the cascade index push constant is already set */
+		std::function<void(VkCommandBuffer commandBuffer, uint32_t casterIndex)> drawCaster;
+
+		vks::VulkanDevice* device = nullptr;
+		VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		/** @brief Array view over all cascades for sampling */
+		VkImageView arrayView = VK_NULL_HANDLE;
+		VkImage cacheImage = VK_NULL_HANDLE;
+		VkDeviceMemory cacheMemory = VK_NULL_HANDLE;
+		VkSampler sampler = VK_NULL_HANDLE;
+		VkDescriptorImageInfo descriptor{};
+
+		/** @brief Clears and renders static casters into a cache layer (ends in transfer source layout) */
+		VkRenderPass cacheRenderPass = VK_NULL_HANDLE;
+		/** @brief Clears and renders all casters (used when there is no valid cache) */
+		VkRenderPass clearRenderPass = VK_NULL_HANDLE;
+		/** @brief Keeps the copied cache contents and adds dynamic casters */
+		VkRenderPass loadRenderPass = VK_NULL_HANDLE;
+
+		/** @brief Uniform buffer with the cascade matrices, matches the UBO of shadowmappingcascade/depthpass.vert */
+		vks::Buffer uniformBuffer;
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+
+		/** @brief GPU depth range reduction used when settings.fitToDepthRange is enabled */
+		struct
+		{
+			vks::Buffer result;
+			VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+			VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			bool valid = false;
+		} depthReduce;
+
+		std::array<Cascade, SHADOW_MAP_MAX_CASCADE_COUNT> cascades;
+		std::array<CascadeStats, SHADOW_MAP_MAX_CASCADE_COUNT> stats;
+		std::vector<Caster> casters;
+
+		vks::GpuTimer gpuTimer;
+
+		void prepare(vks::VulkanDevice* device, VkQueue queue, const std::string& shadersPath, VkPipelineCache pipelineCache, uint32_t frameCount = 1);
+		void preparePipeline(VkPipelineCache pipelineCache, const std::vector<VkPipelineShaderStageCreateInfo>& shaderStages,
+			const VkPipelineVertexInputStateCreateInfo& vertexInputState, const std::vector<VkDescriptorSetLayout>& additionalSetLayouts = {});
+		void destroy();
+
+		uint32_t addCaster(const glm::vec3& center, float radius, bool isStatic);
+		void updateCaster(uint32_t index, const glm::vec3& center, float radius);
+		void removeCaster(uint32_t index);
+		void invalidateCache();
+
+		void setDepthSource(VkImageView depthView, VkSampler depthSampler, uint32_t width, uint32_t height);
+
+		void update(const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar, const glm::vec3& lightDir);
+		void recordDepthReduce(VkCommandBuffer commandBuffer, float zNear, float zFar);
+		void recordShadowPasses(VkCommandBuffer commandBuffer);
+		/** @brief Resolve the GPU times of the previously recorded frame, call before recording the next one */
+		void collectStats();
+
+		static void computeSplits(float zNear, float zFar, float lambda, uint32_t cascadeCount, float* splits);
+
+	private:
+		uint64_t frameIndex = 0;
+		std::array<bool, SHADOW_MAP_MAX_CASCADE_COUNT> updateScheduled{};
+		std::array<uint32_t, SHADOW_MAP_MAX_CASCADE_COUNT> timerScopes{};
+		glm::mat4 lightRotation = glm::mat4(1.0f);
+		glm::vec3 lastLightDir = glm::vec3(0.0f);
+
+		void createImages(VkQueue queue);
+		void createRenderPasses();
+		void cullCasters();
+		void drawCasters(VkCommandBuffer commandBuffer, uint32_t cascadeIndex, bool staticCasters, uint32_t& drawCount);
+	};
+
+	/**
+	* @brief Renders a generated scene into the cascades once with every cascade updated every frame and once with reduced update rates,
+	* the static caster cache and the depth fit, and reports updates, cache rebuilds, draws and GPU time per cascade
+	*/
+	void benchmarkCascadedShadows(vks::VulkanDevice* device, VkQueue queue, const std::string& shadersPath, std::ostream& out, uint32_t frames = 600);
+}//vks
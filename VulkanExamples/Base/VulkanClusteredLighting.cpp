@@ -0,0 +1,523 @@
+/*
+* Clustered light culling
+*
+* Assigns lights to view space froxel clusters on the GPU and exposes a compact light index list
+* that deferred or forward+ shading passes read instead of looping over every light
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanClusteredLighting.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iterator>
+#include <random>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace vks
+{
+	namespace
+	{
+		// Local sizes must match cluster_build.comp and light_cull.comp
+		const uint32_t clusterBuildGroupSize = 64;
+
+		glm::vec3 viewRayAtDepth(const glm::mat4& inverseProjection, glm::vec2 ndc, float depth)
+		{
+			glm::vec4 p = inverseProjection * glm::vec4(ndc, 1.0f, 1.0f);
+			glm::vec3 ray = glm::vec3(p) / p.w;
+			// View space looks down -z, scale the ray so that it ends on the z = -depth plane
+			return ray * (-depth / ray.z);
+		}
+
+		float sphereAABBDistance2(const glm::vec3& center, const ClusteredLighting::ClusterAABB& aabb)
+		{
+			glm::vec3 d = glm::max(glm::vec3(0.0f), glm::max(glm::vec3(aabb.min) - center, center - glm::vec3(aabb.max)));
+			return glm::dot(d, d);
+		}
+
+		/** Random lights inside the view frustum of params, up to a thousand times the near plane distance away */
+		std::vector<ClusteredLighting::Light> randomLights(const ClusteredLighting::Params& params, uint32_t count, std::default_random_engine& rndEngine)
+		{
+			const float zNear = params.screen.z;
+			const float zFar = std::min(params.screen.w, zNear * 1000.0f);
+			std::uniform_real_distribution<float> rndNdc(-1.0f, 1.0f);
+			std::uniform_real_distribution<float> rndDepth(zNear, zFar);
+			std::uniform_real_distribution<float> rndRadius(0.5f, 4.0f);
+			std::uniform_real_distribution<float> rndColor(0.0f, 1.0f);
+			const glm::mat4 inverseView = glm::inverse(params.view);
+			std::vector<ClusteredLighting::Light> lights(count);
+			for (ClusteredLighting::Light& light : lights)
+			{
+				glm::vec3 viewPos = viewRayAtDepth(params.inverseProjection, glm::vec2(rndNdc(rndEngine), rndNdc(rndEngine)), rndDepth(rndEngine));
+				light.positionRadius = glm::vec4(glm::vec3(inverseView * glm::vec4(viewPos, 1.0f)), rndRadius(rndEngine));
+				light.colorIntensity = glm::vec4(rndColor(rndEngine), rndColor(rndEngine), rndColor(rndEngine), 1.0f);
+			}
+			return lights;
+		}
+	}
+
+	/**
+	* Create buffers, descriptors and compute pipelines
+	*
+	* @param device Device to create the resources on
+	* @param pipelineCache Pipeline cache used for the compute pipelines
+	* @param shadersPath Base path of the GLSL shaders (getShadersPath())
+	* @param frameCount Number of command buffers the culling gets recorded into, used for the GPU timer query ranges
+	*/
+	void ClusteredLighting::prepare(vks::VulkanDevice* device, VkPipelineCache pipelineCache, const std::string& shadersPath, uint32_t frameCount)
+	{
+		this->device = device;
+
+		const uint32_t clusterCount = getClusterCount();
+		const uint32_t indexCapacity = clusterCount * settings.averageLightsPerCluster;
+
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&uniformBuffer, sizeof(Params)));
+		VK_CHECK_RESULT(uniformBuffer.map());
+		// Lights are rewritten by the host every frame, so they stay in host visible memory
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&lightBuffer, settings.maxLights * sizeof(Light)));
+		VK_CHECK_RESULT(lightBuffer.map());
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&clusterBuffer, clusterCount * sizeof(ClusterAABB)));
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&clusterRangeBuffer, clusterCount * sizeof(ClusterRange)));
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&lightIndexBuffer, indexCapacity * sizeof(uint32_t)));
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &counterBuffer, sizeof(uint32_t)));
+
+		params = {};
+		params.gridSize = glm::uvec4(settings.gridX, settings.gridY, settings.gridZ, 0);
+		params.slicing.z = static_cast<float>(settings.maxLightsPerCluster);
+		params.slicing.w = static_cast<float>(indexCapacity);
+
+		setupDescriptors();
+		preparePipelines(pipelineCache, shadersPath);
+
+		// Two scopes per frame: cluster build and light culling
+		gpuTimer.create(device, 4, frameCount);
+	}
+
+	void ClusteredLighting::destroy()
+	{
+		if (!device)
+		{
+			return;
+		}
+		VkDevice logicalDevice = device->logicalDevice;
+		vkDestroyPipeline(logicalDevice, pipelineBuildClusters, nullptr);
+		vkDestroyPipeline(logicalDevice, pipelineCullLights, nullptr);
+		vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(logicalDevice, computeSetLayout, nullptr);
+		vkDestroyDescriptorSetLayout(logicalDevice, shadingSetLayout, nullptr);
+		vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+		uniformBuffer.destroy();
+		lightBuffer.destroy();
+		clusterBuffer.destroy();
+		clusterRangeBuffer.destroy();
+		lightIndexBuffer.destroy();
+		counterBuffer.destroy();
+		gpuTimer.destroy();
+		device = nullptr;
+	}
+
+	void ClusteredLighting::setupDescriptors()
+	{
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8),
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::GenDescriptorPoolCreateInfo(poolSizes, 2);
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+
+		// Compute set used by cluster_build.comp and light_cull.comp
+		std::vector<VkDescriptorSetLayoutBinding> computeBindings = {
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 5),
+		};
+		VkDescriptorSetLayoutCreateInfo layoutInfo = vks::initializers::GenDescriptorSetLayoutCreateInfo(computeBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &layoutInfo, nullptr, &computeSetLayout));
+
+		// Shading set, read by deferred composition or forward+ fragment shaders
+		std::vector<VkDescriptorSetLayoutBinding> shadingBindings = {
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 3),
+		};
+		layoutInfo = vks::initializers::GenDescriptorSetLayoutCreateInfo(shadingBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &layoutInfo, nullptr, &shadingSetLayout));
+
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &computeSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &computeSet));
+		allocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &shadingSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &shadingSet));
+
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::GenWriteDescriptorSet(computeSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(computeSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &lightBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(computeSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &clusterBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(computeSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &clusterRangeBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(computeSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &lightIndexBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(computeSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &counterBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(shadingSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(shadingSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &lightBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(shadingSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &clusterRangeBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(shadingSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &lightIndexBuffer.descriptorBufferInfo),
+		};
+		vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
+	void ClusteredLighting::preparePipelines(VkPipelineCache pipelineCache, const std::string& shadersPath)
+	{
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = vks::initializers::GenPipelineLayoutCreateInfo(&computeSetLayout, 1);
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+
+		VkComputePipelineCreateInfo pipelineInfo = vks::initializers::GenComputePipelineCreateInfo(pipelineLayout);
+
+		pipelineInfo.stage = vks::tools::loadShaderStage(shadersPath + "clusteredlighting/cluster_build.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT, device->logicalDevice);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &pipelineBuildClusters));
+		vkDestroyShaderModule(device->logicalDevice, pipelineInfo.stage.module, nullptr);
+
+		// The per cluster shared light list is sized through a specialization constant
+		uint32_t maxLightsPerCluster = settings.maxLightsPerCluster;
+		VkSpecializationMapEntry specializationEntry = vks::initializers::GenSpecializationMapEntry(0, 0, sizeof(uint32_t));
+		VkSpecializationInfo specializationInfo = vks::initializers::GenSpecializationInfo(1, &specializationEntry, sizeof(uint32_t), &maxLightsPerCluster);
+		pipelineInfo.stage = vks::tools::loadShaderStage(shadersPath + "clusteredlighting/light_cull.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT, device->logicalDevice);
+		pipelineInfo.stage.pSpecializationInfo = &specializationInfo;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &pipelineCullLights));
+		vkDestroyShaderModule(device->logicalDevice, pipelineInfo.stage.module, nullptr);
+	}
+
+	/**
+	* Copy the active light set into the mapped light buffer
+	*
+	* @note Lights beyond settings.maxLights are ignored
+	*/
+	void ClusteredLighting::setLights(const std::vector<Light>& lights)
+	{
+		lightCount = std::min(static_cast<uint32_t>(lights.size()), settings.maxLights);
+		if (lightCount > 0)
+		{
+			memcpy(lightBuffer.mappedData, lights.data(), lightCount * sizeof(Light));
+		}
+		params.gridSize.w = lightCount;
+		memcpy(uniformBuffer.mappedData, &params, sizeof(Params));
+	}
+
+	/**
+	* Update the view dependent parameters, call whenever the camera changes
+	*/
+	void ClusteredLighting::updateView(const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar, uint32_t width, uint32_t height)
+	{
+		params.view = view;
+		params.inverseProjection = glm::inverse(projection);
+		params.screen = glm::vec4(static_cast<float>(width), static_cast<float>(height), zNear, zFar);
+		// Exponential depth slicing: slice = log(z) * scale + bias
+		const float logRatio = std::log(zFar / zNear);
+		params.slicing.x = static_cast<float>(settings.gridZ) / logRatio;
+		params.slicing.y = -static_cast<float>(settings.gridZ) * std::log(zNear) / logRatio;
+		memcpy(uniformBuffer.mappedData, &params, sizeof(Params));
+	}
+
+	/**
+	* Record cluster bound generation and light culling into a command buffer
+	*
+	* @note Resets the GPU timer for the current frame, shading passes can add their own scopes to gpuTimer afterwards
+	* @note Results are made visible to fragment and compute shader reads
+	*/
+	void ClusteredLighting::recordCulling(VkCommandBuffer commandBuffer)
+	{
+		const uint32_t clusterCount = getClusterCount();
+
+		gpuTimer.reset(commandBuffer);
+
+		// Previous readers of the light lists must be done before they are overwritten
+		VkMemoryBarrier memoryBarrier = vks::initializers::GenMemoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		vkCmdFillBuffer(commandBuffer, counterBuffer.buffer, 0, sizeof(uint32_t), 0);
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &computeSet, 0, nullptr);
+
+		// Cluster bounds only depend on the projection, but rebuilding them is a few thousand invocations
+		// and keeps prebuilt command buffers valid across resizes
+		uint32_t scope = gpuTimer.beginScope(commandBuffer, "Cluster build");
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineBuildClusters);
+		vkCmdDispatch(commandBuffer, (clusterCount + clusterBuildGroupSize - 1) / clusterBuildGroupSize, 1, 1);
+		gpuTimer.endScope(commandBuffer, scope);
+
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		// One workgroup per cluster
+		scope = gpuTimer.beginScope(commandBuffer, "Light culling");
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineCullLights);
+		vkCmdDispatch(commandBuffer, clusterCount, 1, 1);
+		gpuTimer.endScope(commandBuffer, scope);
+
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	uint32_t ClusteredLighting::getClusterCount() const
+	{
+		return settings.gridX * settings.gridY * settings.gridZ;
+	}
+
+	void ClusteredLighting::buildClustersCPU(const Params& params, std::vector<ClusterAABB>& clusters)
+	{
+		const glm::uvec3 grid = glm::uvec3(params.gridSize.x, params.gridSize.y, params.gridSize.z);
+		const float zNear = params.screen.z;
+		const float zFar = params.screen.w;
+		clusters.resize(grid.x * grid.y * grid.z);
+		for (uint32_t z = 0; z < grid.z; z++)
+		{
+			const float sliceNear = zNear * std::pow(zFar / zNear, static_cast<float>(z) / grid.z);
+			const float sliceFar = zNear * std::pow(zFar / zNear, static_cast<float>(z + 1) / grid.z);
+			for (uint32_t y = 0; y < grid.y; y++)
+			{
+				for (uint32_t x = 0; x < grid.x; x++)
+				{
+					const glm::vec2 ndcMin = glm::vec2(-1.0f) + 2.0f * glm::vec2(static_cast<float>(x) / grid.x, static_cast<float>(y) / grid.y);
+					const glm::vec2 ndcMax = glm::vec2(-1.0f) + 2.0f * glm::vec2(static_cast<float>(x + 1) / grid.x, static_cast<float>(y + 1) / grid.y);
+					const glm::vec3 corners[4] = {
+						viewRayAtDepth(params.inverseProjection, ndcMin, sliceNear),
+						viewRayAtDepth(params.inverseProjection, ndcMax, sliceNear),
+						viewRayAtDepth(params.inverseProjection, ndcMin, sliceFar),
+						viewRayAtDepth(params.inverseProjection, ndcMax, sliceFar),
+					};
+					ClusterAABB& aabb = clusters[x + grid.x * (y + grid.y * z)];
+					glm::vec3 minCorner = corners[0];
+					glm::vec3 maxCorner = corners[0];
+					for (uint32_t i = 1; i < 4; i++)
+					{
+						minCorner = glm::min(minCorner, corners[i]);
+						maxCorner = glm::max(maxCorner, corners[i]);
+					}
+					aabb.min = glm::vec4(minCorner, 0.0f);
+					aabb.max = glm::vec4(maxCorner, 0.0f);
+				}//for x
+			}//for y
+		}//for z
+	}
+
+	void ClusteredLighting::binLightsCPU(const Params& params, const std::vector<ClusterAABB>& clusters, const std::vector<Light>& lights,
+		std::vector<ClusterRange>& ranges, std::vector<uint32_t>& indices)
+	{
+		const uint32_t maxLightsPerCluster = static_cast<uint32_t>(params.slicing.z);
+		const uint32_t lightCount = std::min(params.gridSize.w, static_cast<uint32_t>(lights.size()));
+
+		std::vector<glm::vec4> viewLights(lightCount);
+		for (uint32_t i = 0; i < lightCount; i++)
+		{
+			viewLights[i] = glm::vec4(glm::vec3(params.view * glm::vec4(glm::vec3(lights[i].positionRadius), 1.0f)), lights[i].positionRadius.w);
+		}
+
+		ranges.resize(clusters.size());
+		indices.clear();
+		for (size_t c = 0; c < clusters.size(); c++)
+		{
+			ranges[c].offset = static_cast<uint32_t>(indices.size());
+			ranges[c].count = 0;
+			for (uint32_t i = 0; i < lightCount && ranges[c].count < maxLightsPerCluster; i++)
+			{
+				const float radius = viewLights[i].w;
+				if (sphereAABBDistance2(glm::vec3(viewLights[i]), clusters[c]) <= radius * radius)
+				{
+					indices.push_back(i);
+					ranges[c].count++;
+				}
+			}//for
+		}//for
+	}
+
+	/**
+	* Run the GPU culling for a light set and compare the result against the CPU reference
+	*
+	* @note Blocks on the queue, meant for debugging and automated checks
+	* @note Lights that touch a cluster boundary within float tolerance are not reported as mismatches
+	*
+	* @return True if every cluster holds the same light set on GPU and CPU
+	*/
+	bool ClusteredLighting::validate(VkQueue queue, const std::vector<Light>& lights)
+	{
+		setLights(lights);
+
+		VkCommandBuffer commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		recordCulling(commandBuffer);
+		device->FlushCommandBuffer(commandBuffer, queue);
+
+		// Read back the GPU results
+		vks::Buffer rangeReadback, indexReadback, counterReadback;
+		const VkMemoryPropertyFlags hostFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostFlags, &rangeReadback, clusterRangeBuffer.size));
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostFlags, &indexReadback, lightIndexBuffer.size));
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostFlags, &counterReadback, counterBuffer.size));
+		device->CopyBuffer(&clusterRangeBuffer, &rangeReadback, queue);
+		device->CopyBuffer(&lightIndexBuffer, &indexReadback, queue);
+		device->CopyBuffer(&counterBuffer, &counterReadback, queue);
+		VK_CHECK_RESULT(rangeReadback.map());
+		VK_CHECK_RESULT(indexReadback.map());
+		VK_CHECK_RESULT(counterReadback.map());
+		const ClusterRange* gpuRanges = static_cast<const ClusterRange*>(rangeReadback.mappedData);
+		const uint32_t* gpuIndices = static_cast<const uint32_t*>(indexReadback.mappedData);
+		const uint32_t requested = *static_cast<const uint32_t*>(counterReadback.mappedData);
+		const uint32_t capacity = static_cast<uint32_t>(params.slicing.w);
+
+		std::vector<ClusterAABB> clusters;
+		std::vector<ClusterRange> cpuRanges;
+		std::vector<uint32_t> cpuIndices;
+		buildClustersCPU(params, clusters);
+		binLightsCPU(params, clusters, lights, cpuRanges, cpuIndices);
+
+		std::vector<glm::vec4> viewLights(lightCount);
+		for (uint32_t i = 0; i < lightCount; i++)
+		{
+			viewLights[i] = glm::vec4(glm::vec3(params.view * glm::vec4(glm::vec3(lights[i].positionRadius), 1.0f)), lights[i].positionRadius.w);
+		}
+		auto isBorderline = [&](uint32_t light, const ClusterAABB& aabb)
+		{
+			const float r2 = viewLights[light].w * viewLights[light].w;
+			return std::abs(sphereAABBDistance2(glm::vec3(viewLights[light]), aabb) - r2) <= 1e-3f * std::max(r2, 1.0f);
+		};
+
+		uint32_t mismatches = 0;
+		for (size_t c = 0; c < clusters.size(); c++)
+		{
+			const uint32_t count = std::min(gpuRanges[c].count, settings.maxLightsPerCluster);
+			std::vector<uint32_t> gpuSet(gpuIndices + gpuRanges[c].offset, gpuIndices + gpuRanges[c].offset + count);
+			std::vector<uint32_t> cpuSet(cpuIndices.begin() + cpuRanges[c].offset, cpuIndices.begin() + cpuRanges[c].offset + cpuRanges[c].count);
+			// Clusters that hit either limit keep an arbitrary subset on the GPU, only the count can be checked
+			if (cpuRanges[c].count >= settings.maxLightsPerCluster || requested > capacity)
+			{
+				continue;
+			}
+			std::sort(gpuSet.begin(), gpuSet.end());
+			std::vector<uint32_t> difference;
+			std::set_symmetric_difference(gpuSet.begin(), gpuSet.end(), cpuSet.begin(), cpuSet.end(), std::back_inserter(difference));
+			for (uint32_t light : difference)
+			{
+				if (light >= lightCount || !isBorderline(light, clusters[c]))
+				{
+					mismatches++;
+				}
+			}//for
+		}//for
+
+		if (requested > capacity)
+		{
+			std::cout << "Clustered lighting: light index list overflow (" << requested << " requested, capacity " << capacity << ")\n";
+		}
+		std::cout << "Clustered lighting validation: " << lightCount << " lights, " << clusters.size() << " clusters, "
+			<< cpuIndices.size() << " CPU references, " << requested << " GPU references, " << mismatches << " mismatches\n";
+
+		rangeReadback.destroy();
+		indexReadback.destroy();
+		counterReadback.destroy();
+
+		return mismatches == 0;
+	}
+
+	/**
+	* Measure GPU culling time for different light counts
+	*
+	* @note Replaces the active light set with random lights inside the current view frustum
+	*
+	* @return Pairs of light count and average culling time (cluster build + light culling) in milliseconds
+	*/
+	std::vector<std::pair<uint32_t, double>> ClusteredLighting::benchmarkLightCounts(VkQueue queue, const std::vector<uint32_t>& counts)
+	{
+		const uint32_t iterations = 16;
+		std::vector<std::pair<uint32_t, double>> timings;
+		if (!gpuTimer.supported)
+		{
+			return timings;
+		}
+
+		std::default_random_engine rndEngine(0);
+		const uint32_t frame = gpuTimer.currentFrame;
+		for (uint32_t count : counts)
+		{
+			setLights(randomLights(params, std::min(count, settings.maxLights), rndEngine));
+
+			double total = 0.0;
+			for (uint32_t i = 0; i < iterations; i++)
+			{
+				VkCommandBuffer commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+				recordCulling(commandBuffer);
+				device->FlushCommandBuffer(commandBuffer, queue);
+				gpuTimer.collect(true);
+				total += gpuTimer.getMilliseconds("Cluster build") + gpuTimer.getMilliseconds("Light culling");
+			}//for
+			timings.push_back(std::make_pair(lightCount, total / iterations));
+		}//for
+		gpuTimer.currentFrame = frame;
+		return timings;
+	}
+
+	/**
+	* @param device Device the culling runs on
+	* @param queue Queue the culling is submitted to
+	* @param shadersPath Base path of the GLSL shaders (getShadersPath())
+	* @param out Stream the report is written to
+	*/
+	void benchmarkClusteredLighting(vks::VulkanDevice* device, VkQueue queue, const std::string& shadersPath, std::ostream& out)
+	{
+		const uint32_t width = 1920;
+		const uint32_t height = 1080;
+		const float zNear = 0.1f;
+		const float zFar = 256.0f;
+		const std::vector<uint32_t> counts = { 256, 1024, 4096, 16384 };
+
+		ClusteredLighting lighting;
+		lighting.prepare(device, VK_NULL_HANDLE, shadersPath);
+		const glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 8.0f, 24.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		const glm::mat4 projection = glm::perspective(glm::radians(60.0f), static_cast<float>(width) / static_cast<float>(height), zNear, zFar);
+		lighting.updateView(view, projection, zNear, zFar, width, height);
+
+		std::ios_base::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+		out << std::fixed << std::setprecision(3);
+		out << "Clustered lighting: " << lighting.settings.gridX << " x " << lighting.settings.gridY << " x " << lighting.settings.gridZ << " clusters at "
+			<< width << " x " << height << ", random lights in the view frustum\n";
+
+		// GPU lists against the CPU reference before anything is timed
+		std::default_random_engine rndEngine(1);
+		const bool valid = lighting.validate(queue, randomLights(lighting.params, 1024, rndEngine));
+
+		std::vector<std::pair<uint32_t, double>> timings = lighting.benchmarkLightCounts(queue, counts);
+		if (timings.empty())
+		{
+			out << "  Timestamp queries are not supported, no timings\n";
+		}
+		else
+		{
+			out << "  " << std::left << std::setw(12) << "lights" << std::right << std::setw(12) << "cull ms" << std::setw(14) << "ns per light" << "\n";
+			for (const std::pair<uint32_t, double>& timing : timings)
+			{
+				out << "  " << std::left << std::setw(12) << timing.first << std::right << std::setw(12) << timing.second << std::setw(14)
+					<< timing.second * 1e6 / std::max(timing.first, 1u) << "\n";
+			}
+		}
+		out << "  validation " << (valid ? "passed" : "failed") << "\n";
+		out.flags(flags);
+		out.precision(precision);
+
+		lighting.destroy();
+	}
+}//vks
@@ -0,0 +1,131 @@
+/*
+* Clustered light culling
+*
+* Assigns lights to view space froxel clusters on the GPU and exposes a compact light index list
+* that deferred or forward+ shading passes read instead of looping over every light
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanGpuTimer.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	class ClusteredLighting
+	{
+	public:
+		/** @brief Light layout as consumed by the shaders (std430), position and radius are in world space */
+		struct Light
+		{
+			glm::vec4 positionRadius;
+			glm::vec4 colorIntensity;
+		};
+
+		/** @brief Per cluster range into the light index list */
+		struct ClusterRange
+		{
+			uint32_t offset;
+			uint32_t count;
+		};
+
+		/** @brief View space bounding box of a single cluster (std430, w unused) */
+		struct ClusterAABB
+		{
+			glm::vec4 min;
+			glm::vec4 max;
+		};
+
+		struct Settings
+		{
+			uint32_t gridX = 16;
+			uint32_t gridY = 9;
+			uint32_t gridZ = 24;
+			uint32_t maxLights = 16384;
+			/** @brief Lights beyond this count are dropped from a cluster */
+			uint32_t maxLightsPerCluster = 256;
+			/** @brief Size of the global light index list in multiples of the cluster count */
+			uint32_t averageLightsPerCluster = 64;
+		} settings;
+
+		/** @brief Uniform block shared by the culling and shading shaders (std140) */
+		struct Params
+		{
+			glm::mat4 view;
+			glm::mat4 inverseProjection;
+			/** @brief Cluster grid dimensions in xyz, active light count in w */
+			glm::uvec4 gridSize;
+			/** @brief Framebuffer width, height, near and far plane */
+			glm::vec4 screen;
+			/** @brief Depth slice scale, bias, max lights per cluster and index list capacity */
+			glm::vec4 slicing;
+		} params;
+
+		vks::VulkanDevice* device = nullptr;
+
+		vks::Buffer uniformBuffer;
+		vks::Buffer lightBuffer;
+		vks::Buffer clusterBuffer;
+		vks::Buffer clusterRangeBuffer;
+		vks::Buffer lightIndexBuffer;
+		/** @brief Single uint allocation counter for the light index list, cleared every frame */
+		vks::Buffer counterBuffer;
+
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		/** @brief Layout used by the culling compute shaders */
+		VkDescriptorSetLayout computeSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSet computeSet = VK_NULL_HANDLE;
+		/** @brief Layout and set to bind from shading passes (see clusteredlighting/clusters.glsl) */
+		VkDescriptorSetLayout shadingSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSet shadingSet = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipelineBuildClusters = VK_NULL_HANDLE;
+		VkPipeline pipelineCullLights = VK_NULL_HANDLE;
+
+		vks::GpuTimer gpuTimer;
+
+		uint32_t lightCount = 0;
+
+		void prepare(vks::VulkanDevice* device, VkPipelineCache pipelineCache, const std::string& shadersPath, uint32_t frameCount = 1);
+		void destroy();
+
+		void setLights(const std::vector<Light>& lights);
+		void updateView(const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar, uint32_t width, uint32_t height);
+
+		void recordCulling(VkCommandBuffer commandBuffer);
+
+		uint32_t getClusterCount() const;
+
+		/** @brief CPU reference implementation of the cluster bounds, matches cluster_build.comp */
+		static void buildClustersCPU(const Params& params, std::vector<ClusterAABB>& clusters);
+		/** @brief CPU reference implementation of the light binning, matches light_cull.comp */
+		static void binLightsCPU(const Params& params, const std::vector<ClusterAABB>& clusters, const std::vector<Light>& lights,
+			std::vector<ClusterRange>& ranges, std::vector<uint32_t>& indices);
+
+		bool validate(VkQueue queue, const std::vector<Light>& lights);
+		std::vector<std::pair<uint32_t, double>> benchmarkLightCounts(VkQueue queue, const std::vector<uint32_t>& counts);
+
+	private:
+		void setupDescriptors();
+		void preparePipelines(VkPipelineCache pipelineCache, const std::string& shadersPath);
+	};
+
+	/**
+	* @brief Validates the GPU light lists against the CPU reference, then reports the culling time of increasing light counts
+	*/
+	void benchmarkClusteredLighting(vks::VulkanDevice* device, VkQueue queue, const std::string& shadersPath, std::ostream& out);
+}//vks
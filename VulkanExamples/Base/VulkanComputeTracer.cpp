@@ -0,0 +1,942 @@
+/*
+* Compute shader path tracer
+*
+* Traces the triangles of glTF models through a BVH with compute shaders only, so reference renders and bakes work on devices
+* without ray tracing hardware. The BVH is built on the CPU with binned SAH splits and flattened into a node array the shaders
+* walk with a short stack. Paths are traced as wavefronts: every bounce is a trace pass over a ray queue followed by a shade
+* pass that appends the continued rays to the other queue, the trace pass runs persistent threads that fetch rays until the
+* queue is drained
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanComputeTracer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <utility>
+
+#include "ParallelAlgorithms.hpp"
+
+namespace vks
+{
+	namespace
+	{
+		// Matches local_size_x of bvh_generate.comp, bvh_trace.comp and bvh_shade.comp
+		const uint32_t tracerGroupSize = 64;
+		// Matches local_size_x/y of bvh_resolve.comp
+		const uint32_t resolveGroupSize = 8;
+		// Matches the ray epsilon of bvh.glsl
+		const float rayMinDistance = 1e-4f;
+		const float missDistance = 1e30f;
+
+		struct Bounds
+		{
+			glm::vec3 min = glm::vec3(FLT_MAX);
+			glm::vec3 max = glm::vec3(-FLT_MAX);
+
+			void grow(const glm::vec3& point)
+			{
+				min = glm::min(min, point);
+				max = glm::max(max, point);
+			}
+
+			void grow(const Bounds& other)
+			{
+				min = glm::min(min, other.min);
+				max = glm::max(max, other.max);
+			}
+
+			float area() const
+			{
+				if (min.x > max.x)
+				{
+					return 0.0f;
+				}
+				const glm::vec3 size = max - min;
+				return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+			}
+		};
+
+		struct Bin
+		{
+			Bounds bounds;
+			uint32_t count = 0;
+		};
+
+		uint32_t packColor(const glm::vec4& color)
+		{
+			uint32_t packed = 0;
+			for (int i = 0; i < 4; i++)
+			{
+				const float channel = std::min(std::max(color[i], 0.0f), 1.0f);
+				packed |= static_cast<uint32_t>(channel * 255.0f + 0.5f) << (8 * i);
+			}
+			return packed;
+		}
+
+		/** Bin index of a centroid along an axis, the same for binning and partitioning so both agree on the split */
+		uint32_t binIndex(float centroid, float axisMin, float scale, uint32_t binCount)
+		{
+			return std::min(static_cast<uint32_t>((centroid - axisMin) * scale), binCount - 1);
+		}
+
+		/** Distance along the ray to the box or missDistance, same slab test as bvh_trace.comp */
+		float intersectBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec3& origin, const glm::vec3& inverseDirection, float tBest)
+		{
+			const glm::vec3 t0 = (boundsMin - origin) * inverseDirection;
+			const glm::vec3 t1 = (boundsMax - origin) * inverseDirection;
+			const glm::vec3 tSmall = glm::min(t0, t1);
+			const glm::vec3 tLarge = glm::max(t0, t1);
+			const float tNear = std::max(std::max(std::max(tSmall.x, tSmall.y), tSmall.z), 0.0f);
+			const float tFar = std::min(std::min(tLarge.x, tLarge.y), tLarge.z);
+			return ((tFar >= tNear) && (tNear < tBest)) ? tNear : missDistance;
+		}
+
+		/** Moeller-Trumbore, same as bvh_trace.comp */
+		bool intersectTriangle(const bvh::Triangle& triangle, const glm::vec3& origin, const glm::vec3& direction, float& tBest)
+		{
+			const glm::vec3 edge1 = glm::vec3(triangle.edge1);
+			const glm::vec3 edge2 = glm::vec3(triangle.edge2);
+			const glm::vec3 pvec = glm::cross(direction, edge2);
+			const float det = glm::dot(edge1, pvec);
+			if (std::abs(det) < 1e-12f)
+			{
+				return false;
+			}
+			const float inverseDet = 1.0f / det;
+			const glm::vec3 tvec = origin - triangle.v0;
+			const float u = glm::dot(tvec, pvec) * inverseDet;
+			if ((u < 0.0f) || (u > 1.0f))
+			{
+				return false;
+			}
+			const glm::vec3 qvec = glm::cross(tvec, edge1);
+			const float v = glm::dot(direction, qvec) * inverseDet;
+			if ((v < 0.0f) || (u + v > 1.0f))
+			{
+				return false;
+			}
+			const float t = glm::dot(edge2, qvec) * inverseDet;
+			if ((t > rayMinDistance) && (t < tBest))
+			{
+				tBest = t;
+				return true;
+			}
+			return false;
+		}
+
+		glm::vec3 triangleMin(const bvh::Triangle& triangle)
+		{
+			return glm::min(triangle.v0, glm::min(triangle.v0 + glm::vec3(triangle.edge1), triangle.v0 + glm::vec3(triangle.edge2)));
+		}
+
+		glm::vec3 triangleMax(const bvh::Triangle& triangle)
+		{
+			return glm::max(triangle.v0, glm::max(triangle.v0 + glm::vec3(triangle.edge1), triangle.v0 + glm::vec3(triangle.edge2)));
+		}
+	}
+
+	namespace bvh
+	{
+		void collectTriangles(const vkglTF::Model& model, std::vector<Triangle>& triangles)
+		{
+			const std::vector<vkglTF::Vertex>& vertices = model.hostGeometry.vertices;
+			const std::vector<uint32_t>& indices = model.hostGeometry.indices;
+			// Primitives of pooled models include the pool offset in their first index
+			const uint32_t indexOffset = model.geometry.valid() ? model.geometry.firstIndex : 0;
+			for (uint32_t slot = 0; slot < model.nodes.slotCount(); slot++)
+			{
+				if (!model.nodes.slotOccupied(slot))
+				{
+					continue;
+				}
+				const vkglTF::Node& node = model.nodes.slot(slot);
+				const vkglTF::Mesh* mesh = model.meshes.get(node.mesh);
+				if (!mesh)
+				{
+					continue;
+				}
+				const glm::mat4 matrix = model.hostGeometry.preTransformed ? glm::mat4(1.0f) : node.worldMatrix;
+				for (const vkglTF::Primitive& primitive : mesh->primitives)
+				{
+					const vkglTF::Material* material = model.materials.get(primitive.material);
+					const uint32_t color = packColor(material ? material->baseColorFactor : glm::vec4(1.0f));
+					const uint32_t firstIndex = primitive.firstIndex - indexOffset;
+					for (uint32_t i = 0; i + 2 < primitive.indexCount; i += 3)
+					{
+						if (firstIndex + i + 2 >= indices.size())
+						{
+							break;
+						}
+						glm::vec3 positions[3];
+						for (uint32_t j = 0; j < 3; j++)
+						{
+							positions[j] = glm::vec3(matrix * glm::vec4(vertices[indices[firstIndex + i + j]].pos, 1.0f));
+						}
+						Triangle triangle;
+						triangle.v0 = positions[0];
+						triangle.color = color;
+						triangle.edge1 = glm::vec4(positions[1] - positions[0], 0.0f);
+						triangle.edge2 = glm::vec4(positions[2] - positions[0], 0.0f);
+						triangles.push_back(triangle);
+					}//for
+				}//for primitive
+			}//for
+		}
+
+		/**
+		* Top down build: every node bins the centroids of its triangles along each axis, takes the bin boundary with the lowest
+		* surface area heuristic and partitions its triangles. Large nodes bin on the parallel pool, the levels below them are
+		* small enough to stay on the calling thread
+		*
+		* @param triangles Triangles to build over, reordered to leaf order
+		* @param nodes Receives the flattened nodes, the root is nodes[0]
+		*/
+		BuildStatistics build(std::vector<Triangle>& triangles, std::vector<Node>& nodes, const BuildSettings& settings)
+		{
+			auto tStart = std::chrono::high_resolution_clock::now();
+			BuildStatistics statistics;
+			nodes.clear();
+			if (triangles.empty())
+			{
+				return statistics;
+			}
+			const uint32_t binCount = std::max(settings.binCount, 2u);
+			const uint32_t triangleCount = static_cast<uint32_t>(triangles.size());
+
+			std::vector<Bounds> triangleBounds(triangleCount);
+			std::vector<glm::vec3> centroids(triangleCount);
+			std::vector<uint32_t> order(triangleCount);
+			// Per triangle passes, on the calling thread only if parallel binning is off as well
+			auto forEachTriangle = [&](const std::function<void(size_t)>& function)
+			{
+				if (settings.parallelThreshold == 0)
+				{
+					for (size_t i = 0; i < triangleCount; i++)
+					{
+						function(i);
+					}
+					return;
+				}
+				vks::parallel::forEachIndex(0, triangleCount, function);
+			};
+			forEachTriangle([&](size_t i)
+			{
+				triangleBounds[i].min = triangleMin(triangles[i]);
+				triangleBounds[i].max = triangleMax(triangles[i]);
+				centroids[i] = (triangleBounds[i].min + triangleBounds[i].max) * 0.5f;
+				order[i] = static_cast<uint32_t>(i);
+			});
+
+			// Bounds and centroid bounds of a range of order, in parallel for large ranges
+			auto measure = [&](uint32_t first, uint32_t count, Bounds& bounds, Bounds& centroidBounds)
+			{
+				auto measureRange = [&](size_t begin, size_t end, Bounds& rangeBounds, Bounds& rangeCentroids)
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						rangeBounds.grow(triangleBounds[order[i]]);
+						rangeCentroids.grow(centroids[order[i]]);
+					}
+				};
+				if ((settings.parallelThreshold == 0) || (count <= settings.parallelThreshold))
+				{
+					measureRange(first, first + count, bounds, centroidBounds);
+					return;
+				}
+				std::mutex mutex;
+				vks::parallel::forRange(first, first + count, [&](size_t begin, size_t end)
+				{
+					Bounds rangeBounds, rangeCentroids;
+					measureRange(begin, end, rangeBounds, rangeCentroids);
+					std::lock_guard<std::mutex> lock(mutex);
+					bounds.grow(rangeBounds);
+					centroidBounds.grow(rangeCentroids);
+				});
+			};
+
+			// Bins of all three axes for a range of order, in parallel for large ranges
+			auto binTriangles = [&](uint32_t first, uint32_t count, const Bounds& centroidBounds, std::vector<Bin>& bins)
+			{
+				const glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+				auto binRange = [&](size_t begin, size_t end, std::vector<Bin>& rangeBins)
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						const uint32_t index = order[i];
+						for (int axis = 0; axis < 3; axis++)
+						{
+							if (extent[axis] <= 0.0f)
+							{
+								continue;
+							}
+							const float scale = binCount / extent[axis];
+							Bin& bin = rangeBins[axis * binCount + binIndex(centroids[index][axis], centroidBounds.min[axis], scale, binCount)];
+							bin.bounds.grow(triangleBounds[index]);
+							bin.count++;
+						}
+					}//for
+				};
+				bins.assign(3 * binCount, Bin());
+				if ((settings.parallelThreshold == 0) || (count <= settings.parallelThreshold))
+				{
+					binRange(first, first + count, bins);
+					return;
+				}
+				std::mutex mutex;
+				vks::parallel::forRange(first, first + count, [&](size_t begin, size_t end)
+				{
+					std::vector<Bin> rangeBins(3 * binCount);
+					binRange(begin, end, rangeBins);
+					std::lock_guard<std::mutex> lock(mutex);
+					for (size_t i = 0; i < bins.size(); i++)
+					{
+						bins[i].bounds.grow(rangeBins[i].bounds);
+						bins[i].count += rangeBins[i].count;
+					}
+				});
+			};
+
+			struct Task
+			{
+				uint32_t node;
+				uint32_t first;
+				uint32_t count;
+				uint32_t depth;
+			};
+			std::vector<Task> stack;
+			std::vector<Bin> bins;
+			std::vector<float> rightAreas(binCount);
+			std::vector<uint32_t> rightCounts(binCount);
+			float rootArea = 0.0f;
+			float cost = 0.0f;
+
+			nodes.reserve(2 * triangleCount / std::max(settings.maxLeafSize, 1u) + 1);
+			nodes.push_back(Node());
+			stack.push_back({ 0, 0, triangleCount, 0 });
+			while (!stack.empty())
+			{
+				const Task task = stack.back();
+				stack.pop_back();
+				statistics.maxDepth = std::max(statistics.maxDepth, task.depth);
+
+				Bounds bounds, centroidBounds;
+				measure(task.first, task.count, bounds, centroidBounds);
+				nodes[task.node].min = bounds.min;
+				nodes[task.node].max = bounds.max;
+				const float area = bounds.area();
+				if (task.node == 0)
+				{
+					rootArea = std::max(area, FLT_MIN);
+				}
+
+				// Best bin boundary over all axes, cost in units of the node area
+				int bestAxis = -1;
+				uint32_t bestSplit = 0;
+				float bestCost = FLT_MAX;
+				if ((task.count > 1) && (task.depth + 1 < maxDepth))
+				{
+					binTriangles(task.first, task.count, centroidBounds, bins);
+					for (int axis = 0; axis < 3; axis++)
+					{
+						if (centroidBounds.max[axis] <= centroidBounds.min[axis])
+						{
+							continue;
+						}
+						const Bin* axisBins = &bins[axis * binCount];
+						// Sweep from the right to get the area and count right of every boundary
+						Bounds right;
+						uint32_t rightCount = 0;
+						for (uint32_t i = binCount - 1; i > 0; i--)
+						{
+							right.grow(axisBins[i].bounds);
+							rightCount += axisBins[i].count;
+							rightAreas[i] = right.area();
+							rightCounts[i] = rightCount;
+						}
+						Bounds left;
+						uint32_t leftCount = 0;
+						for (uint32_t i = 1; i < binCount; i++)
+						{
+							left.grow(axisBins[i - 1].bounds);
+							leftCount += axisBins[i - 1].count;
+							if ((leftCount == 0) || (rightCounts[i] == 0))
+							{
+								continue;
+							}
+							const float splitCost = 1.0f + (leftCount * left.area() + rightCounts[i] * rightAreas[i]) / std::max(area, FLT_MIN);
+							if (splitCost < bestCost)
+							{
+								bestCost = splitCost;
+								bestAxis = axis;
+								bestSplit = i;
+							}
+						}//for
+					}//for axis
+				}
+
+				// Leaf if splitting doesn't pay off and the node is small enough, or if there is nothing to split
+				const bool split = (bestAxis >= 0) && ((bestCost < static_cast<float>(task.count)) || (task.count > settings.maxLeafSize));
+				if (!split)
+				{
+					nodes[task.node].leftFirst = task.first;
+					nodes[task.node].count = task.count;
+					statistics.leaves++;
+					cost += area / rootArea * task.count;
+					continue;
+				}
+
+				const float scale = binCount / (centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis]);
+				const float axisMin = centroidBounds.min[bestAxis];
+				auto middle = std::partition(order.begin() + task.first, order.begin() + task.first + task.count, [&](uint32_t index)
+				{
+					return binIndex(centroids[index][bestAxis], axisMin, scale, binCount) < bestSplit;
+				});
+				const uint32_t leftCount = static_cast<uint32_t>(middle - (order.begin() + task.first));
+
+				const uint32_t left = static_cast<uint32_t>(nodes.size());
+				nodes.push_back(Node());
+				nodes.push_back(Node());
+				nodes[task.node].leftFirst = left;
+				nodes[task.node].count = 0;
+				cost += area / rootArea;
+				stack.push_back({ left + 1, task.first + leftCount, task.count - leftCount, task.depth + 1 });
+				stack.push_back({ left, task.first, leftCount, task.depth + 1 });
+			}//while
+
+			// Leaves refer to ranges of order, move the triangles into that order
+			std::vector<Triangle> ordered(triangleCount);
+			forEachTriangle([&](size_t i)
+			{
+				ordered[i] = triangles[order[i]];
+			});
+			triangles.swap(ordered);
+
+			statistics.nodes = static_cast<uint32_t>(nodes.size());
+			statistics.sahCost = cost;
+			statistics.buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+			return statistics;
+		}
+
+		/**
+		* Closest hit traversal, visits the nearer child first and skips children farther away than the closest hit so far
+		*
+		* @param t Receives the hit distance
+		*/
+		uint32_t intersect(const std::vector<Node>& nodes, const std::vector<Triangle>& triangles, const glm::vec3& origin, const glm::vec3& direction,
+			float& t)
+		{
+			uint32_t hit = ~0u;
+			t = missDistance;
+			if (nodes.empty())
+			{
+				return hit;
+			}
+			glm::vec3 inverseDirection;
+			for (int i = 0; i < 3; i++)
+			{
+				const float d = (std::abs(direction[i]) < 1e-12f) ? std::copysign(1e-12f, direction[i]) : direction[i];
+				inverseDirection[i] = 1.0f / d;
+			}
+			if (intersectBounds(nodes[0].min, nodes[0].max, origin, inverseDirection, t) >= missDistance)
+			{
+				return hit;
+			}
+
+			uint32_t stack[maxDepth];
+			uint32_t stackSize = 0;
+			uint32_t nodeIndex = 0;
+			while (true)
+			{
+				const Node& node = nodes[nodeIndex];
+				if (node.count > 0)
+				{
+					for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; i++)
+					{
+						if (intersectTriangle(triangles[i], origin, direction, t))
+						{
+							hit = i;
+						}
+					}
+				}
+				else
+				{
+					uint32_t nearChild = node.leftFirst;
+					uint32_t farChild = node.leftFirst + 1;
+					float nearDistance = intersectBounds(nodes[nearChild].min, nodes[nearChild].max, origin, inverseDirection, t);
+					float farDistance = intersectBounds(nodes[farChild].min, nodes[farChild].max, origin, inverseDirection, t);
+					if (farDistance < nearDistance)
+					{
+						std::swap(nearChild, farChild);
+						std::swap(nearDistance, farDistance);
+					}
+					if (nearDistance < missDistance)
+					{
+						if (farDistance < missDistance)
+						{
+							stack[stackSize++] = farChild;
+						}
+						nodeIndex = nearChild;
+						continue;
+					}
+				}
+				if (stackSize == 0)
+				{
+					break;
+				}
+				nodeIndex = stack[--stackSize];
+			}//while
+			return hit;
+		}
+	}//bvh
+
+	/**
+	* Upload the BVH, create the ray queues, the output image, descriptors and compute pipelines
+	*
+	* @param device Device to create the resources on
+	* @param queue Queue used for the uploads
+	* @param pipelineCache Pipeline cache used for the compute pipelines
+	* @param shadersPath Base path of the GLSL shaders (getShadersPath())
+	* @param nodes Flattened BVH, see bvh::build
+	* @param triangles Triangles in the order of the BVH leaves
+	*/
+	void ComputeTracer::prepare(vks::VulkanDevice* device, VkQueue queue, VkPipelineCache pipelineCache, const std::string& shadersPath,
+		const std::vector<bvh::Node>& nodes, const std::vector<bvh::Triangle>& triangles, uint32_t width, uint32_t height)
+	{
+		this->device = device;
+		this->width = width;
+		this->height = height;
+		sampleCount = 0;
+		const uint32_t pixelCount = width * height;
+
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&uniformBuffer, sizeof(Params)));
+		VK_CHECK_RESULT(uniformBuffer.map());
+		// The shaders index at least one node and triangle
+		const bvh::Node emptyNode = { glm::vec3(1.0f), 0, glm::vec3(-1.0f), 0 };
+		const bvh::Triangle emptyTriangle = {};
+		VK_CHECK_RESULT(device->CreateDeviceLocalBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &nodeBuffer, std::max<size_t>(nodes.size(), 1) * sizeof(bvh::Node),
+			nodes.empty() ? &emptyNode : nodes.data(), queue));
+		VK_CHECK_RESULT(device->CreateDeviceLocalBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &triangleBuffer, std::max<size_t>(triangles.size(), 1) * sizeof(bvh::Triangle),
+			triangles.empty() ? &emptyTriangle : triangles.data(), queue));
+		// Ray: origin and pixel, direction and random state, throughput. Hit: distance, barycentrics and triangle
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &rayBuffer,
+			2 * static_cast<VkDeviceSize>(pixelCount) * 3 * sizeof(glm::vec4)));
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &hitBuffer,
+			static_cast<VkDeviceSize>(pixelCount) * sizeof(glm::vec4)));
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &counterBuffer, sizeof(Counters)));
+		VK_CHECK_RESULT(device->CreateHostBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, vks::HostAccess::Readback, &counterReadback, sizeof(Counters)));
+		memset(counterReadback.mappedData, 0, sizeof(Counters));
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&accumulationBuffer, static_cast<VkDeviceSize>(pixelCount) * sizeof(glm::vec4)));
+
+		// Storage support for RGBA8 is mandatory
+		VkImageCreateInfo imageInfo = vks::initializers::GenImageCreateInfo();
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+		imageInfo.extent = { width, height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageInfo, nullptr, &output.image));
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device->logicalDevice, output.image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::GenMemoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &output.memory));
+		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, output.image, output.memory, 0));
+
+		VkImageViewCreateInfo viewInfo = vks::initializers::GenImageViewCreateInfo();
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+		viewInfo.image = output.image;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewInfo, nullptr, &output.view));
+		VkSamplerCreateInfo samplerInfo = vks::initializers::GenSamplerCreateInfo();
+		samplerInfo.magFilter = VK_FILTER_LINEAR;
+		samplerInfo.minFilter = VK_FILTER_LINEAR;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.maxLod = 1.0f;
+		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerInfo, nullptr, &output.sampler));
+		output.descriptor = vks::initializers::GenDescriptorImageInfo(output.sampler, output.view, VK_IMAGE_LAYOUT_GENERAL);
+
+		VkCommandBuffer layoutCmd = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		vks::tools::setImageLayout(layoutCmd, output.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, viewInfo.subresourceRange);
+		device->FlushCommandBuffer(layoutCmd, queue, true);
+
+		params = {};
+		params.inverseView = glm::mat4(1.0f);
+		params.inverseProjection = glm::mat4(1.0f);
+		params.size = glm::uvec4(width, height, settings.maxBounces, pixelCount);
+		params.skyColor = glm::vec4(0.8f, 0.9f, 1.0f, 1.0f);
+		memcpy(uniformBuffer.mappedData, &params, sizeof(Params));
+
+		setupDescriptors();
+		preparePipelines(pipelineCache, shadersPath);
+
+		// Generate, trace and shade per bounce and resolve
+		gpuTimer.create(device, 2 + 2 * settings.maxBounces);
+	}
+
+	void ComputeTracer::destroy()
+	{
+		if (!device)
+		{
+			return;
+		}
+		VkDevice logicalDevice = device->logicalDevice;
+		vkDestroyPipeline(logicalDevice, pipelineGenerate, nullptr);
+		vkDestroyPipeline(logicalDevice, pipelineTrace, nullptr);
+		vkDestroyPipeline(logicalDevice, pipelineShade, nullptr);
+		vkDestroyPipeline(logicalDevice, pipelineResolve, nullptr);
+		vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+		vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+		vkDestroySampler(logicalDevice, output.sampler, nullptr);
+		vkDestroyImageView(logicalDevice, output.view, nullptr);
+		vkDestroyImage(logicalDevice, output.image, nullptr);
+		vkFreeMemory(logicalDevice, output.memory, nullptr);
+		uniformBuffer.destroy();
+		nodeBuffer.destroy();
+		triangleBuffer.destroy();
+		rayBuffer.destroy();
+		hitBuffer.destroy();
+		counterBuffer.destroy();
+		counterReadback.destroy();
+		accumulationBuffer.destroy();
+		gpuTimer.destroy();
+		device = nullptr;
+	}
+
+	void ComputeTracer::setupDescriptors()
+	{
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1),
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::GenDescriptorPoolCreateInfo(poolSizes, 1);
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+
+		// One set for all passes, see computeraytracing/bvh.glsl
+		std::vector<VkDescriptorSetLayoutBinding> bindings = {
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 5),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 6),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 7),
+		};
+		VkDescriptorSetLayoutCreateInfo layoutInfo = vks::initializers::GenDescriptorSetLayoutCreateInfo(bindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &layoutInfo, nullptr, &descriptorSetLayout));
+
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &descriptorSet));
+
+		VkDescriptorImageInfo storageImage = vks::initializers::GenDescriptorImageInfo(VK_NULL_HANDLE, output.view, VK_IMAGE_LAYOUT_GENERAL);
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::GenWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &nodeBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &triangleBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &rayBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &hitBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &counterBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6, &accumulationBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 7, &storageImage),
+		};
+		vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
+	void ComputeTracer::preparePipelines(VkPipelineCache pipelineCache, const std::string& shadersPath)
+	{
+		VkPushConstantRange pushConstantRange = vks::initializers::GenPushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PushConstants), 0);
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = vks::initializers::GenPipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+
+		VkComputePipelineCreateInfo pipelineInfo = vks::initializers::GenComputePipelineCreateInfo(pipelineLayout);
+		const std::pair<const char*, VkPipeline*> pipelines[] = {
+			{ "computeraytracing/bvh_generate.comp.spv", &pipelineGenerate },
+			{ "computeraytracing/bvh_trace.comp.spv", &pipelineTrace },
+			{ "computeraytracing/bvh_shade.comp.spv", &pipelineShade },
+			{ "computeraytracing/bvh_resolve.comp.spv", &pipelineResolve },
+		};
+		for (const auto& pipeline : pipelines)
+		{
+			pipelineInfo.stage = vks::tools::loadShaderStage(shadersPath + pipeline.first, VK_SHADER_STAGE_COMPUTE_BIT, device->logicalDevice);
+			VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, pipeline.second));
+			vkDestroyShaderModule(device->logicalDevice, pipelineInfo.stage.module, nullptr);
+		}
+	}
+
+	/**
+	* Update the camera, the accumulated samples are discarded if it moved
+	*/
+	void ComputeTracer::updateCamera(const glm::mat4& view, const glm::mat4& projection)
+	{
+		const glm::mat4 inverseView = glm::inverse(view);
+		const glm::mat4 inverseProjection = glm::inverse(projection);
+		if ((inverseView != params.inverseView) || (inverseProjection != params.inverseProjection))
+		{
+			sampleCount = 0;
+		}
+		params.inverseView = inverseView;
+		params.inverseProjection = inverseProjection;
+		params.size.z = settings.maxBounces;
+		memcpy(uniformBuffer.mappedData, &params, sizeof(Params));
+	}
+
+	/**
+	* Record one sample per pixel
+	*
+	* Ray generation fills queue 0 with a camera ray per pixel. Every bounce traces the current queue with persistent threads and shades
+	* the hits, the shade pass adds sky hits to the accumulation and appends continued paths to the other queue. The counters are copied
+	* to counterReadback at the end
+	*
+	* @note Resets the GPU timer, the command buffer must be executed before the next sample is recorded
+	*/
+	void ComputeTracer::recordSample(VkCommandBuffer commandBuffer)
+	{
+		const uint32_t pixelCount = width * height;
+		PushConstants pushConstants = { 0, 0, sampleCount };
+
+		VkMemoryBarrier memoryBarrier = vks::initializers::GenMemoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		auto barrier = [&]()
+		{
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		};
+
+		gpuTimer.reset(commandBuffer);
+		// Readers of the previous sample must be done before the buffers are reset
+		barrier();
+		if (sampleCount == 0)
+		{
+			vkCmdFillBuffer(commandBuffer, accumulationBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+		}
+		const Counters counters = { { pixelCount, 0 }, 0, 0 };
+		vkCmdUpdateBuffer(commandBuffer, counterBuffer.buffer, 0, sizeof(Counters), &counters);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		barrier();
+
+		uint32_t scope = gpuTimer.beginScope(commandBuffer, "Generate");
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineGenerate);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+		vkCmdDispatch(commandBuffer, (pixelCount + tracerGroupSize - 1) / tracerGroupSize, 1, 1);
+		gpuTimer.endScope(commandBuffer, scope);
+		barrier();
+
+		for (uint32_t bounce = 0; bounce < settings.maxBounces; bounce++)
+		{
+			pushConstants.queue = bounce % 2;
+			pushConstants.bounce = bounce;
+
+			// The queue size isn't known on the host, persistent threads stop once the fetch counter passes it
+			scope = gpuTimer.beginScope(commandBuffer, "Trace " + std::to_string(bounce));
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineTrace);
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+			vkCmdDispatch(commandBuffer, settings.traceGroups, 1, 1);
+			gpuTimer.endScope(commandBuffer, scope);
+
+			// The shade pass appends to the other queue, which has to be empty, and the next trace pass fetches from 0 again
+			vkCmdFillBuffer(commandBuffer, counterBuffer.buffer, offsetof(Counters, queueCount) + ((bounce + 1) % 2) * sizeof(uint32_t), sizeof(uint32_t), 0);
+			vkCmdFillBuffer(commandBuffer, counterBuffer.buffer, offsetof(Counters, traceNext), sizeof(uint32_t), 0);
+			barrier();
+
+			// Dispatched for the largest possible queue, invocations past the queue size return
+			scope = gpuTimer.beginScope(commandBuffer, "Shade " + std::to_string(bounce));
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineShade);
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+			vkCmdDispatch(commandBuffer, (pixelCount + tracerGroupSize - 1) / tracerGroupSize, 1, 1);
+			gpuTimer.endScope(commandBuffer, scope);
+			barrier();
+		}//for
+
+		scope = gpuTimer.beginScope(commandBuffer, "Resolve");
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineResolve);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+		vkCmdDispatch(commandBuffer, (width + resolveGroupSize - 1) / resolveGroupSize, (height + resolveGroupSize - 1) / resolveGroupSize, 1);
+		gpuTimer.endScope(commandBuffer, scope);
+
+		VkBufferCopy copyRegion = { 0, 0, sizeof(Counters) };
+		vkCmdCopyBuffer(commandBuffer, counterBuffer.buffer, counterReadback.buffer, 1, &copyRegion);
+		VkBufferMemoryBarrier readbackBarrier = vks::initializers::GenBufferMemoryBarrier();
+		readbackBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		readbackBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		readbackBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		readbackBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		readbackBarrier.buffer = counterReadback.buffer;
+		readbackBarrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &readbackBarrier, 0, nullptr);
+
+		// The resolved image is sampled by fragment shaders or copied
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		sampleCount++;
+	}
+
+	uint32_t ComputeTracer::tracedRays()
+	{
+		Counters counters;
+		counterReadback.invalidate();
+		memcpy(&counters, counterReadback.mappedData, sizeof(Counters));
+		return counters.tracedRays;
+	}
+
+	/**
+	* @param device Device the tracer runs on
+	* @param queue Queue used for uploads and the traced samples
+	* @param shadersPath Base path of the GLSL shaders (getShadersPath())
+	* @param fileName glTF file to trace
+	* @param out Stream the report is written to
+	*/
+	void benchmarkComputeTracer(vks::VulkanDevice* device, VkQueue queue, const std::string& shadersPath, const std::string& fileName, std::ostream& out)
+	{
+		const uint32_t width = 1280;
+		const uint32_t height = 720;
+		const uint32_t samples = 16;
+		const uint32_t buildRuns = 3;
+
+		vkglTF::Model model;
+		model.loadFromFile(fileName, device, queue, vkglTF::FileLoadingFlags::DontLoadImages | vkglTF::FileLoadingFlags::KeepHostGeometry);
+		std::vector<bvh::Triangle> sourceTriangles;
+		bvh::collectTriangles(model, sourceTriangles);
+		if (sourceTriangles.empty())
+		{
+			out << "\"" << fileName << "\" has no triangles to trace\n";
+			return;
+		}
+
+		std::ios_base::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+		out << std::fixed << std::setprecision(2);
+		out << "Compute tracer: \"" << fileName << "\", " << sourceTriangles.size() << " triangles, " << width << " x " << height << ", best of "
+			<< buildRuns << " builds\n";
+
+		// Binning on the calling thread only and on the parallel pool
+		std::vector<bvh::Triangle> triangles;
+		std::vector<bvh::Node> nodes;
+		bvh::BuildStatistics serial, parallel;
+		for (bool parallelBuild : { false, true })
+		{
+			bvh::BuildSettings buildSettings;
+			buildSettings.parallelThreshold = parallelBuild ? buildSettings.parallelThreshold : 0;
+			bvh::BuildStatistics& best = parallelBuild ? parallel : serial;
+			best.buildMs = 1e30;
+			for (uint32_t run = 0; run < buildRuns; run++)
+			{
+				triangles = sourceTriangles;
+				bvh::BuildStatistics statistics = bvh::build(triangles, nodes, buildSettings);
+				if (statistics.buildMs < best.buildMs)
+				{
+					best = statistics;
+				}
+			}
+		}//for
+		out << "  " << std::left << std::setw(18) << "" << std::right << std::setw(12) << "serial" << std::setw(12) << "parallel" << "\n";
+		out << "  " << std::left << std::setw(18) << "build ms" << std::right << std::setw(12) << serial.buildMs << std::setw(12) << parallel.buildMs << "\n";
+		out << "  " << std::left << std::setw(18) << "nodes" << std::right << std::setw(12) << serial.nodes << std::setw(12) << parallel.nodes << "\n";
+		out << "  " << std::left << std::setw(18) << "leaves" << std::right << std::setw(12) << serial.leaves << std::setw(12) << parallel.leaves << "\n";
+		out << "  " << std::left << std::setw(18) << "depth" << std::right << std::setw(12) << serial.maxDepth << std::setw(12) << parallel.maxDepth << "\n";
+		out << "  " << std::left << std::setw(18) << "SAH cost" << std::right << std::setw(12) << serial.sahCost << std::setw(12) << parallel.sahCost << "\n";
+
+		// Camera in front of the model, looking at its center
+		const glm::vec3 center = (model.dimensions.min + model.dimensions.max) * 0.5f;
+		const float radius = std::max(glm::length(model.dimensions.max - model.dimensions.min) * 0.5f, 1e-3f);
+		const glm::mat4 view = glm::lookAt(center + glm::vec3(0.0f, radius * 0.3f, radius * 1.8f), center, glm::vec3(0.0f, 1.0f, 0.0f));
+		const glm::mat4 projection = glm::perspective(glm::radians(60.0f), width / static_cast<float>(height), radius * 0.01f, radius * 10.0f);
+
+		// Primary hits against the CPU traversal
+		ComputeTracer tracer;
+		tracer.settings.maxBounces = 1;
+		tracer.prepare(device, queue, VK_NULL_HANDLE, shadersPath, nodes, triangles, width, height);
+		tracer.updateCamera(view, projection);
+		VkCommandBuffer commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		tracer.recordSample(commandBuffer);
+		device->FlushCommandBuffer(commandBuffer, queue, true);
+
+		vks::Buffer hitReadback;
+		VK_CHECK_RESULT(device->CreateHostBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, vks::HostAccess::Readback, &hitReadback, tracer.hitBuffer.size));
+		VkBufferCopy copyRegion = { 0, 0, tracer.hitBuffer.size };
+		device->CopyBuffer(&tracer.hitBuffer, &hitReadback, queue, &copyRegion);
+		hitReadback.invalidate();
+		const glm::vec4* hits = static_cast<const glm::vec4*>(hitReadback.mappedData);
+		// Every 7th pixel, the first sample traces through the pixel centers
+		uint32_t checked = 0, mismatches = 0;
+		for (uint32_t pixel = 0; pixel < width * height; pixel += 7)
+		{
+			const glm::vec2 ndc = glm::vec2((pixel % width + 0.5f) / width, (pixel / width + 0.5f) / height) * 2.0f - 1.0f;
+			glm::vec4 target = tracer.params.inverseProjection * glm::vec4(ndc, 1.0f, 1.0f);
+			const glm::vec3 origin = glm::vec3(tracer.params.inverseView * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+			const glm::vec3 direction = glm::normalize(glm::vec3(tracer.params.inverseView * glm::vec4(glm::normalize(glm::vec3(target) / target.w), 0.0f)));
+			float t;
+			const uint32_t cpuHit = bvh::intersect(nodes, triangles, origin, direction, t);
+			uint32_t gpuHit;
+			memcpy(&gpuHit, &hits[pixel].w, sizeof(uint32_t));
+			checked++;
+			// Rays through triangle edges may hit either neighbour, the distance decides
+			if ((cpuHit == ~0u) != (gpuHit == ~0u) || ((cpuHit != ~0u) && (std::abs(hits[pixel].x - t) > 1e-3f * std::max(t, 1.0f))))
+			{
+				mismatches++;
+			}
+		}//for
+		hitReadback.destroy();
+		tracer.destroy();
+		out << "  primary hits: " << checked << " pixels compared with the CPU traversal, " << mismatches << " mismatches\n";
+
+		// Paths of settings.maxBounces segments
+		tracer.settings = ComputeTracer::Settings();
+		tracer.prepare(device, queue, VK_NULL_HANDLE, shadersPath, nodes, triangles, width, height);
+		tracer.updateCamera(view, projection);
+		double traceMs = 0.0, totalMs = 0.0;
+		uint64_t rays = 0;
+		for (uint32_t sample = 0; sample < samples; sample++)
+		{
+			commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			tracer.recordSample(commandBuffer);
+			device->FlushCommandBuffer(commandBuffer, queue, true);
+			tracer.gpuTimer.collect(true);
+			for (const GpuTimer::Result& result : tracer.gpuTimer.results)
+			{
+				totalMs += result.milliseconds;
+				traceMs += (result.name.compare(0, 5, "Trace") == 0) ? result.milliseconds : 0.0;
+			}
+			rays += tracer.tracedRays();
+		}//for
+		if (tracer.gpuTimer.supported && (traceMs > 0.0))
+		{
+			out << "  " << samples << " samples of " << tracer.settings.maxBounces << " bounces: " << rays << " rays, "
+				<< rays / (traceMs * 1000.0) << " Mrays/s traced, " << rays / (totalMs * 1000.0) << " Mrays/s with generation, shading and resolve\n";
+		}
+		else
+		{
+			out << "  " << samples << " samples of " << tracer.settings.maxBounces << " bounces: " << rays << " rays, no timestamps on this queue\n";
+		}
+		tracer.destroy();
+		out.flags(flags);
+		out.precision(precision);
+	}
+}//vks
@@ -0,0 +1,189 @@
+/*
+* Compute shader path tracer
+*
+* Traces the triangles of glTF models through a BVH with compute shaders only, so reference renders and bakes work on devices
+* without ray tracing hardware. The BVH is built on the CPU with binned SAH splits and flattened into a node array the shaders
+* walk with a short stack. Paths are traced as wavefronts: every bounce is a trace pass over a ray queue followed by a shade
+* pass that appends the continued rays to the other queue, the trace pass runs persistent threads that fetch rays until the
+* queue is drained
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanGpuTimer.h"
+#include "VulkanglTFModel.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	namespace bvh
+	{
+		/** @brief Triangle as read by the shaders (std430), the first vertex and the two edges leaving it */
+		struct Triangle
+		{
+			glm::vec3 v0;
+			/** @brief Base color packed as unorm 4x8 */
+			uint32_t color;
+			glm::vec4 edge1;
+			glm::vec4 edge2;
+		};
+
+		/**
+		* @brief Flattened node as read by the shaders (std430)
+		* @note Leaves have count > 0 and their triangles at [leftFirst, leftFirst + count), the children of inner nodes are leftFirst and leftFirst + 1
+		*/
+		struct Node
+		{
+			glm::vec3 min;
+			uint32_t leftFirst;
+			glm::vec3 max;
+			uint32_t count;
+		};
+
+		struct BuildSettings
+		{
+			/** @brief Centroid bins per axis the split candidates are taken from */
+			uint32_t binCount = 16;
+			/** @brief Nodes with this many triangles or less become leaves when splitting does not lower the SAH cost */
+			uint32_t maxLeafSize = 4;
+			/** @brief Nodes with more triangles than this bin in parallel on the vks::parallel pool, 0 bins every node on the calling thread */
+			uint32_t parallelThreshold = 16384;
+		};
+
+		struct BuildStatistics
+		{
+			double buildMs = 0.0;
+			uint32_t nodes = 0;
+			uint32_t leaves = 0;
+			uint32_t maxDepth = 0;
+			/** @brief Expected traversal cost relative to the root area, inner nodes cost 1 and triangles 1 */
+			float sahCost = 0.0f;
+		};
+
+		/** @brief Depth the trace shader's stack can hold, deeper nodes are made leaves */
+		const uint32_t maxDepth = 64;
+
+		/**
+		* @brief Appends the triangles of all primitives of a model, transformed by their nodes' world matrices
+		* @note The model must be loaded with FileLoadingFlags::KeepHostGeometry
+		*/
+		void collectTriangles(const vkglTF::Model& model, std::vector<Triangle>& triangles);
+		/** @brief Build a BVH over the triangles, which are reordered so every leaf refers to a contiguous range */
+		BuildStatistics build(std::vector<Triangle>& triangles, std::vector<Node>& nodes, const BuildSettings& settings = BuildSettings());
+		/** @brief Closest hit on the CPU, matches the traversal of bvh_trace.comp. Returns the triangle index or ~0u for a miss */
+		uint32_t intersect(const std::vector<Node>& nodes, const std::vector<Triangle>& triangles, const glm::vec3& origin, const glm::vec3& direction,
+			float& t);
+	}
+
+	class ComputeTracer
+	{
+	public:
+		struct Settings
+		{
+			/** @brief Path segments per sample, 1 only traces primary rays */
+			uint32_t maxBounces = 4;
+			/** @brief Workgroups of the persistent trace pass, enough to fill the device. Their threads fetch rays until the queue is drained */
+			uint32_t traceGroups = 256;
+		} settings;
+
+		/** @brief Uniform block of the tracer shaders (std140), see computeraytracing/bvh.glsl */
+		struct Params
+		{
+			glm::mat4 inverseView;
+			glm::mat4 inverseProjection;
+			/** @brief Width, height, max bounces and pixel count */
+			glm::uvec4 size;
+			glm::vec4 skyColor;
+		} params;
+
+		/** @brief Queue sizes and fetch counters of the passes (std430) */
+		struct Counters
+		{
+			uint32_t queueCount[2];
+			uint32_t traceNext;
+			uint32_t tracedRays;
+		};
+
+		vks::VulkanDevice* device = nullptr;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		/** @brief Samples accumulated since the last camera change */
+		uint32_t sampleCount = 0;
+
+		vks::Buffer uniformBuffer;
+		vks::Buffer nodeBuffer;
+		vks::Buffer triangleBuffer;
+		/** @brief Two ray queues of one ray per pixel each */
+		vks::Buffer rayBuffer;
+		vks::Buffer hitBuffer;
+		vks::Buffer counterBuffer;
+		/** @brief Host visible copy of the counters, written at the end of every recorded sample */
+		vks::Buffer counterReadback;
+		/** @brief Radiance summed over the samples per pixel */
+		vks::Buffer accumulationBuffer;
+
+		/** @brief Resolved image, stays in VK_IMAGE_LAYOUT_GENERAL and can be sampled through descriptor once the sample finished */
+		struct
+		{
+			VkImage image = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+			VkSampler sampler = VK_NULL_HANDLE;
+			VkDescriptorImageInfo descriptor{};
+		} output;
+
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipelineGenerate = VK_NULL_HANDLE;
+		VkPipeline pipelineTrace = VK_NULL_HANDLE;
+		VkPipeline pipelineShade = VK_NULL_HANDLE;
+		VkPipeline pipelineResolve = VK_NULL_HANDLE;
+
+		vks::GpuTimer gpuTimer;
+
+		/** @brief Upload the BVH and create the ray queues and the output image for the given size */
+		void prepare(vks::VulkanDevice* device, VkQueue queue, VkPipelineCache pipelineCache, const std::string& shadersPath,
+			const std::vector<bvh::Node>& nodes, const std::vector<bvh::Triangle>& triangles, uint32_t width, uint32_t height);
+		void destroy();
+
+		/** @brief Set the camera, restarts the accumulation if it changed */
+		void updateCamera(const glm::mat4& view, const glm::mat4& projection);
+		/** @brief Record one sample per pixel: ray generation, maxBounces trace and shade passes and the resolve into the output image */
+		void recordSample(VkCommandBuffer commandBuffer);
+		/** @brief Rays traced by the last finished sample, read from counterReadback */
+		uint32_t tracedRays();
+
+	private:
+		struct PushConstants
+		{
+			uint32_t queue;
+			uint32_t bounce;
+			uint32_t sample;
+		};
+
+		void setupDescriptors();
+		void preparePipelines(VkPipelineCache pipelineCache, const std::string& shadersPath);
+	};
+
+	/**
+	* @brief Loads a glTF file, compares BVH builds on one and on all threads, checks traced primary hits against the CPU traversal
+	* and reports rays per second of the trace passes and of whole paths
+	*/
+	void benchmarkComputeTracer(vks::VulkanDevice* device, VkQueue queue, const std::string& shadersPath, const std::string& fileName, std::ostream& out);
+}//vks
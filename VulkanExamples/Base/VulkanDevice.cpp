@@ -13,6 +13,9 @@
 #define VK_ENABLE_BETA_EXTENSIONS
 #endif
 #include <VulkanDevice.h>
+#include <chrono>
+#include <cmath>
+#include <functional>
 #include <unordered_set>
 
 namespace vks
@@ -34,6 +37,26 @@ namespace vks
 		vkGetPhysicalDeviceFeatures(physicalDevice, &features);
 		// Memory properties are used regularly for creating all kinds of buffers
 		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+		// Buffers are written directly if the host can map device local memory for the whole heap, that is on integrated GPUs
+		// and with resizable BAR, a legacy 256 MB BAR window is too small to hold static geometry and stays unused
+		VkDeviceSize largestDeviceLocalHeap = 0;
+		for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+		{
+			if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+			{
+				largestDeviceLocalHeap = std::max(largestDeviceLocalHeap, memoryProperties.memoryHeaps[i].size);
+			}
+		}
+		const VkMemoryPropertyFlags hostVisibleDeviceLocal = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+		{
+			if ((memoryProperties.memoryTypes[i].propertyFlags & hostVisibleDeviceLocal) == hostVisibleDeviceLocal)
+			{
+				VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[i].heapIndex].size;
+				directUpload.hostVisibleDeviceLocalHeapSize = std::max(directUpload.hostVisibleDeviceLocalHeapSize, heapSize);
+			}
+		}
+		directUpload.buffers = (directUpload.hostVisibleDeviceLocalHeapSize > 0) && (directUpload.hostVisibleDeviceLocalHeapSize >= largestDeviceLocalHeap / 2);
 		// Queue family properties, used for setting up requested queues upon device creation
 		uint32_t queueFamilyCount;
 		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
@@ -117,6 +140,42 @@ namespace vks
 		}
 	}
 
+	/**
+	* Get the index of the host visible memory type that suits how the host accesses the memory
+	*
+	* @param typeBits Bit mask with bits set for each memory type supported by the resource (from VkMemoryRequirements)
+	* @param access Upload prefers uncached memory the host writes through write combining, readback prefers cached memory
+	*
+	* @return Index of the memory type
+	*
+	* @throw Throws an exception if the resource supports no host visible memory type
+	*/
+	uint32_t VulkanDevice::GetHostMemoryType(uint32_t typeBits, HostAccess access) const
+	{
+		uint32_t bestType = UINT32_MAX;
+		int bestScore = -1;
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+		{
+			VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[i].propertyFlags;
+			if (((typeBits & (1u << i)) == 0) || ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == 0))
+			{
+				continue;
+			}
+			bool cached = (flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != 0;
+			int score = ((cached == (access == HostAccess::Readback)) ? 2 : 0) + (((flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0) ? 1 : 0);
+			if (score > bestScore)
+			{
+				bestType = i;
+				bestScore = score;
+			}
+		}//for
+		if (bestType == UINT32_MAX)
+		{
+			throw std::runtime_error("Could not find a host visible memory type");
+		}
+		return bestType;
+	}
+
 	/**
 	* Get the index of a queue family that supports the requested queue flags
 	* SRS - support VkQueueFlags parameter for requesting multiple flags vs. VkQueueFlagBits for a single flag only
@@ -258,6 +317,66 @@ namespace vks
 			deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 		}
 
+		// Enable VK_EXT_host_image_copy for direct image uploads if the example didn't, its dependencies
+		// VK_KHR_copy_commands2 and VK_KHR_format_feature_flags2 are core in Vulkan 1.3 and enabled alongside it below that
+		VkPhysicalDeviceHostImageCopyFeaturesEXT hostImageCopyFeatures{};
+		hostImageCopyFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT;
+		bool hostImageCopyEnabled = false;
+#if !defined(__ANDROID__)
+		bool hostImageCopyListed = std::find_if(deviceExtensions.begin(), deviceExtensions.end(), [](const char* extension)
+		{
+			return std::string(extension) == VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME;
+		}) != deviceExtensions.end();
+		uint32_t hostImageCopyApiVersion = std::min(instanceApiVersion, properties.apiVersion);
+		bool hostImageCopyDependencies = (hostImageCopyApiVersion >= VK_API_VERSION_1_3) ||
+			((hostImageCopyApiVersion >= VK_API_VERSION_1_1) && IsExtensionSupported(VK_KHR_COPY_COMMANDS_2_EXTENSION_NAME) && IsExtensionSupported(VK_KHR_FORMAT_FEATURE_FLAGS_2_EXTENSION_NAME));
+		if (!hostImageCopyListed && hostImageCopyDependencies && IsExtensionSupported(VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME))
+		{
+			VkPhysicalDeviceFeatures2 supportedFeatures{};
+			supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			supportedFeatures.pNext = &hostImageCopyFeatures;
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+			if (hostImageCopyFeatures.hostImageCopy)
+			{
+				deviceExtensions.push_back(VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME);
+				if (hostImageCopyApiVersion < VK_API_VERSION_1_3)
+				{
+					for (const char* dependency : { VK_KHR_COPY_COMMANDS_2_EXTENSION_NAME, VK_KHR_FORMAT_FEATURE_FLAGS_2_EXTENSION_NAME })
+					{
+						if (std::find_if(deviceExtensions.begin(), deviceExtensions.end(), [dependency](const char* extension) { return std::string(extension) == dependency; }) == deviceExtensions.end())
+						{
+							deviceExtensions.push_back(dependency);
+						}
+					}
+				}
+				hostImageCopyFeatures.pNext = pNextChain;
+				pNextChain = &hostImageCopyFeatures;
+				hostImageCopyEnabled = true;
+			}
+		}
+#endif
+
+		// Buffer device addresses are core in Vulkan 1.2, only enabled on request as the feature struct must not be chained
+		// together with a VkPhysicalDeviceVulkan12Features struct passed by the example
+		VkPhysicalDeviceBufferDeviceAddressFeatures bufferDeviceAddressFeatures{};
+		bufferDeviceAddressFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
+		bufferDeviceAddress.enabled = false;
+		if (bufferDeviceAddress.requested && (std::min(instanceApiVersion, properties.apiVersion) >= VK_API_VERSION_1_2))
+		{
+			VkPhysicalDeviceFeatures2 supportedFeatures{};
+			supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			supportedFeatures.pNext = &bufferDeviceAddressFeatures;
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+			if (bufferDeviceAddressFeatures.bufferDeviceAddress)
+			{
+				bufferDeviceAddressFeatures.bufferDeviceAddressCaptureReplay = VK_FALSE;
+				bufferDeviceAddressFeatures.bufferDeviceAddressMultiDevice = VK_FALSE;
+				bufferDeviceAddressFeatures.pNext = pNextChain;
+				pNextChain = &bufferDeviceAddressFeatures;
+				bufferDeviceAddress.enabled = true;
+			}
+		}
+
 		VkDeviceCreateInfo deviceCreateInfo = {};
 		deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 		deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
@@ -309,6 +428,30 @@ namespace vks
 		//create a default command pool for graphics command buffers
 		commandPool = CreateCommandPool(queueFamilyIndices.graphicIndex);
 
+#if !defined(__ANDROID__)
+		if (hostImageCopyEnabled)
+		{
+			fpCopyMemoryToImageEXT = reinterpret_cast<PFN_vkCopyMemoryToImageEXT>(vkGetDeviceProcAddr(logicalDevice, "vkCopyMemoryToImageEXT"));
+			fpTransitionImageLayoutEXT = reinterpret_cast<PFN_vkTransitionImageLayoutEXT>(vkGetDeviceProcAddr(logicalDevice, "vkTransitionImageLayoutEXT"));
+			// Layouts the host can copy to, queried once for the count and once for the list
+			VkPhysicalDeviceHostImageCopyPropertiesEXT hostImageCopyProperties{};
+			hostImageCopyProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_PROPERTIES_EXT;
+			VkPhysicalDeviceProperties2 properties2{};
+			properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+			properties2.pNext = &hostImageCopyProperties;
+			vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+			hostImageCopyLayouts.resize(hostImageCopyProperties.copyDstLayoutCount);
+			hostImageCopyProperties.pCopyDstLayouts = hostImageCopyLayouts.data();
+			vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+			directUpload.hostImageCopy = fpCopyMemoryToImageEXT && fpTransitionImageLayoutEXT;
+		}
+#endif
+		if (bufferDeviceAddress.enabled)
+		{
+			fpGetBufferDeviceAddress = reinterpret_cast<PFN_vkGetBufferDeviceAddress>(vkGetDeviceProcAddr(logicalDevice, "vkGetBufferDeviceAddress"));
+			bufferDeviceAddress.enabled = (fpGetBufferDeviceAddress != nullptr);
+		}
+
 		return result;
 	}
 
@@ -464,6 +607,220 @@ namespace vks
 		FlushCommandBuffer(copyCmd, queue);
 	}
 
+	/**
+	* Query the device address of a buffer, shaders access it through GL_EXT_buffer_reference
+	*
+	* @param buffer Buffer created with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+	*
+	* @return Address of the first byte of the buffer, 0 if buffer device addresses are not enabled
+	*/
+	VkDeviceAddress VulkanDevice::GetBufferDeviceAddress(VkBuffer buffer) const
+	{
+		if (!bufferDeviceAddress.enabled || (buffer == VK_NULL_HANDLE))
+		{
+			return 0;
+		}
+		VkBufferDeviceAddressInfo addressInfo{};
+		addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+		addressInfo.buffer = buffer;
+		return fpGetBufferDeviceAddress(logicalDevice, &addressInfo);
+	}
+
+	/**
+	* Create a host visible buffer that stays mapped
+	*
+	* @param usageFlags Usage flag bit mask for the buffer
+	* @param access How the host accesses the buffer, selects the memory type
+	* @param buffer Pointer to a vk::Vulkan buffer object
+	* @param size Size of the buffer in bytes
+	*
+	* @return VK_SUCCESS if the buffer has been created and mapped
+	*/
+	VkResult VulkanDevice::CreateHostBuffer(VkBufferUsageFlags usageFlags, HostAccess access, vks::Buffer * buffer, VkDeviceSize size)
+	{
+		buffer->device = logicalDevice;
+		VkBufferCreateInfo bufferCreateInfo = vks::initializers::GenBufferCreateInfo(usageFlags, size);
+		VK_CHECK_RESULT(vkCreateBuffer(logicalDevice, &bufferCreateInfo, nullptr, &buffer->buffer));
+
+		VkMemoryRequirements memReqs;
+		vkGetBufferMemoryRequirements(logicalDevice, buffer->buffer, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::GenMemoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = GetHostMemoryType(memReqs.memoryTypeBits, access);
+		VkMemoryAllocateFlagsInfoKHR allocFlagsInfo{};
+		if (usageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)
+		{
+			allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR;
+			allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
+			memAlloc.pNext = &allocFlagsInfo;
+		}
+		VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &buffer->deviceMemory));
+
+		buffer->alignment = memReqs.alignment;
+		buffer->size = size;
+		buffer->bufferUsageFlags = usageFlags;
+		buffer->memoryPropertyFlags = memoryProperties.memoryTypes[memAlloc.memoryTypeIndex].propertyFlags;
+		buffer->setupDescriptor();
+		VK_CHECK_RESULT(buffer->bind());
+		return buffer->map();
+	}
+
+	/**
+	* Create a device local buffer and fill it, the host writes the data directly if device local memory is host visible,
+	* otherwise it goes through a staging buffer and a copy that is waited for
+	*
+	* @param usageFlags Usage flag bit mask for the buffer, transfer destination usage is added for the staging path
+	* @param size Size of the buffer in bytes
+	* @param buffer Pointer to the buffer handle acquired by the function
+	* @param memory Pointer to the memory handle acquired by the function
+	* @param data Data to fill the buffer with
+	* @param queue Queue the staging copy is submitted to
+	*
+	* @return VK_SUCCESS if the buffer has been created and filled
+	*/
+	VkResult VulkanDevice::CreateDeviceLocalBuffer(VkBufferUsageFlags usageFlags, VkDeviceSize size, VkBuffer * buffer, VkDeviceMemory * memory, const void * data, VkQueue queue)
+	{
+		vks::Buffer deviceBuffer;
+		VkResult result = CreateDeviceLocalBuffer(usageFlags, &deviceBuffer, size, data, queue);
+		*buffer = deviceBuffer.buffer;
+		*memory = deviceBuffer.deviceMemory;
+		return result;
+	}
+
+	VkResult VulkanDevice::CreateDeviceLocalBuffer(VkBufferUsageFlags usageFlags, vks::Buffer * buffer, VkDeviceSize size, const void * data, VkQueue queue)
+	{
+		if (directUpload.buffers)
+		{
+			// Prefer coherent memory, CreateBuffer flushes if the type isn't
+			VkMemoryPropertyFlags memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+			bool coherent = false;
+			for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+			{
+				coherent |= (memoryProperties.memoryTypes[i].propertyFlags & memoryPropertyFlags) == memoryPropertyFlags;
+			}
+			if (!coherent)
+			{
+				memoryPropertyFlags &= ~VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+			}
+			return CreateBuffer(usageFlags, memoryPropertyFlags, buffer, size, const_cast<void*>(data));
+		}
+
+		vks::Buffer stagingBuffer;
+		VK_CHECK_RESULT(CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, size, const_cast<void*>(data)));
+		VK_CHECK_RESULT(CreateBuffer(usageFlags | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, size));
+		CopyBuffer(&stagingBuffer, buffer, queue);
+		stagingBuffer.destroy();
+		return VK_SUCCESS;
+	}
+
+	/**
+	* Pick the usage bit an image needs to be filled by UploadImage
+	*
+	* @param format Format of the image
+	* @param usageFlags Usage the image is created with besides the upload
+	* @param finalLayout Layout the image is used in after the upload
+	*
+	* @return VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT if the host can copy to the image, VK_IMAGE_USAGE_TRANSFER_DST_BIT otherwise
+	*/
+	VkImageUsageFlags VulkanDevice::GetUploadUsage(VkFormat format, VkImageUsageFlags usageFlags, VkImageLayout finalLayout)
+	{
+#if !defined(__ANDROID__)
+		if (!directUpload.hostImageCopy || (std::find(hostImageCopyLayouts.begin(), hostImageCopyLayouts.end(), finalLayout) == hostImageCopyLayouts.end()))
+		{
+			return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		}
+		VkFormatProperties3 formatProperties3{};
+		formatProperties3.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_3;
+		VkFormatProperties2 formatProperties2{};
+		formatProperties2.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2;
+		formatProperties2.pNext = &formatProperties3;
+		vkGetPhysicalDeviceFormatProperties2(physicalDevice, format, &formatProperties2);
+		if ((formatProperties3.optimalTilingFeatures & VK_FORMAT_FEATURE_2_HOST_IMAGE_TRANSFER_BIT_EXT) == 0)
+		{
+			return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		}
+		// Some implementations give up compression for host copyable images, those keep the staging path
+		VkHostImageCopyDevicePerformanceQueryEXT performanceQuery{};
+		performanceQuery.sType = VK_STRUCTURE_TYPE_HOST_IMAGE_COPY_DEVICE_PERFORMANCE_QUERY_EXT;
+		VkImageFormatProperties2 imageFormatProperties{};
+		imageFormatProperties.sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2;
+		imageFormatProperties.pNext = &performanceQuery;
+		VkPhysicalDeviceImageFormatInfo2 imageFormatInfo{};
+		imageFormatInfo.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2;
+		imageFormatInfo.format = format;
+		imageFormatInfo.type = VK_IMAGE_TYPE_2D;
+		imageFormatInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageFormatInfo.usage = usageFlags | VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT;
+		if ((vkGetPhysicalDeviceImageFormatProperties2(physicalDevice, &imageFormatInfo, &imageFormatProperties) == VK_SUCCESS) && performanceQuery.optimalDeviceAccess)
+		{
+			return VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT;
+		}
+#endif
+		return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	}
+
+	/**
+	* Fill an optimal tiled image and transition it to the layout it is used in
+	*
+	* @param image Image created with uploadUsage in its usage flags
+	* @param uploadUsage Result of GetUploadUsage for the image
+	* @param subresourceRange Subresources that are filled
+	* @param data Image data
+	* @param size Size of the data in bytes
+	* @param regions Copy regions, buffer offsets are relative to data
+	* @param finalLayout Layout the image is transitioned to
+	* @param queue Queue the staging copy is submitted to
+	*/
+	void VulkanDevice::UploadImage(VkImage image, VkImageUsageFlags uploadUsage, const VkImageSubresourceRange & subresourceRange, const void * data, VkDeviceSize size,
+		const std::vector<VkBufferImageCopy>& regions, VkImageLayout finalLayout, VkQueue queue)
+	{
+		if (uploadUsage & VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT)
+		{
+			// The host writes straight into the image in its final layout, nothing is submitted
+			VkHostImageLayoutTransitionInfoEXT transition{};
+			transition.sType = VK_STRUCTURE_TYPE_HOST_IMAGE_LAYOUT_TRANSITION_INFO_EXT;
+			transition.image = image;
+			transition.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			transition.newLayout = finalLayout;
+			transition.subresourceRange = subresourceRange;
+			VK_CHECK_RESULT(fpTransitionImageLayoutEXT(logicalDevice, 1, &transition));
+
+			std::vector<VkMemoryToImageCopyEXT> copies(regions.size());
+			for (size_t i = 0; i < regions.size(); i++)
+			{
+				copies[i].sType = VK_STRUCTURE_TYPE_MEMORY_TO_IMAGE_COPY_EXT;
+				copies[i].pHostPointer = static_cast<const uint8_t*>(data) + regions[i].bufferOffset;
+				copies[i].memoryRowLength = regions[i].bufferRowLength;
+				copies[i].memoryImageHeight = regions[i].bufferImageHeight;
+				copies[i].imageSubresource = regions[i].imageSubresource;
+				copies[i].imageOffset = regions[i].imageOffset;
+				copies[i].imageExtent = regions[i].imageExtent;
+			}
+			VkCopyMemoryToImageInfoEXT copyInfo{};
+			copyInfo.sType = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_IMAGE_INFO_EXT;
+			copyInfo.dstImage = image;
+			copyInfo.dstImageLayout = finalLayout;
+			copyInfo.regionCount = static_cast<uint32_t>(copies.size());
+			copyInfo.pRegions = copies.data();
+			VK_CHECK_RESULT(fpCopyMemoryToImageEXT(logicalDevice, &copyInfo));
+			return;
+		}
+
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingMemory;
+		VK_CHECK_RESULT(CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			size, &stagingBuffer, &stagingMemory, const_cast<void*>(data)));
+
+		VkCommandBuffer copyCmd = CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+		vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+		vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, finalLayout, subresourceRange);
+		FlushCommandBuffer(copyCmd, queue);
+
+		vkDestroyBuffer(logicalDevice, stagingBuffer, nullptr);
+		vkFreeMemory(logicalDevice, stagingMemory, nullptr);
+	}
+
 	/** 
 	* Create a command pool for allocation command buffers from
 	* 
@@ -609,6 +966,199 @@ namespace vks
 		throw std::runtime_error("Could not find a matching depth format");
 	}
 
+	/**
+	* Upload the same data through the staging path and through the direct paths the device supports and print the bandwidth
+	*
+	* @param device Device to upload to
+	* @param queue Queue the staging copies are submitted to
+	* @param out Stream the results are written to
+	* @param megabytes Size of the buffer and of the RGBA8 image
+	*/
+	void benchmarkUploads(vks::VulkanDevice* device, VkQueue queue, std::ostream& out, uint32_t megabytes)
+	{
+		const uint32_t iterations = 8;
+		const double megabyte = 1024.0 * 1024.0;
+		const auto directUpload = device->directUpload;
+
+		// Square RGBA8 image of about the same size as the buffer
+		uint32_t extent = static_cast<uint32_t>(std::sqrt(static_cast<double>(megabytes) * megabyte / 4.0));
+		VkDeviceSize bufferSize = static_cast<VkDeviceSize>(megabytes) * 1024 * 1024;
+		VkDeviceSize imageSize = static_cast<VkDeviceSize>(extent) * extent * 4;
+		std::vector<uint8_t> data(static_cast<size_t>(std::max(bufferSize, imageSize)));
+		for (size_t i = 0; i < data.size(); i++)
+		{
+			data[i] = static_cast<uint8_t>(i * 31);
+		}
+
+		out << "Upload benchmark: " << megabytes << " MB, " << iterations << " iterations\n";
+		out << "  host visible device local heap: " << directUpload.hostVisibleDeviceLocalHeapSize / (1024 * 1024) << " MB, direct buffer uploads "
+			<< (directUpload.buffers ? "on" : "off") << ", VK_EXT_host_image_copy " << (directUpload.hostImageCopy ? "on" : "off") << "\n";
+
+		auto measure = [&](const char* name, VkDeviceSize size, const std::function<void()>& upload)
+		{
+			// First upload warms up allocations and pipelines in the driver
+			upload();
+			auto start = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < iterations; i++)
+			{
+				upload();
+			}
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / iterations;
+			out << "  " << name << ": " << ms << " ms, " << (size / megabyte) / (ms / 1000.0) << " MB/s\n";
+		};
+
+		auto uploadBuffer = [&]()
+		{
+			VkBuffer buffer;
+			VkDeviceMemory memory;
+			VK_CHECK_RESULT(device->CreateDeviceLocalBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, bufferSize, &buffer, &memory, data.data(), queue));
+			vkDestroyBuffer(device->logicalDevice, buffer, nullptr);
+			vkFreeMemory(device->logicalDevice, memory, nullptr);
+		};
+		auto uploadImage = [&]()
+		{
+			VkImageUsageFlags uploadUsage = device->GetUploadUsage(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			VkImageCreateInfo imageCreateInfo = vks::initializers::GenImageCreateInfo();
+			imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+			imageCreateInfo.extent = { extent, extent, 1 };
+			imageCreateInfo.mipLevels = 1;
+			imageCreateInfo.arrayLayers = 1;
+			imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | uploadUsage;
+			VkImage image;
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+			VkMemoryAllocateInfo memAllocInfo = vks::initializers::GenMemoryAllocateInfo();
+			memAllocInfo.allocationSize = memReqs.size;
+			memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			VkDeviceMemory memory;
+			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &memory));
+			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, memory, 0));
+
+			VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+			VkBufferImageCopy region = {};
+			region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			region.imageExtent = { extent, extent, 1 };
+			device->UploadImage(image, uploadUsage, subresourceRange, data.data(), imageSize, { region }, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, queue);
+			vkDestroyImage(device->logicalDevice, image, nullptr);
+			vkFreeMemory(device->logicalDevice, memory, nullptr);
+		};
+
+		device->directUpload.buffers = false;
+		device->directUpload.hostImageCopy = false;
+		measure("buffer, staging copy", bufferSize, uploadBuffer);
+		if (directUpload.buffers)
+		{
+			device->directUpload.buffers = true;
+			measure("buffer, direct write", bufferSize, uploadBuffer);
+		}
+		measure("image, staging copy", imageSize, uploadImage);
+		if (directUpload.hostImageCopy)
+		{
+			device->directUpload.hostImageCopy = true;
+			measure("image, host image copy", imageSize, uploadImage);
+		}
+		device->directUpload = directUpload;
+	}
+
+	/**
+	* Write small records into one buffer and make them visible to the device, once with a flush call per record
+	* and once with the records collected by a MappedRangeTracker and flushed together
+	*
+	* @param device Device the buffer is created on, a non coherent host visible memory type is used if there is one
+	* @param out Stream the results are written to
+	* @param rangeCount Number of records written per frame
+	*/
+	void benchmarkMappedRangeFlushes(vks::VulkanDevice* device, std::ostream& out, uint32_t rangeCount)
+	{
+		const uint32_t frames = 200;
+		const VkDeviceSize writeSize = 64;
+		const VkDeviceSize atomSize = std::max<VkDeviceSize>(device->properties.limits.nonCoherentAtomSize, 1);
+		// Each record starts on its own atom, like a per object uniform block
+		const VkDeviceSize recordSize = ((writeSize + atomSize - 1) / atomSize) * atomSize;
+		const VkDeviceSize bufferSize = recordSize * rangeCount;
+
+		VkBufferCreateInfo bufferCreateInfo = vks::initializers::GenBufferCreateInfo(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, bufferSize);
+		VkBuffer buffer;
+		VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &buffer));
+		VkMemoryRequirements memReqs;
+		vkGetBufferMemoryRequirements(device->logicalDevice, buffer, &memReqs);
+		uint32_t memoryType = device->GetHostMemoryType(memReqs.memoryTypeBits, HostAccess::Upload);
+		for (uint32_t i = 0; i < device->memoryProperties.memoryTypeCount; i++)
+		{
+			VkMemoryPropertyFlags flags = device->memoryProperties.memoryTypes[i].propertyFlags;
+			if ((memReqs.memoryTypeBits & (1u << i)) && (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+			{
+				memoryType = i;
+				break;
+			}
+		}//for
+		bool coherent = (device->memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+		VkMemoryAllocateInfo memAlloc = vks::initializers::GenMemoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = memoryType;
+		VkDeviceMemory memory;
+		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &memory));
+		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, buffer, memory, 0));
+		uint8_t* mapped;
+		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void**>(&mapped)));
+
+		out << "Mapped range flush benchmark: " << rangeCount << " records of " << writeSize << " bytes, non coherent atom " << atomSize << " bytes, "
+			<< frames << " frames\n";
+		if (coherent)
+		{
+			out << "  the device has no non coherent host visible memory, flushes are measured on coherent memory\n";
+		}
+
+		std::vector<uint8_t> record(static_cast<size_t>(writeSize), 0x5a);
+		vks::MappedRangeTracker tracker;
+		tracker.create(device->logicalDevice, atomSize);
+		// Every record dirty coalesces into one range, every fourth record dirty leaves separate ranges
+		for (uint32_t stride : { 1u, 4u })
+		{
+			auto measure = [&](bool batched)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				for (uint32_t frame = 0; frame < frames; frame++)
+				{
+					for (uint32_t i = 0; i < rangeCount; i += stride)
+					{
+						VkDeviceSize offset = i * recordSize;
+						memcpy(mapped + offset, record.data(), record.size());
+						if (batched)
+						{
+							tracker.add(memory, bufferSize, offset, writeSize);
+						}
+						else
+						{
+							VkMappedMemoryRange range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, memory, offset, recordSize };
+							VK_CHECK_RESULT(vkFlushMappedMemoryRanges(device->logicalDevice, 1, &range));
+						}
+					}//for
+					if (batched)
+					{
+						VK_CHECK_RESULT(tracker.flush());
+					}
+				}//for
+				return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / frames;
+			};
+			vks::MappedRangeTracker::Statistics before = tracker.statistics();
+			double individualMs = measure(false);
+			double batchedMs = measure(true);
+			vks::MappedRangeTracker::Statistics after = tracker.statistics();
+			out << "  " << (stride == 1 ? "all records" : "every 4th record") << ": " << individualMs << " ms per frame with a flush per record, "
+				<< batchedMs << " ms batched (" << (after.submittedRanges - before.submittedRanges) / frames << " ranges in one call), "
+				<< (individualMs - batchedMs) * 1000.0 << " us saved\n";
+		}//for
+
+		vkUnmapMemory(device->logicalDevice, memory);
+		vkDestroyBuffer(device->logicalDevice, buffer, nullptr);
+		vkFreeMemory(device->logicalDevice, memory, nullptr);
+	}
+
 
 }//namespace vks
 
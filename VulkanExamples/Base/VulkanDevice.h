@@ -16,9 +16,19 @@
 #include <algorithm>
 #include <assert.h>
 #include <exception>
+#include <ostream>
 
 namespace vks
 {
+	/** @brief How the host accesses a host visible buffer, selects its memory type */
+	enum class HostAccess
+	{
+		/** @brief Written sequentially by the host, uncached (write combined) memory is preferred */
+		Upload,
+		/** @brief Read by the host, cached memory is preferred */
+		Readback
+	};
+
 	struct VulkanDevice
 	{
 		/** @brief Physical device representation */
@@ -44,6 +54,33 @@ namespace vks
 			uint32_t computeIndex;
 			uint32_t transferIndex;
 		}	queueFamilyIndices;
+		/** @brief API version of the instance, device level functionality of newer versions is only used if both support it */
+		uint32_t instanceApiVersion = VK_API_VERSION_1_0;
+
+		/** @brief Upload paths that skip the staging copy, detected on construction and device creation, clear a flag to force the staging path */
+		struct
+		{
+			/** @brief Device local memory is host visible for the whole heap (integrated GPUs, resizable BAR), buffers are written directly */
+			bool buffers = false;
+			/** @brief VK_EXT_host_image_copy is enabled, optimal tiled images are written from the host */
+			bool hostImageCopy = false;
+			/** @brief Size of the heap behind the host visible device local memory type, 0 if there is none */
+			VkDeviceSize hostVisibleDeviceLocalHeapSize = 0;
+		}	directUpload;
+		PFN_vkCopyMemoryToImageEXT fpCopyMemoryToImageEXT = nullptr;
+		PFN_vkTransitionImageLayoutEXT fpTransitionImageLayoutEXT = nullptr;
+		/** @brief Layouts VK_EXT_host_image_copy can copy to */
+		std::vector<VkImageLayout> hostImageCopyLayouts;
+
+		/** @brief Buffer device address access, requested by the application before device creation and enabled if the device supports it */
+		struct
+		{
+			/** @brief Enable the bufferDeviceAddress feature (Vulkan 1.2) on CreateLogicalDevice */
+			bool requested = false;
+			/** @brief The feature is enabled, buffers created with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT have an address */
+			bool enabled = false;
+		}	bufferDeviceAddress;
+		PFN_vkGetBufferDeviceAddress fpGetBufferDeviceAddress = nullptr;
 
 		operator VkDevice() const
 		{
@@ -56,6 +93,9 @@ namespace vks
 
 		uint32_t GetMemoryType(uint32_t typeBits, VkMemoryPropertyFlags propertyFlags, VkBool32 *memTypeFound = nullptr)const;
 
+		/** @brief Host visible memory type suited for the access pattern, coherent types are preferred if the access pattern is equally served */
+		uint32_t GetHostMemoryType(uint32_t typeBits, HostAccess access)const;
+
 		uint32_t GetQueueFamilyIndex(VkQueueFlagBits queueFlags)const;
 
 		VkResult CreateLogicalDevice(VkPhysicalDeviceFeatures enabledDeviceFeatures, std::vector<const char*>enabledExtensions,
@@ -65,8 +105,35 @@ namespace vks
 
 		VkResult CreateBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, vks::Buffer* buffer, VkDeviceSize size, void* data = nullptr);
 
+		/**
+		* @brief Create a persistently mapped buffer in the memory type GetHostMemoryType picks for the access pattern
+		* @note memoryPropertyFlags of the buffer receives the flags of that type, non coherent buffers need their writes flushed or reads invalidated
+		*/
+		VkResult CreateHostBuffer(VkBufferUsageFlags usageFlags, HostAccess access, vks::Buffer* buffer, VkDeviceSize size);
+
 		void CopyBuffer(vks::Buffer * src, vks::Buffer * dst, VkQueue queue, VkBufferCopy * copyRegion = nullptr);
 
+		/** @brief Address of a buffer created with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, 0 if buffer device addresses are not enabled */
+		VkDeviceAddress GetBufferDeviceAddress(VkBuffer buffer)const;
+
+		/** @brief Create a device local buffer holding data, written directly if directUpload.buffers is set and copied from a staging buffer on the queue otherwise */
+		VkResult CreateDeviceLocalBuffer(VkBufferUsageFlags usageFlags, VkDeviceSize size, VkBuffer *buffer, VkDeviceMemory *memory, const void *data, VkQueue queue);
+
+		VkResult CreateDeviceLocalBuffer(VkBufferUsageFlags usageFlags, vks::Buffer *buffer, VkDeviceSize size, const void *data, VkQueue queue);
+
+		/**
+		* @brief Usage bit an optimal tiled image needs for UploadImage, VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT if the format can be written
+		* from the host to the final layout without losing optimal device access, VK_IMAGE_USAGE_TRANSFER_DST_BIT otherwise
+		*/
+		VkImageUsageFlags GetUploadUsage(VkFormat format, VkImageUsageFlags usageFlags, VkImageLayout finalLayout);
+
+		/**
+		* @brief Fill an image created with uploadUsage added to its usage and transition it to finalLayout
+		* @note Region buffer offsets are offsets into data
+		*/
+		void UploadImage(VkImage image, VkImageUsageFlags uploadUsage, const VkImageSubresourceRange &subresourceRange, const void *data, VkDeviceSize size,
+			const std::vector<VkBufferImageCopy> &regions, VkImageLayout finalLayout, VkQueue queue);
+
 		VkCommandPool CreateCommandPool(uint32_t queueFamilyIndex, VkCommandPoolCreateFlags createFlags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
 		VkCommandBuffer CreateCommandBuffer(VkCommandBufferLevel	level, VkCommandPool curCommandPool, bool begin = false);
@@ -82,4 +149,10 @@ namespace vks
 		VkFormat GetSupportedDepthFormat(bool checkSamplingSupport);
 
 	};//VulkanDevice
+
+	/** @brief Compares staging and direct upload bandwidth for buffers and images of the given size */
+	void benchmarkUploads(vks::VulkanDevice* device, VkQueue queue, std::ostream& out, uint32_t megabytes = 64);
+
+	/** @brief Compares the CPU cost of flushing dirty ranges of non coherent memory one by one against one batched flush per frame */
+	void benchmarkMappedRangeFlushes(vks::VulkanDevice* device, std::ostream& out, uint32_t rangeCount = 4096);
 }
\ No newline at end of file
@@ -10,6 +10,18 @@
 
 #include "VulkanExampleBase.h"
 
+#include "ParallelAlgorithms.hpp"
+#include "VulkanRenderQueue.h"
+#include "VulkanMemoryPool.h"
+#include "VulkanglTFModel.h"
+#include "VulkanSceneStreaming.h"
+#include "VulkanComputeTracer.h"
+#include "VulkanNeighborGrid.h"
+#include "VulkanClusteredLighting.h"
+#include "VulkanCascadedShadows.h"
+#include "VulkanPostProcess.h"
+#include "VulkanTerrain.h"
+
 #if (defined(VK_USE_PLATFORM_MACOS_MVK) && defined(VK_EXAMPLE_XCODE_GENERATED))
 #include <Cocoa/Cocoa.h>
 #include <QuartzCore/CAMetalLayer.h>
@@ -119,6 +131,7 @@ void VulkanExampleBase::nextFrame()
 
 	// TODO: Cap UI overlay update rates
 	updateOverlay();
+	frameStats.endFrame(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count());
 }
 
 void VulkanExampleBase::updateOverlay()
@@ -138,6 +151,7 @@ void VulkanExampleBase::updateOverlay()
 	io.MouseDown[1] = mouseState.buttons.right && uiOverlay.visible;
 	io.MouseDown[2] = mouseState.buttons.middle && uiOverlay.visible;
 
+	auto tUpdateStart = std::chrono::high_resolution_clock::now();
 	ImGui::NewFrame();
 
 	ImGui::PushStyleVar(ImGuiStyleVar_WindowRounding, 0);
@@ -147,6 +161,7 @@ void VulkanExampleBase::updateOverlay()
 	ImGui::TextUnformatted(windowTitle.c_str());
 	ImGui::TextUnformatted(deviceProperties.deviceName);
 	ImGui::Text("%.2f ms/frame (%.1d fps)", (1000.0f / lastFPS), lastFPS);
+	updateFrameStatsOverlay();
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0.0f, 5.0f * uiOverlay.scale));
@@ -161,8 +176,10 @@ void VulkanExampleBase::updateOverlay()
 	ImGui::End();
 	ImGui::PopStyleVar();
 	ImGui::Render();
+	frameStats.addStage(vks::FrameStats::Update, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tUpdateStart).count());
 
 	if (uiOverlay.update() || uiOverlay.updated) {
+		vks::FrameStats::ScopedStage recordStage(frameStats, vks::FrameStats::Record);
 		buildCommandBuffersForMainRendering();
 		uiOverlay.updated = false;
 	}
@@ -174,6 +191,75 @@ void VulkanExampleBase::updateOverlay()
 #endif
 }
 
+// Collapsed panel below the frame rate: percentiles of the CPU frame time, a graph of the window with spikes marked in red
+// and the average and worst time of every stage. Nothing is allocated, the graph reads the ring directly
+void VulkanExampleBase::updateFrameStatsOverlay()
+{
+	if (!ImGui::CollapsingHeader("Frame timing"))
+	{
+		return;
+	}
+	const vks::FrameStats::Summary summary = frameStats.summarize(static_cast<uint32_t>(frameStatsWindow));
+	if (summary.frames < 2)
+	{
+		return;
+	}
+	ImGui::Text("CPU p50 %.2f ms, p99 %.2f ms, max %.2f ms", summary.p50, summary.p99, summary.max);
+	if (summary.gpuAverage > 0.0f)
+	{
+		ImGui::Text("GPU %.2f ms average", summary.gpuAverage);
+	}
+
+	// Oldest frame on the left
+	struct Graph
+	{
+		const vks::FrameStats* stats;
+		uint32_t frames;
+		static float value(void* data, int index)
+		{
+			const Graph* graph = static_cast<const Graph*>(data);
+			return graph->stats->frame(graph->frames - 1 - static_cast<uint32_t>(index)).cpuMilliseconds;
+		}
+	} graph = { &frameStats, summary.frames };
+	const float scaleMax = std::max(summary.p99 * 1.5f, summary.p50 * frameStats.spikeFactor * 1.25f);
+	char overlayText[32];
+	snprintf(overlayText, sizeof(overlayText), "%.2f ms", frameStats.frame(0).cpuMilliseconds);
+	ImGui::PlotLines("##frametimes", &Graph::value, &graph, static_cast<int>(summary.frames), 0, overlayText, 0.0f, scaleMax,
+		ImVec2(220.0f * uiOverlay.scale, 60.0f * uiOverlay.scale));
+
+	// The plot fills the item rectangle minus the frame padding, the markers use the same mapping
+	const ImVec2 padding = ImGui::GetStyle().FramePadding;
+	const ImVec2 plotMin = ImVec2(ImGui::GetItemRectMin().x + padding.x, ImGui::GetItemRectMin().y + padding.y);
+	const ImVec2 plotMax = ImVec2(ImGui::GetItemRectMax().x - padding.x, ImGui::GetItemRectMax().y - padding.y);
+	ImDrawList* drawList = ImGui::GetWindowDrawList();
+	const float p99Y = plotMax.y - std::min(summary.p99 / scaleMax, 1.0f) * (plotMax.y - plotMin.y);
+	drawList->AddLine(ImVec2(plotMin.x, p99Y), ImVec2(plotMax.x, p99Y), ImGui::GetColorU32(ImVec4(1.0f, 1.0f, 0.0f, 0.5f)));
+	const float spikeThreshold = summary.p50 * frameStats.spikeFactor;
+	for (uint32_t index = 0; index < summary.frames; index++)
+	{
+		if (Graph::value(&graph, static_cast<int>(index)) > spikeThreshold)
+		{
+			const float x = plotMin.x + (plotMax.x - plotMin.x) * index / (summary.frames - 1);
+			drawList->AddLine(ImVec2(x, plotMin.y), ImVec2(x, plotMax.y), ImGui::GetColorU32(ImVec4(1.0f, 0.0f, 0.0f, 0.8f)));
+		}
+	}
+
+	if (summary.spikes > 0)
+	{
+		ImGui::Text("%u spikes > %.1fx p50, last %u frames ago", summary.spikes, frameStats.spikeFactor, summary.lastSpikeAge);
+	}
+	else
+	{
+		ImGui::Text("No spikes > %.1fx p50", frameStats.spikeFactor);
+	}
+	for (uint32_t stage = 0; stage < vks::FrameStats::StageCount; stage++)
+	{
+		ImGui::Text("%-13s %6.3f ms avg %6.3f max", vks::FrameStats::stageName(static_cast<vks::FrameStats::Stage>(stage)),
+			summary.stageAverage[stage], summary.stageMax[stage]);
+	}
+	uiOverlay.sliderInt("Frames", &frameStatsWindow, 60, static_cast<int32_t>(vks::FrameStats::capacity));
+}
+
 void VulkanExampleBase::createPipelineCache()
 {
 	VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
@@ -285,6 +371,25 @@ VulkanExampleBase::VulkanExampleBase()
 	commandLineParser.add("benchmarkresultfile", { "-bf", "--benchfilename" }, 1, "Set file name for benchmark results");
 	commandLineParser.add("benchmarkresultframes", { "-bt", "--benchframetimes" }, 0, "Save frame times to benchmark results file");
 	commandLineParser.add("benchmarkframes", { "-bfs", "--benchmarkframes" }, 1, "Only render the given number of frames");
+	commandLineParser.add("threadpinning", { "-tp", "--threadpinning" }, 1, "Pin the render and worker threads to cores or NUMA nodes (none, core or node)");
+	commandLineParser.add("assetbenchmark", { "-ab", "--assetbenchmark" }, 1, "Benchmark the given number of concurrent texture uploads with blocking and fiber jobs and exit");
+	commandLineParser.add("parallelbenchmark", { "-pb", "--parallelbenchmark" }, 0, "Benchmark the parallel algorithms against the standard library and exit");
+	commandLineParser.add("uploadbenchmark", { "-ub", "--uploadbenchmark" }, 1, "Compare staging and direct upload bandwidth for buffers and images of the given size in MB and exit");
+	commandLineParser.add("flushbenchmark", { "-fb", "--flushbenchmark" }, 1, "Compare flushing the given number of dirty ranges of non coherent memory one by one and batched and exit");
+	commandLineParser.add("defragbenchmark", { "-db", "--defragbenchmark" }, 1, "Run the memory pool soak test for the given number of frames without and with defragmentation and exit");
+	commandLineParser.add("streamingbenchmark", { "-sb", "--streamingbenchmark" }, 1, "Fly over a streamed world for the given number of frames, loading inside the frame and streamed, and exit");
+	commandLineParser.add("computetracebenchmark", { "-ctb", "--computetracebenchmark" }, 1, "Build a BVH over the given glTF file, trace it with the compute path tracer, report rays per second and exit");
+	commandLineParser.add("neighborgridbenchmark", { "-ngb", "--neighborgridbenchmark" }, 0, "Build the GPU neighbor grid over growing particle counts, report build time and queries per second and exit");
+	commandLineParser.add("cascadedshadowbenchmark", { "-csb", "--cascadedshadowbenchmark" }, 1, "Render the cascaded shadow maps of a generated scene for the given number of frames, report the cost per cascade and exit");
+	commandLineParser.add("postprocessbenchmark", { "-ppb", "--postprocessbenchmark" }, 1, "Run the post processing stack for the given number of frames per resolution, report the GPU time of each pass and exit");
+	commandLineParser.add("vrsbenchmark", { "-vrsb", "--vrsbenchmark" }, 1, "Render the given number of frames at full and at adaptive shading rates, report the fragment invocations saved and exit");
+	commandLineParser.add("terrainbenchmark", { "-trb", "--terrainbenchmark" }, 1, "Fly over a generated streaming terrain for the given number of frames, report the memory footprint and tile load throughput and exit");
+	commandLineParser.add("vertexpullingbenchmark", { "-vpb", "--vertexpullingbenchmark" }, 1, "Render a scene with vertex pulling and with vertex input draws for the given number of frames each, compare the recording and GPU times and exit (enables buffer device addresses)");
+	commandLineParser.add("clusteredlightingbenchmark", { "-clb", "--clusteredlightingbenchmark" }, 0, "Validate the clustered light lists against the CPU, report the culling time of growing light counts and exit");
+	commandLineParser.add("bufferdeviceaddress", { "-bda", "--bufferdeviceaddress" }, 0, "Access buffers through device addresses where examples support it (requires Vulkan 1.2)");
+	commandLineParser.add("computesplatting", { "-cs", "--computesplatting" }, 0, "Render particles by splatting them in compute shaders where examples support it");
+	commandLineParser.add("renderqueuebenchmark", { "-rqb", "--renderqueuebenchmark" }, 1, "Compare binds and CPU time of the given number of draws in submission and sorted order and exit");
+	commandLineParser.add("traversalbenchmark", { "-tb", "--traversalbenchmark" }, 1, "Compare updating and drawing a generated scene of the given number of nodes stored as pointers and in registries and exit");
 
 	commandLineParser.parse(args);
 	if (commandLineParser.isSet("help")) {
@@ -359,6 +464,33 @@ VulkanExampleBase::VulkanExampleBase()
 		benchmark.outputFrames = commandLineParser.getValueAsInt("benchmarkframes", benchmark.outputFrames);
 	}
 
+	if (commandLineParser.isSet("threadpinning"))
+	{
+		std::string value = commandLineParser.getValueAsString("threadpinning", "none");
+		if (!vks::threading::parsePinning(value, settings.threadPinning))
+		{
+			std::cerr << "Thread pinning must be one of 'none', 'core' or 'node'\n";
+		}
+	}
+	configureThreads();
+
+	if (commandLineParser.isSet("bufferdeviceaddress") || commandLineParser.isSet("vertexpullingbenchmark"))
+	{
+		settings.bufferDeviceAddress = true;
+	}
+
+	if (commandLineParser.isSet("computesplatting"))
+	{
+		settings.computeSplatting = true;
+	}
+
+	// Benchmarks that do not need a Vulkan device
+	runRequestedBenchmark({
+		{ "parallelbenchmark", [](std::ostream& out) { vks::parallel::benchmark(out); } },
+		{ "renderqueuebenchmark", [this](std::ostream& out) { vks::benchmarkRenderQueue(out, getBenchmarkCount("renderqueuebenchmark", 20000)); } },
+		{ "traversalbenchmark", [this](std::ostream& out) { vkglTF::benchmarkTraversal(out, getBenchmarkCount("traversalbenchmark", 100000)); } },
+	});
+
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	// Vulkan library is loaded dynamically on Android
 	bool libLoaded = vks::android::loadVulkanLibrary();
@@ -473,6 +605,28 @@ bool VulkanExampleBase::initVulkanSetting()
 {
 	VkResult err;
 
+#if !defined(__ANDROID__)
+	// Request up to Vulkan 1.3 so the device can enable VK_EXT_host_image_copy for direct image uploads,
+	// capped to what the loader supports (vkEnumerateInstanceVersion is missing from 1.0 loaders)
+	uint32_t instanceVersion = VK_API_VERSION_1_0;
+	PFN_vkEnumerateInstanceVersion fpEnumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+	if (fpEnumerateInstanceVersion && (fpEnumerateInstanceVersion(&instanceVersion) != VK_SUCCESS))
+	{
+		instanceVersion = VK_API_VERSION_1_0;
+	}
+	apiVersion = std::max(apiVersion, std::min(instanceVersion, static_cast<uint32_t>(VK_API_VERSION_1_3)));
+#endif
+	// Buffer device addresses are core in Vulkan 1.2
+	if (settings.bufferDeviceAddress)
+	{
+		apiVersion = std::max(apiVersion, static_cast<uint32_t>(VK_API_VERSION_1_2));
+	}
+	// Attachment shading rates are queried through Vulkan 1.1 entry points
+	if (commandLineParser.isSet("vrsbenchmark"))
+	{
+		apiVersion = std::max(apiVersion, static_cast<uint32_t>(VK_API_VERSION_1_1));
+	}
+
 	// Vulkan instance
 	err = createInstance(settings.validation);
 	if (err) {
@@ -555,10 +709,24 @@ bool VulkanExampleBase::initVulkanSetting()
 	// This is handled by a separate class that gets a logical device representation
 	// and encapsulates functions related to a device
 	vulkanDevice = new vks::VulkanDevice(physicalDevice);
+	vulkanDevice->instanceApiVersion = apiVersion;
+	vulkanDevice->bufferDeviceAddress.requested = settings.bufferDeviceAddress;
 
 	// Derived examples can enable extensions based on the list of supported extensions read from the physical device
 	getEnabledExtensions();
 
+	// The VRS benchmark counts fragment invocations and needs the shading rate extensions
+	if (commandLineParser.isSet("vrsbenchmark"))
+	{
+		curEnabledDeviceFeatures.pipelineStatisticsQuery = deviceFeatures.pipelineStatisticsQuery;
+		benchmarkShadingRate.requestDeviceSupport(vulkanDevice, apiVersion, enabledDeviceExtensions, pDeviceCreateNextChain);
+	}
+	// The streaming terrain is drawn as tessellated patches
+	if (commandLineParser.isSet("terrainbenchmark"))
+	{
+		curEnabledDeviceFeatures.tessellationShader = deviceFeatures.tessellationShader;
+	}
+
 	VkResult res = vulkanDevice->CreateLogicalDevice(curEnabledDeviceFeatures, enabledDeviceExtensions, pDeviceCreateNextChain);
 	if (res != VK_SUCCESS)
     {
@@ -606,9 +774,69 @@ bool VulkanExampleBase::initVulkanSetting()
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = &semaphores.renderComplete;
 
+	// Benchmarks on the device, run before anything else uses the graphics queue
+	runRequestedBenchmark({
+		{ "assetbenchmark", [this](std::ostream& out) { vks::benchmarkAssetLoading(vulkanDevice, graphicQueue, out, getBenchmarkCount("assetbenchmark", 256)); } },
+		{ "uploadbenchmark", [this](std::ostream& out) { vks::benchmarkUploads(vulkanDevice, graphicQueue, out, getBenchmarkCount("uploadbenchmark", 64)); } },
+		{ "flushbenchmark", [this](std::ostream& out) { vks::benchmarkMappedRangeFlushes(vulkanDevice, out, getBenchmarkCount("flushbenchmark", 4096)); } },
+		{ "defragbenchmark", [this](std::ostream& out) { vks::benchmarkDefragmentation(vulkanDevice, graphicQueue, out, getBenchmarkCount("defragbenchmark", 2000)); } },
+		{ "streamingbenchmark", [this](std::ostream& out) { vks::benchmarkStreaming(vulkanDevice, graphicQueue, out, getBenchmarkCount("streamingbenchmark", 600)); } },
+		{ "computetracebenchmark", [this](std::ostream& out)
+			{
+				vks::benchmarkComputeTracer(vulkanDevice, graphicQueue, getShadersPath(), commandLineParser.getValueAsString("computetracebenchmark", ""), out);
+			} },
+		{ "neighborgridbenchmark", [this](std::ostream& out) { vks::benchmarkNeighborGrid(vulkanDevice, graphicQueue, getShadersPath(), out); } },
+		{ "clusteredlightingbenchmark", [this](std::ostream& out) { vks::benchmarkClusteredLighting(vulkanDevice, graphicQueue, getShadersPath(), out); } },
+		{ "postprocessbenchmark", [this](std::ostream& out)
+			{
+				vks::benchmarkPostProcess(vulkanDevice, graphicQueue, getShadersPath(), apiVersion, out, getBenchmarkCount("postprocessbenchmark", 120));
+			} },
+		{ "vrsbenchmark", [this](std::ostream& out)
+			{
+				vks::benchmarkVariableRateShading(vulkanDevice, graphicQueue, getShadersPath(), benchmarkShadingRate, out, getBenchmarkCount("vrsbenchmark", 300));
+			} },
+		{ "terrainbenchmark", [this](std::ostream& out)
+			{
+				vks::benchmarkTerrain(vulkanDevice, graphicQueue, getShadersPath(), out, getBenchmarkCount("terrainbenchmark", 600));
+			} },
+		{ "cascadedshadowbenchmark", [this](std::ostream& out)
+			{
+				vks::benchmarkCascadedShadows(vulkanDevice, graphicQueue, getShadersPath(), out, getBenchmarkCount("cascadedshadowbenchmark", 600));
+			} },
+		{ "vertexpullingbenchmark", [this](std::ostream& out)
+			{
+				vkglTF::benchmarkVertexPulling(vulkanDevice, graphicQueue, getShadersPath(), out, getBenchmarkCount("vertexpullingbenchmark", 300));
+			} },
+	});
+
 	return true;
 }
 
+/**
+* Benchmarks replace the example, the first one of the table whose flag is set runs with its report on the console and the process exits
+*
+* @param benchmarks Table of the flags and the benchmarks they select, in priority order
+*/
+void VulkanExampleBase::runRequestedBenchmark(const std::vector<BenchmarkEntry>& benchmarks)
+{
+	for (const BenchmarkEntry& entry : benchmarks)
+	{
+		if (commandLineParser.isSet(entry.flag))
+		{
+#if defined(_WIN32)
+			setupConsole("Vulkan example");
+#endif
+			entry.run(std::cout);
+			exit(0);
+		}
+	}//for
+}
+
+uint32_t VulkanExampleBase::getBenchmarkCount(const std::string& flag, int32_t defaultValue)
+{
+	return static_cast<uint32_t>(std::max(commandLineParser.getValueAsInt(flag, defaultValue), 1));
+}
+
 #if defined(_WIN32)
 // Win32 : Sets up a console window and redirects standard output to it
 void VulkanExampleBase::setupConsole(std::string title)
@@ -2789,29 +3017,93 @@ void VulkanExampleBase::getEnabledExtensions() {}
 
 void VulkanExampleBase::prepareForRendering()
 {
-	initSwapChainSurface();
-	createCommandPool();
-	setupSwapChain();
-	createCommandBuffers();
-	createSynchronizationPrimitives();
-	setupDepthStencil();
-	setupRenderPass();
-	createPipelineCache();
-	setupFrameBuffer();
+	vks::StartupGraph startupGraph;
+	addBaseStartupTasks(startupGraph);
+	runStartupGraph(startupGraph);
+}
+
+VulkanExampleBase::BaseStartupTasks VulkanExampleBase::addBaseStartupTasks(vks::StartupGraph& graph)
+{
+	typedef vks::StartupGraph::Affinity Affinity;
+	BaseStartupTasks baseTasks;
+
+	// The surface also selects the present queue family and the color format
+	vks::StartupGraph::TaskId surface = graph.addTask("surface", [this] { initSwapChainSurface(); }, {}, Affinity::MainThread);
+	vks::StartupGraph::TaskId commandPool = graph.addTask("command pool", [this] { createCommandPool(); }, { surface });
+	vks::StartupGraph::TaskId swapChainTask = graph.addTask("swapchain", [this] { setupSwapChain(); }, { surface });
+	vks::StartupGraph::TaskId commandBuffers = graph.addTask("command buffers", [this]
+	{
+		createCommandBuffers();
+		createSynchronizationPrimitives();
+	}, { swapChainTask, commandPool });
+	// The swap chain may change the window size the depth buffer is created with
+	vks::StartupGraph::TaskId depth = graph.addTask("depth stencil", [this] { setupDepthStencil(); }, { swapChainTask });
+	baseTasks.renderPass = graph.addTask("render pass", [this] { setupRenderPass(); }, { surface });
+	baseTasks.pipelineCache = graph.addTask("pipeline cache", [this] { createPipelineCache(); });
+	vks::StartupGraph::TaskId frameBuffers = graph.addTask("frame buffers", [this] { setupFrameBuffer(); }, { swapChainTask, depth, baseTasks.renderPass });
+
+	std::vector<vks::StartupGraph::TaskId> baseSteps = { commandBuffers, frameBuffers };
 
 	settings.overlay = settings.overlay && (!benchmark.active);
 	if (settings.overlay)
 	{
 		uiOverlay.device = vulkanDevice;
 		uiOverlay.queue = graphicQueue;
-		uiOverlay.shaders =
+		vks::StartupGraph::TaskId overlayShaders = graph.addTask("overlay shaders", [this]
 		{
-			loadShader(getShadersPath() + "base/uioverlay.vert.spv",VK_SHADER_STAGE_VERTEX_BIT),
-			loadShader(getShadersPath() + "base/uioverlay.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT),
-		};
-		uiOverlay.prepareResources();
-		uiOverlay.preparePipeline(pipelineCache, renderPass, swapChain.colorFormat, depthFormat);
+			uiOverlay.shaders =
+			{
+				loadShader(getShadersPath() + "base/uioverlay.vert.spv",VK_SHADER_STAGE_VERTEX_BIT),
+				loadShader(getShadersPath() + "base/uioverlay.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT),
+			};
+		});
+		// Uploads the font through the device's command pool and the graphics queue
+		vks::StartupGraph::TaskId overlayResources = graph.addTask("overlay resources", [this] { uiOverlay.prepareResources(); }, {}, Affinity::MainThread);
+		baseSteps.push_back(graph.addTask("overlay pipeline", [this]
+		{
+			uiOverlay.preparePipeline(pipelineCache, renderPass, swapChain.colorFormat, depthFormat);
+		}, { overlayShaders, overlayResources, baseTasks.pipelineCache, baseTasks.renderPass }));
 	}
+
+	baseTasks.complete = graph.addJoin("base", baseSteps);
+	return baseTasks;
+}
+
+void VulkanExampleBase::runStartupGraph(vks::StartupGraph& graph)
+{
+	graph.workerPlacement = workerPlacement("vks startup");
+	graph.run();
+	graph.printTimeline();
+}
+
+vks::threading::ThreadPlacement VulkanExampleBase::workerPlacement(const std::string& name) const
+{
+	vks::threading::ThreadPlacement placement;
+	placement.pinning = settings.threadPinning;
+	placement.priority = vks::threading::Priority::FrameCritical;
+	placement.name = name;
+	placement.reservedCores = 1;
+	return placement;
+}
+
+/**
+* Apply the thread pinning setting to the render thread and the workers of the parallel algorithms
+*
+* The render thread is pinned to the first core (or the first NUMA node) before any worker is started from it,
+* which the benchmark reports so frame time variance can be compared between the pinning modes
+*/
+void VulkanExampleBase::configureThreads()
+{
+	vks::threading::ThreadPlacement renderPlacement;
+	renderPlacement.pinning = settings.threadPinning;
+	renderPlacement.priority = vks::threading::Priority::FrameCritical;
+	renderPlacement.name = "vks render";
+	vks::threading::applyPlacement(renderPlacement, 0);
+
+	vks::ThreadPool& pool = vks::parallel::threadPool();
+	pool.setThreadCount(static_cast<uint32_t>(pool.threads.size()), workerPlacement("vks parallel"));
+
+	benchmark.configuration = std::string("threadpinning=") + vks::threading::toString(settings.threadPinning);
 }
 
 VkPipelineShaderStageCreateInfo VulkanExampleBase::loadShader(std::string fileName, VkShaderStageFlagBits stage)
@@ -2827,7 +3119,10 @@ VkPipelineShaderStageCreateInfo VulkanExampleBase::loadShader(std::string fileNa
 
 	shaderStage.pName = "main";
 	assert(shaderStage.module != VK_NULL_HANDLE);
-	shaderModules.push_back(shaderStage.module);
+	{
+		std::lock_guard<std::mutex> lock(shaderModulesMutex);
+		shaderModules.push_back(shaderStage.module);
+	}
 
 	return shaderStage;
 }
@@ -3293,6 +3588,7 @@ void VulkanExampleBase::drawUI(const VkCommandBuffer commandBuffer)
 
 void VulkanExampleBase::prepareFrame()
 {
+	vks::FrameStats::ScopedStage acquireStage(frameStats, vks::FrameStats::AcquireWait);
 	//Acquire the next image from the swap chain λһ֡ƽpresentлź
 	VkResult result = swapChain.acquireNextImage(semaphores.presentComplete, &currentCmdBufferIndex);
 
@@ -3312,6 +3608,7 @@ void VulkanExampleBase::prepareFrame()
 
 void VulkanExampleBase::submitFrame()
 {
+	vks::FrameStats::ScopedStage presentStage(frameStats, vks::FrameStats::Present);
 	VkResult result = swapChain.queuePresent(graphicQueue, currentCmdBufferIndex, semaphores.renderComplete);
     // Recreate the swapchain if it's no longer compatible with the surface (OUT_OF_DATE) or no longer optimal for presentation (SUBOPTIMAL)
 	
@@ -3334,7 +3631,10 @@ void VulkanExampleBase::renderFrame()
 	VulkanExampleBase::prepareFrame();
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &drawCmdBuffers[currentCmdBufferIndex];
-	VK_CHECK_RESULT(vkQueueSubmit(graphicQueue, 1, &submitInfo, VK_NULL_HANDLE));
+	{
+		vks::FrameStats::ScopedStage submitStage(frameStats, vks::FrameStats::Submit);
+		VK_CHECK_RESULT(vkQueueSubmit(graphicQueue, 1, &submitInfo, VK_NULL_HANDLE));
+	}
 
 	VulkanExampleBase::submitFrame();
 }
@@ -44,6 +44,8 @@
 #include <chrono>
 #include <random>
 #include <algorithm>
+#include <mutex>
+#include <functional>
 #include <sys/stat.h>
 
 #define GLM_FORCE_RADIANS
@@ -73,6 +75,11 @@
 #include "VulkanInitializers.hpp"
 #include "camera.hpp"
 #include "benchmark.hpp"
+#include "VulkanStartupGraph.h"
+#include "ThreadAffinity.h"
+#include "VulkanJobSystem.h"
+#include "VulkanFrameStats.h"
+#include "VulkanVariableRateShading.h"
 
 class VulkanExampleBase
 {
@@ -84,6 +91,7 @@ private:
 	void handleMouseMove(int32_t x, int32_t y);
 	void nextFrame();
 	void updateOverlay();
+	void updateFrameStatsOverlay();
 	void createPipelineCache();
 	void createCommandPool();
 	void createSynchronizationPrimitives();
@@ -91,7 +99,21 @@ private:
 	void setupSwapChain();
 	void createCommandBuffers();
 	void destroyCommandBuffers();
+	void configureThreads();
 	std::string shaderDir = "glsl";
+	/** @brief Benchmark run instead of the example if its command line flag is set */
+	struct BenchmarkEntry
+	{
+		/** @brief Name of the command line option selecting the benchmark */
+		const char* flag;
+		std::function<void(std::ostream&)> run;
+	};
+	/** @brief Runs the first benchmark of the table whose flag is set and exits, returns if none is set */
+	void runRequestedBenchmark(const std::vector<BenchmarkEntry>& benchmarks);
+	/** @brief Count passed to a benchmark flag, at least 1 */
+	uint32_t getBenchmarkCount(const std::string& flag, int32_t defaultValue);
+	/** @brief Shading rate module of the VRS benchmark, its device support has to be requested before the device is created */
+	vks::VariableRateShading benchmarkShadingRate;
 protected:
 	// Returns the path to the root of the glsl or hlsl shader directory.
 	std::string getShadersPath() const;
@@ -100,6 +122,10 @@ protected:
 	uint32_t frameCounter = 0;
 	uint32_t lastFPS = 0;
 	std::chrono::time_point<std::chrono::high_resolution_clock> lastTimestamp, tPrevEnd;
+	// Timings of the recent frames for the frame timing panel of the overlay, examples add their stages and GPU time
+	vks::FrameStats frameStats;
+	// Frames the percentiles and the graph of the frame timing panel cover
+	int32_t frameStatsWindow = 300;
 	// Vulkan instance, stores all per-application states
 	VkInstance instance{ VK_NULL_HANDLE };
 	std::vector<std::string> supportedInstanceExtensions;
@@ -142,6 +168,8 @@ protected:
 	VkDescriptorPool descriptorPool{ VK_NULL_HANDLE };
 	// List of shader modules created (stored for cleanup)
 	std::vector<VkShaderModule> shaderModules;
+	// loadShader may be called from startup graph workers
+	std::mutex shaderModulesMutex;
 	// Pipeline cache object
 	VkPipelineCache pipelineCache{ VK_NULL_HANDLE };
 	// Wraps the swap chain to present images (framebuffers) to the windowing system
@@ -186,6 +214,12 @@ public:
 		bool vsync = false;
 		/** @brief Enable UI overlay */
 		bool overlay = true;
+		/** @brief Pinning of the render thread and the worker threads, set via command line */
+		vks::threading::Pinning threadPinning = vks::threading::Pinning::None;
+		/** @brief Request buffer device addresses (raises the API version to 1.2), set via command line, check vulkanDevice->bufferDeviceAddress.enabled before using them */
+		bool bufferDeviceAddress = false;
+		/** @brief Render particles with compute splatting instead of point sprites, set via command line, examples without particles ignore it */
+		bool computeSplatting = false;
 	} settings;
 
 	/** @brief State of gamepad input (only used on Android) */
@@ -389,6 +423,27 @@ public:
 	/** @brief Prepares all Vulkan resources and functions required to run the sample */
 	virtual void prepareForRendering();
 
+	/** @brief Startup graph tasks of the base setup that example steps can depend on */
+	struct BaseStartupTasks
+	{
+		vks::StartupGraph::TaskId renderPass;
+		vks::StartupGraph::TaskId pipelineCache;
+		/** @brief Completes with the last base step (frame buffers, command buffers, overlay) */
+		vks::StartupGraph::TaskId complete;
+	};
+	/**
+	* @brief Adds the swap chain, depth stencil, render pass, pipeline cache, frame buffer and overlay setup to a startup graph
+	* @note setupDepthStencil, setupRenderPass and setupFrameBuffer run on worker threads and must not use the device's command pool or the graphics queue
+	*/
+	BaseStartupTasks addBaseStartupTasks(vks::StartupGraph& graph);
+	/** @brief Runs a startup graph and prints its timeline */
+	void runStartupGraph(vks::StartupGraph& graph);
+	/**
+	* @brief Placement for frame critical worker threads following the thread pinning setting
+	* @note Per core pinning leaves the first core to the render thread
+	*/
+	vks::threading::ThreadPlacement workerPlacement(const std::string& name) const;
+
 	/** @brief Loads a SPIR-V shader file for the given shader stage */
 	VkPipelineShaderStageCreateInfo loadShader(std::string fileName, VkShaderStageFlagBits stage);
 
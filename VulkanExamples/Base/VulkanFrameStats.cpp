@@ -0,0 +1,155 @@
+/*
+* Frame statistics
+*
+* Fixed size ring buffer of per frame CPU and GPU timings with a breakdown into the stages of a frame, cheap enough to record
+* every frame of a long session. Stage times are accumulated in atomics, so frame graph workers can time their submits while
+* the main thread commits the frames. Nothing allocates after construction
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanFrameStats.h"
+
+#include <algorithm>
+
+namespace vks
+{
+	namespace
+	{
+		uint64_t toNanoseconds(double milliseconds)
+		{
+			return static_cast<uint64_t>(std::max(milliseconds, 0.0) * 1e6);
+		}
+
+		float toMilliseconds(uint64_t nanoseconds)
+		{
+			return static_cast<float>(static_cast<double>(nanoseconds) * 1e-6);
+		}
+	}
+
+	FrameStats::FrameStats()
+	{
+		for (std::atomic<uint64_t>& stage : stageNanoseconds)
+		{
+			stage.store(0, std::memory_order_relaxed);
+		}
+		gpuNanoseconds.store(0, std::memory_order_relaxed);
+	}
+
+	void FrameStats::addStage(Stage stage, double milliseconds)
+	{
+		stageNanoseconds[stage].fetch_add(toNanoseconds(milliseconds), std::memory_order_relaxed);
+	}
+
+	void FrameStats::setGpuMilliseconds(double milliseconds)
+	{
+		gpuNanoseconds.store(toNanoseconds(milliseconds), std::memory_order_relaxed);
+	}
+
+	/**
+	* Commit the current frame
+	*
+	* The stage accumulators are swapped with zero, time added by a worker while the frame is committed goes to the next frame
+	*
+	* @param cpuMilliseconds CPU time of the whole frame
+	*/
+	void FrameStats::endFrame(double cpuMilliseconds)
+	{
+		Frame& frame = frames[frameCount % capacity];
+		frame.cpuMilliseconds = static_cast<float>(cpuMilliseconds);
+		frame.gpuMilliseconds = toMilliseconds(gpuNanoseconds.load(std::memory_order_relaxed));
+		for (uint32_t stage = 0; stage < StageCount; stage++)
+		{
+			frame.stageMilliseconds[stage] = toMilliseconds(stageNanoseconds[stage].exchange(0, std::memory_order_relaxed));
+		}
+		frameCount++;
+	}
+
+	uint32_t FrameStats::size() const
+	{
+		return static_cast<uint32_t>(std::min<uint64_t>(frameCount, capacity));
+	}
+
+	const FrameStats::Frame& FrameStats::frame(uint32_t age) const
+	{
+		return frames[(frameCount - 1 - age) % capacity];
+	}
+
+	/**
+	* @param frameCount Frames to summarize, clamped to the committed frames
+	*/
+	FrameStats::Summary FrameStats::summarize(uint32_t frameCount)
+	{
+		Summary summary;
+		summary.frames = std::min(frameCount, size());
+		if (summary.frames == 0)
+		{
+			return summary;
+		}
+
+		uint32_t gpuFrames = 0;
+		for (uint32_t age = 0; age < summary.frames; age++)
+		{
+			const Frame& current = frame(age);
+			scratch[age] = current.cpuMilliseconds;
+			summary.average += current.cpuMilliseconds;
+			summary.max = std::max(summary.max, current.cpuMilliseconds);
+			if (current.gpuMilliseconds > 0.0f)
+			{
+				summary.gpuAverage += current.gpuMilliseconds;
+				gpuFrames++;
+			}
+			for (uint32_t stage = 0; stage < StageCount; stage++)
+			{
+				summary.stageAverage[stage] += current.stageMilliseconds[stage];
+				summary.stageMax[stage] = std::max(summary.stageMax[stage], current.stageMilliseconds[stage]);
+			}
+		}//for
+		summary.average /= summary.frames;
+		summary.gpuAverage = (gpuFrames > 0) ? summary.gpuAverage / gpuFrames : 0.0f;
+		for (uint32_t stage = 0; stage < StageCount; stage++)
+		{
+			summary.stageAverage[stage] /= summary.frames;
+		}
+
+		// Nearest rank percentiles, the p-th percentile is the value of rank ceil(frames * p / 100), partial sorts of the scratch copy
+		float* first = scratch.data();
+		float* last = first + summary.frames;
+		float* p50 = first + (summary.frames * 50 + 99) / 100 - 1;
+		std::nth_element(first, p50, last);
+		summary.p50 = *p50;
+		float* p99 = first + (summary.frames * 99 + 99) / 100 - 1;
+		std::nth_element(p50, p99, last);
+		summary.p99 = *p99;
+
+		const float spikeThreshold = summary.p50 * spikeFactor;
+		for (uint32_t age = 0; age < summary.frames; age++)
+		{
+			if (frame(age).cpuMilliseconds > spikeThreshold)
+			{
+				summary.spikes++;
+				summary.lastSpikeAge = std::min(summary.lastSpikeAge, age);
+			}
+		}
+		return summary;
+	}
+
+	const char* FrameStats::stageName(Stage stage)
+	{
+		switch (stage)
+		{
+		case AcquireWait:
+			return "Acquire wait";
+		case Update:
+			return "Update";
+		case Record:
+			return "Record";
+		case Submit:
+			return "Submit";
+		case Present:
+			return "Present";
+		default:
+			return "";
+		}
+	}
+}//vks
@@ -0,0 +1,113 @@
+/*
+* Frame statistics
+*
+* Fixed size ring buffer of per frame CPU and GPU timings with a breakdown into the stages of a frame, cheap enough to record
+* every frame of a long session. Stage times are accumulated in atomics, so frame graph workers can time their submits while
+* the main thread commits the frames. Nothing allocates after construction
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace vks
+{
+	/**
+	* @brief Per frame timings of the last capacity frames, with percentiles and spikes over a window of recent frames
+	* @note Stages may be timed from any thread. endFrame, frame and summarize must be called from the thread running the frame loop
+	*/
+	class FrameStats
+	{
+	public:
+		enum Stage : uint32_t
+		{
+			/** @brief Acquiring the next swap chain image, including waiting for it */
+			AcquireWait,
+			/** @brief CPU side updates: uniforms, simulation, UI */
+			Update,
+			/** @brief Recording command buffers */
+			Record,
+			/** @brief Queue submits */
+			Submit,
+			/** @brief Presenting, including waiting for the queue to finish the frame */
+			Present,
+			StageCount
+		};
+
+		/** @brief Frames kept in the ring */
+		static const uint32_t capacity = 1024;
+
+		struct Frame
+		{
+			float cpuMilliseconds = 0.0f;
+			/** @brief Latest GPU time reported by the example when the frame was committed, 0 if none was reported */
+			float gpuMilliseconds = 0.0f;
+			float stageMilliseconds[StageCount] = {};
+		};
+
+		struct Summary
+		{
+			uint32_t frames = 0;
+			float p50 = 0.0f;
+			float p99 = 0.0f;
+			float max = 0.0f;
+			float average = 0.0f;
+			float gpuAverage = 0.0f;
+			float stageAverage[StageCount] = {};
+			float stageMax[StageCount] = {};
+			/** @brief Frames slower than spikeFactor times the median */
+			uint32_t spikes = 0;
+			/** @brief Age of the latest spike in frames, ~0u if the window has none */
+			uint32_t lastSpikeAge = ~0u;
+		};
+
+		/** @brief Times a stage from construction to destruction */
+		class ScopedStage
+		{
+		public:
+			ScopedStage(FrameStats& stats, Stage stage) : stats(stats), stage(stage), start(std::chrono::high_resolution_clock::now()) {}
+			~ScopedStage()
+			{
+				stats.addStage(stage, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+			}
+		private:
+			FrameStats& stats;
+			Stage stage;
+			std::chrono::high_resolution_clock::time_point start;
+		};
+
+		/** @brief Frames slower than this multiple of the window's median are spikes */
+		float spikeFactor = 2.0f;
+
+		FrameStats();
+
+		/** @brief Add time to a stage of the current frame, may be called from any thread */
+		void addStage(Stage stage, double milliseconds);
+		/** @brief GPU time of the latest frame the example resolved, kept for the following frames until it is set again */
+		void setGpuMilliseconds(double milliseconds);
+		/** @brief Commit the current frame with its CPU time and start the next one */
+		void endFrame(double cpuMilliseconds);
+
+		/** @brief Number of committed frames in the ring */
+		uint32_t size() const;
+		/** @brief Committed frame by age, 0 is the latest. age must be less than size() */
+		const Frame& frame(uint32_t age) const;
+		/** @brief Percentiles, averages and spikes of the latest frameCount frames */
+		Summary summarize(uint32_t frameCount);
+
+		static const char* stageName(Stage stage);
+
+	private:
+		std::array<Frame, capacity> frames;
+		uint64_t frameCount = 0;
+		std::array<std::atomic<uint64_t>, StageCount> stageNanoseconds;
+		std::atomic<uint64_t> gpuNanoseconds;
+		/** @brief Sorting space for the percentiles */
+		std::array<float, capacity> scratch;
+	};
+}//vks
@@ -0,0 +1,274 @@
+/*
+* Geometry pool
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanGeometryPool.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace vks
+{
+	void RangeAllocator::reset(uint32_t capacity)
+	{
+		freeRanges.clear();
+		size = capacity;
+		available = capacity;
+		if (capacity > 0)
+		{
+			freeRanges[0] = capacity;
+		}
+	}
+
+	uint32_t RangeAllocator::allocate(uint32_t count)
+	{
+		if (count == 0)
+		{
+			return 0;
+		}
+		for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+		{
+			if (it->second >= count)
+			{
+				uint32_t offset = it->first;
+				uint32_t remaining = it->second - count;
+				freeRanges.erase(it);
+				if (remaining > 0)
+				{
+					freeRanges[offset + count] = remaining;
+				}
+				available -= count;
+				return offset;
+			}
+		}
+		return invalidOffset;
+	}
+
+	uint32_t RangeAllocator::allocate(uint32_t count, uint32_t alignment)
+	{
+		if ((count == 0) || (alignment <= 1))
+		{
+			return allocate(count);
+		}
+		for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+		{
+			uint64_t rangeStart = it->first;
+			uint64_t rangeEnd = rangeStart + it->second;
+			uint64_t offset = (rangeStart + alignment - 1) & ~static_cast<uint64_t>(alignment - 1);
+			if (offset + count <= rangeEnd)
+			{
+				freeRanges.erase(it);
+				if (offset > rangeStart)
+				{
+					freeRanges[static_cast<uint32_t>(rangeStart)] = static_cast<uint32_t>(offset - rangeStart);
+				}
+				if (offset + count < rangeEnd)
+				{
+					freeRanges[static_cast<uint32_t>(offset + count)] = static_cast<uint32_t>(rangeEnd - offset - count);
+				}
+				available -= count;
+				return static_cast<uint32_t>(offset);
+			}
+		}
+		return invalidOffset;
+	}
+
+	void RangeAllocator::free(uint32_t offset, uint32_t count)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+		available += count;
+		auto next = freeRanges.lower_bound(offset);
+		// Merge with the preceding free range
+		if (next != freeRanges.begin())
+		{
+			auto previous = std::prev(next);
+			if (previous->first + previous->second == offset)
+			{
+				offset = previous->first;
+				count += previous->second;
+				freeRanges.erase(previous);
+			}
+		}
+		// Merge with the following free range
+		if ((next != freeRanges.end()) && (offset + count == next->first))
+		{
+			count += next->second;
+			freeRanges.erase(next);
+		}
+		freeRanges[offset] = count;
+	}
+
+	uint32_t RangeAllocator::largestFree() const
+	{
+		uint32_t largest = 0;
+		for (const auto& range : freeRanges)
+		{
+			largest = std::max(largest, range.second);
+		}
+		return largest;
+	}
+
+	/**
+	* Set up the pool, no memory is allocated until the first allocation
+	*
+	* @param device Device the buffers are created on
+	* @param vertexStride Size of one vertex in bytes
+	* @param blockVertices Vertex capacity of a block
+	* @param blockIndices Index capacity of a block
+	* @param usageFlags Buffer usage added to vertex/index buffer and transfer destination usage
+	*/
+	void GeometryPool::create(vks::VulkanDevice* device, uint32_t vertexStride, uint32_t blockVertices, uint32_t blockIndices, VkBufferUsageFlags usageFlags)
+	{
+		this->device = device;
+		this->vertexStride = vertexStride;
+		this->blockVertices = blockVertices;
+		this->blockIndices = blockIndices;
+		this->usageFlags = usageFlags;
+	}
+
+	void GeometryPool::destroy()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto& block : blocks)
+		{
+			vkDestroyBuffer(device->logicalDevice, block.vertexBuffer, nullptr);
+			vkFreeMemory(device->logicalDevice, block.vertexMemory, nullptr);
+			vkDestroyBuffer(device->logicalDevice, block.indexBuffer, nullptr);
+			vkFreeMemory(device->logicalDevice, block.indexMemory, nullptr);
+		}
+		blocks.clear();
+	}
+
+	void GeometryPool::addBlock(uint32_t vertexCapacity, uint32_t indexCapacity)
+	{
+		Block block;
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | usageFlags,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, static_cast<VkDeviceSize>(vertexCapacity) * vertexStride, &block.vertexBuffer, &block.vertexMemory));
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | usageFlags,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, static_cast<VkDeviceSize>(indexCapacity) * sizeof(uint32_t), &block.indexBuffer, &block.indexMemory));
+		block.vertices.reset(vertexCapacity);
+		block.indices.reset(indexCapacity);
+		blocks.push_back(std::move(block));
+	}
+
+	/**
+	* Reserve a vertex and an index range in the first block that has room for both
+	*
+	* @param vertexCount Number of vertices
+	* @param indexCount Number of 32 bit indices
+	*
+	* @return The ranges and the buffers they live in
+	*/
+	GeometryPool::Allocation GeometryPool::allocate(uint32_t vertexCount, uint32_t indexCount)
+	{
+		assert(device && (vertexCount > 0));
+		std::lock_guard<std::mutex> lock(mutex);
+		Allocation allocation;
+		for (uint32_t attempt = 0; attempt < 2; attempt++)
+		{
+			for (uint32_t i = 0; i < static_cast<uint32_t>(blocks.size()); i++)
+			{
+				Block& block = blocks[i];
+				if ((block.vertices.largestFree() < vertexCount) || ((indexCount > 0) && (block.indices.largestFree() < indexCount)))
+				{
+					continue;
+				}
+				allocation.block = i;
+				allocation.vertexBuffer = block.vertexBuffer;
+				allocation.indexBuffer = block.indexBuffer;
+				allocation.vertexOffset = block.vertices.allocate(vertexCount);
+				allocation.vertexCount = vertexCount;
+				allocation.firstIndex = block.indices.allocate(indexCount);
+				allocation.indexCount = indexCount;
+				block.allocations++;
+				return allocation;
+			}
+			addBlock(std::max(blockVertices, vertexCount), std::max(blockIndices, indexCount));
+		}
+		vks::tools::exitFatal("Could not allocate " + std::to_string(vertexCount) + " vertices from the geometry pool", -1);
+		return allocation;
+	}
+
+	void GeometryPool::free(Allocation& allocation)
+	{
+		if (!allocation.valid())
+		{
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		Block& block = blocks[allocation.block];
+		block.vertices.free(allocation.vertexOffset, allocation.vertexCount);
+		block.indices.free(allocation.firstIndex, allocation.indexCount);
+		block.allocations--;
+		allocation = Allocation();
+	}
+
+	/**
+	* Copy geometry into an allocation
+	*
+	* @param allocation Target ranges
+	* @param vertexData allocation.vertexCount vertices of vertexStride bytes
+	* @param indexData allocation.indexCount indices relative to the first vertex of vertexData
+	* @param queue Queue the copy is submitted to
+	*/
+	void GeometryPool::upload(const Allocation& allocation, const void* vertexData, const uint32_t* indexData, VkQueue queue)
+	{
+		assert(allocation.valid());
+		VkDeviceSize vertexBytes = static_cast<VkDeviceSize>(allocation.vertexCount) * vertexStride;
+		VkDeviceSize indexBytes = static_cast<VkDeviceSize>(allocation.indexCount) * sizeof(uint32_t);
+
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingMemory;
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			vertexBytes + indexBytes, &stagingBuffer, &stagingMemory));
+		void* mapped;
+		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, vertexBytes + indexBytes, 0, &mapped));
+		memcpy(mapped, vertexData, static_cast<size_t>(vertexBytes));
+		uint32_t* indices = reinterpret_cast<uint32_t*>(static_cast<char*>(mapped) + vertexBytes);
+		for (uint32_t i = 0; i < allocation.indexCount; i++)
+		{
+			indices[i] = indexData[i] + allocation.vertexOffset;
+		}
+		vkUnmapMemory(device->logicalDevice, stagingMemory);
+
+		VkCommandBuffer copyCmd = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkBufferCopy copyRegion = {};
+		copyRegion.srcOffset = 0;
+		copyRegion.dstOffset = static_cast<VkDeviceSize>(allocation.vertexOffset) * vertexStride;
+		copyRegion.size = vertexBytes;
+		vkCmdCopyBuffer(copyCmd, stagingBuffer, allocation.vertexBuffer, 1, &copyRegion);
+		if (indexBytes > 0)
+		{
+			copyRegion.srcOffset = vertexBytes;
+			copyRegion.dstOffset = static_cast<VkDeviceSize>(allocation.firstIndex) * sizeof(uint32_t);
+			copyRegion.size = indexBytes;
+			vkCmdCopyBuffer(copyCmd, stagingBuffer, allocation.indexBuffer, 1, &copyRegion);
+		}
+		device->FlushCommandBuffer(copyCmd, queue, true);
+
+		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
+	}
+
+	GeometryPool::Statistics GeometryPool::statistics()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Statistics statistics;
+		statistics.blocks = static_cast<uint32_t>(blocks.size());
+		for (const auto& block : blocks)
+		{
+			statistics.allocations += block.allocations;
+			statistics.vertexCapacity += block.vertices.capacity();
+			statistics.usedVertices += block.vertices.capacity() - block.vertices.freeCount();
+			statistics.indexCapacity += block.indices.capacity();
+			statistics.usedIndices += block.indices.capacity() - block.indices.freeCount();
+			statistics.fragments += block.vertices.fragments() + block.indices.fragments();
+		}
+		return statistics;
+	}
+}//vks
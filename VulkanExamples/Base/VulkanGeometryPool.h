@@ -0,0 +1,125 @@
+/*
+* Geometry pool
+*
+* Scene wide vertex and index buffers that models sub-allocate their ranges from, so draws of different models share
+* one buffer binding and can be batched. Ranges are managed with a first fit free list per buffer
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+
+namespace vks
+{
+	/** @brief First fit allocator of element ranges with coalescing of adjacent free ranges */
+	class RangeAllocator
+	{
+	public:
+		static const uint32_t invalidOffset = ~0u;
+
+		void reset(uint32_t capacity);
+		/** @brief Returns the offset of the range or invalidOffset if no free range is large enough */
+		uint32_t allocate(uint32_t count);
+		/** @brief First fit with the offset rounded up to a power of two alignment, the skipped part stays free */
+		uint32_t allocate(uint32_t count, uint32_t alignment);
+		void free(uint32_t offset, uint32_t count);
+
+		uint32_t capacity() const { return size; }
+		uint32_t freeCount() const { return available; }
+		/** @brief Number of free ranges, 1 for an empty allocator */
+		uint32_t fragments() const { return static_cast<uint32_t>(freeRanges.size()); }
+		uint32_t largestFree() const;
+
+	private:
+		/** @brief Free ranges by offset */
+		std::map<uint32_t, uint32_t> freeRanges;
+		uint32_t size = 0;
+		uint32_t available = 0;
+	};
+
+	/**
+	* @brief Sub-allocates vertex and index ranges from a few large device local buffers
+	* @note A new block (one vertex and one index buffer) is added when no block has room, blocks are never released before destroy
+	*/
+	class GeometryPool
+	{
+	public:
+		struct Allocation
+		{
+			uint32_t block = ~0u;
+			VkBuffer vertexBuffer = VK_NULL_HANDLE;
+			VkBuffer indexBuffer = VK_NULL_HANDLE;
+			/** @brief First vertex of the range, indices are rebased to it when uploaded through the pool */
+			uint32_t vertexOffset = 0;
+			uint32_t vertexCount = 0;
+			uint32_t firstIndex = 0;
+			uint32_t indexCount = 0;
+
+			bool valid() const { return block != ~0u; }
+		};
+
+		struct Statistics
+		{
+			uint32_t blocks = 0;
+			uint32_t allocations = 0;
+			uint64_t vertexCapacity = 0;
+			uint64_t usedVertices = 0;
+			uint64_t indexCapacity = 0;
+			uint64_t usedIndices = 0;
+			/** @brief Free ranges over all vertex and index buffers */
+			uint32_t fragments = 0;
+		};
+
+		vks::VulkanDevice* device = nullptr;
+		/** @brief Size of one vertex in bytes */
+		uint32_t vertexStride = 0;
+
+		/**
+		* @brief Sets up the pool, blocks are created on first use
+		* @param usageFlags Additional buffer usage, e.g. VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT or storage buffer usage
+		*/
+		void create(vks::VulkanDevice* device, uint32_t vertexStride, uint32_t blockVertices = 1 << 20, uint32_t blockIndices = 3 << 20, VkBufferUsageFlags usageFlags = 0);
+		void destroy();
+
+		/** @brief Reserves a vertex and an index range in the same block, a block larger than the default is added for oversized requests */
+		Allocation allocate(uint32_t vertexCount, uint32_t indexCount);
+		void free(Allocation& allocation);
+
+		/**
+		* @brief Copies vertices and indices into the ranges of an allocation through a staging buffer and waits for the copy
+		* @note Indices are relative to the first vertex of the data and are rebased to the allocation's vertex offset, so
+		* draws work with a vertex offset of 0. Uses the device's command pool, so the queue and pool must not be used concurrently
+		*/
+		void upload(const Allocation& allocation, const void* vertexData, const uint32_t* indexData, VkQueue queue);
+
+		Statistics statistics();
+
+	private:
+		struct Block
+		{
+			VkBuffer vertexBuffer = VK_NULL_HANDLE;
+			VkDeviceMemory vertexMemory = VK_NULL_HANDLE;
+			VkBuffer indexBuffer = VK_NULL_HANDLE;
+			VkDeviceMemory indexMemory = VK_NULL_HANDLE;
+			RangeAllocator vertices;
+			RangeAllocator indices;
+			uint32_t allocations = 0;
+		};
+
+		std::vector<Block> blocks;
+		std::mutex mutex;
+		uint32_t blockVertices = 0;
+		uint32_t blockIndices = 0;
+		VkBufferUsageFlags usageFlags = 0;
+
+		void addBlock(uint32_t vertexCapacity, uint32_t indexCapacity);
+	};
+}//vks
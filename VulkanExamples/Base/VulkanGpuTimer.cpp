@@ -0,0 +1,176 @@
+/*
+* GPU timer class
+*
+* Named GPU timestamp scopes backed by a query pool, with one query range per frame in flight
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanGpuTimer.h"
+
+namespace vks
+{
+	/**
+	* Create the timestamp query pool
+	*
+	* @param device Device used to create the query pool
+	* @param maxScopes Maximum number of scopes that can be recorded per frame
+	* @param frameCount Number of frames (or prebuilt command buffers) that each get their own query range
+	*/
+	void GpuTimer::create(vks::VulkanDevice* device, uint32_t maxScopes, uint32_t frameCount)
+	{
+		this->device = device;
+		this->maxScopes = maxScopes;
+		this->frameCount = std::max(frameCount, 1u);
+		currentFrame = 0;
+		frames.assign(this->frameCount, FrameScopes());
+		results.clear();
+
+		timestampPeriod = device->properties.limits.timestampPeriod;
+		supported = device->properties.limits.timestampComputeAndGraphics == VK_TRUE
+			|| device->queueFamilyProperties[device->queueFamilyIndices.graphicIndex].timestampValidBits > 0;
+		if (!supported)
+		{
+			std::cout << "GPU timestamps are not supported on the graphics queue, GPU timings are disabled\n";
+			return;
+		}
+
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = maxScopes * 2 * this->frameCount;
+		VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolInfo, nullptr, &queryPool));
+	}
+
+	void GpuTimer::destroy()
+	{
+		if (queryPool != VK_NULL_HANDLE)
+		{
+			vkDestroyQueryPool(device->logicalDevice, queryPool, nullptr);
+			queryPool = VK_NULL_HANDLE;
+		}
+		frames.clear();
+		results.clear();
+	}
+
+	/**
+	* Reset the query range of the current frame, must be recorded before the first scope of that frame
+	*/
+	void GpuTimer::reset(VkCommandBuffer commandBuffer)
+	{
+		if (!supported)
+		{
+			return;
+		}
+		vkCmdResetQueryPool(commandBuffer, queryPool, currentFrame * maxScopes * 2, maxScopes * 2);
+		frames[currentFrame].names.clear();
+		frames[currentFrame].recorded = true;
+	}
+
+	/**
+	* Write the begin timestamp of a named scope
+	*
+	* @return Scope index to pass to endScope, or UINT32_MAX if the scope could not be recorded
+	*/
+	uint32_t GpuTimer::beginScope(VkCommandBuffer commandBuffer, const std::string& name, VkPipelineStageFlagBits stage)
+	{
+		if (!supported)
+		{
+			return UINT32_MAX;
+		}
+		FrameScopes& frame = frames[currentFrame];
+		if (frame.names.size() >= maxScopes)
+		{
+			return UINT32_MAX;
+		}
+		uint32_t scope = static_cast<uint32_t>(frame.names.size());
+		frame.names.push_back(name);
+		vkCmdWriteTimestamp(commandBuffer, stage, queryPool, (currentFrame * maxScopes + scope) * 2);
+		return scope;
+	}
+
+	void GpuTimer::endScope(VkCommandBuffer commandBuffer, uint32_t scope, VkPipelineStageFlagBits stage)
+	{
+		if (!supported || scope == UINT32_MAX)
+		{
+			return;
+		}
+		vkCmdWriteTimestamp(commandBuffer, stage, queryPool, (currentFrame * maxScopes + scope) * 2 + 1);
+	}
+
+	/**
+	* Resolve the scopes of the current frame into results
+	*
+	* @param wait If true, block until the queries are available, otherwise return false if they are not yet
+	*
+	* @return True if results were updated
+	*/
+	bool GpuTimer::collect(bool wait)
+	{
+		if (!supported)
+		{
+			return false;
+		}
+		const FrameScopes& frame = frames[currentFrame];
+		if (!frame.recorded || frame.names.empty())
+		{
+			return false;
+		}
+
+		const uint32_t queryCount = static_cast<uint32_t>(frame.names.size()) * 2;
+		// Each query returns its value followed by an availability word
+		std::vector<uint64_t> data(queryCount * 2);
+		VkQueryResultFlags flags = VK_QUERY_RESULT_64_BIT | (wait ? VK_QUERY_RESULT_WAIT_BIT : VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+		VkDeviceSize stride = wait ? sizeof(uint64_t) : sizeof(uint64_t) * 2;
+		VkResult result = vkGetQueryPoolResults(device->logicalDevice, queryPool, currentFrame * maxScopes * 2, queryCount,
+			data.size() * sizeof(uint64_t), data.data(), stride, flags);
+		if (result == VK_NOT_READY)
+		{
+			return false;
+		}
+		VK_CHECK_RESULT(result);
+
+		const uint32_t validBits = device->queueFamilyProperties[device->queueFamilyIndices.graphicIndex].timestampValidBits;
+		const uint64_t mask = (validBits >= 64 || validBits == 0) ? ~0ull : ((1ull << validBits) - 1);
+		const uint32_t words = wait ? 1 : 2;
+
+		if (!wait)
+		{
+			for (uint32_t i = 0; i < queryCount; i++)
+			{
+				if (data[i * 2 + 1] == 0)
+				{
+					return false;
+				}
+			}//for
+		}
+
+		results.resize(frame.names.size());
+		for (size_t i = 0; i < frame.names.size(); i++)
+		{
+			const uint64_t* begin = &data[(i * 2) * words];
+			const uint64_t* end = &data[(i * 2 + 1) * words];
+			results[i].name = frame.names[i];
+			results[i].milliseconds = static_cast<double>((end[0] - begin[0]) & mask) * timestampPeriod / 1000000.0;
+		}//for
+		return true;
+	}
+
+	void GpuTimer::nextFrame()
+	{
+		currentFrame = (currentFrame + 1) % frameCount;
+	}
+
+	/** @brief Returns the last resolved time of the named scope, or 0 if it has not been resolved */
+	double GpuTimer::getMilliseconds(const std::string& name) const
+	{
+		for (const Result& result : results)
+		{
+			if (result.name == name)
+			{
+				return result.milliseconds;
+			}
+		}
+		return 0.0;
+	}
+}//vks
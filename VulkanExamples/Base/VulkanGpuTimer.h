@@ -0,0 +1,67 @@
+/*
+* GPU timer class
+*
+* Named GPU timestamp scopes backed by a query pool, with one query range per frame in flight
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+
+namespace vks
+{
+	/**
+	* @brief Records named begin/end timestamp pairs into a command buffer and resolves them to milliseconds
+	* @note Results are read back without waiting, so they lag the recorded frame by up to frameCount frames
+	*/
+	class GpuTimer
+	{
+	public:
+		struct Result
+		{
+			std::string name;
+			double milliseconds = 0.0;
+		};
+
+		vks::VulkanDevice* device = nullptr;
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		/** @brief Maximum number of scopes per frame (each scope uses two queries) */
+		uint32_t maxScopes = 0;
+		/** @brief Number of frames in flight that get their own query range */
+		uint32_t frameCount = 1;
+		uint32_t currentFrame = 0;
+		/** @brief Nanoseconds per timestamp tick, taken from the device limits */
+		float timestampPeriod = 1.0f;
+		/** @brief False if the graphics/compute queues do not support timestamps, all calls are no-ops then */
+		bool supported = false;
+
+		/** @brief Latest resolved results, in the order the scopes were begun */
+		std::vector<Result> results;
+
+		void create(vks::VulkanDevice* device, uint32_t maxScopes, uint32_t frameCount = 1);
+		void destroy();
+
+		void reset(VkCommandBuffer commandBuffer);
+		uint32_t beginScope(VkCommandBuffer commandBuffer, const std::string& name, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+		void endScope(VkCommandBuffer commandBuffer, uint32_t scope, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+		bool collect(bool wait = false);
+		void nextFrame();
+
+		double getMilliseconds(const std::string& name) const;
+
+	private:
+		struct FrameScopes
+		{
+			std::vector<std::string> names;
+			bool recorded = false;
+		};
+		std::vector<FrameScopes> frames;
+	};
+}//vks
@@ -0,0 +1,680 @@
+/*
+* Fiber job system
+*
+* Fibers use the Win32 fiber API on Windows and ucontext on Linux. Other platforms (Android, Apple) run the jobs
+* directly on the workers, so a waiting job blocks its worker there
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanJobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <string>
+
+#include "ThreadPool.hpp"
+#include "VulkanInitializers.hpp"
+#include "VulkanTools.h"
+
+#if defined(_WIN32)
+#define VKS_JOB_FIBERS 1
+#elif defined(__linux__) && !defined(__ANDROID__)
+#define VKS_JOB_FIBERS 1
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+#else
+#define VKS_JOB_FIBERS 0
+#endif
+
+// Thread locals are read through functions that are never inlined, so a fiber that resumed on another worker
+// does not use a thread local address cached from the worker it was suspended on
+#if defined(_MSC_VER)
+#define VKS_NOINLINE __declspec(noinline)
+#else
+#define VKS_NOINLINE __attribute__((noinline))
+#endif
+
+namespace vks
+{
+	namespace
+	{
+		// Pause of the completion thread between polls while fences are outstanding
+		const std::chrono::microseconds fencePollInterval(200);
+		// Asset loading benchmark
+		const uint32_t benchmarkWorkers = 4;
+		const uint32_t benchmarkTextureSize = 256;
+
+		VKS_NOINLINE JobFiber*& currentFiber()
+		{
+			static thread_local JobFiber* fiber = nullptr;
+			return fiber;
+		}
+
+		VKS_NOINLINE void*& currentWorker()
+		{
+			static thread_local void* worker = nullptr;
+			return worker;
+		}
+	}
+
+	struct JobSystem::Worker
+	{
+		std::thread thread;
+		uint32_t index = 0;
+		threading::ThreadPlacement placement;
+#if defined(_WIN32)
+		LPVOID schedulerFiber = nullptr;
+#elif VKS_JOB_FIBERS
+		ucontext_t schedulerContext;
+#endif
+	};
+
+	/** @brief Execution context of one job, reused for the next job once the job finished */
+	struct JobFiber
+	{
+		enum class State
+		{
+			Idle,
+			Running,
+			Finished,
+			WaitCounter,
+			WaitFence
+		};
+
+		JobSystem* system = nullptr;
+		std::function<void()> function;
+		JobCounter* counter = nullptr;
+		State state = State::Idle;
+		JobCounter* waitCounter = nullptr;
+		VkDevice waitDevice = VK_NULL_HANDLE;
+		VkFence waitFence = VK_NULL_HANDLE;
+#if defined(_WIN32)
+		LPVOID handle = nullptr;
+
+		static VOID CALLBACK start(LPVOID parameter)
+		{
+			JobSystem::fiberMain(static_cast<JobFiber*>(parameter));
+		}
+#elif VKS_JOB_FIBERS
+		ucontext_t context;
+		void* stack = nullptr;
+		size_t stackSize = 0;
+
+		// makecontext only passes int arguments, so the fiber pointer is split into two halves
+		static void start(unsigned int high, unsigned int low)
+		{
+			uint64_t address = (static_cast<uint64_t>(high) << 32) | static_cast<uint64_t>(low);
+			JobSystem::fiberMain(reinterpret_cast<JobFiber*>(static_cast<uintptr_t>(address)));
+		}
+#endif
+	};
+
+	JobSystem::JobSystem() = default;
+
+	JobSystem::~JobSystem()
+	{
+		destroy();
+	}
+
+	/**
+	* Allocate the fibers and start the worker threads and the fence completion thread
+	*
+	* @param workerCount Number of worker threads
+	* @param fiberCount Number of fibers, i.e. the number of jobs that can be running or suspended at the same time
+	* @param fiberStackSize Stack size of every fiber in bytes
+	* @param placement Pinning, priority and name of the workers, the worker index is appended to the name
+	*/
+	void JobSystem::initialize(uint32_t workerCount, uint32_t fiberCount, size_t fiberStackSize, const threading::ThreadPlacement& placement)
+	{
+		destroy();
+
+#if VKS_JOB_FIBERS && !defined(_WIN32)
+		const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		fiberStackSize = (fiberStackSize + pageSize - 1) / pageSize * pageSize;
+#endif
+		for (uint32_t i = 0; i < std::max(fiberCount, 1u); i++)
+		{
+			std::unique_ptr<JobFiber> fiber(new JobFiber());
+			fiber->system = this;
+#if defined(_WIN32)
+			fiber->handle = CreateFiber(fiberStackSize, &JobFiber::start, fiber.get());
+			if (!fiber->handle)
+			{
+				vks::tools::exitFatal("Could not create job fiber", -1);
+			}
+#elif VKS_JOB_FIBERS
+			// The lowest page stays inaccessible, so a stack overflow faults instead of corrupting the neighbouring stack
+			fiber->stackSize = fiberStackSize + pageSize;
+			fiber->stack = mmap(nullptr, fiber->stackSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (fiber->stack == MAP_FAILED)
+			{
+				vks::tools::exitFatal("Could not allocate job fiber stack", -1);
+			}
+			mprotect(fiber->stack, pageSize, PROT_NONE);
+			getcontext(&fiber->context);
+			fiber->context.uc_stack.ss_sp = static_cast<uint8_t*>(fiber->stack) + pageSize;
+			fiber->context.uc_stack.ss_size = fiberStackSize;
+			fiber->context.uc_link = nullptr;
+			uint64_t address = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(fiber.get()));
+			makecontext(&fiber->context, reinterpret_cast<void(*)()>(&JobFiber::start), 2, static_cast<unsigned int>(address >> 32), static_cast<unsigned int>(address & 0xffffffffu));
+#else
+			(void)fiberStackSize;
+#endif
+			freeFibers.push_back(fiber.get());
+			fibers.push_back(std::move(fiber));
+		}
+
+		for (uint32_t i = 0; i < std::max(workerCount, 1u); i++)
+		{
+			std::unique_ptr<Worker> worker(new Worker());
+			worker->index = i;
+			worker->placement = placement;
+			if (!worker->placement.name.empty())
+			{
+				worker->placement.name += " " + std::to_string(i);
+			}
+			worker->thread = std::thread(&JobSystem::workerLoop, this, worker.get());
+			workers.push_back(std::move(worker));
+		}
+		completionThread = std::thread(&JobSystem::completionLoop, this);
+	}
+
+	void JobSystem::destroy()
+	{
+		if (workers.empty())
+		{
+			return;
+		}
+		waitIdle();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		condition.notify_all();
+		for (auto& worker : workers)
+		{
+			worker->thread.join();
+		}
+		workers.clear();
+
+		{
+			std::lock_guard<std::mutex> lock(fenceMutex);
+			stoppingCompletion = true;
+		}
+		fenceCondition.notify_all();
+		completionThread.join();
+
+		// Idle fibers are parked inside fiberMain and are never resumed again
+		for (auto& fiber : fibers)
+		{
+#if defined(_WIN32)
+			DeleteFiber(fiber->handle);
+#elif VKS_JOB_FIBERS
+			munmap(fiber->stack, fiber->stackSize);
+#endif
+		}
+		fibers.clear();
+		freeFibers.clear();
+		stopping = false;
+		stoppingCompletion = false;
+	}
+
+	void JobSystem::run(std::function<void()> function, JobCounter* counter)
+	{
+		if (counter)
+		{
+			counter->count++;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.emplace_back(std::move(function), counter);
+			outstanding++;
+		}
+		jobCount++;
+		condition.notify_one();
+	}
+
+	void JobSystem::waitForCounter(JobCounter& counter)
+	{
+		// The count is only inspected under the counter's lock, the job that decrements it to zero still holds
+		// the lock while it wakes the waiters, so a waiter may destroy the counter as soon as it returns
+		std::unique_lock<std::mutex> lock(counter.mutex);
+		if (counter.count == 0)
+		{
+			return;
+		}
+#if VKS_JOB_FIBERS
+		JobFiber* fiber = currentFiber();
+		if (fiber)
+		{
+			lock.unlock();
+			fiber->state = JobFiber::State::WaitCounter;
+			fiber->waitCounter = &counter;
+			suspensionCount++;
+			switchToScheduler(fiber);
+			return;
+		}
+#endif
+		counter.condition.wait(lock, [&counter] { return counter.count == 0; });
+	}
+
+	void JobSystem::waitForFence(VkDevice device, VkFence fence)
+	{
+#if VKS_JOB_FIBERS
+		JobFiber* fiber = currentFiber();
+		if (fiber)
+		{
+			VkResult result = vkGetFenceStatus(device, fence);
+			if (result == VK_SUCCESS)
+			{
+				return;
+			}
+			if (result != VK_NOT_READY)
+			{
+				VK_CHECK_RESULT(result);
+			}
+			fiber->state = JobFiber::State::WaitFence;
+			fiber->waitDevice = device;
+			fiber->waitFence = fence;
+			suspensionCount++;
+			switchToScheduler(fiber);
+			return;
+		}
+#endif
+		VK_CHECK_RESULT(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX));
+	}
+
+	void JobSystem::waitIdle()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		idleCondition.wait(lock, [this] { return outstanding == 0; });
+	}
+
+	JobSystem::Statistics JobSystem::statistics() const
+	{
+		Statistics result;
+		result.jobs = jobCount.load();
+		result.suspensions = suspensionCount.load();
+		result.fencePolls = fencePollCount.load();
+		return result;
+	}
+
+	bool JobSystem::fibersSupported()
+	{
+		return VKS_JOB_FIBERS != 0;
+	}
+
+	bool JobSystem::insideJob()
+	{
+		return currentFiber() != nullptr;
+	}
+
+	/**
+	* Take suspended jobs that can continue before new jobs, so started work completes first
+	*/
+	void JobSystem::workerLoop(Worker* worker)
+	{
+		threading::applyPlacement(worker->placement, worker->index);
+#if defined(_WIN32)
+		worker->schedulerFiber = ConvertThreadToFiber(nullptr);
+		if (!worker->schedulerFiber)
+		{
+			vks::tools::exitFatal("Could not convert job worker thread to a fiber", -1);
+		}
+#endif
+		currentWorker() = worker;
+
+		while (true)
+		{
+			JobFiber* fiber = nullptr;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this] { return stopping || !resumable.empty() || (!jobs.empty() && !freeFibers.empty()); });
+				if (stopping)
+				{
+					break;
+				}
+				if (!resumable.empty())
+				{
+					fiber = resumable.front();
+					resumable.pop_front();
+				}
+				else
+				{
+					fiber = freeFibers.back();
+					freeFibers.pop_back();
+					fiber->function = std::move(jobs.front().first);
+					fiber->counter = jobs.front().second;
+					fiber->state = JobFiber::State::Running;
+					jobs.pop_front();
+				}
+			}
+			execute(worker, fiber);
+		}//while
+
+		currentWorker() = nullptr;
+#if defined(_WIN32)
+		ConvertFiberToThread();
+#endif
+	}
+
+	void JobSystem::execute(Worker* worker, JobFiber* fiber)
+	{
+		currentFiber() = fiber;
+#if defined(_WIN32)
+		(void)worker;
+		SwitchToFiber(fiber->handle);
+#elif VKS_JOB_FIBERS
+		swapcontext(&worker->schedulerContext, &fiber->context);
+#else
+		(void)worker;
+		fiber->function();
+		fiber->function = nullptr;
+		fiber->state = JobFiber::State::Finished;
+#endif
+		currentFiber() = nullptr;
+
+		// The fiber's context is saved at this point, so a wait is only published now and the fiber
+		// cannot be resumed on another worker before it has been switched out here
+		if (fiber->state == JobFiber::State::Finished)
+		{
+			finish(fiber);
+		}
+		else
+		{
+			suspend(fiber);
+		}
+	}
+
+	void JobSystem::finish(JobFiber* fiber)
+	{
+		std::vector<JobFiber*> resumed;
+		if (fiber->counter)
+		{
+			decrement(fiber->counter, resumed);
+			fiber->counter = nullptr;
+		}
+		for (JobFiber* waiter : resumed)
+		{
+			waiter->system->resume(waiter);
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			fiber->state = JobFiber::State::Idle;
+			freeFibers.push_back(fiber);
+			outstanding--;
+			if (outstanding == 0)
+			{
+				idleCondition.notify_all();
+			}
+		}
+		condition.notify_one();
+	}
+
+	void JobSystem::suspend(JobFiber* fiber)
+	{
+		if (fiber->state == JobFiber::State::WaitCounter)
+		{
+			JobCounter* counter = fiber->waitCounter;
+			bool ready;
+			{
+				std::lock_guard<std::mutex> lock(counter->mutex);
+				ready = (counter->count == 0);
+				if (!ready)
+				{
+					counter->waiters.push_back(fiber);
+				}
+			}
+			if (ready)
+			{
+				resume(fiber);
+			}
+		}
+		else if (fiber->state == JobFiber::State::WaitFence)
+		{
+			{
+				std::lock_guard<std::mutex> lock(fenceMutex);
+				pendingFences.push_back({ fiber->waitDevice, fiber->waitFence, fiber });
+			}
+			fenceCondition.notify_one();
+		}
+	}
+
+	void JobSystem::resume(JobFiber* fiber)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			fiber->state = JobFiber::State::Running;
+			resumable.push_back(fiber);
+		}
+		condition.notify_one();
+	}
+
+	void JobSystem::decrement(JobCounter* counter, std::vector<JobFiber*>& resumed)
+	{
+		std::lock_guard<std::mutex> lock(counter->mutex);
+		if (--counter->count == 0)
+		{
+			resumed.insert(resumed.end(), counter->waiters.begin(), counter->waiters.end());
+			counter->waiters.clear();
+			counter->condition.notify_all();
+		}
+	}
+
+	/**
+	* Poll the fences of suspended jobs and resume the jobs whose fence is signaled
+	*
+	* Waits without polling while no fence is outstanding, new fences wake the thread up
+	*/
+	void JobSystem::completionLoop()
+	{
+		threading::setCurrentThreadName("vks fences");
+
+		std::vector<FenceWait> polling;
+		std::vector<JobFiber*> signaled;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(fenceMutex);
+				auto wake = [this] { return stoppingCompletion || !pendingFences.empty(); };
+				if (polling.empty())
+				{
+					fenceCondition.wait(lock, wake);
+				}
+				else
+				{
+					fenceCondition.wait_for(lock, fencePollInterval, wake);
+				}
+				if (stoppingCompletion && polling.empty() && pendingFences.empty())
+				{
+					break;
+				}
+				polling.insert(polling.end(), pendingFences.begin(), pendingFences.end());
+				pendingFences.clear();
+			}
+
+			for (size_t i = 0; i < polling.size();)
+			{
+				VkResult result = vkGetFenceStatus(polling[i].device, polling[i].fence);
+				fencePollCount++;
+				if (result == VK_NOT_READY)
+				{
+					i++;
+					continue;
+				}
+				VK_CHECK_RESULT(result);
+				signaled.push_back(polling[i].fiber);
+				polling[i] = polling.back();
+				polling.pop_back();
+			}
+			for (JobFiber* fiber : signaled)
+			{
+				resume(fiber);
+			}
+			signaled.clear();
+		}//while
+	}
+
+	void JobSystem::fiberMain(JobFiber* fiber)
+	{
+		// Every job returns here and the fiber is parked in switchToScheduler until it gets the next job
+		while (true)
+		{
+			fiber->function();
+			fiber->function = nullptr;
+			fiber->state = JobFiber::State::Finished;
+			switchToScheduler(fiber);
+		}
+	}
+
+	void JobSystem::switchToScheduler(JobFiber* fiber)
+	{
+		// The worker is looked up on every switch, the fiber may have been resumed on a different worker
+		Worker* worker = static_cast<Worker*>(currentWorker());
+#if defined(_WIN32)
+		(void)fiber;
+		SwitchToFiber(worker->schedulerFiber);
+#elif VKS_JOB_FIBERS
+		swapcontext(&fiber->context, &worker->schedulerContext);
+#else
+		(void)fiber;
+		(void)worker;
+#endif
+	}
+
+	namespace
+	{
+		struct TextureLoad
+		{
+			VkCommandPool commandPool = VK_NULL_HANDLE;
+			VkBuffer staging = VK_NULL_HANDLE;
+			VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+			VkBuffer target = VK_NULL_HANDLE;
+			VkDeviceMemory targetMemory = VK_NULL_HANDLE;
+			VkFence fence = VK_NULL_HANDLE;
+		};
+
+		/** Stand-in for decoding a texture file, some arithmetic per texel */
+		void decodeTexture(uint32_t seed, std::vector<uint32_t>& texels)
+		{
+			texels.resize(benchmarkTextureSize * benchmarkTextureSize);
+			uint32_t state = seed * 747796405u + 2891336453u;
+			for (uint32_t& texel : texels)
+			{
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				texel = state | 0xff000000u;
+			}
+		}
+
+		/** Stages a decoded texture and submits its copy into a device local buffer, signaling the load's fence */
+		void submitUpload(vks::VulkanDevice* device, VkQueue queue, std::mutex& queueMutex, std::vector<uint32_t>& texels, TextureLoad& load)
+		{
+			const VkDeviceSize size = texels.size() * sizeof(uint32_t);
+			VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				size, &load.staging, &load.stagingMemory, texels.data()));
+			VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				size, &load.target, &load.targetMemory));
+
+			// Every load records into its own pool, pools must not be used from two threads at the same time
+			load.commandPool = device->CreateCommandPool(device->queueFamilyIndices.graphicIndex, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+			VkCommandBuffer commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, load.commandPool, true);
+			VkBufferCopy region = { 0, 0, size };
+			vkCmdCopyBuffer(commandBuffer, load.staging, load.target, 1, &region);
+			VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+
+			VkFenceCreateInfo fenceInfo = vks::initializers::GenFenceCreateInfo(0);
+			VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceInfo, nullptr, &load.fence));
+			VkSubmitInfo submitInfo = vks::initializers::GenSubmitInfo();
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &commandBuffer;
+			std::lock_guard<std::mutex> lock(queueMutex);
+			VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, load.fence));
+		}
+
+		void releaseLoad(vks::VulkanDevice* device, TextureLoad& load)
+		{
+			VkDevice logicalDevice = device->logicalDevice;
+			vkDestroyFence(logicalDevice, load.fence, nullptr);
+			vkDestroyCommandPool(logicalDevice, load.commandPool, nullptr);
+			vkDestroyBuffer(logicalDevice, load.staging, nullptr);
+			vkFreeMemory(logicalDevice, load.stagingMemory, nullptr);
+			vkDestroyBuffer(logicalDevice, load.target, nullptr);
+			vkFreeMemory(logicalDevice, load.targetMemory, nullptr);
+		}
+	}
+
+	/**
+	* Compare blocking and suspending waits for texture uploads
+	*
+	* Both variants use the same number of workers. A blocking load occupies its worker until the GPU copy finished,
+	* a fiber load gives its worker to the next load while the copy is in flight
+	*
+	* @param device Device the uploads are created on
+	* @param queue Queue the copies are submitted to, it must not be used by other threads during the benchmark
+	* @param out Stream the results are written to
+	* @param loadCount Number of concurrent loads
+	*/
+	void benchmarkAssetLoading(vks::VulkanDevice* device, VkQueue queue, std::ostream& out, uint32_t loadCount)
+	{
+		std::mutex queueMutex;
+		auto load = [&](uint32_t index, const std::function<void(VkFence)>& wait)
+		{
+			std::vector<uint32_t> texels;
+			decodeTexture(index, texels);
+			TextureLoad textureLoad;
+			submitUpload(device, queue, queueMutex, texels, textureLoad);
+			wait(textureLoad.fence);
+			releaseLoad(device, textureLoad);
+		};
+
+		auto start = std::chrono::high_resolution_clock::now();
+		{
+			vks::ThreadPool pool;
+			pool.setThreadCount(benchmarkWorkers);
+			for (uint32_t i = 0; i < loadCount; i++)
+			{
+				pool.threads[i % benchmarkWorkers]->addJob([&, i]
+				{
+					load(i, [&](VkFence fence) { VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &fence, VK_TRUE, UINT64_MAX)); });
+				});
+			}
+			pool.wait();
+		}
+		double blockingMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		JobSystem jobSystem;
+		// One fiber per load, so every load can be in flight at the same time
+		jobSystem.initialize(benchmarkWorkers, loadCount);
+		JobCounter counter;
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < loadCount; i++)
+		{
+			jobSystem.run([&, i]
+			{
+				load(i, [&](VkFence fence) { jobSystem.waitForFence(device->logicalDevice, fence); });
+			}, &counter);
+		}
+		jobSystem.waitForCounter(counter);
+		double fiberMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		JobSystem::Statistics statistics = jobSystem.statistics();
+		jobSystem.destroy();
+
+		std::ios_base::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+		out << std::fixed << std::setprecision(2);
+		out << "Asset loading benchmark, " << loadCount << " loads of " << benchmarkTextureSize << "x" << benchmarkTextureSize << " texels, "
+			<< benchmarkWorkers << " workers" << (JobSystem::fibersSupported() ? "" : " (no fiber support, fiber jobs block their worker)") << "\n";
+		out << "  blocking thread pool: " << std::setw(9) << blockingMs << " ms " << std::setw(9) << (loadCount * 1000.0 / blockingMs) << " loads/s\n";
+		out << "  fiber jobs:           " << std::setw(9) << fiberMs << " ms " << std::setw(9) << (loadCount * 1000.0 / fiberMs) << " loads/s ("
+			<< statistics.suspensions << " suspensions, " << statistics.fencePolls << " fence polls)\n";
+		out.flags(flags);
+		out.precision(precision);
+	}
+}//vks
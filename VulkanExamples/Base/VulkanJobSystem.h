@@ -0,0 +1,147 @@
+/*
+* Fiber job system
+*
+* Jobs run on fibers (user mode execution contexts) on a fixed set of worker threads. A job that waits for a counter
+* or for a fence is suspended and the worker continues with other jobs, the suspended job resumes on whichever worker
+* picks it up once its wait is satisfied. Fences are polled by a dedicated completion thread
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "ThreadAffinity.h"
+#include "VulkanDevice.h"
+
+namespace vks
+{
+	struct JobFiber;
+	class JobSystem;
+
+	/**
+	* @brief Number of outstanding jobs, waiting on a counter suspends until it drops to zero
+	* @note The counter must outlive all jobs it was passed to and all waits on it
+	*/
+	class JobCounter
+	{
+	public:
+		JobCounter() = default;
+		JobCounter(const JobCounter&) = delete;
+		JobCounter& operator=(const JobCounter&) = delete;
+
+		uint32_t value() const { return count.load(); }
+
+	private:
+		friend class JobSystem;
+
+		std::atomic<uint32_t> count{ 0 };
+		std::mutex mutex;
+		/** @brief Wakes threads that wait outside of a job */
+		std::condition_variable condition;
+		/** @brief Suspended fibers, resumed when the count drops to zero */
+		std::vector<JobFiber*> waiters;
+	};
+
+	class JobSystem
+	{
+	public:
+		struct Statistics
+		{
+			uint64_t jobs = 0;
+			/** @brief Number of times a job was suspended on a counter or fence */
+			uint64_t suspensions = 0;
+			/** @brief Number of vkGetFenceStatus calls of the completion thread */
+			uint64_t fencePolls = 0;
+		};
+
+		JobSystem();
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+		~JobSystem();
+
+		/**
+		* @brief Starts the workers and the fence completion thread and allocates the fibers
+		* @note fiberCount limits the number of jobs that can be started or suspended at the same time, further jobs stay queued
+		*/
+		void initialize(uint32_t workerCount, uint32_t fiberCount = 128, size_t fiberStackSize = 256 * 1024, const threading::ThreadPlacement& placement = threading::ThreadPlacement());
+		/** @brief Waits for all jobs and stops all threads */
+		void destroy();
+
+		/** @brief Queues a job, the optional counter is incremented now and decremented once the job has finished */
+		void run(std::function<void()> function, JobCounter* counter = nullptr);
+		/** @brief Suspends the calling job until the counter is zero, blocks the calling thread when called outside of a job */
+		void waitForCounter(JobCounter& counter);
+		/** @brief Suspends the calling job until the fence is signaled, blocks the calling thread when called outside of a job */
+		void waitForFence(VkDevice device, VkFence fence);
+		/** @brief Blocks the calling thread until all queued and suspended jobs have finished, must not be called from a job */
+		void waitIdle();
+
+		Statistics statistics() const;
+		/** @brief True on platforms with fibers, elsewhere a waiting job blocks its worker */
+		static bool fibersSupported();
+		/** @brief True when called from a job of any job system */
+		static bool insideJob();
+
+	private:
+		friend struct JobFiber;
+		struct Worker;
+		struct FenceWait
+		{
+			VkDevice device;
+			VkFence fence;
+			JobFiber* fiber;
+		};
+
+		std::vector<std::unique_ptr<Worker>> workers;
+		std::vector<std::unique_ptr<JobFiber>> fibers;
+		std::thread completionThread;
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::deque<std::pair<std::function<void()>, JobCounter*>> jobs;
+		/** @brief Suspended fibers whose wait has been satisfied */
+		std::deque<JobFiber*> resumable;
+		std::vector<JobFiber*> freeFibers;
+		/** @brief Jobs queued, running or suspended */
+		uint32_t outstanding = 0;
+		std::condition_variable idleCondition;
+		bool stopping = false;
+
+		std::mutex fenceMutex;
+		std::condition_variable fenceCondition;
+		std::vector<FenceWait> pendingFences;
+		bool stoppingCompletion = false;
+
+		std::atomic<uint64_t> jobCount{ 0 };
+		std::atomic<uint64_t> suspensionCount{ 0 };
+		std::atomic<uint64_t> fencePollCount{ 0 };
+
+		void workerLoop(Worker* worker);
+		void completionLoop();
+		void execute(Worker* worker, JobFiber* fiber);
+		void finish(JobFiber* fiber);
+		void resume(JobFiber* fiber);
+		void suspend(JobFiber* fiber);
+		static void decrement(JobCounter* counter, std::vector<JobFiber*>& resumed);
+		static void fiberMain(JobFiber* fiber);
+		static void switchToScheduler(JobFiber* fiber);
+	};
+
+	/**
+	* @brief Uploads loadCount generated textures with a per load staging buffer, command pool and fence, once from
+	* jobs on a vks::ThreadPool that block on the fence and once from fiber jobs that suspend on it, and prints the throughput
+	*/
+	void benchmarkAssetLoading(vks::VulkanDevice* device, VkQueue queue, std::ostream& out, uint32_t loadCount = 256);
+}//vks
@@ -0,0 +1,298 @@
+/*
+* KTX2 container support
+*
+* Layout as defined by the KTX 2.0 specification (https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html)
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanKtx2.h"
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+#include "ParallelAlgorithms.hpp"
+
+namespace vks
+{
+	namespace ktx2
+	{
+		namespace
+		{
+			const uint8_t identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+			// Identifier, nine 32 bit header fields, four 32 bit and two 64 bit index fields
+			const size_t headerSize = 80;
+			const size_t levelIndexEntrySize = 24;
+			// Data format descriptor color models and transfer function
+			const uint8_t colorModelETC1S = 163;
+			const uint8_t colorModelUASTC = 166;
+			const uint8_t transferSRGB = 2;
+			// Sample channel ids that carry alpha
+			const uint8_t channelETC1SAlpha = 15;
+			const uint8_t channelUASTCRGBA = 3;
+			const uint8_t channelUASTCRRRG = 5;
+
+			std::mutex transcoderMutex;
+			Transcoder registeredTranscoder;
+
+			uint32_t read32(const uint8_t* data)
+			{
+				uint32_t value;
+				memcpy(&value, data, sizeof(value));
+				return value;
+			}
+
+			uint64_t read64(const uint8_t* data)
+			{
+				uint64_t value;
+				memcpy(&value, data, sizeof(value));
+				return value;
+			}
+
+			bool supportsSampling(VkPhysicalDevice physicalDevice, VkFormat format)
+			{
+				VkFormatProperties properties;
+				vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+				return (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+			}
+		}
+
+		bool isKtx2(const uint8_t* data, size_t size)
+		{
+			return (size >= sizeof(identifier)) && (memcmp(data, identifier, sizeof(identifier)) == 0);
+		}
+
+		/**
+		* Parse the header, the level index and the basic data format descriptor block, level data is not touched
+		*
+		* @param data File contents
+		* @param size Size of the file in bytes
+		* @param error Receives the reason if the file is not a valid 2D KTX2 file
+		*
+		* @return True if the file was parsed
+		*/
+		bool File::parse(const uint8_t* data, size_t size, std::string& error)
+		{
+			if (!isKtx2(data, size) || (size < headerSize))
+			{
+				error = "Not a KTX2 file";
+				return false;
+			}
+			this->data = data;
+			this->size = size;
+			const uint8_t* header = data + sizeof(identifier);
+			vkFormat = static_cast<VkFormat>(read32(header + 0));
+			width = read32(header + 8);
+			height = read32(header + 12);
+			depth = read32(header + 16);
+			layerCount = read32(header + 20);
+			faceCount = read32(header + 24);
+			uint32_t levelCount = std::max(1u, read32(header + 28));
+			supercompression = read32(header + 32);
+			uint32_t dfdOffset = read32(header + 36);
+			uint32_t dfdLength = read32(header + 40);
+			uint64_t sgdOffset = read64(header + 52);
+			uint64_t sgdLength = read64(header + 60);
+
+			if ((width == 0) || (depth > 1) || (layerCount > 1) || (faceCount != 1))
+			{
+				error = "Only 2D KTX2 textures without layers or faces are supported";
+				return false;
+			}
+			if (height == 0)
+			{
+				height = 1;
+			}
+			if (headerSize + levelCount * levelIndexEntrySize > size)
+			{
+				error = "KTX2 level index is truncated";
+				return false;
+			}
+			levels.resize(levelCount);
+			for (uint32_t i = 0; i < levelCount; i++)
+			{
+				const uint8_t* entry = data + headerSize + i * levelIndexEntrySize;
+				levels[i].offset = read64(entry);
+				levels[i].length = read64(entry + 8);
+				levels[i].uncompressedLength = read64(entry + 16);
+				if (levels[i].offset + levels[i].length > size)
+				{
+					error = "KTX2 level " + std::to_string(i) + " is truncated";
+					return false;
+				}
+			}
+			if (sgdLength > 0)
+			{
+				if (sgdOffset + sgdLength > size)
+				{
+					error = "KTX2 supercompression global data is truncated";
+					return false;
+				}
+				globalData = data + sgdOffset;
+				globalDataSize = static_cast<size_t>(sgdLength);
+			}
+
+			// Basic descriptor block: total size, two words of vendor/type/version, then model, primaries, transfer and flags
+			payload = Payload::Native;
+			if ((dfdLength >= 28) && (dfdOffset + dfdLength <= size))
+			{
+				const uint8_t* block = data + dfdOffset + 4;
+				uint8_t colorModel = block[8];
+				srgb = (block[10] == transferSRGB);
+				uint32_t blockSize = read32(block + 4) >> 16;
+				uint32_t sampleCount = (blockSize > 24) ? (blockSize - 24) / 16 : 0;
+				for (uint32_t i = 0; (i < sampleCount) && (28 + (i + 1) * 16 <= dfdLength); i++)
+				{
+					uint8_t channel = block[24 + i * 16 + 3] & 0x0f;
+					if (colorModel == colorModelETC1S)
+					{
+						hasAlpha |= (channel == channelETC1SAlpha);
+					}
+					else if (colorModel == colorModelUASTC)
+					{
+						hasAlpha |= (channel == channelUASTCRGBA) || (channel == channelUASTCRRRG);
+					}
+				}
+				if (colorModel == colorModelETC1S)
+				{
+					payload = Payload::ETC1S;
+				}
+				else if (colorModel == colorModelUASTC)
+				{
+					payload = Payload::UASTC;
+				}
+			}
+			if ((payload == Payload::Native) && (vkFormat == VK_FORMAT_UNDEFINED))
+			{
+				error = "KTX2 file has neither a Vulkan format nor a Basis Universal payload";
+				return false;
+			}
+			return true;
+		}
+
+		void setTranscoder(Transcoder transcoder)
+		{
+			std::lock_guard<std::mutex> lock(transcoderMutex);
+			registeredTranscoder = transcoder;
+		}
+
+		bool hasTranscoder()
+		{
+			std::lock_guard<std::mutex> lock(transcoderMutex);
+			return static_cast<bool>(registeredTranscoder);
+		}
+
+		VkFormat targetFormat(Target target, bool hasAlpha)
+		{
+			switch (target)
+			{
+			case Target::BC7:
+				return VK_FORMAT_BC7_UNORM_BLOCK;
+			case Target::ASTC4x4:
+				return VK_FORMAT_ASTC_4x4_UNORM_BLOCK;
+			case Target::ETC2:
+				return hasAlpha ? VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK : VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK;
+			case Target::BC1:
+				return hasAlpha ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+			default:
+				return VK_FORMAT_R8G8B8A8_UNORM;
+			}//switch
+		}
+
+		const char* toString(Target target)
+		{
+			switch (target)
+			{
+			case Target::BC7:
+				return "BC7";
+			case Target::ASTC4x4:
+				return "ASTC 4x4";
+			case Target::ETC2:
+				return "ETC2";
+			case Target::BC1:
+				return "BC1/BC3";
+			default:
+				return "RGBA8";
+			}//switch
+		}
+
+		Target selectTarget(VkPhysicalDevice physicalDevice, bool hasAlpha)
+		{
+			const Target candidates[] = { Target::BC7, Target::ASTC4x4, Target::ETC2, Target::BC1 };
+			for (Target target : candidates)
+			{
+				if (supportsSampling(physicalDevice, targetFormat(target, hasAlpha)))
+				{
+					return target;
+				}
+			}
+			return Target::RGBA8;
+		}
+
+		/**
+		* Produce all levels, native levels are copied and everything else is handed to the registered transcoder
+		*
+		* @param file Parsed file
+		* @param physicalDevice Device the target format is selected for
+		* @param levels Receives the data of every level
+		* @param format Receives the Vulkan format of the levels
+		* @param error Receives the reason if a level could not be produced
+		*
+		* @return True if all levels were produced
+		*/
+		bool loadLevels(const File& file, VkPhysicalDevice physicalDevice, std::vector<std::vector<uint8_t>>& levels, VkFormat& format, std::string& error)
+		{
+			Transcoder transcoder;
+			{
+				std::lock_guard<std::mutex> lock(transcoderMutex);
+				transcoder = registeredTranscoder;
+			}
+			Target target = Target::RGBA8;
+			if (file.payload == Payload::Native)
+			{
+				format = file.vkFormat;
+				if (!supportsSampling(physicalDevice, format))
+				{
+					error = "KTX2 format " + std::to_string(format) + " is not supported by the device";
+					return false;
+				}
+			}
+			else
+			{
+				target = selectTarget(physicalDevice, file.hasAlpha);
+				format = targetFormat(target, file.hasAlpha);
+			}
+			if (file.needsTranscoder() && !transcoder)
+			{
+				error = "KTX2 file needs a transcoder, register one with vks::ktx2::setTranscoder";
+				return false;
+			}
+
+			levels.resize(file.levels.size());
+			std::atomic<int> failedLevel(-1);
+			vks::parallel::forEachIndex(0, file.levels.size(), [&](size_t i)
+			{
+				uint32_t level = static_cast<uint32_t>(i);
+				if (file.needsTranscoder())
+				{
+					if (!transcoder(file, level, target, levels[i]))
+					{
+						failedLevel = static_cast<int>(level);
+					}
+				}
+				else
+				{
+					const uint8_t* source = file.levelData(level);
+					levels[i].assign(source, source + file.levels[i].length);
+				}
+			}, 1);//forEachIndex
+			if (failedLevel >= 0)
+			{
+				error = "Could not transcode KTX2 level " + std::to_string(failedLevel.load()) + " to " + toString(target);
+				return false;
+			}
+			return true;
+		}
+	}//ktx2
+}//vks
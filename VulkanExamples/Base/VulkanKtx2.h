@@ -0,0 +1,117 @@
+/*
+* KTX2 container support
+*
+* Parses KTX2 files (header, level index and data format descriptor), selects the best block compressed target
+* format the device samples from and produces the mip levels in parallel. Levels stored in a GPU format are used as is,
+* Basis Universal payloads (ETC1S/BasisLZ, UASTC) and supercompressed levels go through a transcoder that the
+* application registers, e.g. a thin wrapper around the Basis Universal transcoder
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+namespace vks
+{
+	namespace ktx2
+	{
+		enum Supercompression
+		{
+			SupercompressionNone = 0,
+			SupercompressionBasisLZ = 1,
+			SupercompressionZstd = 2,
+			SupercompressionZlib = 3
+		};
+
+		enum class Payload
+		{
+			/** @brief Levels are stored in File::vkFormat */
+			Native,
+			/** @brief Basis Universal ETC1S, always BasisLZ supercompressed */
+			ETC1S,
+			/** @brief Basis Universal UASTC, optionally Zstd supercompressed */
+			UASTC
+		};
+
+		/** @brief Formats a Basis Universal payload can be transcoded to, in order of preference */
+		enum class Target
+		{
+			BC7,
+			ASTC4x4,
+			ETC2,
+			/** @brief BC1 for opaque and BC3 for textures with alpha */
+			BC1,
+			RGBA8
+		};
+
+		struct Level
+		{
+			uint64_t offset = 0;
+			uint64_t length = 0;
+			uint64_t uncompressedLength = 0;
+		};
+
+		/** @brief A parsed KTX2 file, data points into the caller's memory which must outlive the file */
+		struct File
+		{
+			VkFormat vkFormat = VK_FORMAT_UNDEFINED;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			uint32_t depth = 0;
+			uint32_t layerCount = 0;
+			uint32_t faceCount = 1;
+			uint32_t supercompression = SupercompressionNone;
+			Payload payload = Payload::Native;
+			bool hasAlpha = false;
+			bool srgb = false;
+			std::vector<Level> levels;
+
+			const uint8_t* data = nullptr;
+			size_t size = 0;
+			/** @brief Supercompression global data, e.g. the BasisLZ codebooks */
+			const uint8_t* globalData = nullptr;
+			size_t globalDataSize = 0;
+
+			bool parse(const uint8_t* data, size_t size, std::string& error);
+			/** @brief True if the levels need the registered transcoder */
+			bool needsTranscoder() const { return (payload != Payload::Native) || (supercompression != SupercompressionNone); }
+			const uint8_t* levelData(uint32_t level) const { return data + levels[level].offset; }
+			uint32_t levelWidth(uint32_t level) const { return std::max(1u, width >> level); }
+			uint32_t levelHeight(uint32_t level) const { return std::max(1u, height >> level); }
+		};
+
+		/**
+		* @brief Produces one level in the target format (or in File::vkFormat for native payloads that are only supercompressed)
+		* @note Called from worker threads for different levels of the same file at the same time
+		*/
+		using Transcoder = std::function<bool(const File& file, uint32_t level, Target target, std::vector<uint8_t>& output)>;
+
+		/** @brief Registers the transcoder used for Basis Universal and supercompressed files, an empty function removes it */
+		void setTranscoder(Transcoder transcoder);
+		bool hasTranscoder();
+
+		/** @brief True if the identifier of a KTX2 file is at the start of the data */
+		bool isKtx2(const uint8_t* data, size_t size);
+
+		/** @brief Best target the device can sample from with optimal tiling, RGBA8 if no block format is supported */
+		Target selectTarget(VkPhysicalDevice physicalDevice, bool hasAlpha);
+		VkFormat targetFormat(Target target, bool hasAlpha);
+		const char* toString(Target target);
+
+		/**
+		* @brief Produces all levels of the file in parallel, one job per level
+		* @param format Receives the format of the produced levels
+		* @return False with an error message if a level could not be produced
+		*/
+		bool loadLevels(const File& file, VkPhysicalDevice physicalDevice, std::vector<std::vector<uint8_t>>& levels, VkFormat& format, std::string& error);
+	}//ktx2
+}//vks
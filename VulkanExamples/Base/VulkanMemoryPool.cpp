@@ -0,0 +1,819 @@
+/*
+* Device memory pool with incremental defragmentation
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanMemoryPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <random>
+
+#include "VulkanBuffer.h"
+
+namespace vks
+{
+	namespace
+	{
+		VkImageAspectFlags aspectMask(VkFormat format)
+		{
+			switch (format)
+			{
+			case VK_FORMAT_D16_UNORM:
+			case VK_FORMAT_X8_D24_UNORM_PACK32:
+			case VK_FORMAT_D32_SFLOAT:
+				return VK_IMAGE_ASPECT_DEPTH_BIT;
+			case VK_FORMAT_S8_UINT:
+				return VK_IMAGE_ASPECT_STENCIL_BIT;
+			case VK_FORMAT_D16_UNORM_S8_UINT:
+			case VK_FORMAT_D24_UNORM_S8_UINT:
+			case VK_FORMAT_D32_SFLOAT_S8_UINT:
+				return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+			default:
+				return VK_IMAGE_ASPECT_COLOR_BIT;
+			}//switch
+		}
+
+		VkImageMemoryBarrier imageBarrier(VkImage image, const VkImageCreateInfo& createInfo, VkImageLayout oldLayout, VkImageLayout newLayout,
+			VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask)
+		{
+			VkImageMemoryBarrier barrier = vks::initializers::GenImageMemoryBarrier();
+			barrier.image = image;
+			barrier.subresourceRange.aspectMask = aspectMask(createInfo.format);
+			barrier.subresourceRange.baseMipLevel = 0;
+			barrier.subresourceRange.levelCount = createInfo.mipLevels;
+			barrier.subresourceRange.baseArrayLayer = 0;
+			barrier.subresourceRange.layerCount = createInfo.arrayLayers;
+			barrier.oldLayout = oldLayout;
+			barrier.newLayout = newLayout;
+			barrier.srcAccessMask = srcAccessMask;
+			barrier.dstAccessMask = dstAccessMask;
+			return barrier;
+		}
+	}
+
+	/**
+	* Set up the command buffer and fence used for moves, memory blocks are allocated when the first resource needs them
+	*
+	* @param device Device the resources are created on
+	* @param queueFamilyIndex Family of the queue passed to defragment
+	* @param memoryPropertyFlags Properties of the memory type of all blocks
+	* @param blockSize Size of a memory block, at most 4 GB
+	*/
+	void MemoryPool::create(vks::VulkanDevice* device, uint32_t queueFamilyIndex, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize blockSize)
+	{
+		this->device = device;
+		this->memoryPropertyFlags = memoryPropertyFlags;
+		this->blockSize = std::min<VkDeviceSize>(blockSize, UINT32_MAX);
+		frame = 0;
+		batchPending = false;
+		counters = Statistics();
+		commandPool = device->CreateCommandPool(queueFamilyIndex);
+		commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, commandPool, false);
+		VkFenceCreateInfo fenceInfo = vks::initializers::GenFenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+		VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceInfo, nullptr, &fence));
+	}
+
+	/**
+	* Wait for moves in flight and destroy all resources and memory blocks, handles become invalid
+	*/
+	void MemoryPool::destroy()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (device == nullptr)
+		{
+			return;
+		}
+		if (batchPending)
+		{
+			VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &fence, VK_TRUE, UINT64_MAX));
+			for (const Move& move : moves)
+			{
+				destroyPlacement(move.target);
+			}
+			moves.clear();
+			batchPending = false;
+		}
+		for (const Retired& entry : retired)
+		{
+			destroyPlacement(entry.placement);
+		}
+		retired.clear();
+		for (const Resource& resource : resources)
+		{
+			if (resource.alive)
+			{
+				destroyPlacement(resource.placement);
+			}
+		}
+		resources.clear();
+		freeHandles.clear();
+		for (Block& block : blocks)
+		{
+			if (block.memory != VK_NULL_HANDLE)
+			{
+				vkFreeMemory(device->logicalDevice, block.memory, nullptr);
+			}
+		}
+		blocks.clear();
+		vkDestroyFence(device->logicalDevice, fence, nullptr);
+		vkDestroyCommandPool(device->logicalDevice, commandPool, nullptr);
+		fence = VK_NULL_HANDLE;
+		commandPool = VK_NULL_HANDLE;
+		commandBuffer = VK_NULL_HANDLE;
+		device = nullptr;
+	}
+
+	MemoryPool::Handle MemoryPool::addResource()
+	{
+		if (!freeHandles.empty())
+		{
+			Handle handle = freeHandles.back();
+			freeHandles.pop_back();
+			resources[handle] = Resource();
+			return handle;
+		}
+		resources.push_back(Resource());
+		return static_cast<Handle>(resources.size() - 1);
+	}
+
+	float MemoryPool::usage(const Block& block) const
+	{
+		uint32_t capacity = block.ranges.capacity();
+		return (capacity > 0) ? static_cast<float>(capacity - block.ranges.freeCount()) / static_cast<float>(capacity) : 0.0f;
+	}
+
+	/**
+	* Reserve a range for a resource, blocks that are already used most are tried first so that sparse blocks drain
+	*
+	* @param placement Receives the block and range
+	* @param memReqs Requirements of the buffer or image
+	* @param images True for images, buffers and images never share a block
+	* @param excludeBlock Block the resource is moved out of, only blocks used more than it are considered, ~0 for new resources
+	* @param allowNewBlock Allocate a new block if no existing block has room
+	*
+	* @return False if no block has room and no new block may be allocated
+	*/
+	bool MemoryPool::place(Placement& placement, const VkMemoryRequirements& memReqs, bool images, uint32_t excludeBlock, bool allowNewBlock)
+	{
+		if (memReqs.size > UINT32_MAX)
+		{
+			return false;
+		}
+		uint32_t memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
+		uint32_t size = static_cast<uint32_t>(memReqs.size);
+		uint32_t alignment = static_cast<uint32_t>(std::max<VkDeviceSize>(memReqs.alignment, 1));
+		float minimumUsage = (excludeBlock != ~0u) ? usage(blocks[excludeBlock]) : -1.0f;
+
+		std::vector<uint32_t> candidates;
+		for (uint32_t i = 0; i < static_cast<uint32_t>(blocks.size()); i++)
+		{
+			const Block& block = blocks[i];
+			if ((block.memory != VK_NULL_HANDLE) && (i != excludeBlock) && (block.images == images) && (block.memoryTypeIndex == memoryTypeIndex)
+				&& (block.ranges.largestFree() >= size) && (usage(block) > minimumUsage))
+			{
+				candidates.push_back(i);
+			}
+		}//for
+		std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) { return usage(blocks[a]) > usage(blocks[b]); });
+		for (uint32_t i : candidates)
+		{
+			uint32_t offset = blocks[i].ranges.allocate(size, alignment);
+			if (offset != RangeAllocator::invalidOffset)
+			{
+				placement.block = i;
+				placement.offset = offset;
+				placement.size = size;
+				blocks[i].placements++;
+				return true;
+			}
+		}//for
+		if (!allowNewBlock)
+		{
+			return false;
+		}
+
+		// Reuse the slot of a released block so block indices of placements stay valid
+		uint32_t index = 0;
+		while ((index < blocks.size()) && (blocks[index].memory != VK_NULL_HANDLE))
+		{
+			index++;
+		}
+		if (index == blocks.size())
+		{
+			blocks.push_back(Block());
+		}
+		Block& block = blocks[index];
+		VkMemoryAllocateInfo memAlloc = vks::initializers::GenMemoryAllocateInfo();
+		memAlloc.allocationSize = std::max<VkDeviceSize>(blockSize, memReqs.size);
+		memAlloc.memoryTypeIndex = memoryTypeIndex;
+		// Buffers created with the shader device address usage need memory allocated with the device address flag
+		VkMemoryAllocateFlagsInfo allocFlagsInfo{};
+		if (!images && device->bufferDeviceAddress.enabled)
+		{
+			allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+			allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+			memAlloc.pNext = &allocFlagsInfo;
+		}
+		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &block.memory));
+		block.memoryTypeIndex = memoryTypeIndex;
+		block.images = images;
+		block.placements = 1;
+		block.ranges.reset(static_cast<uint32_t>(memAlloc.allocationSize));
+		placement.block = index;
+		placement.offset = block.ranges.allocate(size, alignment);
+		placement.size = size;
+		return true;
+	}
+
+	/**
+	* Create the buffer or image (and view) of a resource and bind it to a new placement
+	*
+	* @return False if the resource could not be placed, nothing is left behind in that case
+	*/
+	bool MemoryPool::createObjects(const Resource& resource, Placement& placement, uint32_t excludeBlock, bool allowNewBlock)
+	{
+		VkMemoryRequirements memReqs;
+		bool images = (resource.imageCreateInfo.sType == VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO);
+		if (images)
+		{
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &resource.imageCreateInfo, nullptr, &placement.image));
+			vkGetImageMemoryRequirements(device->logicalDevice, placement.image, &memReqs);
+		}
+		else
+		{
+			VkBufferCreateInfo bufferCreateInfo = vks::initializers::GenBufferCreateInfo(resource.usageFlags, resource.size);
+			VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &placement.buffer));
+			vkGetBufferMemoryRequirements(device->logicalDevice, placement.buffer, &memReqs);
+		}
+		if (!place(placement, memReqs, images, excludeBlock, allowNewBlock))
+		{
+			vkDestroyImage(device->logicalDevice, placement.image, nullptr);
+			vkDestroyBuffer(device->logicalDevice, placement.buffer, nullptr);
+			placement = Placement();
+			return false;
+		}
+		VkDeviceMemory memory = blocks[placement.block].memory;
+		if (images)
+		{
+			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, placement.image, memory, placement.offset));
+			if (resource.hasView)
+			{
+				VkImageViewCreateInfo viewCreateInfo = resource.viewCreateInfo;
+				viewCreateInfo.image = placement.image;
+				VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, nullptr, &placement.view));
+			}
+		}
+		else
+		{
+			VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, placement.buffer, memory, placement.offset));
+		}
+		return true;
+	}
+
+	/**
+	* Create a buffer in a block with room for it
+	*
+	* @param usageFlags Usage of the buffer, transfer source and destination are added
+	* @param size Size of the buffer in bytes
+	*
+	* @return Handle of the buffer or invalidHandle if it is larger than 4 GB
+	*/
+	MemoryPool::Handle MemoryPool::createBuffer(VkBufferUsageFlags usageFlags, VkDeviceSize size)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Handle handle = addResource();
+		Resource& resource = resources[handle];
+		resource.usageFlags = usageFlags | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		resource.size = size;
+		if (!createObjects(resource, resource.placement, ~0u, true))
+		{
+			freeHandles.push_back(handle);
+			return invalidHandle;
+		}
+		resource.alive = true;
+		return handle;
+	}
+
+	/**
+	* Create an image in a block with room for it
+	*
+	* @param imageCreateInfo Image to create, transfer source and destination usage are added
+	* @param layout Layout the image is kept in between frames, moves transition the copy to it
+	* @param viewCreateInfo Optional view that is recreated with every move
+	*
+	* @return Handle of the image or invalidHandle if it is larger than 4 GB
+	*/
+	MemoryPool::Handle MemoryPool::createImage(const VkImageCreateInfo& imageCreateInfo, VkImageLayout layout, const VkImageViewCreateInfo* viewCreateInfo)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Handle handle = addResource();
+		Resource& resource = resources[handle];
+		resource.imageCreateInfo = imageCreateInfo;
+		resource.imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		resource.layout = layout;
+		if (viewCreateInfo != nullptr)
+		{
+			resource.viewCreateInfo = *viewCreateInfo;
+			resource.hasView = true;
+		}
+		if (!createObjects(resource, resource.placement, ~0u, true))
+		{
+			freeHandles.push_back(handle);
+			return invalidHandle;
+		}
+		resource.size = resource.placement.size;
+		resource.alive = true;
+		return handle;
+	}
+
+	void MemoryPool::release(Handle handle)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Resource& resource = resources[handle];
+		if (!resource.alive)
+		{
+			return;
+		}
+		retire(resource.placement);
+		resource.alive = false;
+		resource.descriptors.clear();
+		// The copy of a resource that is being moved is retired by collect, the handle is reused after that
+		if (!resource.moving)
+		{
+			freeHandles.push_back(handle);
+		}
+	}
+
+	void MemoryPool::setMovable(Handle handle, bool movable)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		resources[handle].movable = movable;
+	}
+
+	VkBuffer MemoryPool::buffer(Handle handle)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return resources[handle].placement.buffer;
+	}
+
+	VkImage MemoryPool::image(Handle handle)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return resources[handle].placement.image;
+	}
+
+	VkImageView MemoryPool::view(Handle handle)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return resources[handle].placement.view;
+	}
+
+	VkDeviceSize MemoryPool::size(Handle handle)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return resources[handle].size;
+	}
+
+	void MemoryPool::trackDescriptor(Handle handle, VkDescriptorSet descriptorSet, uint32_t binding, uint32_t arrayElement, VkDescriptorType type,
+		VkSampler sampler)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Descriptor descriptor;
+		descriptor.descriptorSet = descriptorSet;
+		descriptor.binding = binding;
+		descriptor.arrayElement = arrayElement;
+		descriptor.type = type;
+		descriptor.sampler = sampler;
+		resources[handle].descriptors.push_back(descriptor);
+	}
+
+	void MemoryPool::retire(const Placement& placement)
+	{
+		Retired entry;
+		entry.placement = placement;
+		entry.frame = frame;
+		retired.push_back(entry);
+	}
+
+	/**
+	* Destroy the objects of a placement and free its range, the block's memory is freed with its last placement
+	*/
+	void MemoryPool::destroyPlacement(const Placement& placement)
+	{
+		vkDestroyImageView(device->logicalDevice, placement.view, nullptr);
+		vkDestroyImage(device->logicalDevice, placement.image, nullptr);
+		vkDestroyBuffer(device->logicalDevice, placement.buffer, nullptr);
+		Block& block = blocks[placement.block];
+		block.ranges.free(placement.offset, placement.size);
+		if (--block.placements == 0)
+		{
+			vkFreeMemory(device->logicalDevice, block.memory, nullptr);
+			block.memory = VK_NULL_HANDLE;
+			block.ranges.reset(0);
+			counters.releasedBlocks++;
+		}
+	}
+
+	void MemoryPool::recordMove(const Resource& resource, const Placement& target)
+	{
+		if (resource.placement.buffer != VK_NULL_HANDLE)
+		{
+			VkBufferCopy region{};
+			region.size = resource.size;
+			vkCmdCopyBuffer(commandBuffer, resource.placement.buffer, target.buffer, 1, &region);
+			return;
+		}
+		if (resource.layout == VK_IMAGE_LAYOUT_UNDEFINED)
+		{
+			return;
+		}
+		const VkImageCreateInfo& info = resource.imageCreateInfo;
+		std::vector<VkImageCopy> regions(info.mipLevels);
+		for (uint32_t level = 0; level < info.mipLevels; level++)
+		{
+			VkImageCopy& region = regions[level];
+			region.srcSubresource.aspectMask = aspectMask(info.format);
+			region.srcSubresource.mipLevel = level;
+			region.srcSubresource.baseArrayLayer = 0;
+			region.srcSubresource.layerCount = info.arrayLayers;
+			region.dstSubresource = region.srcSubresource;
+			region.srcOffset = { 0, 0, 0 };
+			region.dstOffset = { 0, 0, 0 };
+			region.extent.width = std::max(1u, info.extent.width >> level);
+			region.extent.height = std::max(1u, info.extent.height >> level);
+			region.extent.depth = std::max(1u, info.extent.depth >> level);
+		}//for
+		vkCmdCopyImage(commandBuffer, resource.placement.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, target.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(regions.size()), regions.data());
+	}
+
+	/**
+	* Plan moves out of the sparsest blocks into denser blocks and submit their copies in one command buffer
+	*
+	* @param queue Queue of the family passed to create, the copies see all work submitted to it before
+	* @param budgetMilliseconds CPU time planning and recording may take
+	* @param budgetBytes Bytes the batch may copy, the first move is always made
+	*
+	* @return Number of moves that were started
+	*/
+	uint32_t MemoryPool::defragment(VkQueue queue, double budgetMilliseconds, VkDeviceSize budgetBytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (batchPending || (commandBuffer == VK_NULL_HANDLE))
+		{
+			return 0;
+		}
+		auto start = std::chrono::high_resolution_clock::now();
+
+		// Draining the sparsest blocks first frees whole blocks with the fewest copies, a block is only drained if the denser
+		// blocks of its kind have room for all of it, partial moves would not free anything
+		std::vector<uint32_t> sources;
+		for (uint32_t i = 0; i < static_cast<uint32_t>(blocks.size()); i++)
+		{
+			const Block& block = blocks[i];
+			if ((block.memory == VK_NULL_HANDLE) || (usage(block) >= sparseThreshold))
+			{
+				continue;
+			}
+			uint64_t room = 0;
+			for (const Block& other : blocks)
+			{
+				if ((&other != &block) && (other.memory != VK_NULL_HANDLE) && (other.images == block.images) && (other.memoryTypeIndex == block.memoryTypeIndex)
+					&& (usage(other) > usage(block)))
+				{
+					room += other.ranges.freeCount();
+				}
+			}//for
+			if (room >= block.ranges.capacity() - block.ranges.freeCount())
+			{
+				sources.push_back(i);
+			}
+		}//for
+		std::sort(sources.begin(), sources.end(), [this](uint32_t a, uint32_t b) { return usage(blocks[a]) < usage(blocks[b]); });
+
+		VkDeviceSize bytes = 0;
+		bool budgetExhausted = false;
+		for (uint32_t source : sources)
+		{
+			for (Handle handle = 0; (handle < resources.size()) && !budgetExhausted; handle++)
+			{
+				Resource& resource = resources[handle];
+				if (!resource.alive || !resource.movable || resource.moving || (resource.placement.block != source))
+				{
+					continue;
+				}
+				double elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+				if (!moves.empty() && ((bytes + resource.size > budgetBytes) || (elapsed > budgetMilliseconds)))
+				{
+					budgetExhausted = true;
+					break;
+				}
+				Move move;
+				move.handle = handle;
+				if (!createObjects(resource, move.target, source, false))
+				{
+					continue;
+				}
+				resource.moving = true;
+				bytes += resource.size;
+				moves.push_back(move);
+			}//for
+			if (budgetExhausted)
+			{
+				break;
+			}
+		}//for
+		if (moves.empty())
+		{
+			return 0;
+		}
+
+		VkCommandBufferBeginInfo beginInfo = vks::initializers::GenCommandBufferBeginInfo();
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+		// Earlier submissions may still be writing the sources, images are copied in transfer layouts and returned to their layout
+		std::vector<VkImageMemoryBarrier> toTransfer;
+		std::vector<VkImageMemoryBarrier> toLayout;
+		for (const Move& move : moves)
+		{
+			const Resource& resource = resources[move.handle];
+			if ((move.target.image == VK_NULL_HANDLE) || (resource.layout == VK_IMAGE_LAYOUT_UNDEFINED))
+			{
+				continue;
+			}
+			toTransfer.push_back(imageBarrier(resource.placement.image, resource.imageCreateInfo, resource.layout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				VK_ACCESS_MEMORY_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT));
+			toTransfer.push_back(imageBarrier(move.target.image, resource.imageCreateInfo, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				0, VK_ACCESS_TRANSFER_WRITE_BIT));
+			toLayout.push_back(imageBarrier(move.target.image, resource.imageCreateInfo, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, resource.layout,
+				VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT));
+		}//for
+		VkMemoryBarrier memoryBarrier = vks::initializers::GenMemoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr,
+			static_cast<uint32_t>(toTransfer.size()), toTransfer.data());
+		for (const Move& move : moves)
+		{
+			recordMove(resources[move.handle], move.target);
+		}
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &memoryBarrier, 0, nullptr,
+			static_cast<uint32_t>(toLayout.size()), toLayout.data());
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+
+		VK_CHECK_RESULT(vkResetFences(device->logicalDevice, 1, &fence));
+		VkSubmitInfo submitInfo = vks::initializers::GenSubmitInfo();
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+		batchPending = true;
+		counters.movesInFlight = static_cast<uint32_t>(moves.size());
+		return static_cast<uint32_t>(moves.size());
+	}
+
+	void MemoryPool::writeDescriptors(const Resource& resource)
+	{
+		for (const Descriptor& descriptor : resource.descriptors)
+		{
+			VkDescriptorBufferInfo bufferInfo{ resource.placement.buffer, 0, VK_WHOLE_SIZE };
+			VkDescriptorImageInfo imageInfo = vks::initializers::GenDescriptorImageInfo(descriptor.sampler, resource.placement.view, resource.layout);
+			VkWriteDescriptorSet write = (resource.placement.buffer != VK_NULL_HANDLE)
+				? vks::initializers::GenWriteDescriptorSet(descriptor.descriptorSet, descriptor.type, descriptor.binding, &bufferInfo)
+				: vks::initializers::GenWriteDescriptorSet(descriptor.descriptorSet, descriptor.type, descriptor.binding, &imageInfo);
+			write.dstArrayElement = descriptor.arrayElement;
+			vkUpdateDescriptorSets(device->logicalDevice, 1, &write, 0, nullptr);
+		}//for
+	}
+
+	/**
+	* Switch moved resources to their copies once the batch finished, then destroy retired objects and free empty blocks
+	*
+	* @param wait If true, block until the batch in flight finished
+	*
+	* @return Number of resources that now use their copy
+	*/
+	uint32_t MemoryPool::collect(bool wait)
+	{
+		std::vector<Handle> relocated;
+		RelocationCallback callback;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			frame++;
+			if (batchPending)
+			{
+				VkResult result = wait ? vkWaitForFences(device->logicalDevice, 1, &fence, VK_TRUE, UINT64_MAX)
+					: vkGetFenceStatus(device->logicalDevice, fence);
+				if (result != VK_NOT_READY)
+				{
+					VK_CHECK_RESULT(result);
+					for (const Move& move : moves)
+					{
+						Resource& resource = resources[move.handle];
+						resource.moving = false;
+						if (!resource.alive)
+						{
+							// Released while its copy was made
+							retire(move.target);
+							freeHandles.push_back(move.handle);
+							continue;
+						}
+						retire(resource.placement);
+						resource.placement = move.target;
+						writeDescriptors(resource);
+						relocated.push_back(move.handle);
+						counters.moves++;
+						counters.movedBytes += resource.size;
+					}//for
+					moves.clear();
+					batchPending = false;
+					counters.movesInFlight = 0;
+				}
+			}
+
+			// Sources of a batch in flight are still read by it
+			if (!batchPending)
+			{
+				auto expired = std::partition(retired.begin(), retired.end(), [this](const Retired& entry) { return frame - entry.frame < retireFrames; });
+				for (auto it = expired; it != retired.end(); ++it)
+				{
+					destroyPlacement(it->placement);
+				}
+				retired.erase(expired, retired.end());
+			}
+			callback = onRelocate;
+		}
+		// Called without the lock so the callback can query the new objects
+		if (callback && !relocated.empty())
+		{
+			callback(relocated);
+		}
+		return static_cast<uint32_t>(relocated.size());
+	}
+
+	MemoryPool::Statistics MemoryPool::statistics()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Statistics stats = counters;
+		uint64_t freeBytes = 0;
+		for (const Block& block : blocks)
+		{
+			if (block.memory == VK_NULL_HANDLE)
+			{
+				continue;
+			}
+			stats.blocks++;
+			stats.capacity += block.ranges.capacity();
+			freeBytes += block.ranges.freeCount();
+			stats.largestFree = std::max<uint64_t>(stats.largestFree, block.ranges.largestFree());
+		}//for
+		stats.used = stats.capacity - freeBytes;
+		stats.fragmentation = (freeBytes > 0) ? 1.0f - static_cast<float>(stats.largestFree) / static_cast<float>(freeBytes) : 0.0f;
+		for (const Resource& resource : resources)
+		{
+			stats.resources += resource.alive ? 1 : 0;
+		}
+		return stats;
+	}
+
+	/**
+	* Soak test of a session that keeps loading and unloading assets, run once without and once with defragmentation
+	*
+	* @param device Device the pool is created on
+	* @param queue Graphics queue the uploads and moves are submitted to
+	* @param out Stream the report is written to
+	* @param frames Number of simulated frames per run
+	*/
+	void benchmarkDefragmentation(vks::VulkanDevice* device, VkQueue queue, std::ostream& out, uint32_t frames)
+	{
+		const uint32_t liveTarget = 300;
+		const uint32_t reportInterval = std::max(frames / 10, 1u);
+		const VkDeviceSize moveBudget = 32 * 1024 * 1024;
+		const double megabyte = 1024.0 * 1024.0;
+		out << "Defragmentation soak test: " << frames << " frames, about " << liveTarget << " live buffers and images, moves of up to "
+			<< moveBudget / (1024 * 1024) << " MB and 2 ms per frame\n";
+
+		struct Live
+		{
+			MemoryPool::Handle handle;
+			uint32_t tag;
+			bool image;
+		};
+		for (bool defragment : { false, true })
+		{
+			out << (defragment ? "  with defragmentation\n" : "  without defragmentation\n");
+			MemoryPool pool;
+			pool.create(device, device->queueFamilyIndices.graphicIndex);
+			// The same load and unload sequence for both runs
+			std::mt19937 random(1);
+			std::vector<Live> live;
+			uint64_t peakCapacity = 0;
+
+			for (uint32_t frame = 0; frame < frames; frame++)
+			{
+				pool.collect();
+
+				// Regular churn and every 100 frames a level change that unloads 30% of the assets
+				uint32_t unloads = (frame % 100 == 99) ? static_cast<uint32_t>(live.size() * 3 / 10) : random() % 4;
+				for (uint32_t i = 0; (i < unloads) && !live.empty(); i++)
+				{
+					size_t index = random() % live.size();
+					pool.release(live[index].handle);
+					live[index] = live.back();
+					live.pop_back();
+				}//for
+
+				VkCommandBuffer cmd = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+				for (uint32_t i = 0; (i < 8) && (live.size() < liveTarget); i++)
+				{
+					Live entry;
+					entry.tag = random();
+					entry.image = (random() % 4 == 0);
+					if (entry.image)
+					{
+						VkImageCreateInfo imageCreateInfo = vks::initializers::GenImageCreateInfo();
+						imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+						imageCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+						imageCreateInfo.extent = { 32u << (random() % 5), 32u << (random() % 5), 1 };
+						imageCreateInfo.mipLevels = 1;
+						imageCreateInfo.arrayLayers = 1;
+						imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+						imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+						imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+						imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+						entry.handle = pool.createImage(imageCreateInfo, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+						VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+						VkImage image = pool.image(entry.handle);
+						vks::tools::setImageLayout(cmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, range);
+						VkClearColorValue color = { { (entry.tag & 0xff) / 255.0f, 0.0f, 0.0f, 1.0f } };
+						vkCmdClearColorImage(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color, 1, &range);
+						vks::tools::setImageLayout(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, range);
+					}
+					else
+					{
+						VkDeviceSize size = (4096ull << (random() % 10)) + (random() % 64) * 256;
+						entry.handle = pool.createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, size);
+						vkCmdFillBuffer(cmd, pool.buffer(entry.handle), 0, VK_WHOLE_SIZE, entry.tag);
+					}
+					live.push_back(entry);
+				}//for
+				device->FlushCommandBuffer(cmd, queue);
+
+				if (defragment)
+				{
+					pool.defragment(queue, 2.0, moveBudget);
+				}
+				MemoryPool::Statistics stats = pool.statistics();
+				peakCapacity = std::max(peakCapacity, stats.capacity);
+				if ((frame + 1) % reportInterval == 0)
+				{
+					out << "    frame " << std::setw(5) << frame + 1 << ": " << std::setw(3) << stats.blocks << " blocks, " << std::fixed << std::setprecision(1)
+						<< std::setw(7) << stats.used / megabyte << " / " << std::setw(7) << stats.capacity / megabyte << " MB used, largest free "
+						<< std::setw(6) << stats.largestFree / megabyte << " MB, fragmentation " << std::setw(5) << stats.fragmentation * 100.0f << "%, moved "
+						<< std::setw(8) << stats.movedBytes / megabyte << " MB\n";
+				}
+			}//for
+
+			// Finish the last batch, then check that every buffer still holds its fill value
+			pool.collect(true);
+			std::vector<const Live*> buffers;
+			for (const Live& entry : live)
+			{
+				if (!entry.image)
+				{
+					buffers.push_back(&entry);
+				}
+			}
+			uint32_t mismatches = 0;
+			if (!buffers.empty())
+			{
+				vks::Buffer readback;
+				VK_CHECK_RESULT(device->CreateHostBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, vks::HostAccess::Readback, &readback, buffers.size() * sizeof(uint32_t)));
+				VkCommandBuffer cmd = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+				for (size_t i = 0; i < buffers.size(); i++)
+				{
+					VkBufferCopy region = { 0, i * sizeof(uint32_t), sizeof(uint32_t) };
+					vkCmdCopyBuffer(cmd, pool.buffer(buffers[i]->handle), readback.buffer, 1, &region);
+				}
+				device->FlushCommandBuffer(cmd, queue);
+				VK_CHECK_RESULT(readback.invalidate());
+				const uint32_t* values = static_cast<const uint32_t*>(readback.mappedData);
+				for (size_t i = 0; i < buffers.size(); i++)
+				{
+					mismatches += (values[i] != buffers[i]->tag) ? 1 : 0;
+				}
+				readback.destroy();
+			}
+			MemoryPool::Statistics stats = pool.statistics();
+			out << "    peak " << std::fixed << std::setprecision(1) << peakCapacity / megabyte << " MB, " << stats.moves << " moves, "
+				<< stats.releasedBlocks << " blocks released, " << buffers.size() << " buffers checked, " << mismatches << " mismatches\n";
+			vkQueueWaitIdle(queue);
+			pool.destroy();
+		}//for
+	}
+}//vks
@@ -0,0 +1,195 @@
+/*
+* Device memory pool with incremental defragmentation
+*
+* Buffers and images are sub-allocated from large device memory blocks and referenced through handles. Long running sessions
+* that load and unload assets leave blocks sparsely used, defragment moves the live resources out of those blocks with GPU
+* copies a few megabytes per frame, points the handles and registered descriptors at the copies and frees the emptied blocks
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+#include "VulkanGeometryPool.h"
+
+namespace vks
+{
+	/**
+	* @brief Sub-allocates buffers and images from device memory blocks and compacts sparsely used blocks over several frames
+	* @note The buffer, image and view behind a handle change when it is moved. Once a move finished, registered descriptors are
+	* rewritten and onRelocate is called so command buffers can be recorded again, the old objects are destroyed retireFrames
+	* collect calls later. Buffers and images are kept in separate blocks, so the buffer image granularity never applies
+	*/
+	class MemoryPool
+	{
+	public:
+		/** @brief Index into the resource table of the pool, stays the same when the resource is moved */
+		typedef uint32_t Handle;
+		static const Handle invalidHandle = ~0u;
+
+		/** @brief Called with the handles whose objects were replaced, after their registered descriptors were rewritten */
+		using RelocationCallback = std::function<void(const std::vector<Handle>& handles)>;
+
+		struct Statistics
+		{
+			uint32_t blocks = 0;
+			uint32_t resources = 0;
+			uint64_t capacity = 0;
+			uint64_t used = 0;
+			/** @brief Largest free range of all blocks, the largest resource that fits without a new block */
+			uint64_t largestFree = 0;
+			/** @brief 1 - largest free range / free bytes, 0 if all free memory is one range */
+			float fragmentation = 0.0f;
+			uint32_t movesInFlight = 0;
+			uint64_t moves = 0;
+			uint64_t movedBytes = 0;
+			uint64_t releasedBlocks = 0;
+		};
+
+		vks::VulkanDevice* device = nullptr;
+		/** @brief Size of a block, larger resources get a block of their own */
+		VkDeviceSize blockSize = 0;
+		/** @brief Blocks with less than this fraction in use are emptied by defragment */
+		float sparseThreshold = 0.5f;
+		/** @brief Number of collect calls (frames) replaced and released objects are kept alive for command buffers in flight */
+		uint32_t retireFrames = 3;
+		RelocationCallback onRelocate;
+
+		/**
+		* @brief Set up the pool, blocks are allocated on demand
+		* @param queueFamilyIndex Family of the queue passed to defragment
+		*/
+		void create(vks::VulkanDevice* device, uint32_t queueFamilyIndex, VkMemoryPropertyFlags memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			VkDeviceSize blockSize = 64 * 1024 * 1024);
+		void destroy();
+
+		/** @brief Transfer source and destination usage is added for moves */
+		Handle createBuffer(VkBufferUsageFlags usageFlags, VkDeviceSize size);
+		/**
+		* @brief Create an image and optionally a view of it, the image field of the view create info is ignored
+		* @param layout Layout the image is in whenever defragment records a move, moves keep it in that layout
+		*/
+		Handle createImage(const VkImageCreateInfo& imageCreateInfo, VkImageLayout layout, const VkImageViewCreateInfo* viewCreateInfo = nullptr);
+		/** @brief Objects of the handle stay alive for retireFrames collect calls, the handle can be reused after that */
+		void release(Handle handle);
+		/** @brief Resources written by the GPU after their upload must not be moved, a move would lose writes made while it is in flight */
+		void setMovable(Handle handle, bool movable);
+
+		VkBuffer buffer(Handle handle);
+		VkImage image(Handle handle);
+		VkImageView view(Handle handle);
+		VkDeviceSize size(Handle handle);
+
+		/** @brief Rewrite a descriptor that refers to the resource whenever it is moved, sampler is only used for image descriptors */
+		void trackDescriptor(Handle handle, VkDescriptorSet descriptorSet, uint32_t binding, uint32_t arrayElement, VkDescriptorType type,
+			VkSampler sampler = VK_NULL_HANDLE);
+
+		/**
+		* @brief Start moving resources out of sparse blocks into denser ones and submit the copies, nothing is started while a previous batch is in flight
+		* @param budgetMilliseconds CPU time for planning and recording
+		* @param budgetBytes Bytes copied by the batch, bounds the GPU time taken from the frame
+		* @return Number of moves started
+		*/
+		uint32_t defragment(VkQueue queue, double budgetMilliseconds, VkDeviceSize budgetBytes);
+		/**
+		* @brief Finish the batch if its copies completed, destroy objects retired long enough ago and free empty blocks
+		* @note Call once per frame while the registered descriptor sets are not in use by pending command buffers
+		* @return Number of resources that were moved
+		*/
+		uint32_t collect(bool wait = false);
+
+		Statistics statistics();
+
+	private:
+		struct Descriptor
+		{
+			VkDescriptorSet descriptorSet;
+			uint32_t binding;
+			uint32_t arrayElement;
+			VkDescriptorType type;
+			VkSampler sampler;
+		};
+		/** @brief Objects and the range they are bound to */
+		struct Placement
+		{
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkImage image = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+			uint32_t block = ~0u;
+			uint32_t offset = 0;
+			uint32_t size = 0;
+		};
+		struct Resource
+		{
+			Placement placement;
+			bool alive = false;
+			bool movable = true;
+			/** @brief A copy of the resource is in the batch in flight */
+			bool moving = false;
+			VkBufferUsageFlags usageFlags = 0;
+			VkDeviceSize size = 0;
+			VkImageCreateInfo imageCreateInfo{};
+			VkImageViewCreateInfo viewCreateInfo{};
+			bool hasView = false;
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			std::vector<Descriptor> descriptors;
+		};
+		struct Block
+		{
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			uint32_t memoryTypeIndex = 0;
+			bool images = false;
+			RangeAllocator ranges;
+			/** @brief Live and retired placements, the block is freed once there are none */
+			uint32_t placements = 0;
+		};
+		struct Move
+		{
+			Handle handle;
+			Placement target;
+		};
+		struct Retired
+		{
+			Placement placement;
+			uint64_t frame;
+		};
+
+		std::mutex mutex;
+		std::vector<Resource> resources;
+		std::vector<Handle> freeHandles;
+		std::vector<Block> blocks;
+		std::vector<Move> moves;
+		std::vector<Retired> retired;
+		VkMemoryPropertyFlags memoryPropertyFlags = 0;
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		bool batchPending = false;
+		uint64_t frame = 0;
+		Statistics counters;
+
+		Handle addResource();
+		/** @brief Bind a new placement in a block of the right kind and memory type, optionally only in blocks denser than excludeBlock */
+		bool place(Placement& placement, const VkMemoryRequirements& memReqs, bool images, uint32_t excludeBlock, bool allowNewBlock);
+		bool createObjects(const Resource& resource, Placement& placement, uint32_t excludeBlock, bool allowNewBlock);
+		void retire(const Placement& placement);
+		void destroyPlacement(const Placement& placement);
+		void recordMove(const Resource& resource, const Placement& target);
+		void writeDescriptors(const Resource& resource);
+		float usage(const Block& block) const;
+	};
+
+	/**
+	* @brief Loads and unloads buffers and images of random sizes for a number of frames, with and without incremental defragmentation,
+	* reports the fragmentation over time and checks that moved buffers kept their contents
+	*/
+	void benchmarkDefragmentation(vks::VulkanDevice* device, VkQueue queue, std::ostream& out, uint32_t frames = 2000);
+}//vks
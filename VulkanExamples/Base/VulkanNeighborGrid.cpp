@@ -0,0 +1,413 @@
+/*
+* GPU neighbor search
+*
+* Sorts particles into a uniform grid on the GPU for short range interactions (fluids, collisions) that only look at particles
+* within one cell size. Cells are hashed into a fixed size table, so the grid has no bounds. A counting sort builds the table:
+* particles are counted per cell, the counts are prefix summed into cell offsets and the particles are scattered into a copy
+* ordered by cell, so the particles of neighbouring cells are close in memory. Queries walk the 27 cells around a position
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanNeighborGrid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "VulkanGpuTimer.h"
+
+namespace vks
+{
+	namespace
+	{
+		// Matches local_size_x of grid_count.comp, grid_scatter.comp and grid_query.comp
+		const uint32_t particleGroupSize = 256;
+		// Cells scanned by one workgroup of grid_scan.comp, 256 invocations with 4 cells each
+		const uint32_t scanBlockSize = 1024;
+
+		uint32_t roundTableSize(uint32_t tableSize)
+		{
+			uint32_t size = scanBlockSize;
+			while ((size < tableSize) && (size < NeighborGrid::maxTableSize))
+			{
+				size *= 2;
+			}
+			return size;
+		}
+	}
+
+	/**
+	* Create the buffers, descriptors and pipelines
+	*
+	* @param device Device to create the resources on
+	* @param pipelineCache Pipeline cache used for the compute pipelines
+	* @param shadersPath Base path of the GLSL shaders (getShadersPath())
+	* @param maxParticles Largest particle count setParticles is called with
+	* @param tableSize Hash table cells, 0 picks twice the particle count
+	*/
+	void NeighborGrid::prepare(vks::VulkanDevice* device, VkPipelineCache pipelineCache, const std::string& shadersPath, uint32_t maxParticles, uint32_t tableSize)
+	{
+		this->device = device;
+		this->maxParticles = std::max(maxParticles, 1u);
+		params = {};
+		params.cellSize = 1.0f;
+		params.tableSize = roundTableSize((tableSize > 0) ? tableSize : 2 * this->maxParticles);
+
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&uniformBuffer, sizeof(Params)));
+		VK_CHECK_RESULT(uniformBuffer.map());
+		memcpy(uniformBuffer.mappedData, &params, sizeof(Params));
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&cellCountBuffer, params.tableSize * sizeof(uint32_t)));
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&cellStartBuffer, params.tableSize * sizeof(uint32_t)));
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&particleCellBuffer, static_cast<VkDeviceSize>(this->maxParticles) * 2 * sizeof(uint32_t)));
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&blockSumBuffer, (maxTableSize / scanBlockSize) * sizeof(uint32_t)));
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&sortedBuffer, static_cast<VkDeviceSize>(this->maxParticles) * sizeof(Particle)));
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&sortedIndexBuffer, static_cast<VkDeviceSize>(this->maxParticles) * sizeof(uint32_t)));
+
+		setupDescriptors();
+		preparePipelines(pipelineCache, shadersPath);
+	}
+
+	void NeighborGrid::destroy()
+	{
+		if (!device)
+		{
+			return;
+		}
+		VkDevice logicalDevice = device->logicalDevice;
+		vkDestroyPipeline(logicalDevice, pipelineCount, nullptr);
+		vkDestroyPipeline(logicalDevice, pipelineScan, nullptr);
+		vkDestroyPipeline(logicalDevice, pipelineScatter, nullptr);
+		vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(logicalDevice, buildSetLayout, nullptr);
+		vkDestroyDescriptorSetLayout(logicalDevice, querySetLayout, nullptr);
+		vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+		uniformBuffer.destroy();
+		cellCountBuffer.destroy();
+		cellStartBuffer.destroy();
+		particleCellBuffer.destroy();
+		blockSumBuffer.destroy();
+		sortedBuffer.destroy();
+		sortedIndexBuffer.destroy();
+		device = nullptr;
+	}
+
+	void NeighborGrid::setupDescriptors()
+	{
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 11),
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::GenDescriptorPoolCreateInfo(poolSizes, 2);
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+
+		// Build passes, see neighborgrid/grid_build.glsl. Binding 1 is the input, written by setParticles
+		std::vector<VkDescriptorSetLayoutBinding> bindings = {
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 5),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 6),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 7),
+		};
+		VkDescriptorSetLayoutCreateInfo layoutInfo = vks::initializers::GenDescriptorSetLayoutCreateInfo(bindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &layoutInfo, nullptr, &buildSetLayout));
+
+		// Query shaders, see neighborgrid/grid.glsl
+		bindings = {
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+		};
+		layoutInfo = vks::initializers::GenDescriptorSetLayoutCreateInfo(bindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &layoutInfo, nullptr, &querySetLayout));
+
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &buildSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &buildSet));
+		allocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &querySetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &querySet));
+
+		// Until setParticles is called the build reads the sorted copy, so the set is complete
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::GenWriteDescriptorSet(buildSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(buildSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &sortedBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(buildSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &cellCountBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(buildSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &cellStartBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(buildSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &particleCellBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(buildSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &blockSumBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(buildSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6, &sortedBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(buildSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7, &sortedIndexBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(querySet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(querySet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &cellStartBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(querySet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &cellCountBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(querySet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &sortedBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(querySet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &sortedIndexBuffer.descriptorBufferInfo),
+		};
+		vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
+	void NeighborGrid::preparePipelines(VkPipelineCache pipelineCache, const std::string& shadersPath)
+	{
+		VkPushConstantRange pushConstantRange = vks::initializers::GenPushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PushConstants), 0);
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = vks::initializers::GenPipelineLayoutCreateInfo(&buildSetLayout, 1);
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+
+		VkComputePipelineCreateInfo pipelineInfo = vks::initializers::GenComputePipelineCreateInfo(pipelineLayout);
+		const std::pair<const char*, VkPipeline*> pipelines[] = {
+			{ "neighborgrid/grid_count.comp.spv", &pipelineCount },
+			{ "neighborgrid/grid_scan.comp.spv", &pipelineScan },
+			{ "neighborgrid/grid_scatter.comp.spv", &pipelineScatter },
+		};
+		for (const auto& pipeline : pipelines)
+		{
+			pipelineInfo.stage = vks::tools::loadShaderStage(shadersPath + pipeline.first, VK_SHADER_STAGE_COMPUTE_BIT, device->logicalDevice);
+			VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, pipeline.second));
+			vkDestroyShaderModule(device->logicalDevice, pipelineInfo.stage.module, nullptr);
+		}
+	}
+
+	void NeighborGrid::setParticles(const VkDescriptorBufferInfo& particles, uint32_t particleCount)
+	{
+		params.particleCount = std::min(particleCount, maxParticles);
+		memcpy(uniformBuffer.mappedData, &params, sizeof(Params));
+		VkDescriptorBufferInfo bufferInfo = particles;
+		VkWriteDescriptorSet writeDescriptorSet = vks::initializers::GenWriteDescriptorSet(buildSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &bufferInfo);
+		vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+	}
+
+	void NeighborGrid::setCellSize(float cellSize)
+	{
+		params.cellSize = cellSize;
+		memcpy(uniformBuffer.mappedData, &params, sizeof(Params));
+	}
+
+	/**
+	* Record the counting sort
+	*
+	* Counting gives every particle its rank inside its cell, the three scan passes turn the cell counts into start offsets (scan the
+	* blocks, scan the block sums, add them to the blocks) and the scatter writes every particle to its cell start plus its rank
+	*/
+	void NeighborGrid::recordBuild(VkCommandBuffer commandBuffer)
+	{
+		const uint32_t particleGroups = (params.particleCount + particleGroupSize - 1) / particleGroupSize;
+		const uint32_t scanGroups = params.tableSize / scanBlockSize;
+
+		VkMemoryBarrier memoryBarrier = vks::initializers::GenMemoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		auto barrier = [&]()
+		{
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		};
+
+		// Queries of the previous build must be done before the counts are cleared
+		VkMemoryBarrier clearBarrier = vks::initializers::GenMemoryBarrier();
+		clearBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		clearBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+		vkCmdFillBuffer(commandBuffer, cellCountBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+		barrier();
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &buildSet, 0, nullptr);
+		PushConstants pushConstants = { 0 };
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineCount);
+		vkCmdDispatch(commandBuffer, particleGroups, 1, 1);
+		barrier();
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineScan);
+		const uint32_t scanDispatches[] = { scanGroups, 1, scanGroups };
+		for (uint32_t pass = 0; pass < 3; pass++)
+		{
+			pushConstants.pass = pass;
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+			vkCmdDispatch(commandBuffer, scanDispatches[pass], 1, 1);
+			barrier();
+		}
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineScatter);
+		vkCmdDispatch(commandBuffer, particleGroups, 1, 1);
+		barrier();
+	}
+
+	glm::ivec3 NeighborGrid::cell(const glm::vec3& position, float cellSize)
+	{
+		return glm::ivec3(glm::floor(position / cellSize));
+	}
+
+	uint32_t NeighborGrid::hash(const glm::ivec3& cell, uint32_t tableSize)
+	{
+		return ((static_cast<uint32_t>(cell.x) * 73856093u) ^ (static_cast<uint32_t>(cell.y) * 19349663u) ^ (static_cast<uint32_t>(cell.z) * 83492791u)) & (tableSize - 1u);
+	}
+
+	/**
+	* @param device Device the grid runs on
+	* @param queue Queue used for uploads and the measured builds and queries
+	* @param shadersPath Base path of the GLSL shaders (getShadersPath())
+	* @param out Stream the report is written to
+	*/
+	void benchmarkNeighborGrid(vks::VulkanDevice* device, VkQueue queue, const std::string& shadersPath, std::ostream& out)
+	{
+		const uint32_t counts[] = { 16384, 65536, 262144, 1048576 };
+		const uint32_t runs = 5;
+		const uint32_t samples = 256;
+		// Particles per unit volume with a cell size of 1, about 33 neighbours per particle away from the borders
+		const float density = 8.0f;
+
+		std::ios_base::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+		out << std::fixed << std::setprecision(2);
+		out << "Neighbor grid: uniform particles, " << density << " per cell volume, radius = cell size, best of " << runs << " runs\n";
+		out << "  " << std::left << std::setw(12) << "particles" << std::right << std::setw(12) << "table" << std::setw(12) << "build ms" << std::setw(12)
+			<< "query ms" << std::setw(14) << "Mqueries/s" << std::setw(12) << "neighbours" << std::setw(12) << "mismatches" << "\n";
+
+		std::default_random_engine rndEngine(0);
+		for (uint32_t count : counts)
+		{
+			const float edge = std::cbrt(count / density);
+			std::uniform_real_distribution<float> rndPosition(-0.5f * edge, 0.5f * edge);
+			std::vector<NeighborGrid::Particle> particles(count);
+			for (NeighborGrid::Particle& particle : particles)
+			{
+				particle.position = glm::vec4(rndPosition(rndEngine), rndPosition(rndEngine), rndPosition(rndEngine), 1.0f);
+				particle.velocity = glm::vec4(0.0f);
+			}
+			vks::Buffer particleBuffer;
+			VK_CHECK_RESULT(device->CreateDeviceLocalBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &particleBuffer, count * sizeof(NeighborGrid::Particle), particles.data(), queue));
+
+			NeighborGrid grid;
+			grid.prepare(device, VK_NULL_HANDLE, shadersPath, count);
+			grid.setParticles(particleBuffer.descriptorBufferInfo, count);
+			grid.setCellSize(1.0f);
+
+			// Query: neighbour count of every sorted particle, the output is bound at set 0 and the grid at set 1
+			vks::Buffer neighborCountBuffer;
+			VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&neighborCountBuffer, count * sizeof(uint32_t)));
+			VkDescriptorPool descriptorPool;
+			std::vector<VkDescriptorPoolSize> poolSizes = { vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1) };
+			VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::GenDescriptorPoolCreateInfo(poolSizes, 1);
+			VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+			std::vector<VkDescriptorSetLayoutBinding> bindings = {
+				vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			};
+			VkDescriptorSetLayoutCreateInfo layoutInfo = vks::initializers::GenDescriptorSetLayoutCreateInfo(bindings);
+			VkDescriptorSetLayout outputSetLayout;
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &layoutInfo, nullptr, &outputSetLayout));
+			VkDescriptorSetAllocateInfo allocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &outputSetLayout, 1);
+			VkDescriptorSet outputSet;
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &outputSet));
+			VkWriteDescriptorSet writeDescriptorSet = vks::initializers::GenWriteDescriptorSet(outputSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &neighborCountBuffer.descriptorBufferInfo);
+			vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+
+			const VkDescriptorSetLayout setLayouts[] = { outputSetLayout, grid.querySetLayout };
+			VkPipelineLayoutCreateInfo pipelineLayoutInfo = vks::initializers::GenPipelineLayoutCreateInfo(setLayouts, 2);
+			VkPipelineLayout queryPipelineLayout;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutInfo, nullptr, &queryPipelineLayout));
+			VkComputePipelineCreateInfo pipelineInfo = vks::initializers::GenComputePipelineCreateInfo(queryPipelineLayout);
+			pipelineInfo.stage = vks::tools::loadShaderStage(shadersPath + "neighborgrid/grid_query.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT, device->logicalDevice);
+			VkPipeline queryPipeline;
+			VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &queryPipeline));
+			vkDestroyShaderModule(device->logicalDevice, pipelineInfo.stage.module, nullptr);
+
+			vks::GpuTimer gpuTimer;
+			gpuTimer.create(device, 2);
+			double buildMs = 1e30, queryMs = 1e30;
+			// The first run warms up and is not measured
+			for (uint32_t run = 0; run <= runs; run++)
+			{
+				VkCommandBuffer commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+				gpuTimer.reset(commandBuffer);
+				uint32_t scope = gpuTimer.beginScope(commandBuffer, "Build");
+				grid.recordBuild(commandBuffer);
+				gpuTimer.endScope(commandBuffer, scope);
+				scope = gpuTimer.beginScope(commandBuffer, "Query");
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, queryPipeline);
+				const VkDescriptorSet sets[] = { outputSet, grid.querySet };
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, queryPipelineLayout, 0, 2, sets, 0, nullptr);
+				vkCmdDispatch(commandBuffer, (count + particleGroupSize - 1) / particleGroupSize, 1, 1);
+				gpuTimer.endScope(commandBuffer, scope);
+				device->FlushCommandBuffer(commandBuffer, queue, true);
+				gpuTimer.collect(true);
+				if (run > 0)
+				{
+					buildMs = std::min(buildMs, gpuTimer.getMilliseconds("Build"));
+					queryMs = std::min(queryMs, gpuTimer.getMilliseconds("Query"));
+				}
+			}//for
+
+			// Brute force counts for evenly spaced sorted particles
+			vks::Buffer sortedReadback, countReadback;
+			VK_CHECK_RESULT(device->CreateHostBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, vks::HostAccess::Readback, &sortedReadback, count * sizeof(NeighborGrid::Particle)));
+			VK_CHECK_RESULT(device->CreateHostBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, vks::HostAccess::Readback, &countReadback, count * sizeof(uint32_t)));
+			VkBufferCopy copyRegion = { 0, 0, count * sizeof(NeighborGrid::Particle) };
+			device->CopyBuffer(&grid.sortedBuffer, &sortedReadback, queue, &copyRegion);
+			copyRegion.size = count * sizeof(uint32_t);
+			device->CopyBuffer(&neighborCountBuffer, &countReadback, queue, &copyRegion);
+			sortedReadback.invalidate();
+			countReadback.invalidate();
+			const NeighborGrid::Particle* sorted = static_cast<const NeighborGrid::Particle*>(sortedReadback.mappedData);
+			const uint32_t* neighborCounts = static_cast<const uint32_t*>(countReadback.mappedData);
+			uint64_t neighborSum = 0;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				neighborSum += neighborCounts[i];
+			}
+			uint32_t mismatches = 0;
+			for (uint32_t sample = 0; sample < samples; sample++)
+			{
+				const uint32_t i = static_cast<uint32_t>(static_cast<uint64_t>(sample) * count / samples);
+				const glm::vec3 position = glm::vec3(sorted[i].position);
+				uint32_t expected = 0;
+				for (uint32_t j = 0; j < count; j++)
+				{
+					const glm::vec3 d = glm::vec3(sorted[j].position) - position;
+					expected += ((j != i) && (glm::dot(d, d) < 1.0f)) ? 1 : 0;
+				}
+				mismatches += (expected != neighborCounts[i]) ? 1 : 0;
+			}//for
+
+			out << "  " << std::left << std::setw(12) << count << std::right << std::setw(12) << grid.params.tableSize;
+			if (gpuTimer.supported)
+			{
+				out << std::setw(12) << buildMs << std::setw(12) << queryMs << std::setw(14) << count / (queryMs * 1000.0);
+			}
+			else
+			{
+				out << std::setw(12) << "-" << std::setw(12) << "-" << std::setw(14) << "-";
+			}
+			out << std::setw(12) << static_cast<double>(neighborSum) / count << std::setw(12) << mismatches << "\n";
+
+			sortedReadback.destroy();
+			countReadback.destroy();
+			gpuTimer.destroy();
+			vkDestroyPipeline(device->logicalDevice, queryPipeline, nullptr);
+			vkDestroyPipelineLayout(device->logicalDevice, queryPipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device->logicalDevice, outputSetLayout, nullptr);
+			vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+			neighborCountBuffer.destroy();
+			grid.destroy();
+			particleBuffer.destroy();
+		}//for
+		out << "  mismatches: of " << samples << " particles per count compared with brute force\n";
+		out.flags(flags);
+		out.precision(precision);
+	}
+}//vks
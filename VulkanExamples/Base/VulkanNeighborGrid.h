@@ -0,0 +1,124 @@
+/*
+* GPU neighbor search
+*
+* Sorts particles into a uniform grid on the GPU for short range interactions (fluids, collisions) that only look at particles
+* within one cell size. Cells are hashed into a fixed size table, so the grid has no bounds. A counting sort builds the table:
+* particles are counted per cell, the counts are prefix summed into cell offsets and the particles are scattered into a copy
+* ordered by cell, so the particles of neighbouring cells are close in memory. Queries walk the 27 cells around a position
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	/**
+	* @brief Uniform grid over particles with cell hashing and a counting sort, rebuilt from scratch by every recordBuild
+	* @note Query shaders include neighborgrid/grid.glsl and bind querySet at GRID_SET
+	*/
+	class NeighborGrid
+	{
+	public:
+		/** @brief Particle layout the grid reads and writes (std430), the position is the xyz of the first vec4 */
+		struct Particle
+		{
+			glm::vec4 position;
+			glm::vec4 velocity;
+		};
+
+		/** @brief Uniform block of the build and query shaders (std140), see neighborgrid/grid_common.glsl */
+		struct Params
+		{
+			float cellSize;
+			uint32_t particleCount;
+			uint32_t tableSize;
+			uint32_t padding;
+		} params{};
+
+		/** @brief Cells the scan can sum: 256 blocks of 1024 cells */
+		static const uint32_t maxTableSize = 262144;
+
+		vks::VulkanDevice* device = nullptr;
+		/** @brief Capacity of the sorted copy, recordBuild sorts up to this many particles */
+		uint32_t maxParticles = 0;
+
+		vks::Buffer uniformBuffer;
+		/** @brief Particles per cell, index = cell hash */
+		vks::Buffer cellCountBuffer;
+		/** @brief Index of the first particle of every cell in sortedBuffer */
+		vks::Buffer cellStartBuffer;
+		/** @brief Cell hash and rank inside the cell of every input particle */
+		vks::Buffer particleCellBuffer;
+		/** @brief Sums of the 1024 cell blocks of the scan */
+		vks::Buffer blockSumBuffer;
+		/** @brief The particles in cell order */
+		vks::Buffer sortedBuffer;
+		/** @brief Input index of every sorted particle */
+		vks::Buffer sortedIndexBuffer;
+
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		/** @brief Layout used by the build shaders */
+		VkDescriptorSetLayout buildSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSet buildSet = VK_NULL_HANDLE;
+		/** @brief Layout and set to bind from query shaders: parameters, cell starts, cell counts and the sorted particles */
+		VkDescriptorSetLayout querySetLayout = VK_NULL_HANDLE;
+		VkDescriptorSet querySet = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipelineCount = VK_NULL_HANDLE;
+		VkPipeline pipelineScan = VK_NULL_HANDLE;
+		VkPipeline pipelineScatter = VK_NULL_HANDLE;
+
+		/**
+		* @brief Create the buffers and pipelines for up to maxParticles particles
+		* @param tableSize Hash table cells, rounded to a power of two between 1024 and maxTableSize. 0 picks twice the particle count
+		*/
+		void prepare(vks::VulkanDevice* device, VkPipelineCache pipelineCache, const std::string& shadersPath, uint32_t maxParticles, uint32_t tableSize = 0);
+		void destroy();
+
+		/** @brief Set the buffer the particles are sorted from, the particles must have the Particle layout */
+		void setParticles(const VkDescriptorBufferInfo& particles, uint32_t particleCount);
+		/** @brief Edge length of a cell, queries find all particles within this distance */
+		void setCellSize(float cellSize);
+
+		/**
+		* @brief Record clearing, counting, scanning and scattering
+		* @note The input particles must be visible to compute shader reads, the sorted particles and cell ranges are visible to compute
+		* shader reads afterwards
+		*/
+		void recordBuild(VkCommandBuffer commandBuffer);
+
+		/** @brief Cell of a position, matches gridCell of neighborgrid/grid_common.glsl */
+		static glm::ivec3 cell(const glm::vec3& position, float cellSize);
+		/** @brief Table index of a cell, matches gridHash of neighborgrid/grid_common.glsl */
+		static uint32_t hash(const glm::ivec3& cell, uint32_t tableSize);
+
+	private:
+		struct PushConstants
+		{
+			uint32_t pass;
+		};
+
+		void setupDescriptors();
+		void preparePipelines(VkPipelineCache pipelineCache, const std::string& shadersPath);
+	};
+
+	/**
+	* @brief Builds the grid over uniformly distributed particles of increasing count, counts the neighbours of every particle
+	* with a query shader and reports build time and queries per second. The counts of a sample are checked against brute force
+	*/
+	void benchmarkNeighborGrid(vks::VulkanDevice* device, VkQueue queue, const std::string& shadersPath, std::ostream& out);
+}//vks
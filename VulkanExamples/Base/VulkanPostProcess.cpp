@@ -0,0 +1,622 @@
+/*
+* Compute post processing stack
+*
+* Dual filter bloom over a half resolution mip chain, luminance histogram auto exposure and
+* tone mapping fused with the final bloom upsample, all recorded as one sequence of compute dispatches
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanPostProcess.h"
+
+#include <iomanip>
+#include <sstream>
+
+namespace vks
+{
+	namespace
+	{
+		/** @brief Per dispatch push constants, matches the PushConsts block of the postprocess shaders */
+		struct PushConstants
+		{
+			glm::vec2 srcTexelSize;
+			uint32_t prefilter;
+			uint32_t _pad;
+		};
+
+		const uint32_t histogramBinCount = 256;
+		const uint32_t filterGroupSize = 8;
+		const uint32_t histogramGroupSize = 16;
+		// Bit pattern of 1.0f, used to initialize the adapted luminance and exposure
+		const uint32_t oneFloatBits = 0x3F800000;
+
+		uint32_t groupCount(uint32_t size, uint32_t groupSize)
+		{
+			return (size + groupSize - 1) / groupSize;
+		}
+
+		/** @brief Timer scopes recorded by PostProcessStack::record, in recording order */
+		const char* const passNames[] = { "Histogram", "Bloom downsample", "Exposure", "Bloom upsample", "Tonemap" };
+		const uint32_t passCount = sizeof(passNames) / sizeof(passNames[0]);
+
+		/** @brief Device local HDR image for the benchmark, left in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL */
+		struct BenchmarkInput
+		{
+			VkImage image = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+		};
+
+		/**
+		* Upload a synthetic HDR frame: a dim gradient with a grid of small, very bright highlights, so the bloom threshold
+		* and the luminance histogram see a realistic spread of values
+		*/
+		BenchmarkInput createBenchmarkInput(vks::VulkanDevice* device, VkQueue queue, uint32_t width, uint32_t height)
+		{
+			BenchmarkInput input;
+			VkDevice logicalDevice = device->logicalDevice;
+			VkImageCreateInfo imageInfo = vks::initializers::GenImageCreateInfo();
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+			imageInfo.extent = { width, height, 1 };
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			VK_CHECK_RESULT(vkCreateImage(logicalDevice, &imageInfo, nullptr, &input.image));
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(logicalDevice, input.image, &memReqs);
+			VkMemoryAllocateInfo memAlloc = vks::initializers::GenMemoryAllocateInfo();
+			memAlloc.allocationSize = memReqs.size;
+			memAlloc.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &input.memory));
+			VK_CHECK_RESULT(vkBindImageMemory(logicalDevice, input.image, input.memory, 0));
+
+			// Two packed half pairs per pixel
+			std::vector<uint32_t> pixels(static_cast<size_t>(width) * height * 2);
+			for (uint32_t y = 0; y < height; y++)
+			{
+				for (uint32_t x = 0; x < width; x++)
+				{
+					glm::vec4 color(0.05f + 0.5f * x / width, 0.05f + 0.3f * y / height, 0.1f, 1.0f);
+					if (x % 128 < 4 && y % 128 < 4)
+					{
+						color = glm::vec4(40.0f, 32.0f, 24.0f, 1.0f);
+					}
+					const size_t index = (static_cast<size_t>(y) * width + x) * 2;
+					pixels[index] = glm::packHalf2x16(glm::vec2(color.x, color.y));
+					pixels[index + 1] = glm::packHalf2x16(glm::vec2(color.z, color.w));
+				}
+			}//for
+			vks::Buffer staging;
+			VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&staging, pixels.size() * sizeof(uint32_t), pixels.data()));
+
+			VkCommandBuffer commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			const VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+			vks::tools::setImageLayout(commandBuffer, input.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, range);
+			VkBufferImageCopy region{};
+			region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			region.imageExtent = { width, height, 1 };
+			vkCmdCopyBufferToImage(commandBuffer, staging.buffer, input.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+			vks::tools::setImageLayout(commandBuffer, input.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, range);
+			device->FlushCommandBuffer(commandBuffer, queue, true);
+			staging.destroy();
+
+			VkImageViewCreateInfo viewInfo = vks::initializers::GenImageViewCreateInfo();
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = imageInfo.format;
+			viewInfo.subresourceRange = range;
+			viewInfo.image = input.image;
+			VK_CHECK_RESULT(vkCreateImageView(logicalDevice, &viewInfo, nullptr, &input.view));
+			return input;
+		}
+
+		void destroyBenchmarkInput(VkDevice logicalDevice, BenchmarkInput& input)
+		{
+			vkDestroyImageView(logicalDevice, input.view, nullptr);
+			vkDestroyImage(logicalDevice, input.image, nullptr);
+			vkFreeMemory(logicalDevice, input.memory, nullptr);
+		}
+	}
+
+	bool PostProcessStack::subgroupArithmeticSupported(uint32_t apiVersion) const
+	{
+		if (apiVersion < VK_API_VERSION_1_1 || device->properties.apiVersion < VK_API_VERSION_1_1)
+		{
+			return false;
+		}
+		VkPhysicalDeviceSubgroupProperties subgroupProperties{};
+		subgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+		VkPhysicalDeviceProperties2 properties2{};
+		properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties2.pNext = &subgroupProperties;
+		vkGetPhysicalDeviceProperties2(device->physicalDevice, &properties2);
+		return (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT)
+			&& (subgroupProperties.supportedOperations & VK_SUBGROUP_FEATURE_ARITHMETIC_BIT);
+	}
+
+	/**
+	* Create the pipelines and size independent buffers
+	*
+	* @param device Device to create the resources on
+	* @param queue Queue used to initialize the histogram and exposure buffers
+	* @param pipelineCache Pipeline cache used for the compute pipelines
+	* @param shadersPath Base path of the GLSL shaders (getShadersPath())
+	* @param apiVersion Instance API version, subgroup reductions are only used with Vulkan 1.1 or newer
+	* @param frameCount Number of command buffers the stack gets recorded into, used for the GPU timer query ranges
+	*/
+	void PostProcessStack::prepare(vks::VulkanDevice* device, VkQueue queue, VkPipelineCache pipelineCache, const std::string& shadersPath, uint32_t apiVersion, uint32_t frameCount)
+	{
+		this->device = device;
+		subgroupsEnabled = settings.useSubgroups && subgroupArithmeticSupported(apiVersion);
+
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&paramsBuffer, sizeof(Params)));
+		VK_CHECK_RESULT(paramsBuffer.map());
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&histogramBuffer, histogramBinCount * sizeof(uint32_t)));
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&exposureBuffer, 2 * sizeof(float)));
+
+		// The exposure pass clears the histogram after reading it, so it only needs to be cleared once here
+		VkCommandBuffer commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		vkCmdFillBuffer(commandBuffer, histogramBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+		vkCmdFillBuffer(commandBuffer, exposureBuffer.buffer, 0, VK_WHOLE_SIZE, oneFloatBits);
+		device->FlushCommandBuffer(commandBuffer, queue);
+
+		VkSamplerCreateInfo samplerInfo = vks::initializers::GenSamplerCreateInfo();
+		samplerInfo.magFilter = VK_FILTER_LINEAR;
+		samplerInfo.minFilter = VK_FILTER_LINEAR;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = samplerInfo.addressModeU;
+		samplerInfo.addressModeW = samplerInfo.addressModeU;
+		samplerInfo.maxAnisotropy = 1.0f;
+		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerInfo, nullptr, &sampler));
+
+		// A single layout shared by all passes, each pass only writes the bindings it uses
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 5),
+		};
+		VkDescriptorSetLayoutCreateInfo layoutInfo = vks::initializers::GenDescriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &layoutInfo, nullptr, &descriptorSetLayout));
+
+		VkPushConstantRange pushConstantRange = vks::initializers::GenPushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PushConstants), 0);
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = vks::initializers::GenPipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+
+		// Sets for the down- and upsample chain plus histogram, exposure and tone mapping
+		const uint32_t maxSets = settings.bloomMips * 2 + 3;
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, maxSets),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxSets + 1),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, maxSets),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4),
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::GenDescriptorPoolCreateInfo(poolSizes, maxSets);
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+
+		auto createPipeline = [&](const std::string& fileName, VkPipeline* pipeline)
+		{
+			VkComputePipelineCreateInfo pipelineInfo = vks::initializers::GenComputePipelineCreateInfo(pipelineLayout);
+			pipelineInfo.stage = vks::tools::loadShaderStage(shadersPath + "postprocess/" + fileName, VK_SHADER_STAGE_COMPUTE_BIT, device->logicalDevice);
+			VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, pipeline));
+			vkDestroyShaderModule(device->logicalDevice, pipelineInfo.stage.module, nullptr);
+		};
+		createPipeline("bloom_downsample.comp.spv", &pipelines.downsample);
+		createPipeline("bloom_upsample.comp.spv", &pipelines.upsample);
+		createPipeline("histogram.comp.spv", &pipelines.histogram);
+		// The subgroup variant is SPIR-V 1.3 and can only be loaded on Vulkan 1.1 devices
+		createPipeline(subgroupsEnabled ? "exposure_subgroup.comp.spv" : "exposure.comp.spv", &pipelines.exposure);
+		createPipeline("tonemap.comp.spv", &pipelines.tonemap);
+
+		gpuTimer.create(device, 5, frameCount);
+
+		update(0.0f);
+	}
+
+	/**
+	* (Re)create the resolution dependent images and descriptor sets for an input
+	*
+	* @param hdrView HDR color input, must be in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL when the stack is executed
+	* @param width Width of the input in pixels
+	* @param height Height of the input in pixels
+	*/
+	void PostProcessStack::setInput(VkImageView hdrView, uint32_t width, uint32_t height)
+	{
+		destroySizeDependent();
+		inputView = hdrView;
+		this->width = width;
+		this->height = height;
+
+		// Bloom mip chain starts at half resolution
+		bloom.mipSizes.clear();
+		VkExtent2D mipSize = { std::max(width / 2, 1u), std::max(height / 2, 1u) };
+		for (uint32_t i = 0; i < settings.bloomMips; i++)
+		{
+			bloom.mipSizes.push_back(mipSize);
+			if (mipSize.width == 1 && mipSize.height == 1)
+			{
+				break;
+			}
+			mipSize = { std::max(mipSize.width / 2, 1u), std::max(mipSize.height / 2, 1u) };
+		}//for
+		const uint32_t mipCount = static_cast<uint32_t>(bloom.mipSizes.size());
+
+		auto createImage = [&](VkFormat format, uint32_t imageWidth, uint32_t imageHeight, uint32_t mipLevels, VkImageUsageFlags usage, VkImage* image, VkDeviceMemory* memory)
+		{
+			VkImageCreateInfo imageInfo = vks::initializers::GenImageCreateInfo();
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.format = format;
+			imageInfo.extent = { imageWidth, imageHeight, 1 };
+			imageInfo.mipLevels = mipLevels;
+			imageInfo.arrayLayers = 1;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.usage = usage;
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageInfo, nullptr, image));
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(device->logicalDevice, *image, &memReqs);
+			VkMemoryAllocateInfo memAlloc = vks::initializers::GenMemoryAllocateInfo();
+			memAlloc.allocationSize = memReqs.size;
+			memAlloc.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, memory));
+			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, *image, *memory, 0));
+		};
+
+		// Storage support for both formats is mandatory
+		createImage(VK_FORMAT_R16G16B16A16_SFLOAT, bloom.mipSizes[0].width, bloom.mipSizes[0].height, mipCount,
+			VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, &bloom.image, &bloom.memory);
+		createImage(VK_FORMAT_R8G8B8A8_UNORM, width, height, 1,
+			VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, &output.image, &output.memory);
+
+		VkImageViewCreateInfo viewInfo = vks::initializers::GenImageViewCreateInfo();
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+		viewInfo.image = bloom.image;
+		bloom.mipViews.resize(mipCount);
+		for (uint32_t i = 0; i < mipCount; i++)
+		{
+			viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1 };
+			VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewInfo, nullptr, &bloom.mipViews[i]));
+		}
+		viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+		viewInfo.image = output.image;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewInfo, nullptr, &output.view));
+		output.descriptor = vks::initializers::GenDescriptorImageInfo(sampler, output.view, VK_IMAGE_LAYOUT_GENERAL);
+
+		// Descriptor sets
+		VK_CHECK_RESULT(vkResetDescriptorPool(device->logicalDevice, descriptorPool, 0));
+		auto allocateSet = [&]()
+		{
+			VkDescriptorSet set;
+			VkDescriptorSetAllocateInfo allocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &set));
+			return set;
+		};
+		// Image infos must stay alive until the update, so they are collected up front
+		std::vector<VkDescriptorImageInfo> imageInfos;
+		imageInfos.reserve(mipCount * 4 + 4);
+		std::vector<VkWriteDescriptorSet> writes;
+		auto writeImage = [&](VkDescriptorSet set, VkDescriptorType type, uint32_t binding, VkImageView view, VkImageLayout layout)
+		{
+			imageInfos.push_back(vks::initializers::GenDescriptorImageInfo(sampler, view, layout));
+			writes.push_back(vks::initializers::GenWriteDescriptorSet(set, type, binding, &imageInfos.back()));
+		};
+		auto writeBuffer = [&](VkDescriptorSet set, VkDescriptorType type, uint32_t binding, vks::Buffer& buffer)
+		{
+			writes.push_back(vks::initializers::GenWriteDescriptorSet(set, type, binding, &buffer.descriptorBufferInfo));
+		};
+
+		descriptorSets.downsample.resize(mipCount);
+		for (uint32_t i = 0; i < mipCount; i++)
+		{
+			VkDescriptorSet set = allocateSet();
+			descriptorSets.downsample[i] = set;
+			writeBuffer(set, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, paramsBuffer);
+			if (i == 0)
+			{
+				writeImage(set, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, inputView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			}
+			else
+			{
+				writeImage(set, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, bloom.mipViews[i - 1], VK_IMAGE_LAYOUT_GENERAL);
+			}
+			writeImage(set, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2, bloom.mipViews[i], VK_IMAGE_LAYOUT_GENERAL);
+		}//for
+		descriptorSets.upsample.resize(mipCount - 1);
+		for (uint32_t i = 0; i + 1 < mipCount; i++)
+		{
+			VkDescriptorSet set = allocateSet();
+			descriptorSets.upsample[i] = set;
+			writeBuffer(set, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, paramsBuffer);
+			writeImage(set, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, bloom.mipViews[i + 1], VK_IMAGE_LAYOUT_GENERAL);
+			writeImage(set, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2, bloom.mipViews[i], VK_IMAGE_LAYOUT_GENERAL);
+		}//for
+
+		descriptorSets.histogram = allocateSet();
+		writeBuffer(descriptorSets.histogram, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, paramsBuffer);
+		writeImage(descriptorSets.histogram, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, inputView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		writeBuffer(descriptorSets.histogram, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, histogramBuffer);
+
+		descriptorSets.exposure = allocateSet();
+		writeBuffer(descriptorSets.exposure, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, paramsBuffer);
+		writeBuffer(descriptorSets.exposure, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, histogramBuffer);
+		writeBuffer(descriptorSets.exposure, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, exposureBuffer);
+
+		descriptorSets.tonemap = allocateSet();
+		writeBuffer(descriptorSets.tonemap, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, paramsBuffer);
+		writeImage(descriptorSets.tonemap, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, inputView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		writeImage(descriptorSets.tonemap, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2, output.view, VK_IMAGE_LAYOUT_GENERAL);
+		writeBuffer(descriptorSets.tonemap, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, exposureBuffer);
+		writeImage(descriptorSets.tonemap, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 5, bloom.mipViews[0], VK_IMAGE_LAYOUT_GENERAL);
+
+		vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+		update(0.0f);
+	}
+
+	void PostProcessStack::destroySizeDependent()
+	{
+		if (bloom.image == VK_NULL_HANDLE)
+		{
+			return;
+		}
+		for (VkImageView view : bloom.mipViews)
+		{
+			vkDestroyImageView(device->logicalDevice, view, nullptr);
+		}
+		bloom.mipViews.clear();
+		vkDestroyImage(device->logicalDevice, bloom.image, nullptr);
+		vkFreeMemory(device->logicalDevice, bloom.memory, nullptr);
+		vkDestroyImageView(device->logicalDevice, output.view, nullptr);
+		vkDestroyImage(device->logicalDevice, output.image, nullptr);
+		vkFreeMemory(device->logicalDevice, output.memory, nullptr);
+		bloom.image = VK_NULL_HANDLE;
+		output.image = VK_NULL_HANDLE;
+	}
+
+	void PostProcessStack::destroy()
+	{
+		if (!device)
+		{
+			return;
+		}
+		destroySizeDependent();
+		VkDevice logicalDevice = device->logicalDevice;
+		vkDestroyPipeline(logicalDevice, pipelines.downsample, nullptr);
+		vkDestroyPipeline(logicalDevice, pipelines.upsample, nullptr);
+		vkDestroyPipeline(logicalDevice, pipelines.histogram, nullptr);
+		vkDestroyPipeline(logicalDevice, pipelines.exposure, nullptr);
+		vkDestroyPipeline(logicalDevice, pipelines.tonemap, nullptr);
+		vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+		vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+		vkDestroySampler(logicalDevice, sampler, nullptr);
+		paramsBuffer.destroy();
+		histogramBuffer.destroy();
+		exposureBuffer.destroy();
+		gpuTimer.destroy();
+		device = nullptr;
+	}
+
+	/**
+	* Update the shader parameters, call once per frame (prebuilt command buffers pick up the new values)
+	*
+	* @param deltaTime Frame time in seconds, drives the exposure adaptation
+	*/
+	void PostProcessStack::update(float deltaTime)
+	{
+		Params params;
+		params.bloomThreshold = settings.bloomThreshold;
+		params.bloomKnee = settings.bloomKnee;
+		params.bloomIntensity = settings.bloomIntensity;
+		params.exposure = settings.exposure;
+		params.minLogLuminance = settings.minLogLuminance;
+		params.logLuminanceRange = settings.maxLogLuminance - settings.minLogLuminance;
+		params.deltaTime = deltaTime;
+		params.adaptationRate = settings.adaptationRate;
+		params.autoExposure = settings.autoExposure ? 1 : 0;
+		params.pixelCount = width * height;
+		memcpy(paramsBuffer.mappedData, &params, sizeof(Params));
+	}
+
+	/**
+	* Record the complete post processing chain
+	*
+	* @note The input must be in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, the output is left in VK_IMAGE_LAYOUT_GENERAL
+	* and is visible to fragment shader reads and transfers afterwards
+	*/
+	void PostProcessStack::record(VkCommandBuffer commandBuffer)
+	{
+		const uint32_t mipCount = static_cast<uint32_t>(bloom.mipSizes.size());
+		gpuTimer.reset(commandBuffer);
+
+		// Both images are completely rewritten every frame, so their previous contents can be discarded
+		std::array<VkImageMemoryBarrier, 2> imageBarriers;
+		for (VkImageMemoryBarrier& barrier : imageBarriers)
+		{
+			barrier = vks::initializers::GenImageMemoryBarrier();
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		}
+		imageBarriers[0].image = bloom.image;
+		imageBarriers[0].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipCount, 0, 1 };
+		imageBarriers[1].image = output.image;
+		imageBarriers[1].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		// The memory barrier orders the histogram clear of the previous frame's exposure pass before this frame's histogram
+		VkMemoryBarrier computeBarrier = vks::initializers::GenMemoryBarrier();
+		computeBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		computeBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeBarrier, 0, nullptr, static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+
+		auto dispatchBarrier = [&]()
+		{
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeBarrier, 0, nullptr, 0, nullptr);
+		};
+		auto dispatch = [&](VkPipeline pipeline, VkDescriptorSet set, const PushConstants& pushConstants, uint32_t x, uint32_t y)
+		{
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &set, 0, nullptr);
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+			vkCmdDispatch(commandBuffer, x, y, 1);
+		};
+
+		// Auto exposure first, it only depends on the input and can overlap with the first downsample
+		if (settings.autoExposure)
+		{
+			uint32_t scope = gpuTimer.beginScope(commandBuffer, "Histogram");
+			dispatch(pipelines.histogram, descriptorSets.histogram, PushConstants{}, groupCount(width, histogramGroupSize), groupCount(height, histogramGroupSize));
+			gpuTimer.endScope(commandBuffer, scope);
+		}
+
+		uint32_t scope = gpuTimer.beginScope(commandBuffer, "Bloom downsample");
+		for (uint32_t i = 0; i < mipCount; i++)
+		{
+			PushConstants pushConstants{};
+			pushConstants.srcTexelSize = i == 0 ? glm::vec2(1.0f / width, 1.0f / height)
+				: glm::vec2(1.0f / bloom.mipSizes[i - 1].width, 1.0f / bloom.mipSizes[i - 1].height);
+			// The first pass applies the threshold and a firefly reducing weighted average
+			pushConstants.prefilter = i == 0 ? 1 : 0;
+			dispatch(pipelines.downsample, descriptorSets.downsample[i], pushConstants, groupCount(bloom.mipSizes[i].width, filterGroupSize), groupCount(bloom.mipSizes[i].height, filterGroupSize));
+			dispatchBarrier();
+		}//for
+		gpuTimer.endScope(commandBuffer, scope);
+
+		if (settings.autoExposure)
+		{
+			scope = gpuTimer.beginScope(commandBuffer, "Exposure");
+			dispatch(pipelines.exposure, descriptorSets.exposure, PushConstants{}, 1, 1);
+			dispatchBarrier();
+			gpuTimer.endScope(commandBuffer, scope);
+		}
+
+		// Upsample and accumulate back up to mip 1, the last upsample to full resolution is fused with tone mapping
+		scope = gpuTimer.beginScope(commandBuffer, "Bloom upsample");
+		for (int32_t i = static_cast<int32_t>(mipCount) - 2; i >= 0; i--)
+		{
+			PushConstants pushConstants{};
+			pushConstants.srcTexelSize = glm::vec2(1.0f / bloom.mipSizes[i + 1].width, 1.0f / bloom.mipSizes[i + 1].height);
+			dispatch(pipelines.upsample, descriptorSets.upsample[i], pushConstants, groupCount(bloom.mipSizes[i].width, filterGroupSize), groupCount(bloom.mipSizes[i].height, filterGroupSize));
+			dispatchBarrier();
+		}//for
+		gpuTimer.endScope(commandBuffer, scope);
+
+		scope = gpuTimer.beginScope(commandBuffer, "Tonemap");
+		PushConstants pushConstants{};
+		pushConstants.srcTexelSize = glm::vec2(1.0f / bloom.mipSizes[0].width, 1.0f / bloom.mipSizes[0].height);
+		dispatch(pipelines.tonemap, descriptorSets.tonemap, pushConstants, groupCount(width, filterGroupSize), groupCount(height, filterGroupSize));
+		gpuTimer.endScope(commandBuffer, scope);
+
+		VkMemoryBarrier outputBarrier = vks::initializers::GenMemoryBarrier();
+		outputBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		outputBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &outputBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	/**
+	* Runs the stack on synthetic HDR frames at several resolutions and reports the GPU time of each pass. If the device supports
+	* the subgroup exposure reduction, the exposure pass is timed a second time with the shared memory variant
+	*
+	* @param device Device the stack runs on
+	* @param queue Queue the frames are submitted to, every frame is waited for
+	* @param shadersPath Base path of the GLSL shaders (getShadersPath())
+	* @param apiVersion Vulkan version the instance was created with, selects the exposure variant
+	* @param out Stream the report is written to
+	* @param frames Number of timed frames per resolution
+	*/
+	void benchmarkPostProcess(vks::VulkanDevice* device, VkQueue queue, const std::string& shadersPath, uint32_t apiVersion, std::ostream& out, uint32_t frames)
+	{
+		const VkExtent2D resolutions[] = { { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 } };
+		// Frames rendered before timing, lets the exposure adapt and the clocks settle
+		const uint32_t warmupFrames = 8;
+
+		std::ios_base::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+		out << std::fixed << std::setprecision(3);
+		out << "Post processing: " << frames << " frames per resolution, average GPU ms per pass\n";
+
+		std::array<bool, 2> subgroupVariants = { true, false };
+		for (bool useSubgroups : subgroupVariants)
+		{
+			PostProcessStack stack;
+			stack.settings.useSubgroups = useSubgroups;
+			stack.prepare(device, queue, VK_NULL_HANDLE, shadersPath, apiVersion);
+			if (useSubgroups && !stack.subgroupsEnabled)
+			{
+				out << "  Subgroup arithmetic is not supported, exposure uses the shared memory reduction\n";
+			}
+			if (!useSubgroups)
+			{
+				out << "  shared memory exposure reduction\n";
+			}
+			if (!stack.gpuTimer.supported)
+			{
+				out << "  Timestamp queries are not supported, GPU times are 0\n";
+			}
+			out << "    " << std::left << std::setw(12) << "resolution";
+			for (const char* name : passNames)
+			{
+				out << std::right << std::setw(18) << name;
+			}
+			out << std::setw(10) << "total" << "\n";
+
+			for (const VkExtent2D& resolution : resolutions)
+			{
+				BenchmarkInput input = createBenchmarkInput(device, queue, resolution.width, resolution.height);
+				stack.setInput(input.view, resolution.width, resolution.height);
+				std::array<double, passCount> milliseconds{};
+				for (uint32_t frame = 0; frame < warmupFrames + frames; frame++)
+				{
+					stack.update(1.0f / 60.0f);
+					VkCommandBuffer commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+					stack.record(commandBuffer);
+					device->FlushCommandBuffer(commandBuffer, queue, true);
+					stack.gpuTimer.collect(true);
+					if (frame >= warmupFrames)
+					{
+						for (uint32_t pass = 0; pass < passCount; pass++)
+						{
+							milliseconds[pass] += stack.gpuTimer.getMilliseconds(passNames[pass]);
+						}
+					}
+				}//for
+
+				std::ostringstream name;
+				name << resolution.width << "x" << resolution.height;
+				out << "    " << std::left << std::setw(12) << name.str() << std::right;
+				double total = 0.0;
+				for (uint32_t pass = 0; pass < passCount; pass++)
+				{
+					out << std::setw(18) << milliseconds[pass] / frames;
+					total += milliseconds[pass] / frames;
+				}
+				out << std::setw(10) << total << "\n";
+				destroyBenchmarkInput(device->logicalDevice, input);
+			}//for
+			stack.destroy();
+			// Without subgroup support both runs would use the same exposure shader
+			if (useSubgroups && !stack.subgroupsEnabled)
+			{
+				break;
+			}
+		}//for
+		out.flags(flags);
+		out.precision(precision);
+	}
+}//vks
@@ -0,0 +1,135 @@
+/*
+* Compute post processing stack
+*
+* Dual filter bloom over a half resolution mip chain, luminance histogram auto exposure and
+* tone mapping fused with the final bloom upsample, all recorded as one sequence of compute dispatches
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanGpuTimer.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	class PostProcessStack
+	{
+	public:
+		struct Settings
+		{
+			/** @brief Number of bloom mip levels below the input resolution */
+			uint32_t bloomMips = 6;
+			float bloomThreshold = 1.0f;
+			/** @brief Width of the soft threshold knee, relative to the threshold */
+			float bloomKnee = 0.5f;
+			float bloomIntensity = 0.05f;
+			bool autoExposure = true;
+			/** @brief Exposure used when autoExposure is disabled */
+			float exposure = 1.0f;
+			float minLogLuminance = -8.0f;
+			float maxLogLuminance = 4.0f;
+			/** @brief Speed at which the auto exposure adapts to luminance changes */
+			float adaptationRate = 1.5f;
+			/** @brief Use subgroup arithmetic for the exposure reduction, requires Vulkan 1.1 and is disabled if unsupported */
+			bool useSubgroups = true;
+		} settings;
+
+		/** @brief Uniform block shared by all post processing shaders (std140) */
+		struct Params
+		{
+			float bloomThreshold;
+			float bloomKnee;
+			float bloomIntensity;
+			float exposure;
+			float minLogLuminance;
+			float logLuminanceRange;
+			float deltaTime;
+			float adaptationRate;
+			uint32_t autoExposure;
+			uint32_t pixelCount;
+		};
+
+		vks::VulkanDevice* device = nullptr;
+
+		/** @brief Tone mapped result (RGBA8, gamma encoded) in VK_IMAGE_LAYOUT_GENERAL, sample it or copy it to the swap chain */
+		struct
+		{
+			VkImage image = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+			VkDescriptorImageInfo descriptor{};
+		} output;
+
+		struct
+		{
+			VkImage image = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			std::vector<VkImageView> mipViews;
+			std::vector<VkExtent2D> mipSizes;
+		} bloom;
+
+		vks::Buffer paramsBuffer;
+		vks::Buffer histogramBuffer;
+		/** @brief Adapted average luminance and resulting exposure, kept on the GPU between frames */
+		vks::Buffer exposureBuffer;
+
+		VkSampler sampler = VK_NULL_HANDLE;
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+
+		struct
+		{
+			VkPipeline downsample = VK_NULL_HANDLE;
+			VkPipeline upsample = VK_NULL_HANDLE;
+			VkPipeline histogram = VK_NULL_HANDLE;
+			VkPipeline exposure = VK_NULL_HANDLE;
+			VkPipeline tonemap = VK_NULL_HANDLE;
+		} pipelines;
+
+		struct
+		{
+			std::vector<VkDescriptorSet> downsample;
+			std::vector<VkDescriptorSet> upsample;
+			VkDescriptorSet histogram = VK_NULL_HANDLE;
+			VkDescriptorSet exposure = VK_NULL_HANDLE;
+			VkDescriptorSet tonemap = VK_NULL_HANDLE;
+		} descriptorSets;
+
+		vks::GpuTimer gpuTimer;
+		bool subgroupsEnabled = false;
+
+		void prepare(vks::VulkanDevice* device, VkQueue queue, VkPipelineCache pipelineCache, const std::string& shadersPath, uint32_t apiVersion, uint32_t frameCount = 1);
+		void setInput(VkImageView hdrView, uint32_t width, uint32_t height);
+		void destroy();
+
+		void update(float deltaTime);
+		void record(VkCommandBuffer commandBuffer);
+
+	private:
+		VkImageView inputView = VK_NULL_HANDLE;
+		uint32_t width = 0;
+		uint32_t height = 0;
+
+		void destroySizeDependent();
+		bool subgroupArithmeticSupported(uint32_t apiVersion) const;
+	};
+
+	/** @brief Times every pass of the stack on synthetic HDR frames at 720p to 2160p, with and without the subgroup exposure reduction */
+	void benchmarkPostProcess(vks::VulkanDevice* device, VkQueue queue, const std::string& shadersPath, uint32_t apiVersion, std::ostream& out, uint32_t frames = 120);
+}//vks
@@ -0,0 +1,294 @@
+/*
+* GPU to CPU readback
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanReadback.h"
+
+#include <algorithm>
+#include <memory>
+
+namespace vks
+{
+	namespace
+	{
+		VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+		{
+			return ((value + alignment - 1) / alignment) * alignment;
+		}
+	}
+
+	/**
+	* Create the readback buffers, command buffers and fences
+	*
+	* @param device Device the copies run on
+	* @param queueFamilyIndex Family of the queue passed to submit
+	* @param frameCount Number of frames whose copies can be in flight at the same time
+	* @param frameCapacity Bytes that can be read back per frame
+	*/
+	void ReadbackManager::create(vks::VulkanDevice* device, uint32_t queueFamilyIndex, uint32_t frameCount, VkDeviceSize frameCapacity)
+	{
+		this->device = device;
+		this->frameCount = std::max(frameCount, 1u);
+		this->frameCapacity = frameCapacity;
+		currentFrame = 0;
+		counters = Statistics();
+		// Offsets are aligned for buffer to image copies and for invalidating non coherent memory
+		alignment = std::max<VkDeviceSize>(16, device->properties.limits.nonCoherentAtomSize);
+
+		commandPool = device->CreateCommandPool(queueFamilyIndex);
+		VkFenceCreateInfo fenceInfo = vks::initializers::GenFenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+		frames.resize(this->frameCount);
+		for (Frame& frame : frames)
+		{
+			// Cached memory makes reading on the CPU fast, it usually needs to be invalidated
+			VK_CHECK_RESULT(device->CreateHostBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, vks::HostAccess::Readback, &frame.buffer, frameCapacity));
+			coherent = (frame.buffer.memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+			frame.commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, commandPool, false);
+			VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceInfo, nullptr, &frame.fence));
+		}
+	}
+
+	/**
+	* Wait for submitted copies and release all resources, callbacks of outstanding requests are not run
+	*/
+	void ReadbackManager::destroy()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (Frame& frame : frames)
+		{
+			if (frame.pending)
+			{
+				VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &frame.fence, VK_TRUE, UINT64_MAX));
+			}
+			vkDestroyFence(device->logicalDevice, frame.fence, nullptr);
+			frame.buffer.destroy();
+		}
+		frames.clear();
+		if (commandPool != VK_NULL_HANDLE)
+		{
+			vkDestroyCommandPool(device->logicalDevice, commandPool, nullptr);
+			commandPool = VK_NULL_HANDLE;
+		}
+	}
+
+	/**
+	* Reserve room in the current frame's buffer and queue the copy
+	*
+	* @param copy Copy to record, its destination offset is filled in
+	* @param size Bytes the copy writes
+	* @param offsetAlignment Alignment the destination offset needs in addition to the default alignment
+	* @param callback Run with the data once the copy finished
+	*
+	* @return False if the frame is still in flight or has no room left
+	*/
+	bool ReadbackManager::add(Copy& copy, VkDeviceSize size, VkDeviceSize offsetAlignment, Callback& callback)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		counters.requests++;
+		Frame& frame = frames[currentFrame];
+		VkDeviceSize offset = alignUp(frame.used, alignment * offsetAlignment);
+		if ((size == 0) || frame.pending || (offset + size > frameCapacity))
+		{
+			counters.rejected++;
+			return false;
+		}
+		if (copy.image != VK_NULL_HANDLE)
+		{
+			copy.imageRegion.bufferOffset = offset;
+		}
+		else
+		{
+			copy.bufferRegion.dstOffset = offset;
+		}
+		frame.used = offset + size;
+		frame.copies.push_back(copy);
+		Request request;
+		request.offset = offset;
+		request.size = size;
+		request.callback = std::move(callback);
+		frame.requests.push_back(std::move(request));
+		return true;
+	}
+
+	bool ReadbackManager::readBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, Callback callback)
+	{
+		Copy copy;
+		copy.buffer = buffer;
+		copy.bufferRegion.srcOffset = offset;
+		copy.bufferRegion.size = size;
+		return add(copy, size, 1, callback);
+	}
+
+	std::future<std::vector<uint8_t>> ReadbackManager::readBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size)
+	{
+		// std::function needs a copyable target, so the promise is shared
+		auto promise = std::make_shared<std::promise<std::vector<uint8_t>>>();
+		std::future<std::vector<uint8_t>> future = promise->get_future();
+		bool accepted = readBuffer(buffer, offset, size, [promise](const void* data, VkDeviceSize size)
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			promise->set_value(std::vector<uint8_t>(bytes, bytes + size));
+		});
+		if (!accepted)
+		{
+			promise->set_value(std::vector<uint8_t>());
+		}
+		return future;
+	}
+
+	bool ReadbackManager::readImage(VkImage image, VkImageLayout layout, const VkImageSubresourceLayers& subresource, VkOffset3D offset, VkExtent3D extent,
+		uint32_t texelSize, Callback callback)
+	{
+		Copy copy;
+		copy.image = image;
+		copy.layout = layout;
+		copy.imageRegion.imageSubresource = subresource;
+		copy.imageRegion.imageOffset = offset;
+		copy.imageRegion.imageExtent = extent;
+		VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * extent.depth * subresource.layerCount * texelSize;
+		return add(copy, size, texelSize, callback);
+	}
+
+	/**
+	* Record the copies of the current frame into its command buffer and submit it with the frame's fence
+	*
+	* @param queue Queue the copies run on, they see all writes submitted to it before
+	*/
+	void ReadbackManager::submit(VkQueue queue)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Frame& frame = frames[currentFrame];
+		currentFrame = (currentFrame + 1) % frameCount;
+		if (frame.pending || frame.copies.empty())
+		{
+			return;
+		}
+
+		VkCommandBuffer cmd = frame.commandBuffer;
+		VkCommandBufferBeginInfo beginInfo = vks::initializers::GenCommandBufferBeginInfo();
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		VK_CHECK_RESULT(vkBeginCommandBuffer(cmd, &beginInfo));
+
+		// Earlier submissions to the queue may still be writing the sources
+		std::vector<VkImageMemoryBarrier> toTransfer;
+		std::vector<VkImageMemoryBarrier> toOriginal;
+		for (const Copy& copy : frame.copies)
+		{
+			if ((copy.image == VK_NULL_HANDLE) || (copy.layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL))
+			{
+				continue;
+			}
+			VkImageMemoryBarrier barrier = vks::initializers::GenImageMemoryBarrier();
+			barrier.image = copy.image;
+			barrier.subresourceRange.aspectMask = copy.imageRegion.imageSubresource.aspectMask;
+			barrier.subresourceRange.baseMipLevel = copy.imageRegion.imageSubresource.mipLevel;
+			barrier.subresourceRange.levelCount = 1;
+			barrier.subresourceRange.baseArrayLayer = copy.imageRegion.imageSubresource.baseArrayLayer;
+			barrier.subresourceRange.layerCount = copy.imageRegion.imageSubresource.layerCount;
+			barrier.oldLayout = copy.layout;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			toTransfer.push_back(barrier);
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			barrier.newLayout = copy.layout;
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = 0;
+			toOriginal.push_back(barrier);
+		}
+		VkMemoryBarrier memoryBarrier = vks::initializers::GenMemoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr,
+			static_cast<uint32_t>(toTransfer.size()), toTransfer.data());
+
+		for (const Copy& copy : frame.copies)
+		{
+			if (copy.image != VK_NULL_HANDLE)
+			{
+				vkCmdCopyImageToBuffer(cmd, copy.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, frame.buffer.buffer, 1, &copy.imageRegion);
+			}
+			else
+			{
+				vkCmdCopyBuffer(cmd, copy.buffer, frame.buffer.buffer, 1, &copy.bufferRegion);
+			}
+		}
+
+		// Make the copies visible to the host and keep later submissions from overwriting the sources before they were read
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &memoryBarrier, 0, nullptr,
+			static_cast<uint32_t>(toOriginal.size()), toOriginal.data());
+		VK_CHECK_RESULT(vkEndCommandBuffer(cmd));
+
+		VK_CHECK_RESULT(vkResetFences(device->logicalDevice, 1, &frame.fence));
+		VkSubmitInfo submitInfo = vks::initializers::GenSubmitInfo();
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &cmd;
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, frame.fence));
+		frame.pending = true;
+	}
+
+	/**
+	* Hand the data of finished frames to their callbacks, oldest frame first
+	*
+	* @param wait If true, block until all submitted copies finished, otherwise skip frames whose fence has not signaled yet
+	*
+	* @return Number of callbacks that were run
+	*/
+	uint32_t ReadbackManager::collect(bool wait)
+	{
+		uint32_t callbacks = 0;
+		for (uint32_t i = 0; i < frameCount; i++)
+		{
+			Frame* frame;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				frame = &frames[(currentFrame + i) % frameCount];
+				if (!frame->pending)
+				{
+					continue;
+				}
+			}
+			VkResult result = wait ? vkWaitForFences(device->logicalDevice, 1, &frame->fence, VK_TRUE, UINT64_MAX)
+				: vkGetFenceStatus(device->logicalDevice, frame->fence);
+			if (result == VK_NOT_READY)
+			{
+				continue;
+			}
+			VK_CHECK_RESULT(result);
+			if (!coherent)
+			{
+				VkDeviceSize range = alignUp(frame->used, alignment);
+				VK_CHECK_RESULT(frame->buffer.invalidate((range < frameCapacity) ? range : VK_WHOLE_SIZE));
+			}
+
+			// The frame stays pending while the callbacks read its buffer, requests made from them go to the current frame
+			const uint8_t* data = static_cast<const uint8_t*>(frame->buffer.mappedData);
+			VkDeviceSize bytes = 0;
+			for (Request& request : frame->requests)
+			{
+				request.callback(data + request.offset, request.size);
+				bytes += request.size;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			callbacks += static_cast<uint32_t>(frame->requests.size());
+			counters.completed += frame->requests.size();
+			counters.bytes += bytes;
+			frame->requests.clear();
+			frame->copies.clear();
+			frame->used = 0;
+			frame->pending = false;
+		}
+		return callbacks;
+	}
+
+	ReadbackManager::Statistics ReadbackManager::statistics()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return counters;
+	}
+}//vks
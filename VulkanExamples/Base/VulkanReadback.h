@@ -0,0 +1,112 @@
+/*
+* GPU to CPU readback
+*
+* Asynchronous copies from device buffers and images into a ring of host visible buffers, one per frame in flight,
+* completed without stalling the frame once the fence of the frame they were submitted with has signaled
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <vector>
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+
+namespace vks
+{
+	/**
+	* @brief Collects region copies per frame, submits them in one command buffer and hands the data to callbacks once the copy finished
+	* @note Memory is bounded by frameCount buffers of frameCapacity bytes, requests that do not fit into the current frame are rejected
+	* instead of waiting. Requests can be made from any thread, callbacks run on the thread calling collect
+	*/
+	class ReadbackManager
+	{
+	public:
+		/** @brief Receives the copied bytes, data is only valid during the call */
+		using Callback = std::function<void(const void* data, VkDeviceSize size)>;
+
+		struct Statistics
+		{
+			uint64_t requests = 0;
+			uint64_t rejected = 0;
+			uint64_t completed = 0;
+			uint64_t bytes = 0;
+		};
+
+		vks::VulkanDevice* device = nullptr;
+		/** @brief Number of frames in flight that get their own readback buffer */
+		uint32_t frameCount = 0;
+		/** @brief Bytes that can be read back per frame */
+		VkDeviceSize frameCapacity = 0;
+		/** @brief False if the readback buffers are host cached and need to be invalidated before they are read */
+		bool coherent = false;
+
+		void create(vks::VulkanDevice* device, uint32_t queueFamilyIndex, uint32_t frameCount, VkDeviceSize frameCapacity);
+		void destroy();
+
+		/** @brief Read size bytes at offset of a buffer, false if the current frame has no room left */
+		bool readBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, Callback callback);
+		/** @brief Future variant of readBuffer, a rejected request yields an empty vector */
+		std::future<std::vector<uint8_t>> readBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size);
+		/**
+		* @brief Read a region of one image subresource, tightly packed
+		* @param layout Layout the image is in when the copy executes, it is moved to transfer source and back
+		* @param texelSize Size of one texel (or compressed block) in bytes
+		*/
+		bool readImage(VkImage image, VkImageLayout layout, const VkImageSubresourceLayers& subresource, VkOffset3D offset, VkExtent3D extent,
+			uint32_t texelSize, Callback callback);
+
+		/**
+		* @brief Record and submit the copies of the current frame and move on to the next frame
+		* @note Must be called on a queue of the family passed to create, after the work that writes the source data was submitted to it
+		*/
+		void submit(VkQueue queue);
+		/** @brief Run the callbacks of all frames whose copies finished, optionally waiting for them, returns the number of callbacks run */
+		uint32_t collect(bool wait = false);
+
+		Statistics statistics();
+
+	private:
+		struct Copy
+		{
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkBufferCopy bufferRegion{};
+			VkImage image = VK_NULL_HANDLE;
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkBufferImageCopy imageRegion{};
+		};
+		struct Request
+		{
+			VkDeviceSize offset = 0;
+			VkDeviceSize size = 0;
+			Callback callback;
+		};
+		struct Frame
+		{
+			vks::Buffer buffer;
+			VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+			VkFence fence = VK_NULL_HANDLE;
+			VkDeviceSize used = 0;
+			std::vector<Copy> copies;
+			std::vector<Request> requests;
+			/** @brief Submitted and not yet collected, no requests are added until it is collected */
+			bool pending = false;
+		};
+
+		std::mutex mutex;
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		std::vector<Frame> frames;
+		uint32_t currentFrame = 0;
+		VkDeviceSize alignment = 16;
+		Statistics counters;
+
+		bool add(Copy& copy, VkDeviceSize size, VkDeviceSize offsetAlignment, Callback& callback);
+	};
+}//vks
@@ -0,0 +1,332 @@
+/*
+* Sorted render queue
+*
+* Key layout from the most significant bit, opaque and alpha masked passes are sorted by state first and front to
+* back within equal state, blended draws back to front first:
+*   opaque/mask: pass (4) | pipeline (12) | material (16) | geometry (8) | depth (24)
+*   blend:       pass (4) | inverted depth (24) | pipeline (12) | material (16) | geometry (8)
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanRenderQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <random>
+
+#include "ParallelAlgorithms.hpp"
+
+namespace vks
+{
+	namespace
+	{
+		const uint32_t pipelineBits = 12;
+		const uint32_t materialBits = 16;
+		const uint32_t geometryBits = 8;
+		const uint32_t depthBits = 24;
+		const uint32_t maxDescriptorSets = 8;
+		const int benchmarkRuns = 5;
+
+		/** Positive floats compare like their bit patterns, the top 24 bits (without the sign) keep the order */
+		uint64_t quantizeDepth(float depth)
+		{
+			depth = std::max(depth, 0.0f);
+			uint32_t bits;
+			std::memcpy(&bits, &depth, sizeof(bits));
+			return (bits >> 7) & ((1u << depthBits) - 1);
+		}
+
+		uint64_t handleValue(uint64_t handle)
+		{
+			return handle;
+		}
+
+		template<typename Handle>
+		uint64_t handleValue(Handle* handle)
+		{
+			return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(handle));
+		}
+
+		/** Cast that works for both dispatchable pointer and 64 bit integer handle definitions */
+		template<typename Handle>
+		Handle fakeHandle(uint64_t value)
+		{
+			return (Handle)(uintptr_t)value;
+		}
+
+		struct BindState
+		{
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+			VkDescriptorSet sets[maxDescriptorSets] = {};
+			VkBuffer vertexBuffer = VK_NULL_HANDLE;
+			VkBuffer indexBuffer = VK_NULL_HANDLE;
+			VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+		};
+
+		/** Binds a set unless it is already bound (or always when redundant binds are kept), returns true if bound */
+		bool bindSet(VkCommandBuffer commandBuffer, BindState& state, VkPipelineLayout layout, uint32_t index, VkDescriptorSet set, bool skipRedundant)
+		{
+			if (set == VK_NULL_HANDLE)
+			{
+				return false;
+			}
+			bool tracked = (index < maxDescriptorSets);
+			if (skipRedundant && tracked && (state.sets[index] == set))
+			{
+				return false;
+			}
+			if (commandBuffer != VK_NULL_HANDLE)
+			{
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, index, 1, &set, 0, nullptr);
+			}
+			if (tracked)
+			{
+				state.sets[index] = set;
+			}
+			return true;
+		}
+	}
+
+	void RenderQueue::clear()
+	{
+		draws.clear();
+		entries.clear();
+		sorted = false;
+		sortMs = 0.0;
+	}
+
+	void RenderQueue::reset()
+	{
+		clear();
+		pipelineIds.clear();
+		materialIds.clear();
+		geometryIds.clear();
+	}
+
+	uint32_t RenderQueue::idOf(std::unordered_map<uint64_t, uint32_t>& ids, uint64_t handle)
+	{
+		auto it = ids.find(handle);
+		if (it != ids.end())
+		{
+			return it->second;
+		}
+		uint32_t id = static_cast<uint32_t>(ids.size());
+		ids.emplace(handle, id);
+		return id;
+	}
+
+	uint64_t RenderQueue::makeKey(uint32_t pass, uint32_t pipelineId, uint32_t materialId, uint32_t geometryId, float depth)
+	{
+		uint64_t pipeline = pipelineId & ((1u << pipelineBits) - 1);
+		uint64_t material = materialId & ((1u << materialBits) - 1);
+		uint64_t geometry = geometryId & ((1u << geometryBits) - 1);
+		uint64_t distance = quantizeDepth(depth);
+		uint64_t key = static_cast<uint64_t>(pass & 0xf) << 60;
+		if (pass == PassAlphaBlend)
+		{
+			uint64_t inverted = ((1u << depthBits) - 1) - distance;
+			key |= inverted << (pipelineBits + materialBits + geometryBits);
+			key |= pipeline << (materialBits + geometryBits);
+			key |= material << geometryBits;
+			key |= geometry;
+		}
+		else
+		{
+			key |= pipeline << (materialBits + geometryBits + depthBits);
+			key |= material << (geometryBits + depthBits);
+			key |= geometry << depthBits;
+			key |= distance;
+		}
+		return key;
+	}
+
+	/**
+	* Add a draw, its key is built from ids assigned in order of first use to the pipeline, the material set and the
+	* vertex/index buffer pair, so draws sharing state end up next to each other after sorting
+	*
+	* @param draw Draw to add, all handles are only recorded and not owned by the queue
+	*/
+	void RenderQueue::add(const Draw& draw)
+	{
+		uint32_t pipelineId = idOf(pipelineIds, handleValue(draw.pipeline));
+		uint32_t materialId = idOf(materialIds, handleValue(draw.materialSet));
+		uint64_t geometry = handleValue(draw.vertexBuffer) * 31 + handleValue(draw.indexBuffer);
+		uint32_t geometryId = idOf(geometryIds, geometry);
+		Entry entry;
+		entry.key = makeKey(draw.pass, pipelineId, materialId, geometryId, draw.depth);
+		entry.draw = static_cast<uint32_t>(draws.size());
+		entries.push_back(entry);
+		draws.push_back(draw);
+		sorted = false;
+	}
+
+	void RenderQueue::sort()
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		vks::parallel::radixSort(entries, [](const Entry& entry) { return entry.key; });
+		sortMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		sorted = true;
+	}
+
+	/**
+	* Record all draws, in sorted order a bind is only recorded if the state differs from what is bound already.
+	* Descriptor sets are tracked per set index and forgotten when the pipeline layout changes
+	*
+	* @param commandBuffer Command buffer in recording state inside a render pass, VK_NULL_HANDLE to only count
+	* @param order Submission order for the scene graph equivalent, Sorted for the key order (sorts if not sorted yet)
+	* @return Number of draws and binds recorded and the CPU time of sorting and recording
+	*/
+	RenderQueue::Statistics RenderQueue::record(VkCommandBuffer commandBuffer, Order order)
+	{
+		if ((order == Order::Sorted) && !sorted)
+		{
+			sort();
+		}
+		auto start = std::chrono::high_resolution_clock::now();
+		Statistics statistics;
+		bool skipRedundant = (order == Order::Sorted);
+		bool recording = (commandBuffer != VK_NULL_HANDLE);
+		BindState state;
+		const VkDeviceSize offsets[1] = { 0 };
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			const Draw& draw = skipRedundant ? draws[entries[i].draw] : draws[i];
+			if (draw.pipelineLayout != state.pipelineLayout)
+			{
+				// Sets stay bound across compatible layouts, but that is not worth tracking here
+				state.pipelineLayout = draw.pipelineLayout;
+				std::fill(std::begin(state.sets), std::end(state.sets), static_cast<VkDescriptorSet>(VK_NULL_HANDLE));
+			}
+			if (draw.pipeline != state.pipeline)
+			{
+				if (recording)
+				{
+					vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, draw.pipeline);
+				}
+				state.pipeline = draw.pipeline;
+				statistics.pipelineBinds++;
+			}
+			if (bindSet(commandBuffer, state, draw.pipelineLayout, draw.objectSetIndex, draw.objectSet, skipRedundant))
+			{
+				statistics.descriptorSetBinds++;
+			}
+			if (bindSet(commandBuffer, state, draw.pipelineLayout, draw.materialSetIndex, draw.materialSet, skipRedundant))
+			{
+				statistics.descriptorSetBinds++;
+			}
+			if (draw.vertexBuffer != state.vertexBuffer)
+			{
+				if (recording)
+				{
+					vkCmdBindVertexBuffers(commandBuffer, 0, 1, &draw.vertexBuffer, offsets);
+				}
+				state.vertexBuffer = draw.vertexBuffer;
+				statistics.vertexBufferBinds++;
+			}
+			if ((draw.indexBuffer != state.indexBuffer) || (draw.indexType != state.indexType))
+			{
+				if (recording)
+				{
+					vkCmdBindIndexBuffer(commandBuffer, draw.indexBuffer, 0, draw.indexType);
+				}
+				state.indexBuffer = draw.indexBuffer;
+				state.indexType = draw.indexType;
+				statistics.indexBufferBinds++;
+			}
+			if (recording)
+			{
+				vkCmdDrawIndexed(commandBuffer, draw.indexCount, 1, draw.firstIndex, draw.vertexOffset, 0);
+			}
+			statistics.draws++;
+		}//for
+		statistics.recordMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		statistics.sortMs = skipRedundant ? sortMs : 0.0;
+		return statistics;
+	}
+
+	void RenderQueue::printStatistics(std::ostream& out, const Statistics& before, const Statistics& after)
+	{
+		std::ios_base::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+		out << std::fixed << std::setprecision(3);
+		out << "  " << std::left << std::setw(18) << "" << std::right << std::setw(12) << "submission" << std::setw(12) << "sorted" << "\n";
+		out << "  " << std::left << std::setw(18) << "draws" << std::right << std::setw(12) << before.draws << std::setw(12) << after.draws << "\n";
+		out << "  " << std::left << std::setw(18) << "pipeline binds" << std::right << std::setw(12) << before.pipelineBinds << std::setw(12) << after.pipelineBinds << "\n";
+		out << "  " << std::left << std::setw(18) << "descriptor binds" << std::right << std::setw(12) << before.descriptorSetBinds << std::setw(12) << after.descriptorSetBinds << "\n";
+		out << "  " << std::left << std::setw(18) << "vertex binds" << std::right << std::setw(12) << before.vertexBufferBinds << std::setw(12) << after.vertexBufferBinds << "\n";
+		out << "  " << std::left << std::setw(18) << "index binds" << std::right << std::setw(12) << before.indexBufferBinds << std::setw(12) << after.indexBufferBinds << "\n";
+		out << "  " << std::left << std::setw(18) << "sort (ms)" << std::right << std::setw(12) << before.sortMs << std::setw(12) << after.sortMs << "\n";
+		out << "  " << std::left << std::setw(18) << "record (ms)" << std::right << std::setw(12) << before.recordMs << std::setw(12) << after.recordMs << "\n";
+		out.flags(flags);
+		out.precision(precision);
+	}
+
+	/**
+	* Fill a queue with a synthetic scene (a few pipelines, a few hundred materials and meshes, three passes) in random
+	* submission order and record it without a command buffer in both orders, the handles are never passed to Vulkan
+	*
+	* @param out Stream the table is written to
+	* @param drawCount Number of draws in the scene
+	*/
+	void benchmarkRenderQueue(std::ostream& out, uint32_t drawCount)
+	{
+		const uint64_t pipelineCount = 8;
+		const uint64_t materialCount = 256;
+		const uint64_t meshCount = 64;
+		std::mt19937 random(42);
+		std::uniform_real_distribution<float> distance(0.1f, 500.0f);
+
+		std::vector<RenderQueue::Draw> scene(drawCount);
+		for (auto& draw : scene)
+		{
+			uint64_t pipeline = random() % pipelineCount;
+			uint64_t material = random() % materialCount;
+			uint64_t mesh = random() % meshCount;
+			// Most pipelines opaque, one alpha masked and one blended
+			draw.pass = (pipeline < pipelineCount - 2) ? RenderQueue::PassOpaque : ((pipeline < pipelineCount - 1) ? RenderQueue::PassAlphaMask : RenderQueue::PassAlphaBlend);
+			// Non zero fake handles, never passed to Vulkan
+			draw.pipeline = fakeHandle<VkPipeline>(0x1000 + pipeline);
+			draw.pipelineLayout = fakeHandle<VkPipelineLayout>(0x2000);
+			draw.objectSet = fakeHandle<VkDescriptorSet>(0x3000 + mesh);
+			draw.objectSetIndex = 0;
+			draw.materialSet = fakeHandle<VkDescriptorSet>(0x10000 + material);
+			draw.materialSetIndex = 1;
+			draw.vertexBuffer = fakeHandle<VkBuffer>(0x4000 + mesh / 16);
+			draw.indexBuffer = fakeHandle<VkBuffer>(0x5000 + mesh / 16);
+			draw.indexCount = 36;
+			draw.firstIndex = static_cast<uint32_t>(mesh % 16) * 36;
+			draw.depth = distance(random);
+		}
+
+		RenderQueue queue;
+		RenderQueue::Statistics before;
+		RenderQueue::Statistics after;
+		for (int run = 0; run < benchmarkRuns; run++)
+		{
+			queue.clear();
+			for (const auto& draw : scene)
+			{
+				queue.add(draw);
+			}
+			RenderQueue::Statistics submission = queue.record(VK_NULL_HANDLE, RenderQueue::Order::Submission);
+			queue.sort();
+			RenderQueue::Statistics sorted = queue.record(VK_NULL_HANDLE, RenderQueue::Order::Sorted);
+			if ((run == 0) || (submission.recordMs < before.recordMs))
+			{
+				before = submission;
+			}
+			if ((run == 0) || (sorted.sortMs + sorted.recordMs < after.sortMs + after.recordMs))
+			{
+				after = sorted;
+			}
+		}
+
+		out << "Render queue benchmark, " << drawCount << " draws, " << pipelineCount << " pipelines, " << materialCount << " materials, "
+			<< meshCount << " meshes, best of " << benchmarkRuns << " runs\n";
+		RenderQueue::printStatistics(out, before, after);
+	}
+}//vks
@@ -0,0 +1,116 @@
+/*
+* Sorted render queue
+*
+* Draws are collected with a 64 bit sort key (pass, pipeline, material, geometry, depth), sorted with the parallel
+* radix sort and recorded with redundant pipeline, descriptor set and buffer binds skipped
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+namespace vks
+{
+	class RenderQueue
+	{
+	public:
+		/** @brief Passes in recording order, blended draws are sorted back to front */
+		enum Pass
+		{
+			PassOpaque = 0,
+			PassAlphaMask = 1,
+			PassAlphaBlend = 2
+		};
+
+		struct Draw
+		{
+			uint32_t pass = PassOpaque;
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+			/** @brief Per object set (e.g. a node's uniform buffer), not bound if VK_NULL_HANDLE */
+			VkDescriptorSet objectSet = VK_NULL_HANDLE;
+			uint32_t objectSetIndex = 0;
+			/** @brief Material set (e.g. textures), not bound if VK_NULL_HANDLE */
+			VkDescriptorSet materialSet = VK_NULL_HANDLE;
+			uint32_t materialSetIndex = 1;
+			VkBuffer vertexBuffer = VK_NULL_HANDLE;
+			VkBuffer indexBuffer = VK_NULL_HANDLE;
+			VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+			uint32_t indexCount = 0;
+			uint32_t firstIndex = 0;
+			int32_t vertexOffset = 0;
+			/** @brief View space distance used to order draws within a pass */
+			float depth = 0.0f;
+		};
+
+		enum class Order
+		{
+			/** @brief Submission order with the material and object sets bound for every draw, like a scene graph walk */
+			Submission,
+			/** @brief Sort key order with every redundant bind skipped */
+			Sorted
+		};
+
+		struct Statistics
+		{
+			uint32_t draws = 0;
+			uint32_t pipelineBinds = 0;
+			uint32_t descriptorSetBinds = 0;
+			uint32_t vertexBufferBinds = 0;
+			uint32_t indexBufferBinds = 0;
+			double sortMs = 0.0;
+			double recordMs = 0.0;
+		};
+
+		/** @brief Removes all draws, the ids assigned to pipelines, materials and geometry are kept so keys stay stable between frames */
+		void clear();
+		/** @brief Also forgets the assigned ids, e.g. after pipelines were recreated */
+		void reset();
+		void add(const Draw& draw);
+		/** @brief Sorts the draws by key with the parallel radix sort, only required for Order::Sorted */
+		void sort();
+		/**
+		* @brief Records the draws into the command buffer and returns the number of binds and the CPU time
+		* @note With VK_NULL_HANDLE as command buffer nothing is recorded and only the statistics are gathered
+		*/
+		Statistics record(VkCommandBuffer commandBuffer, Order order = Order::Sorted);
+
+		size_t size() const { return draws.size(); }
+
+		/**
+		* @brief Builds the sort key of a draw
+		* @note Ids wrap around at their bit width, which only weakens the grouping and never affects correctness
+		*/
+		static uint64_t makeKey(uint32_t pass, uint32_t pipelineId, uint32_t materialId, uint32_t geometryId, float depth);
+
+		static void printStatistics(std::ostream& out, const Statistics& before, const Statistics& after);
+
+	private:
+		struct Entry
+		{
+			uint64_t key;
+			uint32_t draw;
+		};
+
+		std::vector<Draw> draws;
+		std::vector<Entry> entries;
+		bool sorted = false;
+		double sortMs = 0.0;
+
+		std::unordered_map<uint64_t, uint32_t> pipelineIds;
+		std::unordered_map<uint64_t, uint32_t> materialIds;
+		std::unordered_map<uint64_t, uint32_t> geometryIds;
+
+		static uint32_t idOf(std::unordered_map<uint64_t, uint32_t>& ids, uint64_t handle);
+	};
+
+	/** @brief Records a synthetic scene dry (without a command buffer) in submission and in sorted order and prints the bind counts and CPU times */
+	void benchmarkRenderQueue(std::ostream& out, uint32_t drawCount = 20000);
+}//vks
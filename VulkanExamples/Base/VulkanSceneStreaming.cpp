@@ -0,0 +1,504 @@
+/*
+* Scene streaming
+*
+* glTF models placed in the world are grouped into square cells on the x/z plane. Models of cells around the camera are parsed
+* on loader threads and uploaded by the frame loop within a byte budget per frame, models of cells the camera left are destroyed
+* a few frames later once no command buffer can use them anymore
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanSceneStreaming.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <utility>
+
+namespace vks
+{
+	namespace
+	{
+		/** Write a flat grid of quads with positions and normals as .gltf and .bin, split into tiles x tiles primitives */
+		bool writeGridModel(const std::string& fileName, const std::string& binaryName, uint32_t resolution, float size, uint32_t tiles)
+		{
+			std::vector<float> vertexData;
+			vertexData.reserve(resolution * resolution * 6);
+			for (uint32_t z = 0; z < resolution; z++)
+			{
+				for (uint32_t x = 0; x < resolution; x++)
+				{
+					const float u = x / static_cast<float>(resolution - 1);
+					const float v = z / static_cast<float>(resolution - 1);
+					const float position[3] = { (u - 0.5f) * size, std::sin(u * 12.0f) * std::cos(v * 12.0f), (v - 0.5f) * size };
+					const float normal[3] = { 0.0f, 1.0f, 0.0f };
+					vertexData.insert(vertexData.end(), position, position + 3);
+					vertexData.insert(vertexData.end(), normal, normal + 3);
+				}
+			}//for
+			// The quads of a tile follow each other, every tile is one primitive
+			const uint32_t quads = resolution - 1;
+			std::vector<uint32_t> indexData;
+			std::vector<uint32_t> tileFirstIndex;
+			indexData.reserve(quads * quads * 6);
+			for (uint32_t tileZ = 0; tileZ < tiles; tileZ++)
+			{
+				for (uint32_t tileX = 0; tileX < tiles; tileX++)
+				{
+					tileFirstIndex.push_back(static_cast<uint32_t>(indexData.size()));
+					for (uint32_t z = tileZ * quads / tiles; z < (tileZ + 1) * quads / tiles; z++)
+					{
+						for (uint32_t x = tileX * quads / tiles; x < (tileX + 1) * quads / tiles; x++)
+						{
+							const uint32_t i = z * resolution + x;
+							const uint32_t quad[6] = { i, i + resolution, i + 1, i + 1, i + resolution, i + resolution + 1 };
+							indexData.insert(indexData.end(), quad, quad + 6);
+						}
+					}//for
+				}
+			}//for
+			tileFirstIndex.push_back(static_cast<uint32_t>(indexData.size()));
+
+			const size_t vertexBytes = vertexData.size() * sizeof(float);
+			const size_t indexBytes = indexData.size() * sizeof(uint32_t);
+			std::ofstream binary(binaryName, std::ios::binary);
+			binary.write(reinterpret_cast<const char*>(vertexData.data()), vertexBytes);
+			binary.write(reinterpret_cast<const char*>(indexData.data()), indexBytes);
+			if (!binary)
+			{
+				return false;
+			}
+
+			const uint32_t vertexCount = resolution * resolution;
+			const std::string binaryUri = binaryName.substr(binaryName.find_last_of("/\\") + 1);
+			std::ofstream gltf(fileName);
+			gltf << "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],\"meshes\":[{\"primitives\":[";
+			for (uint32_t tile = 0; tile < tiles * tiles; tile++)
+			{
+				gltf << (tile > 0 ? "," : "") << "{\"attributes\":{\"POSITION\":0,\"NORMAL\":1},\"indices\":" << tile + 2 << "}";
+			}
+			gltf << "]}],"
+				<< "\"buffers\":[{\"uri\":\"" << binaryUri << "\",\"byteLength\":" << vertexBytes + indexBytes << "}],"
+				<< "\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":" << vertexBytes << ",\"byteStride\":24,\"target\":34962},"
+				<< "{\"buffer\":0,\"byteOffset\":" << vertexBytes << ",\"byteLength\":" << indexBytes << ",\"target\":34963}],"
+				<< "\"accessors\":[{\"bufferView\":0,\"byteOffset\":0,\"componentType\":5126,\"count\":" << vertexCount << ",\"type\":\"VEC3\","
+				<< "\"min\":[" << -size * 0.5f << ",-1," << -size * 0.5f << "],\"max\":[" << size * 0.5f << ",1," << size * 0.5f << "]},"
+				<< "{\"bufferView\":0,\"byteOffset\":12,\"componentType\":5126,\"count\":" << vertexCount << ",\"type\":\"VEC3\"}";
+			for (uint32_t tile = 0; tile < tiles * tiles; tile++)
+			{
+				gltf << ",{\"bufferView\":1,\"byteOffset\":" << tileFirstIndex[tile] * sizeof(uint32_t) << ",\"componentType\":5125,\"count\":"
+					<< tileFirstIndex[tile + 1] - tileFirstIndex[tile] << ",\"type\":\"SCALAR\"}";
+			}
+			gltf << "]}";
+			return static_cast<bool>(gltf);
+		}
+
+		double percentile(std::vector<double> values, double fraction)
+		{
+			if (values.empty())
+			{
+				return 0.0;
+			}
+			std::sort(values.begin(), values.end());
+			const size_t index = static_cast<size_t>(std::ceil(fraction * values.size()));
+			return values[std::min(std::max<size_t>(index, 1), values.size()) - 1];
+		}
+	}
+
+	void SceneStreamer::create(vks::VulkanDevice* device, VkQueue queue)
+	{
+		this->device = device;
+		this->queue = queue;
+		if (settings.loaderThreads > 0)
+		{
+			threading::ThreadPlacement loaderPlacement;
+			loaderPlacement.priority = threading::Priority::Background;
+			loaderPlacement.name = "vks loader";
+			loaderPool.setThreadCount(settings.loaderThreads, loaderPlacement);
+		}
+	}
+
+	void SceneStreamer::destroy()
+	{
+		if (!device)
+		{
+			return;
+		}
+		// Outstanding parses write into their models and the completion queue
+		loaderPool.wait();
+		loaderPool.setThreadCount(0);
+		completedParses.clear();
+		uploads.clear();
+		retired.clear();
+		instances.clear();
+		device = nullptr;
+	}
+
+	uint32_t SceneStreamer::add(const std::string& fileName, const glm::mat4& transform)
+	{
+		Instance instance;
+		instance.fileName = fileName;
+		instance.transform = transform;
+		instance.cellX = static_cast<int32_t>(std::floor(transform[3].x / settings.cellSize));
+		instance.cellZ = static_cast<int32_t>(std::floor(transform[3].z / settings.cellSize));
+		instances.push_back(std::move(instance));
+		return static_cast<uint32_t>(instances.size() - 1);
+	}
+
+	/**
+	* Distance on the x/z plane from the camera to the nearest point of the instance's cell
+	*/
+	float SceneStreamer::cellDistance(const Instance& instance, const glm::vec3& cameraPosition) const
+	{
+		const float minX = instance.cellX * settings.cellSize;
+		const float minZ = instance.cellZ * settings.cellSize;
+		const float dx = std::max(std::max(minX - cameraPosition.x, cameraPosition.x - (minX + settings.cellSize)), 0.0f);
+		const float dz = std::max(std::max(minZ - cameraPosition.z, cameraPosition.z - (minZ + settings.cellSize)), 0.0f);
+		return std::sqrt(dx * dx + dz * dz);
+	}
+
+	void SceneStreamer::requestLoad(uint32_t index)
+	{
+		Instance& instance = instances[index];
+		instance.state = State::Parsing;
+		instance.unloadRequested = false;
+		instance.model.reset(new vkglTF::Model());
+		instance.model->geometryPool = geometryPool;
+		pendingParses++;
+		// The job gets the model and file name, instances may grow while it runs
+		vkglTF::Model* model = instance.model.get();
+		const std::string fileName = instance.fileName;
+		if (loaderPool.threads.empty())
+		{
+			parse(index, model, fileName);
+			return;
+		}
+		loaderPool.threads[nextLoader]->addJob([this, index, model, fileName] { parse(index, model, fileName); });
+		nextLoader = (nextLoader + 1) % static_cast<uint32_t>(loaderPool.threads.size());
+	}
+
+	/**
+	* Parse a model file, runs on a loader thread
+	*
+	* Only touches the model, which the main thread leaves alone while it is parsed, and the completion queue
+	*/
+	void SceneStreamer::parse(uint32_t index, vkglTF::Model* model, const std::string& fileName)
+	{
+		auto tStart = std::chrono::high_resolution_clock::now();
+		ParsedModel parsed;
+		parsed.instance = index;
+		parsed.success = model->parseFile(fileName, device, settings.fileLoadingFlags, settings.scale);
+		parseNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - tStart).count();
+
+		std::lock_guard<std::mutex> lock(completedMutex);
+		completedParses.push_back(parsed);
+		pendingParses--;
+	}
+
+	/**
+	* Take the model out of the world, it is destroyed once retireFrames updates have passed
+	*/
+	void SceneStreamer::unload(uint32_t index)
+	{
+		Instance& instance = instances[index];
+		if (instance.state == State::Uploading)
+		{
+			uploads.erase(std::find(uploads.begin(), uploads.end(), index));
+		}
+		if ((instance.state == State::Uploading) || (instance.state == State::Resident))
+		{
+			stats.modelsUnloaded++;
+		}
+		RetiredModel retiredModel;
+		retiredModel.model = std::move(instance.model);
+		retiredModel.frame = frameIndex;
+		retired.push_back(std::move(retiredModel));
+		instance.state = State::Unloaded;
+		instance.unloadRequested = false;
+	}
+
+	/**
+	* Queue finished parses for upload, unless their cell was left in the meantime
+	*/
+	void SceneStreamer::takeParsedModels()
+	{
+		std::deque<ParsedModel> parsed;
+		{
+			std::lock_guard<std::mutex> lock(completedMutex);
+			parsed.swap(completedParses);
+		}
+		for (const ParsedModel& entry : parsed)
+		{
+			Instance& instance = instances[entry.instance];
+			parsedModels++;
+			if (!entry.success)
+			{
+				std::cerr << "Could not stream \"" << instance.fileName << "\": " << instance.model->loadError << "\n";
+				unload(entry.instance);
+				instance.state = State::Failed;
+				stats.failedLoads++;
+			}
+			else if (instance.unloadRequested)
+			{
+				unload(entry.instance);
+			}
+			else
+			{
+				instance.state = State::Uploading;
+				uploads.push_back(entry.instance);
+			}
+		}//for
+	}
+
+	/**
+	* @param view View matrix of the camera, only its position is used
+	*/
+	bool SceneStreamer::update(const glm::mat4& view)
+	{
+		frameIndex++;
+		bool changed = false;
+
+		takeParsedModels();
+
+		// Unload cells beyond the unload radius, load the nearest cells inside the load radius first
+		const glm::vec3 cameraPosition = glm::vec3(glm::inverse(view)[3]);
+		std::vector<std::pair<float, uint32_t>> loadRequests;
+		for (uint32_t index = 0; index < static_cast<uint32_t>(instances.size()); index++)
+		{
+			Instance& instance = instances[index];
+			const float distance = cellDistance(instance, cameraPosition);
+			switch (instance.state)
+			{
+			case State::Unloaded:
+				if (distance <= settings.loadRadius)
+				{
+					loadRequests.push_back(std::make_pair(distance, index));
+				}
+				break;
+			case State::Parsing:
+				instance.unloadRequested = (distance > settings.unloadRadius);
+				break;
+			case State::Uploading:
+			case State::Resident:
+				if (distance > settings.unloadRadius)
+				{
+					changed |= (instance.state == State::Resident);
+					unload(index);
+				}
+				break;
+			case State::Failed:
+				break;
+			}
+		}//for
+		std::sort(loadRequests.begin(), loadRequests.end());
+		for (const auto& request : loadRequests)
+		{
+			if (pendingParses >= std::max(settings.maxPendingLoads, 1u))
+			{
+				break;
+			}
+			requestLoad(request.second);
+		}//for
+		if (loaderPool.threads.empty())
+		{
+			// Parsed synchronously, uploaded in the same frame
+			takeParsedModels();
+		}
+
+		// Upload the oldest parsed models first until the budget is spent
+		auto tUpload = std::chrono::high_resolution_clock::now();
+		VkDeviceSize budget = settings.uploadBudget;
+		while (!uploads.empty() && (budget > 0))
+		{
+			const uint32_t index = uploads.front();
+			if (!instances[index].model->upload(queue, budget))
+			{
+				break;
+			}
+			uploads.pop_front();
+			instances[index].state = State::Resident;
+			stats.modelsLoaded++;
+			changed = true;
+		}//while
+		stats.frameUploadBytes = settings.uploadBudget - budget;
+		stats.uploadedBytes += stats.frameUploadBytes;
+		stats.frameUploadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tUpload).count();
+
+		// Command buffers recorded before the unload may still be in flight for retireFrames frames
+		while (!retired.empty() && (retired.front().frame + settings.retireFrames <= frameIndex))
+		{
+			retired.pop_front();
+		}
+
+		// Statistics
+		stats.residentModels = 0;
+		stats.parsingModels = 0;
+		stats.uploadingModels = static_cast<uint32_t>(uploads.size());
+		for (const Instance& instance : instances)
+		{
+			stats.residentModels += (instance.state == State::Resident) ? 1 : 0;
+			stats.parsingModels += (instance.state == State::Parsing) ? 1 : 0;
+		}
+		stats.retiredModels = static_cast<uint32_t>(retired.size());
+		stats.averageParseMs = parsedModels > 0 ? parseNanoseconds / 1e6 / parsedModels : 0.0;
+		return changed;
+	}
+
+	void SceneStreamer::forEachResident(const std::function<void(vkglTF::Model& model, const glm::mat4& transform)>& function)
+	{
+		for (Instance& instance : instances)
+		{
+			if (instance.state == State::Resident)
+			{
+				function(*instance.model, instance.transform);
+			}
+		}
+	}
+
+	/**
+	* Writes a grid model of 16 x 16 small primitives to the working directory and places a copy of it in every cell of a 16 x 16 world.
+	* The camera flies diagonally across the world at 60 frames per second, once with the models parsed and uploaded inside the frame
+	* that needs them, once streamed and once streamed with the small primitives merged on load. The time of the streaming update per
+	* frame is compared against the frame budget, the draws per cell show what merging saves
+	*
+	* @param device Device the models are created on
+	* @param queue Queue used for the uploads, must be idle outside of the update
+	* @param out Stream the report is written to
+	* @param frames Number of frames of each flight
+	*/
+	void benchmarkStreaming(vks::VulkanDevice* device, VkQueue queue, std::ostream& out, uint32_t frames)
+	{
+		const std::string fileName = "streaming_benchmark.gltf";
+		const std::string binaryName = "streaming_benchmark.bin";
+		const uint32_t gridResolution = 256;
+		const uint32_t gridTiles = 16;
+		const int32_t worldCells = 16;
+		const double frameBudgetMs = 1000.0 / 60.0;
+		if (!writeGridModel(fileName, binaryName, gridResolution, 60.0f, gridTiles))
+		{
+			out << "Could not write " << fileName << " to the working directory\n";
+			return;
+		}
+
+		std::ios_base::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+		out << "Streaming flythrough: " << frames << " frames at 60 Hz over " << worldCells << " x " << worldCells << " cells, one "
+			<< gridResolution << " x " << gridResolution << " vertex grid of " << gridTiles * gridTiles << " primitives per cell, best of 3 runs\n";
+
+		struct Result
+		{
+			double p50Ms = 0.0;
+			double p99Ms = 0.0;
+			double maxMs = 0.0;
+			uint32_t framesOverBudget = 0;
+			uint64_t modelsLoaded = 0;
+			uint32_t maxResident = 0;
+			uint32_t drawsPerCell = 0;
+		};
+		struct Configuration
+		{
+			bool streamed;
+			uint32_t fileLoadingFlags;
+		};
+		const Configuration configurations[] =
+		{
+			{ false, vkglTF::FileLoadingFlags::None },
+			{ true, vkglTF::FileLoadingFlags::None },
+			{ true, vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::MergeStaticPrimitives },
+		};
+		std::vector<Result> results;
+		for (const Configuration& configuration : configurations)
+		{
+			const bool streamed = configuration.streamed;
+			Result best;
+			best.p99Ms = 1e30;
+			for (uint32_t run = 0; run < 3; run++)
+			{
+				SceneStreamer streamer;
+				streamer.settings.loaderThreads = streamed ? 2 : 0;
+				streamer.settings.uploadBudget = streamed ? 8 * 1024 * 1024 : VK_WHOLE_SIZE;
+				streamer.settings.fileLoadingFlags = configuration.fileLoadingFlags;
+				streamer.create(device, queue);
+				for (int32_t z = 0; z < worldCells; z++)
+				{
+					for (int32_t x = 0; x < worldCells; x++)
+					{
+						const glm::vec3 center((x + 0.5f) * streamer.settings.cellSize, 0.0f, (z + 0.5f) * streamer.settings.cellSize);
+						streamer.add(fileName, glm::translate(glm::mat4(1.0f), center));
+					}
+				}//for
+
+				Result result;
+				std::vector<double> frameTimes;
+				frameTimes.reserve(frames);
+				const float worldSize = worldCells * streamer.settings.cellSize;
+				auto nextFrame = std::chrono::steady_clock::now();
+				for (uint32_t frame = 0; frame < frames; frame++)
+				{
+					const float t = frame / static_cast<float>(std::max(frames - 1, 1u));
+					const glm::vec3 cameraPosition(worldSize * t, 20.0f, worldSize * t);
+					const glm::mat4 view = glm::translate(glm::mat4(1.0f), -cameraPosition);
+
+					auto tStart = std::chrono::high_resolution_clock::now();
+					streamer.update(view);
+					const double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+					frameTimes.push_back(ms);
+					result.framesOverBudget += (ms > frameBudgetMs) ? 1 : 0;
+					result.maxResident = std::max(result.maxResident, streamer.stats.residentModels);
+
+					nextFrame += std::chrono::microseconds(16667);
+					std::this_thread::sleep_until(nextFrame);
+				}//for
+				result.p50Ms = percentile(frameTimes, 0.5);
+				result.p99Ms = percentile(frameTimes, 0.99);
+				result.maxMs = percentile(frameTimes, 1.0);
+				result.modelsLoaded = streamer.stats.modelsLoaded;
+				// Every cell holds the same model, so any resident one tells the draws per cell
+				streamer.forEachResident([&](vkglTF::Model& model, const glm::mat4&)
+				{
+					uint32_t draws = 0;
+					model.meshes.forEach([&](vkglTF::MeshHandle, vkglTF::Mesh& mesh) { draws += static_cast<uint32_t>(mesh.primitives.size()); });
+					result.drawsPerCell = draws;
+				});
+				streamer.destroy();
+				if (result.p99Ms < best.p99Ms)
+				{
+					best = result;
+				}
+			}//for run
+			results.push_back(best);
+		}//for
+
+		out << std::fixed << std::setprecision(2);
+		out << "  " << std::left << std::setw(18) << "" << std::right << std::setw(12) << "in frame" << std::setw(12) << "streamed" << std::setw(12)
+			<< "merged" << "\n";
+		auto row = [&](const char* name, const std::function<void(const Result&)>& value)
+		{
+			out << "  " << std::left << std::setw(18) << name << std::right;
+			for (const Result& result : results)
+			{
+				out << std::setw(12);
+				value(result);
+			}
+			out << "\n";
+		};
+		row("p50 ms", [&](const Result& result) { out << result.p50Ms; });
+		row("p99 ms", [&](const Result& result) { out << result.p99Ms; });
+		row("max ms", [&](const Result& result) { out << result.maxMs; });
+		row("frames over 16.67", [&](const Result& result) { out << result.framesOverBudget; });
+		row("models loaded", [&](const Result& result) { out << result.modelsLoaded; });
+		row("max resident", [&](const Result& result) { out << result.maxResident; });
+		row("draws per cell", [&](const Result& result) { out << result.drawsPerCell; });
+		out << "  streamed p99 " << (results[1].p99Ms <= frameBudgetMs ? "fits" : "exceeds") << " the 16.67 ms frame budget\n";
+		out.flags(flags);
+		out.precision(precision);
+
+		std::remove(fileName.c_str());
+		std::remove(binaryName.c_str());
+	}
+}//vks
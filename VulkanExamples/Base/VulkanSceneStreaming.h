@@ -0,0 +1,156 @@
+/*
+* Scene streaming
+*
+* glTF models placed in the world are grouped into square cells on the x/z plane. Models of cells around the camera are parsed
+* on loader threads and uploaded by the frame loop within a byte budget per frame, models of cells the camera left are destroyed
+* a few frames later once no command buffer can use them anymore
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+#include "VulkanGeometryPool.h"
+#include "VulkanglTFModel.h"
+#include "ThreadPool.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	/**
+	* @brief Loads and unloads glTF models by world cell as the camera moves
+	* @note Destroying a model also destroys the global vkglTF descriptor set layouts, the next finished model creates them again.
+	* Pipeline layouts created from the old ones stay valid
+	*/
+	class SceneStreamer
+	{
+	public:
+		struct Settings
+		{
+			/** @brief Edge length of a cell in world units */
+			float cellSize = 64.0f;
+			/** @brief Cells closer to the camera than this are loaded */
+			float loadRadius = 128.0f;
+			/** @brief Cells farther away than this are unloaded, larger than loadRadius so cells on the border don't load and unload every frame */
+			float unloadRadius = 160.0f;
+			/** @brief 0 parses the models inside update on the calling thread */
+			uint32_t loaderThreads = 2;
+			/** @brief Maximum number of models parsed at the same time */
+			uint32_t maxPendingLoads = 8;
+			/** @brief Bytes uploaded per update, a model step larger than the budget is uploaded alone */
+			VkDeviceSize uploadBudget = 8 * 1024 * 1024;
+			/** @brief Number of updates (frames) an unloaded model is kept alive for command buffers in flight */
+			uint32_t retireFrames = 3;
+			uint32_t fileLoadingFlags = vkglTF::FileLoadingFlags::None;
+			float scale = 1.0f;
+		} settings;
+
+		enum class State : uint8_t { Unloaded, Parsing, Uploading, Resident, Failed };
+
+		struct Instance
+		{
+			std::string fileName;
+			glm::mat4 transform;
+			int32_t cellX;
+			int32_t cellZ;
+			State state = State::Unloaded;
+			std::unique_ptr<vkglTF::Model> model;
+			/** @brief The cell was left while the model was parsed, it is unloaded once the parse finished */
+			bool unloadRequested = false;
+		};
+
+		struct Stats
+		{
+			uint32_t residentModels = 0;
+			uint32_t parsingModels = 0;
+			uint32_t uploadingModels = 0;
+			/** @brief Unloaded models waiting for retireFrames to pass */
+			uint32_t retiredModels = 0;
+			uint64_t modelsLoaded = 0;
+			uint64_t modelsUnloaded = 0;
+			uint64_t failedLoads = 0;
+			uint64_t uploadedBytes = 0;
+			/** @brief Bytes uploaded by the last update */
+			VkDeviceSize frameUploadBytes = 0;
+			/** @brief Time the last update spent on uploads */
+			double frameUploadMs = 0.0;
+			/** @brief Average time spent parsing one model */
+			double averageParseMs = 0.0;
+		} stats;
+
+		vks::VulkanDevice* device = nullptr;
+		/** @brief If set, the models sub-allocate their geometry from the pool instead of creating buffers of their own */
+		vks::GeometryPool* geometryPool = nullptr;
+		std::vector<Instance> instances;
+
+		void create(vks::VulkanDevice* device, VkQueue queue);
+		void destroy();
+
+		/** @brief Place a model in the world, the cell is taken from the translation of the transform. Returns the index into instances */
+		uint32_t add(const std::string& fileName, const glm::mat4& transform);
+		/**
+		* @brief Request and unload models around the camera, upload parsed models and destroy retired ones, call once per frame before recording
+		* @return True if the set of resident models changed and command buffers drawing them have to be recorded again
+		*/
+		bool update(const glm::mat4& view);
+		/** @brief Calls function(model, transform) for every model that can be drawn */
+		void forEachResident(const std::function<void(vkglTF::Model& model, const glm::mat4& transform)>& function);
+
+	private:
+		struct ParsedModel
+		{
+			uint32_t instance;
+			bool success;
+		};
+		struct RetiredModel
+		{
+			std::unique_ptr<vkglTF::Model> model;
+			uint64_t frame;
+		};
+
+		VkQueue queue = VK_NULL_HANDLE;
+		uint32_t nextLoader = 0;
+
+		std::mutex completedMutex;
+		std::deque<ParsedModel> completedParses;
+		std::atomic<uint32_t> pendingParses{ 0 };
+		std::atomic<uint64_t> parseNanoseconds{ 0 };
+		uint64_t parsedModels = 0;
+
+		/** @brief Parsed models in upload order, the front one is uploaded first */
+		std::deque<uint32_t> uploads;
+		std::deque<RetiredModel> retired;
+		uint64_t frameIndex = 0;
+		// Declared last so its threads are joined before the state the parse jobs touch is destroyed
+		vks::ThreadPool loaderPool;
+
+		void requestLoad(uint32_t index);
+		void parse(uint32_t index, vkglTF::Model* model, const std::string& fileName);
+		void takeParsedModels();
+		void unload(uint32_t index);
+		float cellDistance(const Instance& instance, const glm::vec3& cameraPosition) const;
+	};
+
+	/**
+	* @brief Flies the camera over a grid of generated models at 60 frames per second, once loading inside the frame, once streamed
+	* with loader threads and an upload budget and once streamed with FileLoadingFlags::MergeStaticPrimitives, and reports the frame
+	* time percentiles of the streaming update and the draws per model
+	*/
+	void benchmarkStreaming(vks::VulkanDevice* device, VkQueue queue, std::ostream& out, uint32_t frames = 600);
+}//vks
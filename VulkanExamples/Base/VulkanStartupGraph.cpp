@@ -0,0 +1,296 @@
+/*
+* Startup task graph
+*
+* Runs the setup steps of an example as a dependency graph, independent steps execute concurrently on worker threads
+* and steps that need the window system or submit to a queue shared with other steps run on the calling thread.
+* Every step is timed for a per step startup timeline report
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanStartupGraph.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <thread>
+
+#include "VulkanTools.h"
+
+namespace vks
+{
+	namespace
+	{
+		// Width of the timeline bars in characters
+		const uint32_t timelineWidth = 48;
+		// Startup steps are short and mostly driver bound, more workers than this only add contention
+		const uint32_t maxDefaultWorkers = 4;
+	}
+
+	/**
+	* Add a task to the graph
+	*
+	* @param name Name shown in the timeline report
+	* @param function Work of the task
+	* @param dependencies Tasks that have to complete before this one starts
+	* @param affinity Any thread or the thread calling run()
+	* @return Id of the new task
+	*/
+	StartupGraph::TaskId StartupGraph::addTask(const std::string& name, std::function<void()> function, const std::vector<TaskId>& dependencies, Affinity affinity)
+	{
+		TaskId id = static_cast<TaskId>(tasks.size());
+		for (TaskId dependency : dependencies)
+		{
+			if (dependency >= id)
+			{
+				vks::tools::exitFatal("Startup task \"" + name + "\" depends on a task that has not been added yet", -1);
+			}
+		}
+
+		Task task;
+		task.name = name;
+		task.function = std::move(function);
+		task.dependencies = dependencies;
+		task.affinity = affinity;
+		tasks.push_back(std::move(task));
+		return id;
+	}
+
+	StartupGraph::TaskId StartupGraph::addJoin(const std::string& name, const std::vector<TaskId>& dependencies)
+	{
+		return addTask(name, nullptr, dependencies);
+	}
+
+	uint32_t StartupGraph::defaultWorkerCount()
+	{
+		// The calling thread takes part in the execution, so leave one hardware thread for it
+		uint32_t hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+		return std::min(hardwareThreads - 1, maxDefaultWorkers);
+	}
+
+	void StartupGraph::enqueue(TaskId task)
+	{
+		if (tasks[task].affinity == Affinity::MainThread)
+		{
+			readyMain.push_back(task);
+		}
+		else
+		{
+			readyAny.push_back(task);
+		}
+	}
+
+	/**
+	* Execute all tasks of the graph
+	*
+	* Ready tasks are taken from a shared queue by the workers and the calling thread, main thread tasks
+	* are only taken by the calling thread which prefers them over other ready tasks
+	*
+	* @param workerCount Number of worker threads started in addition to the calling thread
+	*/
+	void StartupGraph::run(uint32_t workerCount)
+	{
+		threadCount = workerCount + 1;
+		completed = 0;
+		readyAny.clear();
+		readyMain.clear();
+		pendingDependencies.assign(tasks.size(), 0);
+		dependents.assign(tasks.size(), std::vector<TaskId>());
+		for (TaskId i = 0; i < static_cast<TaskId>(tasks.size()); i++)
+		{
+			pendingDependencies[i] = static_cast<uint32_t>(tasks[i].dependencies.size());
+			for (TaskId dependency : tasks[i].dependencies)
+			{
+				dependents[dependency].push_back(i);
+			}
+			if (pendingDependencies[i] == 0)
+			{
+				enqueue(i);
+			}
+		}
+
+		startTime = std::chrono::high_resolution_clock::now();
+
+		std::vector<std::thread> workers;
+		workers.reserve(workerCount);
+		for (uint32_t i = 0; i < workerCount; i++)
+		{
+			workers.emplace_back(&StartupGraph::execute, this, i + 1);
+		}
+		execute(0);
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+
+		wallMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	}
+
+	void StartupGraph::execute(uint32_t thread)
+	{
+		const bool mainThread = (thread == 0);
+		if (!mainThread)
+		{
+			threading::ThreadPlacement placement = workerPlacement;
+			if (!placement.name.empty())
+			{
+				placement.name += " " + std::to_string(thread - 1);
+			}
+			threading::applyPlacement(placement, thread - 1);
+		}
+
+		while (true)
+		{
+			TaskId id;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [&] { return completed == tasks.size() || !readyAny.empty() || (mainThread && !readyMain.empty()); });
+				if (completed == tasks.size())
+				{
+					return;
+				}
+				std::deque<TaskId>& queue = (mainThread && !readyMain.empty()) ? readyMain : readyAny;
+				id = queue.front();
+				queue.pop_front();
+			}
+
+			// Each task is only touched by the thread executing it until its completion is published under the lock
+			Task& task = tasks[id];
+			task.thread = thread;
+			task.startMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+			if (task.function)
+			{
+				task.function();
+			}
+			task.endMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				completed++;
+				for (TaskId dependent : dependents[id])
+				{
+					if (--pendingDependencies[dependent] == 0)
+					{
+						enqueue(dependent);
+					}
+				}
+			}
+			condition.notify_all();
+		}//while
+	}
+
+	double StartupGraph::serialMilliseconds() const
+	{
+		double sum = 0.0;
+		for (auto& task : tasks)
+		{
+			sum += task.endMs - task.startMs;
+		}
+		return sum;
+	}
+
+	/**
+	* Longest chain of dependent tasks weighted by their measured durations
+	*
+	* @param path (Optional) Receives the tasks of the chain in execution order
+	* @return Summed duration of the chain in milliseconds
+	*/
+	double StartupGraph::criticalPathMilliseconds(std::vector<TaskId>* path) const
+	{
+		// Dependencies always have lower ids, so a single pass in id order visits them first
+		std::vector<double> finish(tasks.size(), 0.0);
+		std::vector<TaskId> predecessor(tasks.size(), UINT32_MAX);
+		TaskId last = UINT32_MAX;
+		for (TaskId i = 0; i < static_cast<TaskId>(tasks.size()); i++)
+		{
+			double start = 0.0;
+			for (TaskId dependency : tasks[i].dependencies)
+			{
+				if (finish[dependency] > start || predecessor[i] == UINT32_MAX)
+				{
+					start = std::max(start, finish[dependency]);
+					predecessor[i] = dependency;
+				}
+			}
+			finish[i] = start + (tasks[i].endMs - tasks[i].startMs);
+			if (last == UINT32_MAX || finish[i] > finish[last])
+			{
+				last = i;
+			}
+		}
+
+		if (last == UINT32_MAX)
+		{
+			return 0.0;
+		}
+		if (path)
+		{
+			path->clear();
+			for (TaskId i = last; i != UINT32_MAX; i = predecessor[i])
+			{
+				path->push_back(i);
+			}
+			std::reverse(path->begin(), path->end());
+		}
+		return finish[last];
+	}
+
+	/**
+	* Print one line per task in start order with its thread, start, duration and a bar on a shared time axis,
+	* followed by the wall time, the serial time and the critical path
+	*/
+	void StartupGraph::printTimeline(std::ostream& out) const
+	{
+		std::vector<TaskId> order;
+		size_t nameWidth = 4;
+		for (TaskId i = 0; i < static_cast<TaskId>(tasks.size()); i++)
+		{
+			// Joins carry no work and would only clutter the report
+			if (tasks[i].function)
+			{
+				order.push_back(i);
+				nameWidth = std::max(nameWidth, tasks[i].name.size());
+			}
+		}
+		std::sort(order.begin(), order.end(), [this](TaskId a, TaskId b) { return tasks[a].startMs < tasks[b].startMs; });
+
+		const double scale = (wallMs > 0.0) ? timelineWidth / wallMs : 0.0;
+		std::ios_base::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+		out << std::fixed << std::setprecision(2);
+
+		out << "Startup timeline (" << threadCount << " threads)\n";
+		out << "  " << std::left << std::setw(nameWidth) << "step" << std::right << "  thread   start ms     ms\n";
+		for (TaskId i : order)
+		{
+			const Task& task = tasks[i];
+			uint32_t begin = std::min(static_cast<uint32_t>(task.startMs * scale), timelineWidth - 1);
+			uint32_t end = std::max(std::min(static_cast<uint32_t>(task.endMs * scale + 0.5), timelineWidth), begin + 1);
+			std::string bar(timelineWidth, ' ');
+			std::fill(bar.begin() + begin, bar.begin() + end, '#');
+
+			out << "  " << std::left << std::setw(nameWidth) << task.name << std::right
+				<< "  " << std::setw(6) << (task.thread == 0 ? std::string("main") : std::to_string(task.thread))
+				<< std::setw(11) << task.startMs
+				<< std::setw(7) << (task.endMs - task.startMs)
+				<< "  |" << bar << "|\n";
+		}
+
+		std::vector<TaskId> path;
+		double criticalPath = criticalPathMilliseconds(&path);
+		double serial = serialMilliseconds();
+		out << "  wall " << wallMs << " ms, serial " << serial << " ms (" << ((wallMs > 0.0) ? serial / wallMs : 1.0) << "x), critical path " << criticalPath << " ms:";
+		bool first = true;
+		for (TaskId i : path)
+		{
+			if (tasks[i].function)
+			{
+				out << (first ? " " : " > ") << tasks[i].name;
+				first = false;
+			}
+		}
+		out << "\n";
+
+		out.flags(flags);
+		out.precision(precision);
+	}
+}//vks
@@ -0,0 +1,88 @@
+/*
+* Startup task graph
+*
+* Runs the setup steps of an example as a dependency graph, independent steps execute concurrently on worker threads
+* and steps that need the window system or submit to a queue shared with other steps run on the calling thread.
+* Every step is timed for a per step startup timeline report
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ThreadAffinity.h"
+
+namespace vks
+{
+	class StartupGraph
+	{
+	public:
+		typedef uint32_t TaskId;
+
+		enum class Affinity
+		{
+			/** @brief May run on any thread */
+			Any,
+			/** @brief Runs on the thread calling run(), for window system calls and work using the device's command pool or a shared queue */
+			MainThread
+		};
+
+		struct Task
+		{
+			std::string name;
+			std::function<void()> function;
+			std::vector<TaskId> dependencies;
+			Affinity affinity = Affinity::Any;
+			/** @brief Milliseconds since the start of run() */
+			double startMs = 0.0;
+			double endMs = 0.0;
+			/** @brief 0 for the thread calling run(), 1..n for the workers */
+			uint32_t thread = 0;
+		};
+
+		std::vector<Task> tasks;
+		/** @brief Pinning, priority and name applied by every worker thread when it starts, the worker index is appended to the name */
+		threading::ThreadPlacement workerPlacement;
+
+		/** @brief Dependencies must have been added before, which keeps the graph acyclic */
+		TaskId addTask(const std::string& name, std::function<void()> function, const std::vector<TaskId>& dependencies = {}, Affinity affinity = Affinity::Any);
+		/** @brief Adds a task without work that completes once all of its dependencies completed */
+		TaskId addJoin(const std::string& name, const std::vector<TaskId>& dependencies);
+
+		/** @brief Executes all tasks and returns after the last one finished, without workers the graph runs serially on the calling thread */
+		void run(uint32_t workerCount = defaultWorkerCount());
+		static uint32_t defaultWorkerCount();
+
+		double wallMilliseconds() const { return wallMs; }
+		/** @brief Sum of all task durations, i.e. the startup time of a serial execution */
+		double serialMilliseconds() const;
+		/** @brief Longest chain of dependent tasks, the lower bound of the wall time with unlimited threads */
+		double criticalPathMilliseconds(std::vector<TaskId>* path = nullptr) const;
+		void printTimeline(std::ostream& out = std::cout) const;
+
+	private:
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::deque<TaskId> readyAny;
+		std::deque<TaskId> readyMain;
+		std::vector<uint32_t> pendingDependencies;
+		std::vector<std::vector<TaskId>> dependents;
+		size_t completed = 0;
+		uint32_t threadCount = 1;
+		double wallMs = 0.0;
+		std::chrono::high_resolution_clock::time_point startTime;
+
+		void execute(uint32_t thread);
+		void enqueue(TaskId task);
+	};
+}//vks
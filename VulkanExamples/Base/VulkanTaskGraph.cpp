@@ -0,0 +1,444 @@
+/*
+* Frame task graph
+*
+* Reusable dependency graph of per frame work executed on persistent worker threads, ready nodes are scheduled
+* longest remaining path first and submit nodes fire as soon as their inputs completed
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanTaskGraph.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+#include "VulkanTools.h"
+
+namespace vks
+{
+	namespace
+	{
+		// Cost of nodes that have not been measured yet, so the first executions are ordered by path length
+		const double unmeasuredNodeMs = 0.01;
+
+		std::string escapeLabel(const std::string& text)
+		{
+			std::string escaped;
+			for (char c : text)
+			{
+				if (c == '"' || c == '\\')
+				{
+					escaped += '\\';
+				}
+				escaped += c;
+			}
+			return escaped;
+		}
+	}
+
+	TaskGraph::~TaskGraph()
+	{
+		destroy();
+	}
+
+	/**
+	* Add a node to the graph, only valid before compile()
+	*
+	* @param name Name used in the graph dump
+	* @param function Work of the node
+	* @param dependencies Nodes that have to complete before this one starts
+	* @param affinity Any thread or the thread calling execute()
+	* @return Id of the new node
+	*/
+	TaskGraph::NodeId TaskGraph::addNode(const std::string& name, std::function<void()> function, const std::vector<NodeId>& dependencies, Affinity affinity)
+	{
+		if (compiled)
+		{
+			vks::tools::exitFatal("Task graph node \"" + name + "\" added after the graph has been compiled", -1);
+		}
+		NodeId id = static_cast<NodeId>(nodes.size());
+		for (NodeId dependency : dependencies)
+		{
+			if (dependency >= id)
+			{
+				vks::tools::exitFatal("Task graph node \"" + name + "\" depends on a node that has not been added yet", -1);
+			}
+		}
+
+		Node node;
+		node.name = name;
+		node.function = std::move(function);
+		node.dependencies = dependencies;
+		node.affinity = affinity;
+		nodes.push_back(std::move(node));
+		return id;
+	}
+
+	/**
+	* Add a node that submits work to a queue
+	*
+	* @param name Name used in the graph dump
+	* @param queue Queue passed to the submit function
+	* @param submit Function doing the submission, called with the queue lock held
+	* @param dependencies Nodes producing the inputs of the submission (e.g. recording its command buffers)
+	* @param affinity Any thread or the thread calling execute()
+	* @return Id of the new node
+	*/
+	TaskGraph::NodeId TaskGraph::addSubmitNode(const std::string& name, VkQueue queue, std::function<void(VkQueue)> submit, const std::vector<NodeId>& dependencies, Affinity affinity)
+	{
+		NodeId id = addNode(name, [submit, queue] { submit(queue); }, dependencies, affinity);
+		nodes[id].queue = queue;
+		return id;
+	}
+
+	/**
+	* Build the dependents, queue locks and initial priorities and start the workers
+	*
+	* @param workerCount Number of worker threads started in addition to the thread calling execute()
+	*/
+	void TaskGraph::compile(uint32_t workerCount)
+	{
+		dependencyCounts.assign(nodes.size(), 0);
+		pendingDependencies.assign(nodes.size(), 0);
+		nodeQueueLocks.assign(nodes.size(), UINT32_MAX);
+		roots.clear();
+		queueLocks.clear();
+
+		for (NodeId i = 0; i < static_cast<NodeId>(nodes.size()); i++)
+		{
+			Node& node = nodes[i];
+			node.dependents.clear();
+			dependencyCounts[i] = static_cast<uint32_t>(node.dependencies.size());
+			for (NodeId dependency : node.dependencies)
+			{
+				nodes[dependency].dependents.push_back(i);
+			}
+			if (node.dependencies.empty())
+			{
+				roots.push_back(i);
+			}
+			if (node.estimatedMs <= 0.0)
+			{
+				node.estimatedMs = unmeasuredNodeMs;
+			}
+
+			if (node.queue != VK_NULL_HANDLE)
+			{
+				auto lock = std::find_if(queueLocks.begin(), queueLocks.end(), [&](const QueueLock& queueLock) { return queueLock.queue == node.queue; });
+				if (lock == queueLocks.end())
+				{
+					QueueLock queueLock;
+					queueLock.queue = node.queue;
+					queueLock.mutex.reset(new std::mutex());
+					queueLocks.push_back(std::move(queueLock));
+					lock = queueLocks.end() - 1;
+				}
+				nodeQueueLocks[i] = static_cast<uint32_t>(lock - queueLocks.begin());
+			}
+		}
+
+		// Reserve the ready lists once so executions never allocate
+		readyAny.reserve(nodes.size());
+		readyMain.reserve(nodes.size());
+		updatePriorities();
+
+		compiled = true;
+		stopping = false;
+		workers.reserve(workerCount);
+		for (uint32_t i = 0; i < workerCount; i++)
+		{
+			workers.emplace_back(&TaskGraph::workerLoop, this, i + 1);
+		}
+	}
+
+	void TaskGraph::destroy()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		condition.notify_all();
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+		workers.clear();
+		nodes.clear();
+		queueLocks.clear();
+		compiled = false;
+		executions = 0;
+	}
+
+	/**
+	* Priority of a node is its estimated duration plus the largest priority of its dependents,
+	* so the ready node heading the longest remaining chain is started first
+	*/
+	void TaskGraph::updatePriorities()
+	{
+		// Dependents always have higher ids, so a reverse pass visits them first
+		for (size_t i = nodes.size(); i-- > 0;)
+		{
+			double remaining = 0.0;
+			for (NodeId dependent : nodes[i].dependents)
+			{
+				remaining = std::max(remaining, nodes[dependent].priority);
+			}
+			nodes[i].priority = nodes[i].estimatedMs + remaining;
+		}
+	}
+
+	void TaskGraph::push(NodeId id)
+	{
+		std::vector<NodeId>& ready = (nodes[id].affinity == Affinity::MainThread) ? readyMain : readyAny;
+		ready.push_back(id);
+		std::push_heap(ready.begin(), ready.end(), [this](NodeId a, NodeId b) { return nodes[a].priority < nodes[b].priority; });
+	}
+
+	TaskGraph::NodeId TaskGraph::popAny()
+	{
+		std::pop_heap(readyAny.begin(), readyAny.end(), [this](NodeId a, NodeId b) { return nodes[a].priority < nodes[b].priority; });
+		NodeId id = readyAny.back();
+		readyAny.pop_back();
+		return id;
+	}
+
+	void TaskGraph::runNode(NodeId id, uint32_t thread)
+	{
+		// The node is only touched by this thread until its completion is published under the graph lock
+		Node& node = nodes[id];
+		node.thread = thread;
+		node.startMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+		if (nodeQueueLocks[id] != UINT32_MAX)
+		{
+			std::lock_guard<std::mutex> queueLock(*queueLocks[nodeQueueLocks[id]].mutex);
+			node.function();
+		}
+		else if (node.function)
+		{
+			node.function();
+		}
+		node.endMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			completed++;
+			for (NodeId dependent : node.dependents)
+			{
+				if (--pendingDependencies[dependent] == 0)
+				{
+					push(dependent);
+				}
+			}
+		}
+		condition.notify_all();
+	}
+
+	void TaskGraph::workerLoop(uint32_t thread)
+	{
+		threading::ThreadPlacement placement = workerPlacement;
+		if (!placement.name.empty())
+		{
+			placement.name += " " + std::to_string(thread - 1);
+		}
+		threading::applyPlacement(placement, thread - 1);
+
+		while (true)
+		{
+			NodeId id;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this] { return stopping || !readyAny.empty(); });
+				if (stopping)
+				{
+					return;
+				}
+				id = popAny();
+			}
+			runNode(id, thread);
+		}//while
+	}
+
+	/**
+	* Run every node of the graph once
+	*
+	* The calling thread runs main thread nodes as soon as they are ready and helps with other nodes in between,
+	* afterwards the measured durations are folded into the cost estimates used to order the next execution
+	*/
+	void TaskGraph::execute()
+	{
+		if (!compiled)
+		{
+			vks::tools::exitFatal("Task graph executed before it has been compiled", -1);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			std::copy(dependencyCounts.begin(), dependencyCounts.end(), pendingDependencies.begin());
+			completed = 0;
+			readyAny.clear();
+			readyMain.clear();
+			startTime = std::chrono::high_resolution_clock::now();
+			for (NodeId root : roots)
+			{
+				push(root);
+			}
+		}
+		condition.notify_all();
+
+		while (true)
+		{
+			NodeId id;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this] { return completed == nodes.size() || !readyMain.empty() || !readyAny.empty(); });
+				if (completed == nodes.size())
+				{
+					break;
+				}
+				if (!readyMain.empty())
+				{
+					std::pop_heap(readyMain.begin(), readyMain.end(), [this](NodeId a, NodeId b) { return nodes[a].priority < nodes[b].priority; });
+					id = readyMain.back();
+					readyMain.pop_back();
+				}
+				else
+				{
+					id = popAny();
+				}
+			}
+			runNode(id, 0);
+		}//while
+
+		wallMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+		executions++;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto& node : nodes)
+		{
+			double duration = node.endMs - node.startMs;
+			node.estimatedMs = (executions == 1) ? duration : node.estimatedMs + (duration - node.estimatedMs) * smoothing;
+		}
+		updatePriorities();
+	}
+
+	/**
+	* Longest chain of dependent nodes weighted by the durations of the last execution
+	*
+	* @param path (Optional) Receives the nodes of the chain in execution order
+	* @return Summed duration of the chain in milliseconds
+	*/
+	double TaskGraph::criticalPathMilliseconds(std::vector<NodeId>* path) const
+	{
+		std::vector<double> finish(nodes.size(), 0.0);
+		std::vector<NodeId> predecessor(nodes.size(), UINT32_MAX);
+		NodeId last = UINT32_MAX;
+		for (NodeId i = 0; i < static_cast<NodeId>(nodes.size()); i++)
+		{
+			double start = 0.0;
+			for (NodeId dependency : nodes[i].dependencies)
+			{
+				if (finish[dependency] > start || predecessor[i] == UINT32_MAX)
+				{
+					start = std::max(start, finish[dependency]);
+					predecessor[i] = dependency;
+				}
+			}
+			finish[i] = start + (nodes[i].endMs - nodes[i].startMs);
+			if (last == UINT32_MAX || finish[i] > finish[last])
+			{
+				last = i;
+			}
+		}
+
+		if (last == UINT32_MAX)
+		{
+			return 0.0;
+		}
+		if (path)
+		{
+			path->clear();
+			for (NodeId i = last; i != UINT32_MAX; i = predecessor[i])
+			{
+				path->push_back(i);
+			}
+			std::reverse(path->begin(), path->end());
+		}
+		return finish[last];
+	}
+
+	/**
+	* Write the graph of the last execution in Graphviz dot format (render with e.g. "dot -Tsvg graph.dot -o graph.svg")
+	*
+	* Every node shows its start, duration and thread, submit nodes and main thread nodes get their own color
+	* and the nodes and edges of the critical path are drawn in red
+	*/
+	void TaskGraph::dumpDot(std::ostream& out) const
+	{
+		std::vector<NodeId> path;
+		double criticalPath = criticalPathMilliseconds(&path);
+		std::vector<bool> critical(nodes.size(), false);
+		std::vector<NodeId> criticalNext(nodes.size(), UINT32_MAX);
+		for (size_t i = 0; i < path.size(); i++)
+		{
+			critical[path[i]] = true;
+			if (i + 1 < path.size())
+			{
+				criticalNext[path[i]] = path[i + 1];
+			}
+		}
+
+		std::ios_base::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+		out << std::fixed << std::setprecision(3);
+
+		out << "digraph TaskGraph\n{\n";
+		out << "\trankdir=LR;\n";
+		out << "\tlabel=\"execution " << executions << ", wall " << wallMs << " ms, critical path " << criticalPath << " ms, "
+			<< (workers.size() + 1) << " threads\";\n";
+		out << "\tnode [shape=box, style=\"rounded,filled\", fontname=\"Helvetica\"];\n";
+
+		for (NodeId i = 0; i < static_cast<NodeId>(nodes.size()); i++)
+		{
+			const Node& node = nodes[i];
+			const char* fillColor = (node.queue != VK_NULL_HANDLE) ? "#f8cbad" : (node.affinity == Affinity::MainThread) ? "#bdd7ee" : "#e2f0d9";
+			out << "\tn" << i << " [label=\"" << escapeLabel(node.name)
+				<< "\\n" << (node.endMs - node.startMs) << " ms at " << node.startMs << " ms"
+				<< "\\nthread " << (node.thread == 0 ? std::string("main") : std::to_string(node.thread)) << "\""
+				<< ", fillcolor=\"" << fillColor << "\"";
+			if (critical[i])
+			{
+				out << ", color=red, penwidth=2";
+			}
+			out << "];\n";
+		}
+
+		for (NodeId i = 0; i < static_cast<NodeId>(nodes.size()); i++)
+		{
+			for (NodeId dependent : nodes[i].dependents)
+			{
+				out << "\tn" << i << " -> n" << dependent;
+				if (criticalNext[i] == dependent)
+				{
+					out << " [color=red, penwidth=2]";
+				}
+				out << ";\n";
+			}
+		}
+		out << "}\n";
+
+		out.flags(flags);
+		out.precision(precision);
+	}
+
+	bool TaskGraph::dumpDot(const std::string& fileName) const
+	{
+		std::ofstream file(fileName);
+		if (!file.is_open())
+		{
+			return false;
+		}
+		dumpDot(file);
+		return true;
+	}
+}//vks
@@ -0,0 +1,135 @@
+/*
+* Frame task graph
+*
+* Reusable dependency graph of per frame work executed on persistent worker threads, ready nodes are scheduled
+* longest remaining path first and submit nodes fire as soon as their inputs completed
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+#include "ThreadAffinity.h"
+
+namespace vks
+{
+	/**
+	* @brief Graph of named nodes with dependencies that is built once and executed every frame
+	* @note The graph is immutable after compile(), execute() does not allocate
+	*/
+	class TaskGraph
+	{
+	public:
+		typedef uint32_t NodeId;
+
+		enum class Affinity
+		{
+			/** @brief May run on any thread */
+			Any,
+			/** @brief Runs on the thread calling execute(), e.g. for swap chain acquire and present */
+			MainThread
+		};
+
+		struct Node
+		{
+			std::string name;
+			std::function<void()> function;
+			std::vector<NodeId> dependencies;
+			std::vector<NodeId> dependents;
+			Affinity affinity = Affinity::Any;
+			/** @brief Queue a submit node submits to, VK_NULL_HANDLE for other nodes */
+			VkQueue queue = VK_NULL_HANDLE;
+			/** @brief Smoothed measured duration, the cost estimate for scheduling */
+			double estimatedMs = 0.0;
+			/** @brief Estimated length of the longest path from the start of this node to the end of the graph */
+			double priority = 0.0;
+			/** @brief Timings of the last execution in milliseconds since its start */
+			double startMs = 0.0;
+			double endMs = 0.0;
+			/** @brief 0 for the thread calling execute(), 1..n for the workers */
+			uint32_t thread = 0;
+		};
+
+		std::vector<Node> nodes;
+		/** @brief Weight of the latest measurement in the smoothed node durations */
+		double smoothing = 0.1;
+		/** @brief Pinning, priority and name applied by every worker thread when compile() starts it, the worker index is appended to the name */
+		threading::ThreadPlacement workerPlacement;
+
+		TaskGraph() = default;
+		TaskGraph(const TaskGraph&) = delete;
+		TaskGraph& operator=(const TaskGraph&) = delete;
+		~TaskGraph();
+
+		/** @brief Dependencies must have been added before, which keeps the graph acyclic */
+		NodeId addNode(const std::string& name, std::function<void()> function, const std::vector<NodeId>& dependencies = {}, Affinity affinity = Affinity::Any);
+		/**
+		* @brief Adds a node that submits to a queue
+		* @note Submit nodes of the same queue are serialized by a per queue lock, so the queue is externally synchronized
+		*/
+		NodeId addSubmitNode(const std::string& name, VkQueue queue, std::function<void(VkQueue)> submit, const std::vector<NodeId>& dependencies = {}, Affinity affinity = Affinity::Any);
+
+		/** @brief Finalizes the graph and starts the workers, the calling thread takes part in every execution */
+		void compile(uint32_t workerCount);
+		/** @brief Runs every node once and returns after the last one finished */
+		void execute();
+		/** @brief Stops the workers and clears the graph */
+		void destroy();
+
+		uint64_t executionCount() const { return executions; }
+		double wallMilliseconds() const { return wallMs; }
+		/** @brief Longest chain of dependent nodes of the last execution */
+		double criticalPathMilliseconds(std::vector<NodeId>* path = nullptr) const;
+
+		/** @brief Writes the last execution as a Graphviz graph, nodes carry their timings and the critical path is highlighted */
+		void dumpDot(std::ostream& out) const;
+		bool dumpDot(const std::string& fileName) const;
+
+	private:
+		struct QueueLock
+		{
+			VkQueue queue;
+			std::unique_ptr<std::mutex> mutex;
+		};
+
+		std::vector<std::thread> workers;
+		std::vector<QueueLock> queueLocks;
+		std::vector<uint32_t> nodeQueueLocks;
+		std::vector<uint32_t> dependencyCounts;
+		std::vector<uint32_t> pendingDependencies;
+		std::vector<NodeId> roots;
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		/** @brief Binary heap ordered by Node::priority */
+		std::vector<NodeId> readyAny;
+		std::vector<NodeId> readyMain;
+		size_t completed = 0;
+		bool running = false;
+		bool stopping = false;
+		bool compiled = false;
+
+		uint64_t executions = 0;
+		double wallMs = 0.0;
+		std::chrono::high_resolution_clock::time_point startTime;
+
+		void workerLoop(uint32_t thread);
+		void runNode(NodeId id, uint32_t thread);
+		void push(NodeId id);
+		NodeId popAny();
+		void updatePriorities();
+	};
+}//vks
@@ -0,0 +1,1053 @@
+/*
+* Streaming terrain
+*
+* CPU quadtree over a tiled heightmap file, tiles are loaded asynchronously on a thread pool and selected per frame
+* by frustum and screen space error, selected tiles are drawn as tessellated patches with factors derived from the
+* projected edge length
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanTerrain.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "frustum.hpp"
+#include "VulkanGpuTimer.h"
+
+namespace vks
+{
+	namespace
+	{
+		// Tiles uploaded per update, also sizes the staging buffer
+		const uint32_t maxUploadsPerUpdate = 8;
+
+		uint32_t log2(uint32_t value)
+		{
+			uint32_t result = 0;
+			while (value > 1)
+			{
+				value >>= 1;
+				result++;
+			}
+			return result;
+		}
+
+		/** @brief Rolling hills with ridges, enough detail that the finest levels carry geometric error everywhere */
+		std::vector<uint16_t> generateHeights(uint32_t size)
+		{
+			std::vector<uint16_t> heights(static_cast<size_t>(size) * size);
+			for (uint32_t y = 0; y < size; y++)
+			{
+				for (uint32_t x = 0; x < size; x++)
+				{
+					const float u = static_cast<float>(x) / (size - 1);
+					const float v = static_cast<float>(y) / (size - 1);
+					float height = 0.0f;
+					float amplitude = 0.5f;
+					float frequency = 3.0f;
+					for (uint32_t octave = 0; octave < 6; octave++)
+					{
+						height += amplitude * std::sin(u * frequency * 6.2831853f + octave) * std::cos(v * frequency * 6.2831853f - octave * 0.7f);
+						amplitude *= 0.5f;
+						frequency *= 2.1f;
+					}
+					heights[static_cast<size_t>(y) * size + x] = static_cast<uint16_t>(glm::clamp(0.5f + height * 0.5f, 0.0f, 1.0f) * UINT16_MAX);
+				}
+			}//for
+			return heights;
+		}
+	}
+
+	namespace terrainfile
+	{
+		/**
+		* Convert a square heightmap into the tiled quadtree format
+		*
+		* @param fileName Output file
+		* @param heights Row major 16 bit heights
+		* @param size Edge length of the heightmap, (size - 1) / (tileResolution - 1) must be a power of two
+		* @param tileResolution Samples per tile edge, including the border shared with the neighbouring tiles
+		* @param worldSize Edge length of the terrain in world units
+		* @param heightScale World space height of the largest sample value
+		*
+		* @return False if the dimensions do not match or the file could not be written
+		*/
+		bool write(const std::string& fileName, const uint16_t* heights, uint32_t size, uint32_t tileResolution, float worldSize, float heightScale)
+		{
+			if (tileResolution < 2 || size < tileResolution || (size - 1) % (tileResolution - 1) != 0)
+			{
+				return false;
+			}
+			const uint32_t finestTiles = (size - 1) / (tileResolution - 1);
+			if ((finestTiles & (finestTiles - 1)) != 0)
+			{
+				return false;
+			}
+
+			Header header{};
+			header.magic = magic;
+			header.version = version;
+			header.tileResolution = tileResolution;
+			header.levelCount = log2(finestTiles) + 1;
+			header.worldSize = worldSize;
+			header.heightScale = heightScale;
+
+			const uint32_t tileBytes = tileResolution * tileResolution * sizeof(uint16_t);
+			std::vector<TileEntry> directory(nodeCount(header.levelCount));
+			uint64_t offset = sizeof(Header) + directory.size() * sizeof(TileEntry);
+
+			std::ofstream file(fileName, std::ios::binary);
+			if (!file.is_open())
+			{
+				return false;
+			}
+			// The directory is written once all tiles are known
+			file.seekp(offset);
+
+			std::vector<uint16_t> samples(tileResolution * tileResolution);
+			for (uint32_t level = 0; level < header.levelCount; level++)
+			{
+				const uint32_t step = 1u << (header.levelCount - 1 - level);
+				const uint32_t tilesPerEdge = 1u << level;
+				for (uint32_t y = 0; y < tilesPerEdge; y++)
+				{
+					for (uint32_t x = 0; x < tilesPerEdge; x++)
+					{
+						const uint32_t originX = x * (tileResolution - 1) * step;
+						const uint32_t originY = y * (tileResolution - 1) * step;
+						for (uint32_t j = 0; j < tileResolution; j++)
+						{
+							for (uint32_t i = 0; i < tileResolution; i++)
+							{
+								samples[j * tileResolution + i] = heights[(originY + j * step) * size + originX + i * step];
+							}
+						}
+
+						// Bounds and error are measured against the full resolution data the tile stands in for
+						TileEntry& entry = directory[nodeIndex(level, x, y)];
+						entry.offset = offset;
+						entry.size = tileBytes;
+						entry.minHeight = UINT16_MAX;
+						entry.maxHeight = 0;
+						float maxError = 0.0f;
+						const uint32_t span = (tileResolution - 1) * step;
+						for (uint32_t sy = 0; sy <= span; sy++)
+						{
+							for (uint32_t sx = 0; sx <= span; sx++)
+							{
+								const uint16_t height = heights[(originY + sy) * size + originX + sx];
+								entry.minHeight = std::min(entry.minHeight, height);
+								entry.maxHeight = std::max(entry.maxHeight, height);
+
+								const uint32_t i = std::min(sx / step, tileResolution - 2);
+								const uint32_t j = std::min(sy / step, tileResolution - 2);
+								const float fx = static_cast<float>(sx - i * step) / step;
+								const float fy = static_cast<float>(sy - j * step) / step;
+								const float top = glm::mix(static_cast<float>(samples[j * tileResolution + i]), static_cast<float>(samples[j * tileResolution + i + 1]), fx);
+								const float bottom = glm::mix(static_cast<float>(samples[(j + 1) * tileResolution + i]), static_cast<float>(samples[(j + 1) * tileResolution + i + 1]), fx);
+								maxError = std::max(maxError, std::abs(glm::mix(top, bottom, fy) - height));
+							}
+						}
+						entry.geometricError = maxError / static_cast<float>(UINT16_MAX);
+
+						file.write(reinterpret_cast<const char*>(samples.data()), tileBytes);
+						offset += tileBytes;
+					}//for
+				}//for
+			}//for
+
+			file.seekp(0);
+			file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+			file.write(reinterpret_cast<const char*>(directory.data()), directory.size() * sizeof(TileEntry));
+			return file.good();
+		}
+	}
+
+	/**
+	* Read the header and tile directory and build the quadtree, tile data is loaded on demand
+	*
+	* @return False if the file is missing or not a tiled heightmap
+	*/
+	bool StreamingTerrain::open(const std::string& fileName)
+	{
+		std::ifstream file(fileName, std::ios::binary);
+		if (!file.is_open())
+		{
+			return false;
+		}
+		file.read(reinterpret_cast<char*>(&header), sizeof(terrainfile::Header));
+		if (!file || header.magic != terrainfile::magic || header.version != terrainfile::version || header.levelCount == 0 || header.levelCount > 12)
+		{
+			return false;
+		}
+		directory.resize(terrainfile::nodeCount(header.levelCount));
+		file.read(reinterpret_cast<char*>(directory.data()), directory.size() * sizeof(terrainfile::TileEntry));
+		if (!file)
+		{
+			return false;
+		}
+		this->fileName = fileName;
+
+		nodes.resize(directory.size());
+		const float halfSize = header.worldSize * 0.5f;
+		for (uint32_t level = 0; level < header.levelCount; level++)
+		{
+			const uint32_t tilesPerEdge = 1u << level;
+			const float tileSize = header.worldSize / tilesPerEdge;
+			for (uint32_t y = 0; y < tilesPerEdge; y++)
+			{
+				for (uint32_t x = 0; x < tilesPerEdge; x++)
+				{
+					const uint32_t index = terrainfile::nodeIndex(level, x, y);
+					const terrainfile::TileEntry& entry = directory[index];
+					Node& node = nodes[index];
+					node.level = level;
+					node.x = x;
+					node.y = y;
+					// A negative height scale flips the terrain for y down cameras, so the bounds are sorted
+					const float h0 = entry.minHeight / static_cast<float>(UINT16_MAX) * header.heightScale;
+					const float h1 = entry.maxHeight / static_cast<float>(UINT16_MAX) * header.heightScale;
+					node.boundsMin = glm::vec3(-halfSize + x * tileSize, std::min(h0, h1), -halfSize + y * tileSize);
+					node.boundsMax = glm::vec3(-halfSize + (x + 1) * tileSize, std::max(h0, h1), -halfSize + (y + 1) * tileSize);
+					node.geometricError = entry.geometricError * std::abs(header.heightScale);
+				}//for
+			}//for
+		}//for
+		return true;
+	}
+
+	/**
+	* Create the height atlas, buffers and pipelines and load the root tile synchronously
+	*
+	* @param device Device, tessellationShader must be enabled (fillModeNonSolid for the wireframe pipeline)
+	* @param queue Queue used for the tile uploads
+	* @param renderPass Render pass the terrain is drawn in
+	* @param pipelineCache Pipeline cache used for the pipelines
+	* @param shadersPath Base path of the GLSL shaders (getShadersPath())
+	*/
+	void StreamingTerrain::prepare(vks::VulkanDevice* device, VkQueue queue, VkRenderPass renderPass, VkPipelineCache pipelineCache, const std::string& shadersPath)
+	{
+		this->device = device;
+		this->queue = queue;
+		if (nodes.empty())
+		{
+			vks::tools::exitFatal("Terrain must be opened before it is prepared", -1);
+		}
+		if (!device->m_enabledDeviceFeatures.tessellationShader)
+		{
+			vks::tools::exitFatal("Streaming terrain requires the tessellationShader feature", -1);
+		}
+
+		// Patch corners have to fall on samples so neighbouring tiles derive identical edge factors
+		const uint32_t sampleSpans = header.tileResolution - 1;
+		settings.patchesPerTile = std::max(1u, std::min(settings.patchesPerTile, sampleSpans));
+		while (sampleSpans % settings.patchesPerTile != 0)
+		{
+			settings.patchesPerTile--;
+		}
+		settings.maxResidentTiles = std::max(1u, std::min(settings.maxResidentTiles, device->properties.limits.maxImageArrayLayers));
+
+		// Height atlas, one layer per resident tile
+		VkImageCreateInfo imageInfo = vks::initializers::GenImageCreateInfo();
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = VK_FORMAT_R16_UNORM;
+		imageInfo.extent = { header.tileResolution, header.tileResolution, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = settings.maxResidentTiles;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageInfo, nullptr, &heightAtlas.image));
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device->logicalDevice, heightAtlas.image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::GenMemoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &heightAtlas.memory));
+		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, heightAtlas.image, heightAtlas.memory, 0));
+
+		VkImageViewCreateInfo viewInfo = vks::initializers::GenImageViewCreateInfo();
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		viewInfo.format = VK_FORMAT_R16_UNORM;
+		viewInfo.image = heightAtlas.image;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, settings.maxResidentTiles };
+		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewInfo, nullptr, &heightAtlas.view));
+
+		VkSamplerCreateInfo samplerInfo = vks::initializers::GenSamplerCreateInfo();
+		samplerInfo.magFilter = VK_FILTER_LINEAR;
+		samplerInfo.minFilter = VK_FILTER_LINEAR;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = samplerInfo.addressModeU;
+		samplerInfo.addressModeW = samplerInfo.addressModeU;
+		samplerInfo.maxAnisotropy = 1.0f;
+		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerInfo, nullptr, &heightAtlas.sampler));
+
+		VkCommandBuffer commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		vks::tools::setImageLayout(commandBuffer, heightAtlas.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, settings.maxResidentTiles });
+		device->FlushCommandBuffer(commandBuffer, queue);
+
+		freeLayers.clear();
+		for (uint32_t i = settings.maxResidentTiles; i > 0; i--)
+		{
+			freeLayers.push_back(i - 1);
+		}
+		layerOwners.assign(settings.maxResidentTiles, UINT32_MAX);
+
+		// Patch grid in tile local coordinates, four control points per quad
+		std::vector<glm::vec2> patchVertices;
+		const float patchSize = 1.0f / settings.patchesPerTile;
+		for (uint32_t y = 0; y < settings.patchesPerTile; y++)
+		{
+			for (uint32_t x = 0; x < settings.patchesPerTile; x++)
+			{
+				patchVertices.push_back(glm::vec2(x, y) * patchSize);
+				patchVertices.push_back(glm::vec2(x + 1, y) * patchSize);
+				patchVertices.push_back(glm::vec2(x + 1, y + 1) * patchSize);
+				patchVertices.push_back(glm::vec2(x, y + 1) * patchSize);
+			}
+		}
+		patchVertexCount = static_cast<uint32_t>(patchVertices.size());
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&patchBuffer, patchVertices.size() * sizeof(glm::vec2), patchVertices.data()));
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&instanceBuffer, settings.maxResidentTiles * sizeof(TileInstance)));
+		VK_CHECK_RESULT(instanceBuffer.map());
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&indirectBuffer, sizeof(VkDrawIndirectCommand)));
+		VK_CHECK_RESULT(indirectBuffer.map());
+		VkDrawIndirectCommand drawCommand = { patchVertexCount, 0, 0, 0 };
+		memcpy(indirectBuffer.mappedData, &drawCommand, sizeof(drawCommand));
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&uniformBuffer, sizeof(UniformData)));
+		VK_CHECK_RESULT(uniformBuffer.map());
+		const VkDeviceSize tileBytes = header.tileResolution * header.tileResolution * sizeof(uint16_t);
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&stagingBuffer, tileBytes * maxUploadsPerUpdate));
+		VK_CHECK_RESULT(stagingBuffer.map());
+		stats.gpuBytes = memReqs.size + patchBuffer.size + instanceBuffer.size + indirectBuffer.size + uniformBuffer.size + stagingBuffer.size;
+
+		// Descriptors
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1),
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::GenDescriptorPoolCreateInfo(poolSizes, 1);
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+
+		const VkShaderStageFlags stages = VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, stages, 0),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, stages, 1),
+		};
+		VkDescriptorSetLayoutCreateInfo layoutInfo = vks::initializers::GenDescriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &layoutInfo, nullptr, &descriptorSetLayout));
+
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &descriptorSet));
+		VkDescriptorImageInfo atlasInfo = vks::initializers::GenDescriptorImageInfo(heightAtlas.sampler, heightAtlas.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		std::vector<VkWriteDescriptorSet> writes = {
+			vks::initializers::GenWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &atlasInfo),
+		};
+		vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = vks::initializers::GenPipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+
+		// Pipelines
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::GenPipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_PATCH_LIST, 0, VK_FALSE);
+		VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::GenPipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
+		VkPipelineColorBlendAttachmentState blendAttachmentState = vks::initializers::GenPipelineColorBlendAttachmentState(0xf, VK_FALSE);
+		VkPipelineColorBlendStateCreateInfo colorBlendState = vks::initializers::GenPipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
+		VkPipelineDepthStencilStateCreateInfo depthStencilState = vks::initializers::GenPipelineDepthStencilStateCreateInfo(VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL);
+		VkPipelineViewportStateCreateInfo viewportState = vks::initializers::GenPipelineViewportStateCreateInfo(1, 1, 0);
+		VkPipelineMultisampleStateCreateInfo multisampleState = vks::initializers::GenPipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT, 0);
+		std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamicState = vks::initializers::GenPipelineDynamicStateCreateInfo(dynamicStateEnables);
+		VkPipelineTessellationStateCreateInfo tessellationState = vks::initializers::GenPipelineTessellationStateCreateInfo(4);
+
+		std::vector<VkVertexInputBindingDescription> vertexInputBindings = {
+			vks::initializers::GenVertexInputBindingDescription(0, sizeof(glm::vec2), VK_VERTEX_INPUT_RATE_VERTEX),
+			vks::initializers::GenVertexInputBindingDescription(1, sizeof(TileInstance), VK_VERTEX_INPUT_RATE_INSTANCE),
+		};
+		std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
+			vks::initializers::GenVertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32_SFLOAT, 0),
+			vks::initializers::GenVertexInputAttributeDescription(1, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(TileInstance, originSize)),
+			vks::initializers::GenVertexInputAttributeDescription(1, 2, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(TileInstance, neighbourDeltas)),
+		};
+		VkPipelineVertexInputStateCreateInfo vertexInputState = vks::initializers::GenPipelineVertexInputStateCreateInfo(vertexInputBindings, vertexInputAttributes);
+
+		std::array<VkPipelineShaderStageCreateInfo, 4> shaderStages = {
+			vks::tools::loadShaderStage(shadersPath + "terraintessellation/terrain_streaming.vert.spv", VK_SHADER_STAGE_VERTEX_BIT, device->logicalDevice),
+			vks::tools::loadShaderStage(shadersPath + "terraintessellation/terrain_streaming.tesc.spv", VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, device->logicalDevice),
+			vks::tools::loadShaderStage(shadersPath + "terraintessellation/terrain_streaming.tese.spv", VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, device->logicalDevice),
+			vks::tools::loadShaderStage(shadersPath + "terraintessellation/terrain_streaming.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT, device->logicalDevice),
+		};
+
+		VkGraphicsPipelineCreateInfo pipelineCreateInfo = vks::initializers::GenPipelineCreateInfo(pipelineLayout, renderPass, 0);
+		pipelineCreateInfo.pVertexInputState = &vertexInputState;
+		pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
+		pipelineCreateInfo.pRasterizationState = &rasterizationState;
+		pipelineCreateInfo.pColorBlendState = &colorBlendState;
+		pipelineCreateInfo.pMultisampleState = &multisampleState;
+		pipelineCreateInfo.pViewportState = &viewportState;
+		pipelineCreateInfo.pDepthStencilState = &depthStencilState;
+		pipelineCreateInfo.pDynamicState = &dynamicState;
+		pipelineCreateInfo.pTessellationState = &tessellationState;
+		pipelineCreateInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+		pipelineCreateInfo.pStages = shaderStages.data();
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device->logicalDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline));
+		if (device->m_enabledDeviceFeatures.fillModeNonSolid)
+		{
+			rasterizationState.polygonMode = VK_POLYGON_MODE_LINE;
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device->logicalDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelineWireframe));
+		}
+		for (VkPipelineShaderStageCreateInfo& stage : shaderStages)
+		{
+			vkDestroyShaderModule(device->logicalDevice, stage.module, nullptr);
+		}
+
+		// Loaders run below normal priority, so streaming does not compete with the frame critical threads
+		vks::threading::ThreadPlacement loaderPlacement;
+		loaderPlacement.priority = vks::threading::Priority::Background;
+		loaderPlacement.name = "vks loader";
+		loaderPool.setThreadCount(std::max(1u, settings.loaderThreads), loaderPlacement);
+
+		// The root is always resident, so there is something to draw while the rest streams in
+		nodes[0].state = TileState::Loading;
+		pendingLoads++;
+		loadTile(0);
+		uploadCompletedTiles(1);
+		if (nodes[0].state != TileState::Resident)
+		{
+			vks::tools::exitFatal("Could not load the terrain root tile from " + fileName, -1);
+		}
+	}
+
+	void StreamingTerrain::destroy()
+	{
+		if (!device)
+		{
+			return;
+		}
+		// Outstanding loads reference the completion queue
+		loaderPool.wait();
+		loaderPool.setThreadCount(0);
+		completedLoads.clear();
+
+		VkDevice logicalDevice = device->logicalDevice;
+		vkDestroyPipeline(logicalDevice, pipeline, nullptr);
+		if (pipelineWireframe != VK_NULL_HANDLE)
+		{
+			vkDestroyPipeline(logicalDevice, pipelineWireframe, nullptr);
+		}
+		vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+		vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+		vkDestroySampler(logicalDevice, heightAtlas.sampler, nullptr);
+		vkDestroyImageView(logicalDevice, heightAtlas.view, nullptr);
+		vkDestroyImage(logicalDevice, heightAtlas.image, nullptr);
+		vkFreeMemory(logicalDevice, heightAtlas.memory, nullptr);
+		patchBuffer.destroy();
+		instanceBuffer.destroy();
+		indirectBuffer.destroy();
+		uniformBuffer.destroy();
+		stagingBuffer.destroy();
+		device = nullptr;
+	}
+
+	void StreamingTerrain::requestLoad(uint32_t nodeIndex)
+	{
+		if (!requestsStarted)
+		{
+			firstRequest = std::chrono::high_resolution_clock::now();
+			requestsStarted = true;
+		}
+		nodes[nodeIndex].state = TileState::Loading;
+		pendingLoads++;
+		loaderPool.threads[nextLoader]->addJob([this, nodeIndex] { loadTile(nodeIndex); });
+		nextLoader = (nextLoader + 1) % static_cast<uint32_t>(loaderPool.threads.size());
+	}
+
+	/**
+	* Read a tile from the file, runs on a loader thread
+	*
+	* Only touches immutable state (file name, directory) and the completion queue, the node state is owned by the main thread
+	*/
+	void StreamingTerrain::loadTile(uint32_t nodeIndex)
+	{
+		auto tStart = std::chrono::high_resolution_clock::now();
+		const terrainfile::TileEntry& entry = directory[nodeIndex];
+		LoadedTile tile;
+		tile.node = nodeIndex;
+
+		std::ifstream file(fileName, std::ios::binary);
+		if (file.is_open() && entry.size == header.tileResolution * header.tileResolution * sizeof(uint16_t))
+		{
+			tile.samples.resize(header.tileResolution * header.tileResolution);
+			file.seekg(entry.offset);
+			file.read(reinterpret_cast<char*>(tile.samples.data()), entry.size);
+			if (!file)
+			{
+				tile.samples.clear();
+			}
+		}
+
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		const uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(tEnd - tStart).count();
+		tile.milliseconds = nanoseconds / 1000000.0;
+		loadNanoseconds += nanoseconds;
+
+		std::lock_guard<std::mutex> lock(completedMutex);
+		completedLoads.push_back(std::move(tile));
+		pendingLoads--;
+	}
+
+	/**
+	* Find an atlas layer for a tile, evicting the least recently selected tile if the atlas is full
+	*
+	* @return False if every resident tile is still in use
+	*/
+	bool StreamingTerrain::allocateLayer(uint32_t nodeIndex)
+	{
+		if (freeLayers.empty())
+		{
+			uint32_t victimLayer = UINT32_MAX;
+			uint64_t oldestFrame = UINT64_MAX;
+			for (uint32_t layer = 0; layer < layerOwners.size(); layer++)
+			{
+				const uint32_t owner = layerOwners[layer];
+				// The root stays resident as fallback
+				if (owner == 0 || owner == UINT32_MAX)
+				{
+					continue;
+				}
+				const Node& node = nodes[owner];
+				if (node.lastSelectedFrame + settings.evictionDelay < frameIndex && node.lastSelectedFrame < oldestFrame)
+				{
+					oldestFrame = node.lastSelectedFrame;
+					victimLayer = layer;
+				}
+			}
+			if (victimLayer == UINT32_MAX)
+			{
+				return false;
+			}
+			Node& victim = nodes[layerOwners[victimLayer]];
+			victim.state = TileState::Unloaded;
+			victim.atlasLayer = UINT32_MAX;
+			layerOwners[victimLayer] = UINT32_MAX;
+			freeLayers.push_back(victimLayer);
+			stats.tilesEvicted++;
+		}
+		const uint32_t layer = freeLayers.back();
+		freeLayers.pop_back();
+		layerOwners[layer] = nodeIndex;
+		nodes[nodeIndex].atlasLayer = layer;
+		return true;
+	}
+
+	/**
+	* Copy finished loads into the height atlas with a single submission
+	*
+	* @param maxUploads Upper bound of tiles uploaded in this call, the remaining loads stay queued
+	*/
+	void StreamingTerrain::uploadCompletedTiles(size_t maxUploads)
+	{
+		std::vector<LoadedTile> tiles;
+		{
+			std::lock_guard<std::mutex> lock(completedMutex);
+			const size_t count = std::min<size_t>(std::min<size_t>(maxUploads, maxUploadsPerUpdate), completedLoads.size());
+			for (size_t i = 0; i < count; i++)
+			{
+				tiles.push_back(std::move(completedLoads.front()));
+				completedLoads.pop_front();
+			}
+		}
+		if (tiles.empty())
+		{
+			return;
+		}
+
+		const VkDeviceSize tileBytes = header.tileResolution * header.tileResolution * sizeof(uint16_t);
+		std::vector<VkBufferImageCopy> copyRegions;
+		std::vector<VkImageMemoryBarrier> barriers;
+		for (LoadedTile& tile : tiles)
+		{
+			Node& node = nodes[tile.node];
+			if (tile.samples.empty())
+			{
+				node.state = TileState::Failed;
+				continue;
+			}
+			if (!allocateLayer(tile.node))
+			{
+				// Atlas is full of tiles in use, the tile is requested again once space frees up
+				node.state = TileState::Unloaded;
+				continue;
+			}
+			const VkDeviceSize offset = tileBytes * copyRegions.size();
+			memcpy(static_cast<uint8_t*>(stagingBuffer.mappedData) + offset, tile.samples.data(), tileBytes);
+
+			VkBufferImageCopy region{};
+			region.bufferOffset = offset;
+			region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, node.atlasLayer, 1 };
+			region.imageExtent = { header.tileResolution, header.tileResolution, 1 };
+			copyRegions.push_back(region);
+
+			VkImageMemoryBarrier barrier = vks::initializers::GenImageMemoryBarrier();
+			barrier.image = heightAtlas.image;
+			barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, node.atlasLayer, 1 };
+			barriers.push_back(barrier);
+
+			node.state = TileState::Resident;
+			stats.tilesLoaded++;
+			stats.bytesLoaded += tileBytes;
+		}//for
+		if (copyRegions.empty())
+		{
+			return;
+		}
+
+		VkCommandBuffer commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		for (VkImageMemoryBarrier& barrier : barriers)
+		{
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		}
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT | VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+		vkCmdCopyBufferToImage(commandBuffer, stagingBuffer.buffer, heightAtlas.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+		for (VkImageMemoryBarrier& barrier : barriers)
+		{
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		}
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT | VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+		device->FlushCommandBuffer(commandBuffer, queue);
+	}
+
+	/**
+	* Walk the quadtree and collect the tiles to draw
+	*
+	* A visible tile is refined while its geometric error projects to more than settings.maxScreenError pixels, but only
+	* once all of its visible children are resident; until then the tile itself is drawn and the children are requested
+	*/
+	void StreamingTerrain::select(const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float projectionScale)
+	{
+		vks::Frustum frustum;
+		frustum.update(viewProjection);
+
+		selection.clear();
+		loadRequests.clear();
+		std::vector<uint32_t> stack = { 0 };
+		while (!stack.empty())
+		{
+			const uint32_t index = stack.back();
+			stack.pop_back();
+			Node& node = nodes[index];
+			node.lastSelectedFrame = frameIndex;
+
+			bool refine = false;
+			if (node.level + 1 < header.levelCount)
+			{
+				const glm::vec3 closest = glm::clamp(cameraPosition, node.boundsMin, node.boundsMax);
+				const float distance = std::max(glm::length(cameraPosition - closest), 1e-3f);
+				refine = node.geometricError * projectionScale / distance > settings.maxScreenError;
+			}
+			if (!refine)
+			{
+				selection.push_back(index);
+				continue;
+			}
+
+			std::array<uint32_t, 4> children;
+			uint32_t visibleCount = 0;
+			bool childrenReady = true;
+			for (uint32_t i = 0; i < 4; i++)
+			{
+				const uint32_t childIndex = terrainfile::nodeIndex(node.level + 1, node.x * 2 + (i & 1), node.y * 2 + (i >> 1));
+				const Node& child = nodes[childIndex];
+				const glm::vec3 center = (child.boundsMin + child.boundsMax) * 0.5f;
+				if (!frustum.checkSphere(center, glm::length(child.boundsMax - center)))
+				{
+					continue;
+				}
+				children[visibleCount++] = childIndex;
+				if (child.state == TileState::Unloaded)
+				{
+					loadRequests.push_back(childIndex);
+				}
+				if (child.state != TileState::Resident)
+				{
+					childrenReady = false;
+				}
+			}//for
+
+			if (childrenReady)
+			{
+				stack.insert(stack.end(), children.begin(), children.begin() + visibleCount);
+			}
+			else
+			{
+				selection.push_back(index);
+			}
+		}//while
+	}
+
+	/**
+	* Fill the instance buffer with the selection and the level of the coarser neighbour on each edge
+	*/
+	void StreamingTerrain::buildInstances()
+	{
+		std::vector<uint8_t> selected(nodes.size(), 0);
+		for (uint32_t index : selection)
+		{
+			selected[index] = 1;
+		}
+
+		TileInstance* instances = static_cast<TileInstance*>(instanceBuffer.mappedData);
+		const std::array<glm::ivec2, 4> edges = { glm::ivec2(-1, 0), glm::ivec2(1, 0), glm::ivec2(0, -1), glm::ivec2(0, 1) };
+		uint32_t instanceCount = 0;
+		for (uint32_t index : selection)
+		{
+			const Node& node = nodes[index];
+			const int32_t tilesPerEdge = 1 << node.level;
+			glm::vec4 deltas(0.0f);
+			for (uint32_t e = 0; e < 4; e++)
+			{
+				const int32_t nx = static_cast<int32_t>(node.x) + edges[e].x;
+				const int32_t ny = static_cast<int32_t>(node.y) + edges[e].y;
+				if (nx < 0 || ny < 0 || nx >= tilesPerEdge || ny >= tilesPerEdge)
+				{
+					continue;
+				}
+				// Walk up from the same level neighbour until a selected tile covers it, finer neighbours adapt to us
+				for (int32_t level = static_cast<int32_t>(node.level) - 1; level >= 0; level--)
+				{
+					const uint32_t shift = node.level - level;
+					if (selected[terrainfile::nodeIndex(level, nx >> shift, ny >> shift)])
+					{
+						deltas[e] = static_cast<float>(shift);
+						break;
+					}
+				}
+			}//for
+
+			const float tileSize = node.boundsMax.x - node.boundsMin.x;
+			instances[instanceCount].originSize = glm::vec4(node.boundsMin.x, node.boundsMin.z, tileSize, static_cast<float>(node.atlasLayer));
+			instances[instanceCount].neighbourDeltas = deltas;
+			instanceCount++;
+		}//for
+
+		VkDrawIndirectCommand* drawCommand = static_cast<VkDrawIndirectCommand*>(indirectBuffer.mappedData);
+		drawCommand->instanceCount = instanceCount;
+	}
+
+	/**
+	* Per frame update: upload finished tiles, select the tiles for the view, request missing tiles and refresh the draw data
+	*
+	* @param view View matrix
+	* @param projection Projection matrix
+	* @param viewportSize Viewport size in pixels
+	* @param lightDir Direction toward the light
+	*/
+	void StreamingTerrain::update(const glm::mat4& view, const glm::mat4& projection, const glm::vec2& viewportSize, const glm::vec3& lightDir)
+	{
+		frameIndex++;
+		uploadCompletedTiles(maxUploadsPerUpdate);
+
+		const glm::vec3 cameraPosition = glm::vec3(glm::inverse(view)[3]);
+		// Pixels per world unit at distance one
+		const float projectionScale = std::abs(projection[1][1]) * viewportSize.y * 0.5f;
+		select(projection * view, cameraPosition, projectionScale);
+
+		// Coarse tiles first, they unblock the most refinement
+		std::sort(loadRequests.begin(), loadRequests.end());
+		loadRequests.erase(std::unique(loadRequests.begin(), loadRequests.end()), loadRequests.end());
+		for (uint32_t index : loadRequests)
+		{
+			if (pendingLoads >= settings.maxPendingLoads)
+			{
+				break;
+			}
+			if (nodes[index].state == TileState::Unloaded)
+			{
+				requestLoad(index);
+			}
+		}
+
+		buildInstances();
+
+		UniformData uniformData;
+		uniformData.projection = projection;
+		uniformData.view = view;
+		uniformData.lightDir = glm::vec4(glm::normalize(lightDir), 0.0f);
+		uniformData.viewport = glm::vec4(viewportSize, settings.tessellatedEdgeSize, header.heightScale);
+		uniformData.tileParams = glm::vec4(static_cast<float>(header.tileResolution), static_cast<float>(settings.patchesPerTile), 0.0f, 0.0f);
+		memcpy(uniformBuffer.mappedData, &uniformData, sizeof(UniformData));
+
+		// Statistics
+		stats.selectedTiles = static_cast<uint32_t>(selection.size());
+		stats.residentTiles = settings.maxResidentTiles - static_cast<uint32_t>(freeLayers.size());
+		stats.pendingLoads = pendingLoads;
+		size_t queuedBytes = 0;
+		{
+			std::lock_guard<std::mutex> lock(completedMutex);
+			for (const LoadedTile& tile : completedLoads)
+			{
+				queuedBytes += tile.samples.size() * sizeof(uint16_t);
+			}
+		}
+		stats.cpuBytes = nodes.size() * sizeof(Node) + directory.size() * sizeof(terrainfile::TileEntry) + queuedBytes;
+		const double loadSeconds = loadNanoseconds / 1e9;
+		// The root is loaded during prepare and not counted against the streaming time
+		const uint64_t streamedTiles = stats.tilesLoaded > 0 ? stats.tilesLoaded - 1 : 0;
+		stats.averageLoadMs = stats.tilesLoaded > 0 ? loadSeconds * 1000.0 / stats.tilesLoaded : 0.0;
+		stats.loadMegabytesPerSecond = loadSeconds > 0.0 ? stats.bytesLoaded / (1024.0 * 1024.0) / loadSeconds : 0.0;
+		if (requestsStarted)
+		{
+			const double wallSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - firstRequest).count();
+			stats.tilesPerSecond = wallSeconds > 0.0 ? streamedTiles / wallSeconds : 0.0;
+		}
+	}
+
+	/**
+	* Draw the selected tiles, the instance count is read from the indirect buffer so prebuilt command buffers stay valid
+	*/
+	void StreamingTerrain::draw(VkCommandBuffer commandBuffer, bool wireframe)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, (wireframe && pipelineWireframe != VK_NULL_HANDLE) ? pipelineWireframe : pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		const VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &patchBuffer.buffer, offsets);
+		vkCmdBindVertexBuffers(commandBuffer, 1, 1, &instanceBuffer.buffer, offsets);
+		vkCmdDrawIndirect(commandBuffer, indirectBuffer.buffer, 0, 1, sizeof(VkDrawIndirectCommand));
+	}
+
+	/**
+	* Writes a generated heightmap in the tiled format and flies a camera low over it, once per loader thread count. Every frame
+	* updates the selection, uploads finished tiles and draws the terrain offscreen. Reports the memory footprint and the tile
+	* load throughput of each flight
+	*
+	* @param device Device, tessellationShader must be enabled
+	* @param queue Queue the frames and tile uploads are submitted to, every frame is waited for
+	* @param shadersPath Base path of the GLSL shaders (getShadersPath())
+	* @param out Stream the report is written to
+	* @param frames Number of frames of each flight
+	*/
+	void benchmarkTerrain(vks::VulkanDevice* device, VkQueue queue, const std::string& shadersPath, std::ostream& out, uint32_t frames)
+	{
+		const std::string fileName = "terrain_benchmark.vthm";
+		const uint32_t heightmapSize = 4097;
+		const uint32_t tileResolution = 65;
+		const float worldSize = 8192.0f;
+		const float heightScale = 600.0f;
+		const uint32_t width = 1920;
+		const uint32_t height = 1080;
+		const VkFormat colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+		VkDevice logicalDevice = device->logicalDevice;
+
+		if (!device->m_enabledDeviceFeatures.tessellationShader)
+		{
+			out << "Streaming terrain: the device does not support tessellation shaders\n";
+			return;
+		}
+		{
+			const std::vector<uint16_t> heights = generateHeights(heightmapSize);
+			if (!terrainfile::write(fileName, heights.data(), heightmapSize, tileResolution, worldSize, heightScale))
+			{
+				out << "Could not write " << fileName << " to the working directory\n";
+				return;
+			}
+		}
+
+		VkFormat depthFormat;
+		VkBool32 validFormat = vks::tools::getSupportedDepthFormat(device->physicalDevice, &depthFormat);
+		assert(validFormat);
+		std::array<VkAttachmentDescription, 2> attachments{};
+		attachments[0].format = colorFormat;
+		attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		attachments[1] = attachments[0];
+		attachments[1].format = depthFormat;
+		attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		VkAttachmentReference depthReference = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = &colorReference;
+		subpass.pDepthStencilAttachment = &depthReference;
+		VkSubpassDependency dependency{};
+		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependency.dstSubpass = 0;
+		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependency.dstStageMask = dependency.srcStageMask;
+		dependency.srcAccessMask = 0;
+		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		VkRenderPassCreateInfo renderPassInfo = vks::initializers::GenRenderPassCreateInfo();
+		renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		renderPassInfo.pAttachments = attachments.data();
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpass;
+		renderPassInfo.dependencyCount = 1;
+		renderPassInfo.pDependencies = &dependency;
+		VkRenderPass renderPass;
+		VK_CHECK_RESULT(vkCreateRenderPass(logicalDevice, &renderPassInfo, nullptr, &renderPass));
+
+		// Color and depth targets of the offscreen frame
+		std::array<VkImage, 2> images;
+		std::array<VkDeviceMemory, 2> memories;
+		std::array<VkImageView, 2> views;
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			VkImageCreateInfo imageInfo = vks::initializers::GenImageCreateInfo();
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.format = attachments[i].format;
+			imageInfo.extent = { width, height, 1 };
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.usage = (i == 0) ? VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT : VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+			VK_CHECK_RESULT(vkCreateImage(logicalDevice, &imageInfo, nullptr, &images[i]));
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(logicalDevice, images[i], &memReqs);
+			VkMemoryAllocateInfo memAlloc = vks::initializers::GenMemoryAllocateInfo();
+			memAlloc.allocationSize = memReqs.size;
+			memAlloc.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &memories[i]));
+			VK_CHECK_RESULT(vkBindImageMemory(logicalDevice, images[i], memories[i], 0));
+			VkImageViewCreateInfo viewInfo = vks::initializers::GenImageViewCreateInfo();
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = attachments[i].format;
+			viewInfo.subresourceRange = { static_cast<VkImageAspectFlags>((i == 0) ? VK_IMAGE_ASPECT_COLOR_BIT : VK_IMAGE_ASPECT_DEPTH_BIT), 0, 1, 0, 1 };
+			viewInfo.image = images[i];
+			VK_CHECK_RESULT(vkCreateImageView(logicalDevice, &viewInfo, nullptr, &views[i]));
+		}//for
+		VkFramebufferCreateInfo frameBufferInfo = vks::initializers::GenFrameBufferCreateInfo();
+		frameBufferInfo.renderPass = renderPass;
+		frameBufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+		frameBufferInfo.pAttachments = views.data();
+		frameBufferInfo.width = width;
+		frameBufferInfo.height = height;
+		frameBufferInfo.layers = 1;
+		VkFramebuffer frameBuffer;
+		VK_CHECK_RESULT(vkCreateFramebuffer(logicalDevice, &frameBufferInfo, nullptr, &frameBuffer));
+
+		std::ios_base::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+		out << std::fixed << std::setprecision(2);
+		out << "Streaming terrain: " << frames << " frames at " << width << " x " << height << " over a " << heightmapSize << " x " << heightmapSize
+			<< " heightmap in " << tileResolution << " x " << tileResolution << " sample tiles, camera 60 units above the highest peak\n";
+		out << "  " << std::left << std::setw(10) << "loaders" << std::right << std::setw(10) << "tiles" << std::setw(10) << "MB read" << std::setw(12)
+			<< "ms/tile" << std::setw(10) << "MB/s" << std::setw(12) << "tiles/s" << std::setw(11) << "resident" << std::setw(11) << "selected"
+			<< std::setw(10) << "GPU MB" << std::setw(10) << "CPU KB" << std::setw(10) << "GPU ms" << "\n";
+
+		const glm::mat4 projection = glm::perspective(glm::radians(60.0f), static_cast<float>(width) / static_cast<float>(height), 1.0f, worldSize);
+		const glm::vec3 lightDir = glm::normalize(glm::vec3(-0.5f, -1.0f, -0.3f));
+		for (uint32_t loaderThreads : { 1u, 2u, 4u })
+		{
+			StreamingTerrain terrain;
+			terrain.settings.loaderThreads = loaderThreads;
+			if (!terrain.open(fileName))
+			{
+				out << "Could not read " << fileName << "\n";
+				break;
+			}
+			terrain.prepare(device, queue, renderPass, VK_NULL_HANDLE, shadersPath);
+
+			vks::GpuTimer gpuTimer;
+			gpuTimer.create(device, 1);
+			double gpuMilliseconds = 0.0;
+			uint64_t selectedTiles = 0;
+			uint32_t maxResident = 0;
+			VkDeviceSize maxGpuBytes = 0;
+			size_t maxCpuBytes = 0;
+			for (uint32_t frame = 0; frame < frames; frame++)
+			{
+				// Straight across the terrain, slowly turning, fast enough to keep the loaders busy
+				const float t = static_cast<float>(frame) / std::max(frames - 1, 1u);
+				const float along = (t - 0.5f) * worldSize * 0.8f;
+				const glm::vec3 position(along, heightScale + 60.0f, std::sin(t * 6.2831853f) * worldSize * 0.1f);
+				const float yaw = t * 1.5f;
+				const glm::vec3 forward(std::cos(yaw), -0.25f, std::sin(yaw));
+				const glm::mat4 view = glm::lookAt(position, position + forward, glm::vec3(0.0f, 1.0f, 0.0f));
+				terrain.update(view, projection, glm::vec2(width, height), lightDir);
+
+				VkCommandBuffer commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+				gpuTimer.reset(commandBuffer);
+				uint32_t scope = gpuTimer.beginScope(commandBuffer, "Terrain");
+				std::array<VkClearValue, 2> clearValues{};
+				clearValues[1].depthStencil = { 1.0f, 0 };
+				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::GenRenderPassBeginInfo();
+				renderPassBeginInfo.renderPass = renderPass;
+				renderPassBeginInfo.framebuffer = frameBuffer;
+				renderPassBeginInfo.renderArea.extent = { width, height };
+				renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+				renderPassBeginInfo.pClearValues = clearValues.data();
+				vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+				VkViewport viewport = vks::initializers::GenViewport(static_cast<float>(width), static_cast<float>(height), 0.0f, 1.0f);
+				VkRect2D scissor = vks::initializers::GenRect2D(width, height, 0, 0);
+				vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+				vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+				terrain.draw(commandBuffer);
+				vkCmdEndRenderPass(commandBuffer);
+				gpuTimer.endScope(commandBuffer, scope);
+				device->FlushCommandBuffer(commandBuffer, queue, true);
+				gpuTimer.collect(true);
+
+				gpuMilliseconds += gpuTimer.getMilliseconds("Terrain");
+				selectedTiles += terrain.stats.selectedTiles;
+				maxResident = std::max(maxResident, terrain.stats.residentTiles);
+				maxGpuBytes = std::max(maxGpuBytes, terrain.stats.gpuBytes);
+				maxCpuBytes = std::max(maxCpuBytes, terrain.stats.cpuBytes);
+			}//for
+
+			const StreamingTerrain::Stats& stats = terrain.stats;
+			out << "  " << std::left << std::setw(10) << loaderThreads << std::right << std::setw(10) << stats.tilesLoaded << std::setw(10)
+				<< stats.bytesLoaded / (1024.0 * 1024.0) << std::setw(12) << stats.averageLoadMs << std::setw(10) << stats.loadMegabytesPerSecond
+				<< std::setw(12) << stats.tilesPerSecond << std::setw(11) << maxResident << std::setw(11) << static_cast<double>(selectedTiles) / frames
+				<< std::setw(10) << maxGpuBytes / (1024.0 * 1024.0) << std::setw(10) << maxCpuBytes / 1024.0 << std::setw(10) << gpuMilliseconds / frames << "\n";
+			gpuTimer.destroy();
+			terrain.destroy();
+		}//for
+		out << "  resident, GPU MB and CPU KB are the peaks of the flight, selected is the average per frame\n";
+		out.flags(flags);
+		out.precision(precision);
+
+		vkDestroyFramebuffer(logicalDevice, frameBuffer, nullptr);
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			vkDestroyImageView(logicalDevice, views[i], nullptr);
+			vkDestroyImage(logicalDevice, images[i], nullptr);
+			vkFreeMemory(logicalDevice, memories[i], nullptr);
+		}
+		vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
+		std::remove(fileName.c_str());
+	}
+}//vks
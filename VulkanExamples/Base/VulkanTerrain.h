@@ -0,0 +1,233 @@
+/*
+* Streaming terrain
+*
+* CPU quadtree over a tiled heightmap file, tiles are loaded asynchronously on a thread pool and selected per frame
+* by frustum and screen space error, selected tiles are drawn as tessellated patches with factors derived from the
+* projected edge length
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "ThreadPool.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	/**
+	* @brief Tiled heightmap file layout
+	*
+	* A header, one directory entry per quadtree node (level by level, row major inside a level, level 0 is the root)
+	* and the uncompressed 16 bit samples of each tile. Tiles have tileResolution samples per edge and share their
+	* border samples with their neighbours, level l is a decimation of the finest level by 2^(levelCount - 1 - l)
+	*/
+	namespace terrainfile
+	{
+		const uint32_t magic = 0x4D485456; // "VTHM"
+		const uint32_t version = 1;
+
+		struct Header
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t tileResolution;
+			uint32_t levelCount;
+			float worldSize;
+			float heightScale;
+			uint32_t reserved[2];
+		};
+
+		struct TileEntry
+		{
+			uint64_t offset;
+			uint32_t size;
+			uint16_t minHeight;
+			uint16_t maxHeight;
+			/** @brief Largest height difference to the finest level inside the tile, in normalized height units */
+			float geometricError;
+			uint32_t reserved;
+		};
+
+		/** @brief Number of nodes in a full quadtree with the given number of levels */
+		inline uint32_t nodeCount(uint32_t levelCount)
+		{
+			return ((1u << (2 * levelCount)) - 1) / 3;
+		}
+
+		/** @brief Index of a node in the directory */
+		inline uint32_t nodeIndex(uint32_t level, uint32_t x, uint32_t y)
+		{
+			return nodeCount(level) + y * (1u << level) + x;
+		}
+
+		bool write(const std::string& fileName, const uint16_t* heights, uint32_t size, uint32_t tileResolution, float worldSize, float heightScale);
+	}
+
+	class StreamingTerrain
+	{
+	public:
+		struct Settings
+		{
+			/** @brief Refine a tile while its geometric error projects to more than this many pixels */
+			float maxScreenError = 2.0f;
+			/** @brief Target length of a tessellated edge in pixels */
+			float tessellatedEdgeSize = 16.0f;
+			/** @brief Quad patches per tile edge */
+			uint32_t patchesPerTile = 8;
+			/** @brief Layers of the height atlas, i.e. the maximum number of resident tiles */
+			uint32_t maxResidentTiles = 256;
+			/** @brief Resident tiles not selected for this many frames can be evicted */
+			uint32_t evictionDelay = 60;
+			uint32_t loaderThreads = 2;
+			/** @brief Maximum number of tile requests in flight */
+			uint32_t maxPendingLoads = 32;
+		} settings;
+
+		enum class TileState : uint8_t { Unloaded, Loading, Loaded, Resident, Failed };
+
+		struct Node
+		{
+			uint32_t level;
+			uint32_t x;
+			uint32_t y;
+			glm::vec3 boundsMin;
+			glm::vec3 boundsMax;
+			float geometricError;
+			TileState state = TileState::Unloaded;
+			uint32_t atlasLayer = UINT32_MAX;
+			uint64_t lastSelectedFrame = 0;
+		};
+
+		/** @brief Per instance data of a selected tile, matches the instance attributes of terrain_streaming.vert */
+		struct TileInstance
+		{
+			/** @brief xy: world space origin (x/z), z: edge length, w: atlas layer */
+			glm::vec4 originSize;
+			/** @brief Level difference to the coarser neighbour on the -x, +x, -z, +z edge (0 if not coarser) */
+			glm::vec4 neighbourDeltas;
+		};
+
+		/** @brief Matches the UBO of terrain_streaming.tesc / .tese */
+		struct UniformData
+		{
+			glm::mat4 projection;
+			glm::mat4 view;
+			glm::vec4 lightDir;
+			/** @brief xy: viewport size, z: tessellated edge size, w: height scale */
+			glm::vec4 viewport;
+			/** @brief x: tile resolution, y: patches per tile */
+			glm::vec4 tileParams;
+		};
+
+		struct Stats
+		{
+			uint32_t selectedTiles = 0;
+			uint32_t residentTiles = 0;
+			uint32_t pendingLoads = 0;
+			uint64_t tilesLoaded = 0;
+			uint64_t bytesLoaded = 0;
+			uint64_t tilesEvicted = 0;
+			/** @brief Device memory of the height atlas, instance, patch and staging buffers */
+			VkDeviceSize gpuBytes = 0;
+			/** @brief Host memory of the quadtree and the tile data waiting for upload */
+			size_t cpuBytes = 0;
+			/** @brief Average time a loader thread spends on one tile */
+			double averageLoadMs = 0.0;
+			/** @brief Bytes read per second of loader thread time */
+			double loadMegabytesPerSecond = 0.0;
+			/** @brief Tiles made resident per second since the first request */
+			double tilesPerSecond = 0.0;
+		} stats;
+
+		vks::VulkanDevice* device = nullptr;
+		terrainfile::Header header{};
+		std::vector<Node> nodes;
+
+		struct
+		{
+			VkImage image = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+			VkSampler sampler = VK_NULL_HANDLE;
+		} heightAtlas;
+
+		vks::Buffer patchBuffer;
+		vks::Buffer instanceBuffer;
+		vks::Buffer uniformBuffer;
+		vks::Buffer stagingBuffer;
+		/** @brief Indirect draw arguments, the instance count follows the selection without re-recording command buffers */
+		vks::Buffer indirectBuffer;
+		uint32_t patchVertexCount = 0;
+
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		VkPipeline pipelineWireframe = VK_NULL_HANDLE;
+
+		bool open(const std::string& fileName);
+		void prepare(vks::VulkanDevice* device, VkQueue queue, VkRenderPass renderPass, VkPipelineCache pipelineCache, const std::string& shadersPath);
+		void destroy();
+
+		/** @brief Select tiles, issue loads and upload finished tiles, call once per frame before recording */
+		void update(const glm::mat4& view, const glm::mat4& projection, const glm::vec2& viewportSize, const glm::vec3& lightDir);
+		void draw(VkCommandBuffer commandBuffer, bool wireframe = false);
+
+	private:
+		struct LoadedTile
+		{
+			uint32_t node;
+			std::vector<uint16_t> samples;
+			double milliseconds;
+		};
+
+		std::string fileName;
+		std::vector<terrainfile::TileEntry> directory;
+		VkQueue queue = VK_NULL_HANDLE;
+		uint32_t nextLoader = 0;
+
+		std::mutex completedMutex;
+		std::deque<LoadedTile> completedLoads;
+		std::atomic<uint32_t> pendingLoads{ 0 };
+		std::atomic<uint64_t> loadNanoseconds{ 0 };
+
+		std::vector<uint32_t> freeLayers;
+		std::vector<uint32_t> layerOwners;
+		std::vector<uint32_t> selection;
+		std::vector<uint32_t> loadRequests;
+		uint64_t frameIndex = 0;
+		std::chrono::high_resolution_clock::time_point firstRequest;
+		bool requestsStarted = false;
+		// Declared last so its threads are joined before the state the load jobs touch is destroyed
+		vks::ThreadPool loaderPool;
+
+		void requestLoad(uint32_t nodeIndex);
+		void loadTile(uint32_t nodeIndex);
+		void uploadCompletedTiles(size_t maxUploads);
+		bool allocateLayer(uint32_t nodeIndex);
+		void select(const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float projectionScale);
+		void buildInstances();
+	};
+
+	/** @brief Flies over a generated terrain with 1, 2 and 4 loader threads and reports the memory footprint and tile load throughput of each flight */
+	void benchmarkTerrain(vks::VulkanDevice* device, VkQueue queue, const std::string& shadersPath, std::ostream& out, uint32_t frames = 600);
+}//vks
@@ -73,6 +73,26 @@ namespace vks
 		ktxResult result = loadKTXFile(fileName, &pKtxTexture);
 		assert(result == KTX_SUCCESS);
 
+		loadFromKtx(pKtxTexture, format, device, copyQueue, imageUsageFlags, imageLayout, forceLinear);
+	}	//Texture2D::loadFromFile
+
+	/**
+	* Create a 2D texture including all mip levels from an already decoded ktx texture
+	*
+	* Splits the file decode from the upload, so the decode can run on any thread while the upload
+	* uses the device's command pool and copyQueue from the thread that owns them
+	*
+	* @param pKtxTexture Decoded texture (see loadKTXFile), destroyed by this function
+	* @param format Vulkan format of the image data stored in the file
+	* @param device Vulkan device to create the texture on
+	* @param copyQueue Queue used for the texture staging copy commands (must support transfer)
+	* @param (Optional) imageUsageFlags Usage flags for the texture's image (defaults to VK_IMAGE_USAGE_SAMPLED_BIT)
+	* @param (Optional) imageLayout Usage layout for the texture (defaults VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+	* @param (Optional) forceLinear Force linear tiling (not advised, defaults to false)
+	*
+	*/
+	void Texture2D::loadFromKtx(ktxTexture* pKtxTexture, VkFormat format, vks::VulkanDevice * device, VkQueue copyQueue, VkImageUsageFlags imageUsageFlags, VkImageLayout imageLayout, bool forceLinear)
+	{
 		this->device = device;
 		this->width = pKtxTexture->baseWidth;
 		this->height = pKtxTexture->baseHeight;
@@ -95,40 +115,8 @@ namespace vks
 		VkMemoryAllocateInfo memAllocInfo = vks::initializers::GenMemoryAllocateInfo();
 		VkMemoryRequirements memReqs;
 
-		// Use a separate command buffer for texture loading
-		VkCommandBuffer copyCmd = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
 		if (useStaging)
 		{
-			//Create a host-visible staging buffer that contains the raw image data
-			VkBuffer stagingBuffer;
-			VkDeviceMemory stagingMemory;
-
-			VkBufferCreateInfo bufferCreateInfo = vks::initializers::GenBufferCreateInfo();
-			bufferCreateInfo.size = ktxTextureSize;
-			//This buffer is used as a transfer source for the buffer copy
-			bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-			bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-			VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-			//Get memory requirements for the staging buffer(alignment,memory type bits)
-			vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-
-			memAllocInfo.allocationSize = memReqs.size;
-			// Get memory type index for a host visible buffer
-			memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-			VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-			//Copy texture data into staging buffer
-			uint8_t * data;
-			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
-			memcpy(data, ktxTextureData, ktxTextureSize);
-			vkUnmapMemory(device->logicalDevice, stagingMemory);
-
 			// Setup buffer copy regions for each mip level
 			std::vector<VkBufferImageCopy> bufferCopyRegions;
 
@@ -163,12 +151,9 @@ namespace vks
 			imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 			imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 			imageCreateInfo.extent = { width, height, 1 };
-			imageCreateInfo.usage = imageUsageFlags;
-			// Ensure that the TRANSFER_DST bit is set for staging
-			if (!(imageCreateInfo.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
-			{
-				imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-			}
+			// Written from the host if the device supports it, through a staging buffer otherwise
+			VkImageUsageFlags uploadUsage = device->GetUploadUsage(format, imageUsageFlags, imageLayout);
+			imageCreateInfo.usage = imageUsageFlags | uploadUsage;
 			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
 
 			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
@@ -183,24 +168,9 @@ namespace vks
 			subresourceRange.levelCount = mipLevels;
 			subresourceRange.layerCount = 1;
 
-			// Image barrier for optimal image (target)
-			// Optimal image will be used as destination for the copy
-			vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
-
-			//Copy mip levels from staging buffer
-			vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
-
-			//Change texture image layout to shader read after all mip levels have been copied
+			//Copy all mip levels and change texture image layout to shader read
 			this->imageLayout = imageLayout;
-			vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, imageLayout, subresourceRange);
-
-			device->FlushCommandBuffer(copyCmd, copyQueue);
-
-			//Ѿɣ
-			//Clean up staging resources
-			vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-			vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+			device->UploadImage(image, uploadUsage, subresourceRange, ktxTextureData, ktxTextureSize, bufferCopyRegions, imageLayout, copyQueue);
 		}
 		else
 		{
@@ -214,6 +184,9 @@ namespace vks
 			VkImage mappableImage;
 			VkDeviceMemory mappableMemory;
 
+			// Use a separate command buffer for texture loading
+			VkCommandBuffer copyCmd = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
 			VkImageCreateInfo imageCreateInfo = vks::initializers::GenImageCreateInfo();
 			imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
 			imageCreateInfo.format = format;
@@ -316,7 +289,7 @@ namespace vks
 
 		// Update descriptor image info member that can be used for setting up descriptor sets
 		updateDescriptor();
-	}	//Texture2D::loadFromFile
+	}	//Texture2D::loadFromKtx
 
 	/**
 	* Creates a 2D texture from a buffer
@@ -344,38 +317,8 @@ namespace vks
 		VkMemoryAllocateInfo memAllocInfo = vks::initializers::GenMemoryAllocateInfo();
 		VkMemoryRequirements memReqs;
 
-		// Use a separate command buffer for texture loading
-		VkCommandBuffer copyCmd = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-		// Create a host-visible staging buffer that contains the raw image data
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
-
-		VkBufferCreateInfo bufferCreateInfo = vks::initializers::GenBufferCreateInfo();
-		bufferCreateInfo.size = bufferSize;
-		//This buffer is used as a transfer source for the buffer copy
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-		VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-		//Get memory requirements for the staging buffer(alignment,memory type bits)
-		vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-
-		memAllocInfo.allocationSize = memReqs.size;
-		//Get memory type index for a host visible buffer
-		memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-		// Copy texture data into staging buffer
-		uint8_t *data;
-		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-		memcpy(data, buffer, bufferSize);
-		vkUnmapMemory(device->logicalDevice, stagingMemory);
-
-		VkBufferImageCopy bufferCopyRegion = {};
+		std::vector<VkBufferImageCopy> bufferCopyRegions(1);
+		VkBufferImageCopy& bufferCopyRegion = bufferCopyRegions[0];
 		bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		bufferCopyRegion.imageSubresource.mipLevel = 0;
 		bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
@@ -396,12 +339,9 @@ namespace vks
 		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 		imageCreateInfo.extent = { width,height,1 };
-		imageCreateInfo.usage = imageUsageFlags;
-		// Ensure that the TRANSFER_DST bit is set for staging
-		if (!(imageCreateInfo.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
-		{
-			imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-		}
+		// Written from the host if the device supports it, through a staging buffer otherwise
+		VkImageUsageFlags uploadUsage = device->GetUploadUsage(format, imageUsageFlags, imageLayout);
+		imageCreateInfo.usage = imageUsageFlags | uploadUsage;
 		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
 
 		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
@@ -418,22 +358,9 @@ namespace vks
 		subresourceRange.levelCount = mipLevels;
 		subresourceRange.layerCount = 1;
 
-		// Image barrier for optimal image (target)
-		// Optimal image will be used as destination for the copy
-		vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
-
-		// Copy mip levels from staging buffer
-		vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
-
-		// Change texture image layout to shader read after all mip levels have been copied
+		// Copy the image and change texture image layout to shader read
 		this->imageLayout = imageLayout;
-		vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, imageLayout, subresourceRange);
-
-		device->FlushCommandBuffer(copyCmd, copyQueue);
-
-		// Clean up staging resources
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+		device->UploadImage(image, uploadUsage, subresourceRange, buffer, bufferSize, bufferCopyRegions, imageLayout, copyQueue);
 
 		// Create sampler
 		VkSamplerCreateInfo samplerCreateInfo = {};
@@ -496,35 +423,6 @@ namespace vks
 		VkMemoryAllocateInfo memAllocInfo = vks::initializers::GenMemoryAllocateInfo();
 		VkMemoryRequirements memReqs;
 
-		//Create a host-visible staging buffer that contains the raw image data
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
-
-		VkBufferCreateInfo bufferCreateInfo = vks::initializers::GenBufferCreateInfo();
-		bufferCreateInfo.size = ktxTextureSize;
-		//This buffer is used as a transfer source for the buffer copy
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;//bufferתbugԭ
-
-		VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-		//Get memory requirements for the staging buffer(alignment, memory type bits)
-		vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-
-		memAllocInfo.allocationSize = memReqs.size;
-		// Get memory type index for a host visible buffer
-		memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-
-		//Copy texture data into staging buffer
-		uint8_t *data;
-		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
-		memcpy(data, pKtxTextureData, ktxTextureSize);
-		vkUnmapMemory(device->logicalDevice, stagingMemory);
-
 		// Setup buffer copy regions for each layer including all of its miplevels
 		std::vector<VkBufferImageCopy> bufferCopyRegions;
 		for (uint32_t layer = 0;layer<layerCount;layer++)
@@ -558,13 +456,9 @@ namespace vks
 		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 		imageCreateInfo.extent = { width, height, 1 };
-		imageCreateInfo.usage = imageUsageFlags;
-
-		// Ensure that the TRANSFER_DST bit is set for staging
-		if (!(imageCreateInfo.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
-		{
-			imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-		}
+		// Written from the host if the device supports it, through a staging buffer otherwise
+		VkImageUsageFlags uploadUsage = device->GetUploadUsage(format, imageUsageFlags, imageLayout);
+		imageCreateInfo.usage = imageUsageFlags | uploadUsage;
 		imageCreateInfo.arrayLayers = layerCount;
 		imageCreateInfo.mipLevels = mipLevels;
 
@@ -578,27 +472,16 @@ namespace vks
 		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
 		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
 
-		// Use a separate command buffer for texture loading
-		VkCommandBuffer copyCmd = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-		// Image barrier for optimal image (target)
-		// Set initial layout for all array layers (faces) of the optimal (target) tiled texture
+		// All array layers and mip levels of the optimal tiled texture
 		VkImageSubresourceRange subresourceRange = {};
 		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		subresourceRange.baseMipLevel = 0;
 		subresourceRange.levelCount = mipLevels;
 		subresourceRange.layerCount = layerCount;
 
-		vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
-
-		// Copy the layers and mip levels from the staging buffer to the optimal tiled image
-		vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
-
-		// Change texture image layout to shader read after all faces have been copied
+		// Copy all layers and mip levels and change texture image layout to shader read
 		this->imageLayout = imageLayout;
-		vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, imageLayout, subresourceRange);
-
-		device->FlushCommandBuffer(copyCmd, copyQueue);
+		device->UploadImage(image, uploadUsage, subresourceRange, pKtxTextureData, ktxTextureSize, bufferCopyRegions, imageLayout, copyQueue);
 
 		// Create sampler
 		VkSamplerCreateInfo samplerCreateInfo = vks::initializers::GenSamplerCreateInfo();
@@ -628,10 +511,7 @@ namespace vks
 		viewCreateInfo.image = image;
 		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, nullptr, &view));
 
-		// Clean up staging resources
 		ktxTexture_Destroy(pKtxTexture);
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
 
 		// Update descriptor image info member that can be used for setting up descriptor sets
 		updateDescriptor();
@@ -665,32 +545,6 @@ namespace vks
 		VkMemoryAllocateInfo memAllocateInfo = vks::initializers::GenMemoryAllocateInfo();
 		VkMemoryRequirements memReqs;
 
-		// Create a host-visible staging buffer that contains the raw image data
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
-		VkBufferCreateInfo bufferCreateInfo = vks::initializers::GenBufferCreateInfo();
-		bufferCreateInfo.size = ktxTextureSize;
-		// This buffer is used as a transfer source for the buffer copy
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-		VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-		// Get memory requirements for the staging buffer(alignments,memory type bits)
-		vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-		memAllocateInfo.allocationSize = memReqs.size;
-		// Get memory type index for a host visible buffer
-		memAllocateInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocateInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-		// Copy texture data into staging buffer
-		uint8_t *data;
-		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-		memcpy(data, pKtxTextureData, ktxTextureSize);
-		vkUnmapMemory(device->logicalDevice, stagingMemory);
-
 		// Setup buffer copy regions for each face including all of its mip levels.
 		std::vector<VkBufferImageCopy> bufferCopyRegions;
 
@@ -726,13 +580,9 @@ namespace vks
 		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 		imageCreateInfo.extent = { width, height, 1 };
-		imageCreateInfo.usage = imageUsageFlags;
-
-		// Ensure that the TRANSFER_DST bit is set for staging
-		if (!(imageCreateInfo.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
-		{
-			imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-		}
+		// Written from the host if the device supports it, through a staging buffer otherwise
+		VkImageUsageFlags uploadUsage = device->GetUploadUsage(format, imageUsageFlags, imageLayout);
+		imageCreateInfo.usage = imageUsageFlags | uploadUsage;
 
 		//Cube faces count as array layers in Vulkan
 		imageCreateInfo.arrayLayers = 6;
@@ -748,27 +598,16 @@ namespace vks
 		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocateInfo, nullptr, &deviceMemory));
 		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
 
-		// Use a separate command buffer for texture loading
-		VkCommandBuffer copyCmd = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-		// Image barrier for optimal image (target)
-		// Set initial layout for all array layers (faces) of the otimal (target) tiled texture
+		// All array layers (faces) and mip levels of the optimal tiled texture
 		VkImageSubresourceRange subresourceRange = {};
 		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		subresourceRange.baseMipLevel = 0;
 		subresourceRange.levelCount = mipLevels;
 		subresourceRange.layerCount = 6;
 
-		vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
-
-		// Copy the cube map faces from the staging buffer to the optimal tiled image
-		vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
-
-		// Change texture image layout to shader read after all faces have been copied
+		// Copy all layers and mip levels and change texture image layout to shader read
 		this->imageLayout = imageLayout;
-		vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, imageLayout, subresourceRange);
-
-		device->FlushCommandBuffer(copyCmd, copyQueue);
+		device->UploadImage(image, uploadUsage, subresourceRange, pKtxTextureData, ktxTextureSize, bufferCopyRegions, imageLayout, copyQueue);
 
         // Create sampler
 		VkSamplerCreateInfo samplerCreateInfo = vks::initializers::GenSamplerCreateInfo();
@@ -798,10 +637,7 @@ namespace vks
 		viewCreateInfo.image = image;
 		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, nullptr, &view));
 
-		// Clean up staging resources
 		ktxTexture_Destroy(pKtxTexture);
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
 
 		// Update descriptor image info member that can be used for setting up descriptor sets
 		updateDescriptor();
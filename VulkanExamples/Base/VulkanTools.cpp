@@ -425,6 +425,21 @@ namespace vks
 		}
 #endif
 
+		VkPipelineShaderStageCreateInfo loadShaderStage(const std::string& fileName, VkShaderStageFlagBits stage, VkDevice device)
+		{
+			VkPipelineShaderStageCreateInfo shaderStage{};
+			shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			shaderStage.stage = stage;
+#if defined(__ANDROID__)
+			shaderStage.module = loadShader(androidApp->activity->assetManager, fileName.c_str(), device);
+#else
+			shaderStage.module = loadShader(fileName.c_str(), device);
+#endif
+			shaderStage.pName = "main";
+			assert(shaderStage.module != VK_NULL_HANDLE);
+			return shaderStage;
+		}
+
 		bool fileExists(const std::string &filename)
 		{
 			std::ifstream f(filename.c_str());
@@ -128,6 +128,8 @@ namespace vks
 #else
 		VkShaderModule loadShader(const char *fileName, VkDevice device);
 #endif
+		/** @brief Load a SPIR-V shader into a shader stage description, the caller owns (and destroys) the module */
+		VkPipelineShaderStageCreateInfo loadShaderStage(const std::string& fileName, VkShaderStageFlagBits stage, VkDevice device);
 
 		/** @brief Checks if a file exists */
 		bool fileExists(const std::string &filename);
@@ -60,6 +60,7 @@ namespace vks
 	void UIOverlay::prepareResources()
 	{
 		ImGuiIO& io = ImGui::GetIO();
+		dirtyRanges.create(device->logicalDevice, device->properties.limits.nonCoherentAtomSize);
 
 		// Create font texture
 		unsigned char* fontData;
@@ -331,10 +332,8 @@ namespace vks
 		if ((vertexBuffer.buffer == VK_NULL_HANDLE) || (vertexCount != imDrawData->TotalVtxCount)) {
 			vertexBuffer.unmap();
 			vertexBuffer.destroy();
-			VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &vertexBuffer, vertexBufferSize));
+			VK_CHECK_RESULT(device->CreateHostBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vks::HostAccess::Upload, &vertexBuffer, vertexBufferSize));
 			vertexCount = imDrawData->TotalVtxCount;
-			vertexBuffer.unmap();
-			vertexBuffer.map();
 			updateCmdBuffers = true;
 		}
 
@@ -342,9 +341,8 @@ namespace vks
 		if ((indexBuffer.buffer == VK_NULL_HANDLE) || (indexCount < imDrawData->TotalIdxCount)) {
 			indexBuffer.unmap();
 			indexBuffer.destroy();
-			VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &indexBuffer, indexBufferSize));
+			VK_CHECK_RESULT(device->CreateHostBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, vks::HostAccess::Upload, &indexBuffer, indexBufferSize));
 			indexCount = imDrawData->TotalIdxCount;
-			indexBuffer.map();
 			updateCmdBuffers = true;
 		}
 
@@ -360,9 +358,10 @@ namespace vks
 			idxDst += cmd_list->IdxBuffer.Size;
 		}
 
-		// Flush to make writes visible to GPU
-		vertexBuffer.flush();
-		indexBuffer.flush();
+		// Flush the written part of non coherent buffers to make the writes visible to the GPU, both in one call
+		dirtyRanges.add(vertexBuffer, vertexBufferSize);
+		dirtyRanges.add(indexBuffer, indexBufferSize);
+		VK_CHECK_RESULT(dirtyRanges.flush());
 
 		return updateCmdBuffers;
 	}
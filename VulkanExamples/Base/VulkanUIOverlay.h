@@ -43,6 +43,8 @@ namespace vks
 		vks::Buffer indexBuffer;
 		int32_t vertexCount = 0;
 		int32_t indexCount = 0;
+		/** @brief Written ranges of the vertex and index buffer if they are not host coherent */
+		vks::MappedRangeTracker dirtyRanges;
 
 		std::vector<VkPipelineShaderStageCreateInfo> shaders;
 
@@ -0,0 +1,918 @@
+/*
+* Content adaptive variable rate shading
+*
+* Builds a per tile shading rate image from the luminance gradients and motion of the previous frame
+* and applies it through a VK_KHR_fragment_shading_rate attachment, falls back to full rate shading
+* when the extension is not available
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanVariableRateShading.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+namespace vks
+{
+	namespace
+	{
+		/** @brief Matches the PushConsts block of variablerateshading/shading_rate.comp */
+		struct PushConstants
+		{
+			glm::vec4 thresholds;
+			glm::ivec2 inputSize;
+			uint32_t hasMotion;
+			uint32_t _pad;
+		};
+
+		const uint32_t classifyGroupSize = 8;
+
+		/** @brief Matches the PushConsts block of variablerateshading/benchmark.frag */
+		struct BenchmarkPushConstants
+		{
+			float time;
+			uint32_t iterations;
+		};
+
+		/** @brief Device local 2D image with a single mip level and view */
+		struct BenchmarkImage
+		{
+			VkImage image = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+
+			void create(vks::VulkanDevice* device, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, uint32_t width, uint32_t height)
+			{
+				VkImageCreateInfo imageInfo = vks::initializers::GenImageCreateInfo();
+				imageInfo.imageType = VK_IMAGE_TYPE_2D;
+				imageInfo.format = format;
+				imageInfo.extent = { width, height, 1 };
+				imageInfo.mipLevels = 1;
+				imageInfo.arrayLayers = 1;
+				imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+				imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+				imageInfo.usage = usage;
+				VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageInfo, nullptr, &image));
+				VkMemoryRequirements memReqs;
+				vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+				VkMemoryAllocateInfo memAlloc = vks::initializers::GenMemoryAllocateInfo();
+				memAlloc.allocationSize = memReqs.size;
+				memAlloc.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+				VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &memory));
+				VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, memory, 0));
+				VkImageViewCreateInfo viewInfo = vks::initializers::GenImageViewCreateInfo();
+				viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+				viewInfo.format = format;
+				viewInfo.subresourceRange = { aspect, 0, 1, 0, 1 };
+				viewInfo.image = image;
+				VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewInfo, nullptr, &view));
+			}
+
+			void destroy(VkDevice logicalDevice)
+			{
+				vkDestroyImageView(logicalDevice, view, nullptr);
+				vkDestroyImage(logicalDevice, image, nullptr);
+				vkFreeMemory(logicalDevice, memory, nullptr);
+			}
+		};
+	}
+
+	uint8_t VariableRateShading::encodeRate(uint32_t log2Width, uint32_t log2Height)
+	{
+		return static_cast<uint8_t>((log2Width << 2) | log2Height);
+	}
+
+	uint32_t VariableRateShading::rateIndex(uint8_t rate)
+	{
+		return ((rate >> 2) << 1) | (rate & 3);
+	}
+
+	/**
+	* Pick the shading rate of a tile, mirrored by classifyTile in variablerateshading/shading_rate.comp
+	*
+	* An axis is shaded at half rate if the luminance barely changes along it, if it changes moderately and the
+	* tile moves at more than half the motion threshold, or if the tile moves faster than the motion threshold
+	*
+	* @param gradientX Average absolute luminance difference between horizontal neighbours
+	* @param gradientY Average absolute luminance difference between vertical neighbours
+	* @param motion Largest motion inside the tile in pixels per frame
+	* @param settings Classification thresholds
+	*
+	* @return Encoded attachment rate
+	*/
+	uint8_t VariableRateShading::classifyTile(float gradientX, float gradientY, float motion, const Settings& settings)
+	{
+		auto coarseAxis = [&](float gradient)
+		{
+			if (motion >= settings.motionThreshold)
+			{
+				return true;
+			}
+			if (gradient < settings.lowGradient)
+			{
+				return true;
+			}
+			return gradient < settings.highGradient && motion >= settings.motionThreshold * 0.5f;
+		};
+		// A 2x1 rate covers two pixels horizontally, so it is used when the horizontal gradient is low
+		return encodeRate(coarseAxis(gradientX) ? 1 : 0, coarseAxis(gradientY) ? 1 : 0);
+	}
+
+	/**
+	* Reference implementation of the classification pass
+	*
+	* @param luminance Display referred luminance per pixel (width * height)
+	* @param motion Optional motion per pixel in pixels per frame, may be nullptr
+	* @param width Width of the input in pixels
+	* @param height Height of the input in pixels
+	* @param tileSize Size of a shading rate texel in pixels
+	* @param settings Classification thresholds
+	* @param rates Receives the encoded rate of each tile, row major
+	*/
+	void VariableRateShading::classifyTilesCPU(const float* luminance, const glm::vec2* motion, uint32_t width, uint32_t height, uint32_t tileSize,
+		const Settings& settings, std::vector<uint8_t>& rates)
+	{
+		const uint32_t tilesX = (width + tileSize - 1) / tileSize;
+		const uint32_t tilesY = (height + tileSize - 1) / tileSize;
+		rates.resize(tilesX * tilesY);
+		for (uint32_t ty = 0; ty < tilesY; ty++)
+		{
+			for (uint32_t tx = 0; tx < tilesX; tx++)
+			{
+				float sumX = 0.0f;
+				float sumY = 0.0f;
+				float maxMotion = 0.0f;
+				uint32_t count = 0;
+				const uint32_t endY = std::min((ty + 1) * tileSize, height);
+				const uint32_t endX = std::min((tx + 1) * tileSize, width);
+				for (uint32_t y = ty * tileSize; y < endY; y++)
+				{
+					for (uint32_t x = tx * tileSize; x < endX; x++)
+					{
+						const float center = luminance[y * width + x];
+						sumX += std::abs(luminance[y * width + std::min(x + 1, width - 1)] - center);
+						sumY += std::abs(luminance[std::min(y + 1, height - 1) * width + x] - center);
+						if (motion)
+						{
+							maxMotion = std::max(maxMotion, glm::length(motion[y * width + x]));
+						}
+						count++;
+					}//for
+				}//for
+				rates[ty * tilesX + tx] = classifyTile(sumX / count, sumY / count, maxMotion, settings);
+			}//for
+		}//for
+	}
+
+	/**
+	* Check for attachment shading rate support and request the extensions and features, call from getEnabledExtensions
+	*
+	* @param device Device whose physical device is checked, the logical device does not need to exist yet
+	* @param apiVersion Instance API version, Vulkan 1.1 is required to query the features
+	* @param enabledExtensions Device extensions, the required extensions are appended
+	* @param pNextChain Device create pNext chain, the feature structure is prepended
+	*
+	* @return True if variable rate shading will be available
+	*/
+	bool VariableRateShading::requestDeviceSupport(vks::VulkanDevice* device, uint32_t apiVersion, std::vector<const char*>& enabledExtensions, void*& pNextChain)
+	{
+		supported = false;
+		if (apiVersion < VK_API_VERSION_1_1 || device->properties.apiVersion < VK_API_VERSION_1_1)
+		{
+			return false;
+		}
+		if (!device->IsExtensionSupported(VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME) || !device->IsExtensionSupported(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME))
+		{
+			return false;
+		}
+
+		VkPhysicalDeviceFragmentShadingRateFeaturesKHR shadingRateFeatures{};
+		shadingRateFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR;
+		VkPhysicalDeviceFeatures2 features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &shadingRateFeatures;
+		vkGetPhysicalDeviceFeatures2(device->physicalDevice, &features2);
+		if (!shadingRateFeatures.attachmentFragmentShadingRate)
+		{
+			return false;
+		}
+
+		// The classification shader writes the rates as storage image
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(device->physicalDevice, VK_FORMAT_R8_UINT, &formatProperties);
+		const VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR;
+		if ((formatProperties.optimalTilingFeatures & requiredFeatures) != requiredFeatures)
+		{
+			return false;
+		}
+
+		enabledExtensions.push_back(VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME);
+		enabledExtensions.push_back(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME);
+		enabledFeatures = {};
+		enabledFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR;
+		enabledFeatures.attachmentFragmentShadingRate = VK_TRUE;
+		enabledFeatures.pNext = pNextChain;
+		pNextChain = &enabledFeatures;
+		supported = true;
+		return true;
+	}
+
+	/**
+	* Create the classification pipeline and the statistics queries
+	*
+	* @param device Logical device, created with the chain from requestDeviceSupport
+	* @param pipelineCache Pipeline cache used for the compute pipeline
+	* @param shadersPath Base path of the GLSL shaders (getShadersPath())
+	* @param frameCount Number of command buffers recorded with the module, each gets its own query and tile counts
+	*/
+	void VariableRateShading::prepare(vks::VulkanDevice* device, VkPipelineCache pipelineCache, const std::string& shadersPath, uint32_t frameCount)
+	{
+		this->device = device;
+		this->frameCount = frameCount;
+
+		// Pipeline statistics also work without shading rate support and then report the full rate baseline
+		statisticsSupported = device->m_enabledDeviceFeatures.pipelineStatisticsQuery == VK_TRUE;
+		if (statisticsSupported)
+		{
+			VkQueryPoolCreateInfo queryPoolInfo{};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+			queryPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+			queryPoolInfo.queryCount = frameCount;
+			VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolInfo, nullptr, &statisticsQueryPool));
+		}
+
+		if (!supported)
+		{
+			return;
+		}
+
+		vkCreateRenderPass2KHR = reinterpret_cast<PFN_vkCreateRenderPass2KHR>(vkGetDeviceProcAddr(device->logicalDevice, "vkCreateRenderPass2KHR"));
+
+		VkPhysicalDeviceFragmentShadingRatePropertiesKHR shadingRateProperties{};
+		shadingRateProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_PROPERTIES_KHR;
+		VkPhysicalDeviceProperties2 properties2{};
+		properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties2.pNext = &shadingRateProperties;
+		vkGetPhysicalDeviceProperties2(device->physicalDevice, &properties2);
+
+		// Texel sizes are powers of two, square tiles keep the classification symmetric
+		uint32_t tileSize = settings.tileSize;
+		tileSize = std::max(tileSize, std::max(shadingRateProperties.minFragmentShadingRateAttachmentTexelSize.width, shadingRateProperties.minFragmentShadingRateAttachmentTexelSize.height));
+		tileSize = std::min(tileSize, std::min(shadingRateProperties.maxFragmentShadingRateAttachmentTexelSize.width, shadingRateProperties.maxFragmentShadingRateAttachmentTexelSize.height));
+		tileSize = std::max(tileSize, classifyGroupSize);
+		texelSize = { tileSize, tileSize };
+
+		// Only rates up to 2x2 are used, those are guaranteed for attachment shading rates
+		pipelineShadingRateState = {};
+		pipelineShadingRateState.sType = VK_STRUCTURE_TYPE_PIPELINE_FRAGMENT_SHADING_RATE_STATE_CREATE_INFO_KHR;
+		pipelineShadingRateState.fragmentSize = { 1, 1 };
+		pipelineShadingRateState.combinerOps[0] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR;
+		pipelineShadingRateState.combinerOps[1] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_REPLACE_KHR;
+
+		countsStride = vks::tools::alignedSize(VRS_RATE_COUNT * sizeof(uint32_t), static_cast<uint32_t>(device->properties.limits.minStorageBufferOffsetAlignment));
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &countsBuffer, countsStride * frameCount));
+		VK_CHECK_RESULT(countsBuffer.map());
+		memset(countsBuffer.mappedData, 0, countsStride * frameCount);
+
+		VkSamplerCreateInfo samplerInfo = vks::initializers::GenSamplerCreateInfo();
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = samplerInfo.addressModeU;
+		samplerInfo.addressModeW = samplerInfo.addressModeU;
+		samplerInfo.maxAnisotropy = 1.0f;
+		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerInfo, nullptr, &sampler));
+
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+		};
+		VkDescriptorSetLayoutCreateInfo layoutInfo = vks::initializers::GenDescriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &layoutInfo, nullptr, &descriptorSetLayout));
+
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1),
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::GenDescriptorPoolCreateInfo(poolSizes, 1);
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+
+		VkPushConstantRange pushConstantRange = vks::initializers::GenPushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PushConstants), 0);
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = vks::initializers::GenPipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+
+		// One workgroup per tile, the tile size is baked in as specialization constant
+		VkSpecializationMapEntry specializationEntry = vks::initializers::GenSpecializationMapEntry(0, 0, sizeof(uint32_t));
+		VkSpecializationInfo specializationInfo = vks::initializers::GenSpecializationInfo(1, &specializationEntry, sizeof(uint32_t), &tileSize);
+		VkComputePipelineCreateInfo pipelineInfo = vks::initializers::GenComputePipelineCreateInfo(pipelineLayout);
+		pipelineInfo.stage = vks::tools::loadShaderStage(shadersPath + "variablerateshading/shading_rate.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT, device->logicalDevice);
+		pipelineInfo.stage.pSpecializationInfo = &specializationInfo;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline));
+		vkDestroyShaderModule(device->logicalDevice, pipelineInfo.stage.module, nullptr);
+
+		gpuTimer.create(device, 1, frameCount);
+	}
+
+	/**
+	* (Re)create the shading rate image for a new resolution and point the classification at the previous frame
+	*
+	* @param colorView Display referred color of the previous frame, must be in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	* @param motionView Optional motion vectors in UV units (RG), VK_NULL_HANDLE classifies on luminance only
+	* @param width Render width in pixels
+	* @param height Render height in pixels
+	*/
+	void VariableRateShading::setInputs(VkImageView colorView, VkImageView motionView, uint32_t width, uint32_t height)
+	{
+		inputWidth = width;
+		inputHeight = height;
+		hasMotion = motionView != VK_NULL_HANDLE;
+		if (!supported)
+		{
+			return;
+		}
+		destroyImage();
+
+		extent = { (width + texelSize.width - 1) / texelSize.width, (height + texelSize.height - 1) / texelSize.height };
+		VkImageCreateInfo imageInfo = vks::initializers::GenImageCreateInfo();
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = VK_FORMAT_R8_UINT;
+		imageInfo.extent = { extent.width, extent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR;
+		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageInfo, nullptr, &image));
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::GenMemoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &memory));
+		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, memory, 0));
+
+		VkImageViewCreateInfo viewInfo = vks::initializers::GenImageViewCreateInfo();
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R8_UINT;
+		viewInfo.image = image;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewInfo, nullptr, &view));
+
+		if (descriptorSet == VK_NULL_HANDLE)
+		{
+			VkDescriptorSetAllocateInfo allocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &descriptorSet));
+		}
+		// Without motion vectors the color view is bound as placeholder, the shader skips the motion fetch
+		VkDescriptorImageInfo colorInfo = vks::initializers::GenDescriptorImageInfo(sampler, colorView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		VkDescriptorImageInfo motionInfo = vks::initializers::GenDescriptorImageInfo(sampler, hasMotion ? motionView : colorView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		VkDescriptorImageInfo rateInfo = vks::initializers::GenDescriptorImageInfo(VK_NULL_HANDLE, view, VK_IMAGE_LAYOUT_GENERAL);
+		VkDescriptorBufferInfo countsInfo = { countsBuffer.buffer, 0, VRS_RATE_COUNT * sizeof(uint32_t) };
+		std::vector<VkWriteDescriptorSet> writes = {
+			vks::initializers::GenWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &colorInfo),
+			vks::initializers::GenWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &motionInfo),
+			vks::initializers::GenWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2, &rateInfo),
+			vks::initializers::GenWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 3, &countsInfo),
+		};
+		vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+
+	void VariableRateShading::destroyImage()
+	{
+		if (image == VK_NULL_HANDLE)
+		{
+			return;
+		}
+		vkDestroyImageView(device->logicalDevice, view, nullptr);
+		vkDestroyImage(device->logicalDevice, image, nullptr);
+		vkFreeMemory(device->logicalDevice, memory, nullptr);
+		image = VK_NULL_HANDLE;
+		view = VK_NULL_HANDLE;
+	}
+
+	void VariableRateShading::destroy()
+	{
+		if (!device)
+		{
+			return;
+		}
+		if (statisticsQueryPool != VK_NULL_HANDLE)
+		{
+			vkDestroyQueryPool(device->logicalDevice, statisticsQueryPool, nullptr);
+			statisticsQueryPool = VK_NULL_HANDLE;
+		}
+		if (supported)
+		{
+			destroyImage();
+			vkDestroyPipeline(device->logicalDevice, pipeline, nullptr);
+			vkDestroyPipelineLayout(device->logicalDevice, pipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayout, nullptr);
+			vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+			vkDestroySampler(device->logicalDevice, sampler, nullptr);
+			countsBuffer.destroy();
+			gpuTimer.destroy();
+		}
+		device = nullptr;
+	}
+
+	/**
+	* Create a single subpass color/depth render pass that consumes the shading rate image
+	*
+	* Uses vkCreateRenderPass2KHR with a fragment shading rate attachment when supported and a regular
+	* render pass otherwise, so the same code path works on both
+	*
+	* @param colorFormat Format of the color attachment (cleared, stored)
+	* @param colorFinalLayout Layout of the color attachment after the pass
+	* @param depthFormat Format of the depth attachment (cleared, not stored)
+	*
+	* @return Render pass matching the attachments returned by getFramebufferAttachments
+	*/
+	VkRenderPass VariableRateShading::createRenderPass(VkFormat colorFormat, VkImageLayout colorFinalLayout, VkFormat depthFormat)
+	{
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		if (!supported)
+		{
+			std::array<VkAttachmentDescription, 2> attachments{};
+			attachments[0].format = colorFormat;
+			attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+			attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			attachments[0].finalLayout = colorFinalLayout;
+			attachments[1] = attachments[0];
+			attachments[1].format = depthFormat;
+			attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+			VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+			VkAttachmentReference depthReference = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+			VkSubpassDescription subpass{};
+			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+			subpass.colorAttachmentCount = 1;
+			subpass.pColorAttachments = &colorReference;
+			subpass.pDepthStencilAttachment = &depthReference;
+
+			VkSubpassDependency dependency{};
+			dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+			dependency.dstSubpass = 0;
+			dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependency.dstStageMask = dependency.srcStageMask;
+			dependency.srcAccessMask = 0;
+			dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+			VkRenderPassCreateInfo renderPassInfo = vks::initializers::GenRenderPassCreateInfo();
+			renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+			renderPassInfo.pAttachments = attachments.data();
+			renderPassInfo.subpassCount = 1;
+			renderPassInfo.pSubpasses = &subpass;
+			renderPassInfo.dependencyCount = 1;
+			renderPassInfo.pDependencies = &dependency;
+			VK_CHECK_RESULT(vkCreateRenderPass(device->logicalDevice, &renderPassInfo, nullptr, &renderPass));
+			return renderPass;
+		}
+
+		std::array<VkAttachmentDescription2, 3> attachments{};
+		for (VkAttachmentDescription2& attachment : attachments)
+		{
+			attachment.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
+			attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+			attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		}
+		attachments[0].format = colorFormat;
+		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[0].finalLayout = colorFinalLayout;
+		attachments[1].format = depthFormat;
+		attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		attachments[2].format = VK_FORMAT_R8_UINT;
+		attachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[2].initialLayout = VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR;
+		attachments[2].finalLayout = VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR;
+
+		VkAttachmentReference2 colorReference{ VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2, nullptr, 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT };
+		VkAttachmentReference2 depthReference{ VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2, nullptr, 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT };
+		VkAttachmentReference2 shadingRateReference{ VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2, nullptr, 2, VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR, 0 };
+
+		VkFragmentShadingRateAttachmentInfoKHR shadingRateAttachmentInfo{};
+		shadingRateAttachmentInfo.sType = VK_STRUCTURE_TYPE_FRAGMENT_SHADING_RATE_ATTACHMENT_INFO_KHR;
+		shadingRateAttachmentInfo.pFragmentShadingRateAttachment = &shadingRateReference;
+		shadingRateAttachmentInfo.shadingRateAttachmentTexelSize = texelSize;
+
+		VkSubpassDescription2 subpass{};
+		subpass.sType = VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_2;
+		subpass.pNext = &shadingRateAttachmentInfo;
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = &colorReference;
+		subpass.pDepthStencilAttachment = &depthReference;
+
+		VkSubpassDependency2 dependency{};
+		dependency.sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2;
+		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependency.dstSubpass = 0;
+		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependency.dstStageMask = dependency.srcStageMask;
+		dependency.srcAccessMask = 0;
+		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		VkRenderPassCreateInfo2 renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO_2;
+		renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		renderPassInfo.pAttachments = attachments.data();
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpass;
+		renderPassInfo.dependencyCount = 1;
+		renderPassInfo.pDependencies = &dependency;
+		VK_CHECK_RESULT(vkCreateRenderPass2KHR(device->logicalDevice, &renderPassInfo, nullptr, &renderPass));
+		return renderPass;
+	}
+
+	/**
+	* Framebuffer attachments for a render pass created with createRenderPass
+	*/
+	std::vector<VkImageView> VariableRateShading::getFramebufferAttachments(VkImageView colorView, VkImageView depthView) const
+	{
+		std::vector<VkImageView> attachments = { colorView, depthView };
+		if (supported)
+		{
+			attachments.push_back(view);
+		}
+		return attachments;
+	}
+
+	/**
+	* Chain the shading rate state into a pipeline that is used in the shading rate render pass
+	*
+	* @note Pipelines created for the render pass must not be used when the image is not bound, nothing is chained without support
+	*/
+	void VariableRateShading::applyToPipeline(VkGraphicsPipelineCreateInfo& pipelineCreateInfo)
+	{
+		if (!supported)
+		{
+			return;
+		}
+		pipelineShadingRateState.pNext = pipelineCreateInfo.pNext;
+		pipelineCreateInfo.pNext = &pipelineShadingRateState;
+	}
+
+	/**
+	* Record the classification pass and transition the image for use as shading rate attachment
+	*
+	* Disabling settings.enabled fills the image with full rate, so the render pass and pipelines stay unchanged
+	* (re-record the command buffers after toggling)
+	*/
+	void VariableRateShading::recordShadingRate(VkCommandBuffer commandBuffer)
+	{
+		if (statisticsSupported)
+		{
+			vkCmdResetQueryPool(commandBuffer, statisticsQueryPool, currentFrame, 1);
+		}
+		if (!supported)
+		{
+			return;
+		}
+
+		gpuTimer.currentFrame = currentFrame;
+		gpuTimer.reset(commandBuffer);
+		uint32_t scope = gpuTimer.beginScope(commandBuffer, "Shading rate");
+
+		VkImageMemoryBarrier imageBarrier = vks::initializers::GenImageMemoryBarrier();
+		imageBarrier.srcAccessMask = 0;
+		imageBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imageBarrier.image = image;
+		imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+		VkPipelineStageFlags writeStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		if (settings.enabled)
+		{
+			vkCmdFillBuffer(commandBuffer, countsBuffer.buffer, countsStride * currentFrame, VRS_RATE_COUNT * sizeof(uint32_t), 0);
+			VkBufferMemoryBarrier bufferBarrier = vks::initializers::GenBufferMemoryBarrier();
+			bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.buffer = countsBuffer.buffer;
+			bufferBarrier.offset = countsStride * currentFrame;
+			bufferBarrier.size = VRS_RATE_COUNT * sizeof(uint32_t);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
+			PushConstants pushConstants{};
+			pushConstants.thresholds = glm::vec4(settings.lowGradient, settings.highGradient, settings.motionThreshold, 0.0f);
+			pushConstants.inputSize = glm::ivec2(inputWidth, inputHeight);
+			pushConstants.hasMotion = hasMotion ? 1 : 0;
+			uint32_t dynamicOffset = static_cast<uint32_t>(countsStride * currentFrame);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 1, &dynamicOffset);
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+			vkCmdDispatch(commandBuffer, extent.width, extent.height, 1);
+		}
+		else
+		{
+			// A zero rate is 1x1
+			VkClearColorValue clearValue{};
+			VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+			vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &range);
+			writeStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		}
+
+		imageBarrier.srcAccessMask = settings.enabled ? VK_ACCESS_SHADER_WRITE_BIT : VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageBarrier.dstAccessMask = VK_ACCESS_FRAGMENT_SHADING_RATE_ATTACHMENT_READ_BIT_KHR;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR;
+		vkCmdPipelineBarrier(commandBuffer, writeStage, VK_PIPELINE_STAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+		gpuTimer.endScope(commandBuffer, scope);
+	}
+
+	/** @brief Start counting fragment shader invocations, call inside the render pass before the draws */
+	void VariableRateShading::beginStatistics(VkCommandBuffer commandBuffer)
+	{
+		if (statisticsSupported)
+		{
+			vkCmdBeginQuery(commandBuffer, statisticsQueryPool, currentFrame, 0);
+		}
+	}
+
+	void VariableRateShading::endStatistics(VkCommandBuffer commandBuffer)
+	{
+		if (statisticsSupported)
+		{
+			vkCmdEndQuery(commandBuffer, statisticsQueryPool, currentFrame);
+		}
+	}
+
+	/**
+	* Read back the results of a completed frame
+	*
+	* Frames recorded with settings.enabled off (or without shading rate support) update the baseline,
+	* the savings compare the latest adaptive frame against that baseline
+	*
+	* @param frame Frame slot the command buffer was recorded with
+	*/
+	void VariableRateShading::collectStats(uint32_t frame)
+	{
+		const bool adaptive = supported && settings.enabled;
+		if (adaptive)
+		{
+			const uint32_t* counts = reinterpret_cast<const uint32_t*>(static_cast<const uint8_t*>(countsBuffer.mappedData) + countsStride * frame);
+			std::copy(counts, counts + VRS_RATE_COUNT, stats.tileCounts.begin());
+		}
+		else
+		{
+			stats.tileCounts = {};
+			stats.tileCounts[0] = extent.width * extent.height;
+		}
+		if (supported)
+		{
+			gpuTimer.currentFrame = frame;
+			gpuTimer.collect();
+		}
+
+		if (!statisticsSupported)
+		{
+			return;
+		}
+		uint64_t invocations = 0;
+		if (vkGetQueryPoolResults(device->logicalDevice, statisticsQueryPool, frame, 1, sizeof(uint64_t), &invocations, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+		{
+			return;
+		}
+		stats.fragmentInvocations = invocations;
+		if (!adaptive)
+		{
+			stats.baselineInvocations = invocations;
+		}
+		stats.invocationSavings = stats.baselineInvocations > 0 ? 1.0f - static_cast<float>(invocations) / static_cast<float>(stats.baselineInvocations) : 0.0f;
+	}
+
+	/**
+	* Renders the same animated procedural frames once at full rate and once with the adaptive shading rate image classified from
+	* the previous frame, then reports the fragment invocations, the GPU time of the scene and of the classification, and the share
+	* of tiles per rate
+	*
+	* @param device Device created with the chain requested by shadingRate.requestDeviceSupport
+	* @param queue Queue the frames are submitted to, every frame is waited for
+	* @param shadersPath Base path of the GLSL shaders (getShadersPath())
+	* @param shadingRate Module that requested the device support, prepared and destroyed here
+	* @param out Stream the report is written to
+	* @param frames Number of frames of each flight
+	*/
+	void benchmarkVariableRateShading(vks::VulkanDevice* device, VkQueue queue, const std::string& shadersPath, VariableRateShading& shadingRate, std::ostream& out, uint32_t frames)
+	{
+		const uint32_t width = 1920;
+		const uint32_t height = 1080;
+		const uint32_t iterations = 64;
+		const VkFormat colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+		VkDevice logicalDevice = device->logicalDevice;
+
+		shadingRate.prepare(device, VK_NULL_HANDLE, shadersPath);
+		if (!shadingRate.supported)
+		{
+			out << "Variable rate shading: attachment shading rates are not supported by the device\n";
+			shadingRate.destroy();
+			return;
+		}
+
+		VkFormat depthFormat;
+		VkBool32 validFormat = vks::tools::getSupportedDepthFormat(device->physicalDevice, &depthFormat);
+		assert(validFormat);
+		// The frame is copied into the history image the next frame is classified from
+		BenchmarkImage color, history, depth;
+		color.create(device, colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT, width, height);
+		history.create(device, colorFormat, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_IMAGE_ASPECT_COLOR_BIT, width, height);
+		depth.create(device, depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, width, height);
+		{
+			VkCommandBuffer commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vks::tools::setImageLayout(commandBuffer, history.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			device->FlushCommandBuffer(commandBuffer, queue, true);
+		}
+		shadingRate.setInputs(history.view, VK_NULL_HANDLE, width, height);
+
+		VkRenderPass renderPass = shadingRate.createRenderPass(colorFormat, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, depthFormat);
+		std::vector<VkImageView> attachments = shadingRate.getFramebufferAttachments(color.view, depth.view);
+		VkFramebufferCreateInfo frameBufferInfo = vks::initializers::GenFrameBufferCreateInfo();
+		frameBufferInfo.renderPass = renderPass;
+		frameBufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		frameBufferInfo.pAttachments = attachments.data();
+		frameBufferInfo.width = width;
+		frameBufferInfo.height = height;
+		frameBufferInfo.layers = 1;
+		VkFramebuffer frameBuffer;
+		VK_CHECK_RESULT(vkCreateFramebuffer(logicalDevice, &frameBufferInfo, nullptr, &frameBuffer));
+
+		VkPushConstantRange pushConstantRange = vks::initializers::GenPushConstantRange(VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(BenchmarkPushConstants), 0);
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = vks::initializers::GenPipelineLayoutCreateInfo(nullptr, 0);
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		VkPipelineLayout pipelineLayout;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::GenPipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
+		VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::GenPipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
+		VkPipelineColorBlendAttachmentState blendAttachmentState = vks::initializers::GenPipelineColorBlendAttachmentState(0xf, VK_FALSE);
+		VkPipelineColorBlendStateCreateInfo colorBlendState = vks::initializers::GenPipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
+		VkPipelineDepthStencilStateCreateInfo depthStencilState = vks::initializers::GenPipelineDepthStencilStateCreateInfo(VK_FALSE, VK_FALSE, VK_COMPARE_OP_ALWAYS);
+		VkPipelineViewportStateCreateInfo viewportState = vks::initializers::GenPipelineViewportStateCreateInfo(1, 1, 0);
+		VkPipelineMultisampleStateCreateInfo multisampleState = vks::initializers::GenPipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT, 0);
+		std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamicState = vks::initializers::GenPipelineDynamicStateCreateInfo(dynamicStateEnables);
+		VkPipelineVertexInputStateCreateInfo vertexInputState = vks::initializers::GenPipelineVertexInputStateCreateInfo();
+		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {
+			vks::tools::loadShaderStage(shadersPath + "variablerateshading/benchmark.vert.spv", VK_SHADER_STAGE_VERTEX_BIT, logicalDevice),
+			vks::tools::loadShaderStage(shadersPath + "variablerateshading/benchmark.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT, logicalDevice),
+		};
+		VkGraphicsPipelineCreateInfo pipelineInfo = vks::initializers::GenPipelineCreateInfo(pipelineLayout, renderPass, 0);
+		pipelineInfo.pVertexInputState = &vertexInputState;
+		pipelineInfo.pInputAssemblyState = &inputAssemblyState;
+		pipelineInfo.pRasterizationState = &rasterizationState;
+		pipelineInfo.pColorBlendState = &colorBlendState;
+		pipelineInfo.pMultisampleState = &multisampleState;
+		pipelineInfo.pViewportState = &viewportState;
+		pipelineInfo.pDepthStencilState = &depthStencilState;
+		pipelineInfo.pDynamicState = &dynamicState;
+		pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+		pipelineInfo.pStages = shaderStages.data();
+		shadingRate.applyToPipeline(pipelineInfo);
+		VkPipeline pipeline;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline));
+		for (const VkPipelineShaderStageCreateInfo& stage : shaderStages)
+		{
+			vkDestroyShaderModule(logicalDevice, stage.module, nullptr);
+		}
+
+		vks::GpuTimer gpuTimer;
+		gpuTimer.create(device, 1);
+
+		std::ios_base::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+		out << std::fixed << std::setprecision(3);
+		out << "Variable rate shading: " << frames << " frames at " << width << " x " << height << ", " << shadingRate.texelSize.width << " x "
+			<< shadingRate.texelSize.height << " pixel tiles, " << iterations << " shading iterations per invocation\n";
+		if (!shadingRate.statisticsSupported)
+		{
+			out << "  Pipeline statistics queries are not supported, invocation counts are 0\n";
+		}
+		if (!gpuTimer.supported)
+		{
+			out << "  Timestamp queries are not supported, GPU times are 0\n";
+		}
+		out << "  " << std::left << std::setw(12) << "mode" << std::right << std::setw(16) << "invocations" << std::setw(10) << "savings" << std::setw(12)
+			<< "scene ms" << std::setw(14) << "classify ms";
+		const char* rateNames[VRS_RATE_COUNT] = { "1x1", "1x2", "2x1", "2x2" };
+		for (const char* rateName : rateNames)
+		{
+			out << std::setw(8) << rateName;
+		}
+		out << "\n";
+
+		// The full rate flight runs first, so the adaptive flight has a baseline to compare against
+		uint64_t baselineInvocations = 0;
+		for (bool adaptive : { false, true })
+		{
+			shadingRate.settings.enabled = adaptive;
+			uint64_t invocations = 0;
+			double sceneMilliseconds = 0.0;
+			double classifyMilliseconds = 0.0;
+			std::array<uint64_t, VRS_RATE_COUNT> tileCounts{};
+			for (uint32_t frame = 0; frame < frames; frame++)
+			{
+				VkCommandBuffer commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+				shadingRate.recordShadingRate(commandBuffer);
+				gpuTimer.reset(commandBuffer);
+				uint32_t scope = gpuTimer.beginScope(commandBuffer, "Scene");
+
+				std::array<VkClearValue, 3> clearValues{};
+				clearValues[1].depthStencil = { 1.0f, 0 };
+				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::GenRenderPassBeginInfo();
+				renderPassBeginInfo.renderPass = renderPass;
+				renderPassBeginInfo.framebuffer = frameBuffer;
+				renderPassBeginInfo.renderArea.extent = { width, height };
+				renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(attachments.size());
+				renderPassBeginInfo.pClearValues = clearValues.data();
+				vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+				VkViewport viewport = vks::initializers::GenViewport(static_cast<float>(width), static_cast<float>(height), 0.0f, 1.0f);
+				VkRect2D scissor = vks::initializers::GenRect2D(width, height, 0, 0);
+				vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+				vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+				const BenchmarkPushConstants pushConstants = { frame / 60.0f, iterations };
+				vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(BenchmarkPushConstants), &pushConstants);
+				shadingRate.beginStatistics(commandBuffer);
+				vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+				shadingRate.endStatistics(commandBuffer);
+				vkCmdEndRenderPass(commandBuffer);
+				gpuTimer.endScope(commandBuffer, scope);
+
+				// Keep the frame as classification input of the next one, the render pass already left it in the transfer source layout
+				VkMemoryBarrier memoryBarrier = vks::initializers::GenMemoryBarrier();
+				memoryBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+				memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+				vks::tools::setImageLayout(commandBuffer, history.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+				VkImageCopy copyRegion{};
+				copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+				copyRegion.dstSubresource = copyRegion.srcSubresource;
+				copyRegion.extent = { width, height, 1 };
+				vkCmdCopyImage(commandBuffer, color.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, history.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+				vks::tools::setImageLayout(commandBuffer, history.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+				device->FlushCommandBuffer(commandBuffer, queue, true);
+
+				gpuTimer.collect(true);
+				shadingRate.collectStats(0);
+				invocations += shadingRate.stats.fragmentInvocations;
+				sceneMilliseconds += gpuTimer.getMilliseconds("Scene");
+				classifyMilliseconds += adaptive ? shadingRate.gpuTimer.getMilliseconds("Shading rate") : 0.0;
+				for (uint32_t rate = 0; rate < VRS_RATE_COUNT; rate++)
+				{
+					tileCounts[rate] += shadingRate.stats.tileCounts[rate];
+				}
+			}//for
+
+			if (!adaptive)
+			{
+				baselineInvocations = invocations;
+			}
+			const double savings = baselineInvocations > 0 ? 1.0 - static_cast<double>(invocations) / static_cast<double>(baselineInvocations) : 0.0;
+			const uint64_t tiles = std::max<uint64_t>(static_cast<uint64_t>(shadingRate.extent.width) * shadingRate.extent.height * frames, 1);
+			out << "  " << std::left << std::setw(12) << (adaptive ? "adaptive" : "full rate") << std::right << std::setw(16) << invocations / frames
+				<< std::setw(9) << savings * 100.0 << "%" << std::setw(12) << sceneMilliseconds / frames << std::setw(14) << classifyMilliseconds / frames;
+			for (uint32_t rate = 0; rate < VRS_RATE_COUNT; rate++)
+			{
+				out << std::setw(7) << 100.0 * tileCounts[rate] / tiles << "%";
+			}
+			out << "\n";
+		}//for
+		out.flags(flags);
+		out.precision(precision);
+
+		gpuTimer.destroy();
+		vkDestroyPipeline(logicalDevice, pipeline, nullptr);
+		vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+		vkDestroyFramebuffer(logicalDevice, frameBuffer, nullptr);
+		vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
+		color.destroy(logicalDevice);
+		history.destroy(logicalDevice);
+		depth.destroy(logicalDevice);
+		shadingRate.destroy();
+	}
+}//vks
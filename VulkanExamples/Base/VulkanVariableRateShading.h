@@ -0,0 +1,133 @@
+/*
+* Content adaptive variable rate shading
+*
+* Builds a per tile shading rate image from the luminance gradients and motion of the previous frame
+* and applies it through a VK_KHR_fragment_shading_rate attachment, falls back to full rate shading
+* when the extension is not available
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <array>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanGpuTimer.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// Number of distinct attachment rates written by the classification (1x1, 1x2, 2x1, 2x2)
+#define VRS_RATE_COUNT 4
+
+namespace vks
+{
+	class VariableRateShading
+	{
+	public:
+		struct Settings
+		{
+			/** @brief Requested tile size in pixels, clamped to the texel sizes supported by the device */
+			uint32_t tileSize = 16;
+			/** @brief Average per pixel luminance change below which an axis is always shaded at half rate */
+			float lowGradient = 0.02f;
+			/** @brief Average per pixel luminance change above which an axis needs full rate unless motion is fast */
+			float highGradient = 0.08f;
+			/** @brief Motion in pixels per frame at which all tiles are shaded at 2x2 */
+			float motionThreshold = 8.0f;
+			bool enabled = true;
+		} settings;
+
+		/** @brief Classification statistics of one frame */
+		struct Stats
+		{
+			/** @brief Tiles per rate, indexed by rateIndex() */
+			std::array<uint32_t, VRS_RATE_COUNT> tileCounts{};
+			uint64_t fragmentInvocations = 0;
+			/** @brief Fragment invocations of the last frame rendered at full rate */
+			uint64_t baselineInvocations = 0;
+			/** @brief Fraction of fragment invocations saved against the baseline */
+			float invocationSavings = 0.0f;
+		} stats;
+
+		vks::VulkanDevice* device = nullptr;
+		/** @brief True if the device supports attachment shading rates and requestDeviceSupport enabled them */
+		bool supported = false;
+		VkExtent2D texelSize{ 16, 16 };
+
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkExtent2D extent{ 0, 0 };
+
+		/** @brief Per frame tile counts written by the classification shader */
+		vks::Buffer countsBuffer;
+		VkDeviceSize countsStride = 0;
+
+		VkSampler sampler = VK_NULL_HANDLE;
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+
+		/** @brief Fragment shader invocation statistics, one query per frame */
+		VkQueryPool statisticsQueryPool = VK_NULL_HANDLE;
+		bool statisticsSupported = false;
+
+		/** @brief Chained into the device create info by requestDeviceSupport */
+		VkPhysicalDeviceFragmentShadingRateFeaturesKHR enabledFeatures{};
+		/** @brief Chain into VkGraphicsPipelineCreateInfo::pNext of pipelines used in the shading rate render pass */
+		VkPipelineFragmentShadingRateStateCreateInfoKHR pipelineShadingRateState{};
+
+		vks::GpuTimer gpuTimer;
+		uint32_t frameCount = 1;
+		/** @brief Frame slot used for the statistics query and tile counts, set before recording a frame's command buffer */
+		uint32_t currentFrame = 0;
+
+		bool requestDeviceSupport(vks::VulkanDevice* device, uint32_t apiVersion, std::vector<const char*>& enabledExtensions, void*& pNextChain);
+		void prepare(vks::VulkanDevice* device, VkPipelineCache pipelineCache, const std::string& shadersPath, uint32_t frameCount = 1);
+		void setInputs(VkImageView colorView, VkImageView motionView, uint32_t width, uint32_t height);
+		void destroy();
+
+		VkRenderPass createRenderPass(VkFormat colorFormat, VkImageLayout colorFinalLayout, VkFormat depthFormat);
+		std::vector<VkImageView> getFramebufferAttachments(VkImageView colorView, VkImageView depthView) const;
+		void applyToPipeline(VkGraphicsPipelineCreateInfo& pipelineCreateInfo);
+
+		void recordShadingRate(VkCommandBuffer commandBuffer);
+		void beginStatistics(VkCommandBuffer commandBuffer);
+		void endStatistics(VkCommandBuffer commandBuffer);
+		/** @brief Read the tile counts and invocation statistics of a completed frame */
+		void collectStats(uint32_t frame);
+
+		/** @brief Encodes a rate as the attachment value (log2(width) << 2 | log2(height)) */
+		static uint8_t encodeRate(uint32_t log2Width, uint32_t log2Height);
+		/** @brief Index of an encoded rate into Stats::tileCounts */
+		static uint32_t rateIndex(uint8_t rate);
+		static uint8_t classifyTile(float gradientX, float gradientY, float motion, const Settings& settings);
+		static void classifyTilesCPU(const float* luminance, const glm::vec2* motion, uint32_t width, uint32_t height, uint32_t tileSize,
+			const Settings& settings, std::vector<uint8_t>& rates);
+
+	private:
+		uint32_t inputWidth = 0;
+		uint32_t inputHeight = 0;
+		bool hasMotion = false;
+		PFN_vkCreateRenderPass2KHR vkCreateRenderPass2KHR = nullptr;
+
+		void destroyImage();
+	};
+
+	/**
+	* @brief Renders animated procedural frames at full rate and with the adaptive shading rate image and reports the fragment invocations saved
+	* @note shadingRate.requestDeviceSupport must have been called for the device before it was created
+	*/
+	void benchmarkVariableRateShading(vks::VulkanDevice* device, VkQueue queue, const std::string& shadersPath, VariableRateShading& shadingRate, std::ostream& out, uint32_t frames = 300);
+}//vks
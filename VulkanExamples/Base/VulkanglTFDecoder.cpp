@@ -0,0 +1,769 @@
+/*
+* glTF attribute decoding
+*
+* The meshopt decoder follows the bitstream of the EXT_meshopt_compression specification
+* (https://github.com/KhronosGroup/glTF/tree/main/extensions/2.0/Vendor/EXT_meshopt_compression)
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanglTFDecoder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "ParallelAlgorithms.hpp"
+
+namespace vkglTF
+{
+	AccessorReader::AccessorReader(const tinygltf::Model& model, int accessorIndex)
+	{
+		if ((accessorIndex < 0) || (accessorIndex >= static_cast<int>(model.accessors.size())))
+		{
+			return;
+		}
+		const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
+		elementCount = accessor.count;
+		componentCount = static_cast<uint32_t>(tinygltf::GetNumComponentsInType(accessor.type));
+		componentType = accessor.componentType;
+		normalized = accessor.normalized;
+		if (accessor.bufferView < 0)
+		{
+			return;
+		}
+		const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+		const tinygltf::Buffer& buffer = model.buffers[view.buffer];
+		int byteStride = accessor.ByteStride(view);
+		if ((byteStride <= 0) || (buffer.data.size() < view.byteOffset + accessor.byteOffset + (elementCount > 0 ? (elementCount - 1) * byteStride + elementSize() : 0)))
+		{
+			return;
+		}
+		stride = static_cast<size_t>(byteStride);
+		data = buffer.data.data() + view.byteOffset + accessor.byteOffset;
+	}
+
+	size_t AccessorReader::elementSize() const
+	{
+		return componentCount * static_cast<size_t>(std::max(tinygltf::GetComponentSizeInBytes(componentType), 0));
+	}
+
+	float AccessorReader::component(const unsigned char* element, uint32_t index) const
+	{
+		switch (componentType)
+		{
+		case TINYGLTF_COMPONENT_TYPE_BYTE:
+		{
+			int8_t value;
+			memcpy(&value, element + index, sizeof(value));
+			return normalized ? std::max(value / 127.0f, -1.0f) : static_cast<float>(value);
+		}
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+		{
+			uint8_t value = element[index];
+			return normalized ? value / 255.0f : static_cast<float>(value);
+		}
+		case TINYGLTF_COMPONENT_TYPE_SHORT:
+		{
+			int16_t value;
+			memcpy(&value, element + index * sizeof(value), sizeof(value));
+			return normalized ? std::max(value / 32767.0f, -1.0f) : static_cast<float>(value);
+		}
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+		{
+			uint16_t value;
+			memcpy(&value, element + index * sizeof(value), sizeof(value));
+			return normalized ? value / 65535.0f : static_cast<float>(value);
+		}
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+		{
+			uint32_t value;
+			memcpy(&value, element + index * sizeof(value), sizeof(value));
+			return static_cast<float>(value);
+		}
+		case TINYGLTF_COMPONENT_TYPE_FLOAT:
+		{
+			float value;
+			memcpy(&value, element + index * sizeof(value), sizeof(value));
+			return value;
+		}
+		default:
+			return 0.0f;
+		}//switch
+	}
+
+	/**
+	* Read one element of the accessor
+	*
+	* @param element Index of the element
+	* @param fallback Value for missing components, or for all of them if the accessor is not valid
+	*
+	* @return The element with integer components converted to float (normalized to [0, 1] or [-1, 1] if the accessor is normalized)
+	*/
+	glm::vec4 AccessorReader::read(size_t element, const glm::vec4& fallback) const
+	{
+		glm::vec4 value = fallback;
+		if (!data)
+		{
+			return value;
+		}
+		const unsigned char* source = data + element * stride;
+		for (uint32_t i = 0; i < std::min(componentCount, 4u); i++)
+		{
+			value[i] = component(source, i);
+		}
+		return value;
+	}
+
+	namespace meshopt
+	{
+		namespace
+		{
+			const unsigned char vertexHeader = 0xa0;
+			const unsigned char indexHeader = 0xe0;
+			const unsigned char sequenceHeader = 0xd0;
+			const size_t vertexBlockSizeBytes = 8192;
+			const size_t vertexBlockMaxSize = 256;
+			const size_t byteGroupSize = 16;
+			// Largest number of bytes a byte group can read, the stream's tail guarantees that much data behind every group
+			const size_t byteGroupDecodeLimit = 24;
+			const size_t tailMaxSize = 32;
+
+			size_t vertexBlockSize(size_t vertexSize)
+			{
+				size_t result = (vertexBlockSizeBytes / vertexSize) & ~(byteGroupSize - 1);
+				return (result < vertexBlockMaxSize) ? result : vertexBlockMaxSize;
+			}
+
+			unsigned char unzigzag8(unsigned char value)
+			{
+				return static_cast<unsigned char>(-(value & 1) ^ (value >> 1));
+			}
+
+			/** Group of 16 values with 0, 2, 4 or 8 bits each, values that do not fit are stored as full bytes after the packed bits */
+			const unsigned char* decodeBytesGroup(const unsigned char* data, unsigned char* destination, int bitsLog2)
+			{
+				switch (bitsLog2)
+				{
+				case 0:
+					memset(destination, 0, byteGroupSize);
+					return data;
+				case 1:
+				case 2:
+				{
+					const uint32_t bits = 1u << bitsLog2;
+					const uint32_t sentinel = (1u << bits) - 1;
+					const uint32_t valuesPerByte = 8 / bits;
+					const unsigned char* extra = data + byteGroupSize / valuesPerByte;
+					for (size_t i = 0; i < byteGroupSize; i++)
+					{
+						unsigned char byte = data[i / valuesPerByte];
+						uint32_t shift = 8 - bits * static_cast<uint32_t>(i % valuesPerByte + 1);
+						uint32_t value = (byte >> shift) & sentinel;
+						destination[i] = (value == sentinel) ? *extra++ : static_cast<unsigned char>(value);
+					}
+					return extra;
+				}
+				default:
+					memcpy(destination, data, byteGroupSize);
+					return data + byteGroupSize;
+				}//switch
+			}
+
+			const unsigned char* decodeBytes(const unsigned char* data, const unsigned char* dataEnd, unsigned char* destination, size_t size)
+			{
+				const unsigned char* header = data;
+				// Two bits per group, rounded up to full bytes
+				size_t headerSize = (size / byteGroupSize + 3) / 4;
+				if (static_cast<size_t>(dataEnd - data) < headerSize)
+				{
+					return nullptr;
+				}
+				data += headerSize;
+				for (size_t i = 0; i < size; i += byteGroupSize)
+				{
+					if (static_cast<size_t>(dataEnd - data) < byteGroupDecodeLimit)
+					{
+						return nullptr;
+					}
+					size_t group = i / byteGroupSize;
+					int bitsLog2 = (header[group / 4] >> ((group % 4) * 2)) & 3;
+					data = decodeBytesGroup(data, destination + i, bitsLog2);
+				}
+				return data;
+			}
+
+			/** Every byte of the vertex is stored as its own stream of zigzag deltas to the previous vertex */
+			const unsigned char* decodeVertexBlock(const unsigned char* data, const unsigned char* dataEnd, unsigned char* vertexData, size_t vertexCount, size_t vertexSize, unsigned char lastVertex[256])
+			{
+				unsigned char deltas[vertexBlockMaxSize];
+				size_t alignedCount = (vertexCount + byteGroupSize - 1) & ~(byteGroupSize - 1);
+				for (size_t k = 0; k < vertexSize; k++)
+				{
+					data = decodeBytes(data, dataEnd, deltas, alignedCount);
+					if (!data)
+					{
+						return nullptr;
+					}
+					unsigned char previous = lastVertex[k];
+					unsigned char* target = vertexData + k;
+					for (size_t i = 0; i < vertexCount; i++)
+					{
+						previous = static_cast<unsigned char>(unzigzag8(deltas[i]) + previous);
+						*target = previous;
+						target += vertexSize;
+					}
+				}
+				memcpy(lastVertex, vertexData + vertexSize * (vertexCount - 1), vertexSize);
+				return data;
+			}
+
+			uint32_t decodeVByte(const unsigned char*& data)
+			{
+				unsigned char lead = *data++;
+				if (lead < 128)
+				{
+					return lead;
+				}
+				uint32_t result = lead & 127;
+				uint32_t shift = 7;
+				for (int i = 0; i < 4; i++)
+				{
+					unsigned char group = *data++;
+					result |= static_cast<uint32_t>(group & 127) << shift;
+					shift += 7;
+					if (group < 128)
+					{
+						break;
+					}
+				}
+				return result;
+			}
+
+			uint32_t decodeIndex(const unsigned char*& data, uint32_t last)
+			{
+				uint32_t value = decodeVByte(data);
+				uint32_t delta = (value >> 1) ^ (0u - (value & 1));
+				return last + delta;
+			}
+
+			void writeTriangle(void* destination, size_t offset, size_t indexSize, uint32_t a, uint32_t b, uint32_t c)
+			{
+				if (indexSize == 2)
+				{
+					uint16_t* target = static_cast<uint16_t*>(destination) + offset;
+					target[0] = static_cast<uint16_t>(a);
+					target[1] = static_cast<uint16_t>(b);
+					target[2] = static_cast<uint16_t>(c);
+				}
+				else
+				{
+					uint32_t* target = static_cast<uint32_t*>(destination) + offset;
+					target[0] = a;
+					target[1] = b;
+					target[2] = c;
+				}
+			}
+
+			struct IndexFifos
+			{
+				uint32_t edges[16][2];
+				uint32_t vertices[16];
+				size_t edgeOffset = 0;
+				size_t vertexOffset = 0;
+
+				IndexFifos()
+				{
+					memset(edges, -1, sizeof(edges));
+					memset(vertices, -1, sizeof(vertices));
+				}
+
+				void pushEdge(uint32_t a, uint32_t b)
+				{
+					edges[edgeOffset][0] = a;
+					edges[edgeOffset][1] = b;
+					edgeOffset = (edgeOffset + 1) & 15;
+				}
+
+				void pushVertex(uint32_t v, bool condition = true)
+				{
+					vertices[vertexOffset] = v;
+					vertexOffset = (vertexOffset + (condition ? 1 : 0)) & 15;
+				}
+			};
+
+			template<typename T>
+			void decodeOctahedral(T* data, size_t count)
+			{
+				const float maximum = static_cast<float>((1 << (sizeof(T) * 8 - 1)) - 1);
+				for (size_t i = 0; i < count; i++)
+				{
+					// z is stored as the value that encodes 1.0 at the same bit count
+					float x = static_cast<float>(data[i * 4 + 0]);
+					float y = static_cast<float>(data[i * 4 + 1]);
+					float z = static_cast<float>(data[i * 4 + 2]) - std::fabs(x) - std::fabs(y);
+					// Fold back the lower hemisphere
+					float t = (z < 0.0f) ? z : 0.0f;
+					x += (x >= 0.0f) ? t : -t;
+					y += (y >= 0.0f) ? t : -t;
+					float length = std::sqrt(x * x + y * y + z * z);
+					float scale = maximum / length;
+					data[i * 4 + 0] = static_cast<T>(static_cast<int>(x * scale + (x >= 0.0f ? 0.5f : -0.5f)));
+					data[i * 4 + 1] = static_cast<T>(static_cast<int>(y * scale + (y >= 0.0f ? 0.5f : -0.5f)));
+					data[i * 4 + 2] = static_cast<T>(static_cast<int>(z * scale + (z >= 0.0f ? 0.5f : -0.5f)));
+				}
+			}
+		}
+
+		/**
+		* Decode an attribute stream, the stream is split into blocks of up to 256 vertices and within a block every byte
+		* of the vertex is delta and bit packed on its own, the first vertex is stored uncompressed in the tail
+		*
+		* @param destination count * size bytes
+		* @param count Number of vertices
+		* @param size Vertex size in bytes
+		* @param buffer Encoded stream
+		* @param bufferSize Size of the encoded stream in bytes
+		*/
+		bool decodeVertexBuffer(void* destination, size_t count, size_t size, const unsigned char* buffer, size_t bufferSize)
+		{
+			if ((size == 0) || (size > 256) || (size % 4 != 0) || (bufferSize < 1 + size))
+			{
+				return false;
+			}
+			const unsigned char* data = buffer;
+			const unsigned char* dataEnd = buffer + bufferSize;
+			unsigned char header = *data++;
+			// Only version 0 is allowed by the extension
+			if (header != vertexHeader)
+			{
+				return false;
+			}
+			unsigned char lastVertex[256];
+			memcpy(lastVertex, dataEnd - size, size);
+			unsigned char* vertexData = static_cast<unsigned char*>(destination);
+			size_t blockSize = vertexBlockSize(size);
+			for (size_t offset = 0; offset < count; offset += blockSize)
+			{
+				size_t vertexCount = std::min(blockSize, count - offset);
+				data = decodeVertexBlock(data, dataEnd, vertexData + offset * size, vertexCount, size, lastVertex);
+				if (!data)
+				{
+					return false;
+				}
+			}
+			size_t tailSize = std::max(size, tailMaxSize);
+			return static_cast<size_t>(dataEnd - data) == tailSize;
+		}
+
+		/**
+		* Decode a triangle list, every triangle is a code byte that refers to recently used edges and vertices (16 entry
+		* FIFOs) or to new vertices, indices that are neither are stored as zigzag varint deltas
+		*
+		* @param destination count indices of size bytes
+		* @param count Number of indices
+		* @param size Index size in bytes
+		* @param buffer Encoded stream
+		* @param bufferSize Size of the encoded stream in bytes
+		*/
+		bool decodeIndexBuffer(void* destination, size_t count, size_t size, const unsigned char* buffer, size_t bufferSize)
+		{
+			// Header, one code byte per triangle and the 16 byte code table
+			if ((count % 3 != 0) || ((size != 2) && (size != 4)) || (bufferSize < 1 + count / 3 + 16))
+			{
+				return false;
+			}
+			if ((buffer[0] & 0xf0) != indexHeader)
+			{
+				return false;
+			}
+			int version = buffer[0] & 0x0f;
+			if (version > 1)
+			{
+				return false;
+			}
+
+			IndexFifos fifos;
+			uint32_t next = 0;
+			uint32_t last = 0;
+			// Version 1 uses the codes 13 and 14 for the last free index -1/+1 instead of vertex FIFO entries
+			int fecMax = (version >= 1) ? 13 : 15;
+
+			const unsigned char* code = buffer + 1;
+			const unsigned char* data = code + count / 3;
+			const unsigned char* dataSafeEnd = buffer + bufferSize - 16;
+			const unsigned char* codeAuxTable = dataSafeEnd;
+
+			for (size_t i = 0; i < count; i += 3)
+			{
+				// A triangle reads at most 16 bytes (one code byte and three 5 byte varints), the code table follows the data
+				if (data > dataSafeEnd)
+				{
+					return false;
+				}
+				unsigned char codeTri = *code++;
+				if (codeTri < 0xf0)
+				{
+					// Edge from the FIFO and a third vertex
+					int fe = codeTri >> 4;
+					uint32_t a = fifos.edges[(fifos.edgeOffset - 1 - fe) & 15][0];
+					uint32_t b = fifos.edges[(fifos.edgeOffset - 1 - fe) & 15][1];
+					int fec = codeTri & 15;
+					if (fec < fecMax)
+					{
+						bool isNew = (fec == 0);
+						uint32_t c = isNew ? next : fifos.vertices[(fifos.vertexOffset - 1 - fec) & 15];
+						next += isNew ? 1 : 0;
+						writeTriangle(destination, i, size, a, b, c);
+						fifos.pushVertex(c, isNew);
+						fifos.pushEdge(c, b);
+						fifos.pushEdge(a, c);
+					}
+					else
+					{
+						// 13 and 14 decode to last - 1 and last + 1
+						uint32_t c = (fec != 15) ? last + static_cast<uint32_t>(fec - (fec ^ 3)) : decodeIndex(data, last);
+						last = c;
+						writeTriangle(destination, i, size, a, b, c);
+						fifos.pushVertex(c);
+						fifos.pushEdge(c, b);
+						fifos.pushEdge(a, c);
+					}
+				}
+				else if (codeTri < 0xfe)
+				{
+					// Three vertices, the FIFO indices of the second and third come from the code table
+					unsigned char codeAux = codeAuxTable[codeTri & 15];
+					int feb = codeAux >> 4;
+					int fec = codeAux & 15;
+					// next is advanced for the first vertex before the others are decoded, like the encoder does
+					uint32_t a = next++;
+					bool newB = (feb == 0);
+					uint32_t b = newB ? next : fifos.vertices[(fifos.vertexOffset - feb) & 15];
+					next += newB ? 1 : 0;
+					bool newC = (fec == 0);
+					uint32_t c = newC ? next : fifos.vertices[(fifos.vertexOffset - fec) & 15];
+					next += newC ? 1 : 0;
+					writeTriangle(destination, i, size, a, b, c);
+					fifos.pushVertex(a);
+					fifos.pushVertex(b, newB);
+					fifos.pushVertex(c, newC);
+					fifos.pushEdge(b, a);
+					fifos.pushEdge(c, b);
+					fifos.pushEdge(a, c);
+				}
+				else
+				{
+					// Three vertices with a full code byte, 0xff marks the first vertex as a free index
+					unsigned char codeAux = *data++;
+					int fea = (codeTri == 0xfe) ? 0 : 15;
+					int feb = codeAux >> 4;
+					int fec = codeAux & 15;
+					if (codeAux == 0)
+					{
+						next = 0;
+					}
+					uint32_t a = (fea == 0) ? next++ : 0;
+					uint32_t b = (feb == 0) ? next++ : fifos.vertices[(fifos.vertexOffset - feb) & 15];
+					uint32_t c = (fec == 0) ? next++ : fifos.vertices[(fifos.vertexOffset - fec) & 15];
+					if (fea == 15)
+					{
+						last = a = decodeIndex(data, last);
+					}
+					if (feb == 15)
+					{
+						last = b = decodeIndex(data, last);
+					}
+					if (fec == 15)
+					{
+						last = c = decodeIndex(data, last);
+					}
+					writeTriangle(destination, i, size, a, b, c);
+					fifos.pushVertex(a);
+					fifos.pushVertex(b, (feb == 0) || (feb == 15));
+					fifos.pushVertex(c, (fec == 0) || (fec == 15));
+					fifos.pushEdge(b, a);
+					fifos.pushEdge(c, b);
+					fifos.pushEdge(a, c);
+				}
+			}//for
+			// All data must be consumed up to the code table
+			return data == dataSafeEnd;
+		}
+
+		/**
+		* Decode an index sequence, every index is a zigzag varint delta to one of two baselines, the lowest bit selects the baseline
+		*
+		* @param destination count indices of size bytes
+		* @param count Number of indices
+		* @param size Index size in bytes
+		* @param buffer Encoded stream
+		* @param bufferSize Size of the encoded stream in bytes
+		*/
+		bool decodeIndexSequence(void* destination, size_t count, size_t size, const unsigned char* buffer, size_t bufferSize)
+		{
+			// Header, at least one byte per index and a 4 byte tail
+			if (((size != 2) && (size != 4)) || (bufferSize < 1 + count + 4))
+			{
+				return false;
+			}
+			if ((buffer[0] & 0xf0) != sequenceHeader)
+			{
+				return false;
+			}
+			int version = buffer[0] & 0x0f;
+			if (version > 1)
+			{
+				return false;
+			}
+			const unsigned char* data = buffer + 1;
+			const unsigned char* dataSafeEnd = buffer + bufferSize - 4;
+			uint32_t last[2] = { 0, 0 };
+			for (size_t i = 0; i < count; i++)
+			{
+				// An index reads at most 5 bytes, the tail keeps the last read in bounds
+				if (data >= dataSafeEnd)
+				{
+					return false;
+				}
+				uint32_t value = decodeVByte(data);
+				uint32_t baseline = value & 1;
+				value >>= 1;
+				uint32_t delta = (value >> 1) ^ (0u - (value & 1));
+				uint32_t index = last[baseline] + delta;
+				last[baseline] = index;
+				if (size == 2)
+				{
+					static_cast<uint16_t*>(destination)[i] = static_cast<uint16_t>(index);
+				}
+				else
+				{
+					static_cast<uint32_t*>(destination)[i] = index;
+				}
+			}
+			return data == dataSafeEnd;
+		}
+
+		void decodeFilterOctahedral(void* data, size_t count, size_t size)
+		{
+			if (size == 4)
+			{
+				decodeOctahedral(static_cast<int8_t*>(data), count);
+			}
+			else
+			{
+				decodeOctahedral(static_cast<int16_t*>(data), count);
+			}
+		}
+
+		void decodeFilterQuaternion(void* data, size_t count, size_t size)
+		{
+			int16_t* values = static_cast<int16_t*>(data);
+			const float scale = 1.0f / std::sqrt(2.0f);
+			for (size_t i = 0; i < count; i++)
+			{
+				int16_t* q = values + i * 4;
+				// The fourth component stores the scale in its upper bits and the index of the omitted component in the lowest two
+				int scaleBits = q[3] | 3;
+				float componentScale = scale / static_cast<float>(scaleBits);
+				float x = q[0] * componentScale;
+				float y = q[1] * componentScale;
+				float z = q[2] * componentScale;
+				// Clamped to avoid NaNs from rounding
+				float ww = 1.0f - x * x - y * y - z * z;
+				float w = std::sqrt(ww >= 0.0f ? ww : 0.0f);
+				int xf = static_cast<int>(x * 32767.0f + (x >= 0.0f ? 0.5f : -0.5f));
+				int yf = static_cast<int>(y * 32767.0f + (y >= 0.0f ? 0.5f : -0.5f));
+				int zf = static_cast<int>(z * 32767.0f + (z >= 0.0f ? 0.5f : -0.5f));
+				int wf = static_cast<int>(w * 32767.0f + 0.5f);
+				int largest = q[3] & 3;
+				q[(largest + 1) & 3] = static_cast<int16_t>(xf);
+				q[(largest + 2) & 3] = static_cast<int16_t>(yf);
+				q[(largest + 3) & 3] = static_cast<int16_t>(zf);
+				q[(largest + 0) & 3] = static_cast<int16_t>(wf);
+			}
+		}
+
+		void decodeFilterExponential(void* data, size_t count, size_t size)
+		{
+			uint32_t* values = static_cast<uint32_t*>(data);
+			size_t valueCount = count * (size / 4);
+			for (size_t i = 0; i < valueCount; i++)
+			{
+				uint32_t value = values[i];
+				// Sign extended 24 bit mantissa and 8 bit exponent
+				int32_t mantissa = static_cast<int32_t>(value << 8) >> 8;
+				int32_t exponent = static_cast<int32_t>(value) >> 24;
+				float result = std::ldexp(static_cast<float>(mantissa), exponent);
+				memcpy(&values[i], &result, sizeof(result));
+			}
+		}
+	}//meshopt
+
+	namespace
+	{
+		struct CompressedView
+		{
+			int view;
+			int sourceBuffer;
+			size_t sourceOffset;
+			const unsigned char* source;
+			size_t sourceSize;
+			size_t count;
+			size_t stride;
+			std::string mode;
+			std::string filter;
+			int targetBuffer;
+		};
+
+		size_t numberProperty(const tinygltf::Value& object, const char* name, size_t fallback)
+		{
+			if (object.Has(name) && object.Get(name).IsNumber())
+			{
+				return static_cast<size_t>(object.Get(name).GetNumberAsDouble());
+			}
+			return fallback;
+		}
+
+		std::string stringProperty(const tinygltf::Value& object, const char* name, const std::string& fallback)
+		{
+			if (object.Has(name) && object.Get(name).IsString())
+			{
+				return object.Get(name).Get<std::string>();
+			}
+			return fallback;
+		}
+
+		bool decodeView(const CompressedView& compressed, unsigned char* destination)
+		{
+			bool decoded = false;
+			if (compressed.mode == "ATTRIBUTES")
+			{
+				decoded = meshopt::decodeVertexBuffer(destination, compressed.count, compressed.stride, compressed.source, compressed.sourceSize);
+			}
+			else if (compressed.mode == "TRIANGLES")
+			{
+				decoded = meshopt::decodeIndexBuffer(destination, compressed.count, compressed.stride, compressed.source, compressed.sourceSize);
+			}
+			else if (compressed.mode == "INDICES")
+			{
+				decoded = meshopt::decodeIndexSequence(destination, compressed.count, compressed.stride, compressed.source, compressed.sourceSize);
+			}
+			if (!decoded)
+			{
+				return false;
+			}
+			if (compressed.filter == "OCTAHEDRAL")
+			{
+				meshopt::decodeFilterOctahedral(destination, compressed.count, compressed.stride);
+			}
+			else if (compressed.filter == "QUATERNION")
+			{
+				meshopt::decodeFilterQuaternion(destination, compressed.count, compressed.stride);
+			}
+			else if (compressed.filter == "EXPONENTIAL")
+			{
+				meshopt::decodeFilterExponential(destination, compressed.count, compressed.stride);
+			}
+			return true;
+		}
+	}
+
+	/**
+	* Decode EXT_meshopt_compression buffer views, each decoded view gets its own buffer so the views can be decoded
+	* in parallel without sharing a destination, the (usually empty) fallback buffers are left untouched
+	*
+	* @param model Model whose buffer views are decoded in place
+	* @param statistics Receives the number of views, their compressed and decoded sizes and the decode time
+	* @param error Receives the reason if decoding failed
+	*
+	* @return True if all compressed views were decoded
+	*/
+	bool decodeMeshoptCompression(tinygltf::Model& model, DecodeStatistics& statistics, std::string& error)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		std::vector<CompressedView> views;
+		for (size_t i = 0; i < model.bufferViews.size(); i++)
+		{
+			const tinygltf::BufferView& view = model.bufferViews[i];
+			auto extension = view.extensions.find("EXT_meshopt_compression");
+			if (extension == view.extensions.end())
+			{
+				continue;
+			}
+			const tinygltf::Value& object = extension->second;
+			CompressedView compressed;
+			compressed.view = static_cast<int>(i);
+			int buffer = static_cast<int>(numberProperty(object, "buffer", model.buffers.size()));
+			compressed.sourceBuffer = buffer;
+			compressed.sourceOffset = numberProperty(object, "byteOffset", 0);
+			compressed.sourceSize = numberProperty(object, "byteLength", 0);
+			compressed.count = numberProperty(object, "count", 0);
+			compressed.stride = numberProperty(object, "byteStride", 0);
+			compressed.mode = stringProperty(object, "mode", "");
+			compressed.filter = stringProperty(object, "filter", "NONE");
+			if ((buffer < 0) || (buffer >= static_cast<int>(model.buffers.size())) || (model.buffers[buffer].data.size() < compressed.sourceOffset + compressed.sourceSize) || (compressed.stride == 0))
+			{
+				error = "Invalid EXT_meshopt_compression buffer view " + std::to_string(i);
+				return false;
+			}
+			views.push_back(compressed);
+		}
+		if (views.empty())
+		{
+			return true;
+		}
+
+		// Allocate all targets up front, model.buffers must not reallocate while views are decoded
+		size_t firstTarget = model.buffers.size();
+		model.buffers.reserve(firstTarget + views.size());
+		for (auto& compressed : views)
+		{
+			compressed.targetBuffer = static_cast<int>(model.buffers.size());
+			tinygltf::Buffer target;
+			target.name = "EXT_meshopt_compression view " + std::to_string(compressed.view);
+			target.data.resize(compressed.count * compressed.stride);
+			model.buffers.push_back(std::move(target));
+			statistics.compressedBytes += compressed.sourceSize;
+			statistics.decodedBytes += compressed.count * compressed.stride;
+		}
+
+		for (auto& compressed : views)
+		{
+			compressed.source = model.buffers[compressed.sourceBuffer].data.data() + compressed.sourceOffset;
+		}
+
+		std::atomic<int> failedView(-1);
+		vks::parallel::forEachIndex(0, views.size(), [&](size_t i)
+		{
+			const CompressedView& compressed = views[i];
+			if (!decodeView(compressed, model.buffers[firstTarget + i].data.data()))
+			{
+				failedView = compressed.view;
+			}
+		}, 1);//forEachIndex
+		if (failedView >= 0)
+		{
+			error = "Could not decode EXT_meshopt_compression buffer view " + std::to_string(failedView.load());
+			return false;
+		}
+
+		for (const auto& compressed : views)
+		{
+			tinygltf::BufferView& view = model.bufferViews[compressed.view];
+			view.buffer = compressed.targetBuffer;
+			view.byteOffset = 0;
+			view.byteLength = compressed.count * compressed.stride;
+			if (compressed.mode == "ATTRIBUTES")
+			{
+				view.byteStride = compressed.stride;
+			}
+			view.extensions.erase("EXT_meshopt_compression");
+		}
+		statistics.compressedViews += static_cast<uint32_t>(views.size());
+		statistics.decodeMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		return true;
+	}
+}//vkglTF
@@ -0,0 +1,79 @@
+/*
+* glTF attribute decoding
+*
+* Accessor reads for all component types allowed by KHR_mesh_quantization (normalized and unnormalized integers,
+* interleaved with a byte stride) and an EXT_meshopt_compression decoder for vertex, triangle index and index
+* sequence streams including the octahedral, quaternion and exponential filters
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "VulkanglTFModel.h"
+
+namespace vkglTF
+{
+	/** @brief Reads accessor elements as floats, integer components are normalized if the accessor is normalized */
+	class AccessorReader
+	{
+	public:
+		AccessorReader() = default;
+		AccessorReader(const tinygltf::Model& model, int accessorIndex);
+
+		/** @brief False for a missing accessor or one without buffer view, reads return the fallback then */
+		bool valid() const { return data != nullptr; }
+		size_t count() const { return elementCount; }
+		uint32_t components() const { return componentCount; }
+		/** @brief Size of the stored element in bytes, without the padding of an interleaved stride */
+		size_t elementSize() const;
+
+		/** @brief Components the accessor does not have are taken from the fallback */
+		glm::vec4 read(size_t element, const glm::vec4& fallback = glm::vec4(0.0f)) const;
+
+	private:
+		const unsigned char* data = nullptr;
+		size_t stride = 0;
+		size_t elementCount = 0;
+		uint32_t componentCount = 0;
+		int componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
+		bool normalized = false;
+
+		float component(const unsigned char* element, uint32_t index) const;
+	};
+
+	namespace meshopt
+	{
+		/** @brief Decodes count vertices of size bytes (a multiple of 4, at most 256), returns false for a malformed stream */
+		bool decodeVertexBuffer(void* destination, size_t count, size_t size, const unsigned char* buffer, size_t bufferSize);
+		/** @brief Decodes count (a multiple of 3) triangle indices of size 2 or 4 bytes */
+		bool decodeIndexBuffer(void* destination, size_t count, size_t size, const unsigned char* buffer, size_t bufferSize);
+		/** @brief Decodes count indices of size 2 or 4 bytes that do not form triangles */
+		bool decodeIndexSequence(void* destination, size_t count, size_t size, const unsigned char* buffer, size_t bufferSize);
+
+		/** @brief Reconstructs unit vectors from octahedral encoding, size is 4 (8 bit components) or 8 (16 bit components) */
+		void decodeFilterOctahedral(void* data, size_t count, size_t size);
+		/** @brief Reconstructs 16 bit quaternions from three components and the index of the largest one, size is 8 */
+		void decodeFilterQuaternion(void* data, size_t count, size_t size);
+		/** @brief Converts 24 bit mantissa and 8 bit exponent pairs to floats, size is a multiple of 4 */
+		void decodeFilterExponential(void* data, size_t count, size_t size);
+	}//meshopt
+
+	struct DecodeStatistics
+	{
+		uint32_t compressedViews = 0;
+		uint64_t compressedBytes = 0;
+		uint64_t decodedBytes = 0;
+		double decodeMs = 0.0;
+	};
+
+	/**
+	* @brief Decodes all EXT_meshopt_compression buffer views in parallel into new buffers and points the views at them
+	* @return False with an error message if a stream is malformed or uses an unknown mode or filter
+	*/
+	bool decodeMeshoptCompression(tinygltf::Model& model, DecodeStatistics& statistics, std::string& error);
+}//vkglTF
@@ -18,18 +18,162 @@
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 
 #include "VulkanglTFModel.h"
+#include "VulkanglTFDecoder.h"
+#include "VulkanKtx2.h"
+#include "ParallelAlgorithms.hpp"
+#include "VulkanGpuTimer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iomanip>
+#include <random>
 
 VkDescriptorSetLayout vkglTF::descriptorSetLayoutImage = VK_NULL_HANDLE;
 VkDescriptorSetLayout vkglTF::descriptorSetLayoutUbo = VK_NULL_HANDLE;
 VkMemoryPropertyFlags vkglTF::memoryPropertyFlags = 0;
 uint32_t vkglTF::descriptorBindingFlags = vkglTF::DescriptorBindingFlags::ImageBaseColor;
 
+namespace
+{
+	// Nodes per chunk when computing the scene bounds, a node transforms the bounds of all its primitives so it is worth more than a vertex
+	const size_t nodeDimensionsGrain = 64;
+	// Primitives up to this many indices are merged by material with FileLoadingFlags::MergeStaticPrimitives
+	const uint32_t smallPrimitiveIndices = 3 * 1024;
+	// Upper bound for the index count of a merged draw, keeps merged draws cullable
+	const uint32_t mergedPrimitiveIndices = 3 * 64 * 1024;
+	// Level offsets in the KTX2 upload data, a multiple of every block size and of 4 as required for buffer to image copies
+	const VkDeviceSize ktx2LevelAlignment = 16;
+
+	/*
+		Image a texture samples from, KHR_texture_basisu textures use the KTX2 source if it can be transcoded or if there is no fallback
+	*/
+	int textureSource(const tinygltf::Texture& texture)
+	{
+		auto extension = texture.extensions.find("KHR_texture_basisu");
+		if ((extension != texture.extensions.end()) && extension->second.Has("source"))
+		{
+			int basisSource = extension->second.Get("source").Get<int>();
+			if (vks::ktx2::hasTranscoder() || (texture.source < 0))
+			{
+				return basisSource;
+			}
+		}
+		return texture.source;
+	}
+
+	/*
+		One entry of the material buffer used with vertex pulling, matches Material in shaders/glsl/base/vertexpulling.glsl
+	*/
+	struct PulledMaterial
+	{
+		glm::vec4 baseColorFactor;
+		float metallicFactor;
+		float roughnessFactor;
+		float alphaCutoff;
+		uint32_t alphaMode;
+	};
+
+	// Four attribute offsets in bytes packed as float offsets of 8 bits each
+	uint32_t packAttributeOffsets(size_t first, size_t second, size_t third, size_t fourth)
+	{
+		const size_t offsets[4] = { first, second, third, fourth };
+		uint32_t packed = 0;
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			assert((offsets[i] % sizeof(float) == 0) && (offsets[i] / sizeof(float) < 256));
+			packed |= static_cast<uint32_t>(offsets[i] / sizeof(float)) << (i * 8);
+		}
+		return packed;
+	}
+
+	// Alpha mode filter of the render flags, as applied by drawNode
+	bool skipMaterial(const vkglTF::Material& material, uint32_t renderFlags)
+	{
+		if ((renderFlags & vkglTF::RenderFlags::RenderOpaqueNodes) && (material.alphaMode != vkglTF::Material::ALPHA_MODE_OPAQUE))
+		{
+			return true;
+		}
+		if ((renderFlags & vkglTF::RenderFlags::RenderAlphaMaskedNodes) && (material.alphaMode != vkglTF::Material::ALPHA_MODE_MASK))
+		{
+			return true;
+		}
+		return (renderFlags & vkglTF::RenderFlags::RenderAlphaBlendedNodes) && (material.alphaMode != vkglTF::Material::ALPHA_MODE_BLEND);
+	}
+
+	/*
+		World matrices of all nodes in one scan in slot order, a parent in an earlier slot is already done. Only a parent in a later
+		slot (its slot was reused after a removal) is resolved by walking its chain
+	*/
+	void updateWorldMatrices(vkglTF::Registry<vkglTF::Node>& nodes)
+	{
+		for (uint32_t slot = 0; slot < nodes.slotCount(); slot++)
+		{
+			if (!nodes.slotOccupied(slot))
+			{
+				continue;
+			}
+			vkglTF::Node& node = nodes.slot(slot);
+			node.worldMatrix = node.localMatrix();
+			const vkglTF::Node* parent = nodes.get(node.parent);
+			if (parent && (node.parent.index < slot))
+			{
+				node.worldMatrix = parent->worldMatrix * node.worldMatrix;
+			}
+			else
+			{
+				while (parent)
+				{
+					node.worldMatrix = parent->localMatrix() * node.worldMatrix;
+					parent = nodes.get(parent->parent);
+				}//while
+			}
+		}//for
+	}
+
+	/*
+		Write the world matrix of a node and the joint matrices of its skin to the uniform block of its mesh
+	*/
+	void writeNodeUniforms(const vkglTF::Node& node, vkglTF::Mesh& mesh, const vkglTF::Skin* skin, const vkglTF::Registry<vkglTF::Node>& nodes,
+		vks::MappedRangeTracker* dirtyRanges)
+	{
+		if (skin)
+		{
+			mesh.uniformBlock.matrix = node.worldMatrix;
+			// Update join matrices
+			glm::mat4 inverseTransform = glm::inverse(node.worldMatrix);
+			for (size_t i = 0; i < skin->joints.size(); ++i)
+			{
+				const vkglTF::Node* jointNode = nodes.get(skin->joints[i]);
+				glm::mat4 jointMat = jointNode ? jointNode->worldMatrix * skin->inverseBindMatrices[i] : node.worldMatrix;
+				mesh.uniformBlock.jointMatrix[i] = inverseTransform * jointMat;
+			}
+
+			mesh.uniformBlock.jointCount = (float)skin->joints.size();
+			memcpy(mesh.uniformBuffer.mapped, &mesh.uniformBlock, sizeof(mesh.uniformBlock));
+			mesh.flushUniformBlock(sizeof(mesh.uniformBlock), dirtyRanges);
+		}
+		else
+		{
+			memcpy(mesh.uniformBuffer.mapped, &node.worldMatrix, sizeof(glm::mat4));
+			mesh.flushUniformBlock(sizeof(glm::mat4), dirtyRanges);
+		}//if_else skin
+	}
+}
+
 /*
 	We use a custom image loading function with tinyglTF, so we can do custom stuff loading ktx textures
 */
 bool loadImageDataFunc(tinygltf::Image* image,const int imageIndex,std::string* error,std::string* warning,
 	int req_width,int req_height,const unsigned char* bytes,int size,void* userData)
 {
+	// KTX2 containers are kept as is and parsed when the texture is created
+	if (vks::ktx2::isKtx2(bytes, static_cast<size_t>(size)))
+	{
+		image->image.assign(bytes, bytes + size);
+		return true;
+	}
 	// KTX files will be handled by our own code
 	if (image->uri.find_last_of(".") != std::string::npos)
     {
@@ -84,9 +228,81 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image& gltfImage, std::string path
 		}
 	}
 
+	bool isKtx2 = vks::ktx2::isKtx2(gltfImage.image.data(), gltfImage.image.size());
+
 	VkFormat format;
 
-	if (!isKtx)
+	if (isKtx2)
+	{
+		// Texture is a KTX2 container, levels are copied or transcoded in parallel
+		vks::ktx2::File ktx2File;
+		std::vector<std::vector<uint8_t>> levels;
+		std::string error;
+		if (!ktx2File.parse(gltfImage.image.data(), gltfImage.image.size(), error) || !vks::ktx2::loadLevels(ktx2File, device->physicalDevice, levels, format, error))
+		{
+			vks::tools::exitFatal("Could not load KTX2 texture \"" + gltfImage.uri + "\": " + error, -1);
+			return;
+		}
+		width = ktx2File.width;
+		height = ktx2File.height;
+		mipLevels = static_cast<uint32_t>(levels.size());
+
+		std::vector<VkBufferImageCopy> bufferCopyRegions(mipLevels);
+		VkDeviceSize uploadSize = 0;
+		for (uint32_t i = 0; i < mipLevels; i++)
+		{
+			uploadSize = (uploadSize + ktx2LevelAlignment - 1) & ~(ktx2LevelAlignment - 1);
+			VkBufferImageCopy& bufferCopyRegion = bufferCopyRegions[i];
+			bufferCopyRegion = {};
+			bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			bufferCopyRegion.imageSubresource.mipLevel = i;
+			bufferCopyRegion.imageSubresource.layerCount = 1;
+			bufferCopyRegion.imageExtent.width = ktx2File.levelWidth(i);
+			bufferCopyRegion.imageExtent.height = ktx2File.levelHeight(i);
+			bufferCopyRegion.imageExtent.depth = 1;
+			bufferCopyRegion.bufferOffset = uploadSize;
+			uploadSize += levels[i].size();
+		}
+
+		std::vector<uint8_t> levelData(static_cast<size_t>(uploadSize));
+		for (uint32_t i = 0; i < mipLevels; i++)
+		{
+			memcpy(levelData.data() + bufferCopyRegions[i].bufferOffset, levels[i].data(), levels[i].size());
+		}
+
+		// Block compressed formats can't be blitted, all levels come from the file
+		VkImageCreateInfo imageCreateInfo = vks::initializers::GenImageCreateInfo();
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.format = format;
+		imageCreateInfo.mipLevels = mipLevels;
+		imageCreateInfo.arrayLayers = 1;
+		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageCreateInfo.extent = { width, height, 1 };
+		VkImageUsageFlags uploadUsage = device->GetUploadUsage(format, VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | uploadUsage;
+		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
+
+		VkMemoryRequirements memReqs;
+		VkMemoryAllocateInfo memAllocInfo = vks::initializers::GenMemoryAllocateInfo();
+		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+		memAllocInfo.allocationSize = memReqs.size;
+		memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
+		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+		memorySize = memReqs.size;
+
+		VkImageSubresourceRange subresourceRange = {};
+		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		subresourceRange.levelCount = mipLevels;
+		subresourceRange.layerCount = 1;
+
+		device->UploadImage(image, uploadUsage, subresourceRange, levelData.data(), uploadSize, bufferCopyRegions, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, copyQueue);
+		imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}// isKtx2
+	else if (!isKtx)
 	{
 		// Texture was loaded using STB_Image
 
@@ -178,6 +394,7 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image& gltfImage, std::string path
 		memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
 		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+		memorySize = memReqs.size;
 
 		VkCommandBuffer copyCmd = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 
@@ -350,34 +567,6 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image& gltfImage, std::string path
 		// @todo: Use ktxTexture_GetVkFormat(pKtxTexture)
 		format = VK_FORMAT_R8G8B8A8_UNORM;
 
-		// Get device properties for the requested texture format
-		VkFormatProperties formatProperties;
-		vkGetPhysicalDeviceFormatProperties(device->physicalDevice, format, &formatProperties);
-
-		VkCommandBuffer copyCmd = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
-
-		VkBufferCreateInfo bufferCreateInfo = vks::initializers::GenBufferCreateInfo();
-		bufferCreateInfo.size = ktxTextureSize;
-		//This buffer is used as a transfer source for the buffer copy
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-		VkMemoryAllocateInfo memAllocInfo = vks::initializers::GenMemoryAllocateInfo();
-		VkMemoryRequirements memReqs;
-		vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer,&memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-		uint8_t* data;
-		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0,(void**)&data));
-		memcpy(data, pKtxTextureData, ktxTextureSize);
-		vkUnmapMemory(device->logicalDevice, stagingMemory);
-
 		std::vector<VkBufferImageCopy> bufferCopyRegions;
 		for (uint32_t i = 0;i<mipLevels;++i)
 		{
@@ -396,7 +585,8 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image& gltfImage, std::string path
 			bufferCopyRegions.push_back(bufferCopyRegion);
 		}
 
-		// Create optimal tiled target image
+		// Create optimal tiled target image, written from the host if the device supports it and through a staging buffer otherwise
+		VkImageUsageFlags uploadUsage = device->GetUploadUsage(format, VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 		VkImageCreateInfo imageCreateInfo = vks::initializers::GenImageCreateInfo();
 		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
 		imageCreateInfo.format = format;
@@ -407,14 +597,17 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image& gltfImage, std::string path
 		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 		imageCreateInfo.extent = { width,height,1 };
-		imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | uploadUsage;
 		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
 
+		VkMemoryAllocateInfo memAllocInfo = vks::initializers::GenMemoryAllocateInfo();
+		VkMemoryRequirements memReqs;
 		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
 		memAllocInfo.allocationSize = memReqs.size;
 		memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
 		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+		memorySize = memReqs.size;
 
 		VkImageSubresourceRange subresourceRange = {};
 		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -422,16 +615,9 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image& gltfImage, std::string path
 		subresourceRange.levelCount = mipLevels;
 		subresourceRange.layerCount = 1;
 
-		vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
-		vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
-		vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
-
-		device->FlushCommandBuffer(copyCmd, copyQueue);
+		device->UploadImage(image, uploadUsage, subresourceRange, pKtxTextureData, ktxTextureSize, bufferCopyRegions, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, copyQueue);
 		this->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
-
 		ktxTexture_Destroy(pKtxTexture);
 	}//if_else isKtx
 
@@ -471,8 +657,12 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image& gltfImage, std::string path
 /*
 	glTF material
 */
-void vkglTF::Material::createDescriptorSet(VkDescriptorPool descriptorPool, VkDescriptorSetLayout descriptorSetLayout, uint32_t descriptorBindingFlags)
+void vkglTF::Material::createDescriptorSet(VkDescriptorPool descriptorPool, VkDescriptorSetLayout descriptorSetLayout, uint32_t descriptorBindingFlags,
+	const Registry<Texture>& textures)
 {
+	const Texture* baseColor = textures.get(baseColorTexture);
+	const Texture* normal = textures.get(normalTexture);
+
 	VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
 	descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	descriptorSetAllocInfo.descriptorPool = descriptorPool;
@@ -483,30 +673,30 @@ void vkglTF::Material::createDescriptorSet(VkDescriptorPool descriptorPool, VkDe
 	std::vector<VkDescriptorImageInfo> imageDescriptors{};
 	std::vector<VkWriteDescriptorSet> writeDescriptorSets{};
 
-	if (descriptorBindingFlags&DescriptorBindingFlags::ImageBaseColor)
+	if (baseColor && (descriptorBindingFlags & DescriptorBindingFlags::ImageBaseColor))
 	{
-		imageDescriptors.push_back(baseColorTexture->descriptorImageInfo);
+		imageDescriptors.push_back(baseColor->descriptorImageInfo);
 		VkWriteDescriptorSet writeDescriptorSet{};
 		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		writeDescriptorSet.descriptorCount = 1;
 		writeDescriptorSet.dstSet = descriptorSet;
 		writeDescriptorSet.dstBinding = static_cast<uint32_t>(writeDescriptorSets.size());//index
-		writeDescriptorSet.pImageInfo = &baseColorTexture->descriptorImageInfo;
+		writeDescriptorSet.pImageInfo = &baseColor->descriptorImageInfo;
 
 		writeDescriptorSets.push_back(writeDescriptorSet);
 	}
 
-	if (normalTexture && (descriptorBindingFlags & DescriptorBindingFlags::ImageNormalMap ))
+	if (normal && (descriptorBindingFlags & DescriptorBindingFlags::ImageNormalMap ))
 	{
-		imageDescriptors.push_back(normalTexture->descriptorImageInfo);
+		imageDescriptors.push_back(normal->descriptorImageInfo);
 		VkWriteDescriptorSet writeDescriptorSet{};
 		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		writeDescriptorSet.descriptorCount = 1;
 		writeDescriptorSet.dstSet = descriptorSet;
 		writeDescriptorSet.dstBinding = static_cast<uint32_t>(writeDescriptorSets.size());//index
-		writeDescriptorSet.pImageInfo = &normalTexture->descriptorImageInfo;
+		writeDescriptorSet.pImageInfo = &normal->descriptorImageInfo;
 
 		writeDescriptorSets.push_back(writeDescriptorSet);
 	}
@@ -529,91 +719,63 @@ void vkglTF::Primitive::setDimensions(glm::vec3 min, glm::vec3 max)
 /*
 	glTF mesh
 */
-vkglTF::Mesh::Mesh(vks::VulkanDevice * device, glm::mat4 matrix)
+void vkglTF::Mesh::create(vks::VulkanDevice * device, glm::mat4 matrix, VkBufferUsageFlags usageFlags)
 {
 	this->device = device;
 	this->uniformBlock.matrix = matrix;
-	VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		sizeof(this->uniformBlock), &this->uniformBuffer.buffer, &this->uniformBuffer.memory, &this->uniformBlock));
-
-	VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, uniformBuffer.memory, 0, sizeof(uniformBlock), 0, &uniformBuffer.mapped));
+	// Written by the host every animated frame, so it goes to write combined memory which may not be coherent
+	vks::Buffer buffer;
+	VK_CHECK_RESULT(device->CreateHostBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | usageFlags, vks::HostAccess::Upload, &buffer, sizeof(this->uniformBlock)));
+	uniformBuffer.buffer = buffer.buffer;
+	uniformBuffer.memory = buffer.deviceMemory;
+	uniformBuffer.mapped = buffer.mappedData;
+	uniformBuffer.size = buffer.size;
+	uniformBuffer.coherent = (buffer.memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
 	uniformBuffer.descriptorBufferInfo = { uniformBuffer.buffer,0,sizeof(uniformBlock) };
-}
-
-vkglTF::Mesh::~Mesh()
-{
-	vkDestroyBuffer(device->logicalDevice, uniformBuffer.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, uniformBuffer.memory, nullptr);
-    for(auto primitive : primitives)
-    {
-        delete primitive;
-    }
-}
-
-/*
-	glTF node
-*/
-glm::mat4 vkglTF::Node::localMatrix() {
-	return glm::translate(glm::mat4(1.0f), translation) * glm::mat4(rotation) * glm::scale(glm::mat4(1.0f), scale) * matrix;
-}
-
-glm::mat4 vkglTF::Node::getMatrix()
-{
-	glm::mat4 m = localMatrix();
-	vkglTF::Node *p = parent;
-	while (p)
+	if (usageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)
 	{
-		m = p->localMatrix()*m;
-		p = p->parent;
+		uniformBuffer.address = device->GetBufferDeviceAddress(uniformBuffer.buffer);
 	}
-	return m;
+	memcpy(uniformBuffer.mapped, &uniformBlock, sizeof(uniformBlock));
+	flushUniformBlock(sizeof(uniformBlock), nullptr);
 }
 
-void vkglTF::Node::update()
+void vkglTF::Mesh::flushUniformBlock(VkDeviceSize size, vks::MappedRangeTracker* dirtyRanges)
 {
-	if (mesh)
+	if (uniformBuffer.coherent)
 	{
-		glm::mat4 m = getMatrix();
-		if (skin)
-		{
-			mesh->uniformBlock.matrix = m;
-			// Update join matrices
-			glm::mat4 inverseTransform = glm::inverse(m);
-			for (size_t i = 0;i<skin->joints.size();++i)
-			{
-				vkglTF::Node *jointNode = skin->joints[i];
-				glm::mat4 jointMat = jointNode->getMatrix()*skin->inverseBindMatrices[i];
-				jointMat = inverseTransform * jointMat;
-				mesh->uniformBlock.jointMatrix[i] = jointMat;
-			}
-
-			mesh->uniformBlock.jointCount = (float)skin->joints.size();
-			memcpy(mesh->uniformBuffer.mapped, &mesh->uniformBlock, sizeof(mesh->uniformBlock));
-		}
-		else
-		{
-			memcpy(mesh->uniformBuffer.mapped, &m, sizeof(glm::mat4));
-		}//if_else skin
-	}//if mesh
-
-	for (auto& child:children)
+		return;
+	}
+	if (dirtyRanges)
+	{
+		dirtyRanges->add(uniformBuffer.memory, uniformBuffer.size, 0, size);
+	}
+	else
 	{
-		child->update();
+		// The whole mapping needs no atom alignment
+		VkMappedMemoryRange range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, uniformBuffer.memory, 0, VK_WHOLE_SIZE };
+		VK_CHECK_RESULT(vkFlushMappedMemoryRanges(device->logicalDevice, 1, &range));
 	}
 }
 
-vkglTF::Node::~Node()
+void vkglTF::Mesh::destroy()
 {
-	if (mesh)
+	if (device)
 	{
-		delete mesh;
+		vkDestroyBuffer(device->logicalDevice, uniformBuffer.buffer, nullptr);
+		vkFreeMemory(device->logicalDevice, uniformBuffer.memory, nullptr);
 	}
+	uniformBuffer.buffer = VK_NULL_HANDLE;
+	uniformBuffer.memory = VK_NULL_HANDLE;
+	uniformBuffer.mapped = nullptr;
+}
 
-	for (auto& child:children)
-	{
-		delete child;
-	}
+/*
+	glTF node
+*/
+glm::mat4 vkglTF::Node::localMatrix() const
+{
+	return glm::translate(glm::mat4(1.0f), translation) * glm::mat4(rotation) * glm::scale(glm::mat4(1.0f), scale) * matrix;
 }
 
 /*
@@ -685,24 +847,22 @@ VkPipelineVertexInputStateCreateInfo * vkglTF::Vertex::getPipelineVertexInputSta
 	return &pipelineVertexInputStateCreateInfo;
 }
 
-vkglTF::Texture * vkglTF::Model::getTexture(uint32_t index)
+vkglTF::TextureHandle vkglTF::Model::getTexture(uint32_t index)
 {
-	if (index <textures.size())
-	{
-		return &textures[index];
-	}
-	return nullptr;
+	TextureHandle handle = textures.handle(index);
+	return (handle != emptyTexture) ? handle : TextureHandle();
 }
 
 void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 {
-	emptyTexture.device = device;
-	emptyTexture.width = 1;
-	emptyTexture.height = 1;
-	emptyTexture.layerCount = 1;
-	emptyTexture.mipLevels = 1;
-
-	size_t bufferSize = emptyTexture.width * emptyTexture.height * 4;
+	Texture texture;
+	texture.device = device;
+	texture.width = 1;
+	texture.height = 1;
+	texture.layerCount = 1;
+	texture.mipLevels = 1;
+
+	size_t bufferSize = texture.width * texture.height * 4;
 	unsigned char* buffer = new unsigned char[bufferSize];
 	memset(buffer, 0, bufferSize);
 
@@ -732,8 +892,8 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 	VkBufferImageCopy bufferCopyRegion = {};
 	bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	bufferCopyRegion.imageSubresource.layerCount = 1;
-	bufferCopyRegion.imageExtent.width = emptyTexture.width;
-	bufferCopyRegion.imageExtent.height = emptyTexture.height;
+	bufferCopyRegion.imageExtent.width = texture.width;
+	bufferCopyRegion.imageExtent.height = texture.height;
 	bufferCopyRegion.imageExtent.depth = 1;
 
 	//Create optimal tiled target image
@@ -746,15 +906,15 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
 	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	imageCreateInfo.extent = { emptyTexture.width,emptyTexture.height,1 };
+	imageCreateInfo.extent = { texture.width,texture.height,1 };
 	imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-	VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &emptyTexture.image));
+	VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &texture.image));
 
-	vkGetImageMemoryRequirements(device->logicalDevice, emptyTexture.image, &memReqs);
+	vkGetImageMemoryRequirements(device->logicalDevice, texture.image, &memReqs);
 	memAllocInfo.allocationSize = memReqs.size;
 	memAllocInfo.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &emptyTexture.deviceMemory));
-	VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, emptyTexture.image, emptyTexture.deviceMemory, 0));
+	VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &texture.deviceMemory));
+	VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, texture.image, texture.deviceMemory, 0));
 
 	VkImageSubresourceRange subresourceRange{};
 	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -763,12 +923,12 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 	subresourceRange.layerCount = 1;
 
 	VkCommandBuffer copyCmd = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-	vks::tools::setImageLayout(copyCmd, emptyTexture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
-	vkCmdCopyBufferToImage(copyCmd, stagingBuffer, emptyTexture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
-	vks::tools::setImageLayout(copyCmd, emptyTexture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
+	vks::tools::setImageLayout(copyCmd, texture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+	vkCmdCopyBufferToImage(copyCmd, stagingBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
+	vks::tools::setImageLayout(copyCmd, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
 
 	device->FlushCommandBuffer(copyCmd, transferQueue);
-	emptyTexture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
 	//Clean up staging resources
 	vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
@@ -783,7 +943,7 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 	samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	samplerCreateInfo.compareOp = VK_COMPARE_OP_NEVER;
 	samplerCreateInfo.maxAnisotropy = 1.0f;
-	VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCreateInfo, nullptr, &emptyTexture.sampler));
+	VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCreateInfo, nullptr, &texture.sampler));
 
 	VkImageViewCreateInfo viewCreateInfo = vks::initializers::GenImageViewCreateInfo();
 	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
@@ -791,12 +951,13 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 	viewCreateInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
 	viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 	viewCreateInfo.subresourceRange.levelCount = 1;
-	viewCreateInfo.image = emptyTexture.image;
-	VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, nullptr, &emptyTexture.view));
+	viewCreateInfo.image = texture.image;
+	VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, nullptr, &texture.view));
 
-	emptyTexture.descriptorImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	emptyTexture.descriptorImageInfo.imageView = emptyTexture.view;
-	emptyTexture.descriptorImageInfo.sampler = emptyTexture.sampler;
+	texture.descriptorImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	texture.descriptorImageInfo.imageView = texture.view;
+	texture.descriptorImageInfo.sampler = texture.sampler;
+	textures[emptyTexture] = std::move(texture);
 }
 
 /*
@@ -804,26 +965,36 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 */
 vkglTF::Model::~Model()
 {
-	vkDestroyBuffer(device->logicalDevice, vertices.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, vertices.memory, nullptr);
-
-	vkDestroyBuffer(device->logicalDevice, indices.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, indices.memory, nullptr);
-
-	for (auto texture:textures)
+	if (!device)
 	{
-		texture.destroy();
+		// Never loaded
+		return;
 	}
-
-	for (auto node:nodes)
+	if (geometryPool)
 	{
-		delete node;
+		// The buffers belong to the pool, only the ranges are returned
+		geometryPool->free(geometry);
 	}
-
-	for (auto skin:skins)
+	else
 	{
-		delete skin;
+		vkDestroyBuffer(device->logicalDevice, vertices.buffer, nullptr);
+		vkFreeMemory(device->logicalDevice, vertices.memory, nullptr);
+
+		vkDestroyBuffer(device->logicalDevice, indices.buffer, nullptr);
+		vkFreeMemory(device->logicalDevice, indices.memory, nullptr);
 	}
+	materialBuffer.destroy();
+
+	// The empty texture is part of textures
+	textures.forEach([](TextureHandle, Texture& texture)
+	{
+		texture.destroy();
+	});
+
+	meshes.forEach([](MeshHandle, Mesh& mesh)
+	{
+		mesh.destroy();
+	});
 
 	if (descriptorSetLayoutUbo!=VK_NULL_HANDLE)
 	{
@@ -838,55 +1009,69 @@ vkglTF::Model::~Model()
 	}
 
 	vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
-	emptyTexture.destroy();
 }
 
-void vkglTF::Model::loadNode(vkglTF::Node * parent, const tinygltf::Node & node, uint32_t nodeIndex, const tinygltf::Model & model, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexArray, float globalScale)
+void vkglTF::Model::loadNode(NodeHandle parent, const tinygltf::Node & node, uint32_t nodeIndex, const tinygltf::Model & model, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexArray, float globalScale)
 {
-	vkglTF::Node *pNewNode = new vkglTF::Node{};
-	pNewNode->index = nodeIndex;
-	pNewNode->parent = parent;
-	pNewNode->name = node.name;
-	pNewNode->skinIndex = node.skin;
-	pNewNode->matrix = glm::mat4(1.0f);
+	vkglTF::Node newNode{};
+	newNode.index = nodeIndex;
+	newNode.parent = parent;
+	newNode.name = node.name;
+	newNode.skinIndex = node.skin;
+	newNode.matrix = glm::mat4(1.0f);
 
 	// Generate local node matrix
 	glm::vec3 translation = glm::vec3(0.0f);
 	if (node.translation.size() == 3)
 	{
 		translation = glm::make_vec3(node.translation.data());
-		pNewNode->translation = translation;
+		newNode.translation = translation;
 	}
 
 	glm::mat4 rotation = glm::mat4(1.0f);
 	if (node.rotation.size() == 4)
 	{
 		glm::quat q = glm::make_quat(node.rotation.data());
-		pNewNode->rotation = glm::mat4(q);
+		newNode.rotation = glm::mat4(q);
 	}
 
 	glm::vec3 scale = glm::vec3(1.0f);
 	if (node.scale.size() == 3)
 	{
 		scale = glm::make_vec3(node.scale.data());
-		pNewNode->scale = scale;
+		newNode.scale = scale;
 	}
 
 	if (node.matrix.size()==16)
 	{
-		pNewNode->matrix = glm::make_mat4x4(node.matrix.data());
+		newNode.matrix = glm::make_mat4x4(node.matrix.data());
 		if (globalScale!=1.0f)
 		{
-			//pNewNode->matrix = glm::scale(pNewNode->matrix, glm::vec3(globalScale));
+			//newNode.matrix = glm::scale(newNode.matrix, glm::vec3(globalScale));
 		}
 	}
 
+	// The node is added before its children, so a scan of the registry in slot order visits parents first
+	NodeHandle handle = nodes.add(std::move(newNode));
+	if (nodeIndex < nodeLookup.size())
+	{
+		nodeLookup[nodeIndex] = handle;
+	}
+	if (parent.valid())
+	{
+		nodes[parent].children.push_back(handle);
+	}
+	else
+	{
+		rootNodes.push_back(handle);
+	}
+
 	// Node with children
 	if (node.children.size()>0)
 	{
 		for (auto i=0;i<node.children.size();i++)
 		{
-			loadNode(pNewNode, model.nodes[node.children[i]], node.children[i], model, indexBuffer, vertexArray, globalScale);
+			loadNode(handle, model.nodes[node.children[i]], node.children[i], model, indexBuffer, vertexArray, globalScale);
 		}
 	}
 
@@ -894,8 +1079,10 @@ void vkglTF::Model::loadNode(vkglTF::Node * parent, const tinygltf::Node & node,
 	if (node.mesh > -1)
 	{
 		const tinygltf::Mesh mesh = model.meshes[node.mesh];
-		Mesh* pNewMesh = new Mesh(device, pNewNode->matrix);
-		pNewMesh->name = mesh.name;
+		// Adding the children may have moved the node
+		Mesh newMesh;
+		newMesh.create(device, nodes[handle].matrix, addresses.enabled ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : 0);
+		newMesh.name = mesh.name;
 		for (size_t j = 0;j<mesh.primitives.size();j++)
 		{
 			const tinygltf::Primitive &primitive = mesh.primitives[j];
@@ -914,102 +1101,60 @@ void vkglTF::Model::loadNode(vkglTF::Node * parent, const tinygltf::Node & node,
 
 			// Vertices
 			{
-				const float *bufferPos = nullptr;
-				const float *bufferNormals = nullptr;
-				const float *bufferTexCoords = nullptr;
-				const float *bufferColors = nullptr;
-				const float *bufferTangents = nullptr;
-				uint32_t numColorComponents;
-				const uint16_t * bufferJoints = nullptr;
-				const float *bufferWeights = nullptr;
+				// Attributes may be quantized (KHR_mesh_quantization) and interleaved, the readers convert them to the float vertex layout
+				auto attribute = [&](const char* name)
+				{
+					auto it = primitive.attributes.find(name);
+					return AccessorReader(model, (it != primitive.attributes.end()) ? it->second : -1);
+				};
 
 				// Position attribute is required
 				assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
 
-				const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
-				const tinygltf::BufferView &posView = model.bufferViews[posAccessor.bufferView];
-				bufferPos = reinterpret_cast<const float *>(&(model.buffers[posView.buffer].data[posAccessor.byteOffset + posView.byteOffset]));
-				posMin = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]);
-				posMax = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]);
-
-				if (primitive.attributes.find("NORMAL")!=primitive.attributes.end())
-				{
-					const tinygltf::Accessor &normAccessor = model.accessors[primitive.attributes.find("NORMAL")->second];
-					const tinygltf::BufferView &normView = model.bufferViews[normAccessor.bufferView];
-					bufferNormals = reinterpret_cast<const float*>(&(model.buffers[normView.buffer].data[normAccessor.byteOffset + normView.byteOffset]));
-				}
-
-				if (primitive.attributes.find("TEXCOORD_0")!= primitive.attributes.end())
-				{
-					const tinygltf::Accessor & uvAccessor = model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
-					const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-					bufferTexCoords = reinterpret_cast<const float*>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
-				}
-
-				if (primitive.attributes.find("COLOR_0") != primitive.attributes.end())
-				{
-					const tinygltf::Accessor& colorAccessor = model.accessors[primitive.attributes.find("COLOR_0")->second];
-					const tinygltf::BufferView& colorView = model.bufferViews[colorAccessor.bufferView];
-					// Color buffer are either of type vec3 or vec4
-					numColorComponents = colorAccessor.type == TINYGLTF_PARAMETER_TYPE_FLOAT_VEC3 ? 3 : 4;
-					bufferColors = reinterpret_cast<const float*>(&(model.buffers[colorView.buffer].data[colorAccessor.byteOffset + colorView.byteOffset]));
-				}
-
-				if (primitive.attributes.find("TANGENT") != primitive.attributes.end())
-				{
-					const tinygltf::Accessor &tangentAccessor = model.accessors[primitive.attributes.find("TANGENT")->second];
-					const tinygltf::BufferView& tangentView = model.bufferViews[tangentAccessor.bufferView];
-					bufferTangents = reinterpret_cast<const float*>(&(model.buffers[tangentView.buffer].data[tangentAccessor.byteOffset + tangentView.byteOffset]));
-				}
-
+				const AccessorReader positions = attribute("POSITION");
+				const AccessorReader normals = attribute("NORMAL");
+				const AccessorReader texCoords = attribute("TEXCOORD_0");
+				// Color buffer are either of type vec3 or vec4
+				const AccessorReader colors = attribute("COLOR_0");
+				const AccessorReader tangents = attribute("TANGENT");
 				// Skinning
-				// Joints
-				if (primitive.attributes.find("JOINTS_0") != primitive.attributes.end())
-				{
-					const tinygltf::Accessor & jointAccessor = model.accessors[primitive.attributes.find("JOINTS_0")->second];
-					const tinygltf::BufferView &jointView = model.bufferViews[jointAccessor.bufferView];
-					bufferJoints = reinterpret_cast<const uint16_t*>(&(model.buffers[jointView.buffer].data[jointAccessor.byteOffset + jointView.byteOffset]));
-				}
+				const AccessorReader joints = attribute("JOINTS_0");
+				const AccessorReader weights = attribute("WEIGHTS_0");
 
-				if (primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end())
-				{
-					const tinygltf::Accessor & uvAccessor = model.accessors[primitive.attributes.find("WEIGHTS_0")->second];
-					const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-					bufferWeights = reinterpret_cast<const float*>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
-				}
+				hasSkin = (joints.valid() && weights.valid());
 
-				hasSkin = (bufferJoints && bufferWeights);
+				vertexCount = static_cast<uint32_t>(positions.count());
+				posMin = glm::vec3(FLT_MAX);
+				posMax = glm::vec3(-FLT_MAX);
 
-				vertexCount = static_cast<uint32_t>(posAccessor.count);
-
-				for (size_t v=0;v<posAccessor.count;v++)
+				for (const AccessorReader* reader : { &positions, &normals, &texCoords, &colors, &tangents, &joints, &weights })
 				{
-					Vertex vert{};
-					vert.pos = glm::vec4(glm::make_vec3(&bufferPos[v * 3]), 1.0f);
-					vert.normal = glm::normalize(glm::vec3(bufferNormals ? glm::make_vec3(&bufferNormals[v * 3]) : glm::vec3(0.0f)));
-					vert.uv = bufferTexCoords ? glm::make_vec2(&bufferTexCoords[v * 2]) : glm::vec3(0.0f);
-					if (bufferColors)
+					if (reader->valid())
 					{
-						switch (numColorComponents)
-						{
-						case 3:
-							vert.color = glm::vec4(glm::make_vec3(&bufferColors[v * 3]), 1.0f);
-							break;
-						case 4:
-							vert.color = glm::make_vec4(&bufferColors[v * 4]);
-							break;
-						}//numColorComponents
-					}
-					else
-					{
-						vert.color = glm::vec4(1.0f);
+						loadStatistics.attributeBytes += reader->count() * reader->elementSize();
+						loadStatistics.floatAttributeBytes += reader->count() * reader->components() * sizeof(float);
 					}
+				}
 
-					vert.tangent = bufferTangents ? glm::vec4(glm::make_vec4(&bufferTangents[v * 4])) : glm::vec4(0.0f);
-					vert.joint0 = hasSkin ? glm::vec4(glm::make_vec4(&bufferJoints[v * 4])) : glm::vec4(0.0f);
-					vert.weight0 = hasSkin ? glm::make_vec4(&bufferWeights[v * 4]) : glm::vec4(0.0f);
+				for (size_t v=0;v<positions.count();v++)
+				{
+					Vertex vert{};
+					vert.pos = glm::vec3(positions.read(v));
+					// Bounds from the decoded positions, the accessor's min/max are in stored units for normalized attributes
+					posMin = glm::min(posMin, vert.pos);
+					posMax = glm::max(posMax, vert.pos);
+					vert.normal = glm::normalize(glm::vec3(normals.read(v)));
+					vert.uv = glm::vec2(texCoords.read(v));
+					vert.color = colors.read(v, glm::vec4(1.0f));
+					vert.tangent = tangents.read(v);
+					vert.joint0 = hasSkin ? joints.read(v) : glm::vec4(0.0f);
+					vert.weight0 = hasSkin ? weights.read(v) : glm::vec4(0.0f);
 					vertexArray.push_back(vert);
 				}//for
+				if (vertexCount == 0)
+				{
+					posMin = posMax = glm::vec3(0.0f);
+				}
 			}
 
 			{	//Indices
@@ -1063,45 +1208,37 @@ void vkglTF::Model::loadNode(vkglTF::Node * parent, const tinygltf::Node & node,
 			}//switch
 			}
 
-			Primitive *pNewPrimitive = new Primitive(indexStart, indexCount, primitive.material > -1 ? materials[primitive.material] : materials.back());
-			pNewPrimitive->firstVertex = vertexStart;
-			pNewPrimitive->vertexCount = vertexCount;
-			pNewPrimitive->setDimensions(posMin, posMax);
-			pNewMesh->primitives.push_back(pNewPrimitive);
+			Primitive newPrimitive(indexStart, indexCount, primitive.material > -1 ? materials.handle(primitive.material) : defaultMaterial);
+			newPrimitive.firstVertex = vertexStart;
+			newPrimitive.vertexCount = vertexCount;
+			newPrimitive.setDimensions(posMin, posMax);
+			newMesh.primitives.push_back(newPrimitive);
 		}//node.mesh
-		pNewNode->mesh = pNewMesh;
+		MeshHandle meshHandle = meshes.add(std::move(newMesh));
+		nodes[handle].mesh = meshHandle;
 	}
-	if (parent)
-	{
-		parent->children.push_back(pNewNode);
-	}
-	else
-	{
-		nodes.push_back(pNewNode);
-	}
-	linearNodes.push_back(pNewNode);
 }
 
 void vkglTF::Model::loadSkins(tinygltf::Model & gltfModel)
 {
 	for (tinygltf::Skin &source:gltfModel.skins)
 	{
-		Skin *pNewSkin = new Skin{};
-		pNewSkin->name = source.name;
+		Skin newSkin{};
+		newSkin.name = source.name;
 
 		//Find skeleton root node
 		if (source.skeleton > -1)
 		{
-			pNewSkin->skeletonRoot = nodeFromIndex(source.skeleton);
+			newSkin.skeletonRoot = nodeFromIndex(source.skeleton);
 		}
 
 		// Find joint nodes
 		for (int jointIndex:source.joints)
 		{
-			Node* pNode = nodeFromIndex(jointIndex);
-			if (pNode)
+			NodeHandle joint = nodeFromIndex(jointIndex);
+			if (nodes.contains(joint))
 			{
-				pNewSkin->joints.push_back(nodeFromIndex(jointIndex));
+				newSkin.joints.push_back(joint);
 			}
 		}
 
@@ -1111,25 +1248,74 @@ void vkglTF::Model::loadSkins(tinygltf::Model & gltfModel)
 			const tinygltf::Accessor &accessor = gltfModel.accessors[source.inverseBindMatrices];
 			const tinygltf::BufferView &bufferView = gltfModel.bufferViews[accessor.bufferView];
 			const tinygltf::Buffer &buffer = gltfModel.buffers[bufferView.buffer];
-			pNewSkin->inverseBindMatrices.resize(accessor.count);
-			memcpy(pNewSkin->inverseBindMatrices.data(), &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::mat4));
+			newSkin.inverseBindMatrices.resize(accessor.count);
+			memcpy(newSkin.inverseBindMatrices.data(), &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::mat4));
 		}
 
-		skins.push_back(pNewSkin);
+		skins.add(std::move(newSkin));
 	}
 }
 
-void vkglTF::Model::loadImages(tinygltf::Model & gltfModel, vks::VulkanDevice * device, VkQueue transferQueue)
+/**
+* Add a texture per image and the empty texture, so materials refer to them before anything is uploaded. The images are kept
+* in the pending upload and created one per upload step by uploadImage
+*
+* @param gltfModel Parsed file, its images are moved out
+*/
+void vkglTF::Model::prepareImages(tinygltf::Model & gltfModel)
 {
-	for (tinygltf::Image& image:gltfModel.images)
+	// KTX2 images of KHR_texture_basisu textures that fall back to another image are skipped if they can't be transcoded
+	std::vector<bool> skipImage(gltfModel.images.size(), false);
+	if (!vks::ktx2::hasTranscoder())
+	{
+		for (const tinygltf::Texture& gltfTexture : gltfModel.textures)
+		{
+			auto extension = gltfTexture.extensions.find("KHR_texture_basisu");
+			if ((extension != gltfTexture.extensions.end()) && extension->second.Has("source") && (gltfTexture.source >= 0))
+			{
+				int basisSource = extension->second.Get("source").Get<int>();
+				if ((basisSource >= 0) && (basisSource < static_cast<int>(skipImage.size())))
+				{
+					skipImage[basisSource] = true;
+				}
+			}
+		}
+	}
+	for (size_t i = 0; i < gltfModel.images.size(); i++)
 	{
 		vkglTF::Texture texture;
-		texture.fromglTfImage(image, path, device, transferQueue);
 		texture.index = static_cast<uint32_t>(textures.size());
-		textures.push_back(texture);
+		textures.add(std::move(texture));
+	}
+	loadStatistics.textureCount = static_cast<uint32_t>(gltfModel.images.size());
+	// Empty texture to be used for empty material images
+	emptyTexture = textures.add(Texture());
+	pending->images.swap(gltfModel.images);
+	pending->skipImage.swap(skipImage);
+}
+
+/**
+* Create the texture of one image in the slot prepareImages reserved for it and release the image data
+*
+* @param index Index of the image in the file
+* @param transferQueue Queue used for the upload if the image can't be written from the host
+*/
+void vkglTF::Model::uploadImage(uint32_t index, VkQueue transferQueue)
+{
+	auto textureStart = std::chrono::high_resolution_clock::now();
+	tinygltf::Image& image = pending->images[index];
+	if (!pending->skipImage[index])
+	{
+		Texture& texture = textures.slot(index);
+		texture.fromglTfImage(image, path, device, transferQueue);
+		loadStatistics.textureBytes += texture.memorySize;
+		if (vks::ktx2::isKtx2(image.image.data(), image.image.size()))
+		{
+			loadStatistics.ktx2Textures++;
+		}
 	}
-	// Create an empty texture to be used for empty material images
-	createEmptyTexture(transferQueue);
+	std::vector<unsigned char>().swap(image.image);
+	loadStatistics.textureMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - textureStart).count();
 }
 
 void vkglTF::Model::loadMaterials(tinygltf::Model & gltfModel)
@@ -1139,12 +1325,12 @@ void vkglTF::Model::loadMaterials(tinygltf::Model & gltfModel)
 		vkglTF::Material material(device);
 		if (mat.values.find("baseColorTexture")!=mat.values.end())
 		{
-			material.baseColorTexture = getTexture(gltfModel.textures[mat.values["baseColorTexture"].TextureIndex()].source);
+			material.baseColorTexture = getTexture(textureSource(gltfModel.textures[mat.values["baseColorTexture"].TextureIndex()]));
 		}
 		// Metallic roughness workflow
 		if (mat.values.find("metallicRoughnessTexture")!=mat.values.end())
 		{
-			material.metallicRoughnessTexture = getTexture(gltfModel.textures[mat.values["metallicRoughnessTexture"].TextureIndex()].source);
+			material.metallicRoughnessTexture = getTexture(textureSource(gltfModel.textures[mat.values["metallicRoughnessTexture"].TextureIndex()]));
 		}
 		if (mat.values.find("roughnessFactor")!=mat.values.end())
 		{
@@ -1161,20 +1347,20 @@ void vkglTF::Model::loadMaterials(tinygltf::Model & gltfModel)
 
 		if (mat.additionalValues.find("normalTexture")!= mat.additionalValues.end())
 		{
-			material.normalTexture = getTexture(gltfModel.textures[mat.additionalValues["normalTexture"].TextureIndex()].source);
+			material.normalTexture = getTexture(textureSource(gltfModel.textures[mat.additionalValues["normalTexture"].TextureIndex()]));
 		}
 		else
 		{
-			material.normalTexture = &emptyTexture;
+			material.normalTexture = emptyTexture;
 		}
 
 		if (mat.additionalValues.find("emissiveTexture")!=mat.additionalValues.end())
 		{
-			material.emissiveTexture = getTexture(gltfModel.textures[mat.additionalValues["emissiveTexture"].TextureIndex()].source);
+			material.emissiveTexture = getTexture(textureSource(gltfModel.textures[mat.additionalValues["emissiveTexture"].TextureIndex()]));
 		}
 		if (mat.additionalValues.find("occlusionTexture") != mat.additionalValues.end())
 		{
-			material.occlusionTexture = getTexture(gltfModel.textures[mat.additionalValues["occlusionTexture"].TextureIndex()].source);
+			material.occlusionTexture = getTexture(textureSource(gltfModel.textures[mat.additionalValues["occlusionTexture"].TextureIndex()]));
 		}
 		if (mat.additionalValues.find("alphaMode")!=mat.additionalValues.end())
 		{
@@ -1193,11 +1379,11 @@ void vkglTF::Model::loadMaterials(tinygltf::Model & gltfModel)
 			material.alphaCutoff = static_cast<float>(mat.additionalValues["alphaCutoff"].Factor());
 		}
 
-		materials.push_back(material);
+		materials.add(std::move(material));
 	}//for
 
-	// Push a default material at the end of the list for meshes with no material assigned
-	materials.push_back(Material(device));
+	// Add a default material at the end of the list for meshes with no material assigned
+	defaultMaterial = materials.add(Material(device));
 }
 
 void vkglTF::Model::loadAnimations(tinygltf::Model & gltfModel)
@@ -1323,7 +1509,7 @@ void vkglTF::Model::loadAnimations(tinygltf::Model & gltfModel)
 
 			channel.samplerIndex = source.sampler;
 			channel.node = nodeFromIndex(source.target_node);
-			if (!channel.node)
+			if (!nodes.contains(channel.node))
 			{
 				continue;
 			}
@@ -1335,20 +1521,149 @@ void vkglTF::Model::loadAnimations(tinygltf::Model & gltfModel)
 	}//for gltfModel.animations
 }
 
-void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device, VkQueue transferQueue, uint32_t fileLoadingFlags, float scale)
+/**
+* Merge small primitives by material, only valid for pre-transformed static geometry since the merged primitives are
+* drawn with an identity matrix. The index buffer is rewritten so that the kept primitives come first and the indices
+* of the small primitives of each material follow each other, each run (up to mergedPrimitiveIndices) becomes one draw
+*
+* @param indexBuffer Indices of the model, rewritten in place
+* @param vertexBuffer Pre-transformed vertices, used for the bounds of the merged primitives
+*/
+void vkglTF::Model::mergeStaticPrimitives(std::vector<uint32_t>& indexBuffer, const std::vector<Vertex>& vertexBuffer)
 {
-	tinygltf::Model gltfModel;
-	tinygltf::TinyGLTF gltfContext;
-	if (fileLoadingFlags&FileLoadingFlags::DontLoadImages)
+	std::vector<uint32_t> mergedIndices;
+	mergedIndices.reserve(indexBuffer.size());
+	std::vector<std::vector<Primitive>> materialPrimitives(materials.slotCount());
+	uint32_t smallCount = 0;
+	nodes.forEach([&](NodeHandle, Node& node)
 	{
-		gltfContext.SetImageLoader(loadImageDataFuncEmpty, nullptr);
-	}
-	else
-	{
-		gltfContext.SetImageLoader(loadImageDataFunc, nullptr);
-	}
-
-#if defined(__ANDROID__)
+		Mesh* mesh = meshes.get(node.mesh);
+		if (!mesh)
+		{
+			return;
+		}
+		std::vector<Primitive> kept;
+		for (Primitive& primitive : mesh->primitives)
+		{
+			if (primitive.indexCount <= smallPrimitiveIndices)
+			{
+				materialPrimitives[primitive.material.index].push_back(primitive);
+				smallCount++;
+				continue;
+			}
+			uint32_t firstIndex = static_cast<uint32_t>(mergedIndices.size());
+			mergedIndices.insert(mergedIndices.end(), indexBuffer.begin() + primitive.firstIndex, indexBuffer.begin() + primitive.firstIndex + primitive.indexCount);
+			primitive.firstIndex = firstIndex;
+			kept.push_back(primitive);
+		}
+		mesh->primitives.swap(kept);
+	});
+
+	if (smallCount == 0)
+	{
+		return;
+	}
+
+	Node mergedNode{};
+	mergedNode.index = static_cast<uint32_t>(nodeLookup.size());
+	mergedNode.name = "merged static primitives";
+	Mesh mergedMesh;
+	mergedMesh.create(device, glm::mat4(1.0f), addresses.enabled ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : 0);
+	mergedMesh.name = mergedNode.name;
+
+	for (size_t m = 0; m < materialPrimitives.size(); m++)
+	{
+		bool open = false;
+		glm::vec3 posMin(FLT_MAX);
+		glm::vec3 posMax(-FLT_MAX);
+		uint32_t vertexMin = UINT32_MAX;
+		uint32_t vertexMax = 0;
+		for (const Primitive& primitive : materialPrimitives[m])
+		{
+			if (open && (mergedMesh.primitives.back().indexCount + primitive.indexCount > mergedPrimitiveIndices))
+			{
+				Primitive& merged = mergedMesh.primitives.back();
+				merged.setDimensions(posMin, posMax);
+				merged.firstVertex = vertexMin;
+				merged.vertexCount = vertexMax - vertexMin;
+				open = false;
+			}
+			if (!open)
+			{
+				mergedMesh.primitives.push_back(Primitive(static_cast<uint32_t>(mergedIndices.size()), 0, primitive.material));
+				posMin = glm::vec3(FLT_MAX);
+				posMax = glm::vec3(-FLT_MAX);
+				vertexMin = UINT32_MAX;
+				vertexMax = 0;
+				open = true;
+			}
+			for (uint32_t i = 0; i < primitive.indexCount; i++)
+			{
+				uint32_t index = indexBuffer[primitive.firstIndex + i];
+				mergedIndices.push_back(index);
+				posMin = glm::min(posMin, vertexBuffer[index].pos);
+				posMax = glm::max(posMax, vertexBuffer[index].pos);
+				vertexMin = std::min(vertexMin, index);
+				vertexMax = std::max(vertexMax, index + 1);
+			}
+			mergedMesh.primitives.back().indexCount += primitive.indexCount;
+		}//for primitive
+		if (open)
+		{
+			Primitive& merged = mergedMesh.primitives.back();
+			merged.setDimensions(posMin, posMax);
+			merged.firstVertex = vertexMin;
+			merged.vertexCount = vertexMax - vertexMin;
+		}
+	}//for material
+
+	loadStatistics.mergedPrimitives = smallCount;
+	loadStatistics.mergedDraws = static_cast<uint32_t>(mergedMesh.primitives.size());
+	indexBuffer.swap(mergedIndices);
+	mergedNode.mesh = meshes.add(std::move(mergedMesh));
+	rootNodes.push_back(nodes.add(std::move(mergedNode)));
+}
+
+void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device, VkQueue transferQueue, uint32_t fileLoadingFlags, float scale)
+{
+	if (!parseFile(filename, device, fileLoadingFlags, scale))
+	{
+		//TODO : throw
+		vks::tools::exitFatal("Could not load glTF file \"" + filename + "\":" + loadError, -1);
+		return;
+	}
+	VkDeviceSize budgetBytes = VK_WHOLE_SIZE;
+	upload(transferQueue, budgetBytes);
+}
+
+/**
+* Parse the file and build the scene: nodes, meshes with their uniform buffers, materials, skins, animations and the pre-transformed
+* vertices. Only creates objects and records no commands, so it can run on a worker thread while the device is used elsewhere.
+* What needs a queue (images, geometry, descriptors) is left to upload
+*
+* @return False if the file could not be loaded, loadError tells why
+*/
+bool vkglTF::Model::parseFile(std::string filename, vks::VulkanDevice *device, uint32_t fileLoadingFlags, float scale)
+{
+	auto loadStart = std::chrono::high_resolution_clock::now();
+	loadStatistics = LoadStatistics();
+	// Set first, the destructor releases what was created up to a failure
+	this->device = device;
+	pending.reset(new PendingUpload());
+	pending->filename = filename;
+	pending->fileLoadingFlags = fileLoadingFlags;
+	tinygltf::Model gltfModel;
+	tinygltf::TinyGLTF gltfContext;
+	if (fileLoadingFlags&FileLoadingFlags::DontLoadImages)
+	{
+		gltfContext.SetImageLoader(loadImageDataFuncEmpty, nullptr);
+	}
+	else
+	{
+		gltfContext.SetImageLoader(loadImageDataFunc, nullptr);
+	}
+
+#if defined(__ANDROID__)
 	// On Android all assets are packed with the apk in a compressed form, so we need to open them using the asset manager
 	// We let tinygltf handle this, by passing the asset manager of our app
 	tinygltf::asset_manager = androidApp->activity->assetManager;
@@ -1357,7 +1672,17 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 	path = filename.substr(0, pos);
 
 	std::string error, warning;
-	this->device = device;
+	uniformRanges.create(device->logicalDevice, device->properties.limits.nonCoherentAtomSize);
+
+	addresses = DeviceAddresses();
+	if (fileLoadingFlags & FileLoadingFlags::BufferDeviceAddresses)
+	{
+		addresses.enabled = device->bufferDeviceAddress.enabled;
+		if (!addresses.enabled)
+		{
+			std::cerr << "Buffer device addresses are not enabled on the device, \"" << filename << "\" can not be drawn with vertex pulling\n";
+		}
+	}
 
 #if defined(__ANDROID__)
 	// On Android all assets are packed with the apk in a compressed form, so we need to open them using the asset manager
@@ -1365,24 +1690,41 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 	tinygltf::asset_manager = androidApp->activity->assetManager;
 #endif
 
-	bool fileLoaded = gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, filename);
+	bool binary = (filename.size() > 4) && (filename.compare(filename.size() - 4, 4, ".glb") == 0);
+	bool fileLoaded = binary ? gltfContext.LoadBinaryFromFile(&gltfModel, &error, &warning, filename) : gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, filename);
 
-	std::vector<uint32_t> indexBuffer;
-	std::vector<Vertex> vertexBuffer;
+	if (fileLoaded)
+	{
+		// Compressed buffer views are decoded before anything reads from them
+		DecodeStatistics decodeStatistics;
+		if (!decodeMeshoptCompression(gltfModel, decodeStatistics, error))
+		{
+			loadError = error;
+			return false;
+		}
+		loadStatistics.decodeMs = decodeStatistics.decodeMs;
+		loadStatistics.compressedViews = decodeStatistics.compressedViews;
+		loadStatistics.compressedBytes = decodeStatistics.compressedBytes;
+		loadStatistics.decodedBytes = decodeStatistics.decodedBytes;
+	}
+
+	std::vector<uint32_t>& indexBuffer = pending->indexBuffer;
+	std::vector<Vertex>& vertexBuffer = pending->vertexBuffer;
 
 	if (fileLoaded)
 	{
 		if (!(fileLoadingFlags&FileLoadingFlags::DontLoadImages))
 		{
-			loadImages(gltfModel, device, transferQueue);
+			prepareImages(gltfModel);
 		}
 		loadMaterials(gltfModel);
 		const tinygltf::Scene &scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
 
+		nodeLookup.assign(gltfModel.nodes.size(), NodeHandle());
 		for (size_t i = 0; i < scene.nodes.size(); ++i)
 		{
 			const tinygltf::Node node = gltfModel.nodes[scene.nodes[i]];
-			loadNode(nullptr, node, scene.nodes[i], gltfModel, indexBuffer, vertexBuffer, scale);
+			loadNode(NodeHandle(), node, scene.nodes[i], gltfModel, indexBuffer, vertexBuffer, scale);
 		}
 		if (gltfModel.animations.size() > 0)
 		{
@@ -1390,26 +1732,23 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 		}
 		loadSkins(gltfModel);
 
-		for (auto node : linearNodes)
+		nodes.forEach([this](NodeHandle, Node& node)
 		{
 			// Assign skins
-			if (node->skinIndex > -1)
+			if (node.skinIndex > -1)
 			{
-				node->skin = skins[node->skinIndex];
+				node.skin = skins.handle(static_cast<uint32_t>(node.skinIndex));
 			}
-			// Initial pose
-			if (node->mesh)
-			{
-				node->update();
-			}
-		}//for linearNodes
+		});
+		// Initial pose
+		updateNodes(&uniformRanges);
+		VK_CHECK_RESULT(uniformRanges.flush());
 
 	}//if fileLoaded
 	else
 	{
-		//TODO : throw
-		vks::tools::exitFatal("Could not load glTF file \"" + filename + "\":" + error, -1);
-		return;
+		loadError = error;
+		return false;
 	}//if_else fileLoaded
 
 	// Pre-Calculations for requested features
@@ -1418,16 +1757,18 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 		const bool preTransform = fileLoadingFlags & FileLoadingFlags::PreTransformVertices;
 		const bool preMultiplyColor = fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors;
 		const bool flipY = fileLoadingFlags & FileLoadingFlags::FlipY;
-		for (Node* node : linearNodes)
+		nodes.forEach([&](NodeHandle, const Node& node)
 		{
-			if (node->mesh)
+			const Mesh* mesh = meshes.get(node.mesh);
+			if (mesh)
 			{
-				const glm::mat4 localMatrix = node->getMatrix();
-				for (Primitive* primitive : node->mesh->primitives)
+				const glm::mat4 localMatrix = node.worldMatrix;
+				for (const Primitive& primitive : mesh->primitives)
 				{
-					for (uint32_t i = 0; i < primitive->vertexCount; ++i)
+					const glm::vec4 baseColorFactor = materials[primitive.material].baseColorFactor;
+					vks::parallel::forEachIndex(0, primitive.vertexCount, [&](size_t i)
 					{
-						Vertex& vertex = vertexBuffer[primitive->firstVertex + i];
+						Vertex& vertex = vertexBuffer[primitive.firstVertex + i];
 						// Pre-transform vertex positions by node-hierarchy
 						if (preTransform)
                         {
@@ -1444,15 +1785,20 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 						// Pre-Multiply vertex colors with material base color
 						if (preMultiplyColor)
 						{
-							vertex.color = primitive->material.baseColorFactor*vertex.color;
+							vertex.color = baseColorFactor*vertex.color;
 						}
 
-					}//for i
+					});//forEachIndex
 				}//for primitive
-			}//if node->mesh
-		}//for linearNodes
+			}//if mesh
+		});//forEach nodes
 	}//if Calculations
 
+	if ((fileLoadingFlags & FileLoadingFlags::MergeStaticPrimitives) && (fileLoadingFlags & FileLoadingFlags::PreTransformVertices) && skins.empty() && animations.empty())
+	{
+		mergeStaticPrimitives(indexBuffer, vertexBuffer);
+	}
+
 	for (auto extension : gltfModel.extensionsUsed)
 	{
 		if (extension == "KHR_materials_pbrSpecularGlossiness")
@@ -1462,6 +1808,98 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 		}
 	}//for
 
+	getSceneDimensions();
+	loadStatistics.loadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - loadStart).count();
+	return true;
+}
+
+/**
+* Move what parseFile left to the device: one step per image, then the geometry, then the address buffers and descriptors. Steps are
+* started while budget is left, so a step larger than the whole budget still runs (alone) and the upload always makes progress
+*
+* @param transferQueue Queue used for uploads that can't be written from the host, must not be in use by another thread
+* @param budgetBytes Bytes that may be uploaded, reduced by the bytes of the steps taken
+* @return True once the model can be drawn
+*/
+bool vkglTF::Model::upload(VkQueue transferQueue, VkDeviceSize& budgetBytes)
+{
+	if (!pending)
+	{
+		return true;
+	}
+	auto uploadStart = std::chrono::high_resolution_clock::now();
+	std::string filename;
+	while (pending && (budgetBytes > 0))
+	{
+		VkDeviceSize stepBytes = 0;
+		if (pending->nextImage < pending->images.size())
+		{
+			stepBytes = pending->images[pending->nextImage].image.size();
+			uploadImage(pending->nextImage++, transferQueue);
+		}
+		else if (!pending->emptyTextureCreated && textures.contains(emptyTexture))
+		{
+			stepBytes = 4;
+			createEmptyTexture(transferQueue);
+			pending->emptyTextureCreated = true;
+		}
+		else if (!pending->geometryUploaded)
+		{
+			stepBytes = pending->vertexBuffer.size() * sizeof(Vertex) + pending->indexBuffer.size() * sizeof(uint32_t);
+			uploadGeometry(transferQueue);
+			pending->geometryUploaded = true;
+		}
+		else
+		{
+			filename = pending->filename;
+			finishUpload(transferQueue);
+		}
+		budgetBytes -= std::min(budgetBytes, stepBytes);
+	}//while
+	loadStatistics.loadMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - uploadStart).count();
+	if (pending)
+	{
+		return false;
+	}
+
+	// Parsing and all upload steps, not the time the upload was spread over
+	if ((loadStatistics.compressedViews > 0) || (loadStatistics.attributeBytes < loadStatistics.floatAttributeBytes) || (loadStatistics.textureCount > 0))
+	{
+		const double megabyte = 1024.0 * 1024.0;
+		std::ios_base::fmtflags flags = std::cout.flags();
+		std::streamsize precision = std::cout.precision();
+		std::cout << std::fixed << std::setprecision(2) << "Loaded \"" << filename << "\" in " << loadStatistics.loadMs << " ms";
+		if (loadStatistics.compressedViews > 0)
+		{
+			std::cout << ", decoded " << loadStatistics.compressedViews << " meshopt buffer views in " << loadStatistics.decodeMs << " ms ("
+				<< loadStatistics.compressedBytes / megabyte << " MB -> " << loadStatistics.decodedBytes / megabyte << " MB)";
+		}
+		std::cout << ", attributes " << loadStatistics.attributeBytes / megabyte << " MB (" << loadStatistics.floatAttributeBytes / megabyte << " MB as float)";
+		if (loadStatistics.textureCount > 0)
+		{
+			std::cout << ", " << loadStatistics.textureCount << " textures (" << loadStatistics.ktx2Textures << " KTX2) in " << loadStatistics.textureMs << " ms, "
+				<< loadStatistics.textureBytes / megabyte << " MB device memory";
+		}
+		if (loadStatistics.mergedPrimitives > 0)
+		{
+			std::cout << ", merged " << loadStatistics.mergedPrimitives << " static primitives into " << loadStatistics.mergedDraws << " draws";
+		}
+		std::cout << std::endl;
+		std::cout.flags(flags);
+		std::cout.precision(precision);
+	}
+
+	return true;
+}
+
+/**
+* Upload the vertices and indices, into the geometry pool if one is set, and release the host copies
+*/
+void vkglTF::Model::uploadGeometry(VkQueue transferQueue)
+{
+	const VkBufferUsageFlags addressUsage = addresses.enabled ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : 0;
+	std::vector<uint32_t>& indexBuffer = pending->indexBuffer;
+	std::vector<Vertex>& vertexBuffer = pending->vertexBuffer;
 	size_t vertexBufferSize = vertexBuffer.size() * sizeof(Vertex);
 	size_t indexBufferSize = indexBuffer.size() * sizeof(uint32_t);
 	indices.count = static_cast<uint32_t>(indexBuffer.size());
@@ -1469,70 +1907,108 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 
 	assert((vertexBufferSize > 0) && (indexBufferSize > 0));
 
-	struct StagingBuffer
+	if (geometryPool)
 	{
-		VkBuffer buffer;
-		VkDeviceMemory memory;
-	} vertexStaging, indexStaging;
-
-	// Create staging buffers
-	// Vertex data
-	VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		vertexBufferSize, &vertexStaging.buffer, &vertexStaging.memory, vertexBuffer.data()));
-
-	//Index data
-	VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		indexBufferSize, &indexStaging.buffer, &indexStaging.memory, indexBuffer.data()));
-
-	// Create device local buffers
-	// Vertex buffer
-	VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | memoryPropertyFlags,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBufferSize, &vertices.buffer, &vertices.memory));
-
-	//Index buffer
-	VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | memoryPropertyFlags,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBufferSize, &indices.buffer, &indices.memory));
-
-	//Copy from staging buffers
-	VkCommandBuffer copyCmd = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		geometry = geometryPool->allocate(vertices.count, indices.count);
+		geometryPool->upload(geometry, vertexBuffer.data(), indexBuffer.data(), transferQueue);
+		vertices.buffer = geometry.vertexBuffer;
+		vertices.memory = VK_NULL_HANDLE;
+		indices.buffer = geometry.indexBuffer;
+		indices.memory = VK_NULL_HANDLE;
+		meshes.forEach([this](MeshHandle, Mesh& mesh)
+		{
+			for (Primitive& primitive : mesh.primitives)
+			{
+				primitive.firstIndex += geometry.firstIndex;
+				primitive.firstVertex += geometry.vertexOffset;
+			}
+		});
+	}
+	else if (device->directUpload.buffers)
+	{
+		// Device local memory is host visible, the geometry is written without staging copies
+		VK_CHECK_RESULT(device->CreateDeviceLocalBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | memoryPropertyFlags | addressUsage, vertexBufferSize,
+			&vertices.buffer, &vertices.memory, vertexBuffer.data(), transferQueue));
+		VK_CHECK_RESULT(device->CreateDeviceLocalBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | memoryPropertyFlags | addressUsage, indexBufferSize,
+			&indices.buffer, &indices.memory, indexBuffer.data(), transferQueue));
+	}
+	else
+	{
+		struct StagingBuffer
+		{
+			VkBuffer buffer;
+			VkDeviceMemory memory;
+		} vertexStaging, indexStaging;
+
+		// Create staging buffers
+		// Vertex data
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
+	    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			vertexBufferSize, &vertexStaging.buffer, &vertexStaging.memory, vertexBuffer.data()));
+
+		//Index data
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
+	    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			indexBufferSize, &indexStaging.buffer, &indexStaging.memory, indexBuffer.data()));
+
+		// Create device local buffers
+		// Vertex buffer
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | memoryPropertyFlags | addressUsage,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBufferSize, &vertices.buffer, &vertices.memory));
+
+		//Index buffer
+		VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | memoryPropertyFlags | addressUsage,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBufferSize, &indices.buffer, &indices.memory));
+
+		//Copy from staging buffers
+		VkCommandBuffer copyCmd = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 
-	VkBufferCopy copyRegion = {};
+		VkBufferCopy copyRegion = {};
 
-	copyRegion.size = vertexBufferSize;
-	vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
+		copyRegion.size = vertexBufferSize;
+		vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
 
-	copyRegion.size = indexBufferSize;
-	vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indices.buffer, 1, &copyRegion);
+		copyRegion.size = indexBufferSize;
+		vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indices.buffer, 1, &copyRegion);
 
-	device->FlushCommandBuffer(copyCmd, transferQueue, true);
+		device->FlushCommandBuffer(copyCmd, transferQueue, true);
 
-	vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
-	vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+		vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
+		vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
+		vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
+		vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+	}//if_else geometryPool
 
-	getSceneDimensions();
+	if (pending->fileLoadingFlags & FileLoadingFlags::KeepHostGeometry)
+	{
+		hostGeometry.vertices.swap(vertexBuffer);
+		hostGeometry.indices.swap(indexBuffer);
+		hostGeometry.preTransformed = (pending->fileLoadingFlags & FileLoadingFlags::PreTransformVertices) != 0;
+	}
+	std::vector<uint32_t>().swap(indexBuffer);
+	std::vector<Vertex>().swap(vertexBuffer);
+}
 
-	// Setup descriptors
-	uint32_t uboCount{ 0 };
-	uint32_t imageCount{ 0 };
-	for (auto node : linearNodes)
+/**
+* Last upload step: address buffers and descriptors, the material descriptors need the images to be uploaded
+*/
+void vkglTF::Model::finishUpload(VkQueue transferQueue)
+{
+	if (addresses.enabled)
 	{
-		if (node->mesh)
-		{
-			uboCount++;
-		}
+		createAddressBuffers(transferQueue);
 	}
 
-	for (auto material : materials)
+	// Setup descriptors
+	uint32_t uboCount = static_cast<uint32_t>(meshes.size());
+	uint32_t imageCount{ 0 };
+	materials.forEach([&](MaterialHandle, const Material& material)
 	{
-		if (material.baseColorTexture != nullptr)
+		if (textures.contains(material.baseColorTexture))
 		{
 			imageCount++;
 		}
-	}
+	});
 
 	std::vector<VkDescriptorPoolSize> tempDescriptorPoolSize = {
 		{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,uboCount},
@@ -1552,6 +2028,8 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 
 	VkDescriptorPoolCreateInfo descriptorPoolCI{};
 	descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	// removeNode returns the sets of removed meshes to the pool, so meshes added later can allocate them again
+	descriptorPoolCI.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
 	descriptorPoolCI.poolSizeCount = static_cast<uint32_t>(tempDescriptorPoolSize.size());
 	descriptorPoolCI.pPoolSizes = tempDescriptorPoolSize.data();
 	descriptorPoolCI.maxSets = uboCount + imageCount;
@@ -1572,10 +2050,10 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, nullptr, &descriptorSetLayoutUbo));
 		}
 
-		for (auto node : nodes)
+		meshes.forEach([this](MeshHandle, Mesh& mesh)
 		{
-			prepareNodeDescriptor(node, descriptorSetLayoutUbo);
-		}
+			prepareMeshDescriptor(mesh, descriptorSetLayoutUbo);
+		});
 	}
 
 	// Descriptors for per-material images
@@ -1601,14 +2079,15 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, nullptr, &descriptorSetLayoutImage));
 		}
 
-		for (auto& material : materials)
+		materials.forEach([this](MaterialHandle, Material& material)
 		{
-			if (material.baseColorTexture != nullptr)
+			if (textures.contains(material.baseColorTexture))
 			{
-				material.createDescriptorSet(descriptorPool, vkglTF::descriptorSetLayoutImage, descriptorBindingFlags);
+				material.createDescriptorSet(descriptorPool, vkglTF::descriptorSetLayoutImage, descriptorBindingFlags, textures);
 			}
-		}//for
+		});
 	}
+	pending.reset();
 }
 
 void vkglTF::Model::bindBuffers(VkCommandBuffer commandBuffer)
@@ -1619,14 +2098,15 @@ void vkglTF::Model::bindBuffers(VkCommandBuffer commandBuffer)
 	buffersBound = true;
 }
 
-void vkglTF::Model::drawNode(Node * node, VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet)
+void vkglTF::Model::drawNode(const Node& node, VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet)
 {
-	if (node->mesh)
+	const Mesh* mesh = meshes.get(node.mesh);
+	if (mesh)
 	{
-		for (Primitive* primitive:node->mesh->primitives)
+		for (const Primitive& primitive : mesh->primitives)
 		{
 			bool skip = false;
-			const vkglTF::Material& material = primitive->material;
+			const vkglTF::Material& material = materials[primitive.material];
 			if (renderFlags&RenderFlags::RenderOpaqueNodes)
 			{
 				skip = (material.alphaMode != Material::ALPHA_MODE_OPAQUE);//Ƿ͸passȷ
@@ -1648,15 +2128,94 @@ void vkglTF::Model::drawNode(Node * node, VkCommandBuffer commandBuffer, uint32_
 				{
 					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindImageSet, 1, &material.descriptorSet, 0, nullptr);
 				}
-				vkCmdDrawIndexed(commandBuffer, primitive->indexCount, 1, primitive->firstIndex, 0, 0);
+				vkCmdDrawIndexed(commandBuffer, primitive.indexCount, 1, primitive.firstIndex, 0, 0);
+			}
+		}//for
+	}//if mesh
+}
+
+/**
+* Upload the material factors into a storage buffer and query the addresses the pulled draws pass to the shaders
+*
+* @param transferQueue Queue used for the upload if device local memory can't be written directly
+*/
+void vkglTF::Model::createAddressBuffers(VkQueue transferQueue)
+{
+	// Indexed by material slot, the index pushed with each draw
+	std::vector<PulledMaterial> materialData(materials.slotCount());
+	materials.forEach([&](MaterialHandle handle, const Material& material)
+	{
+		materialData[handle.index].baseColorFactor = material.baseColorFactor;
+		materialData[handle.index].metallicFactor = material.metallicFactor;
+		materialData[handle.index].roughnessFactor = material.roughnessFactor;
+		materialData[handle.index].alphaCutoff = material.alphaCutoff;
+		materialData[handle.index].alphaMode = static_cast<uint32_t>(material.alphaMode);
+	});
+	VK_CHECK_RESULT(device->CreateDeviceLocalBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, &materialBuffer,
+		materialData.size() * sizeof(PulledMaterial), materialData.data(), transferQueue));
+
+	// Pool allocations rebase their indices to the start of the block, so the address of the whole buffer is the base in both cases
+	addresses.vertices = device->GetBufferDeviceAddress(vertices.buffer);
+	addresses.indices = device->GetBufferDeviceAddress(indices.buffer);
+	addresses.materials = device->GetBufferDeviceAddress(materialBuffer.buffer);
+}
+
+void vkglTF::Model::drawNodePulled(const Node& node, VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet,
+	VkShaderStageFlags stageFlags, PullPushConstants& pushConstants)
+{
+	const Mesh* mesh = meshes.get(node.mesh);
+	if (mesh)
+	{
+		pushConstants.node = mesh->uniformBuffer.address;
+		for (const Primitive& primitive : mesh->primitives)
+		{
+			const vkglTF::Material& material = materials[primitive.material];
+			if (skipMaterial(material, renderFlags))
+			{
+				continue;
+			}
+			if (renderFlags & RenderFlags::BindImages)
+			{
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindImageSet, 1, &material.descriptorSet, 0, nullptr);
 			}
+			pushConstants.materialIndex = primitive.material.index;
+			vkCmdPushConstants(commandBuffer, pipelineLayout, stageFlags, 0, sizeof(PullPushConstants), &pushConstants);
+			vkCmdDrawIndexed(commandBuffer, primitive.indexCount, 1, primitive.firstIndex, 0, 0);
 		}//for
 	}//if mesh
+}
 
-	for (auto& child:node->children)
+/**
+* Draw the model with vertex pulling, the vertex shader fetches the vertices through their address and decodes them with the stride and
+* attribute offsets in the push constants, so one pipeline serves any vertex layout and no vertex buffer or uniform buffer sets are bound
+*
+* @param commandBuffer Command buffer the draws are recorded to
+* @param renderFlags Alpha mode filter and BindImages, as for draw
+* @param pipelineLayout Layout with a push constant range of sizeof(PullPushConstants) at offset 0 for stageFlags
+* @param bindImageSet Set index of the material images, only bound with RenderFlags::BindImages
+* @param stageFlags Stages of the push constant range
+*/
+void vkglTF::Model::drawPulled(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet, VkShaderStageFlags stageFlags)
+{
+	if (!addresses.enabled)
 	{
-		drawNode(child, commandBuffer, renderFlags, pipelineLayout, bindImageSet);
+		return;
+	}
+	if (!buffersBound)
+	{
+		vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
 	}
+	PullPushConstants pushConstants;
+	pushConstants.vertices = addresses.vertices;
+	pushConstants.materials = addresses.materials;
+	pushConstants.vertexStride = sizeof(Vertex) / sizeof(float);
+	pushConstants.attributeOffsets[0] = packAttributeOffsets(offsetof(Vertex, pos), offsetof(Vertex, normal), offsetof(Vertex, uv), offsetof(Vertex, color));
+	pushConstants.attributeOffsets[1] = packAttributeOffsets(offsetof(Vertex, tangent), offsetof(Vertex, joint0), offsetof(Vertex, weight0), 0);
+	// Parents come before their children in slot order, so a linear scan draws in scene graph order
+	nodes.forEach([&](NodeHandle, const Node& node)
+	{
+		drawNodePulled(node, commandBuffer, renderFlags, pipelineLayout, bindImageSet, stageFlags, pushConstants);
+	});
 }
 
 void vkglTF::Model::draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet)
@@ -1667,20 +2226,92 @@ void vkglTF::Model::draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, Vk
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
 		vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
 	}
-	for (auto& node : nodes)
-    {
+	// Parents come before their children in slot order, so a linear scan draws in scene graph order
+	nodes.forEach([&](NodeHandle, const Node& node)
+	{
 		drawNode(node, commandBuffer, renderFlags, pipelineLayout, bindImageSet);
-	}
+	});
 }
 
-void vkglTF::Model::getNodeDimensions(Node *node, glm::vec3 &min, glm::vec3 &max)
+/**
+* Add a draw for every primitive of every node to a render queue, the depth used for ordering is the view space
+* distance of the primitive's center. Sorting and recording is left to the queue, so draws of several models can be merged
+*
+* @param queue Queue the draws are added to
+* @param view View matrix of the camera
+* @param pipelines Pipeline per alpha mode and the set indices to bind
+* @param renderFlags RenderFlags::BindImages to bind the material images
+*/
+void vkglTF::Model::enqueue(vks::RenderQueue& queue, const glm::mat4& view, const QueuePipelines& pipelines, uint32_t renderFlags)
 {
-	if (node->mesh)
+	nodes.forEach([&](NodeHandle, const Node& node)
+	{
+		const Mesh* mesh = meshes.get(node.mesh);
+		if (!mesh)
+		{
+			return;
+		}
+		const glm::mat4 modelView = view * node.worldMatrix;
+		for (const Primitive& primitive : mesh->primitives)
+		{
+			const vkglTF::Material& material = materials[primitive.material];
+			vks::RenderQueue::Draw draw;
+			switch (material.alphaMode)
+			{
+			case Material::ALPHA_MODE_MASK:
+				draw.pass = vks::RenderQueue::PassAlphaMask;
+				draw.pipeline = pipelines.alphaMask;
+				break;
+			case Material::ALPHA_MODE_BLEND:
+				draw.pass = vks::RenderQueue::PassAlphaBlend;
+				draw.pipeline = pipelines.alphaBlend;
+				break;
+			default:
+				draw.pass = vks::RenderQueue::PassOpaque;
+				draw.pipeline = pipelines.opaque;
+				break;
+			}
+			if (draw.pipeline == VK_NULL_HANDLE)
+			{
+				continue;
+			}
+			draw.pipelineLayout = pipelines.pipelineLayout;
+			if (pipelines.bindMeshSet != ~0u)
+			{
+				draw.objectSet = mesh->uniformBuffer.descriptorSet;
+				draw.objectSetIndex = pipelines.bindMeshSet;
+			}
+			if (renderFlags & RenderFlags::BindImages)
+			{
+				draw.materialSet = material.descriptorSet;
+				draw.materialSetIndex = pipelines.bindImageSet;
+			}
+			draw.vertexBuffer = vertices.buffer;
+			draw.indexBuffer = indices.buffer;
+			draw.indexType = VK_INDEX_TYPE_UINT32;
+			draw.indexCount = primitive.indexCount;
+			draw.firstIndex = primitive.firstIndex;
+			// Camera looks down -z in view space
+			draw.depth = -(modelView * glm::vec4(primitive.dimensions.center, 1.0f)).z;
+			queue.add(draw);
+		}//for
+	});//forEach nodes
+}
+
+void vkglTF::Model::getNodeDimensions(NodeHandle handle, glm::vec3 &min, glm::vec3 &max)
+{
+	const Node* node = nodes.get(handle);
+	if (!node)
+	{
+		return;
+	}
+	const Mesh* mesh = meshes.get(node->mesh);
+	if (mesh)
     {
-		for (Primitive *primitive : node->mesh->primitives)
+		for (const Primitive& primitive : mesh->primitives)
         {
-			glm::vec4 locMin = glm::vec4(primitive->dimensions.min, 1.0f) * node->getMatrix();
-			glm::vec4 locMax = glm::vec4(primitive->dimensions.max, 1.0f) * node->getMatrix();
+			glm::vec4 locMin = glm::vec4(primitive.dimensions.min, 1.0f) * node->worldMatrix;
+			glm::vec4 locMax = glm::vec4(primitive.dimensions.max, 1.0f) * node->worldMatrix;
 			if (locMin.x < min.x) { min.x = locMin.x; }
 			if (locMin.y < min.y) { min.y = locMin.y; }
 			if (locMin.z < min.z) { min.z = locMin.z; }
@@ -1688,9 +2319,9 @@ void vkglTF::Model::getNodeDimensions(Node *node, glm::vec3 &min, glm::vec3 &max
 			if (locMax.y > max.y) { max.y = locMax.y; }
 			if (locMax.z > max.z) { max.z = locMax.z; }
 		}
-	}//if node->mesh
+	}//if mesh
 
-	for (auto child : node->children)
+	for (NodeHandle child : node->children)
     {
 		getNodeDimensions(child, min, max);
 	}
@@ -1698,12 +2329,36 @@ void vkglTF::Model::getNodeDimensions(Node *node, glm::vec3 &min, glm::vec3 &max
 
 void vkglTF::Model::getSceneDimensions()
 {
-	dimensions.min = glm::vec3(FLT_MAX);
-	dimensions.max = glm::vec3(-FLT_MAX);
-	for (auto node : nodes)
-    {
-		getNodeDimensions(node, dimensions.min, dimensions.max);
-	}
+	// The registry holds every node of the hierarchy, so the bounds of each slot are computed in parallel
+	// without the recursion of getNodeDimensions and combined afterwards
+	std::vector<Dimensions> nodeDimensions(nodes.slotCount());
+	vks::parallel::forEachIndex(0, nodeDimensions.size(), [&](size_t i)
+	{
+		if (!nodes.slotOccupied(static_cast<uint32_t>(i)))
+		{
+			return;
+		}
+		const Node& node = nodes.slot(static_cast<uint32_t>(i));
+		const Mesh* mesh = meshes.get(node.mesh);
+		if (mesh)
+		{
+			for (const Primitive& primitive : mesh->primitives)
+			{
+				nodeDimensions[i].min = glm::min(nodeDimensions[i].min, glm::vec3(glm::vec4(primitive.dimensions.min, 1.0f) * node.worldMatrix));
+				nodeDimensions[i].max = glm::max(nodeDimensions[i].max, glm::vec3(glm::vec4(primitive.dimensions.max, 1.0f) * node.worldMatrix));
+			}
+		}
+	}, nodeDimensionsGrain);
+
+	Dimensions scene = vks::parallel::reduce(nodeDimensions.begin(), nodeDimensions.end(), Dimensions(), [](const Dimensions& a, const Dimensions& b)
+	{
+		Dimensions combined;
+		combined.min = glm::min(a.min, b.min);
+		combined.max = glm::max(a.max, b.max);
+		return combined;
+	}, nodeDimensionsGrain);
+	dimensions.min = scene.min;
+	dimensions.max = scene.max;
 
 	dimensions.size = dimensions.max - dimensions.min;
 	dimensions.center = (dimensions.min + dimensions.max) / 2.0f;
@@ -1722,7 +2377,8 @@ void vkglTF::Model::updateAnimation(uint32_t index, float time)
 	for (auto& channel : animation.channels)
     {
 		vkglTF::AnimationSampler& sampler = animation.samplers[channel.samplerIndex];
-		if (sampler.inputs.size() > sampler.outputsVec4.size())
+		Node* node = nodes.get(channel.node);
+		if (!node || (sampler.inputs.size() > sampler.outputsVec4.size()))
         {
 			continue;
 		}
@@ -1739,14 +2395,14 @@ void vkglTF::Model::updateAnimation(uint32_t index, float time)
 					case vkglTF::AnimationChannel::PathType::TRANSLATION:
 					{
 						glm::vec4 trans = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
-						channel.node->translation = glm::vec3(trans);
+						node->translation = glm::vec3(trans);
 						break;
 					}
 
 					case vkglTF::AnimationChannel::PathType::SCALE:
 					{
 						glm::vec4 trans = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
-						channel.node->scale = glm::vec3(trans);
+						node->scale = glm::vec3(trans);
 						break;
 					}
 
@@ -1763,7 +2419,7 @@ void vkglTF::Model::updateAnimation(uint32_t index, float time)
 						q2.y = sampler.outputsVec4[i + 1].y;
 						q2.z = sampler.outputsVec4[i + 1].z;
 						q2.w = sampler.outputsVec4[i + 1].w;
-						channel.node->rotation = glm::normalize(glm::slerp(q1, q2, u));
+						node->rotation = glm::normalize(glm::slerp(q1, q2, u));
                         break;
 					}// ROTATION
 
@@ -1779,73 +2435,895 @@ void vkglTF::Model::updateAnimation(uint32_t index, float time)
 
 	if (updated)
 	{
-		for (auto & node:nodes)
+		updateNodes(&uniformRanges);
+		VK_CHECK_RESULT(uniformRanges.flush());
+	}//if updated
+}
+
+/**
+* Compute the world matrices in one scan of the registry instead of walking the parent chain of every node, then write the
+* matrices of the nodes with a mesh to its uniform buffer
+*
+* @param dirtyRanges Collects the written ranges of non coherent uniform buffers, they are flushed right away if null
+*/
+void vkglTF::Model::updateNodes(vks::MappedRangeTracker* dirtyRanges)
+{
+	updateWorldMatrices(nodes);
+	nodes.forEach([&](NodeHandle, const Node& node)
+	{
+		Mesh* mesh = meshes.get(node.mesh);
+		if (mesh)
 		{
-			node->update();
+			writeNodeUniforms(node, *mesh, skins.get(node.skin), nodes, dirtyRanges);
 		}
-	}//if updated
+	});
 }
 
 /*
 	Helper functions
 */
-vkglTF::Node * vkglTF::Model::findNode(Node * parent, uint32_t index)
+vkglTF::NodeHandle vkglTF::Model::nodeFromIndex(uint32_t index)
+{
+	return (index < nodeLookup.size()) ? nodeLookup[index] : NodeHandle();
+}
+
+/**
+* Remove a node and everything below it. Handles kept by skins, animation channels or the application stay invalid, the slots are
+* reused by nodes and meshes added later
+*
+* @param handle Node to remove, nothing happens if it was already removed
+*/
+void vkglTF::Model::removeNode(NodeHandle handle)
 {
-	Node* nodeFound = nullptr;
-	if (parent->index == index)
+	Node* node = nodes.get(handle);
+	if (!node)
 	{
-		return parent;
+		return;
 	}
+	Node* parent = nodes.get(node->parent);
+	std::vector<NodeHandle>& siblings = parent ? parent->children : rootNodes;
+	siblings.erase(std::remove(siblings.begin(), siblings.end(), handle), siblings.end());
 
-	for (auto& child:parent->children)
+	std::vector<NodeHandle> pending = { handle };
+	while (!pending.empty())
 	{
-		nodeFound = findNode(child, index);
-		if (nodeFound)
+		NodeHandle current = pending.back();
+		pending.pop_back();
+		Node& removed = nodes[current];
+		pending.insert(pending.end(), removed.children.begin(), removed.children.end());
+		Mesh* mesh = meshes.get(removed.mesh);
+		if (mesh)
 		{
-			break;
+			if (mesh->uniformBuffer.descriptorSet != VK_NULL_HANDLE)
+			{
+				VK_CHECK_RESULT(vkFreeDescriptorSets(device->logicalDevice, descriptorPool, 1, &mesh->uniformBuffer.descriptorSet));
+			}
+			mesh->destroy();
+			meshes.remove(removed.mesh);
 		}
-	}
-	return nodeFound;
+		nodes.remove(current);
+	}//while
+}
+
+void vkglTF::Model::prepareMeshDescriptor(vkglTF::Mesh& mesh, VkDescriptorSetLayout descriptorSetLayout)
+{
+	VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+	descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptorSetAllocInfo.descriptorPool = descriptorPool;
+	descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayout;
+	descriptorSetAllocInfo.descriptorSetCount = 1;
+	VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &descriptorSetAllocInfo, &mesh.uniformBuffer.descriptorSet));
+
+	VkWriteDescriptorSet writeDescriptorSet{};
+	writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	writeDescriptorSet.descriptorCount = 1;
+	writeDescriptorSet.dstSet = mesh.uniformBuffer.descriptorSet;
+	writeDescriptorSet.dstBinding = 0;
+	writeDescriptorSet.pBufferInfo = &mesh.uniformBuffer.descriptorBufferInfo;
+
+	vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
 }
 
-vkglTF::Node* vkglTF::Model::nodeFromIndex(uint32_t index)
+namespace
 {
-	Node* nodeFound = nullptr;
-	for (auto &node:nodes)
+	/*
+		Scene objects as the loader stored them before the registries: every node, mesh and primitive allocated on its own,
+		linked by pointers and traversed recursively, kept for benchmarkTraversal
+	*/
+	struct PointerPrimitive
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		const vkglTF::Material& material;
+	};
+
+	struct PointerMesh
+	{
+		std::vector<PointerPrimitive*> primitives;
+		vkglTF::Mesh::UniformBlock uniformBlock;
+		void* mapped = nullptr;
+
+		~PointerMesh()
+		{
+			for (PointerPrimitive* primitive : primitives)
+			{
+				delete primitive;
+			}
+		}
+	};
+
+	struct PointerNode
 	{
-		nodeFound = findNode(node, index);
-		if (nodeFound)
+		PointerNode* parent = nullptr;
+		std::vector<PointerNode*> children;
+		glm::mat4 matrix = glm::mat4(1.0f);
+		std::string name;
+		PointerMesh* mesh = nullptr;
+		glm::vec3 translation{};
+		glm::vec3 scale{ 1.0f };
+		glm::quat rotation{};
+
+		glm::mat4 localMatrix() const
 		{
-			break;
+			return glm::translate(glm::mat4(1.0f), translation) * glm::mat4(rotation) * glm::scale(glm::mat4(1.0f), scale) * matrix;
+		}
+
+		glm::mat4 getMatrix() const
+		{
+			glm::mat4 m = localMatrix();
+			for (const PointerNode* p = parent; p; p = p->parent)
+			{
+				m = p->localMatrix() * m;
+			}
+			return m;
+		}
+
+		void update()
+		{
+			if (mesh)
+			{
+				glm::mat4 m = getMatrix();
+				memcpy(mesh->mapped, &m, sizeof(glm::mat4));
+			}
+			for (PointerNode* child : children)
+			{
+				child->update();
+			}
+		}
+
+		~PointerNode()
+		{
+			delete mesh;
+			for (PointerNode* child : children)
+			{
+				delete child;
+			}
+		}
+	};
+
+	/*
+		What recording a draw reads, collected instead of calling vkCmdDrawIndexed
+	*/
+	struct TraversalDraw
+	{
+		VkDescriptorSet materialSet;
+		uint32_t indexCount;
+		uint32_t firstIndex;
+	};
+
+	void drawPointerNode(const PointerNode* node, std::vector<TraversalDraw>& draws)
+	{
+		if (node->mesh)
+		{
+			for (const PointerPrimitive* primitive : node->mesh->primitives)
+			{
+				if (primitive->material.alphaMode == vkglTF::Material::ALPHA_MODE_OPAQUE)
+				{
+					draws.push_back({ primitive->material.descriptorSet, primitive->indexCount, primitive->firstIndex });
+				}
+			}
+		}
+		for (const PointerNode* child : node->children)
+		{
+			drawPointerNode(child, draws);
 		}
 	}
-	return nodeFound;
+
+	// 1 x 1 white PNG, the base color texture of the generated vertex pulling scene
+	const char* whitePixelPng = "iVBORw0KGgoAAAANSUhEUgAAAAEAAAABCAYAAAAfFcSJAAAAC0lEQVR4nGP4DwQACfsD/fteaysAAAAASUVORK5CYII=";
+
+	/*
+		Scene of benchmarkVertexPulling: a grid of nodes sharing one textured UV sphere, written as a glTF file with its vertices and
+		indices in a separate binary
+	*/
+	bool writePullingModel(const std::string& fileName, const std::string& binaryName, uint32_t rings, uint32_t segments, uint32_t gridSize, float spacing)
+	{
+		std::vector<float> vertexData;
+		vertexData.reserve((rings + 1) * (segments + 1) * 8);
+		for (uint32_t ring = 0; ring <= rings; ring++)
+		{
+			for (uint32_t segment = 0; segment <= segments; segment++)
+			{
+				const float theta = glm::pi<float>() * ring / rings;
+				const float phi = 2.0f * glm::pi<float>() * segment / segments;
+				const float normal[3] = { std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi) };
+				const float uv[2] = { static_cast<float>(segment) / segments, static_cast<float>(ring) / rings };
+				vertexData.insert(vertexData.end(), normal, normal + 3);
+				vertexData.insert(vertexData.end(), normal, normal + 3);
+				vertexData.insert(vertexData.end(), uv, uv + 2);
+			}
+		}//for
+		std::vector<uint32_t> indexData;
+		indexData.reserve(rings * segments * 6);
+		for (uint32_t ring = 0; ring < rings; ring++)
+		{
+			for (uint32_t segment = 0; segment < segments; segment++)
+			{
+				const uint32_t i = ring * (segments + 1) + segment;
+				const uint32_t quad[6] = { i, i + segments + 1, i + 1, i + 1, i + segments + 1, i + segments + 2 };
+				indexData.insert(indexData.end(), quad, quad + 6);
+			}
+		}//for
+
+		const size_t vertexBytes = vertexData.size() * sizeof(float);
+		const size_t indexBytes = indexData.size() * sizeof(uint32_t);
+		std::ofstream binary(binaryName, std::ios::binary);
+		binary.write(reinterpret_cast<const char*>(vertexData.data()), vertexBytes);
+		binary.write(reinterpret_cast<const char*>(indexData.data()), indexBytes);
+		if (!binary)
+		{
+			return false;
+		}
+
+		const uint32_t vertexCount = (rings + 1) * (segments + 1);
+		const uint32_t nodeCount = gridSize * gridSize;
+		const std::string binaryUri = binaryName.substr(binaryName.find_last_of("/\\") + 1);
+		std::ofstream gltf(fileName);
+		gltf << "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[";
+		for (uint32_t node = 0; node < nodeCount; node++)
+		{
+			gltf << (node > 0 ? "," : "") << node;
+		}
+		gltf << "]}],\"nodes\":[";
+		for (uint32_t node = 0; node < nodeCount; node++)
+		{
+			const float x = (static_cast<float>(node % gridSize) - (gridSize - 1) * 0.5f) * spacing;
+			const float z = (static_cast<float>(node / gridSize) - (gridSize - 1) * 0.5f) * spacing;
+			gltf << (node > 0 ? "," : "") << "{\"mesh\":0,\"translation\":[" << x << ",0," << z << "]}";
+		}
+		gltf << "],\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,\"TEXCOORD_0\":2},\"indices\":3,\"material\":0}]}],"
+			<< "\"materials\":[{\"pbrMetallicRoughness\":{\"baseColorTexture\":{\"index\":0}}}],"
+			<< "\"textures\":[{\"source\":0}],\"images\":[{\"uri\":\"data:image/png;base64," << whitePixelPng << "\"}],"
+			<< "\"buffers\":[{\"uri\":\"" << binaryUri << "\",\"byteLength\":" << vertexBytes + indexBytes << "}],"
+			<< "\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":" << vertexBytes << ",\"byteStride\":32,\"target\":34962},"
+			<< "{\"buffer\":0,\"byteOffset\":" << vertexBytes << ",\"byteLength\":" << indexBytes << ",\"target\":34963}],"
+			<< "\"accessors\":[{\"bufferView\":0,\"byteOffset\":0,\"componentType\":5126,\"count\":" << vertexCount << ",\"type\":\"VEC3\","
+			<< "\"min\":[-1,-1,-1],\"max\":[1,1,1]},"
+			<< "{\"bufferView\":0,\"byteOffset\":12,\"componentType\":5126,\"count\":" << vertexCount << ",\"type\":\"VEC3\"},"
+			<< "{\"bufferView\":0,\"byteOffset\":24,\"componentType\":5126,\"count\":" << vertexCount << ",\"type\":\"VEC2\"},"
+			<< "{\"bufferView\":1,\"byteOffset\":0,\"componentType\":5125,\"count\":" << indexData.size() << ",\"type\":\"SCALAR\"}]}";
+		return static_cast<bool>(gltf);
+	}
 }
 
-void vkglTF::Model::prepareNodeDescriptor(vkglTF::Node * node, VkDescriptorSetLayout descriptorSetLayout)
+namespace vkglTF
 {
-	if (node->mesh)
+	/**
+	* Generate a random hierarchy (a few dozen roots, depth around 10 to 30, half of the nodes with a mesh of one to three primitives)
+	* and build it twice: as individually allocated nodes linked by pointers, allocated in the interleaved order of the old loader, and
+	* in registries the way Model::loadNode fills them. Times the update (world matrices written to host memory standing in for the
+	* mapped uniform buffers) and a draw traversal of the opaque primitives for both, and checks they produce the same matrices and draws
+	*
+	* @param out Stream the results are written to
+	* @param nodeCount Number of nodes of the generated scene
+	*/
+	void benchmarkTraversal(std::ostream& out, uint32_t nodeCount)
 	{
-		VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
-		descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		descriptorSetAllocInfo.descriptorPool = descriptorPool;
-		descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayout;
-		descriptorSetAllocInfo.descriptorSetCount = 1;
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &descriptorSetAllocInfo, &node->mesh->uniformBuffer.descriptorSet));
+		const uint32_t materialCount = 64;
+		const uint32_t benchmarkRuns = 10;
+		std::mt19937 random(42);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
 
-		VkWriteDescriptorSet writeDescriptorSet{};
-		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		writeDescriptorSet.descriptorCount = 1;
-		writeDescriptorSet.dstSet = node->mesh->uniformBuffer.descriptorSet;
-		writeDescriptorSet.dstBinding = 0;
-		writeDescriptorSet.pBufferInfo = &node->mesh->uniformBuffer.descriptorBufferInfo;
+		// Topology and contents shared by both representations
+		struct GeneratedNode
+		{
+			std::vector<uint32_t> children;
+			glm::vec3 translation;
+			glm::quat rotation;
+			glm::vec3 scale;
+			uint32_t primitiveCount;
+			uint32_t material[3];
+			int32_t mesh;
+		};
+		std::vector<GeneratedNode> generated(std::max(nodeCount, 1u));
+		std::vector<uint32_t> roots;
+		uint32_t meshCount = 0;
+		uint32_t primitiveCount = 0;
+		for (uint32_t i = 0; i < static_cast<uint32_t>(generated.size()); i++)
+		{
+			GeneratedNode& node = generated[i];
+			if ((i == 0) || (random() % 1024 == 0))
+			{
+				roots.push_back(i);
+			}
+			else
+			{
+				generated[random() % i].children.push_back(i);
+			}
+			node.translation = glm::vec3(unit(random), unit(random), unit(random));
+			node.rotation = glm::normalize(glm::quat(unit(random), unit(random), unit(random), unit(random)));
+			node.scale = glm::vec3(1.0f + 0.01f * unit(random));
+			node.mesh = (random() % 2 == 0) ? static_cast<int32_t>(meshCount++) : -1;
+			node.primitiveCount = (node.mesh >= 0) ? 1 + random() % 3 : 0;
+			primitiveCount += node.primitiveCount;
+			for (uint32_t p = 0; p < 3; p++)
+			{
+				node.material[p] = random() % materialCount;
+			}
+		}//for
 
-		vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
-	}
+		std::vector<Material> pointerMaterials(materialCount);
+		Registry<Material> materials;
+		for (uint32_t m = 0; m < materialCount; m++)
+		{
+			// Fake non zero handles, never passed to Vulkan
+			pointerMaterials[m].descriptorSet = reinterpret_cast<VkDescriptorSet>(static_cast<uintptr_t>(0x1000 + m));
+			pointerMaterials[m].alphaMode = (m % 8 == 7) ? Material::ALPHA_MODE_BLEND : Material::ALPHA_MODE_OPAQUE;
+			Material material = pointerMaterials[m];
+			materials.add(std::move(material));
+		}
+		// Host memory standing in for the mapped uniform buffers
+		std::vector<glm::mat4> pointerUniforms(std::max(meshCount, 1u));
+		std::vector<glm::mat4> registryUniforms(std::max(meshCount, 1u));
+
+		// Pointers: children are created before the mesh of their parent as the loader did, spreading a node's data over the heap
+		std::function<PointerNode*(uint32_t, PointerNode*)> createPointerNode = [&](uint32_t index, PointerNode* parent)
+		{
+			const GeneratedNode& source = generated[index];
+			PointerNode* node = new PointerNode();
+			node->parent = parent;
+			node->name = "node " + std::to_string(index);
+			node->translation = source.translation;
+			node->rotation = source.rotation;
+			node->scale = source.scale;
+			for (uint32_t child : source.children)
+			{
+				node->children.push_back(createPointerNode(child, node));
+			}
+			if (source.mesh >= 0)
+			{
+				node->mesh = new PointerMesh();
+				node->mesh->mapped = &pointerUniforms[source.mesh];
+				for (uint32_t p = 0; p < source.primitiveCount; p++)
+				{
+					node->mesh->primitives.push_back(new PointerPrimitive{ index * 3 * 36 + p * 36, 36, pointerMaterials[source.material[p]] });
+				}
+			}
+			return node;
+		};
+		std::vector<PointerNode*> pointerRoots;
+		for (uint32_t root : roots)
+		{
+			pointerRoots.push_back(createPointerNode(root, nullptr));
+		}
+
+		// Registries: filled in the same order as Model::loadNode, a node before its children and its mesh after them
+		Registry<Node> nodes;
+		Registry<Mesh> meshes;
+		Registry<Skin> skins;
+		std::function<void(uint32_t, NodeHandle)> createNode = [&](uint32_t index, NodeHandle parent)
+		{
+			const GeneratedNode& source = generated[index];
+			Node node;
+			node.parent = parent;
+			node.index = index;
+			node.name = "node " + std::to_string(index);
+			node.translation = source.translation;
+			node.rotation = source.rotation;
+			node.scale = source.scale;
+			NodeHandle handle = nodes.add(std::move(node));
+			if (parent.valid())
+			{
+				nodes[parent].children.push_back(handle);
+			}
+			for (uint32_t child : source.children)
+			{
+				createNode(child, handle);
+			}
+			if (source.mesh >= 0)
+			{
+				Mesh mesh;
+				mesh.uniformBuffer.mapped = &registryUniforms[source.mesh];
+				for (uint32_t p = 0; p < source.primitiveCount; p++)
+				{
+					mesh.primitives.push_back(Primitive(index * 3 * 36 + p * 36, 36, materials.handle(source.material[p])));
+				}
+				nodes[handle].mesh = meshes.add(std::move(mesh));
+			}
+		};
+		for (uint32_t root : roots)
+		{
+			createNode(root, NodeHandle());
+		}
+
+		std::vector<TraversalDraw> pointerDraws;
+		std::vector<TraversalDraw> registryDraws;
+		pointerDraws.reserve(primitiveCount);
+		registryDraws.reserve(primitiveCount);
+		double pointerUpdateMs = 0.0;
+		double pointerDrawMs = 0.0;
+		double registryUpdateMs = 0.0;
+		double registryDrawMs = 0.0;
+		for (uint32_t run = 0; run < benchmarkRuns; run++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			for (PointerNode* root : pointerRoots)
+			{
+				root->update();
+			}
+			auto updated = std::chrono::high_resolution_clock::now();
+			pointerDraws.clear();
+			for (const PointerNode* root : pointerRoots)
+			{
+				drawPointerNode(root, pointerDraws);
+			}
+			auto drawn = std::chrono::high_resolution_clock::now();
+			double updateMs = std::chrono::duration<double, std::milli>(updated - start).count();
+			double drawMs = std::chrono::duration<double, std::milli>(drawn - updated).count();
+			pointerUpdateMs = (run == 0) ? updateMs : std::min(pointerUpdateMs, updateMs);
+			pointerDrawMs = (run == 0) ? drawMs : std::min(pointerDrawMs, drawMs);
+
+			// Same work as Model::updateNodes and Model::draw
+			start = std::chrono::high_resolution_clock::now();
+			updateWorldMatrices(nodes);
+			nodes.forEach([&](NodeHandle, const Node& node)
+			{
+				Mesh* mesh = meshes.get(node.mesh);
+				if (mesh)
+				{
+					writeNodeUniforms(node, *mesh, skins.get(node.skin), nodes, nullptr);
+				}
+			});
+			updated = std::chrono::high_resolution_clock::now();
+			registryDraws.clear();
+			nodes.forEach([&](NodeHandle, const Node& node)
+			{
+				const Mesh* mesh = meshes.get(node.mesh);
+				if (mesh)
+				{
+					for (const Primitive& primitive : mesh->primitives)
+					{
+						const Material& material = materials[primitive.material];
+						if (material.alphaMode == Material::ALPHA_MODE_OPAQUE)
+						{
+							registryDraws.push_back({ material.descriptorSet, primitive.indexCount, primitive.firstIndex });
+						}
+					}
+				}
+			});
+			drawn = std::chrono::high_resolution_clock::now();
+			updateMs = std::chrono::duration<double, std::milli>(updated - start).count();
+			drawMs = std::chrono::duration<double, std::milli>(drawn - updated).count();
+			registryUpdateMs = (run == 0) ? updateMs : std::min(registryUpdateMs, updateMs);
+			registryDrawMs = (run == 0) ? drawMs : std::min(registryDrawMs, drawMs);
+		}//for run
+
+		float maxDifference = 0.0f;
+		for (uint32_t m = 0; m < meshCount; m++)
+		{
+			for (int column = 0; column < 4; column++)
+			{
+				glm::vec4 difference = glm::abs(pointerUniforms[m][column] - registryUniforms[m][column]);
+				maxDifference = std::max(maxDifference, std::max(std::max(difference.x, difference.y), std::max(difference.z, difference.w)));
+			}
+		}
+		bool sameDraws = (pointerDraws.size() == registryDraws.size());
+		for (size_t i = 0; sameDraws && (i < pointerDraws.size()); i++)
+		{
+			sameDraws = (pointerDraws[i].materialSet == registryDraws[i].materialSet) && (pointerDraws[i].firstIndex == registryDraws[i].firstIndex);
+		}
+
+		for (PointerNode* root : pointerRoots)
+		{
+			delete root;
+		}
 
-	for (auto& child:node->children)
+		std::ios_base::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+		out << "Scene traversal benchmark, " << generated.size() << " nodes, " << roots.size() << " roots, " << meshCount << " meshes, "
+			<< primitiveCount << " primitives, best of " << benchmarkRuns << " runs\n";
+		out << std::fixed << std::setprecision(3);
+		out << "  " << std::left << std::setw(18) << "" << std::right << std::setw(12) << "pointers" << std::setw(12) << "registry" << "\n";
+		out << "  " << std::left << std::setw(18) << "update (ms)" << std::right << std::setw(12) << pointerUpdateMs << std::setw(12) << registryUpdateMs << "\n";
+		out << "  " << std::left << std::setw(18) << "draw (ms)" << std::right << std::setw(12) << pointerDrawMs << std::setw(12) << registryDrawMs << "\n";
+		out << "  " << std::left << std::setw(18) << "draws" << std::right << std::setw(12) << pointerDraws.size() << std::setw(12) << registryDraws.size() << "\n";
+		out << std::scientific << std::setprecision(2);
+		out << "  largest matrix difference " << maxDifference << ", draw order " << (sameDraws ? "matches" : "DIFFERS") << "\n";
+		out.flags(flags);
+		out.precision(precision);
+	}
+	/**
+	* Render a grid of textured spheres twice with the same model: drawPulled with no vertex input, where the node matrices and
+	* materials are read through device addresses in the push constants, and vertex input draws that bind the vertex buffer and
+	* the uniform buffer set of every node. Reports the CPU time of recording, the GPU time and the binds per frame of both paths,
+	* and compares the last frame of both pixel by pixel
+	*
+	* @param device Device with buffer device addresses enabled, the benchmark reports and returns without them
+	* @param queue Graphics queue the frames are submitted to
+	* @param shadersPath Path of the SPIR-V shaders
+	* @param out Stream the results are written to
+	* @param frames Frames rendered per path
+	*/
+	void benchmarkVertexPulling(vks::VulkanDevice* device, VkQueue queue, const std::string& shadersPath, std::ostream& out, uint32_t frames)
 	{
-		prepareNodeDescriptor(child, descriptorSetLayout);
+		const std::string fileName = "pulling_benchmark.gltf";
+		const std::string binaryName = "pulling_benchmark.bin";
+		const uint32_t gridSize = 24;
+		const uint32_t rings = 16;
+		const uint32_t segments = 32;
+		const uint32_t width = 1920;
+		const uint32_t height = 1080;
+		const VkFormat colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+		VkDevice logicalDevice = device->logicalDevice;
+
+		if (!device->bufferDeviceAddress.enabled)
+		{
+			out << "Vertex pulling: buffer device addresses are not enabled, run with --bufferdeviceaddress on a device that supports them\n";
+			return;
+		}
+		if (!writePullingModel(fileName, binaryName, rings, segments, gridSize, 2.5f))
+		{
+			out << "Could not write " << fileName << " to the working directory\n";
+			return;
+		}
+		Model model;
+		model.loadFromFile(fileName, device, queue, FileLoadingFlags::BufferDeviceAddresses);
+		std::remove(fileName.c_str());
+		std::remove(binaryName.c_str());
+		if (!model.addresses.enabled)
+		{
+			out << "Vertex pulling: the model has no device addresses\n";
+			return;
+		}
+		model.updateNodes();
+
+		VkFormat depthFormat;
+		VkBool32 validFormat = vks::tools::getSupportedDepthFormat(device->physicalDevice, &depthFormat);
+		assert(validFormat);
+		std::array<VkAttachmentDescription, 2> attachments{};
+		attachments[0].format = colorFormat;
+		attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachments[0].finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		attachments[1] = attachments[0];
+		attachments[1].format = depthFormat;
+		attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		VkAttachmentReference depthReference = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = &colorReference;
+		subpass.pDepthStencilAttachment = &depthReference;
+		// The color target is copied to the host after the last frame of each path
+		std::array<VkSubpassDependency, 2> dependencies{};
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].srcAccessMask = 0;
+		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		VkRenderPassCreateInfo renderPassInfo = vks::initializers::GenRenderPassCreateInfo();
+		renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		renderPassInfo.pAttachments = attachments.data();
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpass;
+		renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		renderPassInfo.pDependencies = dependencies.data();
+		VkRenderPass renderPass;
+		VK_CHECK_RESULT(vkCreateRenderPass(logicalDevice, &renderPassInfo, nullptr, &renderPass));
+
+		std::array<VkImage, 2> images;
+		std::array<VkDeviceMemory, 2> memories;
+		std::array<VkImageView, 2> views;
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			VkImageCreateInfo imageInfo = vks::initializers::GenImageCreateInfo();
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.format = attachments[i].format;
+			imageInfo.extent = { width, height, 1 };
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.usage = (i == 0) ? VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT : VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+			VK_CHECK_RESULT(vkCreateImage(logicalDevice, &imageInfo, nullptr, &images[i]));
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(logicalDevice, images[i], &memReqs);
+			VkMemoryAllocateInfo memAlloc = vks::initializers::GenMemoryAllocateInfo();
+			memAlloc.allocationSize = memReqs.size;
+			memAlloc.memoryTypeIndex = device->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &memories[i]));
+			VK_CHECK_RESULT(vkBindImageMemory(logicalDevice, images[i], memories[i], 0));
+			VkImageViewCreateInfo viewInfo = vks::initializers::GenImageViewCreateInfo();
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = attachments[i].format;
+			viewInfo.subresourceRange = { static_cast<VkImageAspectFlags>((i == 0) ? VK_IMAGE_ASPECT_COLOR_BIT : VK_IMAGE_ASPECT_DEPTH_BIT), 0, 1, 0, 1 };
+			viewInfo.image = images[i];
+			VK_CHECK_RESULT(vkCreateImageView(logicalDevice, &viewInfo, nullptr, &views[i]));
+		}//for
+		VkFramebufferCreateInfo frameBufferInfo = vks::initializers::GenFrameBufferCreateInfo();
+		frameBufferInfo.renderPass = renderPass;
+		frameBufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+		frameBufferInfo.pAttachments = views.data();
+		frameBufferInfo.width = width;
+		frameBufferInfo.height = height;
+		frameBufferInfo.layers = 1;
+		VkFramebuffer frameBuffer;
+		VK_CHECK_RESULT(vkCreateFramebuffer(logicalDevice, &frameBufferInfo, nullptr, &frameBuffer));
+
+		// Camera uniform block shared by both paths at set 0
+		struct SceneBlock
+		{
+			glm::mat4 projection;
+			glm::mat4 view;
+		} sceneBlock;
+		sceneBlock.projection = glm::perspective(glm::radians(60.0f), static_cast<float>(width) / static_cast<float>(height), 0.1f, 256.0f);
+		sceneBlock.view = glm::lookAt(glm::vec3(0.0f, 32.0f, 48.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		vks::Buffer sceneBuffer;
+		VK_CHECK_RESULT(device->CreateHostBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, vks::HostAccess::Upload, &sceneBuffer, sizeof(SceneBlock)));
+		sceneBuffer.copyFromData(&sceneBlock, sizeof(SceneBlock));
+		sceneBuffer.flush();
+
+		std::vector<VkDescriptorPoolSize> poolSizes = { vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1) };
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::GenDescriptorPoolCreateInfo(poolSizes, 1);
+		VkDescriptorPool descriptorPool;
+		VK_CHECK_RESULT(vkCreateDescriptorPool(logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = { vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0) };
+		VkDescriptorSetLayoutCreateInfo layoutInfo = vks::initializers::GenDescriptorSetLayoutCreateInfo(setLayoutBindings);
+		VkDescriptorSetLayout sceneSetLayout;
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &sceneSetLayout));
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &sceneSetLayout, 1);
+		VkDescriptorSet sceneSet;
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(logicalDevice, &allocInfo, &sceneSet));
+		VkWriteDescriptorSet writeDescriptorSet = vks::initializers::GenWriteDescriptorSet(sceneSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &sceneBuffer.descriptorBufferInfo);
+		vkUpdateDescriptorSets(logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+
+		// Pulled: scene and material images, everything else comes with the push constants. Vertex input: scene, material images and node
+		const VkShaderStageFlags pushStages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		VkPushConstantRange pushConstantRange = vks::initializers::GenPushConstantRange(pushStages, sizeof(PullPushConstants), 0);
+		const std::array<VkDescriptorSetLayout, 3> setLayouts = { sceneSetLayout, descriptorSetLayoutImage, descriptorSetLayoutUbo };
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = vks::initializers::GenPipelineLayoutCreateInfo(setLayouts.data(), 2);
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		VkPipelineLayout pulledLayout;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &pulledLayout));
+		pipelineLayoutInfo = vks::initializers::GenPipelineLayoutCreateInfo(setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
+		VkPipelineLayout vertexInputLayout;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &vertexInputLayout));
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::GenPipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
+		VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::GenPipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
+		VkPipelineColorBlendAttachmentState blendAttachmentState = vks::initializers::GenPipelineColorBlendAttachmentState(0xf, VK_FALSE);
+		VkPipelineColorBlendStateCreateInfo colorBlendState = vks::initializers::GenPipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
+		VkPipelineDepthStencilStateCreateInfo depthStencilState = vks::initializers::GenPipelineDepthStencilStateCreateInfo(VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL);
+		VkPipelineViewportStateCreateInfo viewportState = vks::initializers::GenPipelineViewportStateCreateInfo(1, 1, 0);
+		VkPipelineMultisampleStateCreateInfo multisampleState = vks::initializers::GenPipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT, 0);
+		std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamicState = vks::initializers::GenPipelineDynamicStateCreateInfo(dynamicStateEnables);
+		VkPipelineVertexInputStateCreateInfo emptyInputState = vks::initializers::GenPipelineVertexInputStateCreateInfo();
+		VkGraphicsPipelineCreateInfo pipelineCreateInfo = vks::initializers::GenPipelineCreateInfo(pulledLayout, renderPass, 0);
+		pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
+		pipelineCreateInfo.pRasterizationState = &rasterizationState;
+		pipelineCreateInfo.pColorBlendState = &colorBlendState;
+		pipelineCreateInfo.pMultisampleState = &multisampleState;
+		pipelineCreateInfo.pViewportState = &viewportState;
+		pipelineCreateInfo.pDepthStencilState = &depthStencilState;
+		pipelineCreateInfo.pDynamicState = &dynamicState;
+		pipelineCreateInfo.pVertexInputState = &emptyInputState;
+		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages =
+		{
+			vks::tools::loadShaderStage(shadersPath + "base/gltfpulled.vert.spv", VK_SHADER_STAGE_VERTEX_BIT, logicalDevice),
+			vks::tools::loadShaderStage(shadersPath + "base/gltfpulled.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT, logicalDevice),
+		};
+		pipelineCreateInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+		pipelineCreateInfo.pStages = shaderStages.data();
+		VkPipeline pulledPipeline;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pulledPipeline));
+		for (const VkPipelineShaderStageCreateInfo& stage : shaderStages)
+		{
+			vkDestroyShaderModule(logicalDevice, stage.module, nullptr);
+		}
+		shaderStages =
+		{
+			vks::tools::loadShaderStage(shadersPath + "base/gltfvertexinput.vert.spv", VK_SHADER_STAGE_VERTEX_BIT, logicalDevice),
+			vks::tools::loadShaderStage(shadersPath + "base/gltfvertexinput.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT, logicalDevice),
+		};
+		pipelineCreateInfo.layout = vertexInputLayout;
+		pipelineCreateInfo.pVertexInputState = Vertex::getPipelineVertexInputState({ VertexComponent::Position, VertexComponent::Normal, VertexComponent::UV, VertexComponent::Color });
+		VkPipeline vertexInputPipeline;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &vertexInputPipeline));
+		for (const VkPipelineShaderStageCreateInfo& stage : shaderStages)
+		{
+			vkDestroyShaderModule(logicalDevice, stage.module, nullptr);
+		}
+
+		struct Result
+		{
+			const char* name;
+			double recordMs = 0.0;
+			double gpuMs = 0.0;
+			uint32_t descriptorBinds = 0;
+			uint32_t vertexBufferBinds = 0;
+			uint32_t pushConstants = 0;
+			uint32_t draws = 0;
+			vks::Buffer readback;
+		};
+		std::array<Result, 2> results;
+		results[0].name = "vertex input";
+		results[1].name = "pulled";
+		const VkDeviceSize imageBytes = static_cast<VkDeviceSize>(width) * height * 4;
+		vks::GpuTimer gpuTimer;
+		gpuTimer.create(device, 1);
+		for (uint32_t path = 0; path < static_cast<uint32_t>(results.size()); path++)
+		{
+			Result& result = results[path];
+			const bool pulled = (path == 1);
+			VK_CHECK_RESULT(device->CreateHostBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, vks::HostAccess::Readback, &result.readback, imageBytes));
+			for (uint32_t frame = 0; frame < frames; frame++)
+			{
+				VkCommandBuffer commandBuffer = device->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+				gpuTimer.reset(commandBuffer);
+				uint32_t scope = gpuTimer.beginScope(commandBuffer, "Scene");
+				std::array<VkClearValue, 2> clearValues{};
+				clearValues[0].color = { { 0.1f, 0.1f, 0.1f, 1.0f } };
+				clearValues[1].depthStencil = { 1.0f, 0 };
+				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::GenRenderPassBeginInfo();
+				renderPassBeginInfo.renderPass = renderPass;
+				renderPassBeginInfo.framebuffer = frameBuffer;
+				renderPassBeginInfo.renderArea.extent = { width, height };
+				renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+				renderPassBeginInfo.pClearValues = clearValues.data();
+				vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+				VkViewport viewport = vks::initializers::GenViewport(static_cast<float>(width), static_cast<float>(height), 0.0f, 1.0f);
+				VkRect2D scissor = vks::initializers::GenRect2D(width, height, 0, 0);
+				vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+				vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+				// Only the draws of the scene are timed on the CPU
+				auto start = std::chrono::high_resolution_clock::now();
+				uint32_t descriptorBinds = 1;
+				uint32_t vertexBufferBinds = 0;
+				uint32_t pushConstants = 0;
+				uint32_t draws = 0;
+				if (pulled)
+				{
+					vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pulledPipeline);
+					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pulledLayout, 0, 1, &sceneSet, 0, nullptr);
+					model.drawPulled(commandBuffer, RenderFlags::BindImages, pulledLayout, 1, pushStages);
+				}
+				else
+				{
+					vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vertexInputPipeline);
+					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vertexInputLayout, 0, 1, &sceneSet, 0, nullptr);
+					const VkDeviceSize offsets[1] = { 0 };
+					vkCmdBindVertexBuffers(commandBuffer, 0, 1, &model.vertices.buffer, offsets);
+					vkCmdBindIndexBuffer(commandBuffer, model.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+					vertexBufferBinds = 1;
+					model.nodes.forEach([&](NodeHandle, const Node& node)
+					{
+						const Mesh* mesh = model.meshes.get(node.mesh);
+						if (mesh)
+						{
+							vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vertexInputLayout, 2, 1, &mesh->uniformBuffer.descriptorSet, 0, nullptr);
+							model.drawNode(node, commandBuffer, RenderFlags::BindImages, vertexInputLayout, 1);
+						}
+					});
+				}
+				auto recorded = std::chrono::high_resolution_clock::now();
+				// Counted outside of the timed recording, both paths bind the material images of every primitive
+				model.nodes.forEach([&](NodeHandle, const Node& node)
+				{
+					const Mesh* mesh = model.meshes.get(node.mesh);
+					if (mesh)
+					{
+						const uint32_t primitives = static_cast<uint32_t>(mesh->primitives.size());
+						descriptorBinds += primitives + (pulled ? 0 : 1);
+						pushConstants += pulled ? primitives : 0;
+						draws += primitives;
+					}
+				});
+
+				vkCmdEndRenderPass(commandBuffer);
+				gpuTimer.endScope(commandBuffer, scope);
+				if (frame == frames - 1)
+				{
+					VkBufferImageCopy copyRegion{};
+					copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+					copyRegion.imageExtent = { width, height, 1 };
+					vkCmdCopyImageToBuffer(commandBuffer, images[0], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, result.readback.buffer, 1, &copyRegion);
+					VkMemoryBarrier hostBarrier = vks::initializers::GenMemoryBarrier();
+					hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+					hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+					vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+				}
+				device->FlushCommandBuffer(commandBuffer, queue, true);
+				gpuTimer.collect(true);
+
+				result.recordMs += std::chrono::duration<double, std::milli>(recorded - start).count();
+				result.gpuMs += gpuTimer.getMilliseconds("Scene");
+				result.descriptorBinds = descriptorBinds;
+				result.vertexBufferBinds = vertexBufferBinds;
+				result.pushConstants = pushConstants;
+				result.draws = draws;
+			}//for frame
+			result.readback.invalidate();
+		}//for path
+		gpuTimer.destroy();
+
+		// Both paths run the same vertex and fragment math, only rounding of the attribute fetch may differ
+		const uint8_t* vertexInputPixels = static_cast<const uint8_t*>(results[0].readback.mappedData);
+		const uint8_t* pulledPixels = static_cast<const uint8_t*>(results[1].readback.mappedData);
+		uint32_t differingPixels = 0;
+		for (VkDeviceSize pixel = 0; pixel < static_cast<VkDeviceSize>(width) * height; pixel++)
+		{
+			for (uint32_t channel = 0; channel < 4; channel++)
+			{
+				if (std::abs(static_cast<int>(vertexInputPixels[pixel * 4 + channel]) - static_cast<int>(pulledPixels[pixel * 4 + channel])) > 1)
+				{
+					differingPixels++;
+					break;
+				}
+			}
+		}//for
+
+		std::ios_base::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+		out << "Vertex pulling: " << frames << " frames per path at " << width << " x " << height << ", " << gridSize * gridSize << " nodes of a "
+			<< (rings + 1) * (segments + 1) << " vertex sphere\n";
+		out << std::fixed << std::setprecision(3);
+		out << "  " << std::left << std::setw(14) << "path" << std::right << std::setw(12) << "record ms" << std::setw(10) << "GPU ms" << std::setw(8) << "draws"
+			<< std::setw(14) << "set binds" << std::setw(14) << "vertex binds" << std::setw(14) << "push consts" << "\n";
+		for (const Result& result : results)
+		{
+			out << "  " << std::left << std::setw(14) << result.name << std::right << std::setw(12) << result.recordMs / frames << std::setw(10)
+				<< result.gpuMs / frames << std::setw(8) << result.draws << std::setw(14) << result.descriptorBinds << std::setw(14)
+				<< result.vertexBufferBinds << std::setw(14) << result.pushConstants << "\n";
+		}
+		out << "  last frames compared: " << differingPixels << " pixels differ by more than 1 in a channel\n";
+		out.flags(flags);
+		out.precision(precision);
+
+		for (Result& result : results)
+		{
+			result.readback.destroy();
+		}
+		vkDestroyPipeline(logicalDevice, pulledPipeline, nullptr);
+		vkDestroyPipeline(logicalDevice, vertexInputPipeline, nullptr);
+		vkDestroyPipelineLayout(logicalDevice, pulledLayout, nullptr);
+		vkDestroyPipelineLayout(logicalDevice, vertexInputLayout, nullptr);
+		vkDestroyDescriptorSetLayout(logicalDevice, sceneSetLayout, nullptr);
+		vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+		sceneBuffer.destroy();
+		vkDestroyFramebuffer(logicalDevice, frameBuffer, nullptr);
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			vkDestroyImageView(logicalDevice, views[i], nullptr);
+			vkDestroyImage(logicalDevice, images[i], nullptr);
+			vkFreeMemory(logicalDevice, memories[i], nullptr);
+		}
+		vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
 	}
-}
+}//vkglTF
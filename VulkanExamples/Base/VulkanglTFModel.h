@@ -18,10 +18,15 @@
 #include <stdlib.h>
 #include <string>
 #include <fstream>
+#include <memory>
+#include <ostream>
 #include <vector>
 
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.h"
+#include "VulkanRenderQueue.h"
+#include "VulkanGeometryPool.h"
+#include "VulkanglTFRegistry.hpp"
 
 #include <ktx.h>
 #include <ktxvulkan.h>
@@ -57,23 +62,35 @@ namespace vkglTF
 	extern uint32_t descriptorBindingFlags;
 
 	struct Node;
-	
+	struct Mesh;
+	struct Skin;
+	struct Texture;
+	struct Material;
+
+	typedef Handle<Node> NodeHandle;
+	typedef Handle<Mesh> MeshHandle;
+	typedef Handle<Skin> SkinHandle;
+	typedef Handle<Texture> TextureHandle;
+	typedef Handle<Material> MaterialHandle;
+
 	/*
 		glTF texture loading class
 	*/
 	struct Texture
 	{
 		vks::VulkanDevice* device = nullptr;
-		VkImage image;
+		VkImage image = VK_NULL_HANDLE;
 		VkImageLayout imageLayout;
-		VkDeviceMemory deviceMemory;
-		VkImageView view;
+		VkDeviceMemory deviceMemory = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
 		uint32_t width, height;
 		uint32_t mipLevels;
 		uint32_t layerCount;
 		VkDescriptorImageInfo descriptorImageInfo;
-		VkSampler sampler;
+		VkSampler sampler = VK_NULL_HANDLE;
 		uint32_t index;
+		/** @brief Device memory of the image, zero for textures that were not loaded */
+		VkDeviceSize memorySize = 0;
 		void updateDescriptor();
 
 		void destroy();
@@ -99,31 +116,33 @@ namespace vkglTF
 		float metallicFactor = 1.0f;
 		float roughnessFactor = 1.0f;
 		glm::vec4 baseColorFactor = glm::vec4(1.0f);
-		vkglTF::Texture* baseColorTexture = nullptr;
-		vkglTF::Texture* metallicRoughnessTexture = nullptr;
-		vkglTF::Texture* normalTexture = nullptr;
-		vkglTF::Texture* occlusionTexture = nullptr;
-		vkglTF::Texture* emissiveTexture = nullptr;
+		vkglTF::TextureHandle baseColorTexture;
+		vkglTF::TextureHandle metallicRoughnessTexture;
+		vkglTF::TextureHandle normalTexture;
+		vkglTF::TextureHandle occlusionTexture;
+		vkglTF::TextureHandle emissiveTexture;
 
-		vkglTF::Texture* specularGlossinessTexture;
-		vkglTF::Texture* diffuseTexture;
+		vkglTF::TextureHandle specularGlossinessTexture;
+		vkglTF::TextureHandle diffuseTexture;
 
 		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
 
-		Material(vks::VulkanDevice* curDevice) :device(curDevice)
+		Material(vks::VulkanDevice* curDevice = nullptr) :device(curDevice)
 		{
 		};
 
-		void createDescriptorSet(VkDescriptorPool descriptorPool, VkDescriptorSetLayout descriptorSetLayout, uint32_t descriptorBindingFlags);
+		/** @param textures Registry the texture handles of the material refer to */
+		void createDescriptorSet(VkDescriptorPool descriptorPool, VkDescriptorSetLayout descriptorSetLayout, uint32_t descriptorBindingFlags,
+			const Registry<Texture>& textures);
 	};
 
 	struct Primitive
 	{
 		uint32_t firstIndex;
 		uint32_t indexCount;
-		uint32_t firstVertex;
-		uint32_t vertexCount;
-		Material& material;
+		uint32_t firstVertex = 0;
+		uint32_t vertexCount = 0;
+		MaterialHandle material;
 
 		struct Dimensions
 		{
@@ -136,7 +155,7 @@ namespace vkglTF
 
 		void setDimensions(glm::vec3 min, glm::vec3 max);
 
-		Primitive(uint32_t tempFirstIndex, uint32_t tempIndexCount, Material& tempMaterial) :firstIndex(tempFirstIndex), indexCount(tempIndexCount), material(tempMaterial)
+		Primitive(uint32_t tempFirstIndex, uint32_t tempIndexCount, MaterialHandle tempMaterial) :firstIndex(tempFirstIndex), indexCount(tempIndexCount), material(tempMaterial)
 		{};
 	};
 
@@ -145,37 +164,47 @@ namespace vkglTF
 	*/
 	struct Mesh
 	{
-		vks::VulkanDevice* device;
+		vks::VulkanDevice* device = nullptr;
 
-		std::vector<Primitive*> primitives;
+		std::vector<Primitive> primitives;
 		std::string name;
 
 		struct UniformBuffer
 		{
-			VkBuffer buffer;
-			VkDeviceMemory memory;
-			VkDescriptorBufferInfo descriptorBufferInfo;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDescriptorBufferInfo descriptorBufferInfo{};
 			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
-			void* mapped;
+			void* mapped = nullptr;
+			VkDeviceSize size = 0;
+			/** @brief Device address of the uniform block, 0 unless the model was loaded with FileLoadingFlags::BufferDeviceAddresses */
+			VkDeviceAddress address = 0;
+			/** @brief False if writes through mapped have to be flushed */
+			bool coherent = true;
 		}uniformBuffer;
 
 		struct UniformBlock
 		{
-			glm::mat4 matrix;
+			glm::mat4 matrix = glm::mat4(1.0f);
 			glm::mat4 jointMatrix[64]{};
 			float jointCount{ 0 };
 		}uniformBlock;
 
-		Mesh(vks::VulkanDevice* device, glm::mat4 matrix);
-		~Mesh();
+		/** @param usageFlags Additional usage of the uniform buffer, e.g. VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT */
+		void create(vks::VulkanDevice* device, glm::mat4 matrix, VkBufferUsageFlags usageFlags = 0);
+		/** @brief Meshes are values in the model's registry, the uniform buffer is destroyed explicitly like a texture's image */
+		void destroy();
+
+		/** @brief Makes the first size bytes written through uniformBuffer.mapped visible, recorded in dirtyRanges if given and flushed right away otherwise */
+		void flushUniformBlock(VkDeviceSize size, vks::MappedRangeTracker* dirtyRanges);
 	};//mesh
 
 	struct Skin
 	{
 		std::string name;
-		Node* skeletonRoot = nullptr;
+		NodeHandle skeletonRoot;
 		std::vector<glm::mat4> inverseBindMatrices;
-		std::vector<Node*> joints;
+		std::vector<NodeHandle> joints;
 	};
 
 	/*
@@ -183,22 +212,22 @@ namespace vkglTF
 	*/
 	struct Node
 	{
-		Node* parent;
-		uint32_t index;
-		std::vector<Node*> children;
-		glm::mat4 matrix;
+		NodeHandle parent;
+		/** @brief Index of the node in the glTF file */
+		uint32_t index = 0;
+		std::vector<NodeHandle> children;
+		glm::mat4 matrix = glm::mat4(1.0f);
 		std::string name;
-		Mesh* mesh;
-		Skin* skin;
+		MeshHandle mesh;
+		SkinHandle skin;
 		int32_t skinIndex = -1;
 		glm::vec3 translation{};
 		glm::vec3 scale{ 1.0f };
 		glm::quat rotation{};
+		/** @brief Local matrix combined with those of the parents, written by Model::updateNodes */
+		glm::mat4 worldMatrix = glm::mat4(1.0f);
 
-		glm::mat4 localMatrix();
-		glm::mat4 getMatrix();
-		void update();
-		~Node();
+		glm::mat4 localMatrix() const;
 	};
 
 	/*
@@ -213,7 +242,7 @@ namespace vkglTF
 			SCALE
 		};
 		PathType path;
-		Node* node;
+		NodeHandle node;
 		uint32_t samplerIndex;
 	};
 
@@ -287,7 +316,16 @@ namespace vkglTF
 		PreTransformVertices = 0x00000001,
 		PreMultiplyVertexColors = 0x00000002,
 		FlipY = 0x00000004,
-		DontLoadImages = 0x00000008
+		DontLoadImages = 0x00000008,
+		/** @brief Combines small primitives of the same material into one draw, only applied together with PreTransformVertices to models without skins and animations */
+		MergeStaticPrimitives = 0x00000010,
+		/**
+		* @brief Vertices, indices, materials and mesh uniform blocks get device addresses for Model::drawPulled, ignored if the device has
+		* no buffer device addresses enabled. A geometry pool must be created with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+		*/
+		BufferDeviceAddresses = 0x00000020,
+		/** @brief Vertices and indices stay on the host after the upload in Model::hostGeometry, e.g. to build a BVH over the triangles */
+		KeepHostGeometry = 0x00000040
 	};
 
 	enum RenderFlags
@@ -298,43 +336,104 @@ namespace vkglTF
 		RenderAlphaBlendedNodes = 0x00000008
 	};
 
+	/*
+	Pipelines per alpha mode for Model::enqueue, primitives of a mode without a pipeline are skipped
+	*/
+	struct QueuePipelines
+	{
+		VkPipeline opaque = VK_NULL_HANDLE;
+		VkPipeline alphaMask = VK_NULL_HANDLE;
+		VkPipeline alphaBlend = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		/** @brief Set index of the material images, only bound with RenderFlags::BindImages */
+		uint32_t bindImageSet = 1;
+		/** @brief Set index of the per mesh uniform buffer, ~0u to not bind it */
+		uint32_t bindMeshSet = ~0u;
+	};
+
+	/*
+	Push constants of Model::drawPulled, matches PullPushConstants in shaders/glsl/base/vertexpulling.glsl
+	*/
+	struct PullPushConstants
+	{
+		VkDeviceAddress vertices = 0;
+		VkDeviceAddress materials = 0;
+		/** @brief Uniform block of the mesh (Mesh::UniformBlock) */
+		VkDeviceAddress node = 0;
+		/** @brief Vertex stride in floats, the vertex shader decodes the vertices with it and the attribute offsets */
+		uint32_t vertexStride = 0;
+		uint32_t materialIndex = 0;
+		/** @brief Offsets in floats, 8 bits each: position, normal, uv, color in the first word and tangent, joint0, weight0 in the second */
+		uint32_t attributeOffsets[2] = { 0, 0 };
+	};
+
 	/*
 	glTF model loading and rendering class
 	*/
 	class Model
 	{
 	private:
-		vkglTF::Texture* getTexture(uint32_t index);
-		vkglTF::Texture emptyTexture;
+		vkglTF::TextureHandle getTexture(uint32_t index);
+		/** @brief 1x1 texture for material images the file does not provide, part of textures */
+		vkglTF::TextureHandle emptyTexture;
+		/** @brief Material of primitives without one, the last material */
+		vkglTF::MaterialHandle defaultMaterial;
+		/** @brief Node of every glTF node index, for resolving skins and animation channels while loading */
+		std::vector<NodeHandle> nodeLookup;
 
 		void createEmptyTexture(VkQueue transferQueue);
 
+		/** @brief What parseFile leaves for upload, released once the model is uploaded */
+		struct PendingUpload
+		{
+			std::string filename;
+			uint32_t fileLoadingFlags = 0;
+			std::vector<tinygltf::Image> images;
+			std::vector<bool> skipImage;
+			uint32_t nextImage = 0;
+			bool emptyTextureCreated = false;
+			std::vector<uint32_t> indexBuffer;
+			std::vector<Vertex> vertexBuffer;
+			bool geometryUploaded = false;
+		};
+		std::unique_ptr<PendingUpload> pending;
+
+		void uploadImage(uint32_t index, VkQueue transferQueue);
+		void uploadGeometry(VkQueue transferQueue);
+		void finishUpload(VkQueue transferQueue);
+
 	public:
 
-		vks::VulkanDevice* device;
-		VkDescriptorPool descriptorPool;
+		vks::VulkanDevice* device = nullptr;
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
 
 		struct Vertices
 		{
-			int count;
-			VkBuffer buffer;
-			VkDeviceMemory memory;
+			int count = 0;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
 		}vertices;
 
 		struct Indices 
 		{
-			int count;
-			VkBuffer buffer;
-			VkDeviceMemory memory;
+			int count = 0;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
 		}indices;
 
-		std::vector<Node*>nodes;
-		std::vector<Node*>linearNodes;
-
-		std::vector<Skin*> skins;
-
-		std::vector<Texture> textures;
-		std::vector<Material>materials;
+		/**
+		* @brief All nodes, parents are added before their children so a scan in slot order visits a parent first. Objects refer to each other
+		* through handles into these registries, so each type is stored contiguously and updates and draws scan them linearly
+		*/
+		Registry<Node> nodes;
+		/** @brief Nodes without a parent */
+		std::vector<NodeHandle> rootNodes;
+		Registry<Mesh> meshes;
+		Registry<Skin> skins;
+		/** @brief One texture per glTF image in image order, followed by the empty texture */
+		Registry<Texture> textures;
+		/** @brief One material per glTF material in material order, followed by the default material */
+		Registry<Material> materials;
 		std::vector<Animation> animations;
 
 		struct Dimensions 
@@ -348,45 +447,144 @@ namespace vkglTF
 
 		bool metallicRoughnessWorkflow = true;
 		bool buffersBound = false;
+		struct LoadStatistics
+		{
+			double loadMs = 0.0;
+			/** @brief Time spent decoding EXT_meshopt_compression buffer views, part of loadMs */
+			double decodeMs = 0.0;
+			uint32_t compressedViews = 0;
+			/** @brief Size of the compressed buffer views and what they decode to */
+			uint64_t compressedBytes = 0;
+			uint64_t decodedBytes = 0;
+			/** @brief Size of the vertex attributes as stored in the file and as 32 bit floats */
+			uint64_t attributeBytes = 0;
+			uint64_t floatAttributeBytes = 0;
+			/** @brief Time spent creating textures (decoding, transcoding and uploading), part of loadMs */
+			double textureMs = 0.0;
+			uint32_t textureCount = 0;
+			uint32_t ktx2Textures = 0;
+			/** @brief Device memory of all textures, compares block compressed KTX2 against RGBA8 images */
+			uint64_t textureBytes = 0;
+			/** @brief Small primitives combined by FileLoadingFlags::MergeStaticPrimitives and the draws they became */
+			uint32_t mergedPrimitives = 0;
+			uint32_t mergedDraws = 0;
+		} loadStatistics;
+
+		/** @brief Device addresses of the model's buffers, set on load with FileLoadingFlags::BufferDeviceAddresses */
+		struct DeviceAddresses
+		{
+			bool enabled = false;
+			VkDeviceAddress vertices = 0;
+			VkDeviceAddress indices = 0;
+			VkDeviceAddress materials = 0;
+		} addresses;
+		/** @brief Factors of all materials in the order of materials, only created for device address access */
+		vks::Buffer materialBuffer;
+
+		/** @brief Mesh uniform blocks written by an update, flushed together once all nodes are updated */
+		vks::MappedRangeTracker uniformRanges;
+
+		/** @brief If set before loading, the geometry is sub-allocated from the pool instead of the model's own buffers */
+		vks::GeometryPool* geometryPool = nullptr;
+		/** @brief Ranges of the model in the geometry pool, primitives' first index and vertex already include the offsets */
+		vks::GeometryPool::Allocation geometry;
 		std::string path;
+		/** @brief Kept with FileLoadingFlags::KeepHostGeometry, the indices refer to vertices without geometry pool offsets */
+		struct HostGeometry
+		{
+			std::vector<Vertex> vertices;
+			std::vector<uint32_t> indices;
+			/** @brief Loaded with PreTransformVertices, the vertices are already in model space and node matrices must not be applied */
+			bool preTransformed = false;
+		} hostGeometry;
+		/** @brief Why parseFile failed */
+		std::string loadError;
 
 		Model() {};
 		~Model();
 
-		void loadNode(vkglTF::Node* parent, const tinygltf::Node& node, uint32_t nodeIndex, const tinygltf::Model& model,
+		void loadNode(NodeHandle parent, const tinygltf::Node& node, uint32_t nodeIndex, const tinygltf::Model& model,
 			std::vector<uint32_t>&indexBuffer, std::vector<Vertex>&vertexBuffer, float globalScale);
 
 		void loadSkins(tinygltf::Model& gltfModel);
 
-		void loadImages(tinygltf::Model& gltfModel, vks::VulkanDevice* device, VkQueue transferQueue);
+		void prepareImages(tinygltf::Model& gltfModel);
 
 		void loadMaterials(tinygltf::Model& gltfModel);
 
+		/** @brief Upload the factors of all materials for vertex pulling and take the addresses of the geometry */
+		void createAddressBuffers(VkQueue transferQueue);
+
 		void loadAnimations(tinygltf::Model& gltfModel);
 
+		/** @brief Rewrites the index buffer so small primitives of one material are contiguous and replaces them with merged primitives on a new root node */
+		void mergeStaticPrimitives(std::vector<uint32_t>& indexBuffer, const std::vector<Vertex>& vertexBuffer);
+
+		/** @brief parseFile and upload without a budget, blocks until the model can be drawn */
 		void loadFromFile(std::string filename, vks::VulkanDevice* device, VkQueue transferQueue,uint32_t fileLoadingFlags = vkglTF::FileLoadingFlags::None,float scale = 1.0f);
 
+		/** @brief CPU part of loading, records no commands and can run on a worker thread, followed by upload on the thread that owns the queue */
+		bool parseFile(std::string filename, vks::VulkanDevice* device, uint32_t fileLoadingFlags = vkglTF::FileLoadingFlags::None, float scale = 1.0f);
+
+		/** @brief Upload steps of a parsed model until budgetBytes is used up, true once the model can be drawn */
+		bool upload(VkQueue transferQueue, VkDeviceSize& budgetBytes);
+
+		/** @brief The model was parsed and everything is uploaded */
+		bool ready() const { return (device != nullptr) && !pending; }
+
 		void bindBuffers(VkCommandBuffer commandBuffer);
 
-		void drawNode(Node* node, VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
+		/** @brief Draws the primitives of one node, its children are not drawn */
+		void drawNode(const Node& node, VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
 
 		void draw(VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
 
-		void getNodeDimensions(Node*node, glm::vec3& min, glm::vec3& max);
+		void drawNodePulled(const Node& node, VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet,
+			VkShaderStageFlags stageFlags, PullPushConstants& pushConstants);
+
+		/**
+		* @brief Draw with vertex pulling, vertices, materials and node matrices are passed as device addresses in PullPushConstants
+		* @note Needs FileLoadingFlags::BufferDeviceAddresses, the pipeline has no vertex input and only the index buffer is bound
+		*/
+		void drawPulled(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet = 1,
+			VkShaderStageFlags stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+
+		/** @brief Adds a draw per visible primitive to a render queue instead of recording them in scene graph order, see vks::RenderQueue */
+		void enqueue(vks::RenderQueue& queue, const glm::mat4& view, const QueuePipelines& pipelines, uint32_t renderFlags = RenderFlags::BindImages);
+
+		void getNodeDimensions(NodeHandle node, glm::vec3& min, glm::vec3& max);
 
 		void getSceneDimensions();
 
 		void updateAnimation(uint32_t index, float time);
-		
-		Node*findNode(Node* parent, uint32_t index);
 
-		Node* nodeFromIndex(uint32_t index);
-		
-		void prepareNodeDescriptor(vkglTF::Node* node, VkDescriptorSetLayout descriptorSetLayout);
+		/** @brief Computes the world matrices of all nodes and writes them to their meshes' uniform buffers, see Mesh::flushUniformBlock for dirtyRanges */
+		void updateNodes(vks::MappedRangeTracker* dirtyRanges = nullptr);
+
+		/** @brief Node of a glTF node index, invalid if the node is not part of the loaded scene */
+		NodeHandle nodeFromIndex(uint32_t index);
+
+		/**
+		* @brief Removes a node, its children and their meshes, handles to them become invalid
+		* @note The meshes' uniform buffers and descriptor sets are released right away, so the node must not be in use by pending command buffers
+		*/
+		void removeNode(NodeHandle node);
+
+		void prepareMeshDescriptor(vkglTF::Mesh& mesh, VkDescriptorSetLayout descriptorSetLayout);
 
 	protected:
 	private:
 	};
 
+	/**
+	* @brief Compares updating and draw traversal of a generated scene stored as individually allocated nodes linked by pointers against
+	* the registries of Model, reports the time per pass
+	*/
+	void benchmarkTraversal(std::ostream& out, uint32_t nodeCount = 100000);
 
+	/**
+	* @brief Renders a grid of nodes with drawPulled and with vertex input draws binding the uniform buffer set of every node, reports the
+	* recording and GPU time and the binds per frame of both paths and compares their images. Needs buffer device addresses
+	*/
+	void benchmarkVertexPulling(vks::VulkanDevice* device, VkQueue queue, const std::string& shadersPath, std::ostream& out, uint32_t frames = 300);
 }
\ No newline at end of file
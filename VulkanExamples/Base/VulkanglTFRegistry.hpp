@@ -0,0 +1,169 @@
+/*
+* Generational handles for glTF scene objects
+*
+* Objects live in one contiguous array per type and refer to each other through handles (slot index plus generation)
+* instead of pointers, so they can be iterated linearly and a handle to a removed object is detected instead of dangling
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace vkglTF
+{
+	/** @brief Refers to an object in a Registry<T>, stays invalid once the object was removed even if its slot is reused */
+	template<typename T>
+	struct Handle
+	{
+		static const uint32_t invalidIndex = ~0u;
+
+		uint32_t index = invalidIndex;
+		uint32_t generation = 0;
+
+		/** @brief True if the handle was set, Registry::get tells if the object still exists */
+		bool valid() const { return index != invalidIndex; }
+		bool operator==(const Handle& other) const { return (index == other.index) && (generation == other.generation); }
+		bool operator!=(const Handle& other) const { return !(*this == other); }
+	};
+
+	/**
+	* @brief Objects of one type in a contiguous array of slots, removed slots are reused by later adds
+	* @note Slots are never moved, so iteration in slot order visits objects in the order they were added as long as nothing
+	* was removed. Pointers returned by get stay valid until the next add
+	*/
+	template<typename T>
+	class Registry
+	{
+	public:
+		Handle<T> add(T&& object)
+		{
+			Handle<T> handle;
+			if (!freeSlots.empty())
+			{
+				handle.index = freeSlots.back();
+				freeSlots.pop_back();
+				objects[handle.index] = std::move(object);
+			}
+			else
+			{
+				handle.index = static_cast<uint32_t>(objects.size());
+				objects.push_back(std::move(object));
+				generations.push_back(0);
+				occupied.push_back(false);
+			}
+			occupied[handle.index] = true;
+			handle.generation = generations[handle.index];
+			count++;
+			return handle;
+		}
+
+		/** @brief Invalidates all handles to the object, the object itself is reset to a default constructed one */
+		void remove(Handle<T> handle)
+		{
+			if (get(handle) == nullptr)
+			{
+				return;
+			}
+			objects[handle.index] = T();
+			occupied[handle.index] = false;
+			generations[handle.index]++;
+			freeSlots.push_back(handle.index);
+			count--;
+		}
+
+		/** @brief The object or nullptr if the handle is invalid or its object was removed */
+		T* get(Handle<T> handle)
+		{
+			return contains(handle) ? &objects[handle.index] : nullptr;
+		}
+
+		const T* get(Handle<T> handle) const
+		{
+			return contains(handle) ? &objects[handle.index] : nullptr;
+		}
+
+		bool contains(Handle<T> handle) const
+		{
+			return (handle.index < objects.size()) && occupied[handle.index] && (generations[handle.index] == handle.generation);
+		}
+
+		T& operator[](Handle<T> handle)
+		{
+			assert(contains(handle));
+			return objects[handle.index];
+		}
+
+		const T& operator[](Handle<T> handle) const
+		{
+			assert(contains(handle));
+			return objects[handle.index];
+		}
+
+		/** @brief Handle of the object in a slot, invalid for free slots */
+		Handle<T> handle(uint32_t slot) const
+		{
+			Handle<T> result;
+			if ((slot < objects.size()) && occupied[slot])
+			{
+				result.index = slot;
+				result.generation = generations[slot];
+			}
+			return result;
+		}
+
+		/** @brief Calls function(handle, object) for every object in slot order */
+		template<typename Function>
+		void forEach(Function function)
+		{
+			for (uint32_t slot = 0; slot < static_cast<uint32_t>(objects.size()); slot++)
+			{
+				if (occupied[slot])
+				{
+					Handle<T> handle;
+					handle.index = slot;
+					handle.generation = generations[slot];
+					function(handle, objects[slot]);
+				}
+			}//for
+		}
+
+		/** @brief Removes all objects, handles taken before stay invalid and the slots are reused in ascending order */
+		void clear()
+		{
+			freeSlots.clear();
+			for (uint32_t slot = static_cast<uint32_t>(objects.size()); slot-- > 0;)
+			{
+				if (occupied[slot])
+				{
+					objects[slot] = T();
+					occupied[slot] = false;
+					generations[slot]++;
+				}
+				freeSlots.push_back(slot);
+			}//for
+			count = 0;
+		}
+
+		/** @brief Number of objects */
+		size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+		/** @brief Number of slots including free ones, the bound for slot indices */
+		uint32_t slotCount() const { return static_cast<uint32_t>(objects.size()); }
+		bool slotOccupied(uint32_t index) const { return occupied[index]; }
+		/** @brief Object in a slot, only valid for occupied slots */
+		T& slot(uint32_t index) { return objects[index]; }
+		const T& slot(uint32_t index) const { return objects[index]; }
+
+	private:
+		std::vector<T> objects;
+		std::vector<uint32_t> generations;
+		std::vector<bool> occupied;
+		std::vector<uint32_t> freeSlots;
+		size_t count = 0;
+	};
+}//vkglTF
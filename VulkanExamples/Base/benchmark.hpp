@@ -9,6 +9,7 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <cmath>
 #include <limits>
 #include <functional>
 #include <chrono>
@@ -28,6 +29,8 @@ namespace vks
 		uint32_t duration = 10;
 		std::vector<double> frameTimes;
 		std::string filename = "";
+		// Describes the run, e.g. the thread pinning mode, so results of different configurations can be told apart
+		std::string configuration = "";
 
 		double runtime = 0.0;
 		uint32_t frameCount = 0;
@@ -69,7 +72,36 @@ namespace vks
 				std::cout << "runtime: " << (runtime / 1000.0) << "\n";
 				std::cout << "frames : " << frameCount << "\n";
 				std::cout << "fps    : " << frameCount / (runtime / 1000.0) << "\n";
+				if (!configuration.empty()) {
+					std::cout << "config : " << configuration << "\n";
+				}
+				std::cout << "stddev : " << frameTimeDeviation() << " ms" << "\n";
+				std::cout << "p99    : " << frameTimePercentile(0.99) << " ms" << "\n";
+			}
+		}
+
+		// Standard deviation of the frame times in ms, the measure of frame pacing stability
+		double frameTimeDeviation() const {
+			if (frameTimes.empty()) {
+				return 0.0;
+			}
+			double mean = std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0) / (double)frameTimes.size();
+			double variance = 0.0;
+			for (double frameTime : frameTimes) {
+				variance += (frameTime - mean) * (frameTime - mean);
+			}
+			return std::sqrt(variance / (double)frameTimes.size());
+		}
+
+		// Frame time in ms that the given fraction of all frames stays below
+		double frameTimePercentile(double fraction) const {
+			if (frameTimes.empty()) {
+				return 0.0;
 			}
+			std::vector<double> sorted = frameTimes;
+			size_t index = std::min(static_cast<size_t>(fraction * (double)sorted.size()), sorted.size() - 1);
+			std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+			return sorted[index];
 		}
 
 		void saveResults() {
@@ -77,8 +109,9 @@ namespace vks
 			if (result.is_open()) {
 				result << std::fixed << std::setprecision(4);
 
-				result << "device,driverversion,duration (ms),frames,fps" << "\n";
-				result << deviceProps.deviceName << "," << deviceProps.driverVersion << "," << runtime << "," << frameCount << "," << frameCount / (runtime / 1000.0) << "\n";
+				result << "device,driverversion,duration (ms),frames,fps,stddev (ms),p99 (ms),configuration" << "\n";
+				result << deviceProps.deviceName << "," << deviceProps.driverVersion << "," << runtime << "," << frameCount << "," << frameCount / (runtime / 1000.0)
+					<< "," << frameTimeDeviation() << "," << frameTimePercentile(0.99) << "," << configuration << "\n";
 
 				if (outputFrameTimes) {
 					result << "\n" << "frame,ms" << "\n";
@@ -12,8 +12,15 @@
 */
 
 #include "VulkanExampleBase.h"
+#include "VulkanTaskGraph.h"
+#include "VulkanReadback.h"
+#include "VulkanGpuTimer.h"
+#include "VulkanNeighborGrid.h"
+#include "ParallelAlgorithms.hpp"
 
 #define VERTEX_BUFFER_BIND_ID 0
+// Tile edge in pixels of the compute splatting path, must match TILE_SIZE of splat.glsl
+#define SPLAT_TILE_SIZE 16
 #define ENABLE_VALIDATION true
 
 #if defined(__ANDROID__)
@@ -89,6 +96,126 @@ public:
 		vks::Buffer uniformBuffer;					// Uniform buffer object containing particle system parameters
 	} compute;
 
+	// Per frame work as a task graph, built once and executed every frame
+	vks::TaskGraph frameGraph;
+	bool useFrameGraph = true;
+
+	// Simulation statistics computed on the CPU from particles read back a few frames late, without waiting for the GPU
+	struct Diagnostics
+	{
+		// Off by default, the readback and the snapshot copy cost time the frame timings should not include
+		bool enabled = false;
+		// Copy of the particles taken by the compute queue if it does not share the graphics queue family,
+		// as the storage buffer is owned by the graphics queue once the compute pass released it
+		vks::Buffer snapshot;
+		glm::vec3 centerOfMass{ 0.0f };
+		float kineticEnergy{ 0.0f };
+		float maxSpeed{ 0.0f };
+		uint32_t samples{ 0 };
+	} diagnostics;
+	vks::ReadbackManager readback;
+
+	// Optional path (started with -bda) where the kernels and the vertex shader get the particle and uniform buffers as device addresses
+	// in push constants instead of descriptors, particles are pulled by gl_VertexIndex instead of being bound as a vertex buffer
+	struct AddressPath
+	{
+		bool available = false;
+		bool active = false;
+		VkPipelineLayout computePipelineLayout = VK_NULL_HANDLE;
+		VkPipelineLayout graphicsPipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipelineCalculate = VK_NULL_HANDLE;
+		VkPipeline pipelineIntegrate = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		struct PushConstants
+		{
+			VkDeviceAddress particles;
+			VkDeviceAddress uniforms;
+		} computeConstants{}, graphicsConstants{};
+	} addressPath;
+
+	// Timestamps around both compute passes, kept per path so the descriptor and the address path can be compared
+	vks::GpuTimer computeTimer;
+	double computeMilliseconds[2] = { 0.0, 0.0 };
+
+	// Optional renderer (started with -cs) that splats the particles in compute shaders instead of drawing point sprites with additive
+	// blending. Particles are binned to screen tiles whose workgroups sum the sprites covering their pixels without atomics, particles
+	// smaller than lodRadius pixels are merged into a grid of lodCellSize pixel cells. A fullscreen pass tone maps the fixed point sums
+	struct Splatting
+	{
+		bool available = false;
+		bool active = false;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipelineBin = VK_NULL_HANDLE;
+		VkPipeline pipelineTiles = VK_NULL_HANDLE;
+		VkPipeline pipelineResolve = VK_NULL_HANDLE;
+		// Size dependent targets, see prepareSplattingTargets
+		vks::Buffer tileCounts;
+		vks::Buffer tileEntries;
+		vks::Buffer accumulation;
+		vks::Buffer density;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		struct PushConstants
+		{
+			glm::uvec2 size;
+			glm::uvec2 tiles;
+			glm::uvec2 densitySize;
+			// Particles a tile list holds, the first pass splats the rest with global atomics
+			uint32_t tileCapacity = 1024;
+			uint32_t lodCellSize = 4;
+			float lodRadius = 1.0f;
+			float exposure = 1.0f;
+		} constants;
+	} splatting;
+
+	// Timestamps around the particle rendering of the graphics command buffers, kept per renderer
+	vks::GpuTimer renderTimer;
+	double renderMilliseconds[2] = { 0.0, 0.0 };
+
+	// Optional SPH fluid simulation replacing the n-body passes, prepared when first enabled in the UI. Every step sorts the particles
+	// into a neighbor grid with a cell size of the smoothing radius, so density and forces only visit the 27 surrounding cells
+	// instead of all particles. The forces pass writes the particles back in the sorted order, which keeps neighbours close in memory
+	struct Fluid
+	{
+		bool available = false;
+		bool active = false;
+		// Set while the compute command buffer replaces the particles with resetBuffer
+		bool resetPending = false;
+		vks::NeighborGrid grid;
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipelineDensity = VK_NULL_HANDLE;
+		VkPipeline pipelineForces = VK_NULL_HANDLE;
+		// Density and pressure per sorted particle
+		vks::Buffer densities;
+		// Host visible particles copied to the storage buffer when switching between the simulations
+		vks::Buffer resetBuffer;
+		// Fixed time steps per frame, larger steps make the stiff pressure unstable
+		uint32_t substeps = 2;
+		double milliseconds = 0.0;
+
+		struct UniformData
+		{
+			// World y points down on screen in these examples
+			glm::vec4 gravity{ 0.0f, 9.81f, 0.0f, 0.0f };
+			float deltaT{ 0.004f };
+			uint32_t particleCount{ 0 };
+			// Smoothing radius, two times the initial particle spacing
+			float h{ 0.4f };
+			float restDensity{ 1000.0f };
+			// Rest density times the volume of one particle at the initial spacing
+			float mass{ 8.0f };
+			float stiffness{ 200.0f };
+			float viscosity{ 50.0f };
+			float boundsRadius{ 6.0f };
+		} uniformData;
+		vks::Buffer uniformBuffer;
+	} fluid;
+
 	VulkanExample() : VulkanExampleBase()
 	{
 		windowTitle = "Compute shader N-body system";
@@ -103,6 +230,10 @@ public:
 	{
 		if (device)
 		{
+			frameGraph.destroy();
+			readback.destroy();
+			diagnostics.snapshot.destroy();
+
 			// Graphics
 			graphics.uniformBuffer.destroy();
 			vkDestroyPipeline(device, graphics.pipeline, nullptr);
@@ -118,6 +249,46 @@ public:
 			vkDestroyPipelineLayout(device, compute.pipelineLayout, nullptr);
 			vkDestroyPipeline(device, compute.pipelineCalculate, nullptr);
 			vkDestroyPipeline(device, compute.pipelineIntegrate, nullptr);
+			computeTimer.destroy();
+			renderTimer.destroy();
+
+			// Splatting
+			if (splatting.available)
+			{
+				vkDestroyPipeline(device, splatting.pipelineBin, nullptr);
+				vkDestroyPipeline(device, splatting.pipelineTiles, nullptr);
+				vkDestroyPipeline(device, splatting.pipelineResolve, nullptr);
+				vkDestroyPipelineLayout(device, splatting.pipelineLayout, nullptr);
+				vkDestroyDescriptorSetLayout(device, splatting.descriptorSetLayout, nullptr);
+				splatting.tileCounts.destroy();
+				splatting.tileEntries.destroy();
+				splatting.accumulation.destroy();
+				splatting.density.destroy();
+			}
+
+			// Fluid
+			if (fluid.available)
+			{
+				vkDestroyPipeline(device, fluid.pipelineDensity, nullptr);
+				vkDestroyPipeline(device, fluid.pipelineForces, nullptr);
+				vkDestroyPipelineLayout(device, fluid.pipelineLayout, nullptr);
+				vkDestroyDescriptorSetLayout(device, fluid.descriptorSetLayout, nullptr);
+				vkDestroyDescriptorPool(device, fluid.descriptorPool, nullptr);
+				fluid.grid.destroy();
+				fluid.densities.destroy();
+				fluid.resetBuffer.destroy();
+				fluid.uniformBuffer.destroy();
+			}
+
+			// Address path
+			if (addressPath.available)
+			{
+				vkDestroyPipeline(device, addressPath.pipeline, nullptr);
+				vkDestroyPipeline(device, addressPath.pipelineCalculate, nullptr);
+				vkDestroyPipeline(device, addressPath.pipelineIntegrate, nullptr);
+				vkDestroyPipelineLayout(device, addressPath.graphicsPipelineLayout, nullptr);
+				vkDestroyPipelineLayout(device, addressPath.computePipelineLayout, nullptr);
+			}
 
 			storageBuffer.destroy();
 
@@ -126,27 +297,29 @@ public:
 		}
 	}
 
-	void loadAssets()
+	// The ktx files are decoded by startup graph workers, the upload uses the device's command pool and the graphics queue
+	void loadAssets(ktxTexture* particleKtx, ktxTexture* gradientKtx)
 	{
-		textures.particle.loadFromFile(getAssetPath() + "textures/particle01_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, graphicQueue);
-		textures.gradient.loadFromFile(getAssetPath() + "textures/particle_gradient_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, graphicQueue);
+		textures.particle.loadFromKtx(particleKtx, VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, graphicQueue);
+		textures.gradient.loadFromKtx(gradientKtx, VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, graphicQueue);
 	}
 
 	void setupDescriptorPool()
 	{
-		// Descriptor pool
+		// Descriptor pool, the splatting set needs the particles, the graphics uniforms, both textures and its four targets
+		const uint32_t splattingSets = splatting.available ? 1 : 0;
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
-			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,2),
-			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,1),
-			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,2)
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,2 + splattingSets),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,1 + 5 * splattingSets),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,2 + 2 * splattingSets)
 		};
-		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::GenDescriptorPoolCreateInfo(poolSizes, 2);
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::GenDescriptorPoolCreateInfo(poolSizes, 2 + splattingSets);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 	}
 
-	// Setup and fill the compute shader storage buffers containing the particles
-	void prepareStorageBuffers()
+	// Generate the initial particle positions, CPU only so it can run concurrently to the device setup
+	void generateParticles(std::vector<Particle>& particleBuffer)
 	{
 		// We mark a few particles as attractors that move along a given path, these will pull in the other particles
 		std::vector<glm::vec3> attractors = {
@@ -163,13 +336,18 @@ public:
 		numParticles = static_cast<uint32_t>(attractors.size())*PARTICLES_PER_ATTRACTOR;
 
 		// Initial particle positions
-		std::vector<Particle> particleBuffer(numParticles);
+		particleBuffer.resize(numParticles);
 
-		std::default_random_engine rndEngine(benchmark.active ? 0 : (unsigned)time(nullptr));
-		std::normal_distribution<float> rndDist(0.0f, 1.0f);
+		const unsigned seed = benchmark.active ? 0 : (unsigned)time(nullptr);
 
-		for (uint32_t i = 0; i < static_cast<uint32_t>(attractors.size()); i++)
+		// Every attractor group is generated in parallel with its own random engine, seeded per group so
+		// benchmark runs stay reproducible regardless of the thread count
+		vks::parallel::forEachIndex(0, attractors.size(), [&](size_t index)
 		{
+			const uint32_t i = static_cast<uint32_t>(index);
+			std::default_random_engine rndEngine(seed + i);
+			std::normal_distribution<float> rndDist(0.0f, 1.0f);
+
 			for (uint32_t j = 0; j < PARTICLES_PER_ATTRACTOR; j++)
 			{
 				Particle &particle = particleBuffer[i*PARTICLES_PER_ATTRACTOR + j];
@@ -199,32 +377,35 @@ public:
 				// Color gradient offset
 				particle.vel.w = (float)i*1.0f / ATTRACTORS_SIZE;
 			}//for_j
-		}//for_i
+		}, 1);//forEachIndex
 
 		compute.uniformData.particleCount = numParticles;
+	}
 
+	// Setup and fill the compute shader storage buffers containing the particles
+	void prepareStorageBuffers(const std::vector<Particle>& particleBuffer)
+	{
 		VkDeviceSize storageBufferSize = particleBuffer.size() * sizeof(Particle);
 
-		// Staging
-		// SSBO won't be changed on the host after upload so copy to device local memory
-
-		vks::Buffer stagingBuffer;
+		// SSBO won't be changed on the host after upload so it goes to device local memory, written directly
+		// if the host can map it (integrated GPUs, resizable BAR) and through a staging copy otherwise
+		// The SSBO will be used as a storage buffer for the compute pipeline and as a vertex buffer in the graphics pipeline
+		// Transfer destination is needed for the fluid reset copies, the direct upload path does not add it
+		VK_CHECK_RESULT(vulkanDevice->CreateDeviceLocalBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | addressUsage(),
+			&storageBuffer, storageBufferSize, particleBuffer.data(), graphicQueue));
 
-		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&stagingBuffer, storageBufferSize, particleBuffer.data());
+		if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
+		{
+			VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&diagnostics.snapshot, storageBufferSize));
+		}
+		// Three frames of particles can be in flight to the host for the diagnostics
+		readback.create(vulkanDevice, compute.queueFamilyIndex, 3, storageBufferSize);
 
-		// The SSBO will be used as a storage buffer for the compute pipeline and as a vertex buffer in the graphics pipeline
-		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &storageBuffer, storageBufferSize);
-
-		// Copy from staging buffer to storage buffer
-		VkCommandBuffer copyCmd = vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		VkBufferCopy copyRegion = {};
-		copyRegion.size = storageBufferSize;
-		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, storageBuffer.buffer, 1, &copyRegion);
 		// Execute a transfer barrier to the compute queue, if necessary
 		if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
 		{
+			VkCommandBuffer copyCmd = vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 			VkBufferMemoryBarrier buffer_barrier =
 			{
 				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,nullptr,VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,0,
@@ -233,12 +414,33 @@ public:
 
 			vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
 				0, nullptr, 1, &buffer_barrier, 0, nullptr);
+			vulkanDevice->FlushCommandBuffer(copyCmd, graphicQueue, true);
+		}
+	}
+
+	// Buffers the address path reaches through device addresses need the usage bit, it also makes CreateBuffer allocate addressable memory
+	VkBufferUsageFlags addressUsage() const
+	{
+		return addressPath.available ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : 0;
+	}
+
+	// Stage and access of the particle reads in the graphics command buffers, used by the queue family ownership transfers
+	// and the wait on the compute semaphore. The splatting passes read the particles in compute shaders
+	VkPipelineStageFlags vertexReadStage() const
+	{
+		if (splatting.active)
+		{
+			return VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 		}
-		vulkanDevice->FlushCommandBuffer(copyCmd, graphicQueue, true);
-		stagingBuffer.destroy();
+		return addressPath.active ? VK_PIPELINE_STAGE_VERTEX_SHADER_BIT : VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+	}
+
+	VkAccessFlags vertexReadAccess() const
+	{
+		return (addressPath.active || splatting.active) ? VK_ACCESS_SHADER_READ_BIT : VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
 	}
 
-	void setupDescriptorSetLayoutAndUpdate()
+	void setupDescriptorSetLayout()
 	{
 		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
 		setLayoutBindings =
@@ -251,7 +453,17 @@ public:
 		VkDescriptorSetLayoutCreateInfo descriptorLayoutCI = vks::initializers::GenDescriptorSetLayoutCreateInfo(setLayoutBindings);
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayoutCI, nullptr, &graphics.descriptorSetLayout));
 
-		updateDescriptorSets();
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::GenPipelineLayoutCreateInfo(&graphics.descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &graphics.pipelineLayout));
+
+		// The address path only uses the textures of the set, the buffers come in as push constants
+		if (addressPath.available)
+		{
+			VkPushConstantRange pushConstantRange = vks::initializers::GenPushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(AddressPath::PushConstants), 0);
+			pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+			pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &addressPath.graphicsPipelineLayout));
+		}
 	}
 
 	void updateDescriptorSets()
@@ -267,13 +479,46 @@ public:
 			vks::initializers::GenWriteDescriptorSet(graphics.descriptorSet,VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,2,&graphics.uniformBuffer.descriptorBufferInfo),
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+		// The compute set is allocated here as well, the descriptor pool must not be used from two threads at once
+		descriptorSetAllocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &compute.descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &compute.descriptorSet));
+
+		std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets =
+		{
+			// Binding 0: Particle position storage buffer
+			vks::initializers::GenWriteDescriptorSet(compute.descriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,0,&storageBuffer.descriptorBufferInfo),
+			// Binding 1: Uniform buffer
+			vks::initializers::GenWriteDescriptorSet(compute.descriptorSet,VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,1,&compute.uniformBuffer.descriptorBufferInfo),
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, nullptr);
+
+		// The splatting targets (bindings 4 to 7) are written by prepareSplattingTargets once the size is known
+		if (splatting.available)
+		{
+			descriptorSetAllocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &splatting.descriptorSetLayout, 1);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &splatting.descriptorSet));
+			std::vector<VkWriteDescriptorSet> splattingWriteDescriptorSets =
+			{
+				vks::initializers::GenWriteDescriptorSet(splatting.descriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,0,&storageBuffer.descriptorBufferInfo),
+				vks::initializers::GenWriteDescriptorSet(splatting.descriptorSet,VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,1,&graphics.uniformBuffer.descriptorBufferInfo),
+				vks::initializers::GenWriteDescriptorSet(splatting.descriptorSet,VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,2,&textures.particle.descriptorImageInfo),
+				vks::initializers::GenWriteDescriptorSet(splatting.descriptorSet,VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,3,&textures.gradient.descriptorImageInfo),
+			};
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(splattingWriteDescriptorSets.size()), splattingWriteDescriptorSets.data(), 0, nullptr);
+		}
+
+		if (addressPath.available)
+		{
+			VkDeviceAddress particles = vulkanDevice->GetBufferDeviceAddress(storageBuffer.buffer);
+			addressPath.computeConstants = { particles, vulkanDevice->GetBufferDeviceAddress(compute.uniformBuffer.buffer) };
+			addressPath.graphicsConstants = { particles, vulkanDevice->GetBufferDeviceAddress(graphics.uniformBuffer.buffer) };
+		}
 	}
 
-	void prepareGraphicPipelines()
+	// With pullVertices the pipeline of the address path is created, it has no vertex input as the vertex shader reads the particles itself
+	void prepareGraphicPipelines(const std::array<VkPipelineShaderStageCreateInfo, 2>& shaderStages, bool pullVertices = false)
 	{
-		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::GenPipelineLayoutCreateInfo(&graphics.descriptorSetLayout, 1);
-		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &graphics.pipelineLayout));
-
 		// Pipeline
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI = vks::initializers::GenPipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_POINT_LIST, 0, VK_FALSE);
 
@@ -290,7 +535,6 @@ public:
 
 		std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT,VK_DYNAMIC_STATE_SCISSOR };
 		VkPipelineDynamicStateCreateInfo dynamicStateCI = vks::initializers::GenPipelineDynamicStateCreateInfo(dynamicStateEnables);
-		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
 
 		// Rendering pipeline
 
@@ -314,12 +558,12 @@ public:
 		vertexInputState.pVertexBindingDescriptions = inputBindings.data();
 		vertexInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
 		vertexInputState.pVertexAttributeDescriptions = attributeDescriptions.data();
+		if (pullVertices)
+		{
+			vertexInputState = vks::initializers::GenPipelineVertexInputStateCreateInfo();
+		}
 
-		// Shaders
-		shaderStages[0] = loadShader(getShadersPath() + "computenbody/particle.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-		shaderStages[1] = loadShader(getShadersPath() + "computenbody/particle.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-
-		VkGraphicsPipelineCreateInfo pipelineCreateInfo = vks::initializers::GenPipelineCreateInfo(graphics.pipelineLayout, renderPass, 0);
+		VkGraphicsPipelineCreateInfo pipelineCreateInfo = vks::initializers::GenPipelineCreateInfo(pullVertices ? addressPath.graphicsPipelineLayout : graphics.pipelineLayout, renderPass, 0);
 		pipelineCreateInfo.pVertexInputState = &vertexInputState;
 		pipelineCreateInfo.pInputAssemblyState = &inputAssemblyStateCI;
 		pipelineCreateInfo.pRasterizationState = &rasterizationStateCI;
@@ -342,7 +586,7 @@ public:
 		blendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
 		blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_DST_ALPHA;
 
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &graphics.pipeline));
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, pullVertices ? &addressPath.pipeline : &graphics.pipeline));
 	}
 
 	void buildCommandBuffersForMainRendering()
@@ -362,12 +606,19 @@ public:
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValues;
 
+		// Created with the first command buffers and again after the window was resized, the device is idle in both cases
+		if (splatting.available && ((splatting.width != width) || (splatting.height != height)))
+		{
+			prepareSplattingTargets();
+		}
+
 		for (int32_t i = 0; i < drawCmdBuffers.size(); i++)
 		{
 			// Set target frame buffer
 			renderPassBeginInfo.framebuffer = frameBuffers[i];
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufBeginInfo));
+			renderTimer.reset(drawCmdBuffers[i]);
 
 			vks::debugutils::cmdBeginLabel(drawCmdBuffers[i], "Acquire barrier", { 0.0f, 0.5f, 1.0f, 1.0f });
 			// Acquire barrier
@@ -375,14 +626,23 @@ public:
 			{
 				VkBufferMemoryBarrier bufferBarrier =
 				{
-					VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,nullptr,0,VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+					VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,nullptr,0,vertexReadAccess(),
 					compute.queueFamilyIndex,graphics.queueFamilyIndex,storageBuffer.buffer,0,storageBuffer.size
 				};
-				vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+				vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, vertexReadStage(), 0,
 					0, nullptr, 1, &bufferBarrier, 0, nullptr);
 			}//if
 			vks::debugutils::cmdEndLabel(drawCmdBuffers[i]);
 
+			// The scope ends after the draw or the resolve, so both renderers are timed from the particle buffer to the frame buffer
+			uint32_t timerScope = renderTimer.beginScope(drawCmdBuffers[i], "particles");
+			if (splatting.active)
+			{
+				vks::debugutils::cmdBeginLabel(drawCmdBuffers[i], "Splat the particle system", { 0.0f, 0.5f, 1.0f, 1.0f });
+				recordSplatting(drawCmdBuffers[i]);
+				vks::debugutils::cmdEndLabel(drawCmdBuffers[i]);
+			}
+
 			vks::debugutils::cmdBeginLabel(drawCmdBuffers[i], "Draw the particle system", { 0.0f, 0.5f, 1.0f, 1.0f });
 
 			// Draw the particle system using the update vertex buffer
@@ -394,12 +654,33 @@ public:
 			VkRect2D scissor = vks::initializers::GenRect2D(width, height, 0, 0);
 			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipeline);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSet, 0, nullptr);
+			if (splatting.active)
+			{
+				// Fullscreen triangle resolving the splatted particles
+				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, splatting.pipelineResolve);
+				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, splatting.pipelineLayout, 0, 1, &splatting.descriptorSet, 0, nullptr);
+				vkCmdPushConstants(drawCmdBuffers[i], splatting.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(Splatting::PushConstants), &splatting.constants);
+				vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
+			}
+			else
+			{
+				if (addressPath.active)
+				{
+					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, addressPath.pipeline);
+					vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, addressPath.graphicsPipelineLayout, 0, 1, &graphics.descriptorSet, 0, nullptr);
+					vkCmdPushConstants(drawCmdBuffers[i], addressPath.graphicsPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(AddressPath::PushConstants), &addressPath.graphicsConstants);
+				}
+				else
+				{
+					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipeline);
+					vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSet, 0, nullptr);
 
-			VkDeviceSize offsets[1] = { 0 };
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &storageBuffer.buffer, offsets);
-			vkCmdDraw(drawCmdBuffers[i], numParticles, 1, 0, 0);
+					VkDeviceSize offsets[1] = { 0 };
+					vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &storageBuffer.buffer, offsets);
+				}
+				vkCmdDraw(drawCmdBuffers[i], numParticles, 1, 0, 0);
+			}
+			renderTimer.endScope(drawCmdBuffers[i], timerScope);
 
 			vks::debugutils::cmdEndLabel(drawCmdBuffers[i]);
 
@@ -412,11 +693,11 @@ public:
 			{
 				VkBufferMemoryBarrier bufferBarrier =
 				{
-					VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,nullptr,VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,0,
+					VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,nullptr,vertexReadAccess(),0,
 					graphics.queueFamilyIndex,compute.queueFamilyIndex,storageBuffer.buffer,0,storageBuffer.size
 				};
 
-				vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+				vkCmdPipelineBarrier(drawCmdBuffers[i], vertexReadStage(), VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
 					0, nullptr, 1, &bufferBarrier, 0, nullptr);
 			}//if
 
@@ -424,16 +705,148 @@ public:
 		}//for
 	}
 
-	void prepareGraphicPass()
+	// Clears the targets, bins the particles to tiles and sums the tiles, the resolve is drawn in the render pass
+	void recordSplatting(VkCommandBuffer commandBuffer)
+	{
+		// Execution dependency only, the previous frame's resolve must be done reading before the targets are cleared
+		VkMemoryBarrier memoryBarrier = vks::initializers::GenMemoryBarrier();
+		memoryBarrier.srcAccessMask = 0;
+		memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		vkCmdFillBuffer(commandBuffer, splatting.tileCounts.buffer, 0, VK_WHOLE_SIZE, 0);
+		vkCmdFillBuffer(commandBuffer, splatting.accumulation.buffer, 0, VK_WHOLE_SIZE, 0);
+		vkCmdFillBuffer(commandBuffer, splatting.density.buffer, 0, VK_WHOLE_SIZE, 0);
+
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		// First pass: merge small particles into the density grid and bin the others to tiles
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, splatting.pipelineBin);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, splatting.pipelineLayout, 0, 1, &splatting.descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, splatting.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(Splatting::PushConstants), &splatting.constants);
+		vkCmdDispatch(commandBuffer, numParticles / 256, 1, 1);
+
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		// Second pass: one workgroup per tile
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, splatting.pipelineTiles);
+		vkCmdDispatch(commandBuffer, splatting.constants.tiles.x, splatting.constants.tiles.y, 1);
+
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	// (Re)creates the tile lists, the accumulation buffer and the density grid for the current size
+	void prepareSplattingTargets()
+	{
+		splatting.tileCounts.destroy();
+		splatting.tileEntries.destroy();
+		splatting.accumulation.destroy();
+		splatting.density.destroy();
+
+		splatting.width = width;
+		splatting.height = height;
+		Splatting::PushConstants& constants = splatting.constants;
+		constants.size = glm::uvec2(width, height);
+		constants.tiles = glm::uvec2((width + SPLAT_TILE_SIZE - 1) / SPLAT_TILE_SIZE, (height + SPLAT_TILE_SIZE - 1) / SPLAT_TILE_SIZE);
+		constants.densitySize = glm::uvec2((width + constants.lodCellSize - 1) / constants.lodCellSize, (height + constants.lodCellSize - 1) / constants.lodCellSize);
+
+		const VkDeviceSize tileCount = constants.tiles.x * constants.tiles.y;
+		const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &splatting.tileCounts, tileCount * sizeof(uint32_t)));
+		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &splatting.tileEntries, tileCount * constants.tileCapacity * sizeof(uint32_t)));
+		// Four uints per pixel and cell: fixed point rgb and padding
+		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &splatting.accumulation,
+			static_cast<VkDeviceSize>(width) * height * 4 * sizeof(uint32_t)));
+		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &splatting.density,
+			static_cast<VkDeviceSize>(constants.densitySize.x) * constants.densitySize.y * 4 * sizeof(uint32_t)));
+
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets =
+		{
+			vks::initializers::GenWriteDescriptorSet(splatting.descriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,4,&splatting.tileCounts.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(splatting.descriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,5,&splatting.tileEntries.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(splatting.descriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,6,&splatting.accumulation.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(splatting.descriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,7,&splatting.density.descriptorBufferInfo),
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
+	void prepareSplattingLayouts()
+	{
+		// The resolve fragment shader only reads the accumulation buffer and the density grid
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+		{
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,0),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,1),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,VK_SHADER_STAGE_COMPUTE_BIT,2),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,VK_SHADER_STAGE_COMPUTE_BIT,3),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,4),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,5),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,6),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,7),
+		};
+		VkDescriptorSetLayoutCreateInfo descriptorLayoutCI = vks::initializers::GenDescriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayoutCI, nullptr, &splatting.descriptorSetLayout));
+
+		VkPushConstantRange pushConstantRange = vks::initializers::GenPushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(Splatting::PushConstants), 0);
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::GenPipelineLayoutCreateInfo(&splatting.descriptorSetLayout, 1);
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &splatting.pipelineLayout));
+	}
+
+	void prepareSplattingPipelines(const VkPipelineShaderStageCreateInfo& binStage, const VkPipelineShaderStageCreateInfo& tilesStage,
+		const std::array<VkPipelineShaderStageCreateInfo, 2>& resolveStages)
+	{
+		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::GenComputePipelineCreateInfo(splatting.pipelineLayout, 0);
+		computePipelineCreateInfo.stage = binStage;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &splatting.pipelineBin));
+		computePipelineCreateInfo.stage = tilesStage;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &splatting.pipelineTiles));
+
+		// The resolve overwrites every pixel, no vertex input, blending or depth
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI = vks::initializers::GenPipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
+		VkPipelineRasterizationStateCreateInfo rasterizationStateCI = vks::initializers::GenPipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
+		VkPipelineColorBlendAttachmentState blendAttachmentState = vks::initializers::GenPipelineColorBlendAttachmentState(0xf, VK_FALSE);
+		VkPipelineColorBlendStateCreateInfo colorBlendStateCI = vks::initializers::GenPipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
+		VkPipelineDepthStencilStateCreateInfo depthStencilStateCI = vks::initializers::GenPipelineDepthStencilStateCreateInfo(VK_FALSE, VK_FALSE, VK_COMPARE_OP_ALWAYS);
+		VkPipelineViewportStateCreateInfo viewportStateCI = vks::initializers::GenPipelineViewportStateCreateInfo(1, 1, 0);
+		VkPipelineMultisampleStateCreateInfo multisampleStateCI = vks::initializers::GenPipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT, 0);
+		std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT,VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamicStateCI = vks::initializers::GenPipelineDynamicStateCreateInfo(dynamicStateEnables);
+		VkPipelineVertexInputStateCreateInfo vertexInputState = vks::initializers::GenPipelineVertexInputStateCreateInfo();
+
+		VkGraphicsPipelineCreateInfo pipelineCreateInfo = vks::initializers::GenPipelineCreateInfo(splatting.pipelineLayout, renderPass, 0);
+		pipelineCreateInfo.pVertexInputState = &vertexInputState;
+		pipelineCreateInfo.pInputAssemblyState = &inputAssemblyStateCI;
+		pipelineCreateInfo.pRasterizationState = &rasterizationStateCI;
+		pipelineCreateInfo.pColorBlendState = &colorBlendStateCI;
+		pipelineCreateInfo.pDepthStencilState = &depthStencilStateCI;
+		pipelineCreateInfo.pViewportState = &viewportStateCI;
+		pipelineCreateInfo.pMultisampleState = &multisampleStateCI;
+		pipelineCreateInfo.pDynamicState = &dynamicStateCI;
+		pipelineCreateInfo.stageCount = static_cast<uint32_t>(resolveStages.size());
+		pipelineCreateInfo.pStages = resolveStages.data();
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &splatting.pipelineResolve));
+	}
+
+	void prepareGraphicLayouts()
 	{
 		// Vertex shader uniform buffer block
-		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | addressUsage(), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
             &graphics.uniformBuffer, sizeof(graphics.uniformData));
 		VK_CHECK_RESULT(graphics.uniformBuffer.map());// Map for host access
 
-		setupDescriptorSetLayoutAndUpdate();
+		setupDescriptorSetLayout();
+	}
 
-		prepareGraphicPipelines();
+	// Submits to the graphics queue, so this runs on the main thread
+	void prepareGraphicPass()
+	{
 		// We use a semaphore to synchronize compute and graphics
 		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::GenSemaphoreCreateInfo();
 		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &graphics.semaphore));
@@ -445,11 +858,18 @@ public:
 		VK_CHECK_RESULT(vkQueueSubmit(graphicQueue, 1, &submitInfo, VK_NULL_HANDLE));
 		VK_CHECK_RESULT(vkQueueWaitIdle(graphicQueue));
 
+		// Timestamps are only written if the graphics queue family supports them
+		if (vulkanDevice->queueFamilyProperties[graphics.queueFamilyIndex].timestampValidBits > 0)
+		{
+			renderTimer.create(vulkanDevice, 1);
+		}
+
 		buildCommandBuffersForMainRendering();
 	}
 
 	void buildComputeCommandBuffer()
 	{
+		vks::FrameStats::ScopedStage recordStage(frameStats, vks::FrameStats::Record);
 		VkCommandBufferBeginInfo cmdBufferInfo = vks::initializers::GenCommandBufferBeginInfo();
 
 		VK_CHECK_RESULT(vkBeginCommandBuffer(compute.commandBuffer, &cmdBufferInfo));
@@ -467,11 +887,71 @@ public:
 				0, nullptr, 1, &toCpmputeBufferBarrier, 0, nullptr);
 		}
 
+		computeTimer.reset(compute.commandBuffer);
+		uint32_t timerScope = computeTimer.beginScope(compute.commandBuffer, "compute");
+		if (fluid.resetPending)
+		{
+			recordParticleReset(compute.commandBuffer);
+		}
+		if (fluid.active)
+		{
+			recordFluid(compute.commandBuffer);
+		}
+		else
+		{
+			recordNBody(compute.commandBuffer);
+		}
+		computeTimer.endScope(compute.commandBuffer, timerScope);
+
+		// Release barrier
+		if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
+		{
+			// Snapshot for the diagnostics readback while the compute queue still owns the particles
+			if (diagnostics.enabled)
+			{
+				VkBufferMemoryBarrier snapshotBarrier = vks::initializers::GenBufferMemoryBarrier();
+				snapshotBarrier.buffer = storageBuffer.buffer;
+				snapshotBarrier.size = storageBuffer.size;
+				snapshotBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				snapshotBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+				snapshotBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				snapshotBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				vkCmdPipelineBarrier(compute.commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+					0, 0, nullptr, 1, &snapshotBarrier, 0, nullptr);
+				VkBufferCopy snapshotRegion = { 0, 0, storageBuffer.size };
+				vkCmdCopyBuffer(compute.commandBuffer, storageBuffer.buffer, diagnostics.snapshot.buffer, 1, &snapshotRegion);
+			}
+
+			VkBufferMemoryBarrier computeToGraphicBufferBarrier =
+			{
+				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,nullptr,VK_ACCESS_SHADER_WRITE_BIT,0,
+				compute.queueFamilyIndex,graphics.queueFamilyIndex,storageBuffer.buffer,0,storageBuffer.size
+			};
+
+			vkCmdPipelineBarrier(compute.commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+				0, 0, nullptr, 1, &computeToGraphicBufferBarrier, 0, nullptr);
+		}
+
+		vkEndCommandBuffer(compute.commandBuffer);
+	}
+
+	// Two passes over all particle pairs: velocities from the gravity of all other particles, then the integration
+	void recordNBody(VkCommandBuffer commandBuffer)
+	{
 		// First pass: Calculate particle movement
 		// ------------------------------------------------
-		vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineCalculate);
-		vkCmdBindDescriptorSets(compute.commandBuffer,VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, 0);
-		vkCmdDispatch(compute.commandBuffer, numParticles / 256, 1, 1);
+		if (addressPath.active)
+		{
+			// Push constants are shared by both passes, the pipeline layout is the same
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, addressPath.pipelineCalculate);
+			vkCmdPushConstants(commandBuffer, addressPath.computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(AddressPath::PushConstants), &addressPath.computeConstants);
+		}
+		else
+		{
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineCalculate);
+			vkCmdBindDescriptorSets(commandBuffer,VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, 0);
+		}
+		vkCmdDispatch(commandBuffer, numParticles / 256, 1, 1);
 
 		// Add memory barrier to ensure that the computer shader has finished writing to the buffer
 		VkBufferMemoryBarrier secondComputePassBufferBarrier = vks::initializers::GenBufferMemoryBarrier();
@@ -483,31 +963,150 @@ public:
 		secondComputePassBufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 		secondComputePassBufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 
-		vkCmdPipelineBarrier(compute.commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 			VK_FLAGS_NONE, 0, nullptr, 1, &secondComputePassBufferBarrier, 0, nullptr);
 
 		// Second pass: Integrate particles
 		// ------------------------------------------
-		vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineIntegrate);
-		vkCmdDispatch(compute.commandBuffer, numParticles / 256, 1, 1);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, addressPath.active ? addressPath.pipelineIntegrate : compute.pipelineIntegrate);
+		vkCmdDispatch(commandBuffer, numParticles / 256, 1, 1);
+	}
 
-		// Release barrier
-		if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
+	// Sorts the particles into the neighbor grid, then the density pass and the forces pass per substep
+	void recordFluid(VkCommandBuffer commandBuffer)
+	{
+		VkMemoryBarrier memoryBarrier = vks::initializers::GenMemoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		const VkDescriptorSet descriptorSets[] = { fluid.descriptorSet, fluid.grid.querySet };
+		for (uint32_t substep = 0; substep < fluid.substeps; substep++)
 		{
-			VkBufferMemoryBarrier computeToGraphicBufferBarrier =
-			{
-				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,nullptr,VK_ACCESS_SHADER_WRITE_BIT,0,
-				compute.queueFamilyIndex,graphics.queueFamilyIndex,storageBuffer.buffer,0,storageBuffer.size
-			};
+			// The build waits for the forces pass of the previous substep writing the particles
+			fluid.grid.recordBuild(commandBuffer);
 
-			vkCmdPipelineBarrier(compute.commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-				0, 0, nullptr, 1, &computeToGraphicBufferBarrier, 0, nullptr);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, fluid.pipelineLayout, 0, 2, descriptorSets, 0, nullptr);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, fluid.pipelineDensity);
+			vkCmdDispatch(commandBuffer, numParticles / 256, 1, 1);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, fluid.pipelineForces);
+			vkCmdDispatch(commandBuffer, numParticles / 256, 1, 1);
+		}//for
+	}
+
+	// Overwrites the particles with resetBuffer before the simulation passes
+	void recordParticleReset(VkCommandBuffer commandBuffer)
+	{
+		// The submit only waits for the graphics semaphore at the compute stage, the copy has to wait for it as well
+		VkMemoryBarrier memoryBarrier = vks::initializers::GenMemoryBarrier();
+		memoryBarrier.srcAccessMask = 0;
+		memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		VkBufferCopy copyRegion = { 0, 0, storageBuffer.size };
+		vkCmdCopyBuffer(commandBuffer, fluid.resetBuffer.buffer, storageBuffer.buffer, 1, &copyRegion);
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	// Creates the fluid resources the first time the simulation is switched, the queues are idle
+	void prepareFluid()
+	{
+		fluid.uniformData.particleCount = numParticles;
+		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&fluid.uniformBuffer, sizeof(Fluid::UniformData)));
+		VK_CHECK_RESULT(fluid.uniformBuffer.map());
+		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &fluid.densities, numParticles * sizeof(glm::vec2)));
+		VK_CHECK_RESULT(vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&fluid.resetBuffer, storageBuffer.size));
+		VK_CHECK_RESULT(fluid.resetBuffer.map());
+
+		// The particles have the layout the grid sorts, the cells are as large as the smoothing radius
+		fluid.grid.prepare(vulkanDevice, pipelineCache, getShadersPath(), numParticles);
+		fluid.grid.setParticles(storageBuffer.descriptorBufferInfo, numParticles);
+		fluid.grid.setCellSize(fluid.uniformData.h);
+
+		std::vector<VkDescriptorPoolSize> poolSizes =
+		{
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,1),
+			vks::initializers::GenDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,2)
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::GenDescriptorPoolCreateInfo(poolSizes, 1);
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &fluid.descriptorPool));
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+		{
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,0),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,1),
+			vks::initializers::GenDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,2),
+		};
+		VkDescriptorSetLayoutCreateInfo descriptorLayoutCI = vks::initializers::GenDescriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayoutCI, nullptr, &fluid.descriptorSetLayout));
+		VkDescriptorSetAllocateInfo descriptorSetAllocInfo = vks::initializers::GenDescriptorSetAllocateInfo(fluid.descriptorPool, &fluid.descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &fluid.descriptorSet));
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets =
+		{
+			vks::initializers::GenWriteDescriptorSet(fluid.descriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,0,&storageBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(fluid.descriptorSet,VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,1,&fluid.uniformBuffer.descriptorBufferInfo),
+			vks::initializers::GenWriteDescriptorSet(fluid.descriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,2,&fluid.densities.descriptorBufferInfo),
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+		// The grid is read through its query set at set 1
+		const VkDescriptorSetLayout setLayouts[] = { fluid.descriptorSetLayout, fluid.grid.querySetLayout };
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::GenPipelineLayoutCreateInfo(setLayouts, 2);
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &fluid.pipelineLayout));
+		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::GenComputePipelineCreateInfo(fluid.pipelineLayout, 0);
+		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computenbody/sph_density.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &fluid.pipelineDensity));
+		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computenbody/sph_forces.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &fluid.pipelineForces));
+
+		fluid.available = true;
+	}
+
+	// Cube of fluid at the initial spacing in the center of the container, colored by height. It collapses under gravity
+	void generateFluid(std::vector<Particle>& particleBuffer)
+	{
+		const float spacing = std::cbrt(fluid.uniformData.mass / fluid.uniformData.restDensity);
+		const uint32_t edge = static_cast<uint32_t>(std::ceil(std::cbrt(static_cast<float>(numParticles))));
+		const glm::vec3 origin = glm::vec3(-0.5f * static_cast<float>(edge) * spacing);
+		std::default_random_engine rndEngine(benchmark.active ? 0 : (unsigned)time(nullptr));
+		std::uniform_real_distribution<float> rndJitter(-0.05f * spacing, 0.05f * spacing);
+		particleBuffer.resize(numParticles);
+		for (uint32_t i = 0; i < numParticles; i++)
+		{
+			const glm::uvec3 cell(i % edge, (i / edge) % edge, i / (edge * edge));
+			const glm::vec3 jitter(rndJitter(rndEngine), rndJitter(rndEngine), rndJitter(rndEngine));
+			// The w components size the sprites and pick the gradient color
+			particleBuffer[i].pos = glm::vec4(origin + glm::vec3(cell) * spacing + jitter, 40.0f);
+			particleBuffer[i].vel = glm::vec4(0.0f, 0.0f, 0.0f, static_cast<float>(cell.y) / edge);
 		}
+	}
 
-		vkEndCommandBuffer(compute.commandBuffer);
+	// Switches between the n-body and the fluid simulation, the particles are replaced with the next compute submit
+	void switchSimulation()
+	{
+		VK_CHECK_RESULT(vkQueueWaitIdle(compute.queue));
+		VK_CHECK_RESULT(vkQueueWaitIdle(graphicQueue));
+		if (!fluid.available)
+		{
+			prepareFluid();
+		}
+		std::vector<Particle> particleBuffer;
+		if (fluid.active)
+		{
+			generateFluid(particleBuffer);
+		}
+		else
+		{
+			generateParticles(particleBuffer);
+		}
+		memcpy(fluid.resetBuffer.mappedData, particleBuffer.data(), particleBuffer.size() * sizeof(Particle));
+		fluid.resetPending = true;
+		buildComputeCommandBuffer();
 	}
 
-	void prepareComputePass()
+	void prepareComputeLayouts()
 	{
 		// Create a compute capable device queue
 		// The VulkanDevice::createLogicalDevice functions finds a compute capable queue and prefers queue families that only support compute
@@ -516,7 +1115,7 @@ public:
 		vkGetDeviceQueue(device, compute.queueFamilyIndex, 0, &compute.queue);
 
 		// Compute shader uniform buffer block
-		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		vulkanDevice->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | addressUsage(),
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &compute.uniformBuffer, sizeof(Compute::ComputeUniformData));
 		VK_CHECK_RESULT(compute.uniformBuffer.map());// Map for host access
 
@@ -533,26 +1132,26 @@ public:
 		VkDescriptorSetLayoutCreateInfo descriptorLayoutCI = vks::initializers::GenDescriptorSetLayoutCreateInfo(setLayoutBindings);
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayoutCI, nullptr, &compute.descriptorSetLayout));
 
-		VkDescriptorSetAllocateInfo descriptorSetAllocInfo = vks::initializers::GenDescriptorSetAllocateInfo(descriptorPool, &compute.descriptorSetLayout, 1);
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &compute.descriptorSet));
-
-		std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets =
-		{
-			// Binding 0: Particle position storage buffer
-			vks::initializers::GenWriteDescriptorSet(compute.descriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,0,&storageBuffer.descriptorBufferInfo),
-			// Binding 1: Uniform buffer
-			vks::initializers::GenWriteDescriptorSet(compute.descriptorSet,VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,1,&compute.uniformBuffer.descriptorBufferInfo),
-		};
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, nullptr);
-
-		// Create pipeline
 		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::GenPipelineLayoutCreateInfo(&compute.descriptorSetLayout, 1);
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &compute.pipelineLayout));
 
-		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::GenComputePipelineCreateInfo(compute.pipelineLayout, 0);
+		// The address path has no descriptor set at all
+		if (addressPath.available)
+		{
+			VkPushConstantRange pushConstantRange = vks::initializers::GenPushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(AddressPath::PushConstants), 0);
+			VkPipelineLayoutCreateInfo addressLayoutCreateInfo = vks::initializers::GenPipelineLayoutCreateInfo(nullptr, 0);
+			addressLayoutCreateInfo.pushConstantRangeCount = 1;
+			addressLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &addressLayoutCreateInfo, nullptr, &addressPath.computePipelineLayout));
+		}
+	}
 
+	// The pipeline cache is internally synchronized, so both compute pipelines and the graphics pipeline can be compiled concurrently
+	void prepareCalculatePipeline(const VkPipelineShaderStageCreateInfo& shaderStage, VkPipelineLayout layout, VkPipeline* pipeline)
+	{
 		// 1st pass
-		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computenbody/particle_calculate.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::GenComputePipelineCreateInfo(layout, 0);
+		computePipelineCreateInfo.stage = shaderStage;
 
 		// We want to use as much shared memory for the compute shader invocations as available, so we calculate it based on the device limits and pass it to the shader via specialization constants
 		uint32_t sharedDataSize = std::min((uint32_t)1024, (uint32_t)(vulkanDevice->properties.limits.maxComputeSharedMemorySize / sizeof(glm::vec4)));
@@ -560,12 +1159,19 @@ public:
 		VkSpecializationInfo specializationInfo = vks::initializers::GenSpecializationInfo(1, &specializationMapEntry, sizeof(int32_t), &sharedDataSize);
 		computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
 
-		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelineCalculate));
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, pipeline));
+	}
 
+	void prepareIntegratePipeline(const VkPipelineShaderStageCreateInfo& shaderStage, VkPipelineLayout layout, VkPipeline* pipeline)
+	{
 		// 2nd pass
-		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computenbody/particle_integrate.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
-		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelineIntegrate));
+		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::GenComputePipelineCreateInfo(layout, 0);
+		computePipelineCreateInfo.stage = shaderStage;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, pipeline));
+	}
 
+	void prepareComputePass()
+	{
 		// Separate command pool as queue family for compute may be different than graphics
 		VkCommandPoolCreateInfo cmdPoolInfo = {};
 		cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -580,28 +1186,151 @@ public:
 		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::GenSemaphoreCreateInfo();
 		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &compute.semaphore));
 
+		// Timestamps are only written if the compute queue family supports them
+		if (vulkanDevice->queueFamilyProperties[compute.queueFamilyIndex].timestampValidBits > 0)
+		{
+			computeTimer.create(vulkanDevice, 1);
+		}
+
 		// Build a single command buffer containing the compute dispatch commands
 		buildComputeCommandBuffer();
 	}
 
 	void prepareForRendering() override
 	{
-		VulkanExampleBase::prepareForRendering();
+		typedef vks::StartupGraph::Affinity Affinity;
+		typedef vks::StartupGraph::TaskId TaskId;
 
 		// We will be using the queue family indices to check if graphics and compute queue families differ
 		// If that's the case, we need additional barriers for acquiring and releasing resources
 		graphics.queueFamilyIndex = vulkanDevice->queueFamilyIndices.graphicIndex;
 		compute.queueFamilyIndex = vulkanDevice->queueFamilyIndices.computeIndex;
-		loadAssets();
-		setupDescriptorPool();
-		prepareStorageBuffers();
-		prepareGraphicPass();
-		prepareComputePass();
+		addressPath.available = vulkanDevice->bufferDeviceAddress.enabled;
+		addressPath.active = addressPath.available;
+		splatting.available = settings.computeSplatting;
+		splatting.active = splatting.available;
+		if (benchmark.active)
+		{
+			diagnostics.enabled = false;
+		}
+
+		// File decoding, particle generation, shader loading and pipeline compilation run concurrently to the swap chain setup,
+		// steps using the device's command pool or the graphics queue run on the main thread which serializes them
+		vks::StartupGraph startupGraph;
+		BaseStartupTasks baseTasks = addBaseStartupTasks(startupGraph);
+
+		ktxTexture* particleKtx = nullptr;
+		ktxTexture* gradientKtx = nullptr;
+		std::vector<Particle> particleBuffer;
+		std::array<VkPipelineShaderStageCreateInfo, 2> graphicsShaderStages;
+		VkPipelineShaderStageCreateInfo calculateShaderStage;
+		VkPipelineShaderStageCreateInfo integrateShaderStage;
+		std::array<VkPipelineShaderStageCreateInfo, 2> addressGraphicsShaderStages;
+		VkPipelineShaderStageCreateInfo addressCalculateShaderStage;
+		VkPipelineShaderStageCreateInfo addressIntegrateShaderStage;
+		VkPipelineShaderStageCreateInfo splattingBinShaderStage;
+		VkPipelineShaderStageCreateInfo splattingTilesShaderStage;
+		std::array<VkPipelineShaderStageCreateInfo, 2> splattingResolveShaderStages;
+
+		TaskId decodeParticle = startupGraph.addTask("decode particle.ktx", [&]
+		{
+			ktxResult result = textures.particle.loadKTXFile(getAssetPath() + "textures/particle01_rgba.ktx", &particleKtx);
+			assert(result == KTX_SUCCESS);
+		});
+		TaskId decodeGradient = startupGraph.addTask("decode gradient.ktx", [&]
+		{
+			ktxResult result = textures.gradient.loadKTXFile(getAssetPath() + "textures/particle_gradient_rgba.ktx", &gradientKtx);
+			assert(result == KTX_SUCCESS);
+		});
+		TaskId uploadTextures = startupGraph.addTask("upload textures", [&] { loadAssets(particleKtx, gradientKtx); },
+			{ decodeParticle, decodeGradient }, Affinity::MainThread);
+
+		TaskId generate = startupGraph.addTask("generate particles", [&] { generateParticles(particleBuffer); });
+		TaskId uploadParticles = startupGraph.addTask("upload particles", [&] { prepareStorageBuffers(particleBuffer); }, { generate }, Affinity::MainThread);
+
+		TaskId graphicsShaders = startupGraph.addTask("graphics shaders", [&]
+		{
+			graphicsShaderStages[0] = loadShader(getShadersPath() + "computenbody/particle.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+			graphicsShaderStages[1] = loadShader(getShadersPath() + "computenbody/particle.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		});
+		TaskId computeShaders = startupGraph.addTask("compute shaders", [&]
+		{
+			calculateShaderStage = loadShader(getShadersPath() + "computenbody/particle_calculate.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+			integrateShaderStage = loadShader(getShadersPath() + "computenbody/particle_integrate.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		});
+
+		TaskId pool = startupGraph.addTask("descriptor pool", [this] { setupDescriptorPool(); });
+		TaskId graphicsLayouts = startupGraph.addTask("graphics layouts", [this] { prepareGraphicLayouts(); });
+		TaskId computeLayouts = startupGraph.addTask("compute layouts", [this] { prepareComputeLayouts(); });
+		std::vector<TaskId> descriptorSetDependencies = { pool, graphicsLayouts, computeLayouts, uploadTextures, uploadParticles };
+		TaskId splattingLayouts = 0;
+		if (splatting.available)
+		{
+			splattingLayouts = startupGraph.addTask("splatting layouts", [this] { prepareSplattingLayouts(); });
+			descriptorSetDependencies.push_back(splattingLayouts);
+		}
+		TaskId descriptorSets = startupGraph.addTask("descriptor sets", [this] { updateDescriptorSets(); }, descriptorSetDependencies);
+
+		TaskId graphicsPipeline = startupGraph.addTask("graphics pipeline", [&] { prepareGraphicPipelines(graphicsShaderStages); },
+			{ graphicsShaders, graphicsLayouts, baseTasks.renderPass, baseTasks.pipelineCache });
+		TaskId calculatePipeline = startupGraph.addTask("calculate pipeline", [&] { prepareCalculatePipeline(calculateShaderStage, compute.pipelineLayout, &compute.pipelineCalculate); },
+			{ computeShaders, computeLayouts, baseTasks.pipelineCache });
+		TaskId integratePipeline = startupGraph.addTask("integrate pipeline", [&] { prepareIntegratePipeline(integrateShaderStage, compute.pipelineLayout, &compute.pipelineIntegrate); },
+			{ computeShaders, computeLayouts, baseTasks.pipelineCache });
+		std::vector<TaskId> graphicsPassDependencies = { baseTasks.complete, graphicsPipeline, descriptorSets };
+		std::vector<TaskId> computePassDependencies = { calculatePipeline, integratePipeline, descriptorSets };
+
+		if (addressPath.available)
+		{
+			TaskId addressShaders = startupGraph.addTask("address shaders", [&]
+			{
+				addressGraphicsShaderStages[0] = loadShader(getShadersPath() + "computenbody/particle_bda.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+				addressCalculateShaderStage = loadShader(getShadersPath() + "computenbody/particle_calculate_bda.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+				addressIntegrateShaderStage = loadShader(getShadersPath() + "computenbody/particle_integrate_bda.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+			});
+			// The fragment shader is shared with the descriptor path
+			graphicsPassDependencies.push_back(startupGraph.addTask("address graphics pipeline", [&]
+			{
+				addressGraphicsShaderStages[1] = graphicsShaderStages[1];
+				prepareGraphicPipelines(addressGraphicsShaderStages, true);
+			}, { addressShaders, graphicsShaders, graphicsLayouts, baseTasks.renderPass, baseTasks.pipelineCache }));
+			computePassDependencies.push_back(startupGraph.addTask("address calculate pipeline", [&]
+			{
+				prepareCalculatePipeline(addressCalculateShaderStage, addressPath.computePipelineLayout, &addressPath.pipelineCalculate);
+			}, { addressShaders, computeLayouts, baseTasks.pipelineCache }));
+			computePassDependencies.push_back(startupGraph.addTask("address integrate pipeline", [&]
+			{
+				prepareIntegratePipeline(addressIntegrateShaderStage, addressPath.computePipelineLayout, &addressPath.pipelineIntegrate);
+			}, { addressShaders, computeLayouts, baseTasks.pipelineCache }));
+		}
+
+		if (splatting.available)
+		{
+			TaskId splattingShaders = startupGraph.addTask("splatting shaders", [&]
+			{
+				splattingBinShaderStage = loadShader(getShadersPath() + "computenbody/splat_bin.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+				splattingTilesShaderStage = loadShader(getShadersPath() + "computenbody/splat_tiles.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+				splattingResolveShaderStages[0] = loadShader(getShadersPath() + "computenbody/splat_resolve.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+				splattingResolveShaderStages[1] = loadShader(getShadersPath() + "computenbody/splat_resolve.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+			});
+			// The passes are recorded into the graphics command buffers
+			graphicsPassDependencies.push_back(startupGraph.addTask("splatting pipelines", [&]
+			{
+				prepareSplattingPipelines(splattingBinShaderStage, splattingTilesShaderStage, splattingResolveShaderStages);
+			}, { splattingShaders, splattingLayouts, baseTasks.renderPass, baseTasks.pipelineCache }));
+		}
+
+		startupGraph.addTask("graphics pass", [this] { prepareGraphicPass(); }, graphicsPassDependencies, Affinity::MainThread);
+		startupGraph.addTask("compute pass", [this] { prepareComputePass(); }, computePassDependencies);
+
+		runStartupGraph(startupGraph);
+		prepareFrameGraph();
 		prepared = true;
 	}
 
-	void draw()
+	void submitCompute(VkQueue queue)
 	{
+		vks::FrameStats::ScopedStage submitStage(frameStats, vks::FrameStats::Submit);
 		// Wait for rendering finished
 		VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 
@@ -614,11 +1343,56 @@ public:
 		computeSubmitInfo.pWaitDstStageMask = &waitStageMask;
 		computeSubmitInfo.signalSemaphoreCount = 1;
 		computeSubmitInfo.pSignalSemaphores = &compute.semaphore;
-		VK_CHECK_RESULT(vkQueueSubmit(compute.queue, 1, &computeSubmitInfo, VK_NULL_HANDLE));
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &computeSubmitInfo, VK_NULL_HANDLE));
+	}
 
-		VulkanExampleBase::prepareFrame();
+	// Queues a copy of the particles after the compute submit, the statistics are computed when collect finds it finished
+	void submitReadback(VkQueue queue)
+	{
+		if (!diagnostics.enabled)
+		{
+			return;
+		}
+		vks::FrameStats::ScopedStage submitStage(frameStats, vks::FrameStats::Submit);
+		VkBuffer source = (diagnostics.snapshot.buffer != VK_NULL_HANDLE) ? diagnostics.snapshot.buffer : storageBuffer.buffer;
+		// The fluid particles all have the same mass, their w component is the sprite size
+		const float uniformMass = fluid.active ? fluid.uniformData.mass : 0.0f;
+		readback.readBuffer(source, 0, storageBuffer.size, [this, uniformMass](const void* data, VkDeviceSize size)
+		{
+			updateDiagnostics(static_cast<const Particle*>(data), static_cast<size_t>(size / sizeof(Particle)), uniformMass);
+		});
+		readback.submit(queue);
+	}
+
+	/**
+	* @param uniformMass Mass of every particle, 0 if the masses are stored in the w components of the positions
+	*/
+	void updateDiagnostics(const Particle* particles, size_t count, float uniformMass)
+	{
+		glm::vec3 weightedPosition(0.0f);
+		float totalMass = 0.0f;
+		float kineticEnergy = 0.0f;
+		float maxSpeedSquared = 0.0f;
+		for (size_t i = 0; i < count; i++)
+		{
+			float mass = (uniformMass > 0.0f) ? uniformMass : particles[i].pos.w;
+			glm::vec3 velocity(particles[i].vel);
+			float speedSquared = glm::dot(velocity, velocity);
+			weightedPosition += glm::vec3(particles[i].pos) * mass;
+			totalMass += mass;
+			kineticEnergy += 0.5f * mass * speedSquared;
+			maxSpeedSquared = std::max(maxSpeedSquared, speedSquared);
+		}
+		diagnostics.centerOfMass = (totalMass > 0.0f) ? weightedPosition / totalMass : glm::vec3(0.0f);
+		diagnostics.kineticEnergy = kineticEnergy;
+		diagnostics.maxSpeed = std::sqrt(maxSpeedSquared);
+		diagnostics.samples++;
+	}
 
-		VkPipelineStageFlags graphicsWaitStageMasks[] = { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	void submitGraphics(VkQueue queue)
+	{
+		vks::FrameStats::ScopedStage submitStage(frameStats, vks::FrameStats::Submit);
+		VkPipelineStageFlags graphicsWaitStageMasks[] = { vertexReadStage(),VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 		VkSemaphore graphicsWaitSemaphores[] = { compute.semaphore,semaphores.presentComplete };
 		VkSemaphore graphicsSignalSemaphores[] = { graphics.semaphore, semaphores.renderComplete };
 
@@ -630,19 +1404,54 @@ public:
 		submitInfo.pWaitDstStageMask = graphicsWaitStageMasks;
 		submitInfo.signalSemaphoreCount = 2;
 		submitInfo.pSignalSemaphores = graphicsSignalSemaphores;
-		VK_CHECK_RESULT(vkQueueSubmit(graphicQueue, 1, &submitInfo, VK_NULL_HANDLE));
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+	}
 
+	void draw()
+	{
+		submitCompute(compute.queue);
+		submitReadback(compute.queue);
+		VulkanExampleBase::prepareFrame();
+		submitGraphics(graphicQueue);
 		VulkanExampleBase::submitFrame();
 	}
 
+	// The uniform updates run in parallel, each submit fires as soon as its inputs are written
+	void prepareFrameGraph()
+	{
+		typedef vks::TaskGraph::Affinity Affinity;
+		typedef vks::TaskGraph::NodeId NodeId;
+
+		NodeId computeUniforms = frameGraph.addNode("compute uniforms", [this] { updateComputeUniformBuffers(); });
+		NodeId graphicsUniforms = frameGraph.addNode("graphics uniforms", [this] { updateGraphicsUniformBuffers(); });
+		NodeId computeSubmit = frameGraph.addSubmitNode("compute submit", compute.queue, [this](VkQueue queue) { submitCompute(queue); }, { computeUniforms });
+		NodeId readbackSubmit = frameGraph.addSubmitNode("readback submit", compute.queue, [this](VkQueue queue) { submitReadback(queue); }, { computeSubmit });
+		// Acquire and present may recreate the swap chain and wait for the device, so they run on the main thread
+		// after the compute and readback submits, when no other node can be using a queue
+		NodeId acquire = frameGraph.addNode("acquire", [this] { VulkanExampleBase::prepareFrame(); }, { computeSubmit, readbackSubmit }, Affinity::MainThread);
+		NodeId graphicsSubmit = frameGraph.addSubmitNode("graphics submit", graphicQueue, [this](VkQueue queue) { submitGraphics(queue); },
+			{ acquire, graphicsUniforms });
+		frameGraph.addSubmitNode("present", graphicQueue, [this](VkQueue) { VulkanExampleBase::submitFrame(); }, { graphicsSubmit }, Affinity::MainThread);
+		frameGraph.workerPlacement = workerPlacement("vks frame");
+		frameGraph.compile(2);
+	}
+
 	void updateComputeUniformBuffers()
 	{
+		vks::FrameStats::ScopedStage updateStage(frameStats, vks::FrameStats::Update);
 		compute.uniformData.deltaT = paused ? 0.0f : frameTimer * 0.05f;
 		memcpy(compute.uniformBuffer.mappedData, &compute.uniformData, sizeof(Compute::ComputeUniformData));
+		if (fluid.available)
+		{
+			Fluid::UniformData uniformData = fluid.uniformData;
+			uniformData.deltaT = paused ? 0.0f : fluid.uniformData.deltaT;
+			memcpy(fluid.uniformBuffer.mappedData, &uniformData, sizeof(Fluid::UniformData));
+		}
 	}
 
 	void updateGraphicsUniformBuffers()
 	{
+		vks::FrameStats::ScopedStage updateStage(frameStats, vks::FrameStats::Update);
 		graphics.uniformData.projection = camera.matrices.perspective;
 		graphics.uniformData.view = camera.matrices.view;
 		graphics.uniformData.screenDim = glm::vec2((float)width, (float)height);
@@ -655,9 +1464,129 @@ public:
 		{
 			return;
 		}
-		updateComputeUniformBuffers();
-		updateGraphicsUniformBuffers();
-		draw();
+		// Callbacks of finished readbacks run here on the main thread, before this frame's nodes are started
+		readback.collect();
+		bool gpuTimesUpdated = false;
+		if (computeTimer.collect())
+		{
+			double milliseconds = computeTimer.getMilliseconds("compute");
+			if (fluid.active)
+			{
+				fluid.milliseconds = milliseconds;
+			}
+			else
+			{
+				computeMilliseconds[addressPath.active ? 1 : 0] = milliseconds;
+			}
+			gpuTimesUpdated = true;
+		}
+		if (renderTimer.collect())
+		{
+			renderMilliseconds[splatting.active ? 1 : 0] = renderTimer.getMilliseconds("particles");
+			gpuTimesUpdated = true;
+		}
+		// Simulation and particle rendering of the active paths, the overlay draws the frame timing panel from it
+		if (gpuTimesUpdated)
+		{
+			const double simulationMilliseconds = fluid.active ? fluid.milliseconds : computeMilliseconds[addressPath.active ? 1 : 0];
+			frameStats.setGpuMilliseconds(simulationMilliseconds + renderMilliseconds[splatting.active ? 1 : 0]);
+		}
+		if (useFrameGraph)
+		{
+			frameGraph.execute();
+		}
+		else
+		{
+			updateComputeUniformBuffers();
+			updateGraphicsUniformBuffers();
+			draw();
+		}
+		// The particles were replaced by this frame's compute submit, the following frames simulate without the copy
+		if (fluid.resetPending)
+		{
+			VK_CHECK_RESULT(vkQueueWaitIdle(compute.queue));
+			fluid.resetPending = false;
+			buildComputeCommandBuffer();
+		}
+	}
+
+	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay) override
+	{
+		if (overlay->header("Frame graph"))
+		{
+			overlay->checkBox("Run frame as task graph", &useFrameGraph);
+			if (useFrameGraph)
+			{
+				overlay->text("Last frame: %.3f ms, critical path %.3f ms", frameGraph.wallMilliseconds(), frameGraph.criticalPathMilliseconds());
+				if (overlay->button("Dump graph"))
+				{
+					const std::string fileName = "computenbody_framegraph.dot";
+					if (frameGraph.dumpDot(fileName))
+					{
+						std::cout << "Frame graph written to " << fileName << "\n";
+					}
+				}
+			}
+		}
+		if (overlay->header("Diagnostics"))
+		{
+			if (overlay->checkBox("Read back particles", &diagnostics.enabled))
+			{
+				// The snapshot copy is recorded into the compute command buffer, which must not be in use
+				VK_CHECK_RESULT(vkQueueWaitIdle(compute.queue));
+				buildComputeCommandBuffer();
+			}
+			if (diagnostics.samples > 0)
+			{
+				overlay->text("Center of mass: %.2f %.2f %.2f", diagnostics.centerOfMass.x, diagnostics.centerOfMass.y, diagnostics.centerOfMass.z);
+				overlay->text("Kinetic energy: %.1f", diagnostics.kineticEnergy);
+				overlay->text("Max speed: %.3f", diagnostics.maxSpeed);
+			}
+			vks::ReadbackManager::Statistics statistics = readback.statistics();
+			overlay->text("Readbacks: %llu completed, %llu rejected", (unsigned long long)statistics.completed, (unsigned long long)statistics.rejected);
+		}
+		if (overlay->header("Resource access"))
+		{
+			if (!addressPath.available)
+			{
+				overlay->text("Start with -bda to compare buffer device addresses");
+			}
+			else if (overlay->checkBox("Buffer device addresses", &addressPath.active))
+			{
+				// The graphics command buffers are rebuilt by the base class, the compute one must not be in use
+				VK_CHECK_RESULT(vkQueueWaitIdle(compute.queue));
+				buildComputeCommandBuffer();
+			}
+			overlay->text("Compute: %.3f ms descriptors, %.3f ms addresses", computeMilliseconds[0], computeMilliseconds[1]);
+		}
+		if (overlay->header("Renderer"))
+		{
+			if (!splatting.available)
+			{
+				overlay->text("Start with -cs to compare compute splatting");
+			}
+			else
+			{
+				// Changes mark the overlay as updated, the base class records the command buffers again
+				overlay->checkBox("Compute splatting", &splatting.active);
+				overlay->sliderFloat("LOD radius (px)", &splatting.constants.lodRadius, 0.0f, 4.0f);
+				overlay->sliderFloat("Exposure", &splatting.constants.exposure, 0.25f, 4.0f);
+			}
+			overlay->text("Particles: %.3f ms sprites, %.3f ms splats", renderMilliseconds[0], renderMilliseconds[1]);
+		}
+		if (overlay->header("Simulation"))
+		{
+			if (overlay->checkBox("SPH fluid", &fluid.active))
+			{
+				switchSimulation();
+			}
+			if (fluid.active)
+			{
+				overlay->sliderFloat("Stiffness", &fluid.uniformData.stiffness, 50.0f, 1000.0f);
+				overlay->sliderFloat("Viscosity", &fluid.uniformData.viscosity, 0.0f, 200.0f);
+				overlay->text("Fluid: %.3f ms for %u steps", fluid.milliseconds, fluid.substeps);
+			}
+		}
 	}
 
 private:
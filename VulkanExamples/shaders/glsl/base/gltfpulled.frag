@@ -0,0 +1,30 @@
+#version 450
+#extension GL_EXT_buffer_reference : require
+#extension GL_GOOGLE_include_directive : require
+
+// Reference fragment shader for vkglTF::Model::drawPulled, the material factors come from the material buffer
+
+#include "vertexpulling.glsl"
+
+layout (set = 1, binding = 0) uniform sampler2D samplerColorMap;
+
+layout (location = 0) in vec3 inWorldPos;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec2 inUV;
+layout (location = 3) in vec4 inColor;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main() 
+{
+	Material material = pullMaterial();
+	vec4 color = texture(samplerColorMap, inUV) * material.baseColorFactor * inColor;
+	if ((material.alphaMode == ALPHA_MODE_MASK) && (color.a < material.alphaCutoff))
+	{
+		discard;
+	}
+	vec3 N = normalize(inNormal);
+	vec3 L = normalize(vec3(0.5, 1.0, 0.25));
+	float diffuse = max(dot(N, L), 0.15);
+	outFragColor = vec4(color.rgb * diffuse, color.a);
+}
@@ -0,0 +1,35 @@
+#version 450
+#extension GL_EXT_buffer_reference : require
+#extension GL_GOOGLE_include_directive : require
+
+// Reference vertex shader for vkglTF::Model::drawPulled, the pipeline has no vertex input state
+
+#include "vertexpulling.glsl"
+
+layout (set = 0, binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 view;
+} ubo;
+
+layout (location = 0) out vec3 outWorldPos;
+layout (location = 1) out vec3 outNormal;
+layout (location = 2) out vec2 outUV;
+layout (location = 3) out vec4 outColor;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+void main() 
+{
+	uint vertex = gl_VertexIndex;
+	mat4 model = pullModelMatrix(vertex);
+	vec4 worldPos = model * vec4(pullVec3(vertex, ATTRIBUTE_POSITION), 1.0);
+	outWorldPos = worldPos.xyz;
+	outNormal = mat3(model) * pullVec3(vertex, ATTRIBUTE_NORMAL);
+	outUV = pullVec2(vertex, ATTRIBUTE_UV);
+	outColor = pullVec4(vertex, ATTRIBUTE_COLOR);
+	gl_Position = ubo.projection * ubo.view * worldPos;
+}
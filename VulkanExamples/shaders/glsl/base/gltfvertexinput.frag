@@ -0,0 +1,21 @@
+#version 450
+
+// Fragment shader of the vertex input path, matches gltfpulled.frag for opaque materials with a white base color factor
+
+layout (set = 1, binding = 0) uniform sampler2D samplerColorMap;
+
+layout (location = 0) in vec3 inWorldPos;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec2 inUV;
+layout (location = 3) in vec4 inColor;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main() 
+{
+	vec4 color = texture(samplerColorMap, inUV) * inColor;
+	vec3 N = normalize(inNormal);
+	vec3 L = normalize(vec3(0.5, 1.0, 0.25));
+	float diffuse = max(dot(N, L), 0.15);
+	outFragColor = vec4(color.rgb * diffuse, color.a);
+}
@@ -0,0 +1,42 @@
+#version 450
+
+// Vertex input counterpart of gltfpulled.vert for vkglTF::Model::draw, the node matrix comes from the mesh uniform buffer set
+// Skinning is left out, the comparison in vkglTF::benchmarkVertexPulling uses static meshes
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec2 inUV;
+layout (location = 3) in vec4 inColor;
+
+layout (set = 0, binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 view;
+} ubo;
+
+layout (set = 2, binding = 0) uniform UBONode 
+{
+	mat4 matrix;
+	mat4 jointMatrix[64];
+	float jointCount;
+} node;
+
+layout (location = 0) out vec3 outWorldPos;
+layout (location = 1) out vec3 outNormal;
+layout (location = 2) out vec2 outUV;
+layout (location = 3) out vec4 outColor;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+void main() 
+{
+	vec4 worldPos = node.matrix * vec4(inPos, 1.0);
+	outWorldPos = worldPos.xyz;
+	outNormal = mat3(node.matrix) * inNormal;
+	outUV = inUV;
+	outColor = inColor;
+	gl_Position = ubo.projection * ubo.view * worldPos;
+}
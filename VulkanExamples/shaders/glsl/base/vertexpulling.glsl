@@ -0,0 +1,99 @@
+// Vertex pulling for vkglTF::Model::drawPulled
+// Vertices, materials and the node's uniform block are read through the buffer device addresses in the push constants,
+// the vertex layout is described by the stride and the attribute offsets so one pipeline serves every vertex format
+
+#define ATTRIBUTE_POSITION 0
+#define ATTRIBUTE_NORMAL 1
+#define ATTRIBUTE_UV 2
+#define ATTRIBUTE_COLOR 3
+#define ATTRIBUTE_TANGENT 4
+#define ATTRIBUTE_JOINT0 5
+#define ATTRIBUTE_WEIGHT0 6
+
+#define ALPHA_MODE_OPAQUE 0
+#define ALPHA_MODE_MASK 1
+#define ALPHA_MODE_BLEND 2
+
+struct Material
+{
+	vec4 baseColorFactor;
+	float metallicFactor;
+	float roughnessFactor;
+	float alphaCutoff;
+	uint alphaMode;
+};
+
+layout(std430, buffer_reference, buffer_reference_align = 4) readonly buffer VertexData
+{
+	float values[ ];
+};
+
+layout(std430, buffer_reference, buffer_reference_align = 16) readonly buffer MaterialData
+{
+	Material materials[ ];
+};
+
+layout(std140, buffer_reference, buffer_reference_align = 16) readonly buffer NodeData
+{
+	mat4 matrix;
+	mat4 jointMatrix[64];
+	float jointCount;
+};
+
+layout(push_constant) uniform PullPushConstants
+{
+	VertexData vertices;
+	MaterialData materials;
+	NodeData node;
+	uint vertexStride;
+	uint materialIndex;
+	uvec2 attributeOffsets;
+} pull;
+
+uint attributeOffset(uint attribute)
+{
+	return (pull.attributeOffsets[attribute / 4] >> ((attribute % 4) * 8)) & 0xff;
+}
+
+float pullFloat(uint vertex, uint attribute, uint component)
+{
+	return pull.vertices.values[vertex * pull.vertexStride + attributeOffset(attribute) + component];
+}
+
+vec2 pullVec2(uint vertex, uint attribute)
+{
+	return vec2(pullFloat(vertex, attribute, 0), pullFloat(vertex, attribute, 1));
+}
+
+vec3 pullVec3(uint vertex, uint attribute)
+{
+	return vec3(pullVec2(vertex, attribute), pullFloat(vertex, attribute, 2));
+}
+
+vec4 pullVec4(uint vertex, uint attribute)
+{
+	return vec4(pullVec3(vertex, attribute), pullFloat(vertex, attribute, 3));
+}
+
+Material pullMaterial()
+{
+	return pull.materials.materials[pull.materialIndex];
+}
+
+// Node matrix, skinned with the node's joints if it has any
+mat4 pullModelMatrix(uint vertex)
+{
+	NodeData node = pull.node;
+	if (node.jointCount > 0.0)
+	{
+		vec4 joint = pullVec4(vertex, ATTRIBUTE_JOINT0);
+		vec4 weight = pullVec4(vertex, ATTRIBUTE_WEIGHT0);
+		mat4 skinMatrix =
+			weight.x * node.jointMatrix[int(joint.x)] +
+			weight.y * node.jointMatrix[int(joint.y)] +
+			weight.z * node.jointMatrix[int(joint.z)] +
+			weight.w * node.jointMatrix[int(joint.w)];
+		return node.matrix * skinMatrix;
+	}
+	return node.matrix;
+}
@@ -0,0 +1,76 @@
+// Clustered light lookup shared by deferred composition and forward+ shaders
+// Bindings match vks::ClusteredLighting::shadingSetLayout, define CLUSTER_SET before including to move the set
+
+#ifndef CLUSTER_SET
+#define CLUSTER_SET 1
+#endif
+
+struct Light
+{
+	vec4 positionRadius;
+	vec4 colorIntensity;
+};
+
+layout (set = CLUSTER_SET, binding = 0) uniform ClusterUBO 
+{
+	mat4 view;
+	mat4 inverseProjection;
+	uvec4 gridSize;
+	vec4 screen;
+	vec4 slicing;
+} clusterUbo;
+
+layout (std430, set = CLUSTER_SET, binding = 1) readonly buffer Lights 
+{
+	Light lights[ ];
+};
+
+layout (std430, set = CLUSTER_SET, binding = 2) readonly buffer ClusterRanges 
+{
+	uvec2 clusterRanges[ ];
+};
+
+layout (std430, set = CLUSTER_SET, binding = 3) readonly buffer LightIndices 
+{
+	uint lightIndices[ ];
+};
+
+// Returns the light index range (offset, count) of the cluster containing a fragment
+uvec2 getClusterRange(vec2 fragCoord, vec3 worldPos)
+{
+	uvec3 grid = clusterUbo.gridSize.xyz;
+	float viewDepth = -(clusterUbo.view * vec4(worldPos, 1.0)).z;
+	uvec2 tile = min(uvec2(fragCoord / clusterUbo.screen.xy * vec2(grid.xy)), grid.xy - 1);
+	int slice = int(floor(log(max(viewDepth, clusterUbo.screen.z)) * clusterUbo.slicing.x + clusterUbo.slicing.y));
+	uint z = uint(clamp(slice, 0, int(grid.z) - 1));
+	return clusterRanges[tile.x + grid.x * (tile.y + grid.y * z)];
+}
+
+// Blinn-Phong contribution of a single point light with smooth radius falloff
+vec3 shadeLight(Light light, vec3 worldPos, vec3 N, vec3 V, vec3 albedo, float specular)
+{
+	vec3 L = light.positionRadius.xyz - worldPos;
+	float dist = length(L);
+	float radius = light.positionRadius.w;
+	if (dist >= radius)
+		return vec3(0.0);
+	L /= dist;
+	float falloff = clamp(1.0 - pow(dist / radius, 4.0), 0.0, 1.0);
+	float atten = falloff * falloff / (dist * dist + 1.0);
+	vec3 color = light.colorIntensity.rgb * light.colorIntensity.w;
+	float NdotL = max(0.0, dot(N, L));
+	vec3 H = normalize(L + V);
+	float NdotH = max(0.0, dot(N, H));
+	return color * atten * (albedo * NdotL + specular * pow(NdotH, 32.0));
+}
+
+vec3 shadeClustered(vec2 fragCoord, vec3 worldPos, vec3 N, vec3 V, vec3 albedo, float specular)
+{
+	uvec2 range = getClusterRange(fragCoord, worldPos);
+	vec3 color = vec3(0.0);
+	for (uint i = 0; i < range.y; i++)
+	{
+		color += shadeLight(lights[lightIndices[range.x + i]], worldPos, N, V, albedo, specular);
+	}
+	return color;
+}
@@ -0,0 +1,46 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : require
+
+layout (set = 0, binding = 1) uniform sampler2D samplerposition;
+layout (set = 0, binding = 2) uniform sampler2D samplerNormal;
+layout (set = 0, binding = 3) uniform sampler2D samplerAlbedo;
+
+layout (set = 0, binding = 4) uniform UBO 
+{
+	vec4 viewPos;
+	int displayDebugTarget;
+} ubo;
+
+#define CLUSTER_SET 1
+#include "clusters.glsl"
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragcolor;
+
+// Heat map of the number of lights per cluster
+vec3 lightCountHeatmap(uint count)
+{
+	float t = clamp(float(count) / 64.0, 0.0, 1.0);
+	return mix(vec3(0.0, 0.0, 1.0), vec3(1.0, 0.0, 0.0), t);
+}
+
+void main() 
+{
+	// Get G-Buffer values
+	vec3 fragPos = texture(samplerposition, inUV).rgb;
+	vec3 normal = texture(samplerNormal, inUV).rgb;
+	vec4 albedo = texture(samplerAlbedo, inUV);
+
+	if (ubo.displayDebugTarget == 1) {
+		outFragcolor = vec4(lightCountHeatmap(getClusterRange(gl_FragCoord.xy, fragPos).y), 1.0);
+		return;
+	}
+
+	vec3 N = normalize(normal);
+	vec3 V = normalize(ubo.viewPos.xyz - fragPos);
+	vec3 fragcolor = shadeClustered(gl_FragCoord.xy, fragPos, N, V, albedo.rgb, albedo.a);
+
+	outFragcolor = vec4(fragcolor, 1.0);
+}
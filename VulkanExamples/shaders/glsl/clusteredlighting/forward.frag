@@ -0,0 +1,29 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : require
+
+// Forward+ variant: same cluster lookup as the deferred composition, fed from interpolated attributes
+
+layout (set = 0, binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 view;
+	mat4 model;
+	vec4 viewPos;
+} ubo;
+
+#define CLUSTER_SET 1
+#include "clusters.glsl"
+
+layout (location = 0) in vec3 inWorldPos;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec3 inColor;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main() 
+{
+	vec3 N = normalize(inNormal);
+	vec3 V = normalize(ubo.viewPos.xyz - inWorldPos);
+	outFragColor = vec4(shadeClustered(gl_FragCoord.xy, inWorldPos, N, V, inColor, 0.5), 1.0);
+}
@@ -0,0 +1,27 @@
+#version 450
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec2 inUV;
+layout (location = 3) in vec3 inColor;
+
+layout (set = 0, binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 view;
+	mat4 model;
+	vec4 viewPos;
+} ubo;
+
+layout (location = 0) out vec3 outWorldPos;
+layout (location = 1) out vec3 outNormal;
+layout (location = 2) out vec3 outColor;
+
+void main() 
+{
+	vec4 worldPos = ubo.model * vec4(inPos, 1.0);
+	outWorldPos = worldPos.xyz;
+	outNormal = mat3(ubo.model) * inNormal;
+	outColor = inColor;
+	gl_Position = ubo.projection * ubo.view * worldPos;
+}
@@ -42,6 +42,10 @@ for root, dirs, files in os.walk(dir_path):
 
             if file.endswith(".rgen") or file.endswith(".rchit") or file.endswith(".rmiss"):
                add_params = add_params + " --target-env vulkan1.2"
+            elif "GL_EXT_buffer_reference" in open(input_file).read():
+               add_params = add_params + " --target-env vulkan1.2"
+            elif "GL_KHR_shader_subgroup" in open(input_file).read():
+               add_params = add_params + " --target-env vulkan1.1"
 
             res = subprocess.call("%s -V %s -o %s %s" % (glslang_path, input_file, output_file, add_params), shell=True)
             # res = subprocess.call([glslang_path, '-V', input_file, '-o', output_file, add_params], shell=True)
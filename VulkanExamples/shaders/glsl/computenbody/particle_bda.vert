@@ -0,0 +1,51 @@
+#version 450
+#extension GL_EXT_buffer_reference : require
+
+struct Particle
+{
+	vec4 pos;
+	vec4 vel;
+};
+
+// Vertex pulling: the particle of this vertex is read from the storage buffer's device address, the pipeline has no vertex input
+layout(std430, buffer_reference, buffer_reference_align = 16) readonly buffer Particles
+{
+	Particle particles[ ];
+};
+
+layout(std140, buffer_reference, buffer_reference_align = 16) readonly buffer UBO
+{
+	mat4 projection;
+	mat4 modelview;
+	vec2 screendim;
+};
+
+layout(push_constant) uniform PushConstants
+{
+	Particles particleBuffer;
+	UBO ubo;
+} pushConstants;
+
+layout (location = 0) out float outGradientPos;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+	float gl_PointSize;
+};
+
+void main () 
+{
+	Particle particle = pushConstants.particleBuffer.particles[gl_VertexIndex];
+	UBO ubo = pushConstants.ubo;
+
+	const float spriteSize = 0.005 * particle.pos.w; // Point size influenced by mass (stored in pos.w);
+
+	vec4 eyePos = ubo.modelview * vec4(particle.pos.xyz, 1.0); 
+	vec4 projectedCorner = ubo.projection * vec4(0.5 * spriteSize, 0.5 * spriteSize, eyePos.z, eyePos.w);
+	gl_PointSize = clamp(ubo.screendim.x * projectedCorner.x / projectedCorner.w, 1.0, 128.0);
+	
+	gl_Position = ubo.projection * eyePos;
+
+	outGradientPos = particle.vel.w;
+}
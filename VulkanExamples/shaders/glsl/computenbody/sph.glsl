@@ -0,0 +1,41 @@
+// Declarations shared by the SPH fluid passes, set 0 matches the fluid descriptor set of the computenbody example,
+// the neighbor grid is bound at set 1
+
+#extension GL_GOOGLE_include_directive : require
+
+#define GRID_SET 1
+#include "../neighborgrid/grid.glsl"
+
+#define PI 3.14159265359
+
+struct Particle
+{
+	vec4 pos;
+	vec4 vel;
+};
+
+// Integrated particles are written in the sorted order, the next grid build sorts from nearly sorted input
+layout (std430, set = 0, binding = 0) writeonly buffer Particles 
+{
+	Particle particles[ ];
+};
+
+layout (set = 0, binding = 1) uniform UBO 
+{
+	vec4 gravity;
+	float deltaT;
+	uint particleCount;
+	// Smoothing radius, equals the cell size of the grid
+	float h;
+	float restDensity;
+	float mass;
+	float stiffness;
+	float viscosity;
+	float boundsRadius;
+} ubo;
+
+// Density and pressure per sorted particle
+layout (std430, set = 0, binding = 2) buffer Densities 
+{
+	vec2 densities[ ];
+};
@@ -0,0 +1,103 @@
+// Declarations shared by the compute splatting passes, bindings match the splatting descriptor set of the computenbody example
+
+#define TILE_SIZE 16
+// Accumulated colors are stored as fixed point, 8 fractional bits leave room for 2^24 sprites of full intensity per pixel
+#define FIXED_POINT_SCALE 256.0
+
+struct Particle
+{
+	vec4 pos;
+	vec4 vel;
+};
+
+layout (std430, binding = 0) readonly buffer Particles 
+{
+	Particle particles[ ];
+};
+
+layout (binding = 1) uniform UBO 
+{
+	mat4 projection;
+	mat4 modelview;
+	vec2 screendim;
+} ubo;
+
+layout (binding = 2) uniform sampler2D samplerColorMap;
+layout (binding = 3) uniform sampler2D samplerGradientRamp;
+
+layout (std430, binding = 4) buffer TileCounts 
+{
+	uint tileCounts[ ];
+};
+
+// tileCapacity particle indices per tile
+layout (std430, binding = 5) buffer TileEntries 
+{
+	uint tileEntries[ ];
+};
+
+// Four uints (rgb and padding) per pixel
+layout (std430, binding = 6) buffer Accumulation 
+{
+	uint accumulation[ ];
+};
+
+// Four uints per density cell of lodCellSize x lodCellSize pixels
+layout (std430, binding = 7) buffer Density 
+{
+	uint density[ ];
+};
+
+layout (push_constant) uniform PushConstants 
+{
+	uvec2 size;
+	uvec2 tiles;
+	uvec2 densitySize;
+	uint tileCapacity;
+	uint lodCellSize;
+	float lodRadius;
+	float exposure;
+} pushConstants;
+
+struct Splat
+{
+	vec2 center;
+	float size;
+	vec3 color;
+};
+
+// Screen position and point size exactly as particle.vert computes them, false if the particle is clipped
+bool projectParticle(Particle particle, out Splat splat)
+{
+	const float spriteSize = 0.005 * particle.pos.w;
+	vec4 eyePos = ubo.modelview * vec4(particle.pos.xyz, 1.0);
+	vec4 clipPos = ubo.projection * eyePos;
+	if ((clipPos.w <= 0.0) || (clipPos.z < 0.0) || (clipPos.z > clipPos.w))
+	{
+		return false;
+	}
+	vec4 projectedCorner = ubo.projection * vec4(0.5 * spriteSize, 0.5 * spriteSize, eyePos.z, eyePos.w);
+	splat.size = clamp(ubo.screendim.x * projectedCorner.x / projectedCorner.w, 1.0, 128.0);
+	splat.center = (clipPos.xy / clipPos.w * 0.5 + 0.5) * vec2(pushConstants.size);
+	splat.color = textureLod(samplerGradientRamp, vec2(particle.vel.w, 0.0), 0.0).rgb;
+	return true;
+}
+
+// Sprite color of a splat at a pixel, the point coordinate is taken at the pixel center like the rasterizer does
+vec3 splatColor(Splat splat, ivec2 pixel)
+{
+	vec2 pointCoord = (vec2(pixel) + 0.5 - (splat.center - 0.5 * splat.size)) / splat.size;
+	if (any(lessThan(pointCoord, vec2(0.0))) || any(greaterThanEqual(pointCoord, vec2(1.0))))
+	{
+		return vec3(0.0);
+	}
+	return textureLod(samplerColorMap, pointCoord, 0.0).rgb * splat.color;
+}
+
+void accumulate(uint index, vec3 color)
+{
+	uvec3 fixedPoint = uvec3(color * FIXED_POINT_SCALE + 0.5);
+	atomicAdd(accumulation[index * 4 + 0], fixedPoint.r);
+	atomicAdd(accumulation[index * 4 + 1], fixedPoint.g);
+	atomicAdd(accumulation[index * 4 + 2], fixedPoint.b);
+}
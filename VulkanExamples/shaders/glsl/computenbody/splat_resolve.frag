@@ -0,0 +1,54 @@
+#version 450
+
+// Adds the bilinearly filtered density grid of the merged distant particles to the splatted sprites and tone maps the sum,
+// the curve is close to linear for dim pixels so the result matches the additive sprite path until that saturates
+
+#define FIXED_POINT_SCALE 256.0
+
+// Only read here, matches the declarations in splat.glsl
+layout (std430, binding = 6) readonly buffer Accumulation 
+{
+	uint accumulation[ ];
+};
+
+layout (std430, binding = 7) readonly buffer Density 
+{
+	uint density[ ];
+};
+
+layout (push_constant) uniform PushConstants 
+{
+	uvec2 size;
+	uvec2 tiles;
+	uvec2 densitySize;
+	uint tileCapacity;
+	uint lodCellSize;
+	float lodRadius;
+	float exposure;
+} pushConstants;
+
+layout (location = 0) out vec4 outFragColor;
+
+vec3 densityCell(ivec2 cell)
+{
+	cell = clamp(cell, ivec2(0), ivec2(pushConstants.densitySize) - 1);
+	uint index = (uint(cell.y) * pushConstants.densitySize.x + uint(cell.x)) * 4;
+	return vec3(density[index], density[index + 1], density[index + 2]);
+}
+
+void main () 
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	uint index = (uint(pixel.y) * pushConstants.size.x + uint(pixel.x)) * 4;
+	vec3 color = vec3(accumulation[index], accumulation[index + 1], accumulation[index + 2]);
+
+	// Cell energy is spread over the cell's pixels
+	vec2 cellCoord = gl_FragCoord.xy / float(pushConstants.lodCellSize) - 0.5;
+	ivec2 cell = ivec2(floor(cellCoord));
+	vec2 weight = cellCoord - vec2(cell);
+	vec3 merged = mix(mix(densityCell(cell), densityCell(cell + ivec2(1, 0)), weight.x),
+		mix(densityCell(cell + ivec2(0, 1)), densityCell(cell + ivec2(1, 1)), weight.x), weight.y);
+	color += merged / float(pushConstants.lodCellSize * pushConstants.lodCellSize);
+
+	outFragColor = vec4(1.0 - exp(-color / FIXED_POINT_SCALE * pushConstants.exposure), 1.0);
+}
@@ -0,0 +1,105 @@
+// Declarations shared by the BVH path tracer passes, bindings match vks::ComputeTracer::setupDescriptors
+
+#define RAY_MIN_DISTANCE 0.0001
+#define MISS_DISTANCE 1e30
+#define NO_HIT 0xffffffffu
+// Matches vks::bvh::maxDepth
+#define STACK_SIZE 64
+
+struct Ray
+{
+	vec3 origin;
+	uint pixel;
+	vec3 direction;
+	uint rng;
+	vec4 throughput;
+};
+
+struct Hit
+{
+	float t;
+	float u;
+	float v;
+	uint triangle;
+};
+
+struct Node
+{
+	vec3 min;
+	uint leftFirst;
+	vec3 max;
+	uint count;
+};
+
+struct Triangle
+{
+	vec3 v0;
+	uint color;
+	vec4 edge1;
+	vec4 edge2;
+};
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 inverseView;
+	mat4 inverseProjection;
+	// Width, height, max bounces and pixel count
+	uvec4 size;
+	vec4 skyColor;
+} ubo;
+
+layout (std430, binding = 1) readonly buffer Nodes 
+{
+	Node nodes[ ];
+};
+
+layout (std430, binding = 2) readonly buffer Triangles 
+{
+	Triangle triangles[ ];
+};
+
+// Two queues of size.w rays each
+layout (std430, binding = 3) buffer Rays 
+{
+	Ray rays[ ];
+};
+
+layout (std430, binding = 4) buffer Hits 
+{
+	Hit hits[ ];
+};
+
+layout (std430, binding = 5) buffer Counters 
+{
+	uint queueCount[2];
+	uint traceNext;
+	uint tracedRays;
+};
+
+layout (std430, binding = 6) buffer Accumulation 
+{
+	vec4 accumulation[ ];
+};
+
+layout (binding = 7, rgba8) uniform writeonly image2D resultImage;
+
+layout (push_constant) uniform PushConstants 
+{
+	uint queue;
+	uint bounce;
+	uint sampleIndex;
+} pushConstants;
+
+// PCG hash, advances the state and returns a float in [0, 1)
+float random(inout uint state)
+{
+	state = state * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	word = (word >> 22u) ^ word;
+	return float(word >> 8u) / 16777216.0;
+}
+
+uint rayIndex(uint queue, uint index)
+{
+	return queue * ubo.size.w + index;
+}
@@ -0,0 +1,57 @@
+// Neighbor grid queries, include from shaders that read a grid built by vks::NeighborGrid and bind its querySet at GRID_SET
+//
+// Walking the neighbours of a position:
+//
+//	ivec3 cell = gridCell(pos, gridParams.cellSize);
+//	for (int n = 0; n < 27; n++)
+//	{
+//		ivec3 neighbor = cell + gridNeighborOffset(n);
+//		uint hash = gridHash(neighbor, gridParams.tableSize);
+//		uint end = gridCellStarts[hash] + gridCellCounts[hash];
+//		for (uint i = gridCellStarts[hash]; i < end; i++)
+//		{
+//			// Cells that share a hash share their range, skip particles of the other cells
+//			if (gridCell(gridParticles[i].pos.xyz, gridParams.cellSize) != neighbor) continue;
+//			...
+//		}
+//	}
+//
+// Cells with the same hash are visited once per cell, the check keeps every particle from being counted more than once
+
+#extension GL_GOOGLE_include_directive : require
+
+#include "grid_common.glsl"
+
+#ifndef GRID_SET
+#define GRID_SET 1
+#endif
+
+layout (set = GRID_SET, binding = 0) uniform GridParams 
+{
+	float cellSize;
+	uint particleCount;
+	uint tableSize;
+	uint padding;
+} gridParams;
+
+layout (std430, set = GRID_SET, binding = 1) readonly buffer GridCellStarts 
+{
+	uint gridCellStarts[ ];
+};
+
+layout (std430, set = GRID_SET, binding = 2) readonly buffer GridCellCounts 
+{
+	uint gridCellCounts[ ];
+};
+
+// The particles in cell order
+layout (std430, set = GRID_SET, binding = 3) readonly buffer GridParticles 
+{
+	GridParticle gridParticles[ ];
+};
+
+// Input index of every sorted particle
+layout (std430, set = GRID_SET, binding = 4) readonly buffer GridSortedIndices 
+{
+	uint gridSortedIndices[ ];
+};
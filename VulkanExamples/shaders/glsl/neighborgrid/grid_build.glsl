@@ -0,0 +1,54 @@
+// Declarations shared by the neighbor grid build passes, bindings match vks::NeighborGrid::buildSetLayout
+
+#extension GL_GOOGLE_include_directive : require
+
+#include "grid_common.glsl"
+
+layout (binding = 0) uniform GridParams 
+{
+	float cellSize;
+	uint particleCount;
+	uint tableSize;
+	uint padding;
+} gridParams;
+
+layout (std430, binding = 1) readonly buffer Particles 
+{
+	GridParticle particles[ ];
+};
+
+layout (std430, binding = 2) buffer CellCounts 
+{
+	uint cellCounts[ ];
+};
+
+layout (std430, binding = 3) buffer CellStarts 
+{
+	uint cellStarts[ ];
+};
+
+// Cell hash and rank inside the cell of every input particle
+layout (std430, binding = 4) buffer ParticleCells 
+{
+	uvec2 particleCells[ ];
+};
+
+layout (std430, binding = 5) buffer BlockSums 
+{
+	uint blockSums[ ];
+};
+
+layout (std430, binding = 6) writeonly buffer SortedParticles 
+{
+	GridParticle sortedParticles[ ];
+};
+
+layout (std430, binding = 7) writeonly buffer SortedIndices 
+{
+	uint sortedIndices[ ];
+};
+
+layout (push_constant) uniform PushConstants 
+{
+	uint pass;
+} pushConstants;
@@ -0,0 +1,25 @@
+// Declarations shared by the neighbor grid build and query shaders, see vks::NeighborGrid
+
+struct GridParticle
+{
+	vec4 pos;
+	vec4 vel;
+};
+
+ivec3 gridCell(vec3 pos, float cellSize)
+{
+	return ivec3(floor(pos / cellSize));
+}
+
+// Table index of a cell, the table size is a power of two. Matches vks::NeighborGrid::hash
+uint gridHash(ivec3 cell, uint tableSize)
+{
+	uvec3 c = uvec3(cell);
+	return ((c.x * 73856093u) ^ (c.y * 19349663u) ^ (c.z * 83492791u)) & (tableSize - 1u);
+}
+
+// Offset of the n-th of the 27 cells around a cell
+ivec3 gridNeighborOffset(int n)
+{
+	return ivec3(n % 3, (n / 3) % 3, n / 9) - 1;
+}
@@ -0,0 +1,60 @@
+// Shared declarations of the compute post processing stack, matches vks::PostProcessStack::Params
+
+layout (binding = 0) uniform UBO 
+{
+	float bloomThreshold;
+	float bloomKnee;
+	float bloomIntensity;
+	float exposure;
+	float minLogLuminance;
+	float logLuminanceRange;
+	float deltaTime;
+	float adaptationRate;
+	uint autoExposure;
+	uint pixelCount;
+} ubo;
+
+layout (push_constant) uniform PushConsts 
+{
+	vec2 srcTexelSize;
+	uint prefilter;
+} pushConsts;
+
+#define HISTOGRAM_BIN_COUNT 256
+
+float luminance(vec3 color)
+{
+	return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// 9 tap tent filter with a radius of one source texel
+vec3 upsampleTent(sampler2D src, vec2 uv, vec2 texelSize)
+{
+	vec4 d = texelSize.xyxy * vec4(1.0, 1.0, -1.0, 0.0);
+	vec3 result = texture(src, uv - d.xy).rgb;
+	result += texture(src, uv - d.wy).rgb * 2.0;
+	result += texture(src, uv - d.zy).rgb;
+	result += texture(src, uv + d.zw).rgb * 2.0;
+	result += texture(src, uv).rgb * 4.0;
+	result += texture(src, uv + d.xw).rgb * 2.0;
+	result += texture(src, uv + d.zy).rgb;
+	result += texture(src, uv + d.wy).rgb * 2.0;
+	result += texture(src, uv + d.xy).rgb;
+	return result * (1.0 / 16.0);
+}
+
+// Temporally adapted average luminance from the bin weighted histogram sum
+float adaptLuminance(float weightedSum, uint blackPixels, float previousLuminance)
+{
+	float validPixels = max(float(ubo.pixelCount) - float(blackPixels), 1.0);
+	float averageBin = weightedSum / validPixels - 1.0;
+	float logLum = (averageBin / float(HISTOGRAM_BIN_COUNT - 2)) * ubo.logLuminanceRange + ubo.minLogLuminance;
+	float lum = exp2(logLum);
+	return previousLuminance + (lum - previousLuminance) * (1.0 - exp(-ubo.deltaTime * ubo.adaptationRate));
+}
+
+// Maps the adapted luminance to middle grey
+float luminanceToExposure(float lum)
+{
+	return 0.18 / max(lum, 1e-4);
+}
@@ -0,0 +1,31 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : require
+
+#include "terrain_streaming.glsl"
+
+layout (location = 0) in vec3 inNormal;
+layout (location = 1) in vec3 inWorldPos;
+layout (location = 2) in float inHeight;
+
+layout (location = 0) out vec4 outFragColor;
+
+vec3 heightColor(float height)
+{
+	vec3 low = vec3(0.25, 0.4, 0.15);
+	vec3 mid = vec3(0.45, 0.38, 0.3);
+	vec3 high = vec3(0.95, 0.95, 0.97);
+	return height < 0.5 ? mix(low, mid, height * 2.0) : mix(mid, high, (height - 0.5) * 2.0);
+}
+
+void main()
+{
+	vec3 N = normalize(inNormal);
+	// A negative height scale flips the terrain for y down cameras
+	if (ubo.viewport.w < 0.0)
+	{
+		N = -N;
+	}
+	float diffuse = max(dot(N, ubo.lightDir.xyz), 0.0);
+	outFragColor = vec4(heightColor(clamp(inHeight, 0.0, 1.0)) * (0.3 + 0.7 * diffuse), 1.0);
+}
@@ -0,0 +1,35 @@
+// Shared declarations of the streaming terrain shaders, matches vks::StreamingTerrain::UniformData
+
+layout (set = 0, binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 view;
+	vec4 lightDir;
+	// xy: viewport size, z: tessellated edge size, w: height scale
+	vec4 viewport;
+	// x: tile resolution, y: patches per tile
+	vec4 tileParams;
+} ubo;
+
+layout (set = 0, binding = 1) uniform sampler2DArray heightAtlas;
+
+// Height of a tile at tile local coordinates, sample positions are hit exactly so shared borders match
+float sampleHeight(vec2 uv, float layer)
+{
+	float resolution = ubo.tileParams.x;
+	vec2 texCoord = (uv * (resolution - 1.0) + 0.5) / resolution;
+	return textureLod(heightAtlas, vec3(texCoord, layer), 0.0).r * ubo.viewport.w;
+}
+
+// Height along an edge shared with a coarser tile: interpolate between the samples the coarser tile has,
+// its data is a decimation of ours so both sides produce the same positions
+float sampleEdgeHeight(vec2 uv, float layer, float levelDelta, bool alongX)
+{
+	float spacing = exp2(levelDelta) / (ubo.tileParams.x - 1.0);
+	float t = alongX ? uv.x : uv.y;
+	float t0 = min(floor(t / spacing) * spacing, 1.0 - spacing);
+	float f = clamp((t - t0) / spacing, 0.0, 1.0);
+	vec2 uv0 = alongX ? vec2(t0, uv.y) : vec2(uv.x, t0);
+	vec2 uv1 = alongX ? vec2(t0 + spacing, uv.y) : vec2(uv.x, t0 + spacing);
+	return mix(sampleHeight(uv0, layer), sampleHeight(uv1, layer), f);
+}
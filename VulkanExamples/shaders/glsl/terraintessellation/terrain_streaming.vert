@@ -0,0 +1,22 @@
+#version 450
+
+// Patch corner of the shared tile grid, placed into the world with the per tile instance data
+
+layout (location = 0) in vec2 inPatchUV;
+// xy: world origin (x/z), z: tile edge length, w: atlas layer
+layout (location = 1) in vec4 inOriginSize;
+// Level difference to the coarser neighbour on the -x, +x, -z, +z edge
+layout (location = 2) in vec4 inNeighbourDeltas;
+
+layout (location = 0) out vec2 outUV;
+layout (location = 1) out vec4 outOriginSize;
+layout (location = 2) out vec4 outNeighbourDeltas;
+
+void main(void)
+{
+	vec2 xz = inOriginSize.xy + inPatchUV * inOriginSize.z;
+	gl_Position = vec4(xz.x, 0.0, xz.y, 1.0);
+	outUV = inPatchUV;
+	outOriginSize = inOriginSize;
+	outNeighbourDeltas = inNeighbourDeltas;
+}
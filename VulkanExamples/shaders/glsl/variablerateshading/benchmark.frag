@@ -0,0 +1,42 @@
+#version 450
+
+// Procedural frame for the shading rate benchmark: a smooth sky, a band of horizontal stripes and a scrolling
+// checkerboard floor, so the classification produces every rate. The loop adds a fixed per invocation cost
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragColor;
+
+layout (push_constant) uniform PushConsts 
+{
+	float time;
+	uint iterations;
+} pushConsts;
+
+void main() 
+{
+	vec3 color;
+	if (inUV.y < 0.4)
+	{
+		color = mix(vec3(0.25, 0.45, 0.8), vec3(0.7, 0.8, 0.95), inUV.y / 0.4);
+	}
+	else if (inUV.y < 0.55)
+	{
+		float stripe = step(0.5, fract(inUV.y * 120.0));
+		color = mix(vec3(0.3, 0.25, 0.2), vec3(0.8, 0.7, 0.5), stripe);
+	}
+	else
+	{
+		float depth = 1.0 / (inUV.y - 0.5);
+		vec2 floorUV = vec2((inUV.x - 0.5) * depth * 4.0, depth + pushConsts.time);
+		float checker = mod(floor(floorUV.x * 8.0) + floor(floorUV.y * 8.0), 2.0);
+		color = mix(vec3(0.1), vec3(0.9), checker);
+	}
+
+	float shading = 0.0;
+	for (uint i = 0; i < pushConsts.iterations; i++)
+	{
+		shading += sin(inUV.x * float(i) + pushConsts.time) * cos(inUV.y * float(i));
+	}
+	outFragColor = vec4(color + shading * 1e-4, 1.0);
+}
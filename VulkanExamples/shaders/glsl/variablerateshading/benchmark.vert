@@ -0,0 +1,11 @@
+#version 450
+
+// Full screen triangle for the shading rate benchmark, no vertex input
+
+layout (location = 0) out vec2 outUV;
+
+void main() 
+{
+	outUV = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+	gl_Position = vec4(outUV * 2.0 - 1.0, 0.0, 1.0);
+}